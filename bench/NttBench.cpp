@@ -0,0 +1,266 @@
+// bench/NttBench.cpp
+// Kernel-level microbenchmark: times every NTT stage, pointwise product,
+// carry variant and copy of the legacy engine, and the kernels behind the
+// marin square / multiply / copy, over a sweep of transform sizes.
+// Built by `make bench` (CMake: `cmake --build . --target prmers-bench`).
+//
+//   prmers-bench [-d <device>] [-p <p1,p2,...>] [-iters <k>] [-kernelpath <prmers.cl>]
+//                [-legacy | -marin] [-csv] [-roofline]
+//
+// Legacy timings come from the profiling queue (opencl::Profiler, p50 of
+// the launches), marin ones from its synchronous profiling mode. GB/s
+// counts one read and one write of the n-word register per launch.
+// -roofline times whole squarings instead and sets their traffic and
+// modular products against the peaks of the device (core::Roofline), the
+// scaling curve of both backends with -csv.
+#include "opencl/Context.hpp"
+#include "opencl/Buffers.hpp"
+#include "opencl/Program.hpp"
+#include "opencl/Kernels.hpp"
+#include "opencl/NttEngine.hpp"
+#include "math/Precompute.hpp"
+#include "math/Carry.hpp"
+#include "marin/engine.h"
+#include "core/Roofline.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef KERNEL_PATH
+#define KERNEL_PATH ""
+#endif
+
+namespace {
+
+struct Options {
+    int device = 0;
+    std::vector<uint32_t> exponents = { 9941u, 44497u, 132049u, 756839u, 3021377u, 13466917u, 37156667u, 82589933u, 136279841u };
+    uint32_t iters = 200;
+    std::string kernelPath;
+    bool legacy = true, marin = true, csv = false, roofline = false;
+};
+
+struct Row {
+    std::string phase, kernel;
+    uint64_t count;
+    double ns;          // per launch
+};
+
+void usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [-d <device>] [-p <p1,p2,...>] [-iters <k>] [-kernelpath <prmers.cl>]"
+                 " [-legacy | -marin] [-csv] [-roofline]" << std::endl;
+}
+
+bool parse(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) o.device = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-iters") == 0 && i + 1 < argc) o.iters = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "-kernelpath") == 0 && i + 1 < argc) o.kernelPath = argv[++i];
+        else if (std::strcmp(argv[i], "-legacy") == 0) { o.legacy = true; o.marin = false; }
+        else if (std::strcmp(argv[i], "-marin") == 0) { o.legacy = false; o.marin = true; }
+        else if (std::strcmp(argv[i], "-csv") == 0) o.csv = true;
+        else if (std::strcmp(argv[i], "-roofline") == 0) o.roofline = true;
+        else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            o.exponents.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ','))
+                if (!item.empty()) o.exponents.push_back(static_cast<uint32_t>(std::strtoul(item.c_str(), nullptr, 10)));
+        }
+        else { usage(argv[0]); return false; }
+    }
+    if (o.iters == 0) o.iters = 1;
+    if (o.legacy && o.kernelPath.empty()) {
+        for (const std::string& cand : { std::string("kernels/prmers.cl"), std::string(KERNEL_PATH) + "prmers.cl" })
+            if (std::filesystem::exists(cand)) { o.kernelPath = cand; break; }
+        if (o.kernelPath.empty()) {
+            std::cerr << "Error: Cannot find kernel file 'prmers.cl', use -kernelpath" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void print(const Options& o, const char* backend, uint32_t p, uint32_t n, const std::vector<Row>& rows) {
+    const double bytes = 2.0 * sizeof(uint64_t) * n;
+    for (const auto& r : rows) {
+        const double perElem = r.ns / n, gbps = (r.ns > 0.0) ? bytes / r.ns : 0.0;
+        if (o.csv) {
+            std::cout << backend << ',' << p << ',' << n << ',' << r.phase << ',' << r.kernel << ','
+                      << r.count << ',' << std::fixed << std::setprecision(1) << r.ns << ','
+                      << std::setprecision(4) << perElem << ',' << std::setprecision(2) << gbps << '\n';
+        } else {
+            std::cout << "  " << std::left << std::setw(10) << r.phase << std::setw(60) << r.kernel << std::right
+                      << std::setw(9) << r.count << std::fixed << std::setprecision(1) << std::setw(13) << r.ns
+                      << std::setprecision(4) << std::setw(10) << perElem
+                      << std::setprecision(1) << std::setw(9) << gbps << '\n';
+        }
+    }
+    std::cout << std::flush;
+}
+
+void header(const Options& o, const char* backend, uint32_t p, uint32_t n) {
+    if (o.csv) return;
+    std::cout << "\n" << backend << " p=" << p << " N=" << n << "\n  "
+              << std::left << std::setw(10) << "phase" << std::setw(60) << "kernel" << std::right
+              << std::setw(9) << "calls" << std::setw(13) << "ns/launch" << std::setw(10) << "ns/elem"
+              << std::setw(9) << "GB/s" << '\n';
+}
+
+double elapsedUs(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// With roof, only whole squarings: their wall time, launches and traffic.
+void benchLegacy(const Options& o, uint32_t p, std::vector<core::Roofline::Row>* roof = nullptr) {
+    opencl::Context ctx(o.device, 0, false, false, false, /*profiling*/ true);
+    math::Precompute pre(p);
+    const uint32_t n = pre.getN();
+    const size_t bytes = size_t(n) * sizeof(uint64_t);
+    ctx.computeOptimalSizes(n, pre.getDigitWidth(), p);
+
+    opencl::Buffers buffers(ctx, pre);
+    std::vector<uint64_t> x(n, 0);
+    x[0] = 3;
+    buffers.input = opencl::Buffers::createBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, x.data(), "input");
+    buffers.save  = opencl::Buffers::createBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, x.data(), "save");
+    buffers.r2    = opencl::Buffers::createBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, x.data(), "r2");
+
+    opencl::Program program(ctx, ctx.getDevice(), o.kernelPath, pre, "", false, "");
+    opencl::Kernels kernels(program.getProgram(), ctx.getQueue());
+    kernels.createEngineKernels();
+    opencl::NttEngine ntt(ctx, kernels, buffers, pre, false, false);
+    math::Carry carry(ctx, ctx.getQueue(), program.getProgram(), n, pre.getDigitWidth());
+    opencl::Profiler& prof = *ctx.getProfiler();
+
+    cl_mem a = buffers.input, b = buffers.save, c = buffers.r2;
+    auto copy = [&]() {
+        cl_event evt = nullptr;
+        if (clEnqueueCopyBuffer(ctx.getQueue(), b, c, 0, 0, bytes, 0, nullptr, &evt) == CL_SUCCESS)
+            prof.record("copy (clEnqueueCopyBuffer)", evt, 2 * bytes);
+    };
+    if (roof) {
+        for (uint32_t i = 0; i < 8; ++i) ntt.squareIteration(a, carry, 0);
+        clFinish(ctx.getQueue());
+        prof.reset();
+        const auto t0 = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < o.iters; ++i) ntt.squareIteration(a, carry, i);
+        clFinish(ctx.getQueue());
+        const double us = elapsedUs(t0) / o.iters;
+        double launches = 0, traffic = 0;
+        for (const auto& s : prof.summary()) {
+            launches += double(s.count);
+            traffic += double(s.count) * double(s.bytes);
+        }
+        roof->push_back({ "legacy", p, n, launches / o.iters, traffic / o.iters, us });
+        return;
+    }
+
+    const std::pair<const char*, std::function<void()>> phases[] = {
+        { "forward",   [&] { ntt.forward_simple(b, 0); } },
+        { "inverse",   [&] { ntt.inverse_simple(b, 0); } },
+        { "pointwise", [&] { ntt.pointwiseMul(b, c); } },
+        { "carry",     [&] { carry.carryGPU(b, buffers.blockCarryBuf, bytes); } },
+        { "carry_mul", [&] { carry.carryGPU3(b, buffers.blockCarryBuf, bytes);
+                             carry.carryGPU_mul_base(b, buffers.blockCarryBuf, bytes); } },
+        { "copy",      copy },
+        { "square",    [&] { ntt.squareIteration(a, carry, 0); } },
+    };
+
+    header(o, "legacy", p, n);
+    for (const auto& [phase, body] : phases) {
+        for (uint32_t i = 0; i < 8; ++i) body();    // warm-up
+        prof.reset();
+        for (uint32_t i = 0; i < o.iters; ++i) body();
+        std::vector<Row> rows;
+        for (const auto& s : prof.summary()) rows.push_back({ phase, s.name, s.count, s.p50Ns });
+        print(o, "legacy", p, n, rows);
+    }
+}
+
+void benchMarin(const Options& o, uint32_t p, std::vector<core::Roofline::Row>* roof = nullptr) {
+    engine* eng = engine::create_gpu(p, 3, static_cast<size_t>(o.device), false, 4);
+    const uint32_t n = static_cast<uint32_t>(eng->get_size());
+    const engine::Reg R0 = 0, R1 = 1, R2 = 2;
+    eng->set(R0, 3);
+    eng->set(R1, 3);
+
+    if (roof) {
+        // timed on the fast queue, counted on the profiling one; res64 waits for the queue
+        for (uint32_t i = 0; i < 8; ++i) eng->square_mul(R0);
+        (void)eng->res64(R0);
+        const auto t0 = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < o.iters; ++i) eng->square_mul(R0);
+        (void)eng->res64(R0);
+        const double us = elapsedUs(t0) / o.iters;
+        eng->set_profiling(true);
+        for (uint32_t i = 0; i < 16; ++i) eng->square_mul(R0);
+        uint64_t launches = 0;
+        for (const auto& k : eng->get_profiles()) launches += k.count;
+        eng->set_profiling(false);
+        const double passes = double(launches) / 16;
+        roof->push_back({ "marin", p, n, passes, passes * 2.0 * sizeof(uint64_t) * n, us });
+        delete eng;
+        return;
+    }
+
+    const std::pair<const char*, std::function<void()>> phases[] = {
+        { "square", [&] { eng->square_mul(R0); } },
+        { "mul",    [&] { eng->set_multiplicand(R1, R0); eng->mul(R0, R1); } },
+        { "copy",   [&] { eng->copy(R2, R0); } },
+    };
+
+    header(o, "marin", p, n);
+    for (const auto& [phase, body] : phases) {
+        for (uint32_t i = 0; i < 8; ++i) body();
+        eng->set_profiling(true);
+        for (uint32_t i = 0; i < o.iters; ++i) body();
+        std::vector<Row> rows;
+        for (const auto& k : eng->get_profiles())
+            rows.push_back({ phase, k.name, k.count, double(k.time) / double(k.count) });
+        eng->set_profiling(false);
+        print(o, "marin", p, n, rows);
+    }
+    delete eng;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options o;
+    if (!parse(argc, argv, o)) return 1;
+    if (o.csv && !o.roofline) std::cout << "backend,exponent,n,phase,kernel,calls,ns_per_launch,ns_per_elem,gbps\n";
+
+    core::Roofline::Peaks peaks;
+    std::string device;
+    std::vector<core::Roofline::Row> roof;
+    if (o.roofline) {
+        opencl::Context ctx(o.device);
+        peaks = core::Roofline::measure(ctx.getContext(), ctx.getDevice(), ctx.getQueue());
+        device = ctx.getDeviceName();
+    }
+
+    int rc = 0;
+    for (uint32_t p : o.exponents) {
+        try {
+            if (o.legacy) benchLegacy(o, p, o.roofline ? &roof : nullptr);
+            if (o.marin)  benchMarin(o, p, o.roofline ? &roof : nullptr);
+        } catch (const std::exception& e) {
+            std::cerr << "p=" << p << ": " << e.what() << std::endl;
+            rc = 1;
+        }
+    }
+    if (o.roofline) {
+        if (o.csv) core::Roofline::writeCsv(std::cout, device, peaks, roof);
+        else       core::Roofline::print(std::cout, peaks, roof);
+    }
+    return rc;
+}
@@ -0,0 +1,27 @@
+# cmake/spirv.cmake - builds <key>.spv for each <key>.cl of SPIRV_DIR
+# (see the spirv target of CMakeList.txt)
+if (NOT CLANG OR NOT LLVM_SPIRV)
+  message(FATAL_ERROR "spirv needs clang and llvm-spirv")
+endif()
+file(MAKE_DIRECTORY ${SPIRV_DIR})
+file(GLOB requests ${SPIRV_DIR}/*.cl)
+foreach(cl ${requests})
+  string(REGEX REPLACE "\\.cl$" "" base ${cl})
+  if (EXISTS ${base}.spv OR NOT EXISTS ${base}.opts)
+    continue()
+  endif()
+  # only the -D and -cl-std of the driver options concern clang
+  file(READ ${base}.opts opts)
+  string(REGEX MATCHALL "-D[^ \n]*|-cl-std=[^ \n]*" flags "${opts}")
+  execute_process(
+    COMMAND ${CLANG} -x cl -cl-std=CL1.2 -target spir64 -O3 -emit-llvm
+            -Xclang -finclude-default-header ${flags} -c ${cl} -o ${base}.bc
+    RESULT_VARIABLE rc)
+  if (rc EQUAL 0)
+    execute_process(COMMAND ${LLVM_SPIRV} ${base}.bc -o ${base}.spv RESULT_VARIABLE rc)
+  endif()
+  file(REMOVE ${base}.bc)
+  if (NOT rc EQUAL 0)
+    message(WARNING "cannot build SPIR-V of ${cl}")
+  endif()
+endforeach()
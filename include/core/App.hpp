@@ -17,9 +17,14 @@
 #include "core/ProofManager.hpp"
 #include "core/ProofManagerMarin.hpp"
 #include "core/Logger.hpp"
+#include "core/GpuShare.hpp"
+#include "core/PlanDb.hpp"
+#include "core/PowerMeter.hpp"
+#include "core/Session.hpp"
 #include "util/Timer.hpp"
 #include "io/JsonBuilder.hpp"
 #include "io/CurlClient.hpp"
+#include <functional>
 #include <memory>
 #include <optional>
 #include <atomic>
@@ -38,22 +43,50 @@ namespace core {
 /// Top-level application driver.
 class App {
 public:
-    App(int argc, char** argv);
+    // `session` carries the OpenCL context and the prefetched tables of the
+    // next entry across the jobs of a worktodo file.
+    App(int argc, char** argv, Session& session);
     int runPrpOrLl();
     int runPrpOrLlMarin();
     int runPM1();
-    int runPM1Stage2();
+    // Stops early, without its gcd, once `stop` returns true.
+    int runPM1Stage2(const std::function<bool()>& stop = {});
+    int runPM1Marin();
     int run();
     void tuneIterforce();
-    double measureIps(uint64_t testIterforce, uint64_t testIters);
+    // With joulesPerIter, also the board energy per iteration (0 without a
+    // power meter).
+    double measureIps(uint64_t testIterforce, uint64_t testIters, double* joulesPerIter = nullptr);
     int runGpuBenchmarkMarin();
+    // -burnin: Gerbicz-Li checked iterations for a while; 1 when a check failed.
+    int runBurnIn();
+    int runPlanTune();
+    int runPlanTuneMarin();
+    // True once a finished worktodo entry left another one to run.
+    bool hasNextJob() const noexcept { return nextJob_; }
+    // What SIGINT does: the running test writes its checkpoint and returns.
+    // The flag stays set until cleared, so it also stops the next App.
+    static void requestStop(bool stop = true) noexcept;
+    static bool stopRequested() noexcept;
 private:
+  void buildNttResources();
+  void advanceWorktodo();
+  void prefetchNextJob();
+  void queueSubmission(const std::string& json);
+  std::optional<int> runTrialFactor();
+  std::optional<int> reportCachedResult();
+  // The power meter of the device, opened on first use; null without one.
+  PowerMeter* powerMeter();
+  // What -tuneenergy maximizes: iterations per joule, else per second.
+  double tuneScore(double ips, double joulesPerIter) const;
+  Session&                           session_;
   int    argc_;
   char** argv_;
   std::unique_ptr<io::WorktodoParser> worktodoParser_;
   bool hasWorktodoEntry_{false};
+  bool nextJob_{false};
   io::CliOptions                     options;
-  opencl::Context                    context;
+  opencl::Context&                   context;
   math::Precompute                   precompute;
   std::optional<opencl::Program>     program;
   std::optional<opencl::Buffers>     buffers;
@@ -67,6 +100,9 @@ private:
   util::Timer                        timer;
   util::Timer                        timer2;
   double                             elapsed;
+  std::unique_ptr<PowerMeter>        powerMeter_;
+  bool                               powerProbed_{false};
+  std::unique_ptr<GpuShare>          gpuShare_;         // -gpushare: the turns on the device
 };
 
 mpz_class buildE(uint64_t B1);
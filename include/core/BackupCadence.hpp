@@ -0,0 +1,50 @@
+// include/core/BackupCadence.hpp
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace core {
+
+// Seconds between two checkpoints. A checkpoint costs C seconds, a crash
+// loses the work since the last one; with M the mean time between crashes
+// of the node, T = sqrt(2 C M) (1 + sqrt(C / 2M) / 3 + C / 18M) - C has the
+// least expected cost (Daly's higher-order form of Young's formula). C is
+// the measured duration of the checkpoints (Metrics::checkpointCost), from
+// their size at kPriorBandwidth until one is written. M is learned per node:
+//   { "nodes": [ { "node": ..., "seconds": ..., "crashes": ..., "open": ... }, ... ] }
+// in a small JSON file, starting from one crash per kPriorSeconds. A run
+// counts itself as open until it is destroyed; a run that was still open
+// when the next one starts ended without its destructor and is a crash. A
+// stop on a signal writes its checkpoint and is not one.
+class BackupCadence {
+public:
+    // `fixed` is -t: the interval stays as given. `cap` is -tmax.
+    BackupCadence(std::string path, std::string node, double fixed, double cap, uint64_t checkpointBytes);
+    ~BackupCadence();
+
+    BackupCadence(const BackupCadence&) = delete;
+    BackupCadence& operator=(const BackupCadence&) = delete;
+
+    // The interval for the checkpoint cost measured so far, also published
+    // as a metric.
+    double interval() const;
+
+    // Adds the run time since the last call to the file; called after each
+    // checkpoint. A failure is a warning.
+    bool save();
+
+private:
+    static constexpr double kPriorSeconds   = 86400.0;
+    static constexpr double kPriorBandwidth = 100e6;    // bytes per second
+    static constexpr double kMinInterval    = 30.0;
+
+    std::string path_, node_;
+    double fixed_, cap_, priorCost_;
+    double seconds_ = 0, crashes_ = 0;    // from the file
+    std::chrono::steady_clock::time_point last_;
+
+    bool update(int open, bool counted);
+};
+
+} // namespace core
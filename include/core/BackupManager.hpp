@@ -9,25 +9,38 @@
 #include <CL/cl.h>
 #endif
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <gmpxx.h>
+#include "io/CheckpointFile.hpp"
+#include "opencl/Staging.hpp"
 
 namespace core {
 
 class BackupManager {
 public:
+    // The sync reads and writes on `queue` go through `staging`; the reads
+    // of the async snapshots go on `transferQueue` (`queue` when null), so
+    // they overlap the kernels queued after them.
     BackupManager(cl_command_queue queue,
+                  opencl::Staging& staging,
                   unsigned interval,
                   size_t vectorSize,
+                  const std::vector<int>& digitWidth,
                   const std::string& savePath,
                   unsigned exponent,
                   const std::string& mode,
                   const uint64_t b1,
                   const uint64_t b2,
                   bool wagstaff,
-                  bool marin
+                  bool marin,
+                  cl_command_queue transferQueue = nullptr
                   );
+    ~BackupManager();
 
     // read existing .loop/.mers into x; return resume iteration
     uint64_t loadState(std::vector<uint64_t>& x);
@@ -37,17 +50,43 @@ public:
     uint64_t loadGerbiczIterSave();
     uint64_t loadGerbiczJSave();
     
+    // Stage 2 state: all primes below the returned / given bound are folded into Q.
+    // Saved as one .s2.ckpt container; the .hq/.q/.loop2 files of older
+    // runs are still read.
     uint64_t loadStatePM1S2(cl_mem hqBuf, cl_mem qBuf, size_t bytes);
-    void     saveStatePM1S2(cl_mem hqBuf, cl_mem qBuf, uint64_t idx, size_t bytes);
+    void     saveStatePM1S2(cl_mem hqBuf, cl_mem qBuf, uint64_t nextP, size_t bytes);
+    void     saveStatePM1S2Async(cl_mem hqBuf, cl_mem qBuf, uint64_t nextP, size_t bytes);
     // read back from device and write .mers/.loop files at iteration iter
     void saveState(cl_mem buffer, uint64_t iter, const mpz_class* E_ptr = nullptr);
     void saveGerbiczLiState(cl_mem correctbuffer,cl_mem bufferd,cl_mem last_correctbufferd, uint64_t itersave, uint64_t jsave, const mpz_class* E_ptr = nullptr);
+
+    // PRP state and Gerbicz-Li buffers in one .ckpt container; loadState and
+    // the Gerbicz-Li loaders prefer it over the per-buffer files.
+    void saveCheckpoint(cl_mem buffer, uint64_t iter,
+                        cl_mem correctbuffer, cl_mem bufferd, cl_mem last_correctbufferd,
+                        uint64_t itersave, uint64_t jsave);
+
+    // Asynchronous variants: the buffers are copied on the device and read
+    // back without blocking into pinned memory; the files are then written
+    // and synced on a background thread while iterations go on. One
+    // checkpoint is in flight at a time, a new one waits for the previous.
+    void saveStateAsync(cl_mem buffer, uint64_t iter);
+    void saveCheckpointAsync(cl_mem buffer, uint64_t iter,
+                             cl_mem correctbuffer, cl_mem bufferd, cl_mem last_correctbufferd,
+                             uint64_t itersave, uint64_t jsave);
+    // Waits for the in-flight checkpoint, if any (also done by every
+    // synchronous save, so the newest state always lands last).
+    void flush();
     
     mpz_class loadExponent() const;
 
     void clearState() const;
+    // Once stage 2 is done: waits for its queued checkpoint and removes it.
+    void clearStatePM1S2();
 private:
     cl_command_queue queue_;
+    cl_command_queue transferQueue_;
+    opencl::Staging& staging_;
     unsigned         backupInterval_;
     size_t           vectorSize_;
     std::string      savePath_;
@@ -65,7 +104,40 @@ private:
     uint64_t b2_;
     bool             wagstaff_;
     bool             marin_;
-    std::string hqFilename_, qFilename_, loop2Filename_;
+    std::string hqFilename_, qFilename_, loop2Filename_, s2CkptFilename_;
+
+    static constexpr int kAsyncSlots = 4;
+    cl_mem      asyncSnap_[kAsyncSlots]   = {};
+    cl_mem      asyncPinned_[kAsyncSlots] = {};   // null on unified memory
+    void*       asyncHost_[kAsyncSlots]   = {};
+    std::thread asyncWriter_;
+    // Snapshots the buffers and runs write(host copies) on the writer
+    // thread; false when the snapshot buffers cannot be allocated.
+    bool startAsync(const std::vector<cl_mem>& buffers,
+                    std::function<void(const std::vector<const void*>&)> write);
+    // startAsync on unified memory: the snapshots are mapped, not read back.
+    bool startAsyncMapped(cl_context ctx, const std::vector<cl_mem>& buffers,
+                          std::function<void(const std::vector<const void*>&)> write);
+
+    std::string ckptFilename_;
+    io::CheckpointHeader ckptHeader_;
+    std::map<uint32_t, std::vector<uint8_t>> ckptSections_;
+    bool ckptLoaded_ = false;
+    io::CheckpointHeader makeCheckpointHeader(uint64_t iter, uint64_t itersave, uint64_t jsave) const;
+    static std::vector<uint32_t> checkpointSections(const cl_mem (&src)[4], std::vector<cl_mem>& present);
+    void writeCheckpointFrom(const std::vector<const void*>& host, const std::vector<uint32_t>& tags,
+                             const io::CheckpointHeader& header) const;
+    bool loadCheckpointSection(uint32_t tag, std::vector<uint64_t>& x, const char* what) const;
+    void writeStage2From(const std::vector<const void*>& host, uint64_t nextP) const;
+
+    // Container sections hold the residue as packedBits_ bits in 32-bit
+    // words rather than vectorSize_ 64-bit limbs.
+    std::vector<int> digitWidth_;
+    uint32_t         packedBits_ = 0;
+    std::vector<uint32_t> packResidue(const uint64_t* limbs) const;
+    // A section back to limbs: packed, or raw limbs from older files.
+    bool unpackResidue(const std::vector<uint8_t>& data, std::vector<uint64_t>& x) const;
+    void releaseAsync();
 
 };
 
@@ -0,0 +1,58 @@
+// include/core/BenchReport.hpp
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace core {
+
+struct BenchDevice {
+    std::string vendor = "Unknown";
+    std::string name   = "Unknown";
+    std::string driver = "Unknown";
+    std::string fp64   = "Unknown";
+    uint32_t    compute_units = 0;
+    uint64_t    vram = 0;              // bytes
+    uint64_t    local_mem = 0;         // bytes
+};
+
+struct BenchResult {
+    uint32_t exponent  = 0;
+    uint32_t transform = 0;
+    double   ips = 0.0;
+    double   us_per_iter = 0.0;
+    double   gbps = 0.0;               // see BenchReport::bandwidthGBps
+    double   joules_per_iter = 0.0;    // board energy, 0 when it cannot be read
+};
+
+// Machine-readable output of -bench and the regression check against a
+// previous run. The JSON file is
+//   { "device": { ... }, "score": ..., "results": [ { "exponent": ..., ... }, ... ] }
+// and the CSV file has one row per exponent with the device columns
+// repeated, so files from several hosts can simply be concatenated.
+class BenchReport {
+public:
+    // Effective bandwidth of one squaring: the n-word register is counted
+    // as read and written once by each of the forward NTT, the inverse NTT
+    // and the carry, whatever the number of stages. It is a lower bound on
+    // the real traffic, but it is comparable across runs and drivers.
+    static double bandwidthGBps(uint32_t n, double usPerIter);
+
+    static bool writeJson(const std::string& path, const BenchDevice& dev,
+                          const std::vector<BenchResult>& rows, double score);
+    static bool writeCsv(const std::string& path, const BenchDevice& dev,
+                         const std::vector<BenchResult>& rows);
+
+    // Reads either format back (CSV when the path ends in .csv).
+    static std::optional<std::vector<BenchResult>> load(const std::string& path);
+
+    // Prints one line per exponent present in both runs and returns how many
+    // got slower by more than thresholdPct percent (in µs/iter).
+    static size_t compare(const std::vector<BenchResult>& baseline,
+                          const std::vector<BenchResult>& current,
+                          double thresholdPct, std::ostream& os);
+};
+
+} // namespace core
@@ -0,0 +1,44 @@
+// include/core/CheckCadence.hpp
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace core {
+
+// How many Gerbicz-Li blocks of B iterations go between two verifications.
+// A verification costs about B squarings, a failed one rolls the run back
+// to the previous verified state, so with a failure rate lambda (per second
+// of squaring) the interval T = sqrt(2 B / ips / lambda) has the least
+// expected cost (Young's formula). lambda is learned per device:
+//   { "devices": [ { "device": ..., "seconds": ..., "failures": ... }, ... ] }
+// in a small JSON file, starting from one failure per kPriorSeconds. Within
+// a run a failure halves the interval and each verification that passes
+// lets it grow back.
+class CheckCadence {
+public:
+    // `fixed` is -checklevel: the level stays as given, the rate is still
+    // recorded.
+    CheckCadence(std::string path, std::string device, uint64_t B, uint64_t fixed = 0);
+
+    // The checkpasslevel at `ips` iterations per second, at least 1.
+    uint64_t level(double ips) const;
+
+    // A verification covering `seconds` of squaring since the previous one.
+    void passed(double seconds);
+    void failed(double seconds);
+
+    // Adds what this run has seen to the file; a failure is a warning.
+    bool save();
+
+private:
+    static constexpr double kPriorSeconds = 86400.0;
+    static constexpr double kMaxInterval  = 4 * 3600.0;
+
+    std::string path_, device_;
+    uint64_t B_, fixed_;
+    double seconds_ = 0, failures_ = 0;          // from the file
+    double newSeconds_ = 0, newFailures_ = 0;    // not saved yet
+    double scale_ = 1;
+};
+
+} // namespace core
@@ -0,0 +1,26 @@
+// include/core/Daemon.hpp
+#pragma once
+#include <optional>
+
+namespace core {
+
+// --daemon: one long-lived process for a scheduler. It keeps its Session,
+// hence the OpenCL context, between entries and takes its work from a Unix
+// socket (-socket, default <save path>/prmers.sock). Each connection
+// sends one JSON object per line and gets one JSON line back per request:
+//
+//   {"cmd":"assign","line":"PRP=..."}  appends the entry to the worktodo file
+//   {"cmd":"status"}                   state, current exponent and iteration
+//   {"cmd":"preempt"}                  checkpoints the running entry and hands
+//                                      its line back, then takes the next one
+//   {"cmd":"stop"}                     checkpoints and exits, keeping the entry
+//
+// Entries are claimed from the worktodo file into <worktodo>.daemon and run
+// by an App there, so a restarted daemon resumes the one it was running.
+class Daemon {
+public:
+    // The exit code when argv asks for --daemon, nothing otherwise.
+    static std::optional<int> run(int argc, char** argv);
+};
+
+} // namespace core
@@ -0,0 +1,60 @@
+// include/core/GpuShare.hpp
+#pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace core {
+
+// Cooperative sharing of one GPU between PrMers jobs (-gpushare), in one
+// process or several: a large PRP and a stream of small double-checks on
+// the same device take turns instead of queueing kernels against each
+// other. The turn is a token kept in a small table file of kSlots entries,
+// read and written under flock(), so that a job that dies gives up its
+// slot and the token with its lock. A job holds the token for at most
+// kSliceMs * weight of iterations, then drains its queue and passes it to
+// the waiting job that has had the least device time per unit of weight.
+// With slices proportional to the weights the turns simply alternate, and
+// a small job waits at most one slice of each other job; a job alone keeps
+// the token and never drains.
+class GpuShare {
+public:
+    // The share of `weight` through the table at `path`; nothing when the
+    // weight is 0 or the table cannot be used (a warning).
+    static std::unique_ptr<GpuShare> open(const std::string& path, double weight);
+    // The default table of a device, in the temporary directory.
+    static std::string defaultPath(int device);
+
+    ~GpuShare();
+    GpuShare(const GpuShare&) = delete;
+    GpuShare& operator=(const GpuShare&) = delete;
+
+    // Between two batches of iterations: takes the token on the first call;
+    // once the slice is over and another job waits, runs `drain` (all the
+    // queued work done), passes the token on and waits for the next turn.
+    void yield(const std::function<void()>& drain);
+    // Gives the token up, when the iterations are over.
+    void release();
+
+    // Seconds this job has waited for the token.
+    double waited() const noexcept { return waited_; }
+
+private:
+    static constexpr int    kSlots   = 16;
+    static constexpr double kSliceMs = 25.0;
+    static constexpr int    kPollUs  = 500;
+
+    GpuShare(int fd, int slot, double weight);
+    void acquire();
+    double sinceTurn() const;
+
+    int    fd_;
+    int    slot_;
+    double weight_;
+    bool   holding_ = false;
+    double waited_  = 0;
+    std::chrono::steady_clock::time_point turn_{};
+};
+
+} // namespace core
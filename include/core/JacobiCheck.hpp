@@ -0,0 +1,69 @@
+// include/core/JacobiCheck.hpp
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+// The Jacobi check of an LL run: with s_0 = 4 and s_{k+1} = s_k^2 - 2,
+// (s_k - 2 | 2^p - 1) is -1 for every k >= 1 (and +1 at k = 0), so a
+// residue that gives +1 has gone wrong since the last one that passed. Half
+// the errors are caught, against none without a check. The symbol is
+// computed on a thread of its own, one residue at a time, while the
+// iterations go on; the caller polls for the outcome and rolls back. The
+// destructor waits for a symbol in flight: the stop paths save their
+// checkpoint first, so a preempted run loses nothing to the wait.
+class JacobiCheck {
+public:
+    struct Result {
+        uint64_t iter;   // number of iterations done at the residue
+        bool     ok;
+    };
+
+    // widths: the digit widths of submitDigits, empty if only submit is used.
+    JacobiCheck(uint32_t exponent, std::vector<int> widths = {});
+    ~JacobiCheck();
+
+    JacobiCheck(const JacobiCheck&) = delete;
+    JacobiCheck& operator=(const JacobiCheck&) = delete;
+
+    // s_iter as E bits in 32-bit words, least significant first.
+    void submit(uint64_t iter, std::vector<uint32_t> words);
+    // s_iter as IBDWT digits, packed on the worker.
+    void submitDigits(uint64_t iter, std::vector<uint64_t> digits);
+
+    // A residue was submitted and its result is not collected yet.
+    bool busy() const;
+    // The result of the submitted residue once it is known; wait() blocks
+    // until then, both return nothing when no residue is submitted.
+    std::optional<Result> poll();
+    std::optional<Result> wait();
+
+    // (x - 2 | 2^E - 1), x being E bits in 32-bit words.
+    static int symbol(const std::vector<uint32_t>& words, uint32_t exponent);
+    static bool expected(uint64_t iter, int symbol) { return symbol == (iter == 0 ? 1 : -1); }
+
+private:
+    uint32_t                 exponent_;
+    std::vector<int>         widths_;
+
+    mutable std::mutex       mutex_;
+    std::condition_variable  cv_;
+    bool                     pending_ = false;   // submitted, not collected
+    bool                     queued_ = false;    // submitted, not picked up by the worker
+    bool                     done_ = false;
+    bool                     stop_ = false;
+    uint64_t                 iter_ = 0;
+    std::vector<uint32_t>    words_;
+    std::vector<uint64_t>    digits_;
+    Result                   result_{0, true};
+    std::thread              worker_;
+
+    void workerLoop();
+};
+
+} // namespace core
@@ -2,21 +2,54 @@
 #pragma once
 
 #include "io/CliParser.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <thread>
 
 
 namespace core {
 
+// logmsg formats straight into a slot of a fixed ring (a bounded MPMC queue
+// in the style of Vyukov's: a claim by CAS, then a sequence number per slot
+// publishes it) and returns; a thread of the Logger appends the slots to the
+// file in order. Nothing on the logging side locks or touches the disk,
+// except that a full ring makes the caller yield until the writer catches
+// up. flush_log waits until everything logged before it is in the file.
 class Logger {
 public:
     explicit Logger(const std::string& logFile);
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
     void logStart(const io::CliOptions& options);
     void logEnd(double elapsed);
     void logmsg(const char* fmt, ...);
     void flush_log();
 
 private:
-    std::string _logFile;
+    static constexpr size_t kSlots = 128;   // a power of two
+    static constexpr size_t kText  = 1024;
+
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        char                  text[kText];
+    };
+
+    std::string                _logFile;
+    std::unique_ptr<Slot[]>    _ring;
+    std::atomic<uint64_t>      _head{0};      // next slot to claim
+    uint64_t                   _tail = 0;     // next slot to write, writer only
+    std::atomic<uint64_t>      _written{0};   // slots in the file
+    std::atomic<uint64_t>      _wake{0};
+    std::atomic<bool>          _stop{false};
+    std::thread                _writer;
+
+    void writerLoop();
 };
 
 } // namespace core
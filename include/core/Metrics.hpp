@@ -0,0 +1,36 @@
+// include/core/Metrics.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace core {
+
+// Fleet-monitoring gauges for -metrics. The iteration loops only store
+// into relaxed atomics; a background thread rewrites the file every
+// `intervalSec` seconds in the Prometheus text exposition format, so it
+// can be picked up by node_exporter's textfile collector or any scraper
+// that reads a file. Rates and ETA are derived on that thread from the
+// iteration counter. Nothing is written until start() succeeded.
+class Metrics {
+public:
+    static bool start(const std::string& path, unsigned intervalSec = 10);
+    // Writes a last sample and joins the writer thread.
+    static void stop();
+    static bool enabled() noexcept;
+
+    static void setRun(uint64_t exponent, uint64_t totalIters, const std::string& mode);
+    static void iteration(uint64_t iter) noexcept;
+    static void queueDepth(std::size_t depth) noexcept;
+    static void gerbiczCheck(bool passed) noexcept;
+    static void checkpoint(double seconds, uint64_t bytes) noexcept;
+    // Smoothed duration of the checkpoints written so far, 0 before the first.
+    static double checkpointCost() noexcept;
+    static void backupInterval(double seconds) noexcept;
+
+    // The gauges are kept with or without -metrics, for --daemon status.
+    struct Progress { uint64_t exponent, iteration, iterations; std::string mode; };
+    static Progress progress();
+};
+
+} // namespace core
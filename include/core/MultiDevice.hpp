@@ -0,0 +1,27 @@
+// include/core/MultiDevice.hpp
+#pragma once
+#include <optional>
+
+namespace core {
+
+// -devices all|<i,j,...>: one supervisor drives several GPUs from one
+// worktodo file. Each device gets a worker thread that claims the next
+// entry into <worktodo>.d<i> (WorktodoParser::claimFirst) and runs a child
+// prmers on it with -d <i>, its log going to <save path>/device<i>.log.
+// A claimed entry stays in the device file until its child finished, so a
+// restarted supervisor resumes it from the checkpoints, which are already
+// per exponent and thus per device.
+//
+// -batch <K> runs K entries at once on the -d device, for small exponents
+// that leave most of a GPU idle: K worker threads claim entries into
+// <worktodo>.b<slot> and run each through an App in this process, every
+// slot with its own Session, hence its own queues and marin engine. Each
+// entry keeps its own Gerbicz-Li checks, checkpoints and result JSON.
+class MultiDevice {
+public:
+    // The exit code when argv asks for -devices or -batch, nothing when a
+    // single App should run.
+    static std::optional<int> run(int argc, char** argv);
+};
+
+} // namespace core
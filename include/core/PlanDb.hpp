@@ -0,0 +1,66 @@
+// include/core/PlanDb.hpp
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// Tuned NTT launch parameters for one (device, driver, transform size).
+struct NttPlan {
+    std::string device;
+    std::string driver;
+    uint32_t    n = 0;
+    int         max_local_size1 = 0;   // 0 = Context default
+    int         max_local_size5 = 0;
+    bool        twiddle_otf = false;   // stage twiddles derived in the kernels
+    bool        lazy_reduce = false;   // butterflies built with LAZY_REDUCTION
+    bool        four_step = false;     // middle stages as local-memory tile passes
+    bool        coalesced = false;     // small-stride stages on contiguous tiles
+    uint32_t    gen_tile = 0;          // generated passes on tiles of this size, 0 = off
+    double      ips = 0.0;             // measured when the plan was tuned
+    // Marin kernel geometry, tuned on the marin transform size; 0 = built-in
+    uint32_t    chunk16 = 0;
+    uint32_t    chunk64 = 0;
+    uint32_t    chunk256 = 0;
+    uint32_t    blk16 = 0;
+    uint32_t    blk64 = 0;
+    uint32_t    cwm_wg_size = 0;
+    double      marin_ips = 0.0;
+};
+
+// Small JSON file holding the plans found by -tuneplan:
+//   { "plans": [ { "device": ..., "driver": ..., "n": ..., ... }, ... ] }
+// Normal runs look their plan up and fall back to the built-in sizing
+// when there is none. The legacy and the marin tuning share a record and
+// each one only rewrites its own fields.
+class PlanDb {
+public:
+    explicit PlanDb(std::string path);
+
+    bool load();
+    bool save() const;
+
+    std::optional<NttPlan> find(const std::string& device,
+                                const std::string& driver,
+                                uint32_t n) const;
+    void put(const NttPlan& plan);
+
+    // Iterations per second of an n-word transform on this device, on the
+    // marin engine or the legacy one, from the rates stored for it: exact
+    // when n was measured, otherwise the cost per n log2(n) word is
+    // interpolated between the two nearest measured sizes. Nothing when no
+    // size within a factor of 4 of n was measured.
+    std::optional<double> predictIps(const std::string& device,
+                                     const std::string& driver,
+                                     uint32_t n, bool marin) const;
+
+    const std::string& path() const noexcept { return path_; }
+
+private:
+    std::string          path_;
+    std::vector<NttPlan> plans_;
+};
+
+} // namespace core
@@ -0,0 +1,61 @@
+// include/core/PowerMeter.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace core {
+
+// Board power of one GPU, for the iterations per joule of -tuneenergy and
+// -bench. The sources are tried in turn: NVML and ROCm SMI, both loaded at
+// run time so that neither is a build dependency, then the hwmon files of
+// the device in sysfs (amdgpu, i915, xe). The GPU is found by its PCI
+// address; without one, a source is only used when it sees a single GPU.
+// Energy comes from the counter of the source when it has one, otherwise
+// from the power sampled every kSampleMs on a thread of its own.
+class PowerMeter {
+public:
+    // The meter of `device` (a PCI address "dddd:bb:dd.f" or empty), or
+    // nothing when no source reports its power.
+    static std::unique_ptr<PowerMeter> open(const std::string& pciAddress);
+    // The PCI address of an OpenCL device, from cl_khr_pci_bus_info or the
+    // AMD and NVIDIA topology queries; empty when none answers.
+    static std::string pciAddress(cl_device_id device);
+
+    ~PowerMeter();
+    PowerMeter(const PowerMeter&) = delete;
+    PowerMeter& operator=(const PowerMeter&) = delete;
+
+    const std::string& source() const noexcept { return name_; }
+
+    // Begins a measurement; stop() returns its energy in joules, 0 when the
+    // source failed meanwhile.
+    void start();
+    double stop();
+
+    struct Source;
+
+private:
+    static constexpr int kSampleMs = 50;
+
+    explicit PowerMeter(std::unique_ptr<Source> src);
+
+    std::unique_ptr<Source> src_;
+    std::string             name_;
+    std::thread             sampler_;
+    std::atomic<bool>       sampling_{false};
+    std::atomic<double>     joules_{0.0};      // integrated by the sampler
+    std::optional<double>   counter0_;         // energy counter at start()
+};
+
+} // namespace core
@@ -4,6 +4,8 @@
 #include <vector>
 #include <filesystem>
 
+class engine;
+
 namespace core {
 
 class GpuContext;
@@ -29,8 +31,14 @@ public:
                                            const std::vector<uint32_t>& words);
     static uint64_t res64(const std::vector<uint32_t>& words);
 
+    // The challenge h of every middle, in order. They depend on B and the
+    // middles only, so a verifier takes them all before any exponentiation.
+    std::vector<uint64_t> challenges() const;
+
     // Proof verification
     bool verify(const GpuContext& gpu) const;
+    // Same, on registers 0-3 of eng (overwritten).
+    bool verify(engine& eng) const;
 };
 
 } // namespace core
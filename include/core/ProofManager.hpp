@@ -9,8 +9,14 @@
 #else
 # include <CL/cl.h>
 #endif
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "core/ProofSet.hpp"
 
 // Forward declarations
@@ -30,17 +36,80 @@ public:
     ProofManager(uint32_t exponent, int proofLevel,
                  cl_command_queue queue, uint32_t n,
                  const std::vector<int>& digitWidth,
-                 const std::vector<std::string>& knownFactors = {});
+                 const std::vector<std::string>& knownFactors = {},
+                 ResidueCodec codec = ResidueCodec::None,
+                 cl_command_queue transferQueue = nullptr);
+    ~ProofManager();
+
+    ProofManager(const ProofManager&) = delete;
+    ProofManager& operator=(const ProofManager&) = delete;
+
+    // Packs checkpoints on the device with kernel_pack_bits (one work-item
+    // per carry block): only E bits are read back, without blocking, and the
+    // point is handed to the writer thread. Called again after a rebuild.
+    // On unified memory each slot packs into buffers of its own that the
+    // writer maps, so nothing is copied. Otherwise the packed words are
+    // read on `transferQueue` (queue when null), overlapping the squarings.
+    void attachPacker(cl_kernel packKernel, size_t workersCarry, bool unifiedMemory = false);
     void checkpoint(cl_mem buf, uint32_t iter);  
     void checkpointMarin(std::vector<uint64_t> host, uint32_t iter);
-    std::filesystem::path proof(const opencl::Context& ctx, opencl::NttEngine& ntt, math::Carry& carry, bool verify=true) const;
+    // Waits until every queued point is on disk.
+    void flush();
+    // Reads back every point written so far and checks it against the CRC
+    // recorded when it was written. Bad files are removed; the iterations
+    // returned (also kept in failedPoints()) have to be recomputed.
+    std::vector<uint32_t> verifyPoints();
+    std::vector<uint32_t> failedPoints() const;
+    std::filesystem::path proof(const opencl::Context& ctx, opencl::NttEngine& ntt, math::Carry& carry, bool verify=true);
 
 private:
+    // Points are written in order by one thread; at most kMaxPending wait
+    // for it, so a slow disk stalls the iterations only when that far behind.
+    static constexpr size_t kMaxPending = 4;
+
+    struct PendingPoint {
+        uint32_t              iter;
+        cl_event              done;   // packed readback, or nullptr
+        size_t                slot;   // pinned slot holding it
+        std::vector<uint32_t> words;  // host-packed residue when done is nullptr
+    };
+
     ProofSet           proofSet_;
     cl_command_queue   queue_;
+    cl_command_queue   transferQueue_;
     uint32_t           n_;
     uint32_t           exponent_;
     std::vector<int>   digitWidth_;
+
+    cl_kernel          packKernel_ = nullptr;
+    size_t             workersCarry_ = 0;
+    cl_mem             packedWords_ = nullptr;
+    cl_mem             packedCarries_ = nullptr;
+    cl_mem             pinned_ = nullptr;
+    char*              pinnedHost_ = nullptr;
+    cl_event           lastRead_ = nullptr;   // of packedWords_, before it is packed again
+    size_t             slotBytes_ = 0;
+    bool               slotBusy_[kMaxPending] = {};
+    bool               unified_ = false;
+    cl_mem             slotWords_[kMaxPending] = {};
+    cl_mem             slotCarries_[kMaxPending] = {};
+    void*              slotMapped_[kMaxPending][2] = {};   // {carries, words}
+
+    mutable std::mutex               mutex_;
+    std::condition_variable          cv_;
+    std::deque<PendingPoint>         pending_;
+    bool                             writing_ = false;
+    bool                             stop_ = false;
+    std::thread                      writer_;
+    std::map<uint32_t, uint32_t>     written_;  // iteration -> CRC32
+    std::vector<uint32_t>            failed_;
+
+    size_t wordCount() const { return (exponent_ - 1) / 32 + 1; }
+    void releasePacker();
+    void enqueue(PendingPoint point);
+    void writerLoop();
+    std::vector<uint32_t> unpack(const uint64_t* carries, const uint32_t* packed) const;
+    void unmapSlot(size_t slot);
 };
 
 }
@@ -21,10 +21,12 @@ public:
     ProofManagerMarin(uint32_t exponent, int proofLevel,
                  cl_command_queue queue, uint32_t n,
                  const std::vector<int>& digitWidth,
-                 const std::vector<std::string>& knownFactors = {});
+                 const std::vector<std::string>& knownFactors = {},
+                 ResidueCodec codec = ResidueCodec::None);
     void checkpoint(cl_mem buf, uint32_t iter);    
     void checkpointMarin(engine::digit host, uint32_t iter);
-    std::filesystem::path proof() const;
+    // Builds the proof on eng when given (its registers are overwritten).
+    std::filesystem::path proof(engine* eng = nullptr) const;
     bool shouldCheckpoint(uint32_t iter) const;
 
 private:
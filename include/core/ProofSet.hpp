@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/Proof.hpp"
+#include "core/ResidueFile.hpp"
 #include <cstdint>
 #include <vector>
 #include <filesystem>
@@ -16,6 +17,7 @@ namespace math {
 }
 
 typedef struct _cl_mem* cl_mem;
+typedef struct _cl_event* cl_event;
 
 namespace core {
 
@@ -36,6 +38,9 @@ public:
     // GPU data transfer methods
     std::vector<uint32_t> read(cl_mem buffer) const;
     void write(cl_mem buffer, const std::vector<uint32_t>& data) const;
+    // Same, for limbs already expanded from the packed words. With done set
+    // the write does not block and limbs must outlive that event.
+    void writeLimbs(cl_mem buffer, const std::vector<uint64_t>& limbs, cl_event* done) const;
 };
 
 class Words {
@@ -58,10 +63,13 @@ public:
     const uint32_t power; // proof power level
     const std::vector<std::string> knownFactors; // known factors (for cofactor tests)
 
-    ProofSet(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors = {});
+    // Residue files are written with `codec`; both kinds are read.
+    ProofSet(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors = {},
+             ResidueCodec codec = ResidueCodec::None);
 
     bool shouldCheckpoint(uint32_t iter) const;
-    void save(uint32_t iter, const std::vector<uint32_t>& words);
+    // Returns the CRC32 stored in front of the words.
+    uint32_t save(uint32_t iter, const std::vector<uint32_t>& words);
     std::vector<uint32_t> load(uint32_t iter) const;
 
     static Words fromUint64(const std::vector<uint64_t>& host, uint32_t exponent);
@@ -75,6 +83,7 @@ public:
 
 private:
     std::vector<uint32_t> points; // checkpoint iteration points
+    ResidueCodec codec_;
     
     bool isValidTo(uint32_t limitK) const;
     bool fileExists(uint32_t k) const;
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "core/ProofMarin.hpp"
+#include "core/ResidueFile.hpp"
 #include <cstdint>
 #include <vector>
 #include <filesystem>
 
+class engine;
+
 namespace core {
 
 class WordsMarin {
@@ -27,7 +30,9 @@ public:
     const uint32_t power; // proof power level
     const std::vector<std::string> knownFactors; // known factors (for cofactor tests)
 
-    ProofSetMarin(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors = {});
+    // Residue files are written with `codec`; both kinds are read.
+    ProofSetMarin(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors = {},
+                  ResidueCodec codec = ResidueCodec::None);
 
     bool shouldCheckpoint(uint32_t iter) const;
     void save(uint32_t iter, const std::vector<uint32_t>& words);
@@ -41,9 +46,12 @@ public:
     
     // Core proof generation algorithm
     ProofMarin computeProof() const;
+    // Same, with the exponentiations and products done in registers 0-2 of eng.
+    ProofMarin computeProof(engine& eng) const;
 
 private:
     std::vector<uint32_t> points; // checkpoint iteration points
+    ResidueCodec codec_;
     
     bool isValidTo(uint32_t limitK) const;
     bool fileExists(uint32_t k) const;
@@ -0,0 +1,33 @@
+// include/core/ResidueFile.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// On-disk form of a proof residue. The plain file is PRPLL's: the CRC32 of
+// the words, then the (E + 31) / 32 words. With a codec the file is
+//   'P' 'R' 'Z' <codec> | CRC32 of the words | compressed words
+// and is kept only when smaller than the plain file, so a file of the plain
+// size is always plain and both kinds can sit in one proof directory.
+enum class ResidueCodec : uint8_t {
+    None = 0,
+    Lz   = 1,   // LZ4-style byte-oriented LZ77, 64 KiB window
+};
+
+// "none" or "lz"; false for any other name.
+bool parseResidueCodec(const std::string& name, ResidueCodec& codec);
+
+// Writes the residue durably (see writeFileDurable); throws on failure.
+void writeResidue(const std::string& path, const std::vector<uint32_t>& words,
+                  uint32_t crc, ResidueCodec codec);
+
+// The words of a residue file of exponent E, either kind, CRC checked;
+// throws naming `path` on a short, corrupt or mismatched file.
+std::vector<uint32_t> decodeResidue(const unsigned char* data, std::size_t size,
+                                    uint32_t E, const std::string& path);
+std::vector<uint32_t> readResidue(const std::string& path, uint32_t E);
+
+} // namespace core
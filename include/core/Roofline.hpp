@@ -0,0 +1,59 @@
+// include/core/Roofline.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// Where a squaring stands against the limits of the device, per transform
+// size: the memory traffic of its passes next to the bandwidth one buffer
+// copy reaches, and its modular products next to what a chain of products
+// mod 2^64 - 2^32 + 1 reaches with no memory access at all. A size near
+// the bandwidth peak gains from fewer passes (fusion, the four-step
+// transform), one near the product peak only from fewer products.
+class Roofline {
+public:
+    struct Peaks {
+        double gbps = 0.0;             // clEnqueueCopyBuffer, read + write
+        double modmulPerSec = 0.0;     // 64-bit products mod p per second
+    };
+
+    struct Row {
+        std::string backend;           // "legacy" or "marin"
+        uint32_t exponent = 0;
+        uint32_t transform = 0;
+        double   passes = 0.0;         // kernel launches per squaring
+        double   bytes = 0.0;          // global memory traffic per squaring
+        double   us_per_iter = 0.0;
+    };
+
+    // Times a copy of up to 256 MiB and a kernel of independent product
+    // chains on `queue`, best of a few runs; a figure that cannot be
+    // measured is 0 (a warning).
+    static Peaks measure(cl_context context, cl_device_id device, cl_command_queue queue);
+
+    // Modular products of one squaring of n words: the radix-4 forward and
+    // inverse transforms (3 twiddle products per butterfly, log4 n stages
+    // each), the pointwise square and the two weightings.
+    static double modmulsPerIter(uint32_t n);
+
+    // Prints one line per row, and the peaks.
+    static void print(std::ostream& os, const Peaks& peaks, const std::vector<Row>& rows);
+    // The scaling curve as CSV: one row per backend and transform size with
+    // bytes/iter, GB/s, modmul/s, both as a share of the peaks, and which
+    // one bounds the size.
+    static void writeCsv(std::ostream& os, const std::string& device, const Peaks& peaks, const std::vector<Row>& rows);
+    static bool writeCsv(const std::string& path, const std::string& device, const Peaks& peaks, const std::vector<Row>& rows);
+};
+
+} // namespace core
@@ -0,0 +1,50 @@
+// include/core/Session.hpp
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include "io/ResultOutbox.hpp"
+#include "math/Precompute.hpp"
+#include "opencl/Context.hpp"
+
+class engine;
+
+namespace core {
+
+// What outlives one worktodo entry: the OpenCL context, created by the
+// first App and reused by the next ones, and the host tables of the next
+// entry, built on a background thread while the current one finishes.
+// The proof of a finished entry is verified on a background thread too,
+// on an engine of its own, while the next entry already runs.
+class Session {
+public:
+    ~Session();
+
+    std::unique_ptr<opencl::Context> context;
+    // Started by the first result submitted, drained when the session ends.
+    std::unique_ptr<io::ResultOutbox> outbox;
+
+    // Starts building the Precompute of `exponent`; a no-op when one is
+    // already under way.
+    void prefetch(uint64_t exponent, const std::string& cacheDir);
+    // The prefetched tables when they are for `exponent`, built now otherwise.
+    math::Precompute take(uint64_t exponent, const std::string& cacheDir);
+
+    // Loads and verifies `proofFile` on a background thread, on the engine
+    // that makeEngine builds for its exponent; a failure is a warning. The
+    // verification of the previous proof is waited for first.
+    void verifyProof(const std::filesystem::path& proofFile,
+                     std::function<engine*(uint32_t exponent)> makeEngine);
+    // Waits for the verification under way, if any.
+    void finishVerification();
+
+private:
+    uint64_t nextExponent_ = 0;
+    std::future<math::Precompute> next_;
+    std::future<void> verify_;
+};
+
+} // namespace core
@@ -2,16 +2,36 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 
 namespace core {
 
+// Progress lines are rendered by a thread of the Spinner. displayProgress
+// and displayBackupInfo only publish their values into a frame (a seqlock
+// over atomics, one writer: the compute loop) and return; the thread looks
+// at the frames every kTick and prints those that changed, so the loop never
+// formats, writes or flushes the console. The line that reaches totalIters
+// is waited for, so it comes out before whatever the caller prints next.
 class Spinner {
 public:
-    Spinner() = default;
-    ~Spinner() = default;
+    enum class Mode {
+        Console,   // the coloured progress lines
+        Quiet,     // nothing
+        Json,      // one JSON object per line, for headless workers
+    };
+    // "console", "quiet" or "json"; false for any other name.
+    static bool parseMode(const std::string& name, Mode& mode);
+
+    explicit Spinner(Mode mode = Mode::Console);
+    ~Spinner();
+
+    Spinner(const Spinner&) = delete;
+    Spinner& operator=(const Spinner&) = delete;
 
     void displayProgress(uint64_t iter,
                         uint64_t totalIters,
@@ -30,6 +50,43 @@ public:
     void displaySpinner(std::atomic<bool>& waiting,
                         double estimatedSeconds,
                         std::atomic<bool>& isFirst);
+
+private:
+    static constexpr int kTickMs = 250;
+    static constexpr size_t kRes64Words = 4;   // up to 32 characters
+
+    struct Values {
+        uint64_t iter = 0, totalIters = 0, expo = 0, resumeIter = 0;
+        double   elapsedTime = 0, elapsedTime2 = 0;
+        char     res64[kRes64Words * 8 + 1] = {};
+    };
+
+    struct Frame {
+        std::atomic<uint64_t> seq{0};     // odd while written
+        std::atomic<uint64_t> shown{0};   // seq of the last frame printed
+        std::atomic<uint64_t> iter{0}, totalIters{0}, expo{0}, resumeIter{0};
+        std::atomic<double>   elapsedTime{0}, elapsedTime2{0};
+        std::atomic<uint64_t> res64[kRes64Words] = {};
+
+        void publish(const Values& v);
+        // false when nothing new since `seen`
+        bool read(uint64_t seen, Values& v, uint64_t& version) const;
+        void waitShown() const;
+    };
+
+    Mode        mode_;
+    Frame       progress_, backup_;
+    double      smoothedIPS_ = 0.0;   // UI thread only
+    std::mutex  mutex_;               // guards stop_ for the UI thread's sleep
+    std::condition_variable cv_;
+    bool        stop_ = false;
+    std::thread ui_;
+
+    void uiLoop();
+    // Prints the frames that changed.
+    void render();
+    void printProgress(const Values& v);
+    void printBackup(const Values& v);
 };
 
 } // namespace core
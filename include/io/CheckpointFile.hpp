@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace io {
+
+// Single-file checkpoint container.
+// Layout: magic, version, a fixed header protected by its own CRC32, then
+// length-prefixed sections {tag, size, crc32, bytes}. Files are written to a
+// temporary, synced and renamed, so a reader sees either the previous or
+// the new checkpoint, never a mix.
+struct CheckpointHeader {
+    uint32_t    exponent      = 0;
+    uint32_t    transformSize = 0;   // limbs per buffer
+    uint32_t    engine        = 0;   // 0 = legacy NTT backend
+    std::string mode;                // "prp", "ll", ... (at most 8 chars)
+    uint64_t    iteration     = 0;   // next iteration to run
+    uint64_t    j             = 0;   // Gerbicz-Li jsave
+    uint64_t    itersave      = 0;   // Gerbicz-Li itersave
+};
+
+struct CheckpointSection {
+    uint32_t    tag;
+    const void* data;
+    uint64_t    size;
+};
+
+constexpr uint32_t checkpointTag(char a, char b, char c, char d) {
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+bool writeCheckpoint(const std::string& path,
+                     const CheckpointHeader& header,
+                     const std::vector<CheckpointSection>& sections);
+
+// false on a missing file, a foreign magic/version or any CRC mismatch.
+bool readCheckpoint(const std::string& path,
+                    CheckpointHeader& header,
+                    std::map<uint32_t, std::vector<uint8_t>>& sections);
+
+} // namespace io
@@ -19,8 +19,16 @@ struct CliOptions {
     bool marin = true;
     bool bench = false;
     bool profiling = false;
+    bool cpu_engine = false;                 // marin path on the host two-prime (p x M61) engine
+    unsigned cpu_threads = 0;                // threads of the host engine, 0 = one per hardware thread
+    std::string trace_path;                  // Chrome trace of host and GPU spans, empty = off
+    std::string metrics_path;                // Prometheus text metrics file, empty = off
+    unsigned metrics_interval = 10;          // seconds between two rewrites of metrics_path
+    uint64_t profile_interval = 100000;   // iterations between two kernel profile dumps, 0 = at exit only
     bool debug = false;
     bool gerbiczli = true;
+    bool hostRollback = false;               // marin: the last verified Gerbicz-Li state in pinned host memory
+    uint64_t jacobi_interval = 1000000;      // LL: iterations between two Jacobi checks, 0 = off
     uint64_t B1 = 10000;
     uint64_t B2 = 0;
     uint64_t checklevel = 0;
@@ -28,10 +36,14 @@ struct CliOptions {
     uint64_t erroriter = 0;
     bool proof = true;
     bool submit = false;
+    bool skipDone = false;                   // report the cached result of an entry already done instead of running it
+    bool crossCheck = false;                 // run it anyway and compare the residue with the cached one
     uint64_t chunk256 = 4;
     int localCarryPropagationDepth = 8;
     int enqueue_max = 0;
-    int backup_interval = 3000;
+    int backup_interval = 3000;              // with -t: fixed; otherwise chosen by core::BackupCadence
+    bool backup_interval_fixed = false;      // -t given
+    int backup_interval_max = 3000;          // -tmax: the chosen interval is at most this
     std::string save_path = ".";
     std::string user;
     std::string password;
@@ -44,11 +56,42 @@ struct CliOptions {
     int max_local_size5 = 0;
     bool noAsk = false;
     std::string kernel_path;
+    std::string kernel_cache_path;           // compiled program cache, empty = disabled
+    bool kernel_cache = true;
+    bool cmdbuf = true;                      // replay iterations via cl_khr_command_buffer
+    bool tune_plan = false;                  // benchmark NTT launch plans and store the best
+    bool tune_energy = false;                // -tune, -tuneplan: best iterations per joule, not per second
+    bool use_plan = true;                    // apply the stored plan for this device and N
+    bool auto_engine = false;                // marin or legacy, whichever the plan database predicts faster
+    bool twiddle_otf = false;                // derive radix-4 stage twiddles instead of reading the table
+    bool lazy_reduce = false;                // redundant [0, 2^64) residues in the butterflies
+    bool four_step = false;                  // middle NTT stages in local-memory tile passes
+    bool coalesced = false;                  // radix-4 stages of stride 2 to 8 on contiguous local tiles
+    uint32_t gen_tile = 0;                   // -genkernels: largest tile of the generated passes, 0 = off
+    std::string plan_db_path;                // empty = <save_path>/ntt_plans.json
+    uint64_t stage2_mem_mb = 0;              // VRAM budget of P-1 stage 2 in MiB, 0 = 80% of the device
+    std::string stage2_devices;              // -s2devices: P-1 stage 2 split across these marin devices
+    uint64_t vram_mb = 0;                    // device memory budget of the process in MiB, 0 = the device
+    std::string devices;                     // -devices list, run by core::MultiDevice before any App
+    uint32_t batch = 0;                      // -batch: concurrent entries on one device, run by core::MultiDevice
+    uint32_t tf_bits = 0;                    // -tf: trial factor to 2^tf_bits before the test, 0 = no TF
+    uint32_t tf_from = 0;                    // bits already factored (worktodo how_far_factored)
+    bool daemon = false;                     // --daemon: take work over socket_path, run by core::Daemon
+    std::string socket_path;                 // -socket, empty = <save_path>/prmers.sock
+    std::string bench_json;                  // -bench results as JSON, empty = none
+    std::string bench_csv;                   // -bench results as CSV, empty = none
+    std::string bench_baseline;              // previous -bench results to compare with
+    double bench_threshold = 5.0;            // allowed slowdown in % before -bench fails
+    std::string roofline_csv;                // -bench bytes/iter, GB/s and modmul/s against the device peaks, empty = none
+    uint64_t burnin_seconds = 0;             // -burnin: duration of the checked burn-in, 0 = off
+    uint64_t burnin_exponent = 0;            // its exponent, the positional one or 136279841
+    uint64_t burnin_block = 64;              // iterations between two of its Gerbicz-Li checks
     std::string output_path;
     std::string build_options = "";
     uint32_t proofPower = 1;
     bool manual_proofPower = false; // Track if proof power is set manually
     std::string proofFile = "";
+    std::string proofCodec = "none";  // compression of the proof residue files
     int portCode = 8;
     std::string osName = "Linux";
     std::string osVersion = "14.0";
@@ -56,7 +99,10 @@ struct CliOptions {
     std::string aid = "";
     std::string uid = "";
     int res64_display_interval = 0;
+    std::string progress = "console";  // console, quiet or json progress lines
     bool cl_queue_throttle_active = false;
+    double gpu_share = 0;                    // -gpushare: weight of this job's turns on a shared GPU, 0 = off
+    std::string gpu_share_path;              // the turn table, empty = one per device in the temporary directory
     std::vector<std::string> knownFactors;
 };
 
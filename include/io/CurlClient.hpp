@@ -1,10 +1,33 @@
 #ifndef IO_CURLCLIENT_HPP
 #define IO_CURLCLIENT_HPP
 
+#include <cstdio>
 #include <string>
 
 namespace io {
 
+// One logged-in PrimeNet session on a single libcurl handle: the login
+// cookie and the open connection are reused by every submit(), so a batch
+// of results costs one login and one TLS handshake.
+class PrimeNetSession {
+public:
+    PrimeNetSession();
+    ~PrimeNetSession();
+    PrimeNetSession(const PrimeNetSession&) = delete;
+    PrimeNetSession& operator=(const PrimeNetSession&) = delete;
+
+    bool login(const std::string& username, const std::string& password);
+    bool loggedIn() const noexcept { return !uid_.empty(); }
+    // Posts one JSON result through the manual_result form; false on a
+    // transport error, when the result should be retried.
+    bool submit(const std::string& jsonResult);
+
+private:
+    void* curl_ = nullptr;
+    FILE* trace_ = nullptr;
+    std::string uid_;
+};
+
 class CurlClient {
 public:
     static std::string promptHiddenPassword();
@@ -14,6 +37,7 @@ public:
                                           const std::string& password);
 
 private:
+    friend class PrimeNetSession;
     static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp);
     static std::string extractUID(const std::string& html);
 };
@@ -1,6 +1,7 @@
 #ifndef IO_JSONBUILDER_HPP
 #define IO_JSONBUILDER_HPP
 
+#include <optional>
 #include <string>
 #include <tuple>
 #ifndef CL_TARGET_OPENCL_VERSION
@@ -19,13 +20,17 @@ namespace io {
 
 class JsonBuilder {
 public:
+    // kfPower: 3^(KF-1) mod 2^p - 1 as words, computed on the GPU for a
+    // cofactor PRP; when empty the cofactor check runs on the host.
     static std::tuple<bool, std::string, std::string> computeResult(
         const std::vector<uint64_t>& hostResult,
         const CliOptions& opts,
-        const std::vector<int>& digit_width);
+        const std::vector<int>& digit_width,
+        const std::vector<uint32_t>& kfPower = {});
     static std::tuple<bool, std::string, std::string> computeResultMarin(
         const std::vector<uint64_t>& hostResult,
-        const CliOptions& opts);
+        const CliOptions& opts,
+        const std::vector<uint32_t>& kfPower = {});
 
     static std::string generate(const CliOptions& opts,
                                  int transform_size,
@@ -33,6 +38,13 @@ public:
                                  const std::string& res64,
                                  const std::string& res2048);
 
+    // Trial factoring result: "F" with the factor, "NF" when [2^bitLo,
+    // 2^bitHi) was searched to the end.
+    static std::string generateTrialFactor(const CliOptions& opts,
+                                           unsigned bitLo,
+                                           unsigned bitHi,
+                                           const std::string& factor);
+
     // Write JSON string to a file.
     static void write(const std::string& json,
                       const std::string& path);
@@ -57,6 +69,13 @@ public:
          double /*elapsed*/,
          int /*transform_size*/);
 
+    // Quoted, escaped JSON string.
+    static std::string quote(const std::string& s);
+    // The string value of `key` in a flat JSON object, nothing when it has
+    // none (the requests of the --daemon control socket).
+    static std::optional<std::string> stringField(const std::string& json,
+                                                  const std::string& key);
+
     static std::vector<uint32_t> compactBits(
         const std::vector<uint64_t>& x,
         const std::vector<int>& digit_width,
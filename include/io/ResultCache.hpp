@@ -0,0 +1,51 @@
+// include/io/ResultCache.hpp
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace io {
+
+struct CliOptions;
+
+// A result already written to the save directory.
+struct CachedResult {
+    std::string json;
+    std::string source;     // the file it was read from
+    std::string status;     // "P", "C", "F", "NF"
+    std::string res64;      // empty for P-1
+};
+
+// Index of the results in <save_path>/results.txt and the
+// <p>_<mode>_result.json files, keyed by exponent, mode, the P-1 bounds and
+// the known factors of a cofactor test, so that a re-issued assignment is
+// found before it is run again. TF lines and lines that are not one result
+// object are left out; the latest result of a key wins.
+class ResultCache {
+public:
+    explicit ResultCache(const std::string& savePath);
+
+    // The result of the test `opts` describes.
+    std::optional<CachedResult> find(const CliOptions& opts) const;
+    // The result with the same key as `json`, a result that is not indexed yet.
+    std::optional<CachedResult> find(const std::string& json) const;
+
+    size_t size() const noexcept { return entries_.size(); }
+
+    // Empty when `mode` is not prp, ll or pm1.
+    static std::string key(uint64_t exponent, const std::string& mode,
+                           uint64_t B1, uint64_t B2,
+                           std::vector<std::string> knownFactors);
+    static std::string keyOf(const std::string& json);
+    // The status and res64 of one result object.
+    static CachedResult parse(const std::string& json, const std::string& source = {});
+
+private:
+    void add(const std::string& json, const std::string& source);
+
+    std::unordered_map<std::string, CachedResult> entries_;
+};
+
+} // namespace io
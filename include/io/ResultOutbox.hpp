@@ -0,0 +1,52 @@
+// include/io/ResultOutbox.hpp
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace io {
+
+class PrimeNetSession;
+
+// PrimeNet submissions that never hold up the computation. enqueue() writes
+// the result durably to <dir>/<name>_<time>.json and returns; a submitter
+// thread logs in once per pass, posts every pending file over the same
+// libcurl handle and renames each one to .json.sent when the server took
+// it. A failed pass is retried with exponential backoff, and whatever is
+// still pending when the process stops, or crashes, is sent by the next run
+// that submits. Processes sharing a save directory take turns on
+// <dir>/.lock, so no result goes out twice.
+class ResultOutbox {
+public:
+    ResultOutbox(std::string dir, std::string user, std::string password);
+    // Gives the pending results up to kDrainSeconds unless PrimeNet is
+    // failing; the rest stays on disk.
+    ~ResultOutbox();
+    ResultOutbox(const ResultOutbox&) = delete;
+    ResultOutbox& operator=(const ResultOutbox&) = delete;
+
+    bool enqueue(const std::string& name, const std::string& jsonResult);
+    std::size_t pending() const { return pendingFiles().size(); }
+    const std::string& user() const noexcept { return user_; }
+
+private:
+    void loop();
+    std::vector<std::string> pendingFiles() const;
+    // One pass over the pending files; false when it has to be retried.
+    bool drain();
+
+    const std::string dir_, user_, password_;
+    std::unique_ptr<PrimeNetSession> session_;
+    std::mutex mutex_;
+    std::condition_variable wake_, idle_;
+    bool kick_ = true, failing_ = false, busy_ = true;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+} // namespace io
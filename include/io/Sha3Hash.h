@@ -34,6 +34,7 @@
 #include <vector>
 #include <array>
 #include <cstring>
+#include <utility>
 using namespace std;
 namespace io{
 class Sha3Hash {
@@ -54,4 +55,20 @@ public:
 };
 
 using SHA3 = Hash<Sha3Hash>;
+
+// SHA3 of independent buffers ({data, bytes} each), hashed four at a time;
+// entry i equals SHA3::hash of buffer i.
+inline vector<array<u64, 4>> sha3Batch(const vector<pair<const void*, u32>>& buffers) {
+  const u32 n = static_cast<u32>(buffers.size());
+  vector<const unsigned char*> data(n);
+  vector<unsigned> sizes(n);
+  for (u32 i = 0; i < n; ++i) {
+    data[i] = reinterpret_cast<const unsigned char*>(buffers[i].first);
+    sizes[i] = buffers[i].second;
+  }
+  vector<array<u64, 4>> out(n);
+  static_assert(sizeof(array<u64, 4>) == 32);
+  SHA3Batch256(data.data(), sizes.data(), n, reinterpret_cast<unsigned char (*)[32]>(out.data()));
+  return out;
+}
 } // namespace io
\ No newline at end of file
@@ -17,6 +17,9 @@ public:
     void appendToResultsTxt(const std::string& jsonResult) const;
 
 private:
+    // -crosscheck: compares the residue with the saved result of the same test.
+    void crossCheck(const std::string& jsonResult) const;
+
     const io::CliOptions& options_;
 };
 
@@ -1,8 +1,13 @@
 // io/WorktodoParser.hpp
 #pragma once
+#include <istream>
 #include <optional>
 #include <string>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace io {
@@ -11,6 +16,8 @@ struct WorktodoEntry {
     bool prpTest   = false;
     bool llTest    = false;
     bool pm1Test   = false; 
+    bool tfTest    = false;                 // Factor=
+
     uint32_t exponent = 0;
     std::string aid;
     std::string rawLine;  
@@ -18,16 +25,69 @@ struct WorktodoEntry {
     uint32_t residueType = 1;               
     uint64_t B1 = 0;                       
     uint64_t B2 = 0;
+    uint32_t tfFrom = 0;                    // bits factored so far (how_far_factored)
+    uint32_t tfTo   = 0;                    // Factor= target bit level
 };
 
+// The lines of the file are consumed through an append-only journal,
+// <file>.journal, under an exclusive lock on <file>.lock: claiming or
+// finishing an entry appends its line there instead of rewriting the file.
+// Each parser keeps an index of the file and of the journal and reads only
+// what was appended since, so the cost of a claim does not grow with the
+// file. The file is compacted (consumed lines removed, journal emptied)
+// once they make half of it; a file of kCompactBytes or less is rewritten
+// at once, without a journal.
 class WorktodoParser {
 public:
     explicit WorktodoParser(const std::string& filename);
-    std::optional<WorktodoEntry> parse();
+    // The first valid entry, or the one after `skip` valid entries.
+    std::optional<WorktodoEntry> parse(std::size_t skip = 0);
+    // The entry of a single worktodo line, nothing when it is not one.
+    static std::optional<WorktodoEntry> parseLine(const std::string& line);
     bool removeFirstProcessed();  // supprime la 1ʳᵉ entrée non vide et la sauvegarde
+    // Moves the first valid entry to `target` under an exclusive lock on
+    // <file>.lock, so several workers can share one worktodo file.
+    std::optional<WorktodoEntry> claimFirst(const std::string& target);
+    // Appends `line` under the same lock.
+    bool append(const std::string& line);
+    // The first line that is not a comment, empty when there is none.
+    std::string firstLine();
+    // The lines that are not comments.
+    std::size_t pendingCount();
+    // Consumes the first copy of `line`; false when there is none.
+    bool drop(const std::string& line);
 
 private:
-    std::string filename_;
+    static constexpr std::uintmax_t kCompactBytes = 64 << 10;
+
+    struct Line {
+        std::string text;
+        bool consumed = false;
+    };
+
+    static std::optional<WorktodoEntry> parseStream(std::istream& in, std::size_t skip);
+    bool isEntry(const Line& l) const { return !l.consumed && !l.text.empty() && l.text[0] != '#'; }
+    // Reads what was appended to the file and to the journal since the last
+    // call; everything again when the file was compacted meanwhile.
+    void refresh();
+    void reset();
+    void markConsumed(const std::string& text);
+    // Journals the consumption of the first unconsumed copy of `text`,
+    // compacts when it is time.
+    bool consume(const std::string& text);
+    bool compact();
+
+    std::string filename_, journal_;
+    std::mutex mutex_;
+    std::vector<Line> lines_;
+    std::unordered_map<std::string, std::deque<std::size_t>> pending_;  // text -> unconsumed lines
+    std::size_t first_ = 0;            // no unconsumed line before
+    std::uintmax_t scanned_ = 0;       // bytes of the file indexed
+    std::uintmax_t journalRead_ = 0;   // bytes of the journal applied
+    std::uintmax_t consumedBytes_ = 0;
+    uint64_t generation_ = 0;          // of the journal, bumped by a compaction
+    uint64_t fileId_ = 0;              // inode of the file indexed
+    bool tornFile_ = false, tornJournal_ = false;  // no newline at the end
 };
 
 } // namespace io
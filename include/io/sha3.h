@@ -51,4 +51,14 @@ void SHA3Update(SHA3Context *p, const unsigned char *aData, unsigned int nData);
 ** hash value.
 */
 unsigned char *SHA3Final(SHA3Context *p);
+
+/*
+** SHA3-256 of n independent messages, aData[i] of nData[i] bytes, into
+** aOut[i]. The full blocks that four messages have in common go through a
+** 4-way interleaved Keccak (AVX-512 or AVX2 picked at run time on x86-64),
+** the rest of each message through SHA3Update and SHA3Final, so every
+** digest is the one a SHA3Context of size 256 gives.
+*/
+void SHA3Batch256(const unsigned char *const *aData, const unsigned int *nData,
+                  unsigned int n, unsigned char (*aOut)[32]);
 } // namespace io
\ No newline at end of file
@@ -7,7 +7,9 @@ Please give feedback to the authors if improvement is realized. It is distribute
 
 #pragma once
 
+#include <algorithm>
 #include <vector>
+#include <string>
 
 #include "arith.h"
 
@@ -24,28 +26,111 @@ public:
 	typedef size_t Reg;
 
 	virtual size_t get_size() const = 0;
+	virtual size_t get_reg_count() const = 0;
 	virtual void set(const Reg dst, const uint64 a) const = 0;
+	// dst = the integer whose get_size() digits (values only, carried) are in d
+	virtual void set_digits(const Reg dst, const uint64 * const d) const = 0;
 	virtual void copy(const Reg dst, const Reg src) const = 0;
 	virtual bool is_equal(const Reg src1, const Reg src2) const = 0;
+	// The low 64 bits of src, and src == a (a is a small integer) or src == 2^q - 1, without reading the register
+	virtual uint64 res64(const Reg src) const = 0;
+	virtual bool equal_to(const Reg src, const uint32 a) const = 0;
+	bool is_one(const Reg src) const { return equal_to(src, 1); }
+	virtual bool is_Mp(const Reg src) const = 0;
 	virtual void square_mul(const Reg src, const uint32 a = 1) const = 0;
+	// src = src^2 - s; the GPU engine subtracts in the carry of the squaring
+	virtual void square_sub(const Reg src, const uint32 s) const { square_mul(src); sub(src, s); }
 	virtual void set_multiplicand(const Reg dst, const Reg src) const = 0;
 	virtual void mul(const Reg dst, const Reg src) const = 0;
 	virtual void sub(const Reg src, const uint32 a) const = 0;
 
+	// The operations between begin_side and end_side wait for the ones before and may then run concurrently with
+	// the next ones, until join_side: the GPU engine queues them on a second queue. The next ones must not touch
+	// their registers meanwhile. Elsewhere they simply run in order.
+	virtual void begin_side() const {}
+	virtual void end_side() const {}
+	virtual void join_side() const {}
+
+	// Kernel geometry of the GPU engine: the chunk and block sizes of the radix-4 passes and the work-group size of
+	// the carry kernel (CWM). 0 keeps the built-in choice, a value is rounded down to a legal one for the size.
+	struct geometry
+	{
+		size_t chunk16, chunk64, chunk256, blk16, blk64, cwm_wg_size;
+		geometry() : chunk16(0), chunk64(0), chunk256(0), blk16(0), blk64(0), cwm_wg_size(0) {}
+	};
+	// The geometry in use, all zeros on the CPU
+	virtual geometry get_geometry() const { return geometry(); }
+
+	// Per-kernel timings, every launch is then synchronous
+	struct kernel_profile { std::string name; size_t count; uint64 time; };	// time in ns
+	virtual void set_profiling(const bool enable) const = 0;
+	virtual void display_profiles(const size_t count) const = 0;
+	virtual std::vector<kernel_profile> get_profiles() const = 0;
+
+	// Host slots keep raw copies of registers out of the device memory, for values seldom needed (a rollback state):
+	// to_host queues the copy of src into the slot and returns, from_host copies the slot back to dst. get_host and
+	// set_host are the raw bytes of a slot, those of one register in a checkpoint.
+	virtual void to_host(const size_t slot, const Reg src) const = 0;
+	virtual void from_host(const Reg dst, const size_t slot) const = 0;
+	virtual bool get_host(const size_t slot, std::vector<char> & data) const = 0;
+	virtual bool set_host(const size_t slot, const std::vector<char> & data) const = 0;
+
 	virtual size_t get_checkpoint_size() const = 0;
 	virtual bool get_checkpoint(std::vector<char> & data) const = 0;
 	virtual bool set_checkpoint(const std::vector<char> & data) const = 0;
+	// get_checkpoint in two steps: begin_checkpoint takes a snapshot of the registers and returns, end_checkpoint waits
+	// for it and fills data. Only end_checkpoint may run on another thread, while the engine goes on. Synchronous by default.
+	virtual bool begin_checkpoint(std::vector<char> & data) const { return get_checkpoint(data); }
+	virtual bool end_checkpoint(std::vector<char> & data) const { return data.size() == get_checkpoint_size(); }
+
+	// The window, in bits, of pow with spare_count spare registers: about bit_width(e) / (w + 1) multiplications
+	// instead of one per set bit, for 2^(w-1) odd powers of the base to build (it takes 2^(w-1) - 1 spares)
+	static int pow_window(const uint64_t e, const size_t spare_count)
+	{
+		const int l = std::bit_width(e);
+		int w = 1;
+		for (int v = 2; v <= 5 && (size_t(1) << (v - 1)) - 1 <= spare_count; ++v)
+		{
+			if (l / (v + 1) + (1 << (v - 1)) < l / (w + 1) + (1 << (w - 1))) w = v;
+		}
+		return w;
+	}
 
-	// dst = src^e, src is erased
-	void pow(const Reg dst, const Reg src, const uint64_t e) const
+	// dst = src^e, src is erased. The registers spare, spare + 1, ... (spare_count of them, may be none) are erased
+	// too: they hold src^3, src^5, ... in transformed form, src holding src^1, for a sliding window.
+	void pow(const Reg dst, const Reg src, const uint64_t e, const Reg spare = 0, const size_t spare_count = 0) const
 	{
-		set_multiplicand(src, src);
+		const int w = pow_window(e, spare_count);
+		const size_t m = size_t(1) << (w - 1);
+		auto odd = [&](const size_t k) { return (k == 0) ? src : Reg(spare + k - 1); };	// src^(2k+1)
+
+		if (m > 1)
+		{
+			// src^2 waits in the last entry, src^(2m-1) takes its place once it is the last one needed
+			copy(dst, src);
+			square_mul(dst);
+			set_multiplicand(odd(m - 1), dst);
+			copy(dst, src);
+			set_multiplicand(src, src);
+			for (size_t k = 1; k < m; ++k)
+			{
+				mul(dst, odd(m - 1));
+				set_multiplicand(odd(k), dst);
+			}
+		}
+		else set_multiplicand(src, src);
+
 		set(dst, 1);
 		if (e == 0) return;
-		for (int i = std::bit_width(e) - 1; i >= 0; --i)
+		for (int i = std::bit_width(e) - 1; i >= 0; )
 		{
-			square_mul(dst);
-			if ((e & (static_cast<uint64_t>(1) << i)) != 0) mul(dst, src);
+			if ((e & (static_cast<uint64_t>(1) << i)) == 0) { square_mul(dst); --i; continue; }
+			// the longest window of at most w bits from bit i ending with a set bit
+			int j = std::max(i - w + 1, 0);
+			while ((e & (static_cast<uint64_t>(1) << j)) == 0) ++j;
+			for (int k = i; k >= j; --k) square_mul(dst);
+			mul(dst, odd(size_t((e >> j) & ((static_cast<uint64_t>(2) << (i - j)) - 1)) >> 1));
+			i = j - 1;
 		}
 	}
 
@@ -55,7 +140,7 @@ public:
 		std::vector<uint64> _data;
 
 	public:
-		digit(engine * const eng, const Reg src)
+		digit(const engine * const eng, const Reg src)
 		{
 			_data.resize(eng->get_size());
 			eng->get(_data.data(), src);
@@ -106,6 +191,10 @@ public:
 		}
 	};
 
-	static engine * create_gpu(const uint32_t q, const size_t reg_count, const size_t device, const bool verbose, const size_t chunk256_max);
-	static engine * create_cpu(const uint32_t q);
+	// negacyclic: the registers are modulo 2^q + 1 rather than 2^q - 1
+	static engine * create_gpu(const uint32_t q, const size_t reg_count, const size_t device, const bool verbose, const size_t chunk256_max,
+		const std::string & cache_path = "", const size_t size = 0, const bool negacyclic = false, const geometry & geom = geometry());
+	static engine * create_cpu(const uint32_t q, const size_t reg_count, const size_t threads = 0, const bool negacyclic = false);
+	// CL_DEVICE_NAME and CL_DRIVER_VERSION of a GPU device, false if there is no such device
+	static bool gpu_device_key(const size_t device, std::string & name, std::string & driver);
 };
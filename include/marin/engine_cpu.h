@@ -0,0 +1,613 @@
+// include/marin/engine_cpu.h
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "math/Mod64.hpp"
+
+// Persistent host threads. run() splits [0, count) into one range per thread,
+// the caller takes the first one, and returns when all of them are done.
+class cpu_pool
+{
+private:
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::condition_variable _start, _done;
+	const std::function<void(size_t, size_t)> * _fn = nullptr;
+	size_t _count = 0, _generation = 0, _pending = 0;
+	bool _stop = false;
+
+	size_t begin(const size_t i) const { return _count * i / size(); }
+
+	void worker(const size_t id)
+	{
+		size_t seen = 0;
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;)
+		{
+			_start.wait(lock, [&] { return _stop || (_generation != seen); });
+			if (_stop) return;
+			seen = _generation;
+			const std::function<void(size_t, size_t)> & fn = *_fn;
+			const size_t b = begin(id), e = begin(id + 1);
+			lock.unlock();
+			if (b < e) fn(b, e);
+			lock.lock();
+			if (--_pending == 0) _done.notify_one();
+		}
+	}
+
+public:
+	explicit cpu_pool(const size_t threads)
+	{
+		for (size_t i = 1; i < threads; ++i) _threads.emplace_back(&cpu_pool::worker, this, i);
+	}
+
+	~cpu_pool()
+	{
+		{ std::lock_guard<std::mutex> lock(_mutex); _stop = true; }
+		_start.notify_all();
+		for (std::thread & t : _threads) t.join();
+	}
+
+	size_t size() const { return _threads.size() + 1; }
+
+	void run(const size_t count, const std::function<void(size_t, size_t)> & fn)
+	{
+		if (_threads.empty()) { fn(0, count); return; }
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_fn = &fn; _count = count; _pending = _threads.size(); ++_generation;
+		}
+		_start.notify_all();
+		const size_t e = begin(1);
+		if (e > 0) fn(0, e);
+		std::unique_lock<std::mutex> lock(_mutex);
+		_done.wait(lock, [&] { return _pending == 0; });
+	}
+};
+
+// Host engine with a two-prime IBDWT: the weighted cyclic convolution is
+// computed both in Z/pZ, p = 2^64 - 2^32 + 1, and in GF(M61^2), M61 = 2^61 - 1,
+// and every product is rebuilt by CRT modulo p * M61 ~ 2^125. The bound is
+// n * (2^w - 1)^2 < p * M61 instead of n * (2^w - 1)^2 < p, so a digit holds
+// about twice as many bits and the transform is about half as long.
+// In GF(M61), 2 has order 61 and 2^(1/n) = 2^(n^-1 mod 61): the weights are
+// powers of two. The roots of unity live in GF(M61^2), whose group order is
+// 2^62 * (2^60 - 1).
+// Digits are up to 62 bits wide; they are exposed as pairs of half digits so
+// that engine::digit still carries 32-bit values.
+// The forward transforms are decimation in frequency and the inverse ones
+// decimation in time, so the products are taken in bit-reversed order and
+// there is no permutation. Stages whose butterflies span more than a block
+// are spread over the threads one at a time; the last ones run block by
+// block in cache (the inverse does the same in reverse order).
+// Negacyclic, the registers are modulo 2^q + 1: digit j is also weighted by
+// z^j in both fields, z a 2n-th root of unity, the products are signed and the
+// carry out of the top digit wraps around negated.
+// Powers of two only.
+// This is the host reference of the transform, not a GPU backend: engine_gpu
+// still runs the Solinas field alone, and the shorter N for 100M+ exponents
+// is only had on the host until the two-prime kernels are written.
+class engine_cpu : public engine
+{
+private:
+	typedef math::gf61_2 gf61;	// a + b.i, i^2 = -1
+	typedef __uint128_t uint128;
+	typedef __int128_t int128;
+
+	static constexpr uint64 M61 = (uint64(1) << 61) - 1;
+	static constexpr uint128 PM61 = uint128(MOD_P) * M61;
+
+	const size_t _reg_count;
+	const bool _negacyclic;
+	const size_t _n;
+	std::vector<uint8> _width;		// of the n wide digits
+	std::vector<uint64> _w1, _wi1;	// weights in Z/pZ, inverse weights include 1/n
+	std::vector<uint8> _e61;		// weight in GF(M61) is 2^_e61
+	std::vector<gf61> _z61, _zi61;	// and z^j, z^-j if negacyclic
+	std::vector<uint64> _root1, _rooti1;
+	std::vector<gf61> _root61, _rooti61;
+	uint64 _inv_n61 = 0, _invp_61 = 0;
+	mutable std::vector<std::vector<uint64>> _reg;
+	mutable std::vector<std::vector<uint64>> _host;	// host slots: the registers are host memory already
+	mutable std::vector<uint64> _x1, _y1;
+	mutable std::vector<gf61> _x61, _y61;
+	mutable std::vector<int128> _v;
+	std::unique_ptr<cpu_pool> _pool;
+
+	static uint64 reduce61(const uint64 x) { const uint64 r = (x & M61) + (x >> 61); return (r >= M61) ? r - M61 : r; }
+	static uint64 shl61(const uint64 x, const uint32 e) { return (e == 0) ? x : (((x << e) & M61) | (x >> (61 - e))); }
+
+	// A root of order 2^62 in GF(M61^2)
+	static gf61 root61_max()
+	{
+		const gf61 minus_one = { M61 - 1, 0 };
+		for (uint64 a = 1; a < 100; ++a)
+		{
+			const gf61 z = math::Mod64::pow61_2(gf61{ a, 1 }, (uint64(1) << 60) - 1);
+			const gf61 t = math::Mod64::pow61_2(z, uint64(1) << 61);
+			if ((t.a == minus_one.a) && (t.b == minus_one.b)) return z;
+		}
+		throw std::runtime_error("engine_cpu: no root of unity of order 2^62.");
+	}
+
+	struct field1
+	{
+		typedef uint64 T;
+		static T add(const T a, const T b) { return mod_add(a, b); }
+		static T sub(const T a, const T b) { return mod_sub(a, b); }
+		static T mul(const T a, const T b) { return mod_mul(a, b); }
+	};
+
+	struct field61
+	{
+		typedef gf61 T;
+		static T add(const T a, const T b) { return math::Mod64::add61_2(a, b); }
+		static T sub(const T a, const T b) { return math::Mod64::sub61_2(a, b); }
+		static T mul(const T a, const T b) { return math::Mod64::mul61_2(a, b); }
+	};
+
+	// a block of the short stages: 64 KB of Z/pZ and 128 KB of GF(M61^2) elements
+	static constexpr size_t block = size_t(1) << 12;
+	// below, one thread is faster than waking the others
+	static constexpr size_t parallel_min = size_t(1) << 14;
+
+	void par(const size_t count, const std::function<void(size_t, size_t)> & fn) const
+	{
+		if (_n < parallel_min) fn(0, count); else _pool->run(count, fn);
+	}
+
+	// Butterflies t in [b, e) of the stage of span m; twiddles are r[j * s].
+	// They take everything by value: stores through x cannot alias the loop state.
+	template <typename F>
+	static void dif_stage(typename F::T * const x, const typename F::T * const r, const size_t m, const size_t s,
+		const size_t b, const size_t e)
+	{
+		for (size_t t = b; t < e; ++t)
+		{
+			const size_t j = t & (m - 1), i = 2 * t - j;
+			const typename F::T u0 = x[i], u1 = x[i + m];
+			x[i] = F::add(u0, u1); x[i + m] = F::mul(F::sub(u0, u1), r[j * s]);
+		}
+	}
+
+	template <typename F>
+	static void dit_stage(typename F::T * const x, const typename F::T * const r, const size_t m, const size_t s,
+		const size_t b, const size_t e)
+	{
+		for (size_t t = b; t < e; ++t)
+		{
+			const size_t j = t & (m - 1), i = 2 * t - j;
+			const typename F::T u0 = x[i], u1 = F::mul(x[i + m], r[j * s]);
+			x[i] = F::add(u0, u1); x[i + m] = F::sub(u0, u1);
+		}
+	}
+
+	// Stages of span m down to 1 of a block of bs elements
+	template <typename F>
+	static void dif_block(typename F::T * const x, const typename F::T * const r, const size_t bs, size_t m, size_t s)
+	{
+		for (; m >= 1; m /= 2, s *= 2)
+		{
+			for (size_t k = 0; k < bs; k += 2 * m)
+			{
+				for (size_t j = 0; j < m; ++j)
+				{
+					const typename F::T u0 = x[k + j], u1 = x[k + j + m];
+					x[k + j] = F::add(u0, u1); x[k + j + m] = F::mul(F::sub(u0, u1), r[j * s]);
+				}
+			}
+		}
+	}
+
+	// Stages of span 1 up to bs / 2
+	template <typename F>
+	static void dit_block(typename F::T * const x, const typename F::T * const r, const size_t bs, size_t s)
+	{
+		for (size_t m = 1; m < bs; m *= 2, s /= 2)
+		{
+			for (size_t k = 0; k < bs; k += 2 * m)
+			{
+				for (size_t j = 0; j < m; ++j)
+				{
+					const typename F::T u0 = x[k + j], u1 = F::mul(x[k + j + m], r[j * s]);
+					x[k + j] = F::add(u0, u1); x[k + j + m] = F::sub(u0, u1);
+				}
+			}
+		}
+	}
+
+	// Natural order in, bit-reversed order out. root[j] = r^j, j < n/2.
+	template <typename F>
+	void forward_dif(typename F::T * const x, const std::vector<typename F::T> & root) const
+	{
+		const size_t n = _n, bs = std::min(block, n);
+		const typename F::T * const r = root.data();
+		size_t m = n / 2, s = 1;
+		for (; 2 * m > bs; m /= 2, s *= 2)
+			par(n / 2, [=](const size_t b, const size_t e) { dif_stage<F>(x, r, m, s, b, e); });
+		par(n / bs, [=](const size_t b, const size_t e) { for (size_t c = b; c < e; ++c) dif_block<F>(x + c * bs, r, bs, m, s); });
+	}
+
+	// Bit-reversed order in, natural order out
+	template <typename F>
+	void backward_dit(typename F::T * const x, const std::vector<typename F::T> & root) const
+	{
+		const size_t n = _n, bs = std::min(block, n);
+		const typename F::T * const r = root.data();
+		par(n / bs, [=](const size_t b, const size_t e) { for (size_t c = b; c < e; ++c) dit_block<F>(x + c * bs, r, bs, n / 2); });
+		for (size_t m = bs, s = n / (2 * bs); m < n; m *= 2, s /= 2)
+			par(n / 2, [=](const size_t b, const size_t e) { dit_stage<F>(x, r, m, s, b, e); });
+	}
+
+	void forward(const std::vector<uint64> & d, std::vector<uint64> & x1, std::vector<gf61> & x61) const
+	{
+		const size_t n = _n;
+		x1.resize(n); x61.resize(n);
+		uint64 * const y1 = x1.data(); gf61 * const y61 = x61.data();
+		const uint64 * const dk = d.data(), * const w1 = _w1.data(); const uint8 * const e61 = _e61.data();
+		const gf61 * const z61 = _negacyclic ? _z61.data() : nullptr;
+		par(n, [=](const size_t b, const size_t e)
+		{
+			for (size_t k = b; k < e; ++k)
+			{
+				y1[k] = mod_mul(dk[k], w1[k]);
+				y61[k] = gf61{ shl61(reduce61(dk[k]), e61[k]), 0 };
+				if (z61 != nullptr) y61[k] = math::Mod64::mul61_2(y61[k], z61[k]);
+			}
+		});
+		forward_dif<field1>(x1.data(), _root1);
+		forward_dif<field61>(x61.data(), _root61);
+	}
+
+	// Inverse transform, unweight, CRT and carry into dst
+	void backward(std::vector<uint64> & x1, std::vector<gf61> & x61, std::vector<uint64> & dst) const
+	{
+		const size_t n = _n;
+		backward_dit<field1>(x1.data(), _rooti1);
+		backward_dit<field61>(x61.data(), _rooti61);
+
+		_v.resize(n);
+		int128 * const v = _v.data();
+		const uint64 * const y1 = x1.data(), * const wi1 = _wi1.data(); const gf61 * const y61 = x61.data();
+		const uint8 * const e61 = _e61.data();
+		const gf61 * const zi61 = _negacyclic ? _zi61.data() : nullptr;
+		const uint64 inv_n61 = _inv_n61, invp_61 = _invp_61;
+		par(n, [=](const size_t b, const size_t e)
+		{
+			for (size_t k = b; k < e; ++k)
+			{
+				const uint64 r1 = mod_mul(y1[k], wi1[k]);
+				const uint64 ek = e61[k], ei = (ek == 0) ? 0 : 61 - ek;
+				// the product is real: x61[k].b = 0, once unweighted by z^-k if negacyclic
+				const uint64 a61 = (zi61 != nullptr) ? math::Mod64::mul61_2(y61[k], zi61[k]).a : y61[k].a;
+				const uint64 r2 = math::Mod64::mul61(shl61(a61, uint32(ei)), inv_n61);
+				const uint64 t = math::Mod64::mul61(math::Mod64::sub61(r2, reduce61(r1)), invp_61);
+				const uint128 u = uint128(r1) + uint128(MOD_P) * t;
+				// negacyclic products are signed, in (-p * M61 / 2, p * M61 / 2)
+				v[k] = ((zi61 != nullptr) && (u > PM61 / 2)) ? int128(u) - int128(PM61) : int128(u);
+			}
+		});
+		carry(_v, dst);
+	}
+
+	// Every thread carries its own range from 0, then the carries out of the
+	// ranges are rippled into the next ones; they rarely get far. The carries
+	// are signed (shifts are arithmetic) for the negacyclic products.
+	void carry(const std::vector<int128> & v, std::vector<uint64> & d) const
+	{
+		const size_t n = _n, nb = (n < parallel_min) ? 1 : _pool->size();
+		d.resize(n);
+		std::vector<int128> cout(nb, 0);
+		const int128 * const vk = v.data(); uint64 * const dk = d.data(); const uint8 * const wk = _width.data();
+		int128 * const co = cout.data();
+		par(nb, [=](const size_t b, const size_t e)
+		{
+			for (size_t i = b; i < e; ++i)
+			{
+				int128 c = 0;
+				for (size_t k = n * i / nb, k_end = n * (i + 1) / nb; k < k_end; ++k)
+				{
+					const int128 t = vk[k] + c;
+					dk[k] = uint64(t) & ((uint64(1) << wk[k]) - 1);
+					c = t >> wk[k];
+				}
+				co[i] = c;
+			}
+		});
+		for (size_t i = 1; i < nb; ++i)
+		{
+			int128 c = cout[i - 1];
+			for (size_t k = n * i / nb, k_end = n * (i + 1) / nb; (c != 0) && (k < k_end); ++k)
+			{
+				const int128 t = int128(d[k]) + c;
+				d[k] = uint64(t) & ((uint64(1) << _width[k]) - 1);
+				c = t >> _width[k];
+			}
+			cout[i] += c;
+		}
+		int128 c = cout[nb - 1];
+		// 2^q = 1, or 2^q = -1 if negacyclic
+		while (c != 0)
+		{
+			if (_negacyclic) c = -c;
+			for (size_t k = 0; (c != 0) && (k < n); ++k)
+			{
+				const int128 t = int128(d[k]) + c;
+				d[k] = uint64(t) & ((uint64(1) << _width[k]) - 1);
+				c = t >> _width[k];
+			}
+			// -1 = 2^q has no q-bit form: it is 2^w in the top digit
+			if (_negacyclic && (c == 1) && std::all_of(d.begin(), d.end(), [](const uint64 x) { return x == 0; }))
+			{
+				d[n - 1] = uint64(1) << _width[n - 1];
+				c = 0;
+			}
+		}
+	}
+
+	void add_small(std::vector<uint64> & d, const uint64 a) const
+	{
+		std::vector<int128> v(d.begin(), d.end());
+		v[0] += a;
+		carry(v, d);
+	}
+
+	bool is_zero_or_Mp(const std::vector<uint64> & d, bool & Mp) const
+	{
+		bool zero = true, ones = true;
+		for (size_t k = 0; k < _n; ++k)
+		{
+			zero &= (d[k] == 0);
+			ones &= (d[k] == (uint64(1) << _width[k]) - 1);
+		}
+		Mp = ones;
+		return zero || ones;
+	}
+
+	uint8 lo_width(const size_t k) const { return uint8(_width[k] / 2); }
+
+public:
+	// Smallest power of two such that the digits are at most 62 bits wide
+	// and n * (2^w - 1)^2 < 2^124 < p * M61. n <= 2^26 for the root of two in Z/pZ.
+	// Negacyclic products are signed: n * (2^w - 1)^2 < 2^123 < p * M61 / 2.
+	static size_t transform_size(const uint32_t q, const bool negacyclic = false)
+	{
+		for (size_t log2_n = 2; log2_n <= 26; ++log2_n)
+		{
+			const size_t n = size_t(1) << log2_n;
+			const uint64 w_max = (uint64(q) + n - 1) / n;
+			if ((w_max <= 62) && (2 * w_max + log2_n <= (negacyclic ? 123 : 124))) return n;
+		}
+		throw std::runtime_error("engine_cpu: exponent is too large.");
+	}
+
+	// threads = 0: one per hardware thread
+	engine_cpu(const uint32_t q, const size_t reg_count, const size_t threads = 0, const bool negacyclic = false)
+		: engine(), _reg_count(reg_count), _negacyclic(negacyclic), _n(transform_size(q, negacyclic))
+	{
+		const size_t n = _n;
+		if (q < 2 * n) throw std::runtime_error("engine_cpu: exponent is too small.");
+
+		_width.resize(n); _w1.resize(n); _wi1.resize(n); _e61.resize(n);
+
+		// Z/pZ: 554^((p - 1) / 192) = 2
+		const uint64 nr2 = mod_pow(554, (MOD_P - 1) / 192 / n), inv_n1 = mod_invert(n);
+		// GF(M61): (2^k)^n = 2 with k = n^-1 mod 61
+		uint32 k61 = 1;
+		while ((uint64(k61) * n) % 61 != 1) ++k61;
+
+		uint32 ceil_qjm1_n = 0;
+		for (size_t j = 1; j <= n; ++j)
+		{
+			const uint64 qj = q * uint64(j);
+			const uint32 ceil_qj_n = uint32((qj - 1) / n + 1);
+			_width[j - 1] = uint8(ceil_qj_n - ceil_qjm1_n);
+			ceil_qjm1_n = ceil_qj_n;
+		}
+		for (size_t j = 0; j < n; ++j)
+		{
+			// weight is 2^[(n - r) / n], r = qj mod n
+			const uint64 r = (q * uint64(j)) % n, e = (r != 0) ? n - r : 0;
+			const uint64 w = (r != 0) ? mod_pow(nr2, e) : 1;
+			_w1[j] = w; _wi1[j] = mod_mul(mod_invert(w), inv_n1);
+			_e61[j] = uint8((e * k61) % 61);
+		}
+
+		_root1.resize(n / 2); _rooti1.resize(n / 2);
+		const uint64 r1 = mod_root_nth(n), ri1 = mod_invert(r1);
+		uint64 r1j = 1, ri1j = 1;
+		for (size_t j = 0; j < n / 2; ++j) { _root1[j] = r1j; _rooti1[j] = ri1j; r1j = mod_mul(r1j, r1); ri1j = mod_mul(ri1j, ri1); }
+
+		_root61.resize(n / 2); _rooti61.resize(n / 2);
+		const gf61 r61 = math::Mod64::pow61_2(root61_max(), (uint64(1) << 62) / n), ri61 = math::Mod64::inv61_2(r61);
+		gf61 r61j = { 1, 0 }, ri61j = { 1, 0 };
+		for (size_t j = 0; j < n / 2; ++j)
+		{
+			_root61[j] = r61j; _rooti61[j] = ri61j;
+			r61j = math::Mod64::mul61_2(r61j, r61); ri61j = math::Mod64::mul61_2(ri61j, ri61);
+		}
+
+		if (negacyclic)
+		{
+			// z^n = -1
+			const uint64 z1 = mod_root_nth(2 * n), zi1 = mod_invert(z1);
+			const gf61 z61 = math::Mod64::pow61_2(root61_max(), (uint64(1) << 62) / (2 * n)), zi61 = math::Mod64::inv61_2(z61);
+			_z61.resize(n); _zi61.resize(n);
+			uint64 z1j = 1, zi1j = 1;
+			gf61 z61j = { 1, 0 }, zi61j = { 1, 0 };
+			for (size_t j = 0; j < n; ++j)
+			{
+				_w1[j] = mod_mul(_w1[j], z1j); _wi1[j] = mod_mul(_wi1[j], zi1j);
+				_z61[j] = z61j; _zi61[j] = zi61j;
+				z1j = mod_mul(z1j, z1); zi1j = mod_mul(zi1j, zi1);
+				z61j = math::Mod64::mul61_2(z61j, z61); zi61j = math::Mod64::mul61_2(zi61j, zi61);
+			}
+		}
+
+		_inv_n61 = math::Mod64::inv61(reduce61(n));
+		_invp_61 = math::Mod64::inv61(reduce61(MOD_P));
+
+		_reg.assign(reg_count, std::vector<uint64>(n, 0));
+		_pool = std::make_unique<cpu_pool>((threads != 0) ? threads : std::max(1u, std::thread::hardware_concurrency()));
+	}
+
+	virtual ~engine_cpu() {}
+
+	// n wide digits, each one exposed as two
+	size_t get_size() const override { return 2 * _n; }
+	size_t get_reg_count() const override { return _reg_count; }
+
+	void set_profiling(const bool) const override {}
+	void display_profiles(const size_t) const override {}
+	std::vector<kernel_profile> get_profiles() const override { return {}; }
+
+	void set(const Reg dst, const uint64 a) const override
+	{
+		std::vector<uint64> & d = _reg[size_t(dst)];
+		std::fill(d.begin(), d.end(), 0);
+		add_small(d, a);
+	}
+
+	void set_digits(const Reg dst, const uint64 * const d) const override
+	{
+		std::vector<int128> v(_n);
+		for (size_t k = 0; k < _n; ++k) v[k] = int128(uint32(d[2 * k + 0])) + (int128(uint32(d[2 * k + 1])) << lo_width(k));
+		carry(v, _reg[size_t(dst)]);
+	}
+
+	void get(uint64 * const d, const Reg src) const override
+	{
+		const std::vector<uint64> & x = _reg[size_t(src)];
+		for (size_t k = 0; k < _n; ++k)
+		{
+			const uint8 lw = lo_width(k), hw = uint8(_width[k] - lw);
+			d[2 * k + 0] = (x[k] & ((uint64(1) << lw) - 1)) | (uint64(lw) << 32);
+			d[2 * k + 1] = (x[k] >> lw) | (uint64(hw) << 32);
+		}
+	}
+
+	void copy(const Reg dst, const Reg src) const override { _reg[size_t(dst)] = _reg[size_t(src)]; }
+
+	bool is_equal(const Reg src1, const Reg src2) const override
+	{
+		const std::vector<uint64> & d1 = _reg[size_t(src1)], & d2 = _reg[size_t(src2)];
+		if (d1 == d2) return true;
+		// modulo 2^q + 1 the carried digits are unique
+		if (_negacyclic) return false;
+		bool Mp1, Mp2;
+		return is_zero_or_Mp(d1, Mp1) && is_zero_or_Mp(d2, Mp2);
+	}
+
+	uint64 res64(const Reg src) const override { return digit(this, src).res64(); }
+	bool equal_to(const Reg src, const uint32 a) const override { return digit(this, src).equal_to(a); }
+	bool is_Mp(const Reg src) const override { return digit(this, src).equal_to_Mp(); }
+
+	void square_mul(const Reg src, const uint32 a = 1) const override
+	{
+		std::vector<uint64> & d = _reg[size_t(src)];
+		forward(d, _x1, _x61);
+		uint64 * const x1 = _x1.data(); gf61 * const x61 = _x61.data();
+		par(_n, [=](const size_t b, const size_t e)
+		{
+			for (size_t k = b; k < e; ++k) { x1[k] = mod_sqr(x1[k]); x61[k] = math::Mod64::mul61_2(x61[k], x61[k]); }
+		});
+		backward(_x1, _x61, d);
+
+		if (a != 1)
+		{
+			std::vector<int128> v(_n);
+			for (size_t k = 0; k < _n; ++k) v[k] = int128(d[k]) * a;
+			carry(v, d);
+		}
+	}
+
+	// Registers stay in digit form: the multiplicand is transformed by mul.
+	void set_multiplicand(const Reg dst, const Reg src) const override { if (dst != src) copy(dst, src); }
+
+	void mul(const Reg dst, const Reg src) const override
+	{
+		forward(_reg[size_t(dst)], _x1, _x61);
+		forward(_reg[size_t(src)], _y1, _y61);
+		uint64 * const x1 = _x1.data(); gf61 * const x61 = _x61.data();
+		const uint64 * const y1 = _y1.data(); const gf61 * const y61 = _y61.data();
+		par(_n, [=](const size_t b, const size_t e)
+		{
+			for (size_t k = b; k < e; ++k) { x1[k] = mod_mul(x1[k], y1[k]); x61[k] = math::Mod64::mul61_2(x61[k], y61[k]); }
+		});
+		backward(_x1, _x61, _reg[size_t(dst)]);
+	}
+
+	// src - a = src + (2^q - 1 - a), the carry is signed if negacyclic
+	void sub(const Reg src, const uint32 a) const override
+	{
+		std::vector<uint64> & d = _reg[size_t(src)];
+		std::vector<int128> v(_n);
+		if (_negacyclic)
+		{
+			for (size_t k = 0; k < _n; ++k) v[k] = d[k];
+			v[0] -= a;
+			carry(v, d);
+			return;
+		}
+		uint64 r = a;
+		for (size_t k = 0; k < _n; ++k)
+		{
+			const uint64 mask = (uint64(1) << _width[k]) - 1;
+			v[k] = int128(d[k]) + (mask - (r & mask));
+			r >>= _width[k];
+		}
+		carry(v, d);
+	}
+
+	void to_host(const size_t slot, const Reg src) const override
+	{
+		if (slot >= _host.size()) _host.resize(slot + 1);
+		_host[slot] = _reg[size_t(src)];
+	}
+
+	void from_host(const Reg dst, const size_t slot) const override { _reg[size_t(dst)] = _host.at(slot); }
+
+	bool get_host(const size_t slot, std::vector<char> & data) const override
+	{
+		if ((slot >= _host.size()) || _host[slot].empty()) return false;
+		data.resize(_n * sizeof(uint64));
+		std::memcpy(data.data(), _host[slot].data(), data.size());
+		return true;
+	}
+
+	bool set_host(const size_t slot, const std::vector<char> & data) const override
+	{
+		if (data.size() != _n * sizeof(uint64)) return false;
+		if (slot >= _host.size()) _host.resize(slot + 1);
+		_host[slot].resize(_n);
+		std::memcpy(_host[slot].data(), data.data(), data.size());
+		return true;
+	}
+
+	size_t get_checkpoint_size() const override { return _reg_count * _n * sizeof(uint64); }
+
+	bool get_checkpoint(std::vector<char> & data) const override
+	{
+		if (data.size() != get_checkpoint_size()) return false;
+		for (size_t i = 0; i < _reg_count; ++i) std::memcpy(&data[i * _n * sizeof(uint64)], _reg[i].data(), _n * sizeof(uint64));
+		return true;
+	}
+
+	bool set_checkpoint(const std::vector<char> & data) const override
+	{
+		if (data.size() != get_checkpoint_size()) return false;
+		for (size_t i = 0; i < _reg_count; ++i) std::memcpy(_reg[i].data(), &data[i * _n * sizeof(uint64)], _n * sizeof(uint64));
+		return true;
+	}
+};
@@ -7,6 +7,8 @@ Please give feedback to the authors if improvement is realized. It is distribute
 
 #pragma once
 
+#include <cstring>
+
 #include "engine.h"
 #include "ibdwt.h"
 #include "ocl.h"
@@ -39,10 +41,18 @@ private:
 	const int _lcwm_wg_size, _lcwm_wg_size2;
 	const size_t _blk16, _blk64, _blk40, _blk160, _blk640;
 	const size_t _chunk16, _chunk64, _chunk256, _chunk16_5, _chunk64_5;
+	const size_t _red_wg_size;
+	const size_t _reg_per_shard;
 	static const size_t _blk4 = 0, _blk256 = 1, _blk1024 = 1, _blk2560 = 1, _chunk4 = 0, _chunk1024 = 1, _chunk4_5 = 0, _chunk256_5 = 1;
 
 	// reg is the weighted representation of registers R0, R1, ...
-	cl_mem _reg = nullptr, _carry = nullptr, _root = nullptr, _weight = nullptr, _digit_width = nullptr;
+	// Registers are spread across shards of _reg_per_shard registers such that no buffer exceeds CL_DEVICE_MAX_MEM_ALLOC_SIZE.
+	std::vector<cl_mem> _reg;
+	cl_mem _carry = nullptr, _root = nullptr, _weight = nullptr, _digit_width = nullptr;
+	// the carry of the operations on the side queue
+	cl_mem _carry_side = nullptr;
+	// res holds the few words returned by reduce_digits and compare
+	cl_mem _res = nullptr;
 
 	cl_kernel _forward4x2 = nullptr, _backward4x2 = nullptr;
 	cl_kernel _forward16x2 = nullptr, _backward16x2 = nullptr;
@@ -71,18 +81,20 @@ private:
 	cl_kernel _carry_weight_mul_p1 = nullptr, _carry_weight_mul_p2 = nullptr, _carry_weight_mul2_p1 = nullptr, _carry_weight_mul2_p2 = nullptr;
 	cl_kernel _copy = nullptr;
 	cl_kernel _subtract = nullptr, _subtract2 = nullptr;
+	cl_kernel _reduce_digits = nullptr, _compare = nullptr;
 
 	std::vector<cl_kernel> _kernels;
 
 public:
-	gpu(const ocl::platform & platform, const size_t d, const size_t n, const bool even, const size_t reg_count, const bool verbose, const size_t chunk256_max = 4)
+	gpu(const ocl::platform & platform, const size_t d, const size_t n, const bool even, const size_t reg_count, const bool verbose, const size_t chunk256_max = 4,
+		const engine::geometry & geom = engine::geometry())
 		: device(platform, d, verbose), _n(n), _even(even), _reg_count(reg_count),
-		_lcwm_wg_size(ilog2_32(uint32_t(std::min(((n % 5 == 0) ? n / 5 : n) / 4, get_max_local_worksize(sizeof(uint64)))))),
-		_lcwm_wg_size2(ilog2_32(uint32_t(std::min(((n % 5 == 0) ? n / 5 : n) / 8, get_max_local_worksize(2 * sizeof(uint64)))))),
+		_lcwm_wg_size(pick_log2(geom.cwm_wg_size, ilog2_32(uint32_t(std::min(((n % 5 == 0) ? n / 5 : n) / 4, get_max_local_worksize(sizeof(uint64))))))),
+		_lcwm_wg_size2(pick_log2(geom.cwm_wg_size, ilog2_32(uint32_t(std::min(((n % 5 == 0) ? n / 5 : n) / 8, get_max_local_worksize(2 * sizeof(uint64))))))),
 
 		// We must have (u / 4) * BLKu <= n / 8
-		_blk16((n >= 512) ? 16 : 1),	// 16 * BLK16 uint64_2 <= 4KB, workgroup size = (16 / 4) * BLK16 <= 64
-		_blk64((n >= 512) ? 4 : 1),		// 64 * BLK64 uint64_2 <= 4KB, workgroup size = (64 / 4) * BLK64 <= 64
+		_blk16(pick(geom.blk16, (n >= 512) ? 16 : 1)),	// 16 * BLK16 uint64_2 <= 4KB, workgroup size = (16 / 4) * BLK16 <= 64
+		_blk64(pick(geom.blk64, (n >= 512) ? 4 : 1)),		// 64 * BLK64 uint64_2 <= 4KB, workgroup size = (64 / 4) * BLK64 <= 64
 		// 256 uint64_2 = 4KB, workgroup size = 256 / 4 = 64; 1024 uint64_2 = 16KB, workgroup size <= 1024 / 4 = 256
 
 		// We must have (u / 8) * BLKu <= n / 8
@@ -92,18 +104,54 @@ public:
 		// 2560: 1280 uint64_2 = 20KB, workgroup size = 2560 / 8 = 320
 
 		// We must have (u / 4) * CHUNKu <= n / 8 and CHUNKu < m
-		_chunk16(std::min(std::max(n / 8 * 4 / 16, size_t(1)), size_t(16))),	// 16 * CHUNK16 uint64_2 <= 4KB, workgroup size = (16 / 4) * CHUNK16 <= 64
-		_chunk64(std::min(std::max(n / 8 * 4 / 64, size_t(1)), size_t(4))),		// 64 * CHUNK64 uint64_2 <= 4KB, workgroup size = (64 / 4) * CHUNK64 <= 64
-		_chunk256(std::min(std::max(n / 8 * 4 / 256, size_t(1)), size_t(chunk256_max))),	// 256 * CHUNK256 uint64_2 <= 16KB, workgroup size = (256 / 4) * CHUNK256 <= 256
+		_chunk16(pick(geom.chunk16, std::min(std::max(n / 8 * 4 / 16, size_t(1)), size_t(16)))),	// 16 * CHUNK16 uint64_2 <= 4KB, workgroup size = (16 / 4) * CHUNK16 <= 64
+		_chunk64(pick(geom.chunk64, std::min(std::max(n / 8 * 4 / 64, size_t(1)), size_t(4)))),		// 64 * CHUNK64 uint64_2 <= 4KB, workgroup size = (64 / 4) * CHUNK64 <= 64
+		_chunk256(pick(geom.chunk256, std::min(std::max(n / 8 * 4 / 256, size_t(1)), size_t(chunk256_max)))),	// 256 * CHUNK256 uint64_2 <= 16KB, workgroup size = (256 / 4) * CHUNK256 <= 256
 		// 1024: 1024 uint64_2 = 16KB, workgroup size = 1024 / 4 = 256
 
 		// We must have 5 * (u / 4) * CHUNKu <= n / 8
 		_chunk16_5(std::min(std::max(n / 8 / 5 * 4 / 16, size_t(1)), size_t(8))),	// 5 * 16 * CHUNK16_5 uint64_2 <= 10KB, workgroup size = 5 * (16 / 4) * CHUNK16_5 <= 160 = 5 * 32
-		_chunk64_5(std::min(std::max(n / 8 / 5 * 4 / 46, size_t(1)), size_t(2)))	// 5 * 64 * CHUNK64_5 uint64_2 <= 10KB, workgroup size = 5 * (64 / 4) * CHUNK64_5 <= 160
+		_chunk64_5(std::min(std::max(n / 8 / 5 * 4 / 46, size_t(1)), size_t(2))),	// 5 * 64 * CHUNK64_5 uint64_2 <= 10KB, workgroup size = 5 * (64 / 4) * CHUNK64_5 <= 160
 		// 256: 5 * 256 uint64_2 = 20KB, workgroup size = 5 * (256 / 4) = 320
+
+		// The largest power of two <= 256 that divides n and fits in a workgroup
+		_red_wg_size(red_wg_size(n, get_max_workgroup_size())),
+
+		_reg_per_shard(reg_per_shard(n, reg_count, get_max_mem_alloc_size()))
  	{}
 	virtual ~gpu() {}
 
+	// The built-in sizes are the largest legal ones: a tuned size is a power of two below them
+	static size_t pick(const size_t want, const size_t max)
+	{
+		if (want == 0) return max;
+		size_t s = 1;
+		while ((2 * s <= want) && (2 * s <= max)) s *= 2;
+		return s;
+	}
+
+	static int pick_log2(const size_t want, const int max_log2)
+	{
+		return ilog2_32(uint32_t(pick(want, size_t(1) << max_log2)));
+	}
+
+	static size_t red_wg_size(const size_t n, const size_t max_size)
+	{
+		size_t s = 1;
+		while ((s < 256) && (2 * s <= max_size) && (n % (2 * s) == 0)) s *= 2;
+		return s;
+	}
+
+	// The number of registers of a shard: the buffer must fit in a single allocation and the offsets in a uint32
+	static size_t reg_per_shard(const size_t n, const size_t reg_count, const size_t max_alloc_size)
+	{
+		size_t r = (size_t(1) << 32) / n;
+		if (max_alloc_size != 0) r = std::min(r, max_alloc_size / (n * sizeof(uint64)));
+		return std::max(std::min(r, reg_count), size_t(1));
+	}
+
+	size_t get_shard_count() const { return (_reg_count + _reg_per_shard - 1) / _reg_per_shard; }
+
 	int get_lcwm_wg_size() const { return _lcwm_wg_size; }
 	int get_lcwm_wg_size2() const { return _lcwm_wg_size2; }
 	size_t get_blk16() const { return _blk16; }
@@ -116,6 +164,7 @@ public:
 	size_t get_chunk256() const { return _chunk256; }
 	size_t get_chunk16_5() const { return _chunk16_5; }
 	size_t get_chunk64_5() const { return _chunk64_5; }
+	size_t get_red_wg_size() const { return _red_wg_size; }
 
 ///////////////////////////////
 
@@ -127,11 +176,17 @@ public:
 		const size_t n = _n;
 		if (n != 0)
 		{
-			_reg = _create_buffer(CL_MEM_READ_WRITE, _reg_count * n * sizeof(uint64));
+			for (size_t i = 0, count = get_shard_count(); i < count; ++i)
+			{
+				const size_t reg_count = std::min(_reg_per_shard, _reg_count - i * _reg_per_shard);
+				_reg.push_back(_create_buffer(CL_MEM_READ_WRITE, reg_count * n * sizeof(uint64)));
+			}
 			_carry = _create_buffer(CL_MEM_READ_WRITE, n / 4 * sizeof(uint64));
+			_carry_side = _create_buffer(CL_MEM_READ_WRITE, n / 4 * sizeof(uint64));
 			_root = _create_buffer(CL_MEM_READ_ONLY, 2 * n * sizeof(uint64));
 			_weight = _create_buffer(CL_MEM_READ_ONLY, 3 * n * sizeof(uint64));
 			_digit_width = _create_buffer(CL_MEM_READ_ONLY, n * sizeof(uint8));
+			_res = _create_buffer(CL_MEM_READ_WRITE, 3 * sizeof(uint64));
 		}
 	}
 
@@ -142,8 +197,11 @@ public:
 #endif
 		if (_n != 0)
 		{
-			_release_buffer(_reg); _release_buffer(_carry);
+			for (cl_mem & reg : _reg) _release_buffer(reg);
+			_reg.clear();
+			_release_buffer(_carry); _release_buffer(_carry_side);
 			_release_buffer(_root); _release_buffer(_weight); _release_buffer(_digit_width);
+			_release_buffer(_res);
 		}
 	}
 
@@ -152,7 +210,7 @@ public:
 	cl_kernel create_kernel_transform(const char * const kernel_name)
 	{
 		cl_kernel kernel = _create_kernel(kernel_name);
-		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &_reg);
+		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &_reg[0]);
 		_set_kernel_arg(kernel, 1, sizeof(cl_mem), &_root);
 		_kernels.push_back(kernel);
 		return kernel;
@@ -161,7 +219,7 @@ public:
 	cl_kernel create_kernel_carry(const char * const kernel_name)
 	{
 		cl_kernel kernel = _create_kernel(kernel_name);
-		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &_reg);
+		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &_reg[0]);
 		_set_kernel_arg(kernel, 1, sizeof(cl_mem), &_carry);
 		_set_kernel_arg(kernel, 2, sizeof(cl_mem), &_weight);
 		_set_kernel_arg(kernel, 3, sizeof(cl_mem), &_digit_width);
@@ -172,7 +230,7 @@ public:
 	cl_kernel create_kernel_subtract(const char * const kernel_name)
 	{
 		cl_kernel kernel = _create_kernel(kernel_name);
-		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &_reg);
+		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &_reg[0]);
 		_set_kernel_arg(kernel, 1, sizeof(cl_mem), &_weight);
 		_set_kernel_arg(kernel, 2, sizeof(cl_mem), &_digit_width);
 		_kernels.push_back(kernel);
@@ -307,11 +365,19 @@ public:
 		}
 
 		_copy = _create_kernel("copy");
-		_set_kernel_arg(_copy, 0, sizeof(cl_mem), &_reg);
+		_set_kernel_arg(_copy, 0, sizeof(cl_mem), &_reg[0]);
 		_kernels.push_back(_copy);
 
 		if (_even) _subtract = create_kernel_subtract("subtract");
 		else _subtract2 = create_kernel_subtract("subtract2");
+
+		_reduce_digits = create_kernel_subtract("reduce_digits");
+		_set_kernel_arg(_reduce_digits, 3, sizeof(cl_mem), &_res);
+
+		_compare = _create_kernel("compare");
+		_set_kernel_arg(_compare, 0, sizeof(cl_mem), &_reg[0]);
+		_set_kernel_arg(_compare, 1, sizeof(cl_mem), &_res);
+		_kernels.push_back(_compare);
 	}
 
 	void release_kernels()
@@ -325,10 +391,39 @@ public:
 
 ///////////////////////////////
 
-	void read_regs(uint64 * const ptr) { _read_buffer(_reg, ptr, _reg_count * _n * sizeof(uint64)); }
-	void write_regs(const uint64 * const ptr) { _write_buffer(_reg, ptr, _reg_count * _n * sizeof(uint64)); }
-	void read_reg(uint64 * const ptr, const size_t index) { _read_buffer(_reg, ptr, _n * sizeof(uint64), index * _n * sizeof(uint64)); }
-	void write_reg(const uint64 * const ptr, const size_t index) { _write_buffer(_reg, ptr, _n * sizeof(uint64), index * _n * sizeof(uint64)); }
+	void read_regs(uint64 * const ptr)
+	{
+		for (size_t i = 0; i < _reg.size(); ++i)
+		{
+			const size_t reg_count = std::min(_reg_per_shard, _reg_count - i * _reg_per_shard);
+			_read_buffer(_reg[i], &ptr[i * _reg_per_shard * _n], reg_count * _n * sizeof(uint64));
+		}
+	}
+	void write_regs(const uint64 * const ptr)
+	{
+		for (size_t i = 0; i < _reg.size(); ++i)
+		{
+			const size_t reg_count = std::min(_reg_per_shard, _reg_count - i * _reg_per_shard);
+			_write_buffer(_reg[i], &ptr[i * _reg_per_shard * _n], reg_count * _n * sizeof(uint64));
+		}
+	}
+	void snapshot_regs()
+	{
+		_snapshot_alloc(_reg_count * _n * sizeof(uint64));
+		for (size_t i = 0; i < _reg.size(); ++i)
+		{
+			const size_t reg_count = std::min(_reg_per_shard, _reg_count - i * _reg_per_shard);
+			_snapshot_copy(_reg[i], reg_count * _n * sizeof(uint64), 0, i * _reg_per_shard * _n * sizeof(uint64));
+		}
+		_snapshot_read();
+	}
+	const uint64 * snapshot() { return static_cast<const uint64 *>(_snapshot_wait()); }
+	void read_reg(uint64 * const ptr, const size_t index) { _read_buffer(shard(index), ptr, _n * sizeof(uint64), offset(index) * sizeof(uint64)); }
+	void reg_to_host(const size_t slot, const size_t index) { _spill_read(slot, shard(index), _n * sizeof(uint64), offset(index) * sizeof(uint64)); }
+	void reg_from_host(const size_t index, const size_t slot) { _spill_write(slot, shard(index), _n * sizeof(uint64), offset(index) * sizeof(uint64)); }
+	const void * host_slot(const size_t slot) { return _spill_wait(slot); }
+	void * host_slot(const size_t slot, const size_t size) { return _spill_host(slot, size); }
+	void write_reg(const uint64 * const ptr, const size_t index) { _write_buffer(shard(index), ptr, _n * sizeof(uint64), offset(index) * sizeof(uint64)); }
 
 	void write_root(const uint64 * const ptr) { _write_buffer(_root, ptr, 2 * _n * sizeof(uint64)); }
 	void write_weight(const uint64 * const ptr) { _write_buffer(_weight, ptr, 3 * _n * sizeof(uint64)); }
@@ -336,9 +431,28 @@ public:
 
 ///////////////////////////////
 
+	void set_carry(cl_mem & carry)
+	{
+		for (cl_kernel kernel : { _carry_weight_mul_p1, _carry_weight_mul_p2, _carry_weight_mul2_p1, _carry_weight_mul2_p2 })
+		{
+			if (kernel != nullptr) _set_kernel_arg(kernel, 1, sizeof(cl_mem), &carry);
+		}
+	}
+
+	// The arguments are read when a kernel is queued: the side queue gets its carry buffer meanwhile.
+	void begin_side() { device::begin_side(); set_carry(_carry_side); }
+	void end_side() { set_carry(_carry); device::end_side(); }
+	void join_side() { end_side(); device::join_side(); }
+
+///////////////////////////////
+
+	cl_mem & shard(const size_t index) { return _reg[index / _reg_per_shard]; }
+	uint32 offset(const size_t index) const { return uint32((index % _reg_per_shard) * _n); }
+
 	void ek_fb(cl_kernel & kernel, const size_t src, const uint32 lm, const size_t local_size = 0)
 	{
-		const uint32 offset = uint32(src * _n);
+		const uint32 offset = this->offset(src);
+		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &shard(src));
 		_set_kernel_arg(kernel, 2, sizeof(uint32), &offset);
 		_set_kernel_arg(kernel, 3, sizeof(uint32), &lm);
 		_execute_kernel(kernel, _n / 8, local_size);
@@ -346,24 +460,29 @@ public:
 
 	void ek_fms(cl_kernel & kernel, const size_t step, const size_t src, const size_t local_size = 0)
 	{
-		const uint32 offset = uint32(src * _n);
+		const uint32 offset = this->offset(src);
+		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &shard(src));
 		_set_kernel_arg(kernel, 2, sizeof(uint32), &offset);
 		_execute_kernel(kernel, _n / step, local_size);
 	}
 
 	void ek_mul(cl_kernel & kernel, const size_t step, const size_t dst, const size_t src, const size_t local_size = 0)
 	{
-		const uint32 offset_y = uint32(src * _n);
+		const uint32 offset_y = offset(src);
 		_set_kernel_arg(kernel, 3, sizeof(uint32), &offset_y);
+		_set_kernel_arg(kernel, 4, sizeof(cl_mem), &shard(src));
 		ek_fms(kernel, step, dst, local_size);
 	}
 
-	void ek_cwm(cl_kernel & kernel1, cl_kernel & kernel2, const size_t step, const int lcwm_wg_size, const size_t src, const uint32 a)
+	void ek_cwm(cl_kernel & kernel1, cl_kernel & kernel2, const size_t step, const int lcwm_wg_size, const size_t src, const uint32 a, const uint32 s)
 	{
-		const uint32 offset = uint32(src * _n);
+		const uint32 offset = this->offset(src);
+		_set_kernel_arg(kernel1, 0, sizeof(cl_mem), &shard(src));
 		_set_kernel_arg(kernel1, 4, sizeof(uint32), &a);
 		_set_kernel_arg(kernel1, 5, sizeof(uint32), &offset);
+		_set_kernel_arg(kernel1, 6, sizeof(uint32), &s);
 		_execute_kernel(kernel1, _n / step, 1u << lcwm_wg_size);
+		_set_kernel_arg(kernel2, 0, sizeof(cl_mem), &shard(src));
 		_set_kernel_arg(kernel2, 4, sizeof(uint32), &offset);
 		_execute_kernel(kernel2, (_n / step) >> lcwm_wg_size);
 	}
@@ -425,23 +544,27 @@ public:
 	DEFINE_SQR5(2560);
 	DEFINE_MUL5(2560);
 
-	void carry_weight_mul(const size_t src, const uint32 a)
+	// src = (src - s) * a, s below 2^(width of digit 0)
+	void carry_weight_mul(const size_t src, const uint32 a, const uint32 s = 0)
 	{
-		if (_even) ek_cwm(_carry_weight_mul_p1, _carry_weight_mul_p2, 4, _lcwm_wg_size, src, a);
-		else ek_cwm(_carry_weight_mul2_p1, _carry_weight_mul2_p2, 8, _lcwm_wg_size2, src, a);
+		if (_even) ek_cwm(_carry_weight_mul_p1, _carry_weight_mul_p2, 4, _lcwm_wg_size, src, a, s);
+		else ek_cwm(_carry_weight_mul2_p1, _carry_weight_mul2_p2, 8, _lcwm_wg_size2, src, a, s);
 	}
 
 	void copy(const size_t dst, const size_t src)
 	{
-		const uint32 offset_y = uint32(dst * _n), offset_x = uint32(src * _n);
+		const uint32 offset_y = offset(dst), offset_x = offset(src);
+		_set_kernel_arg(_copy, 0, sizeof(cl_mem), &shard(dst));
 		_set_kernel_arg(_copy, 1, sizeof(uint32), &offset_y);
 		_set_kernel_arg(_copy, 2, sizeof(uint32), &offset_x);
+		_set_kernel_arg(_copy, 3, sizeof(cl_mem), &shard(src));
 		_execute_kernel(_copy, _n);
 	}
 
 	void ek_sub(cl_kernel & kernel, const size_t src, const uint32 a)
 	{
-		const uint32 offset = uint32(src * _n);
+		const uint32 offset = this->offset(src);
+		_set_kernel_arg(kernel, 0, sizeof(cl_mem), &shard(src));
 		_set_kernel_arg(kernel, 3, sizeof(uint32), &offset);
 		_set_kernel_arg(kernel, 4, sizeof(uint32), &a);
 		_execute_kernel(kernel, 1);
@@ -452,6 +575,32 @@ public:
 		if (_even) ek_sub(_subtract, src, a);
 		else ek_sub(_subtract2, src, a);
 	}
+
+	// res[0] = low 64 bits, res[1] = flags, see reduce_digits
+	void reduce_digits(const size_t src, const uint32 a, uint64 * const res)
+	{
+		const uint32 offset = this->offset(src);
+		_set_kernel_arg(_reduce_digits, 0, sizeof(cl_mem), &shard(src));
+		_set_kernel_arg(_reduce_digits, 4, sizeof(uint32), &offset);
+		_set_kernel_arg(_reduce_digits, 5, sizeof(uint32), &a);
+		_execute_kernel(_reduce_digits, _red_wg_size, _red_wg_size);
+		_read_buffer(_res, res, 2 * sizeof(uint64));
+	}
+
+	bool compare(const size_t src1, const size_t src2)
+	{
+		const uint64 zero = 0;
+		_write_buffer(_res, &zero, sizeof(uint64), 2 * sizeof(uint64));
+		const uint32 offset_y = offset(src1), offset_x = offset(src2);
+		_set_kernel_arg(_compare, 0, sizeof(cl_mem), &shard(src1));
+		_set_kernel_arg(_compare, 2, sizeof(uint32), &offset_y);
+		_set_kernel_arg(_compare, 3, sizeof(uint32), &offset_x);
+		_set_kernel_arg(_compare, 4, sizeof(cl_mem), &shard(src2));
+		_execute_kernel(_compare, _n);
+		uint64 diff = 1;
+		_read_buffer(_res, &diff, sizeof(uint64), 2 * sizeof(uint64));
+		return (diff == 0);
+	}
 };
 
 class engine_gpu : public engine
@@ -460,18 +609,55 @@ private:
 	const size_t _reg_count;
 	const size_t _n;
 	const bool _even;
+	// modulo 2^q + 1 rather than 2^q - 1
+	const bool _negacyclic;
 	gpu * _gpu;
 	std::vector<uint64> _weight;
 	std::vector<uint8> _digit_width;
 
+	// Unweight and carry modulo 2^q + 1: the terms are signed and the carry out of the top wraps around
+	// negated. The digits are then in [0, 2^w), but for 2^q = -1 that is 2^w in the top digit.
+	void carry_negacyclic(uint64 * const d) const
+	{
+		const size_t n = _n;
+		const uint64 * const wi = &_weight.data()[2 * n];
+		const uint8 * const width = _digit_width.data();
+
+		int64_t c = 0;
+		for (size_t k = 0; k < n; ++k)
+		{
+			const uint64 u = mod_mul(d[k], wi[k]);
+			const int64_t t = ((u > MOD_P / 2) ? int64_t(u - MOD_P) : int64_t(u)) + c;
+			d[k] = uint64(t) & ((uint64(1) << width[k]) - 1);
+			c = t >> width[k];
+		}
+
+		while (c != 0)
+		{
+			c = -c;
+			for (size_t k = 0; (c != 0) && (k < n); ++k)
+			{
+				const int64_t t = int64_t(d[k]) + c;
+				d[k] = uint64(t) & ((uint64(1) << width[k]) - 1);
+				c = t >> width[k];
+			}
+			if ((c == 1) && std::all_of(d, d + n, [](const uint64 x) { return x == 0; })) { d[n - 1] = uint64(1) << width[n - 1]; c = 0; }
+		}
+	}
+
 public:
-	engine_gpu(const uint32_t q, const size_t reg_count, const size_t device, const bool verbose, size_t chunk256_max = 4) : engine(),
-		_reg_count(reg_count), _n(ibdwt::transform_size(q)), _even(ibdwt::is_even(_n))
+	engine_gpu(const uint32_t q, const size_t reg_count, const size_t device, const bool verbose, size_t chunk256_max = 4,
+		const std::string & cache_path = "", const size_t size = 0, const bool negacyclic = false,
+		const geometry & geom = geometry()) : engine(),
+		_reg_count(reg_count), _n((size != 0) ? size : ibdwt::transform_size(q, negacyclic)), _even(ibdwt::is_even(_n)),
+		_negacyclic(negacyclic)
 	{
 		const size_t n = _n;
+		// a larger size is accepted to resume a checkpoint written with it
+		if (!ibdwt::is_supported(n) || (n < ibdwt::transform_size(q, negacyclic))) throw std::runtime_error("unsupported transform size");
 
 		const ocl::platform eng_platform = ocl::platform();
-		_gpu = new gpu(eng_platform, device, n, _even, _reg_count, verbose, chunk256_max);
+		_gpu = new gpu(eng_platform, device, n, _even, _reg_count, verbose, chunk256_max, geom);
 
 		std::ostringstream src;
 		src << "#define N_SZ\t" << n << "u" << std::endl;
@@ -502,10 +688,15 @@ public:
 		if (_even) src << "#define CWM_WG_SZ\t" << (1u << _gpu->get_lcwm_wg_size()) << "u" << std::endl;
 		else       src << "#define CWM_WG_SZ2\t" << (1u << _gpu->get_lcwm_wg_size2()) << "u" << std::endl;
 
-		src << "#define MAX_WG_SZ\t" << _gpu->get_max_workgroup_size() << std::endl << std::endl;
+		src << "#define MAX_WG_SZ\t" << _gpu->get_max_workgroup_size() << std::endl;
+		src << "#define RED_WG_SZ\t" << _gpu->get_red_wg_size() << "u" << std::endl;
+		if (_gpu->isAMD()) src << "#define AMD_MAD64\t1" << std::endl;
+		if (negacyclic) src << "#define NEGACYCLIC\t1" << std::endl;
+		src << std::endl;
 
 		if (!_gpu->read_OpenCL("ocl/kernel.cl", "src/ocl/kernel.h", "src_ocl_kernel", src)) src << src_ocl_kernel;
 
+		_gpu->set_binary_cache(cache_path);
 		_gpu->load_program(src.str());
 		_gpu->alloc_memory();
 		_gpu->create_kernels();
@@ -516,7 +707,7 @@ public:
 
 		_weight.resize(3 * n);
 		_digit_width.resize(n);
-		ibdwt::weights_widths(n, q, _weight.data(), _digit_width.data());
+		ibdwt::weights_widths(n, q, _weight.data(), _digit_width.data(), negacyclic);
 		_gpu->write_weight(_weight.data());
 		_gpu->write_width(_digit_width.data());
 	}
@@ -531,6 +722,29 @@ public:
 	}
 
 	size_t get_size() const override { return _n; }
+	size_t get_reg_count() const override { return _reg_count; }
+
+	geometry get_geometry() const override
+	{
+		geometry g;
+		g.chunk16 = _gpu->get_chunk16(); g.chunk64 = _gpu->get_chunk64(); g.chunk256 = _gpu->get_chunk256();
+		g.blk16 = _gpu->get_blk16(); g.blk64 = _gpu->get_blk64();
+		g.cwm_wg_size = size_t(1) << (_even ? _gpu->get_lcwm_wg_size() : _gpu->get_lcwm_wg_size2());
+		return g;
+	}
+
+	void set_profiling(const bool enable) const override { _gpu->set_profiling(enable); }
+	void display_profiles(const size_t count) const override
+	{
+		if ((count != 0) && (_gpu->get_profile_time() != 0)) _gpu->display_profiles(count);
+	}
+	std::vector<kernel_profile> get_profiles() const override
+	{
+		std::vector<kernel_profile> profiles;
+		_gpu->for_each_profile([&](const std::string & name, const size_t count, const cl_ulong time)
+			{ profiles.push_back(kernel_profile{ name, count, uint64(time) }); });
+		return profiles;
+	}
 
 	void set(const Reg dst, const uint64 a) const override
 	{
@@ -546,6 +760,28 @@ public:
 		_gpu->write_reg(x.data(), size_t(dst));
 	}
 
+	void set_digits(const Reg dst, const uint64 * const d) const override
+	{
+		const size_t n = _n;
+		const uint64 * const w = &_weight.data()[0];
+		std::vector<uint64> x(n);
+
+		// weight
+		for (size_t k = 0; k < n; ++k) x[k] = mod_mul(d[k], w[k]);
+
+		if (!_even)
+		{
+			// radix-2
+			for (size_t k = 0; k < n / 2; ++k)
+			{
+				const uint64 u0 = x[k + 0 * n / 2], u1 = x[k + 1 * n / 2];
+				x[k + 0 * n / 2] = mod_add(u0, u1); x[k + 1 * n / 2] = mod_sub(u0, u1);
+			}
+		}
+
+		_gpu->write_reg(x.data(), size_t(dst));
+	}
+
 	void get(uint64 * const d, const Reg src) const override
 	{
 		const size_t n = _n;
@@ -566,15 +802,19 @@ public:
 		}
 
 		// unweight, carry (strong)
-		uint64 c = 0;
-		for (size_t k = 0; k < n; ++k) d[k] = adc(mod_mul(d[k], wi[k]), width[k], c);
-
-		while (c != 0)
+		if (_negacyclic) carry_negacyclic(d);
+		else
 		{
-			for (size_t k = 0; k < n; ++k)
+			uint64 c = 0;
+			for (size_t k = 0; k < n; ++k) d[k] = adc(mod_mul(d[k], wi[k]), width[k], c);
+
+			while (c != 0)
 			{
-				d[k] = adc(d[k], width[k], c);
-				if (c == 0) break;
+				for (size_t k = 0; k < n; ++k)
+				{
+					d[k] = adc(d[k], width[k], c);
+					if (c == 0) break;
+				}
 			}
 		}
 
@@ -589,14 +829,37 @@ public:
 
 	bool is_equal(const Reg src1, const Reg src2) const override
 	{
-		const size_t n = _n;
-		std::vector<uint64> x(n), y(n);
+		return _gpu->compare(size_t(src1), size_t(src2));
+	}
 
-		_gpu->read_reg(x.data(), size_t(src1));
-		_gpu->read_reg(y.data(), size_t(src2));
+	// reduce_digits wraps around as 2^q - 1, a negacyclic register is read by the host
+	uint64 res64(const Reg src) const override
+	{
+		if (_negacyclic) return digit(this, src).res64();
+		uint64 res[2];
+		_gpu->reduce_digits(size_t(src), 0, res);
+		if ((res[1] & (4 | 8)) == 0) return res[0];
+		return digit(this, src).res64();
+	}
 
-		for (size_t k = 0; k < n; ++k) if (y[k] != x[k]) return false;
-		return true;
+	bool equal_to(const Reg src, const uint32 a) const override
+	{
+		if (!_negacyclic && ((a >> _digit_width[0]) == 0))
+		{
+			uint64 res[2];
+			_gpu->reduce_digits(size_t(src), a, res);
+			if ((res[1] & 4) == 0) return ((res[1] & 1) != 0);
+		}
+		return digit(this, src).equal_to(a);
+	}
+
+	bool is_Mp(const Reg src) const override
+	{
+		if (_negacyclic) return digit(this, src).equal_to_Mp();
+		uint64 res[2];
+		_gpu->reduce_digits(size_t(src), 0, res);
+		if ((res[1] & 4) == 0) return ((res[1] & 2) != 0);
+		return digit(this, src).equal_to_Mp();
 	}
 
 	void set_multiplicand(const Reg rdst, const Reg rsrc) const override
@@ -669,7 +932,8 @@ public:
 		}
 	}
 
-	void square_mul(const Reg rsrc, const uint32 a = 1) const override
+	// The transforms of a squaring, without the carry
+	void square_transform(const Reg rsrc) const
 	{
 		const size_t n = _n, src = size_t(rsrc), wg_size = _gpu->get_max_workgroup_size();
 		switch (n)
@@ -734,7 +998,19 @@ public:
 			default: throw std::runtime_error("An unexpected error has occurred.");
 		}
 
-		_gpu->carry_weight_mul(src, a);
+	}
+
+	void square_mul(const Reg rsrc, const uint32 a = 1) const override
+	{
+		square_transform(rsrc);
+		_gpu->carry_weight_mul(size_t(rsrc), a);
+	}
+
+	void square_sub(const Reg rsrc, const uint32 s) const override
+	{
+		if ((s >> _digit_width[0]) != 0) { engine::square_sub(rsrc, s); return; }
+		square_transform(rsrc);
+		_gpu->carry_weight_mul(size_t(rsrc), 1, s);
 	}
 
 	void mul(const Reg rdst, const Reg rsrc) const override
@@ -805,17 +1081,75 @@ public:
 		_gpu->carry_weight_mul(dst, 1);
 	}
 
-	void sub(const Reg src, const uint32 a) const override { _gpu->subtract(size_t(src), a); }
+	void sub(const Reg src, const uint32 a) const override
+	{
+		if (!_negacyclic) { _gpu->subtract(size_t(src), a); return; }
+
+		// the digits are signed: a is taken off the first one, the next carry fixes it
+		std::vector<uint64> d(_n);
+		get(d.data(), src);
+		for (size_t k = 0; k < _n; ++k) d[k] = uint32(d[k]);
+		d[0] = mod_sub(d[0], a);
+		set_digits(src, d.data());
+	}
+
+	void begin_side() const override { _gpu->begin_side(); }
+	void end_side() const override { _gpu->end_side(); }
+	void join_side() const override { _gpu->join_side(); }
+
+	void to_host(const size_t slot, const Reg src) const override
+	{
+		_gpu->join_side();
+		_gpu->reg_to_host(slot, size_t(src));
+	}
+
+	void from_host(const Reg dst, const size_t slot) const override
+	{
+		_gpu->join_side();
+		_gpu->reg_from_host(size_t(dst), slot);
+	}
+
+	bool get_host(const size_t slot, std::vector<char> & data) const override
+	{
+		const void * const host = _gpu->host_slot(slot);
+		if (host == nullptr) return false;
+		data.resize(_n * sizeof(uint64));
+		std::memcpy(data.data(), host, data.size());
+		return true;
+	}
+
+	bool set_host(const size_t slot, const std::vector<char> & data) const override
+	{
+		if (data.size() != _n * sizeof(uint64)) return false;
+		std::memcpy(_gpu->host_slot(slot, data.size()), data.data(), data.size());
+		return true;
+	}
 
 	size_t get_checkpoint_size() const override { return _reg_count * _n * sizeof(uint64); }
 
 	bool get_checkpoint(std::vector<char> & data) const override
 	{
 		if (data.size() != get_checkpoint_size()) return false;
+		_gpu->join_side();
 		_gpu->read_regs(reinterpret_cast<uint64 *>(data.data()));
 		return true;
 	}
 
+	bool begin_checkpoint(std::vector<char> & data) const override
+	{
+		if (data.size() != get_checkpoint_size()) return false;
+		_gpu->join_side();
+		_gpu->snapshot_regs();
+		return true;
+	}
+
+	bool end_checkpoint(std::vector<char> & data) const override
+	{
+		if (data.size() != get_checkpoint_size()) return false;
+		std::memcpy(data.data(), _gpu->snapshot(), data.size());
+		return true;
+	}
+
 	bool set_checkpoint(const std::vector<char> & data) const override
 	{
 		if (data.size() != get_checkpoint_size()) return false;
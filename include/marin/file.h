@@ -7,7 +7,9 @@ Please give feedback to the authors if improvement is realized. It is distribute
 
 #pragma once
 
+#include <bit>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -44,39 +46,42 @@ public:
 
 	uint32_t crc32() const { return _crc32; }
 
-	// Rosetta Code, CRC-32, C
+	// CRC-32 (IEEE 802.3), slicing-by-8: eight bytes per step, through eight tables built once (thread safe)
 	static uint32_t rc_crc32(const uint32_t crc32, const char * const buf, const size_t len)
 	{
-		static uint32_t table[256];
-		static bool have_table = false;
-	
-		// This check is not thread safe; there is no mutex
-		if (!have_table)
+		struct tables
 		{
-			// Calculate CRC table
-			for (size_t i = 0; i < 256; ++i)
+			uint32_t t[8][256];
+			tables()
 			{
-				uint32_t rem = uint32_t(i);  // remainder from polynomial division
-				for (size_t j = 0; j < 8; ++j)
+				for (size_t i = 0; i < 256; ++i)
 				{
-					if (rem & 1)
-					{
-						rem >>= 1;
-						rem ^= 0xedb88320;
-					}
-					else rem >>= 1;
+					uint32_t rem = uint32_t(i);
+					for (size_t j = 0; j < 8; ++j) rem = (rem & 1) ? (rem >> 1) ^ 0xedb88320 : rem >> 1;
+					t[0][i] = rem;
+				}
+				for (size_t k = 1; k < 8; ++k)
+				{
+					for (size_t i = 0; i < 256; ++i) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
 				}
-				table[i] = rem;
 			}
-			have_table = true;
-		}
+		};
+		static const tables T;
 
 		uint32_t crc = ~crc32;
-		for (size_t i = 0; i < len; ++i)
+		const uint8_t * p = reinterpret_cast<const uint8_t *>(buf);
+		size_t n = len;
+		if constexpr (std::endian::native == std::endian::little)
 		{
-			const uint8_t octet = uint8_t(buf[i]);  // cast to unsigned octet
-			crc = (crc >> 8) ^ table[(crc & 0xff) ^ octet];
+			for (; n >= 8; n -= 8, p += 8)
+			{
+				uint32_t lo, hi; std::memcpy(&lo, p, sizeof(lo)); std::memcpy(&hi, p + 4, sizeof(hi));
+				lo ^= crc;
+				crc = T.t[7][lo & 0xff] ^ T.t[6][(lo >> 8) & 0xff] ^ T.t[5][(lo >> 16) & 0xff] ^ T.t[4][lo >> 24]
+					^ T.t[3][hi & 0xff] ^ T.t[2][(hi >> 8) & 0xff] ^ T.t[1][(hi >> 16) & 0xff] ^ T.t[0][hi >> 24];
+			}
 		}
+		for (; n > 0; --n, ++p) crc = (crc >> 8) ^ T.t[0][(crc ^ *p) & 0xff];
 		return ~crc;
 	}
 
@@ -14,8 +14,12 @@ Please give feedback to the authors if improvement is realized. It is distribute
 class ibdwt
 {
 public:
-	static constexpr size_t transform_size(const uint32_t exponent)
+	// A negacyclic transform (modulo 2^q + 1) has signed convolution terms that must stay
+	// in (-p/2, p/2), hence a bit less per term.
+	static constexpr size_t transform_size(const uint32_t exponent, const bool negacyclic = false)
 	{
+		const uint32_t lim = negacyclic ? 63 : 64;
+
 		// Make sure the transform is long enough so that each 'digit' can't overflow after the convolution.
 		uint32_t w = 0, log2_n = 1, log2_n5 = 2;
 		do
@@ -25,16 +29,52 @@ public:
 			w = exponent >> log2_n;
 		// The condition is n * (2^{w + 1} - 1)^2 < 2^64 - 2^32 + 1.
 		// If (w + 1) * 2 + log2(n) = 63 then n * (2^{w + 1} - 1)^2 < n * (2^{w + 1})^2 = 2^63 < 2^64 - 2^32 + 1.
-		} while ((w + 1) * 2 + log2_n >= 64);
+		} while ((w + 1) * 2 + log2_n >= lim);
 
 		do
 		{
 			++log2_n5;
 			w = exponent / (5u << log2_n5);
 		// log2(5) ~ 2.3219 < 2.4
-		} while ((w + 1) * 2 + (log2_n5 + 2.4) >= 64);
+		} while ((w + 1) * 2 + (log2_n5 + 2.4) >= lim);
+
+		const size_t n = std::min(size_t(1) << log2_n, size_t(5) << log2_n5);	// must be >= 4
+
+		// The bound above takes every digit as w + 1 bits wide. Just past a size boundary
+		// most digits are w bits wide, and a shorter transform still fits.
+		for (size_t m = 4; m < n; m = next_size(m)) if (digits_fit(exponent, m, lim - 1)) return m;
+		return n;
+	}
+
+	// sizes handled by engine_gpu: 2^k (k = 2..26) and 5 * 2^k (k = 3..24)
+	static constexpr bool is_supported(const size_t n)
+	{
+		const size_t m = (n % 5 == 0) ? n / 5 : n;
+		if ((m & (m - 1)) != 0) return false;
+		return (n % 5 == 0) ? ((m >= (1u << 3)) && (m <= (1u << 24))) : ((m >= (1u << 2)) && (m <= (1u << 26)));
+	}
+
+	// the supported size that follows n: 2^k -> 5 * 2^{k-2} -> 2^{k+1}
+	static constexpr size_t next_size(const size_t n)
+	{
+		if (n % 5 == 0) return n / 5 * 8;
+		return is_supported(n / 4 * 5) ? n / 4 * 5 : 2 * n;
+	}
 
-		return std::min(size_t(1) << log2_n, size_t(5) << log2_n5);	// must be >= 4
+	// Worst case of a convolution term for carried digits: with c digits of w + 1 bits and
+	// n - c of w bits, a term is at most c * (2^{w + 1} - 1)^2 + (n - c) * (2^w - 1)^2
+	// (rearrangement inequality). It must be < 2^log2_lim, the margin of the bound above.
+	static constexpr bool digits_fit(const uint32_t exponent, const size_t n, const uint32_t log2_lim = 63)
+	{
+		const uint64 w = exponent / n, c = exponent - w * n;
+		if (w + 1 > 31) return false;
+		const uint64 lim = uint64(1) << log2_lim;
+		const uint64 m0 = (uint64(1) << w) - 1, m1 = (uint64(1) << (w + 1)) - 1;
+		const uint64 s0 = m0 * m0, s1 = m1 * m1;
+		if ((c != 0) && (s1 > lim / c)) return false;
+		const uint64 a = c * s1;
+		if ((n - c != 0) && (s0 > (lim - a) / (n - c))) return false;
+		return a + (n - c) * s0 < lim;
 	}
 
 	static constexpr bool is_even(const size_t n)
@@ -97,8 +137,11 @@ public:
 		}
 	}
 
-	// Init weights and digit widths
-	static void weights_widths(const size_t n, const uint32_t q, uint64 * const weight, uint8 * const width)
+	// Init weights and digit widths. A negacyclic transform also weights digit j by z^j,
+	// z a 2n-th root of unity: the cyclic convolution of the weighted digits is then the
+	// negacyclic one, z^n = -1 as 2^q = -1 modulo 2^q + 1.
+	static void weights_widths(const size_t n, const uint32_t q, uint64 * const weight, uint8 * const width,
+		const bool negacyclic = false)
 	{
 		uint64 * const w = &weight[0];
 		uint64 * const wi_n = &weight[n];
@@ -136,5 +179,16 @@ public:
 			w[j] = nr2r; wi_n[j] = mod_mul(nr2ri, inv_n); wi[j] = nr2ri;
 			ceil_qjm1_n = ceil_qj_n;
 		}
+
+		if (negacyclic)
+		{
+			const uint64 z = mod_root_nth(2 * n), zi = mod_invert(z);
+			uint64 z_j = z, zi_j = zi;
+			for (size_t j = 1; j < n; ++j)
+			{
+				w[j] = mod_mul(w[j], z_j); wi_n[j] = mod_mul(wi_n[j], zi_j); wi[j] = mod_mul(wi[j], zi_j);
+				z_j = mod_mul(z_j, z); zi_j = mod_mul(zi_j, zi);
+			}
+		}
 	}
 };
\ No newline at end of file
@@ -15,6 +15,10 @@ Please give feedback to the authors if improvement is realized. It is distribute
 	#include <CL/cl.h>
 #endif
 
+#include "opencl/ProgramCache.hpp"
+#include "opencl/Staging.hpp"
+#include "util/Trace.hpp"
+
 #include <cstdint>
 #include <cstring>
 #include <sstream>
@@ -23,6 +27,7 @@ Please give feedback to the authors if improvement is realized. It is distribute
 #include <fstream>
 #include <vector>
 #include <map>
+#include <memory>
 #include <algorithm>
 
 // #define ocl_debug		1
@@ -224,6 +229,7 @@ private:
 #endif
 	size_t _sync_count = 0;
 	cl_ulong _local_mem_size = 0;
+	cl_ulong _max_mem_alloc_size = 0;
 	size_t _max_workgroup_size = 0;
 	cl_ulong _timer_resolution = 0;
 	EVendor _vendor = EVendor::Unknown;
@@ -231,7 +237,23 @@ private:
 	cl_command_queue _queueF = nullptr;
 	cl_command_queue _queueP = nullptr;
 	cl_command_queue _queue = nullptr;
+	// side queue, see begin_side
+	cl_command_queue _queueS = nullptr;
+	bool _side_pending = false;
 	cl_program _program = nullptr;
+	std::string _binary_cache;
+	// registers and tables go through pinned memory, or are mapped on unified memory
+	std::unique_ptr<opencl::Staging> _staging;
+	bool _unified_memory = false;
+	// checkpoint snapshot, see _snapshot_alloc
+	cl_command_queue _queueC = nullptr;
+	cl_mem _snap = nullptr, _snap_pinned = nullptr;
+	void * _snap_host = nullptr;
+	size_t _snap_size = 0;
+	cl_event _snap_read = nullptr;
+	// host slots, see _spill_read
+	struct spill_slot { cl_mem pinned = nullptr; void * host = nullptr; size_t size = 0; cl_event read = nullptr; };
+	std::vector<spill_slot> _spill;
 
 	struct profile
 	{
@@ -266,9 +288,12 @@ public:
 		cl_ulong mem_cache_size; fatal(clGetDeviceInfo(_device, CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(mem_cache_size), &mem_cache_size, nullptr));
 		cl_uint mem_cache_line_size; fatal(clGetDeviceInfo(_device, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, sizeof(mem_cache_line_size), &mem_cache_line_size, nullptr));
 		fatal(clGetDeviceInfo(_device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(_local_mem_size), &_local_mem_size, nullptr));
+		fatal(clGetDeviceInfo(_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(_max_mem_alloc_size), &_max_mem_alloc_size, nullptr));
 		cl_ulong mem_const_size; fatal(clGetDeviceInfo(_device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(mem_const_size), &mem_const_size, nullptr));
 		fatal(clGetDeviceInfo(_device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(_max_workgroup_size), &_max_workgroup_size, nullptr));
 		fatal(clGetDeviceInfo(_device, CL_DEVICE_PROFILING_TIMER_RESOLUTION, sizeof(_timer_resolution), &_timer_resolution, nullptr));
+		cl_bool unified = CL_FALSE; fatal(clGetDeviceInfo(_device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, nullptr));
+		_unified_memory = (unified == CL_TRUE);
 
 		if (verbose)
 		{
@@ -279,7 +304,8 @@ public:
 				std::cout << "Running on device '" << device_name << "', vendor '" << device_vendor
 					<< "', version '" << device_version << "', driver '" << driver_version << "'." << std::endl
 					<< compute_units << " Compute Units @ " << max_clock_frequency << " MHz, local memory size = "
-					<< (_local_mem_size >> 10) << " kB, max work-group size = " << _max_workgroup_size << "." << std::endl << std::endl;
+					<< (_local_mem_size >> 10) << " kB, max work-group size = " << _max_workgroup_size
+					<< (_unified_memory ? ", unified host memory" : "") << "." << std::endl << std::endl;
 			}
 		}
 
@@ -289,9 +315,9 @@ public:
 		fatal(err_cc);
 		cl_int err_ccq;
 		_queueF = clCreateCommandQueue(_context, _device, 0, &err_ccq);
-		_queueP = clCreateCommandQueue(_context, _device, CL_QUEUE_PROFILING_ENABLE, &err_ccq);
-		_queue = _queueF;	// default queue is fast
+		_queue = _queueF;	// default queue is fast, the profiling queue is created by set_profiling
 		fatal(err_ccq);
+		_staging = std::make_unique<opencl::Staging>(_queueF, _unified_memory);
 
 		if (_vendor != EVendor::NVIDIA) _is_sync = true;
 	}
@@ -302,7 +328,11 @@ public:
 #if defined(ocl_debug)
 		std::cout << "Delete ocl device " << _d << "." << std::endl;
 #endif
-		fatal(clReleaseCommandQueue(_queueP));
+		_snapshot_release();
+		for (size_t i = 0; i < _spill.size(); ++i) _spill_release(i);
+		_staging.reset();
+		if (_queueS != nullptr) fatal(clReleaseCommandQueue(_queueS));
+		if (_queueP != nullptr) fatal(clReleaseCommandQueue(_queueP));
 		fatal(clReleaseCommandQueue(_queueF));
 		fatal(clReleaseContext(_context));
 	}
@@ -310,9 +340,11 @@ public:
 public:
 	size_t get_max_workgroup_size() const { return _max_workgroup_size; }
 	size_t get_local_mem_size() const { return _local_mem_size; }
+	size_t get_max_mem_alloc_size() const { return size_t(_max_mem_alloc_size); }
 	size_t get_max_local_worksize(const size_t type_size) const { return std::min(_max_workgroup_size, size_t(_local_mem_size) / type_size); }
 	size_t get_timer_resolution() const { return _timer_resolution; }
 	bool isIntel() const { return (_vendor == EVendor::INTEL); }
+	bool isAMD() const { return (_vendor == EVendor::AMD); }
 
 private:
 	static EVendor get_vendor(const std::string & vendor_string)
@@ -348,6 +380,13 @@ public:
 		return time;
 	}
 
+public:
+	template<typename F>
+	void for_each_profile(const F & f) const
+	{
+		for (const auto & it : _profile_map) if (it.second.count != 0) f(it.second.name, it.second.count, it.second.time);
+	}
+
 public:
 	void display_profiles(const size_t count) const
 	{
@@ -371,11 +410,61 @@ public:
 public:
 	void set_profiling(const bool enable)
 	{
+		join_side();
+		for (size_t i = 0; i < _spill.size(); ++i) _spill_wait(i);
+		if (enable && (_queueP == nullptr))
+		{
+			cl_int err_ccq;
+			_queueP = clCreateCommandQueue(_context, _device, CL_QUEUE_PROFILING_ENABLE, &err_ccq);
+			fatal(err_ccq);
+		}
 		_profile = enable;
 		_queue = enable ? _queueP : _queueF;
 		reset_profiles();
 	}
 
+public:
+	// The commands queued between begin_side and end_side wait for the ones queued before and may then run
+	// concurrently with the next ones, until join_side. Profiled launches are synchronous and stay on one queue.
+	// OpenCL 1.1: a marker and a wait for its event order the two queues.
+	void begin_side()
+	{
+		if (_profile || (_queue == _queueS)) return;
+		if (_queueS == nullptr)
+		{
+			cl_int err_ccq;
+			_queueS = clCreateCommandQueue(_context, _device, 0, &err_ccq);
+			fatal(err_ccq);
+		}
+		cl_event evt;
+		fatal(clEnqueueMarker(_queue, &evt));
+		fatal(clFlush(_queue));
+		fatal(clEnqueueWaitForEvents(_queueS, 1, &evt));
+		fatal(clReleaseEvent(evt));
+		_queue = _queueS;
+		_side_pending = true;
+	}
+
+	void end_side()
+	{
+		if (_queue != _queueS) return;
+		fatal(clFlush(_queueS));
+		_queue = _profile ? _queueP : _queueF;
+	}
+
+	// The next commands wait for the side queue.
+	void join_side()
+	{
+		end_side();
+		if (!_side_pending) return;
+		_side_pending = false;
+		cl_event evt;
+		fatal(clEnqueueMarker(_queueS, &evt));
+		fatal(clFlush(_queueS));
+		fatal(clEnqueueWaitForEvents(_queue, 1, &evt));
+		fatal(clReleaseEvent(evt));
+	}
+
 public:
 	bool read_OpenCL(const char * const clFileName, const char * const headerFileName, const char * const varName, std::ostringstream & src) const
 	{
@@ -417,23 +506,35 @@ public:
 		return true;
 	}
 
+public:
+	// directory of the compiled program cache, empty = disabled
+	void set_binary_cache(const std::string & path) { _binary_cache = path; }
+
 public:
 	void load_program(const std::string & program_src)
 	{
 #if defined(ocl_debug)
 		std::cout <<  "Load ocl program." << std::endl;
 #endif
-		const char * src[1]; src[0] = program_src.c_str();
-		cl_int err_cpws;
-		_program = clCreateProgramWithSource(_context, 1, src, nullptr, &err_cpws);
-		fatal(err_cpws);
-
 		char pgm_options[1024];
 		strcpy(pgm_options, "");
 #if defined(ocl_debug)
 		if (_vendor == EVendor::NVIDIA) strcat(pgm_options, " -cl-nv-verbose");
 		if (_vendor == EVendor::AMD) strcat(pgm_options, " -save-temps=.");
 #endif
+
+		const opencl::ProgramCache cache(_binary_cache);
+		const std::string cache_key = cache.enabled() ? cache.makeKey(_device, program_src, pgm_options) : "";
+		_program = cache.load(_context, _device, cache_key, pgm_options);
+		if (_program != nullptr) return;
+		_program = cache.loadIL(_context, _device, program_src, pgm_options);
+		if (_program != nullptr) { cache.store(_program, cache_key); return; }
+
+		const char * src[1]; src[0] = program_src.c_str();
+		cl_int err_cpws;
+		_program = clCreateProgramWithSource(_context, 1, src, nullptr, &err_cpws);
+		fatal(err_cpws);
+
 		const cl_int err = clBuildProgram(_program, 1, &_device, pgm_options, nullptr, nullptr);
 
 #if !defined(ocl_debug)
@@ -457,6 +558,8 @@ public:
 		}
 
 		fatal(err);
+		cache.store(_program, cache_key);
+		cache.requestIL(program_src, pgm_options);
 
 #if defined(ocl_debug)
 		size_t bin_size; clGetProgramInfo(_program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &bin_size, nullptr);
@@ -490,7 +593,9 @@ public:
 	cl_mem _create_buffer(const cl_mem_flags flags, const size_t size, const bool clear = true) const
 	{
 		cl_int err;
-		cl_mem mem = clCreateBuffer(_context, flags, size, nullptr, &err);
+		// host memory the device uses as is: _read_buffer and _write_buffer map it
+		const cl_mem_flags host_flags = _unified_memory ? CL_MEM_ALLOC_HOST_PTR : 0;
+		cl_mem mem = clCreateBuffer(_context, flags | host_flags, size, nullptr, &err);
 		fatal(err);
 		if (clear)
 		{
@@ -518,14 +623,141 @@ protected:
 		char * const cptr = static_cast<char *>(ptr);
 		for (size_t i = 0; i < size; ++i) cptr[i] = char(std::rand());
 		_sync();
-		fatal(clEnqueueReadBuffer(_queue, mem, CL_TRUE, offset, size, ptr, 0, nullptr, nullptr));
+		fatal(_staging->read(mem, ptr, size, offset, _queue));
 	}
 
 protected:
 	void _write_buffer(cl_mem & mem, const void * const ptr, const size_t size, const size_t offset = 0)
 	{
 		_sync();
-		fatal(clEnqueueWriteBuffer(_queue, mem, CL_TRUE, offset, size, ptr, 0, nullptr, nullptr));
+		fatal(_staging->write(mem, ptr, size, offset, _queue));
+	}
+
+protected:
+	// A checkpoint is first copied on the device, which is quick, and the copy is read back into pinned memory on a queue
+	// of its own while the next iterations run: _snapshot_copy queues the pieces of the copy, _snapshot_read the readback
+	// and _snapshot_wait returns the host data once there. The buffers are allocated at the first checkpoint.
+	void _snapshot_alloc(const size_t size)
+	{
+		_snapshot_wait();
+		if (size == _snap_size) return;
+		_snapshot_release();
+		cl_int err;
+		_queueC = clCreateCommandQueue(_context, _device, 0, &err);
+		fatal(err);
+		_snap = _create_buffer(CL_MEM_READ_WRITE, size, false);
+		_snap_pinned = clCreateBuffer(_context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr, &err);
+		fatal(err);
+		_snap_host = clEnqueueMapBuffer(_queueC, _snap_pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, nullptr, nullptr, &err);
+		fatal(err);
+		_snap_size = size;
+	}
+
+	void _snapshot_copy(cl_mem & mem, const size_t size, const size_t offset, const size_t snap_offset)
+	{
+		fatal(clEnqueueCopyBuffer(_queue, mem, _snap, offset, snap_offset, size, 0, nullptr, nullptr));
+	}
+
+	void _snapshot_read()
+	{
+		cl_event copied;
+		fatal(clEnqueueMarker(_queue, &copied));
+		fatal(clFlush(_queue));
+		fatal(clEnqueueReadBuffer(_queueC, _snap, CL_FALSE, 0, _snap_size, _snap_host, 1, &copied, &_snap_read));
+		fatal(clFlush(_queueC));
+		fatal(clReleaseEvent(copied));
+	}
+
+	// May be called on another thread than the one queuing the kernels
+	const void * _snapshot_wait()
+	{
+		if (_snap_read != nullptr)
+		{
+			fatal(clWaitForEvents(1, &_snap_read));
+			fatal(clReleaseEvent(_snap_read));
+			_snap_read = nullptr;
+		}
+		return _snap_host;
+	}
+
+	void _snapshot_release()
+	{
+		_snapshot_wait();
+		if (_snap_host != nullptr)
+		{
+			fatal(clEnqueueUnmapMemObject(_queueC, _snap_pinned, _snap_host, 0, nullptr, nullptr));
+			fatal(clFinish(_queueC));
+			_snap_host = nullptr;
+		}
+		_release_buffer(_snap_pinned);
+		_release_buffer(_snap);
+		if (_queueC != nullptr) { fatal(clReleaseCommandQueue(_queueC)); _queueC = nullptr; }
+		_snap_size = 0;
+	}
+
+	// A host slot keeps a copy of a device range in pinned memory, out of the device memory. _spill_read queues the
+	// copy and returns: the queue is in order, the next kernels cannot overwrite the range before it is read.
+	// _spill_wait returns the host data once there, _spill_write queues the copy back.
+	void _spill_read(const size_t i, cl_mem & mem, const size_t size, const size_t offset)
+	{
+		void * const host = _spill_host(i, size);
+		fatal(clEnqueueReadBuffer(_queue, mem, CL_FALSE, offset, size, host, 0, nullptr, &_spill[i].read));
+		fatal(clFlush(_queue));
+	}
+
+	// The host memory of slot i, of size bytes, once no copy is pending
+	void * _spill_host(const size_t i, const size_t size)
+	{
+		if (i >= _spill.size()) _spill.resize(i + 1);
+		_spill_wait(i);
+		spill_slot & s = _spill[i];
+		if (s.size != size)
+		{
+			_spill_release(i);
+			cl_int err;
+			s.pinned = clCreateBuffer(_context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr, &err);
+			fatal(err);
+			s.host = clEnqueueMapBuffer(_queue, s.pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, nullptr, nullptr, &err);
+			fatal(err);
+			s.size = size;
+		}
+		return s.host;
+	}
+
+	void * _spill_wait(const size_t i)
+	{
+		if (i >= _spill.size()) return nullptr;
+		spill_slot & s = _spill[i];
+		if (s.read != nullptr)
+		{
+			fatal(clWaitForEvents(1, &s.read));
+			fatal(clReleaseEvent(s.read));
+			s.read = nullptr;
+		}
+		return s.host;
+	}
+
+	void _spill_write(const size_t i, cl_mem & mem, const size_t size, const size_t offset)
+	{
+		void * const host = _spill_wait(i);
+		if ((host == nullptr) || (_spill[i].size != size)) throw std::runtime_error("empty host slot");
+		// pinned: the copy is direct, and the slot is not written before the next _spill_read, queued after it
+		fatal(clEnqueueWriteBuffer(_queue, mem, CL_FALSE, offset, size, host, 0, nullptr, nullptr));
+		fatal(clFlush(_queue));
+	}
+
+	void _spill_release(const size_t i)
+	{
+		_spill_wait(i);
+		spill_slot & s = _spill[i];
+		if (s.host != nullptr)
+		{
+			fatal(clEnqueueUnmapMemObject(_queue, s.pinned, s.host, 0, nullptr, nullptr));
+			fatal(clFinish(_queue));
+			s.host = nullptr;
+		}
+		_release_buffer(s.pinned);
+		s.size = 0;
 	}
 
 protected:
@@ -589,7 +821,16 @@ protected:
 				cl_ulong start, end;
 				cl_int err_s = clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr);
 				cl_int err_e = clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr);
-				if ((err_s == CL_SUCCESS) && (err_e == CL_SUCCESS)) dt = end - start;
+				if ((err_s == CL_SUCCESS) && (err_e == CL_SUCCESS))
+				{
+					dt = end - start;
+					if (util::Trace::enabled())
+					{
+						// the launch is synchronous: it ended just now on the host clock
+						if (!util::Trace::gpuCalibrated()) util::Trace::setGpuOffset(int64_t(util::Trace::nowNs()) - int64_t(end));
+						util::Trace::gpu(_profile_map[kernel].name, start, end);
+					}
+				}
 			}
 			clReleaseEvent(evt);
 
@@ -47,6 +47,7 @@ static const char * const src_ocl_kernel = \
 "#define CWM_WG_SZ	32u\n" \
 "#define CWM_WG_SZ2	16u\n" \
 "#define MAX_WG_SZ	256\n" \
+"#define RED_WG_SZ	256u\n" \
 "#endif\n" \
 "\n" \
 "typedef uint	sz_t;\n" \
@@ -97,7 +98,20 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "INLINE uint64 mod_add(const uint64 lhs, const uint64 rhs) { return lhs + rhs + ((lhs >= MOD_P - rhs) ? MOD_MP64 : 0); }\n" \
 "INLINE uint64 mod_sub(const uint64 lhs, const uint64 rhs) { return lhs - rhs - ((lhs < rhs) ? MOD_MP64 : 0); }\n" \
+"#if defined(AMD_MAD64)\n" \
+"// The 128-bit product from 32 x 32 + 64 products, each one a v_mad_u64_u32 on AMD.\n" \
+"INLINE uint64 mod_mul(const uint64 lhs, const uint64 rhs)\n" \
+"{\n" \
+"	const uint32 a0 = (uint32)(lhs), a1 = (uint32)(lhs >> 32), b0 = (uint32)(rhs), b1 = (uint32)(rhs >> 32);\n" \
+"	const uint64 p00 = (uint64)(a0) * b0;\n" \
+"	const uint64 p01 = (uint64)(a0) * b1 + (p00 >> 32);\n" \
+"	const uint64 p10 = (uint64)(a1) * b0 + (uint32)(p01);\n" \
+"	const uint64 p11 = (uint64)(a1) * b1 + (p01 >> 32) + (p10 >> 32);\n" \
+"	return reduce((p10 << 32) | (uint32)(p00), p11);\n" \
+"}\n" \
+"#else\n" \
 "INLINE uint64 mod_mul(const uint64 lhs, const uint64 rhs) { return reduce(lhs * rhs, mul_hi(lhs, rhs)); }\n" \
+"#endif\n" \
 "INLINE uint64 mod_sqr(const uint64 lhs) { return mod_mul(lhs, lhs); }\n" \
 "INLINE uint64 mod_muli(const uint64 lhs) { return reduce(lhs << 48, lhs >> (64 - 48)); }	// sqrt(-1) = 2^48 (mod p)\n" \
 "INLINE uint64 mod_half(const uint64 lhs) { return ((lhs % 2 == 0) ? lhs / 2 : ((lhs - 1) / 2 + (MOD_P + 1) / 2)); }\n" \
@@ -154,6 +168,75 @@ static const char * const src_ocl_kernel = \
 "	return r;\n" \
 "}\n" \
 "\n" \
+"// 2^q - 1 - s spread over four digits, s on the first one: added to the\n" \
+"// unweighted digits (convolution sums, far below 2^64 - 2^32) before the carry,\n" \
+"// it subtracts s from the number without a borrow chain.\n" \
+"INLINE uint64_4 mersenne_sub4(const uint_8_4 width, const uint32 s)\n" \
+"{\n" \
+"	return (uint64_4)((((uint64)(1) << width.s0) - 1) - s, ((uint64)(1) << width.s1) - 1,\n" \
+"		((uint64)(1) << width.s2) - 1, ((uint64)(1) << width.s3) - 1);\n" \
+"}\n" \
+"\n" \
+"#if defined(NEGACYCLIC)\n" \
+"// Modulo 2^q + 1 the convolution is negacyclic: its terms are signed, x in (-p/2, p/2) being\n" \
+"// stored as x mod p. The carry is signed (shifts are arithmetic) and wraps around negated, 2^q = -1.\n" \
+"typedef long	carry_t;\n" \
+"typedef long2	carry_t2;\n" \
+"#define WRAP(c)	(-(c))\n" \
+"\n" \
+"INLINE long to_signed(const uint64 x) { return (x > MOD_P / 2) ? (long)(x - MOD_P) : (long)(x); }\n" \
+"INLINE uint64 from_signed(const long x) { return (x < 0) ? (uint64)(x) + MOD_P : (uint64)(x); }\n" \
+"\n" \
+"INLINE uint32 sadc(const long lhs, const uint_8 width, long * const carry)\n" \
+"{\n" \
+"	const long s = lhs + *carry;\n" \
+"	*carry = s >> width;\n" \
+"	return (uint32)(s) & ((1u << width) - 1);\n" \
+"}\n" \
+"\n" \
+"INLINE uint32 sadc_mul(const long lhs, const uint32 a, const uint_8 width, long * const carry)\n" \
+"{\n" \
+"	long c = 0;\n" \
+"	const uint32 d = sadc(lhs, width, &c);\n" \
+"	const uint32 r = sadc((long)(d) * a, width, carry);\n" \
+"	*carry += (long)(a) * c;\n" \
+"	return r;\n" \
+"}\n" \
+"\n" \
+"// The last digit keeps the carry, it may be negative\n" \
+"INLINE uint64_4 carry4(const uint64_4 lhs, const uint_8_4 width, const long carry)\n" \
+"{\n" \
+"	uint64_4 r;\n" \
+"	long c = carry;\n" \
+"	r.s0 = sadc(to_signed(lhs.s0), width.s0, &c);\n" \
+"	r.s1 = sadc(to_signed(lhs.s1), width.s1, &c);\n" \
+"	r.s2 = sadc(to_signed(lhs.s2), width.s2, &c);\n" \
+"	r.s3 = from_signed(to_signed(lhs.s3) + c);\n" \
+"	return r;\n" \
+"}\n" \
+"\n" \
+"INLINE uint64_4 carry_mul4(const uint64_4 lhs, const uint32 a, const uint_8_4 width, long * const carry)\n" \
+"{\n" \
+"	uint64_4 r;\n" \
+"	r.s0 = sadc_mul(to_signed(lhs.s0), a, width.s0, carry);\n" \
+"	r.s1 = sadc_mul(to_signed(lhs.s1), a, width.s1, carry);\n" \
+"	r.s2 = sadc_mul(to_signed(lhs.s2), a, width.s2, carry);\n" \
+"	r.s3 = sadc_mul(to_signed(lhs.s3), a, width.s3, carry);\n" \
+"	return r;\n" \
+"}\n" \
+"\n" \
+"// The digits are signed: s is taken off the first one\n" \
+"INLINE uint64_4 carry_sub4(const uint64_4 lhs, const uint_8_4 width, const uint32 s) { return (uint64_4)(mod_sub(lhs.s0, s), lhs.s123); }\n" \
+"#else\n" \
+"typedef uint64		carry_t;\n" \
+"typedef uint64_2	carry_t2;\n" \
+"#define WRAP(c)	(c)\n" \
+"#define carry4		adc4\n" \
+"#define carry_mul4	adc_mul4\n" \
+"\n" \
+"INLINE uint64_4 carry_sub4(const uint64_4 lhs, const uint_8_4 width, const uint32 s) { return lhs + mersenne_sub4(width, s); }\n" \
+"#endif\n" \
+"\n" \
 "// Subtract a carry and return the carry if borrowing\n" \
 "INLINE uint64 sbc(const uint64 lhs, const uint_8 width, uint32 * const carry)\n" \
 "{\n" \
@@ -398,10 +481,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "// Radix-2, mul2x2, inverse radix-2\n" \
 "__kernel\n" \
-"void mul4(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y)\n" \
+"void mul4(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	__global uint64_2 * restrict const x = (__global uint64_2 *)(&reg[offset_x]);\n" \
-"	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "	__global const uint64 * restrict const r0 = &root[0];\n" \
 "	__global const uint64 * restrict const r0i = &root[N_SZ];\n" \
 "\n" \
@@ -450,10 +533,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "// 2 x Radix-2, mul2x2, inverse radix-2\n" \
 "__kernel\n" \
-"void mul4x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y)\n" \
+"void mul4x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	__global uint64_2 * restrict const x = (__global uint64_2 *)(&reg[offset_x]);\n" \
-"	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "	__global const uint64_2 * restrict const r0 = (__global const uint64_2 *)&root[0];\n" \
 "	__global const uint64_2 * restrict const r0i = (__global const uint64_2 *)&root[N_SZ];\n" \
 "\n" \
@@ -558,10 +641,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "// Radix-2, radix-5, mul, inverse radix-5, inverse radix-2\n" \
 "__kernel\n" \
-"void mul10(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y)\n" \
+"void mul10(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	__global uint64_2 * restrict const x = (__global uint64_2 *)(&reg[offset_x]);\n" \
-"	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "	__global const uint64 * restrict const r2 = &root[0];\n" \
 "	__global const uint64 * restrict const r2i = &root[N_SZ];\n" \
 "	__global const uint64_2 * restrict const r5 = (__global const uint64_2 *)(&root[N_SZ / 5]);\n" \
@@ -905,10 +988,10 @@ static const char * const src_ocl_kernel = \
 "// 2 x Radix-4, mul4, inverse radix-4\n" \
 "__kernel\n" \
 "ATTR_16x2()\n" \
-"void mul16x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul16x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_16x2();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(2, &X[i4], 2, &x[k4], r2[j4], r4[j4]);\n" \
 "	mul_4x2(&X[i], &y[k], r0[j], r0i[j]);\n" \
@@ -954,10 +1037,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "__kernel\n" \
 "ATTR_64x2()\n" \
-"void mul64x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul64x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_64x2();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(8, &X[i16], 8, &x[k16], r2[j16], r4[j16]);\n" \
 "	forward_4(2, &X[i4], r2[j4], r4[j4]);\n" \
@@ -1009,10 +1092,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "__kernel\n" \
 "ATTR_256x2()\n" \
-"void mul256x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul256x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_256x2();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(32, &X[i64], 32, &x[k64], r2[j64], r4[j64]);\n" \
 "	forward_4(8, &X[i16], r2[j16], r4[j16]);\n" \
@@ -1070,10 +1153,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "__kernel\n" \
 "ATTR_1024x2()\n" \
-"void mul1024x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul1024x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_1024x2();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(128, &X[i256], 128, &x[k256], r2[j256], r4[j256]);\n" \
 "	forward_4(32, &X[i64], r2[j64], r4[j64]);\n" \
@@ -1254,10 +1337,10 @@ static const char * const src_ocl_kernel = \
 "// Radix-4, radix-2, radix-5, mul, inverse radix-5, inverse radix-2, inverse radix-4\n" \
 "__kernel\n" \
 "ATTR_40()\n" \
-"void mul40(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul40(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_40();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(1 * 5, &X[i1], 1 * 5, &x[k1], r2[j1], r4[j1]);\n" \
 "	mul_10(&X[i], &y[k], r0[j], r0i[j], r5[j], r5i[j], lid4 < 4 * WGSIZE40 / 5);\n" \
@@ -1306,10 +1389,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "__kernel\n" \
 "ATTR_160()\n" \
-"void mul160(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul160(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_160();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(4 * 5, &X[i4], 4 * 5, &x[k4], r2[j4], r4[j4]);\n" \
 "	forward_4(1 * 5, &X[i1], r2[j1], r4[j1]);\n" \
@@ -1364,10 +1447,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "__kernel\n" \
 "ATTR_640()\n" \
-"void mul640(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul640(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_640();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(16 * 5, &X[i16], 16 * 5, &x[k16], r2[j16], r4[j16]);\n" \
 "	forward_4(4 * 5, &X[i4], r2[j4], r4[j4]);\n" \
@@ -1428,10 +1511,10 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "__kernel\n" \
 "ATTR_2560()\n" \
-"void mul2560(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)\n" \
+"void mul2560(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)\n" \
 "{\n" \
 "	DECLARE_VAR_2560();\n" \
-"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);\n" \
+"	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);\n" \
 "\n" \
 "	forward_4i(64 * 5, &X[i64], 64 * 5, &x[k64], r2[j64], r4[j64]);\n" \
 "	forward_4(16 * 5, &X[i16], r2[j16], r4[j16]);\n" \
@@ -1452,41 +1535,43 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "#if defined(CWM_WG_SZ)\n" \
 "\n" \
-"// Unweight, carry, mul by a, weight (pass 1)\n" \
+"// Unweight, subtract s, carry, mul by a, weight (pass 1)\n" \
 "__kernel\n" \
-"void carry_weight_mul_p1(__global uint64 * restrict const reg, __global uint64 * restrict const carry,\n" \
-"	__global const uint64 * restrict const weight, __global const uint_8 * restrict const width, const uint32 a, const sz_t offset)\n" \
+"void carry_weight_mul_p1(__global uint64 * restrict const reg, __global carry_t * restrict const carry,\n" \
+"	__global const uint64 * restrict const weight, __global const uint_8 * restrict const width, const uint32 a, const sz_t offset,\n" \
+"	const uint32 s)\n" \
 "{\n" \
 "	__global uint64_4 * restrict const x = (__global uint64_4 *)(&reg[offset]);\n" \
 "	__global const uint64_4 * restrict const weight4 = (__global const uint64_4 *)(&weight[0]);\n" \
 "	__global const uint64_4 * restrict const weight4i_n = (__global const uint64_4 *)(&weight[N_SZ]);\n" \
 "	__global const uint_8_4 * restrict const width4 = (__global const uint_8_4 *)width;\n" \
-"	__local uint64 cl[CWM_WG_SZ];\n" \
+"	__local carry_t cl[CWM_WG_SZ];\n" \
 "\n" \
 "	const sz_t gid = (sz_t)get_global_id(0), lid = gid % CWM_WG_SZ;\n" \
 "\n" \
 "	const uint_8_4 wd = width4[gid];\n" \
 "\n" \
-"	uint64 c = 0;\n" \
+"	carry_t c = 0;\n" \
 "	uint64_4 u = mod_mul4(x[gid], weight4i_n[gid]);\n" \
-"	u = adc_mul4(u, a, wd, &c);\n" \
+"	if (s != 0) u = carry_sub4(u, wd, (gid == 0) ? s : 0);\n" \
+"	u = carry_mul4(u, a, wd, &c);\n" \
 "\n" \
 "	cl[lid] = c;\n" \
 "\n" \
 "	barrier(CLK_LOCAL_MEM_FENCE);\n" \
 "\n" \
-"	u = adc4(u, wd, (lid == 0) ? 0 : cl[lid - 1]);\n" \
+"	u = carry4(u, wd, (lid == 0) ? 0 : cl[lid - 1]);\n" \
 "	x[gid] = mod_mul4(u, weight4[gid]);\n" \
 "\n" \
 "	if (lid == CWM_WG_SZ - 1)\n" \
 "	{\n" \
-"		carry[(gid != N_SZ / 4 - 1) ? gid / CWM_WG_SZ + 1 : 0] = c;\n" \
+"		carry[(gid != N_SZ / 4 - 1) ? gid / CWM_WG_SZ + 1 : 0] = (gid != N_SZ / 4 - 1) ? c : WRAP(c);\n" \
 "	}\n" \
 "}\n" \
 "\n" \
 "// Unweight, carry, mul by a, weight (pass 2)\n" \
 "__kernel\n" \
-"void carry_weight_mul_p2(__global uint64 * restrict const reg, __global const uint64 * restrict const carry,\n" \
+"void carry_weight_mul_p2(__global uint64 * restrict const reg, __global const carry_t * restrict const carry,\n" \
 "	__global const uint64 * restrict const weight, __global const uint_8 * restrict const width, const sz_t offset)\n" \
 "{\n" \
 "	__global uint64_4 * restrict const x = (__global uint64_4 *)(&reg[offset]);\n" \
@@ -1499,7 +1584,7 @@ static const char * const src_ocl_kernel = \
 "	const uint_8_4 wd = width4[id];\n" \
 "\n" \
 "	uint64_4 u = mod_mul4(x[id], weight4i[id]);\n" \
-"	u = adc4(u, wd, carry[gid]);\n" \
+"	u = carry4(u, wd, carry[gid]);\n" \
 "	x[id] = mod_mul4(u, weight4[id]);\n" \
 "}\n" \
 "\n" \
@@ -1508,37 +1593,39 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "#define N_SZ_8	(N_SZ / 8)\n" \
 "\n" \
-"// Inverse radix-2, unweight, carry, mul by a, weight, radix-2 (pass 1)\n" \
+"// Inverse radix-2, unweight, subtract s, carry, mul by a, weight, radix-2 (pass 1)\n" \
 "__kernel\n" \
-"void carry_weight_mul2_p1(__global uint64 * restrict const reg, __global uint64 * restrict const carry,\n" \
-"	__global const uint64 * restrict const weight, __global const uint_8 * restrict const width, const uint32 a, const sz_t offset)\n" \
+"void carry_weight_mul2_p1(__global uint64 * restrict const reg, __global carry_t * restrict const carry,\n" \
+"	__global const uint64 * restrict const weight, __global const uint_8 * restrict const width, const uint32 a, const sz_t offset,\n" \
+"	const uint32 s)\n" \
 "{\n" \
 "	__global uint64_4 * restrict const x = (__global uint64_4 *)(&reg[offset]);\n" \
-"	__global uint64_2 * restrict const carry2 = (__global uint64_2 *)carry;\n" \
+"	__global carry_t2 * restrict const carry2 = (__global carry_t2 *)carry;\n" \
 "	__global const uint64_4 * restrict const weight4 = (__global const uint64_4 *)(&weight[0]);\n" \
 "	__global const uint64_4 * restrict const weight4i_n = (__global const uint64_4 *)(&weight[N_SZ]);\n" \
 "	__global const uint_8_4 * restrict const width4 = (__global const uint_8_4 *)width;\n" \
-"	__local uint64_2 cl[CWM_WG_SZ2];\n" \
+"	__local carry_t2 cl[CWM_WG_SZ2];\n" \
 "\n" \
 "	const sz_t gid = (sz_t)get_global_id(0), lid = gid % CWM_WG_SZ2;\n" \
 "\n" \
 "	const uint_8_4 wd0 = width4[gid + 0 * N_SZ_8], wd1 = width4[gid + 1 * N_SZ_8];\n" \
 "\n" \
-"	uint64 c1_0 = 0, c1_1 = 0;\n" \
+"	carry_t c1_0 = 0, c1_1 = 0;\n" \
 "	const uint64_4 x0 = x[gid + 0 * N_SZ_8], x1 = x[gid + 1 * N_SZ_8];\n" \
 "	uint64_4 u0 = mod_add4(x0, x1), u1 = mod_sub4(x0, x1);\n" \
 "	u0 = mod_mul4(u0, weight4i_n[gid + 0 * N_SZ_8]);\n" \
 "	u1 = mod_mul4(u1, weight4i_n[gid + 1 * N_SZ_8]);\n" \
-"	u0 = adc_mul4(u0, a, wd0, &c1_0);\n" \
-"	u1 = adc_mul4(u1, a, wd1, &c1_1);\n" \
+"	if (s != 0) { u0 = carry_sub4(u0, wd0, (gid == 0) ? s : 0); u1 = carry_sub4(u1, wd1, 0); }\n" \
+"	u0 = carry_mul4(u0, a, wd0, &c1_0);\n" \
+"	u1 = carry_mul4(u1, a, wd1, &c1_1);\n" \
 "\n" \
-"	cl[lid] = (uint64_2)(c1_0, c1_1);\n" \
+"	cl[lid] = (carry_t2)(c1_0, c1_1);\n" \
 "\n" \
 "	barrier(CLK_LOCAL_MEM_FENCE);\n" \
 "\n" \
-"	const uint64_2 c2 = (lid == 0) ? (uint64_2)(0, 0) : cl[lid - 1];\n" \
-"	u0 = adc4(u0, wd0, c2.s0);\n" \
-"	u1 = adc4(u1, wd1, c2.s1);\n" \
+"	const carry_t2 c2 = (lid == 0) ? (carry_t2)(0, 0) : cl[lid - 1];\n" \
+"	u0 = carry4(u0, wd0, c2.s0);\n" \
+"	u1 = carry4(u1, wd1, c2.s1);\n" \
 "	u0 = mod_mul4(u0, weight4[gid + 0 * N_SZ_8]);\n" \
 "	u1 = mod_mul4(u1, weight4[gid + 1 * N_SZ_8]);\n" \
 "	x[gid + 0 * N_SZ_8] = mod_add4(u0, u1);\n" \
@@ -1546,18 +1633,18 @@ static const char * const src_ocl_kernel = \
 "\n" \
 "	if (lid == CWM_WG_SZ2 - 1)\n" \
 "	{\n" \
-"		const uint64_2 c1 = (gid != N_SZ_8 - 1) ? (uint64_2)(c1_0, c1_1) : (uint64_2)(c1_1, c1_0);\n" \
+"		const carry_t2 c1 = (gid != N_SZ_8 - 1) ? (carry_t2)(c1_0, c1_1) : (carry_t2)(WRAP(c1_1), c1_0);\n" \
 "		carry2[(gid != N_SZ_8 - 1) ? gid / CWM_WG_SZ2 + 1 : 0] = c1;\n" \
 "	}\n" \
 "}\n" \
 "\n" \
 "// Inverse radix-2, unweight, carry, mul by a, weight, radix-2 (pass 2)\n" \
 "__kernel\n" \
-"void carry_weight_mul2_p2(__global uint64 * restrict const reg, __global const uint64 * restrict const carry,\n" \
+"void carry_weight_mul2_p2(__global uint64 * restrict const reg, __global const carry_t * restrict const carry,\n" \
 "	__global const uint64 * restrict const weight, __global const uint_8 * restrict const width, const sz_t offset)\n" \
 "{\n" \
 "	__global uint64_4 * restrict const x = (__global uint64_4 *)(&reg[offset]);\n" \
-"	__global const uint64_2 * restrict const carry2 = (__global const uint64_2 *)carry;\n" \
+"	__global const carry_t2 * restrict const carry2 = (__global const carry_t2 *)carry;\n" \
 "	__global const uint64_4 * restrict const weight4 = (__global const uint64_4 *)(&weight[0]);\n" \
 "	__global const uint64_4 * restrict const weight4i = (__global const uint64_4 *)(&weight[2 * N_SZ]);\n" \
 "	__global const uint_8_4 * restrict const width4 = (__global const uint_8_4 *)width;\n" \
@@ -1570,9 +1657,9 @@ static const char * const src_ocl_kernel = \
 "	uint64_4 u0 = mod_half4(mod_add4(x0, x1)), u1 = mod_half4(mod_sub4(x0, x1));\n" \
 "	u0 = mod_mul4(u0, weight4i[id + 0 * N_SZ_8]);\n" \
 "	u1 = mod_mul4(u1, weight4i[id + 1 * N_SZ_8]);\n" \
-"	const uint64_2 c = carry2[gid];\n" \
-"	u0 = adc4(u0, wd0, c.s0);\n" \
-"	u1 = adc4(u1, wd1, c.s1);\n" \
+"	const carry_t2 c = carry2[gid];\n" \
+"	u0 = carry4(u0, wd0, c.s0);\n" \
+"	u1 = carry4(u1, wd1, c.s1);\n" \
 "	u0 = mod_mul4(u0, weight4[id + 0 * N_SZ_8]);\n" \
 "	u1 = mod_mul4(u1, weight4[id + 1 * N_SZ_8]);\n" \
 "	x[id + 0 * N_SZ_8] = mod_add4(u0, u1);\n" \
@@ -1584,10 +1671,10 @@ static const char * const src_ocl_kernel = \
 "// --- misc ---\n" \
 "\n" \
 "__kernel\n" \
-"void copy(__global uint64 * restrict const reg, const sz_t offset_y, const sz_t offset_x)\n" \
+"void copy(__global uint64 * restrict const reg, const sz_t offset_y, const sz_t offset_x, __global const uint64 * restrict const reg_x)\n" \
 "{\n" \
 "	const sz_t gid = (sz_t)get_global_id(0);\n" \
-"	reg[offset_y + gid] = reg[offset_x + gid];\n" \
+"	reg[offset_y + gid] = reg_x[offset_x + gid];\n" \
 "}\n" \
 "\n" \
 "#if defined(CWM_WG_SZ)\n" \
@@ -1647,4 +1734,109 @@ static const char * const src_ocl_kernel = \
 "}\n" \
 "\n" \
 "#endif\n" \
+"\n" \
+"// --- reduce ---\n" \
+"\n" \
+"// Some small reductions of a register, they return a few words rather than the n digits.\n" \
+"// A single work-group: every item unweights and carries a contiguous chunk of digits from a zero carry-in,\n" \
+"// then the first item propagates the carries of the chunks (with the wrap-around of 2^q - 1).\n" \
+"// res[0] = the low 64 bits of the residue\n" \
+"// res[1] = bit 0: residue = a, bit 1: residue = 2^q - 1, bit 2: undecided (a carry did not stop on the first digit of a chunk),\n" \
+"//          bit 3: res[0] is not valid (the first chunk is smaller than 64 bits)\n" \
+"\n" \
+"#define RED_CHUNK	(N_SZ / RED_WG_SZ)\n" \
+"\n" \
+"__kernel\n" \
+"__attribute__((reqd_work_group_size(RED_WG_SZ, 1, 1)))\n" \
+"void reduce_digits(__global const uint64 * restrict const reg, __global const uint64 * restrict const weight,\n" \
+"	__global const uint_8 * restrict const width, __global uint64 * restrict const res, const sz_t offset, const uint32 a)\n" \
+"{\n" \
+"	// fl: bit 0: the upper digits of the chunk are zero, bit 1: they are 2^w - 1, bit 2: the chunk has at least 64 bits\n" \
+"	__local uint64 cl[RED_WG_SZ];\n" \
+"	__local uint32 dl[RED_WG_SZ];\n" \
+"	__local uint_8 wl[RED_WG_SZ], fl[RED_WG_SZ];\n" \
+"\n" \
+"	__global const uint64 * restrict const x = &reg[offset];\n" \
+"	__global const uint64 * restrict const weighti = &weight[2 * N_SZ];\n" \
+"	const sz_t lid = (sz_t)get_local_id(0), k0 = lid * RED_CHUNK;\n" \
+"\n" \
+"	uint64 c = 0, low64 = 0;\n" \
+"	uint32 d0 = 0, f = 3;\n" \
+"	uint_8 w0 = 0;\n" \
+"	sz_t s = 0;\n" \
+"	for (sz_t j = 0; j < RED_CHUNK; ++j)\n" \
+"	{\n" \
+"		const sz_t k = k0 + j;\n" \
+"#if defined(CWM_WG_SZ2)\n" \
+"		// inverse radix-2\n" \
+"		const uint64 u = (k < N_SZ / 2) ? mod_half(mod_add(x[k], x[k + N_SZ / 2])) : mod_half(mod_sub(x[k - N_SZ / 2], x[k]));\n" \
+"#else\n" \
+"		const uint64 u = x[k];\n" \
+"#endif\n" \
+"		const uint_8 w = width[k];\n" \
+"		const uint32 d = adc(mod_mul(u, weighti[k]), w, &c);\n" \
+"		if (j == 0) { d0 = d; w0 = w; }\n" \
+"		else\n" \
+"		{\n" \
+"			if (d != 0) f &= ~1u;\n" \
+"			if (d != (1u << w) - 1) f &= ~2u;\n" \
+"		}\n" \
+"		if (s < 64) low64 |= (uint64)(d) << s;\n" \
+"		s += w;\n" \
+"	}\n" \
+"	if (s >= 64) f |= 4u;\n" \
+"\n" \
+"	cl[lid] = c; dl[lid] = d0; wl[lid] = w0; fl[lid] = (uint_8)(f);\n" \
+"\n" \
+"	barrier(CLK_LOCAL_MEM_FENCE);\n" \
+"\n" \
+"	if (lid != 0) return;\n" \
+"\n" \
+"	uint64 carry = 0, carry0 = 0;\n" \
+"	bool undecided = false;\n" \
+"	for (int pass = 0; pass < 4; ++pass)\n" \
+"	{\n" \
+"		for (sz_t t = 0; t < RED_WG_SZ; ++t)\n" \
+"		{\n" \
+"			uint64 ovf = 0;\n" \
+"			if (carry != 0)\n" \
+"			{\n" \
+"				if (t == 0) carry0 += carry;\n" \
+"				const uint64 b = (uint64)(1) << wl[t], sum = dl[t] + carry;\n" \
+"				if (sum < b) dl[t] = (uint32)(sum);\n" \
+"				else if ((carry < b) && ((fl[t] & 2) != 0))\n" \
+"				{\n" \
+"					// the carry ripples through the chunk: the upper digits become zero\n" \
+"					dl[t] = (uint32)(sum - b);\n" \
+"					fl[t] = (uint_8)((fl[t] & 4) | ((RED_CHUNK == 1) ? 3 : 1));\n" \
+"					ovf = 1;\n" \
+"				}\n" \
+"				else undecided = true;\n" \
+"			}\n" \
+"			carry = ((pass == 0) ? cl[t] : 0) + ovf;\n" \
+"			if ((pass != 0) && (carry == 0)) break;\n" \
+"		}\n" \
+"		if (carry == 0) break;\n" \
+"	}\n" \
+"	if (carry != 0) undecided = true;\n" \
+"\n" \
+"	bool is_a = true, is_Mp = true;\n" \
+"	for (sz_t t = 0; t < RED_WG_SZ; ++t)\n" \
+"	{\n" \
+"		const uint32 d = dl[t];\n" \
+"		const uint_8 ft = fl[t];\n" \
+"		if (((ft & 1) == 0) || (d != ((t == 0) ? a : 0))) is_a = false;\n" \
+"		if (((ft & 2) == 0) || (d != (1u << wl[t]) - 1)) is_Mp = false;\n" \
+"	}\n" \
+"\n" \
+"	res[0] = low64 + carry0;\n" \
+"	res[1] = (is_a ? 1 : 0) | (is_Mp ? 2 : 0) | (undecided ? 4 : 0) | (((fl[0] & 4) == 0) ? 8 : 0);\n" \
+"}\n" \
+"\n" \
+"__kernel\n" \
+"void compare(__global const uint64 * restrict const reg, __global uint64 * restrict const res, const sz_t offset_y, const sz_t offset_x, __global const uint64 * restrict const reg_x)\n" \
+"{\n" \
+"	const sz_t gid = (sz_t)get_global_id(0);\n" \
+"	if (reg[offset_y + gid] != reg_x[offset_x + gid]) res[2] = 1;\n" \
+"}\n" \
 "";
\ No newline at end of file
@@ -10,19 +10,31 @@
 #endif
 #include <vector>
 #include "opencl/Context.hpp"
+#include "opencl/CommandBuffer.hpp"
 
 namespace math {
 
 class Carry {
 public:
-    Carry(const opencl::Context& ctx, cl_command_queue queue, cl_program program, size_t vectorSize, std::vector<int> digitWidth, cl_mem digitWidthMaskBuf);
+    Carry(const opencl::Context& ctx, cl_command_queue queue, cl_program program, size_t vectorSize, std::vector<int> digitWidth);
+    ~Carry();
+    Carry(const Carry&) = delete;
+    Carry& operator=(const Carry&) = delete;
     void carryGPU(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize);
+    // Second pass only, for kernels that already wrote the block carries.
+    void carryFixupGPU(cl_mem buffer, cl_mem blockCarryBuffer);
+    bool recordCarryGPU(opencl::CommandBuffer& cb, cl_mem buffer, cl_mem blockCarryBuffer, bool fixupOnly = false);
     void carryGPU3(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize);
     void carryGPU_mul_base(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize);
     void handleFinalCarry(std::vector<uint64_t>& x, const std::vector<int>& digitWidth);
     uint64_t digit_adc(const uint64_t lhs, const int digit_width, uint64_t & carry);
 
 private:
+    // clEnqueueNDRangeKernel, timed under -profile
+    cl_int enqueue(cl_kernel kernel, size_t workers, const char* name, const size_t* local = nullptr);
+    // kernel_carry_lookahead, when the layout allows it (lookaheadLocal_ != 0)
+    bool useLookahead(cl_mem buffer);
+
     const opencl::Context&    context_;
     cl_command_queue  queue_;
     cl_kernel         carryKernel_;
@@ -30,7 +42,9 @@ private:
     cl_kernel         carryKernel3_;
     cl_kernel         carryKernelMul3_;
     std::vector<int>  digitWidth_;
-    cl_mem                 digitWidthMaskBuf_;
+    cl_kernel         lookaheadKernel_ = nullptr;
+    cl_mem            lookaheadState_ = nullptr;
+    size_t            lookaheadLocal_ = 0;
 };
 
 } // namespace math
@@ -21,6 +21,18 @@ public:
                               const mpz_class& finalResidue,
                               uint32_t base = 3);
 
+    // The same check when kfPower = base^(KF-1) mod 2^p - 1 was computed on
+    // the GPU: N divides residue - kfPower exactly when 2^p - 1 divides
+    // (residue - kfPower) * KF, which only takes a product by the small KF
+    // and a Mersenne fold.
+    static bool isCofactorPRP(uint32_t exponent,
+                              const std::vector<std::string>& factors,
+                              const mpz_class& finalResidue,
+                              const mpz_class& kfPower);
+
+    // KF, the product of the known factors
+    static mpz_class knownFactorsProduct(const std::vector<std::string>& factors);
+
 };
 
 } // namespace math
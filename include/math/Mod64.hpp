@@ -1,7 +1,10 @@
 #pragma once
 #include <cstdint>
 
+// also defined by marin/arith.h
+#ifndef MOD_P
 #define MOD_P 0xffffffff00000001ULL
+#endif
 
 namespace math {
 
@@ -2,17 +2,22 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <string>
 
 namespace math {
 
 class Precompute {
 public:
-    explicit Precompute(uint64_t exponent);
+    // Weights and twiddles are built on all host threads. With a cacheDir,
+    // large transforms are kept in precompute_<exponent>_<n>.bin there and
+    // read back on the next start.
+    explicit Precompute(uint64_t exponent, const std::string& cacheDir = "");
+    // The transform size of `exponent`, without building the tables.
+    static uint32_t transformSize(uint64_t exponent);
     uint32_t getN() const;
     const std::vector<uint64_t>& digitWeight() const;
     const std::vector<uint64_t>& digitInvWeight() const;
     const std::vector<int>&      getDigitWidth() const;
-    const std::vector<bool>&     getDigitWidthMask() const;
     const std::vector<uint64_t>& twiddles() const;
     const std::vector<uint64_t>& invTwiddles() const;
     const std::vector<uint64_t>& twiddlesRadix4() const;
@@ -27,7 +32,6 @@ private:
     std::vector<uint64_t> digitWeight_;
     std::vector<uint64_t> digitInvWeight_;
     std::vector<int>      digitWidth_;
-    std::vector<bool>     digitWidthMask_;
     std::vector<uint64_t> twiddles_;
     std::vector<uint64_t> invTwiddles_;
     std::vector<uint64_t> w4_;
@@ -36,6 +40,9 @@ private:
     std::vector<uint64_t> iw5_;
     uint64_t digitWidthValue1_{0};
     uint64_t digitWidthValue2_{0};
+
+    bool loadCache(const std::string& path, uint64_t exponent);
+    void storeCache(const std::string& path, uint64_t exponent) const;
 };
 
 } // namespace math
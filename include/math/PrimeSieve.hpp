@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace math {
+
+// Segmented sieve of Eratosthenes running on a worker thread.
+// Primes of [from, to] come out in increasing order; each sieved segment is
+// handed to the consumer as one batch through a single-producer /
+// single-consumer ring, so the thread enqueueing GPU work never runs a
+// primality test itself.
+class PrimeSieve {
+public:
+    PrimeSieve(uint64_t from, uint64_t to, std::size_t segmentSize = std::size_t(1) << 18);
+    ~PrimeSieve();
+
+    PrimeSieve(const PrimeSieve&) = delete;
+    PrimeSieve& operator=(const PrimeSieve&) = delete;
+
+    // Next prime, or 0 once [from, to] is exhausted.
+    uint64_t next();
+
+private:
+    // Primes of one segment, as offsets from its low end.
+    struct Batch {
+        uint64_t              low = 0;
+        std::vector<uint32_t> offsets;
+    };
+    static constexpr std::size_t kSlots = 8;
+
+    void run();
+    void push(Batch&& batch);
+    bool pop(Batch& out);
+
+    const uint64_t    from_;
+    const uint64_t    to_;
+    const std::size_t segment_;
+
+    Batch                    ring_[kSlots];
+    std::atomic<std::size_t> head_{0};
+    std::atomic<std::size_t> tail_{0};
+    std::atomic<bool>        done_{false};
+    std::atomic<bool>        stop_{false};
+
+    Batch       current_;
+    std::size_t pos_ = 0;
+
+    std::thread worker_;
+};
+
+} // namespace math
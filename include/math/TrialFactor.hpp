@@ -0,0 +1,59 @@
+// TrialFactor.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "opencl/Context.hpp"
+
+namespace math {
+
+// Trial factoring of 2^p - 1 on the device with kernels/tf.cl. Bit level b
+// covers the candidates q = 2kp + 1 of [2^(b-1), 2^b). Residue classes of k
+// mod kClasses are filtered on the host, the next kSievePrimes primes on the
+// device, and every block of k is read back once for all its classes, so
+// the first factor ends the search within a block. Found factors are
+// checked with GMP before they are reported.
+class TrialFactor {
+public:
+    static constexpr unsigned kClasses     = 4620;   // 4 * 3 * 5 * 7 * 11
+    static constexpr unsigned kSievePrimes = 128;
+    static constexpr size_t   kBlock       = size_t(1) << 20;   // work-items per class launch
+
+    struct Result {
+        std::string factor;        // decimal, empty when none
+        unsigned    bitsDone = 0;  // levels up to here are complete
+        bool        interrupted = false;
+    };
+    // (bit level, blocks done, blocks of the level)
+    using Progress = std::function<void(unsigned, uint64_t, uint64_t)>;
+
+    TrialFactor(const opencl::Context& ctx, const std::string& kernelFile,
+                const std::string& cacheDir = "");
+    ~TrialFactor();
+    TrialFactor(const TrialFactor&) = delete;
+    TrialFactor& operator=(const TrialFactor&) = delete;
+
+    // Highest level whose k still fits 63 bits, and q 96 bits.
+    static unsigned maxBits(uint32_t p);
+
+    Result run(uint32_t p, unsigned fromBits, unsigned toBits,
+               const std::atomic<bool>& stop, const Progress& progress = {},
+               const std::function<void(unsigned)>& levelDone = {});
+
+private:
+    const opencl::Context& ctx_;
+    cl_program program_ = nullptr;
+    cl_kernel  kernel_  = nullptr;
+};
+
+} // namespace math
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "opencl/Context.hpp"
+
+namespace opencl {
+
+// Device memory of the long-lived buffers. Subsystems first reserve() what
+// they will need, checkPlan() refuses a plan that does not fit the budget
+// (-vram, or the whole device) before anything is allocated, then
+// allocate() carves aligned sub-buffers out of a few large slabs. Usage is
+// tallied per subsystem for report(). Sub-buffers are released by their
+// owner with clReleaseMemObject after release(), and always before the
+// arena itself goes away.
+class Arena {
+public:
+    Arena(const Context& ctx, std::size_t budgetBytes = 0);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void reserve(const std::string& subsystem, std::size_t bytes);
+    void checkPlan() const;
+
+    // Read-write sub-buffer of `bytes`, filled from `host` when not null.
+    cl_mem allocate(const std::string& subsystem, const std::string& name,
+                    std::size_t bytes, const void* host = nullptr);
+    // Returns the space of `mem` to its subsystem; the last block of a slab
+    // is reused by the next allocation.
+    void release(cl_mem mem);
+
+    std::size_t budget() const noexcept { return budget_; }
+    std::size_t planned() const noexcept;
+    std::size_t used() const noexcept { return used_; }
+    std::size_t peak() const noexcept { return peak_; }
+    void report(std::ostream& out) const;
+
+private:
+    struct Slab  { cl_mem mem; std::size_t size, top; };
+    struct Block { std::size_t slab, offset, size; std::string subsystem; };
+    struct Usage { std::size_t planned = 0, used = 0, peak = 0; unsigned buffers = 0; };
+
+    std::size_t round(std::size_t bytes) const noexcept { return (bytes + align_ - 1) / align_ * align_; }
+
+    const Context& ctx_;
+    std::size_t globalMem_ = 0, maxAlloc_ = 0, align_ = 1, budget_ = 0;
+    std::size_t used_ = 0, peak_ = 0;
+    std::vector<Slab> slabs_;
+    std::map<cl_mem, Block> blocks_;
+    std::map<std::string, Usage> usage_;
+};
+
+} // namespace opencl
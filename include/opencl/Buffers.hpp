@@ -9,15 +9,25 @@
 #endif
 
 #include <string>
+#include <utility>
+#include <vector>
 #include "math/Precompute.hpp"
+#include "opencl/Arena.hpp"
 #include "opencl/Context.hpp"
 namespace opencl {
 
 class Buffers {
 public:
-    Buffers(const opencl::Context& ctx, const math::Precompute& pre);
+    // `plan` lists the bytes each subsystem will take from the arena on top
+    // of the NTT tables; the whole plan is checked against `budgetBytes`
+    // (0 = the device) before anything is allocated.
+    Buffers(const opencl::Context& ctx, const math::Precompute& pre,
+            std::size_t budgetBytes = 0,
+            const std::vector<std::pair<std::string, std::size_t>>& plan = {});
     ~Buffers();
-    
+
+    Arena arena;              // holds every buffer below but babyPow
+
     cl_mem input;             // main data buffer
     cl_mem digitWeightBuf;    // digit weights
     cl_mem digitInvWeightBuf; // inverse digit weights
@@ -26,13 +36,14 @@ public:
     cl_mem twiddle5Buf;        // forward twiddles
     cl_mem invTwiddle5Buf;     // inverse twiddles
     cl_mem blockCarryBuf;
-    cl_mem digitWidthMaskBuf;
     cl_mem Hbuf;
     cl_mem Hq;
     cl_mem Qbuf;
     cl_mem tmp; 
     cl_mem r2,save,bufd,buf3,last_correct_state,last_correct_bufd;
-    std::vector<cl_mem> evenPow;
+    cl_mem jacobiSnap, jacobiGood;  // LL: the residue being checked, the last one that passed
+    std::vector<cl_mem> babyPow;   // P-1 stage 2 baby-step table, sub-buffers of babySlab
+    cl_mem babySlab;
     static cl_mem createBuffer(const opencl::Context& ctx, cl_mem_flags flags,
                                size_t size, const void* ptr,
                                const std::string& name);
@@ -0,0 +1,66 @@
+// opencl/CommandBuffer.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include "opencl/Context.hpp"
+
+namespace opencl {
+
+// Thin wrapper over cl_khr_command_buffer.
+// Kernel launches are recorded once (the kernel arguments are captured at
+// record time) and the whole sequence is then replayed with one enqueue.
+// Entry points are resolved at run time, so the host build does not depend
+// on the extension header; valid() is false when the device lacks it.
+class CommandBuffer {
+public:
+    explicit CommandBuffer(const Context& ctx);
+    ~CommandBuffer();
+
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    bool valid() const noexcept { return cmdbuf_ != nullptr && !failed_; }
+    bool finalized() const noexcept { return finalized_; }
+    std::size_t size() const noexcept { return recorded_; }
+
+    // Records one 1-D NDRange; each command waits on the previous one.
+    bool ndrange(cl_kernel kernel, std::size_t global, const std::size_t* local);
+    bool finalize();
+    // Replays the recorded sequence on the context queue.
+    bool enqueue();
+
+private:
+    using cmdbuf_t = void*;
+    using sync_t   = cl_uint;
+
+    using CreateFn   = cmdbuf_t (CL_API_CALL *)(cl_uint, const cl_command_queue*, const cl_ulong*, cl_int*);
+    using NDRangeFn  = cl_int (CL_API_CALL *)(cmdbuf_t, cl_command_queue, const cl_ulong*, cl_kernel, cl_uint,
+                                  const std::size_t*, const std::size_t*, const std::size_t*,
+                                  cl_uint, const sync_t*, sync_t*, void**);
+    using FinalizeFn = cl_int (CL_API_CALL *)(cmdbuf_t);
+    using EnqueueFn  = cl_int (CL_API_CALL *)(cl_uint, cl_command_queue*, cmdbuf_t, cl_uint, const cl_event*, cl_event*);
+    using ReleaseFn  = cl_int (CL_API_CALL *)(cmdbuf_t);
+
+    cl_command_queue queue_;
+    cmdbuf_t    cmdbuf_    = nullptr;
+    CreateFn    create_    = nullptr;
+    NDRangeFn   record_    = nullptr;
+    FinalizeFn  finalize_  = nullptr;
+    EnqueueFn   enqueue_   = nullptr;
+    ReleaseFn   release_   = nullptr;
+    sync_t      last_      = 0;
+    std::size_t recorded_  = 0;
+    bool        finalized_ = false;
+    bool        failed_    = false;
+};
+
+} // namespace opencl
@@ -12,17 +12,45 @@
 #include <string>
 #include <vector>
 #include <stdexcept>
+#include <memory>
+#include "opencl/Profiler.hpp"
+#include "opencl/Staging.hpp"
 namespace opencl {
 
 class Context {
 public:
-    Context(int deviceIndex = 0, std::size_t enqueueMax = 0, bool cl_queue_throttle_active = false, bool debug = false, bool marin = false);
+    // A context with no platform, device or queue, for the runs on the host
+    // engine (-cpu): nothing is asked of the OpenCL runtime, so a machine
+    // without a GPU or an ICD runs them too.
+    struct HostOnly {};
+
+    Context(int deviceIndex = 0, std::size_t enqueueMax = 0, bool cl_queue_throttle_active = false, bool debug = false, bool marin = false, bool profiling = false);
+    explicit Context(HostOnly, bool debug = false);
     ~Context();
 
     cl_context        getContext()  const noexcept;
+    cl_platform_id    getPlatform() const noexcept;
     cl_device_id      getDevice()   const noexcept;
     cl_command_queue  getQueue()    const noexcept;
     std::size_t       getQueueSize() const noexcept;
+    // A second in-order queue of the device for the device-to-host copies
+    // (snapshots, proof points, res64): a copy queued there is run by the
+    // copy engine while the kernels of getQueue() go on. getQueue() when
+    // the driver would not create it.
+    cl_command_queue  getTransferQueue() const noexcept;
+    // Non-blocking read of `bytes` at `offset` of `mem` on the transfer
+    // queue, started once what is queued on getQueue() so far is done;
+    // `done` (may be null) is set to the event of the read. Both queues are
+    // flushed.
+    cl_int readAfterCompute(cl_mem mem, std::size_t offset, std::size_t bytes, void* host,
+                            cl_event* done) const;
+    // Non-null only when the queue was created with profiling enabled.
+    Profiler*         getProfiler() const noexcept { return profiler_.get(); }
+    // Pinned staging of the residue-sized blocking reads and writes on the queue.
+    Staging&          getStaging() const noexcept { return *staging_; }
+    // CL_DEVICE_HOST_UNIFIED_MEMORY: device buffers live in host memory
+    // (integrated GPUs, APUs) and are mapped rather than copied.
+    bool              hasUnifiedMemory() const noexcept { return unifiedMemory_; }
 
     std::size_t getMaxWorkGroupSize() const noexcept;
     const std::vector<std::size_t>& getMaxWorkItemSizes() const noexcept;
@@ -40,13 +68,37 @@ public:
     int getExponent() const noexcept;
     bool isEvenExponent() const noexcept;
     cl_uint getWorkGroupCount() const noexcept;
-    void computeOptimalSizes(std::size_t n, const std::vector<int>& digit_width_cpu, uint64_t p, bool debug = false, int localMaxSize = 0, int localMaxSize5 = 0);
+    // Work-group size of the single-kernel squaring, 0 when the transform
+    // does not fit in one work-group's local memory.
+    std::size_t getFusedSquareLocalSize() const noexcept;
+    // True when the last 2-step inverse stage can also run the first carry
+    // pass (its LOCAL_SIZE2 digit runs split into whole carry blocks).
+    bool canFuseInverseCarry() const noexcept;
+    // Residues per work-group of the four-step middle passes, 0 when they
+    // are off (-fourstep not given, or a small transform).
+    std::size_t getLocalStagesTile() const noexcept;
+    std::size_t getLocalStagesWorkGroup() const noexcept;
+    std::size_t getCoalescedTile() const noexcept;
+    std::size_t getCoalescedWorkGroup() const noexcept;
+    // Largest tile of the generated passes (-genkernels), 0 when they are off.
+    std::size_t getGenTile() const noexcept;
+    std::size_t getGenWorkGroup() const noexcept;
+    void computeOptimalSizes(std::size_t n, const std::vector<int>& digit_width_cpu, uint64_t p, bool debug = false, int localMaxSize = 0, int localMaxSize5 = 0, bool localStages = false, bool coalesced = false, std::size_t genTile = 0);
+    bool hasExtension(const std::string& name) const;
+    // cl_intel_subgroups, or cl_khr_subgroups + cl_khr_subgroup_shuffle on OpenCL 2.0+
+    bool hasSubgroupShuffle() const;
+    std::string getDeviceName() const;
+    std::string getDeviceVendor() const;
+    std::string getDriverVersion() const;
     static void listAllOpenCLDevices();
+    // GPU devices in the order of the -d index
+    static std::size_t deviceCount();
 private:
     cl_platform_id    platform_;
     cl_device_id      device_;
     cl_context        context_;
     cl_command_queue  queue_;
+    cl_command_queue  transferQueue_ = nullptr;
     cl_uint           transformSize_;
     cl_uint workGroupCount_;
     std::size_t       queueSize_;
@@ -62,14 +114,26 @@ private:
     std::size_t localSizeCarry_;
     std::size_t localSize5_;
     std::size_t workersCarry_;
+    std::size_t fusedSquareLocalSize_ = 0;
+    bool inverseCarryFused_ = false;
+    std::size_t localStagesTile_ = 0;
+    std::size_t localStagesWorkGroup_ = 0;
+    std::size_t coalescedTile_ = 0;
+    std::size_t coalescedWorkGroup_ = 0;
+    std::size_t genTile_ = 0;
+    std::size_t genWorkGroup_ = 0;
     int localCarryPropagationDepth_;
     int exponent_;
     bool evenExponent_;
     bool debug_;
+    bool unifiedMemory_ = false;
+    std::unique_ptr<Profiler> profiler_;
+    std::unique_ptr<Staging> staging_;
 
     void pickPlatformAndDevice(int deviceIndex);
     void createContext();
     void createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active);
+    void createTransferQueue();
     void queryDeviceCapabilities();
     unsigned queryCLVersion() const;
     std::string queryDeviceString(cl_device_info) const;
@@ -0,0 +1,66 @@
+// opencl/KernelGen.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "opencl/NttPipeline.hpp"
+#include <string>
+#include <vector>
+
+namespace opencl {
+
+class Kernels;
+
+// OpenCL source for fused radix-4 passes, written for one transform size.
+// A plan splits the unweighted part of the squaring (everything between
+// the weighted first stage and the weighted last one) into passes over
+// local-memory tiles: middle passes running the strides hi .. lo of the
+// four-step layout, then a tail pass on contiguous blocks of 4 * tail
+// residues running the forward strides tail .. 1, the pointwise square
+// (or the product by a transformed operand) and the inverse strides
+// 1 .. tail, so the last forward and the first inverse stages never go
+// through global memory. Strides, tile shapes and the work-group size are
+// literals of the emitted kernels. The forward-only and inverse-only tails
+// serve the simple pipelines.
+struct GenPass {
+    enum class Op { Forward, Inverse, Square, Mul };
+    Op      op;
+    cl_uint hi, lo, cols;   // as LocalPass; a tail pass has lo = cols = 1
+};
+
+struct GenPlan {
+    cl_uint hi = 0;                  // the stride below the first forward stage
+    cl_uint inverseHi = 0;           // the stride below the last inverse stage
+    cl_uint tail = 0;                // 0: nothing to generate for this size
+    cl_uint wg = 0;
+    std::vector<LocalPass> middle;          // strides hi .. 4 * tail, forward order
+    std::vector<LocalPass> inverseMiddle;   // strides inverseHi .. 4 * tail
+
+    bool empty() const noexcept { return tail == 0; }
+    // Every kernel generatedSource() emits.
+    std::vector<GenPass> passes() const;
+};
+
+// Plan for the default pipelines of n, tiles of at most `tile` residues and
+// work-groups of wg; empty when those do not end in the radix-4 square
+// stage (radix-2 sizes) or the transform is too small for a tail of wg.
+GenPlan planGenerated(cl_uint n, cl_uint tile, cl_uint wg);
+
+std::string generatedName(const GenPass& p);
+std::string generatedSource(const GenPlan& plan);
+
+// Swaps the middle and end stages of a pipeline for the generated passes.
+// False, leaving v untouched, when its stages do not cover the strides of
+// the plan.
+enum class GenPipeline { Forward, Inverse, ForwardSimple, InverseSimple };
+bool useGeneratedStages(std::vector<NttStage>& v, GenPipeline which, const GenPlan& plan,
+                        Kernels& kernels, cl_mem buf_w, cl_mem buf_wi,
+                        const size_t* wg, bool debug = false);
+
+} // namespace opencl
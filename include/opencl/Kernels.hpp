@@ -9,6 +9,7 @@
 #endif
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <algorithm>
 
 
@@ -22,6 +23,8 @@ public:
     ~Kernels();
 
     void createKernel(const std::string& name);
+    // Creates every kernel the NTT engine and the iteration loops look up by name.
+    void createEngineKernels();
     cl_kernel getKernel(const std::string& name) const;
 
     void runCheckEqual(cl_mem a, cl_mem b,
@@ -31,6 +34,8 @@ public:
     void runSquaring(cl_mem buf, size_t n);
     void runSub2(cl_mem buf);
     void runSub1(cl_mem buf);
+    // Writes the low 64 bits of buf to out (2 x uint32), no host sync.
+    void runRes64Display(cl_mem buf, cl_mem out);
 
 private:
     cl_program            program_;
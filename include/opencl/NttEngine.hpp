@@ -13,6 +13,8 @@
 #include "opencl/Buffers.hpp"
 #include "opencl/Kernels.hpp"
 #include "opencl/NttPipeline.hpp"
+#include "opencl/CommandBuffer.hpp"
+#include <memory>
 
 namespace math { class Carry; }
 
@@ -24,13 +26,48 @@ public:
               Kernels& kernels,
               Buffers& buffers,
               const math::Precompute& precompute, bool pm1, bool debug=false);
+    ~NttEngine();
+
+    // Arms private copies of the four pipelines for buf_x: kernels are
+    // cloned and all their arguments set once, so later forward/inverse
+    // calls on buf_x only enqueue. Unbound buffers keep the shared path.
+    bool bind(cl_mem buf_x);
+    void unbind(cl_mem buf_x);
 
     int forward(cl_mem buf_x, uint64_t iter);
     int inverse(cl_mem buf_x, uint64_t iter);
     int forward_simple(cl_mem buf_x, uint64_t iter);
     int inverse_simple(cl_mem buf_x, uint64_t iter);
     int pointwiseMul(cl_mem a, cl_mem b);
+    // a *= b + c, all three transformed.
+    int pointwiseAddMul(cl_mem a, cl_mem b, cl_mem c);
+    // a = a * bHat in the normal domain (forward_simple, pointwise product,
+    // inverse_simple; no carry), bHat transformed, or a = a^2 when bHat is
+    // null. When the simple pipelines end and start at m = 1 the last
+    // forward stage, the product and the first inverse stage are a single
+    // kernel_ntt_radix{4,2}_{mul,square}_radix{4,2} launch, which saves a
+    // read and a write of a and a read of bHat.
+    int mulTransformed(cl_mem a, cl_mem bHat);
+
+    // One squaring iteration (forward + inverse + carry) on buf_x.
+    // Small transforms run as a single work-group kernel; otherwise the
+    // recorded command buffer is replayed when recordSquaring() succeeded
+    // for this buffer, else the stages are enqueued one by one.
+    int squareIteration(cl_mem buf_x, math::Carry& carry, uint64_t iter);
+    bool recordSquaring(cl_mem buf_x, math::Carry& carry);
     
+    // Pretransformed operands: forward_simple() applied once, so a constant
+    // multiplicand no longer costs a forward NTT per product.
+    // pretransform() returns a new buffer owned by the caller.
+    cl_mem pretransform(cl_mem src, size_t limbBytes);
+    // A = A * B where Bhat = pretransform(B); A stays in the normal domain.
+    void mulByTransformed(cl_mem A, cl_mem Bhat, math::Carry& carry, size_t limbBytes);
+
+    // acc = acc * x, x is left untouched and scratch (n words) is clobbered.
+    // One kernel_ntt_fused_mul launch when the fused squaring is available,
+    // else copy + two forward_simple + pointwise + inverse_simple + carry.
+    int mulAccumulate(cl_mem acc, cl_mem x, cl_mem scratch, math::Carry& carry);
+
     void mulInPlace(cl_mem A, cl_mem B, math::Carry& carry, size_t limbBytes);
     void mulInPlace2(cl_mem A, cl_mem B, math::Carry& carry, size_t limbBytes);
     void mulInPlace3(cl_mem A, cl_mem B, math::Carry& carry, size_t limbBytes);
@@ -39,16 +76,55 @@ public:
     void powInPlace(cl_mem result, cl_mem base, uint64_t exp, math::Carry& carry, size_t limbBytes);
     void copy(cl_mem src, cl_mem dst, size_t bytes);
     void subOne(cl_mem buf);
+    // Digitwise a += b and a -= b (mod 2^p - 1) on normal-domain operands;
+    // the result must go through the carry before any transform.
+    void add(cl_mem a, cl_mem b);
+    void subMod(cl_mem a, cl_mem b);
+
+    // True when -genkernels passes replaced some of the built-in stages.
+    bool usesGeneratedKernels() const noexcept { return generated_; }
 
 private:
+    struct BoundPipelines {
+        cl_mem buf;
+        std::vector<NttStage> forward, inverse, forwardSimple, inverseSimple, inverseCarry;
+    };
+    std::vector<BoundPipelines> bound_;
+    const BoundPipelines* findBound(cl_mem buf_x) const;
+    static void releaseBound(BoundPipelines& b);
+    int runBound(const std::vector<NttStage>& stages, cl_mem buf_x);
+    // inverse NTT whose last stage also runs the first carry pass
+    int inverseCarry(cl_mem buf_x);
+    // -genkernels: swaps the stages for the generated passes, kept when they
+    // transform a test vector as the built-in pipelines do.
+    bool useGenerated(bool debug);
+    bool sameAsBuiltIn(const std::vector<NttStage>& fwd, const std::vector<NttStage>& inv,
+                       const std::vector<NttStage>& fwdSimple, const std::vector<NttStage>& invSimple,
+                       bool square, bool simple, cl_kernel mul);
+
     size_t ls0_val_, ls2_val_, ls3_val_, ls5_val_;
     size_t ls0_vali_, ls2_vali_, ls5_vali_;
+    size_t sgLs_ = 0;
+    size_t localStagesWg_ = 0;
+    size_t coalescedWg_ = 0;
+    size_t genWg_ = 0;
+    bool generated_ = false;
     const Context& ctx_;
     std::vector<NttStage> forward_pipeline;
     std::vector<NttStage> inverse_pipeline;    
     std::vector<NttStage> forward_simple_pipeline;
     std::vector<NttStage> inverse_simple_pipeline;
+    std::vector<NttStage> inverse_carry_pipeline;
     cl_command_queue      queue_;
+    std::unique_ptr<CommandBuffer> squaring_;
+    cl_mem                squaringBuf_ = nullptr;
+    cl_kernel             fusedSquare_ = nullptr;
+    cl_kernel             fusedMul_ = nullptr;
+    cl_kernel             lastMulFirst_ = nullptr;      // x, y
+    cl_kernel             lastSquareFirst_ = nullptr;   // x
+    int                   lastMulFirstScale_ = 0;
+    std::string           lastMulFirstName_, lastSquareFirstName_;
+    size_t                fusedSquareLs_ = 0;
     Kernels&              kernels_;
     Buffers&              buffers_;
     const math::Precompute& pre_;
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <string>
 #include <functional>
+#include <algorithm>
 #ifndef CL_TARGET_OPENCL_VERSION
 #define CL_TARGET_OPENCL_VERSION 300
 #endif
@@ -78,6 +79,45 @@ inline void setStageArgs(NttStage& s, cl_mem buf_x) {
     }
 }
 
+// Fresh kernel object for the same program function, so that arguments
+// can be bound once per target buffer without disturbing the shared kernel.
+inline cl_kernel cloneKernel(cl_kernel k) {
+    cl_program prog = nullptr;
+    size_t nameSize = 0;
+    if (clGetKernelInfo(k, CL_KERNEL_PROGRAM, sizeof(prog), &prog, nullptr) != CL_SUCCESS
+        || clGetKernelInfo(k, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &nameSize) != CL_SUCCESS)
+        return nullptr;
+    std::string name(nameSize, '\0');
+    clGetKernelInfo(k, CL_KERNEL_FUNCTION_NAME, nameSize, name.data(), nullptr);
+    if (!name.empty() && name.back() == '\0') name.pop_back();
+    cl_int err = CL_SUCCESS;
+    cl_kernel clone = clCreateKernel(prog, name.c_str(), &err);
+    return (err == CL_SUCCESS) ? clone : nullptr;
+}
+
+// Copy of s running on its own kernel with every argument set for buf_x.
+// The returned stage is enqueued as is: no clSetKernelArg per call.
+inline bool bindStage(const NttStage& s, cl_mem buf_x, NttStage& out) {
+    out = s;
+    out.kernel = cloneKernel(s.kernel);
+    if (out.kernel == nullptr) return false;
+    for (cl_uint i = 0; i < out.args.size(); ++i) {
+        auto& A = out.args[i];
+        if (A.data.empty()) continue;
+        if (A.size == sizeof(cl_mem)) {
+            cl_mem* candidate = reinterpret_cast<cl_mem*>(A.data.data());
+            if (A.isBufX || *candidate == nullptr)
+                std::memcpy(A.data.data(), &buf_x, sizeof(cl_mem));
+        }
+        if (clSetKernelArg(out.kernel, i, A.size, A.data.data()) != CL_SUCCESS) {
+            clReleaseKernel(out.kernel);
+            out.kernel = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
 template<typename T>
 static std::vector<uint8_t> toBytes(const T& x) {
     std::vector<uint8_t> b(sizeof(T));
@@ -709,6 +749,133 @@ inline std::vector<NttStage> buildInversePipeline(
 }
 
 
+// Four-step layout: the middle radix-4 stages of a pipeline (everything
+// between the weighted first stage and the square / unweighted last one)
+// regrouped into kernel_[inverse_]ntt_radix4_local_stages passes. A pass
+// runs the strides hi, hi / 4, ..., lo (listed in forward order) on tiles of at most `tile` residues
+// with rows of `cols` consecutive ones; rows shorter than 8 are only taken
+// when the stride itself is smaller.
+struct LocalPass { cl_uint hi, lo, cols; };
+
+inline std::vector<LocalPass> planLocalPasses(cl_uint hi, cl_uint lo, cl_uint tile) {
+    // from the bottom, so that the contiguous pass (rows of lo) is the longest
+    std::vector<LocalPass> passes;
+    for (cl_uint bottom = lo; ; bottom *= 4) {
+        cl_uint top = bottom;
+        while (top <= hi / 4) {
+            const cl_uint span = 4 * (4 * top / bottom);
+            if (span > tile || std::min(bottom, tile / span) < std::min(bottom, 8u)) break;
+            top *= 4;
+        }
+        passes.push_back({ top, bottom, std::min(bottom, tile / (4 * (top / bottom))) });
+        bottom = top;
+        if (top == hi) break;
+    }
+    std::reverse(passes.begin(), passes.end());
+    return passes;
+}
+
+inline cl_uint stageStride(const std::string& name) {
+    const auto p = name.find("(m=");
+    return (p == std::string::npos) ? 0 : static_cast<cl_uint>(std::stoul(name.substr(p + 3)));
+}
+
+// An unweighted radix-4 stage between the first and the last one.
+inline bool isMiddleStage(const NttStage& s, bool inverse) {
+    static const char* const fwd[] = { "kernel_ntt_radix4_mm_2steps(", "kernel_ntt_radix4_mm_m2(",
+        "kernel_ntt_radix4_mm_m4(", "kernel_ntt_radix4_mm_m8(", "kernel_ntt_radix4_mm_m16(",
+        "kernel_ntt_radix4_mm_m32(" };
+    static const char* const inv[] = { "kernel_ntt_inverse_mm_2_steps(", "kernel_inverse_ntt_radix4_mm(" };
+    auto has = [&](const char* p) { return s.name.rfind(p, 0) == 0; };
+    return inverse ? std::any_of(std::begin(inv), std::end(inv), has)
+                   : std::any_of(std::begin(fwd), std::end(fwd), has);
+}
+
+inline bool useLocalStages(std::vector<NttStage>& v, bool inverse, cl_uint n,
+                           cl_kernel kernel, cl_mem buf_w, cl_uint tile,
+                           const size_t* wg, bool debug = false)
+{
+    auto middle = [&](const NttStage& s) { return isMiddleStage(s, inverse); };
+    auto a = std::find_if(v.begin(), v.end(), middle);
+    if (a == v.end()) return false;
+    auto b = std::find_if_not(a, v.end(), middle);
+
+    // strides covered, the 2-step kernels doing two of them
+    const NttStage& z = *(b - 1);
+    const bool twoLast = z.name.find("2step") != std::string::npos || z.name.find("2_steps") != std::string::npos;
+    cl_uint hi, lo;
+    if (!inverse) {
+        hi = stageStride(a->name);
+        lo = stageStride(z.name) / (twoLast ? 4 : 1);
+    } else {
+        lo = stageStride(a->name);
+        hi = stageStride(z.name) * (twoLast ? 4 : 1);
+    }
+    if (hi == 0 || lo == 0) return false;
+
+    std::vector<LocalPass> passes = planLocalPasses(hi, lo, tile);
+    if (passes.size() >= static_cast<size_t>(b - a)) return false;
+    if (inverse) std::reverse(passes.begin(), passes.end());
+
+    std::vector<NttStage> repl;
+    const cl_mem unbound = nullptr;
+    const std::string kname = inverse ? "kernel_inverse_ntt_radix4_local_stages" : "kernel_ntt_radix4_local_stages";
+    for (const LocalPass& p : passes) {
+        const cl_uint size = p.cols * (4 * (p.hi / p.lo));
+        if (size < *wg || n % size != 0) return false;
+        NttStage s;
+        s.kernel = kernel;
+        s.args = { { sizeof(cl_mem), toBytes(unbound), true },
+                   { sizeof(cl_mem), toBytes(buf_w), false },
+                   { sizeof(cl_uint), toBytes(p.hi), false },
+                   { sizeof(cl_uint), toBytes(p.lo), false },
+                   { sizeof(cl_uint), toBytes(p.cols), false } };
+        s.globalScale = static_cast<int>(size / *wg);
+        s.localSize = wg;
+        s.name = kname + "(m=" + std::to_string(p.hi) + ".." + std::to_string(p.lo) + ")";
+        s.outputInverse = a->outputInverse;
+        if (debug) std::cout << s.name << " cols=" << p.cols << std::endl;
+        repl.push_back(std::move(s));
+    }
+    const auto at = v.erase(a, b);
+    v.insert(at, repl.begin(), repl.end());
+    return true;
+}
+
+// Swaps the radix-4 stages of stride 2, 4 and 8 for the tiled kernel: a
+// work-group of *wg work-items owns 4 * *wg contiguous residues.
+inline bool useTiledStages(std::vector<NttStage>& v, bool inverse,
+                           cl_kernel kernel, cl_mem buf_w, const size_t* wg,
+                           bool debug = false)
+{
+    static const char* const fwd[] = { "kernel_ntt_radix4_mm_m2(", "kernel_ntt_radix4_mm_m4(",
+        "kernel_ntt_radix4_mm_m8(" };
+    static const char* const inv[] = { "kernel_inverse_ntt_radix4_mm(" };
+    const cl_mem unbound = nullptr;
+    const std::string kname = inverse ? "kernel_inverse_ntt_radix4_tiled" : "kernel_ntt_radix4_tiled";
+    bool any = false;
+    for (NttStage& s : v) {
+        auto has = [&](const char* p) { return s.name.rfind(p, 0) == 0; };
+        const bool small = inverse ? std::any_of(std::begin(inv), std::end(inv), has)
+                                   : std::any_of(std::begin(fwd), std::end(fwd), has);
+        const cl_uint m = stageStride(s.name);
+        if (!small || m < 2 || m > 8) continue;
+        NttStage t;
+        t.kernel = kernel;
+        t.args = { { sizeof(cl_mem), toBytes(unbound), true },
+                   { sizeof(cl_mem), toBytes(buf_w), false },
+                   { sizeof(cl_uint), toBytes(m), false } };
+        t.globalScale = 4;
+        t.localSize = wg;
+        t.name = kname + "(m=" + std::to_string(m) + ")";
+        t.outputInverse = s.outputInverse;
+        if (debug) std::cout << s.name << " -> " << t.name << std::endl;
+        s = std::move(t);
+        any = true;
+    }
+    return any;
+}
+
 } // namespace opencl
 
 #endif // OPENCL_NTTPIPELINE_HPP
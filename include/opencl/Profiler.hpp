@@ -0,0 +1,85 @@
+// opencl/Profiler.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace opencl {
+
+// Per-kernel timing histograms, only alive with -profile (the queue is then
+// created with CL_QUEUE_PROFILING_ENABLE).
+// record() keeps the launch event; completed events are folded lazily into
+// a log-scale histogram (8 bins per octave of nanoseconds) keyed by the
+// stage name, so memory stays constant over a whole test and report()
+// gives p50/p99 and the bandwidth implied by the bytes each launch moves.
+// Under -trace every folded launch is also forwarded to util::Trace.
+class Profiler {
+public:
+    struct Summary {
+        std::string name;
+        uint64_t    count = 0;
+        double      p50Ns = 0.0, p99Ns = 0.0, totalNs = 0.0;
+        std::size_t bytes = 0;
+    };
+
+    Profiler() = default;
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Takes ownership of evt; bytes is the global memory traffic of the launch.
+    void record(const std::string& name, cl_event evt, std::size_t bytes);
+    // Waits for every recorded launch, then prints one line per kernel,
+    // slowest total first. Statistics are cumulative since construction.
+    void report(std::ostream& os, const std::string& when);
+    // Same figures, slowest total first; also waits for every launch.
+    std::vector<Summary> summary();
+    // Drops the statistics gathered so far (pending launches are folded first).
+    void reset();
+
+private:
+    static constexpr int kBinsPerOctave = 8;
+    static constexpr int kBins = 40 * kBinsPerOctave;    // up to ~1100 s
+
+    struct Stats {
+        std::array<uint64_t, kBins> bins{};
+        uint64_t count = 0;
+        uint64_t bytes = 0;       // per launch, last seen
+        double   totalNs = 0.0;
+        double   minNs = 0.0, maxNs = 0.0;
+    };
+    struct Pending {
+        const std::string* name;
+        Stats*   stats;
+        cl_event evt;
+        std::size_t bytes;
+    };
+
+    // Folds the completed head of the queue; wait=true folds everything.
+    void collect(bool wait);
+    void fold(const Pending& p);
+    static int binOf(double ns);
+    static double percentile(const Stats& s, double q);
+    // Maps the device clock of evt's queue onto the trace clock.
+    static void calibrateTrace(cl_event evt);
+
+    std::map<std::string, Stats> stats_;
+    std::deque<Pending>          pending_;
+};
+
+} // namespace opencl
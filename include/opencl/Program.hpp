@@ -18,7 +18,8 @@ class Program {
 public:
     Program(const opencl::Context& context, cl_device_id device,
             const std::string& filePath, const math::Precompute& pre,
-            const std::string& buildOptions = "", bool debug = false);
+            const std::string& buildOptions = "", bool debug = false,
+            const std::string& cacheDir = "");
 
     ~Program();
 
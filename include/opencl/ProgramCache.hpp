@@ -0,0 +1,58 @@
+// opencl/ProgramCache.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+
+namespace opencl {
+
+// On-disk cache of compiled program binaries.
+// An entry is keyed by the device (name, vendor, version, driver version),
+// the build options and the full program source, so any change to the
+// kernels, to the injected -D/#define values or to the driver simply misses
+// and triggers a normal rebuild.
+class ProgramCache {
+public:
+    explicit ProgramCache(std::string dir = "");
+
+    bool enabled() const noexcept { return !dir_.empty(); }
+
+    std::string makeKey(cl_device_id device,
+                        const std::string& source,
+                        const std::string& buildOptions) const;
+
+    // Returns a built program or nullptr on miss / stale / corrupt entry.
+    cl_program load(cl_context context, cl_device_id device,
+                    const std::string& key,
+                    const std::string& buildOptions) const;
+
+    // Best effort: failures are reported but never fatal.
+    void store(cl_program program, const std::string& key) const;
+
+    // SPIR-V built offline by `make spirv`, in <dir>/spirv/<key>.spv, the
+    // key covering the source and the options only. The kernels are
+    // specialized per exponent by -D options, so there is no fixed set to
+    // build: when <dir>/spirv exists, a program built from source leaves
+    // <key>.cl and <key>.opts there for the next `make spirv`.
+    // Returns a built program or nullptr when there is no entry or the
+    // device takes no SPIR-V (CL_DEVICE_IL_VERSION).
+    cl_program loadIL(cl_context context, cl_device_id device,
+                      const std::string& source,
+                      const std::string& buildOptions) const;
+    void requestIL(const std::string& source, const std::string& buildOptions) const;
+
+private:
+    std::string dir_;
+
+    std::string entryPath(const std::string& key) const;
+    std::string ilPath(const std::string& source, const std::string& buildOptions) const;
+};
+
+} // namespace opencl
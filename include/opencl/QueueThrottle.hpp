@@ -0,0 +1,57 @@
+// opencl/QueueThrottle.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+namespace opencl {
+
+// Queue-depth controller for the iteration loops.
+// tick() drops a marker on the (in-order) queue after each iteration and,
+// once depth() markers are pending, waits only on the oldest one, so the
+// device always has the next iterations queued instead of draining at a
+// blocking read. Whenever the host has to wait, the gap between two
+// retired markers is the device time of one tick; depth() follows
+// targetLatencyMs / tickMs() within [2, maxDepth], which bounds how long
+// an interrupt or a display waits behind the queue.
+class QueueThrottle {
+public:
+    QueueThrottle(cl_command_queue queue, std::size_t maxDepth,
+                  double targetLatencyMs = 50.0, std::size_t initialDepth = 16);
+    ~QueueThrottle();
+
+    QueueThrottle(const QueueThrottle&) = delete;
+    QueueThrottle& operator=(const QueueThrottle&) = delete;
+
+    void tick();
+    // Waits for every pending marker.
+    void drain();
+
+    std::size_t depth() const noexcept { return depth_; }
+    std::size_t pending() const noexcept { return markers_.size(); }
+    // Smoothed device time per tick, 0 until the host has had to wait.
+    double tickMs() const noexcept { return tickMs_; }
+
+private:
+    void retireOldest(bool adapt);
+
+    cl_command_queue      queue_;
+    std::deque<cl_event>  markers_;
+    std::size_t           depth_;
+    std::size_t           maxDepth_;
+    double                targetMs_;
+    double                tickMs_ = 0.0;
+    std::chrono::steady_clock::time_point lastRetire_{};
+    bool                  haveRetire_ = false;
+};
+
+} // namespace opencl
@@ -0,0 +1,62 @@
+// opencl/Staging.hpp
+#pragma once
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <cstddef>
+
+namespace opencl {
+
+// Pinned host memory for the large blocking transfers. A read or a write
+// from pageable memory is bounced by the driver through a staging copy of
+// its own; here the device copies straight into a CL_MEM_ALLOC_HOST_PTR
+// block, mapped once, and the host copies it out. The block grows to the
+// largest transfer seen (a residue, or a checkpoint by kMaxBlock pieces)
+// and is reused. Small transfers, or when no pinned block can be had, go
+// directly. On a device sharing host memory (an integrated GPU or an APU)
+// the buffer itself is mapped and copied: there is nothing to stage.
+class Staging {
+public:
+    // The block is mapped on mapQueue, which must outlive the Staging.
+    // `unified` is CL_DEVICE_HOST_UNIFIED_MEMORY of the device.
+    explicit Staging(cl_command_queue mapQueue, bool unified = false);
+    ~Staging();
+
+    Staging(const Staging&) = delete;
+    Staging& operator=(const Staging&) = delete;
+
+    // Blocking transfers of `bytes` at `offset` in `mem` on `queue`
+    // (mapQueue when null).
+    cl_int read(cl_mem mem, void* host, std::size_t bytes, std::size_t offset = 0,
+                cl_command_queue queue = nullptr);
+    cl_int write(cl_mem mem, const void* host, std::size_t bytes, std::size_t offset = 0,
+                 cl_command_queue queue = nullptr);
+
+    bool unified() const noexcept { return unified_; }
+
+private:
+    static constexpr std::size_t kMinBytes = std::size_t(64) << 10;
+    static constexpr std::size_t kMaxBlock = std::size_t(64) << 20;
+
+    // Pinned bytes for a transfer of `bytes`, 0 when it goes directly.
+    std::size_t reserve(std::size_t bytes);
+    void release();
+    // Maps the transfer range of `mem`; false when the map fails.
+    bool mapped(cl_command_queue queue, cl_mem mem, void* host, const void* in,
+                std::size_t bytes, std::size_t offset);
+
+    cl_command_queue queue_;
+    cl_mem pinned_ = nullptr;
+    void* host_ = nullptr;
+    std::size_t size_ = 0;
+    bool failed_ = false;
+    bool unified_;
+};
+
+} // namespace opencl
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+
+namespace util {
+
+// Exclusive flock on <file>.lock for the lifetime of the object: it keeps
+// out the other processes (-devices children, a second prmers on the same
+// directory) as well as the other threads, each taking its own descriptor.
+// Nothing is locked on Windows.
+class FileLock {
+public:
+    explicit FileLock(const std::string& file);
+    ~FileLock();
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+    bool held() const noexcept { return fd_ >= 0; }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
+
+} // namespace util
@@ -1,6 +1,14 @@
 #ifndef FS_HPP
 #define FS_HPP
+#include <cstddef>
 #include <string>
+#include <utility>
+#include <vector>
 std::string getExecutableDir();
 void markJsonAsSent(const std::string& path);
+// Writes the parts back to back to a temporary file of this process and
+// thread next to path, syncs it and renames it over path, so an interrupted
+// write never leaves a truncated file behind and two writers never share one.
+bool writeFileDurable(const std::string& path,
+                      const std::vector<std::pair<const void*, std::size_t>>& parts);
 #endif
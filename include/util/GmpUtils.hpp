@@ -8,9 +8,13 @@
 namespace util {
     mpz_class convertToGMP(const std::vector<uint32_t>& words);
     std::vector<uint32_t> convertFromGMP(const mpz_class& gmp_val);
+    // The digits as a residue mod Mp = 2^E - 1, E being the sum of the widths.
     mpz_class vectToMpz(const std::vector<uint64_t>& v,
                         const std::vector<int>& widths,
                         const mpz_class& Mp);
+    // Inverse of vectToMpz: splits x (< 2^sum(widths)) into digits.
+    std::vector<uint64_t> mpzToVect(const mpz_class& x,
+                                    const std::vector<int>& widths);
 
     mpz_class mersenneReduce(const mpz_class& x, uint32_t E);
     mpz_class mersennePowMod(const mpz_class& base, uint64_t exp, uint32_t E);
@@ -0,0 +1,57 @@
+// include/util/HostPool.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+
+// Reusable host copies of a residue. The saves, the res64 displays and the
+// proof points of a test each need an N-limb vector for a moment; allocated
+// afresh, every one costs N * 8 bytes of page faults, which adds up with
+// many small jobs on a shared host. The pool keeps at most kMaxFree vectors
+// of the size given to reserve() (once per job) and hands them out as
+// leases that come back when destroyed, on any thread. A vector of another
+// size is allocated and freed as before.
+class HostPool {
+public:
+    class Lease {
+    public:
+        Lease() = default;
+        ~Lease() { reset(); }
+        Lease(Lease&& o) noexcept : v_(std::move(o.v_)) {}
+        Lease& operator=(Lease&& o) noexcept { if (this != &o) { reset(); v_ = std::move(o.v_); } return *this; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        std::vector<uint64_t>& operator*() noexcept { return v_; }
+        const std::vector<uint64_t>& operator*() const noexcept { return v_; }
+        std::vector<uint64_t>* operator->() noexcept { return &v_; }
+        uint64_t* data() noexcept { return v_.data(); }
+        std::size_t size() const noexcept { return v_.size(); }
+
+        // Gives the vector back now.
+        void reset();
+
+    private:
+        friend class HostPool;
+        explicit Lease(std::vector<uint64_t>&& v) noexcept : v_(std::move(v)) {}
+        std::vector<uint64_t> v_;
+    };
+
+    // Sets the size of the pooled vectors, freeing those of the last job.
+    static void reserve(std::size_t limbs);
+    // A vector of `limbs` limbs, zeroed unless `clear` is false.
+    static Lease acquire(std::size_t limbs, bool clear = true);
+    // Bytes of the vectors out on lease and kept free.
+    static std::size_t bytes() noexcept;
+
+private:
+    static constexpr std::size_t kMaxFree = 8;
+    static void release(std::vector<uint64_t>&& v);
+};
+
+// Resident set size of the process in bytes, 0 where it is not known.
+std::size_t residentBytes();
+
+} // namespace util
@@ -0,0 +1,29 @@
+#pragma once
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The small JSON files of prmers (plan database, Gerbicz-Li and crash
+// rates): one array of flat objects, read without a JSON library.
+namespace util {
+
+std::string jsonEscape(const std::string& s);
+
+// Value of "key" inside one flat JSON object, without the quotes for
+// strings and the brackets for arrays.
+std::optional<std::string> jsonField(const std::string& obj, const std::string& key);
+
+// The objects of the first array of text.
+std::vector<std::string> jsonObjects(const std::string& text);
+
+// Contents of path, empty when there is none.
+std::string readJsonFile(const std::string& path);
+
+// Replaces path with update(what it holds now) under an exclusive lock on
+// path.lock, through writeFileDurable: runs of other processes that share
+// the file never lose each other's additions.
+bool updateJsonFile(const std::string& path,
+                    const std::function<std::string(const std::string& current)>& update);
+
+} // namespace util
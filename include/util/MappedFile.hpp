@@ -0,0 +1,37 @@
+// include/util/MappedFile.hpp
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace util {
+
+// Read-only memory mapping of a whole file. Pages are brought in on first
+// touch; prefetch() asks the OS to start reading them ahead of use.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool isOpen() const noexcept { return data_ != nullptr; }
+
+    void prefetch() const noexcept;
+
+private:
+    const unsigned char* data_ = nullptr;
+    std::size_t          size_ = 0;
+#ifdef _WIN32
+    void*                mapping_ = nullptr;
+#endif
+
+    void close() noexcept;
+};
+
+} // namespace util
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Residues mod 2^E - 1 as E bits in 32-bit words, least significant first,
+// without going through GMP: linear in the size and no temporaries.
+namespace util {
+    // Packs digits x[i] of width widths[i] (sum E), carrying them on the
+    // way: a digit may hold any 64-bit value, and what overflows bit E wraps
+    // to bit 0. The result is canonical, 2^E - 1 comes out as 0.
+    std::vector<uint32_t> packResidue(const std::vector<uint64_t>& x,
+                                      const std::vector<int>& widths,
+                                      uint32_t E);
+
+    uint32_t mod3(const std::vector<uint32_t>& W);
+    // W / 3 and W / 9 mod 2^E - 1 (E odd), in place: the final PRP-3 residue.
+    void div3(uint32_t E, std::vector<uint32_t>& W);
+    void div9(uint32_t E, std::vector<uint32_t>& W);
+
+    bool isResidue(const std::vector<uint32_t>& W, uint32_t a);
+    // The low 64 bits in 16 upper-case hex digits, the low 2048 in 512 lower-case ones.
+    std::string res64Hex(const std::vector<uint32_t>& W);
+    std::string res2048Hex(const std::vector<uint32_t>& W);
+}
@@ -0,0 +1,50 @@
+// include/util/Trace.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace util {
+
+// Host / GPU timeline recorder for -trace, written in the Chrome Trace
+// Event format (chrome://tracing, Perfetto) when the run ends.
+// Spans go to a fixed-size ring buffer, so a long test keeps only the most
+// recent `capacity` events and the cost of a span is one lock and one copy.
+// GPU spans carry device timestamps; setGpuOffset() maps them onto the host
+// clock. Every call is a no-op until open() succeeded.
+class Trace {
+public:
+    static bool open(const std::string& path, std::size_t capacity = std::size_t(1) << 18);
+    static bool enabled() noexcept;
+
+    // Nanoseconds on the trace clock (steady, 0 at open()).
+    static uint64_t nowNs();
+
+    static void host(const char* name, uint64_t beginNs, uint64_t endNs, const char* cat = "host");
+    static void gpu(const std::string& name, uint64_t deviceBeginNs, uint64_t deviceEndNs);
+    // host clock - device clock, in ns
+    static void setGpuOffset(int64_t offsetNs);
+    static bool gpuCalibrated() noexcept;
+
+    // Writes the buffered events; later spans are still recorded.
+    static bool write();
+};
+
+// Records [construction, destruction) as a host span.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* cat = "host")
+        : name_(name), cat_(cat), on_(Trace::enabled()), begin_(on_ ? Trace::nowNs() : 0) {}
+    ~TraceSpan() { if (on_) Trace::host(name_, begin_, Trace::nowNs(), cat_); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    const char* cat_;
+    bool        on_;
+    uint64_t    begin_;
+};
+
+} // namespace util
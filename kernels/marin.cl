@@ -85,7 +85,20 @@ INLINE uint64 reduce(const uint64 lo, const uint64 hi)
 
 INLINE uint64 mod_add(const uint64 lhs, const uint64 rhs) { return lhs + rhs + ((lhs >= MOD_P - rhs) ? MOD_MP64 : 0); }
 INLINE uint64 mod_sub(const uint64 lhs, const uint64 rhs) { return lhs - rhs - ((lhs < rhs) ? MOD_MP64 : 0); }
+#if defined(AMD_MAD64)
+// The 128-bit product from 32 x 32 + 64 products, each one a v_mad_u64_u32 on AMD.
+INLINE uint64 mod_mul(const uint64 lhs, const uint64 rhs)
+{
+	const uint32 a0 = (uint32)(lhs), a1 = (uint32)(lhs >> 32), b0 = (uint32)(rhs), b1 = (uint32)(rhs >> 32);
+	const uint64 p00 = (uint64)(a0) * b0;
+	const uint64 p01 = (uint64)(a0) * b1 + (p00 >> 32);
+	const uint64 p10 = (uint64)(a1) * b0 + (uint32)(p01);
+	const uint64 p11 = (uint64)(a1) * b1 + (p01 >> 32) + (p10 >> 32);
+	return reduce((p10 << 32) | (uint32)(p00), p11);
+}
+#else
 INLINE uint64 mod_mul(const uint64 lhs, const uint64 rhs) { return reduce(lhs * rhs, mul_hi(lhs, rhs)); }
+#endif
 INLINE uint64 mod_sqr(const uint64 lhs) { return mod_mul(lhs, lhs); }
 INLINE uint64 mod_muli(const uint64 lhs) { return reduce(lhs << 48, lhs >> (64 - 48)); }	// sqrt(-1) = 2^48 (mod p)
 INLINE uint64 mod_half(const uint64 lhs) { return ((lhs % 2 == 0) ? lhs / 2 : ((lhs - 1) / 2 + (MOD_P + 1) / 2)); }
@@ -386,10 +399,10 @@ void sqr4(__global uint64 * restrict const reg, __global const uint64 * restrict
 
 // Radix-2, mul2x2, inverse radix-2
 __kernel
-void mul4(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y)
+void mul4(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	__global uint64_2 * restrict const x = (__global uint64_2 *)(&reg[offset_x]);
-	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 	__global const uint64 * restrict const r0 = &root[0];
 	__global const uint64 * restrict const r0i = &root[N_SZ];
 
@@ -438,10 +451,10 @@ void sqr4x2(__global uint64 * restrict const reg, __global const uint64 * restri
 
 // 2 x Radix-2, mul2x2, inverse radix-2
 __kernel
-void mul4x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y)
+void mul4x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	__global uint64_2 * restrict const x = (__global uint64_2 *)(&reg[offset_x]);
-	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 	__global const uint64_2 * restrict const r0 = (__global const uint64_2 *)&root[0];
 	__global const uint64_2 * restrict const r0i = (__global const uint64_2 *)&root[N_SZ];
 
@@ -546,10 +559,10 @@ void sqr10(__global uint64 * restrict const reg, __global const uint64 * restric
 
 // Radix-2, radix-5, mul, inverse radix-5, inverse radix-2
 __kernel
-void mul10(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y)
+void mul10(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset_x, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	__global uint64_2 * restrict const x = (__global uint64_2 *)(&reg[offset_x]);
-	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global const uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 	__global const uint64 * restrict const r2 = &root[0];
 	__global const uint64 * restrict const r2i = &root[N_SZ];
 	__global const uint64_2 * restrict const r5 = (__global const uint64_2 *)(&root[N_SZ / 5]);
@@ -893,10 +906,10 @@ void sqr16x2(__global uint64 * restrict const reg, __global const uint64 * restr
 // 2 x Radix-4, mul4, inverse radix-4
 __kernel
 ATTR_16x2()
-void mul16x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul16x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_16x2();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(2, &X[i4], 2, &x[k4], r2[j4], r4[j4]);
 	mul_4x2(&X[i], &y[k], r0[j], r0i[j]);
@@ -942,10 +955,10 @@ void sqr64x2(__global uint64 * restrict const reg, __global const uint64 * restr
 
 __kernel
 ATTR_64x2()
-void mul64x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul64x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_64x2();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(8, &X[i16], 8, &x[k16], r2[j16], r4[j16]);
 	forward_4(2, &X[i4], r2[j4], r4[j4]);
@@ -997,10 +1010,10 @@ void sqr256x2(__global uint64 * restrict const reg, __global const uint64 * rest
 
 __kernel
 ATTR_256x2()
-void mul256x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul256x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_256x2();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(32, &X[i64], 32, &x[k64], r2[j64], r4[j64]);
 	forward_4(8, &X[i16], r2[j16], r4[j16]);
@@ -1058,10 +1071,10 @@ void sqr1024x2(__global uint64 * restrict const reg, __global const uint64 * res
 
 __kernel
 ATTR_1024x2()
-void mul1024x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul1024x2(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_1024x2();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(128, &X[i256], 128, &x[k256], r2[j256], r4[j256]);
 	forward_4(32, &X[i64], r2[j64], r4[j64]);
@@ -1242,10 +1255,10 @@ void sqr40(__global uint64 * restrict const reg, __global const uint64 * restric
 // Radix-4, radix-2, radix-5, mul, inverse radix-5, inverse radix-2, inverse radix-4
 __kernel
 ATTR_40()
-void mul40(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul40(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_40();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(1 * 5, &X[i1], 1 * 5, &x[k1], r2[j1], r4[j1]);
 	mul_10(&X[i], &y[k], r0[j], r0i[j], r5[j], r5i[j], lid4 < 4 * WGSIZE40 / 5);
@@ -1294,10 +1307,10 @@ void sqr160(__global uint64 * restrict const reg, __global const uint64 * restri
 
 __kernel
 ATTR_160()
-void mul160(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul160(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_160();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(4 * 5, &X[i4], 4 * 5, &x[k4], r2[j4], r4[j4]);
 	forward_4(1 * 5, &X[i1], r2[j1], r4[j1]);
@@ -1352,10 +1365,10 @@ void sqr640(__global uint64 * restrict const reg, __global const uint64 * restri
 
 __kernel
 ATTR_640()
-void mul640(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul640(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_640();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(16 * 5, &X[i16], 16 * 5, &x[k16], r2[j16], r4[j16]);
 	forward_4(4 * 5, &X[i4], r2[j4], r4[j4]);
@@ -1416,10 +1429,10 @@ void sqr2560(__global uint64 * restrict const reg, __global const uint64 * restr
 
 __kernel
 ATTR_2560()
-void mul2560(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y)
+void mul2560(__global uint64 * restrict const reg, __global const uint64 * restrict const root, const sz_t offset, const sz_t offset_y, __global uint64 * restrict const reg_y)
 {
 	DECLARE_VAR_2560();
-	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg[offset_y]);
+	__global uint64_2 * restrict const y = (__global uint64_2 *)(&reg_y[offset_y]);
 
 	forward_4i(64 * 5, &X[i64], 64 * 5, &x[k64], r2[j64], r4[j64]);
 	forward_4(16 * 5, &X[i16], r2[j16], r4[j16]);
@@ -1572,10 +1585,10 @@ void carry_weight_mul2_p2(__global uint64 * restrict const reg, __global const u
 // --- misc ---
 
 __kernel
-void copy(__global uint64 * restrict const reg, const sz_t offset_y, const sz_t offset_x)
+void copy(__global uint64 * restrict const reg, const sz_t offset_y, const sz_t offset_x, __global const uint64 * restrict const reg_x)
 {
 	const sz_t gid = (sz_t)get_global_id(0);
-	reg[offset_y + gid] = reg[offset_x + gid];
+	reg[offset_y + gid] = reg_x[offset_x + gid];
 }
 
 #if defined(CWM_WG_SZ)
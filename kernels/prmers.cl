@@ -26,9 +26,58 @@ __constant ulong4 mod_p_comp4_const = (ulong4)(MOD_P_COMP,MOD_P_COMP,MOD_P_COMP,
 __constant ulong2 mod_p2_const      = (ulong2)(MOD_P,MOD_P);
 __constant ulong2 mod_p_comp2_const = (ulong2)(MOD_P_COMP,MOD_P_COMP);
 
+#ifdef LAZY_REDUCTION
+// Redundant residues: any 64-bit word, x and x + p (x < 2^32 - 1) stand for
+// the same value. A wrap of the 64-bit sum is folded back with 2^64 = 2^32 - 1
+// (mod p), using the hardware carry instead of comparing against p - b; a
+// second fold is needed only when both operands are >= p. Reduce accepts
+// these inputs and returns [0, p), so every value leaving the transform
+// through the digit weights (or any modMul) is canonical again.
+inline ulong modAdd(const ulong a, const ulong b){
+    ulong r = a + b;
+    const ulong c = (r < a) ? mod_p_comp_const : 0;
+    r += c;
+    return r + ((r < c) ? mod_p_comp_const : 0);
+}
+inline ulong modSub(const ulong a, const ulong b){
+    const ulong r = a - b;
+    const ulong c = (a < b) ? mod_p_comp_const : 0;
+    return (r - c) - ((r < c) ? mod_p_comp_const : 0);
+}
+#else
 inline ulong modAdd(const ulong a, const ulong b){ const uint c = (a >= mod_p_const - b) ? mod_p_comp_const : 0; return a + b + c; }
 inline ulong modSub(const ulong a, const ulong b){ const uint c = (a < b) ? mod_p_comp_const : 0; return a - b - c; }
+#endif
+
+#if defined(VENDOR_NVIDIA) || defined(__NV_CL_C_VERSION)
+#define PTX_ASM 1
+#endif
 
+#if defined(PTX_ASM) || defined(VENDOR_AMD)
+// Any 2^64 * hi + lo to [0, p), as in marin: with hi = (hh, hl),
+// s = hl * (2^32 - 1) + (2^32 - 1 - hh) < p cannot overflow, and adding the
+// extra 2^32 - 1 back is one carry test. With PTX the carries are the flags.
+inline ulong Reduce(const ulong lo, const ulong hi){
+    const uint hh = (uint)(hi >> 32), hl = (uint)hi;
+    const ulong s = upsample(hl, mod_p_comp_const - hh) - hl;
+#if defined(PTX_ASM)
+    ulong r; uint nc, c;
+    asm volatile ("add.cc.u64 %0, %1, %2;" : "=l" (r) : "l" (s), "l" (lo));
+    asm volatile ("addc.u32 %0, 0xffffffff, 0;" : "=r" (nc));
+    asm volatile ("sub.cc.u64 %0, %1, %2;" : "=l" (r) : "l" (r), "l" ((ulong)nc));
+    asm volatile ("subc.u32 %0, 0, 0;" : "=r" (c));
+    asm volatile ("sub.cc.u64 %0, %1, %2;" : "=l" (r) : "l" (r), "l" ((ulong)c));
+    return r;
+#else
+    ulong r = s + lo;
+    if (r >= s) {
+        const uint c = (r < mod_p_comp_const) ? mod_p_comp_const : 0;
+        r -= mod_p_comp_const; r -= c;
+    }
+    return r;
+#endif
+}
+#else
 inline ulong Reduce(const ulong lo, const ulong hi){
     ulong r = lo;
     const ulong add = hi << 32;
@@ -38,6 +87,7 @@ inline ulong Reduce(const ulong lo, const ulong hi){
     r = r - sub - c;
     return r;
 }
+#endif
 
 inline ulong2 Reduce2(const ulong2 lo, const ulong2 hi){
     ulong2 r = lo;
@@ -58,23 +108,85 @@ inline ulong4 Reduce4(const ulong4 lo, const ulong4 hi){
 }
 
 inline ulong modMul(const ulong a, const ulong b){
+#if defined(VENDOR_AMD)
+    // 32 x 32 + 64 products, one v_mad_u64_u32 each, instead of mul_hi
+    const uint a0 = (uint)a, a1 = (uint)(a >> 32), b0 = (uint)b, b1 = (uint)(b >> 32);
+    const ulong p00 = (ulong)a0 * b0;
+    const ulong p01 = (ulong)a0 * b1 + (p00 >> 32);
+    const ulong p10 = (ulong)a1 * b0 + (uint)p01;
+    const ulong p11 = (ulong)a1 * b1 + (p01 >> 32) + (p10 >> 32);
+    return Reduce((p10 << 32) | (uint)p00, p11);
+#else
     const ulong lo = a * b;
     const ulong hi = mul_hi(a, b);
     return Reduce(lo, hi);
+#endif
+}
+
+// Twiddles w^j, w^2j, w^3j of the radix-4 stage of stride m, from the table
+// row 3 * (2m + j). With TWIDDLE_OTF only w^j is read, as the product of two
+// short rows: w_{2m}^j = w_{2m/B}^{j/B} * w_{2m}^{j%B}, B = 2^s ~ sqrt(2m).
+// Those rows stay in cache, so a stage streams the data alone.
+inline ulong4 stage_twiddles(__global const ulong* restrict w, const uint m, const uint j)
+{
+#ifdef TWIDDLE_OTF
+    const uint r = 2 * m, s = (31 - clz(r)) >> 1;
+    const ulong r1 = modMul(w[3 * ((r >> s) + (j >> s))], w[3 * (r + (j & ((1u << s) - 1)))]);
+    const ulong r2 = modMul(r1, r1);
+    return (ulong4)(r1, r2, modMul(r2, r1), 0);
+#else
+    const uint o = 6 * m + 3 * j;
+    return (ulong4)(vload2(0, w + o), w[o + 2], 0);
+#endif
 }
 
 inline ulong2 modMul2(const ulong2 a, const ulong2 b){
+#if defined(PTX_ASM) || defined(VENDOR_AMD)
+    return (ulong2)(modMul(a.s0, b.s0), modMul(a.s1, b.s1));
+#else
     ulong2 lo = a * b;
     ulong2 hi = (ulong2)(mul_hi(a.s0,b.s0), mul_hi(a.s1,b.s1));
     return Reduce2(lo, hi);
+#endif
 }
 
 inline ulong4 modMul4(const ulong4 a, const ulong4 b){
+#if defined(PTX_ASM) || defined(VENDOR_AMD)
+    return (ulong4)(modMul(a.s0, b.s0), modMul(a.s1, b.s1), modMul(a.s2, b.s2), modMul(a.s3, b.s3));
+#else
     ulong4 lo = a * b;
     ulong4 hi = (ulong4)(mul_hi(a.s0,b.s0), mul_hi(a.s1,b.s1), mul_hi(a.s2,b.s2), mul_hi(a.s3,b.s3));
     return Reduce4(lo, hi);
+#endif
+}
+
+#ifdef LAZY_REDUCTION
+inline ulong4 modAdd4(const ulong4 a, const ulong4 b){
+    ulong4 r = a + b;
+    const ulong4 c = select((ulong4)(0), mod_p_comp4_const, r < a);
+    r += c;
+    return r + select((ulong4)(0), mod_p_comp4_const, r < c);
+}
+
+inline ulong4 modSub4(const ulong4 a, const ulong4 b){
+    const ulong4 r = a - b;
+    const ulong4 c = select((ulong4)(0), mod_p_comp4_const, a < b);
+    return (r - c) - select((ulong4)(0), mod_p_comp4_const, r < c);
+}
+
+inline ulong2 modAdd2(const ulong2 a, const ulong2 b){
+    ulong2 r = a + b;
+    const ulong2 c = select((ulong2)(0), mod_p_comp2_const, r < a);
+    r += c;
+    return r + select((ulong2)(0), mod_p_comp2_const, r < c);
 }
 
+inline ulong2 modSub2(const ulong2 a, const ulong2 b){
+    const ulong2 r = a - b;
+    const ulong2 c = select((ulong2)(0), mod_p_comp2_const, a < b);
+    return (r - c) - select((ulong2)(0), mod_p_comp2_const, r < c);
+}
+#else
 inline ulong4 modAdd4(const ulong4 a, const ulong4 b){
     ulong4 r = a + b;
     ulong4 c = select((ulong4)(0), mod_p_comp4_const, a >= mod_p4_const - b);
@@ -96,6 +208,7 @@ inline ulong2 modSub2(const ulong2 a, const ulong2 b){
     ulong2 c = select((ulong2)(0), mod_p_comp2_const, a < b);
     return a - b - c;
 }
+#endif
 
 inline ulong4 modMul3_2(const ulong4 lhs, const ulong2 w02, const ulong w3){
     ulong2 x = (ulong2)(lhs.s1, lhs.s2);
@@ -105,9 +218,13 @@ inline ulong4 modMul3_2(const ulong4 lhs, const ulong2 w02, const ulong w3){
 }
 
 inline ulong modMulPminus1(const ulong x) {
+#ifdef LAZY_REDUCTION
+    return modSub(0, x);
+#else
     ulong r = mod_p_const - x;
     r += (r >= mod_p_const) ? mod_p_comp_const : 0;
     return r;
+#endif
 }
 inline ulong4 modMul3_2_w10(const ulong4 lhs)
 {
@@ -325,28 +442,40 @@ inline ulong4 digit_adc4_last(ulong4 a,int4 w,__private ulong*restrict k){
 #define TRANSFORM_SIZE_N_DIV4  (TRANSFORM_SIZE_N / 4)
 #define TRANSFORM_SIZE_N_DIV8  (TRANSFORM_SIZE_N / 8)
 
+// Digit i spans bits ceil(p*i/n) to ceil(p*(i+1)/n) - 1. With p = q*n + r,
+// its width is q + 1 exactly when (r*i mod n) is 0 or above n - r (r != 0).
+// MODULUS_P and TRANSFORM_SIZE_N are build constants: the modulo by n folds
+// into a mask or a multiply-high and no width table is read.
+#define DIGIT_WIDTH_BASE ((int)(MODULUS_P / TRANSFORM_SIZE_N))
+#define DIGIT_WIDTH_REM  ((uint)(MODULUS_P % TRANSFORM_SIZE_N))
+
 inline int get_digit_width(uint i) {
-    uint j = i + 1;
+    const uint t = (uint)(((ulong)DIGIT_WIDTH_REM * i) % TRANSFORM_SIZE_N);
+    const uint u = (t == 0) ? TRANSFORM_SIZE_N - 1 : t - 1;
+    return DIGIT_WIDTH_BASE + ((u + DIGIT_WIDTH_REM >= TRANSFORM_SIZE_N) ? 1 : 0);
+}
 
-    ulong pj  = (ulong)(MODULUS_P) * j;
-    ulong pj1 = (ulong)(MODULUS_P) * i;
+inline int4 get_digit_width4(uint i){
+    return (int4)(get_digit_width(i), get_digit_width(i + 1), get_digit_width(i + 2), get_digit_width(i + 3));
+}
 
-    ulong ceil1 = (pj - 1U) / (ulong)(TRANSFORM_SIZE_N);
-    ulong ceil2 = (pj1 - 1U) / (ulong)(TRANSFORM_SIZE_N);
+// -DCARRY_SUB=s: the carry of a product (kernel_carry, the lookahead and the
+// fused inverse-carry kernels) also subtracts s. LL sets it for its -2, the
+// squaring being the only product it carries. 2^p - 1 - s is added to the
+// unweighted digits first, each digit its mask and digit 0 s less; those
+// are convolution sums far below 2^64 - 2^32, so nothing overflows and the
+// carry itself settles the borrow.
+#ifndef CARRY_SUB
+#define CARRY_SUB 0
+#endif
 
-    return (int)(ceil1 - ceil2);
+inline ulong carry_sub_digit(uint i, int w) {
+    return ((1UL << w) - 1UL) - ((i == 0) ? (ulong)CARRY_SUB : 0UL);
 }
 
-
-inline int4 get_digit_width4(uint i){
-    ulong P = (ulong)MODULUS_P, N = (ulong)TRANSFORM_SIZE_N;
-    ulong u = (ulong)i * P - 1, v;
-    int4 r;
-    v = u + P;    r.s0 = (int)(v/N - u/N);
-    u = v;        v = u + P;    r.s1 = (int)(v/N - u/N);
-    u = v;        v = u + P;    r.s2 = (int)(v/N - u/N);
-    u = v;        v = u + P;    r.s3 = (int)(v/N - u/N);
-    return r;
+inline ulong4 carry_sub4(uint i, int4 w) {
+    return (ulong4)(carry_sub_digit(i, w.s0), carry_sub_digit(i + 1, w.s1),
+                    carry_sub_digit(i + 2, w.s2), carry_sub_digit(i + 3, w.s3));
 }
 
 
@@ -397,64 +526,25 @@ __kernel void kernel_sub1(__global ulong* restrict x)
         }
     }
 }
-#ifndef DIGIT_WIDTH_VALUE_1
-#define DIGIT_WIDTH_VALUE_1 1
-#endif
-#ifndef DIGIT_WIDTH_VALUE_2
-#define DIGIT_WIDTH_VALUE_2 1
-#endif
-
 __kernel void kernel_carry(
     __global ulong*       restrict x,
-    __global ulong*       restrict carry_array,
-    __global const ulong* restrict maskPacked
+    __global ulong*       restrict carry_array
 ){
     const uint gid   = get_global_id(0);
     const uint start = gid * LOCAL_PROPAGATION_DEPTH;
     const uint end   = start + LOCAL_PROPAGATION_DEPTH;
 
-    const int4 DW1 = (int4)(DIGIT_WIDTH_VALUE_1);
-    const int4 DW2 = (int4)(DIGIT_WIDTH_VALUE_2);
-
     ulong carry = 0UL;
 
-    uint base = start >> 6;
-    uint off  = start & 63;
-
-    ulong lo = maskPacked[base + 0];
-    ulong hi = maskPacked[base + 1];
-
-    ulong sh     = (ulong)((64 - off) & 63);
-    ulong nzmask = (ulong)0 - (ulong)(off != 0);
-    ulong merged = (lo >> off) | ((hi << sh) & nzmask);
-
     PRAGMA_UNROLL(LOCAL_PROPAGATION_DEPTH_DIV4)
     for (uint i = start; i < end; i += 4) {
         ulong4 x_vec = vload4(0, x + i);
-
-        uint nib = (uint)(merged & 0xFULL);
-
-        int4 sel = (int4)(
-            (nib >> 0) & 1,
-            (nib >> 1) & 1,
-            (nib >> 2) & 1,
-            (nib >> 3) & 1
-        ) * -1;
-
-        sel = bitselect(DW1, DW2, (sel));
-
-        x_vec = digit_adc4(x_vec, sel, &carry);
+        const int4 w = get_digit_width4(i);
+#if CARRY_SUB
+        x_vec += carry_sub4(i, w);
+#endif
+        x_vec = digit_adc4(x_vec, w, &carry);
         vstore4(x_vec, 0, x + i);
-
-        sh = (ulong)0 - (off == 60);
-        nzmask = maskPacked[base + 2];
-
-        merged = select(merged >> 4, hi, sh);
-        lo     = select(lo, hi, sh);
-        hi     = select(hi, nzmask, sh);
-
-        off  = (off + 4) & 63;
-        base += sh;
     }
 
     carry_array[gid] = carry;
@@ -466,82 +556,39 @@ __kernel void kernel_carry(
 #define CONST_SCALAR_MUL 3UL
 __constant ulong4 CONST_SCALAR_VEC = (ulong4)(CONST_SCALAR_MUL, CONST_SCALAR_MUL, CONST_SCALAR_MUL, CONST_SCALAR_MUL);
 
+// 3 * x in one pass, from the raw output of the inverse transform as well as
+// from normalised digits: carry1 splits each word into its digit and the
+// carry into the next one, and only the digits are scaled. What carry1 holds
+// at the end of the block is worth 3 * carry1 to the next block; folding it
+// in earlier would count it twice, as the next digit has already taken it.
 __kernel void kernel_carry_mul_3(
     __global ulong*       restrict x,
-    __global ulong*       restrict carry_array,
-    __global const ulong* restrict maskPacked
+    __global ulong*       restrict carry_array
 ) {
     const uint gid   = get_global_id(0);
     const uint start = gid * LOCAL_PROPAGATION_DEPTH;
     const uint end   = start + LOCAL_PROPAGATION_DEPTH;
 
-    const int4 DW1 = (int4)(DIGIT_WIDTH_VALUE_1);
-    const int4 DW2 = (int4)(DIGIT_WIDTH_VALUE_2);
-
     ulong carry1 = 0UL;
     ulong carry  = 0UL;
 
-    uint base = start >> 6;
-    uint off  = start & 63;
-
-    ulong lo = maskPacked[base + 0];
-    ulong hi = maskPacked[base + 1];
-
-    ulong sh     = (ulong)((64 - off) & 63);
-    ulong nzmask = (ulong)0 - (ulong)(off != 0);
-    ulong merged = (lo >> off) | ((hi << sh) & nzmask);
-
     PRAGMA_UNROLL(LOCAL_PROPAGATION_DEPTH_DIV4)
     for (uint i = start; i < end; i += 4) {
         ulong4 x_vec = vload4(0, x + i);
-
-        uint nib = (uint)(merged & 0xFULL);
-        int4 sel = (int4)(
-            (nib >> 0) & 1,
-            (nib >> 1) & 1,
-            (nib >> 2) & 1,
-            (nib >> 3) & 1
-        ) * -1;
-
-        sel = bitselect(DW1, DW2, (sel));
+        const int4 sel = get_digit_width4(i);
 
         x_vec = digit_adc4(x_vec, sel, &carry1);
         ulong4 lo_vec = x_vec * CONST_SCALAR_VEC;
         x_vec = digit_adc4(lo_vec, sel, &carry);
-        carry = carry + 3UL * carry1;
         vstore4(x_vec, 0, x + i);
-
-        uint wrap = (off + 4U) >> 6;
-        ulong wrapMask = (ulong)0 - (ulong)wrap;
-        uint off_next = (off + 4U) & 63U;
-
-        ulong nextChunk = maskPacked[base + 2];
-
-        ulong inject = ((ulong)0 - (ulong)(off == 0)) & (hi << 60);
-        ulong cand0  = (merged >> 4) | inject;
-
-        ulong lo_n = select(lo, hi, wrapMask);
-        ulong hi_n = select(hi, nextChunk, wrapMask);
-
-        sh     = (ulong)((64 - off_next) & 63);
-        nzmask = (ulong)0 - (ulong)(off_next != 0);
-        ulong cand1    = (lo_n >> off_next) | ((hi_n << sh) & nzmask);
-
-        merged = select(cand0, cand1, wrapMask);
-
-        off  = off_next;
-        base += wrap;
-        lo   = lo_n;
-        hi   = hi_n;
     }
 
-    carry_array[gid] = carry;
+    carry_array[gid] = carry + 3UL * carry1;
 }
 
 #define CARRY_WORKER_MIN_1 (CARRY_WORKER - 1)
 __kernel void kernel_carry_2(__global ulong* restrict x,
-                             __global ulong* restrict carry_array,
-                             __global const ulong* restrict maskPacked)
+                             __global ulong* restrict carry_array)
 {
     const uint gid = get_global_id(0);
     const uint prev_gid = (gid == 0) ? (CARRY_WORKER_MIN_1) : (gid - 1);
@@ -551,75 +598,186 @@ __kernel void kernel_carry_2(__global ulong* restrict x,
     const uint start = gid * LOCAL_PROPAGATION_DEPTH;
     const uint end = start + LOCAL_PROPAGATION_DEPTH - 4;
 
-    const int4 DW1 = (int4)(DIGIT_WIDTH_VALUE_1);
-    const int4 DW2 = (int4)(DIGIT_WIDTH_VALUE_2);
-
-    uint base = start >> 6;
-    uint off  = start & 63;
-
-    ulong lo = maskPacked[base + 0];
-    ulong hi = maskPacked[base + 1];
-
-    ulong sh     = (ulong)((64 - off) & 63);
-    ulong nzmask = (ulong)0 - (ulong)(off != 0);
-    ulong merged = (lo >> off) | ((hi << sh) & nzmask);
-
     PRAGMA_UNROLL(LOCAL_PROPAGATION_DEPTH_DIV4_MIN)
     for (uint i = start; i < end; i += 4) {
         ulong4 x_vec = vload4(0, x + i);
-
-        uint nib = (uint)(merged & 0xFULL);
-        
-        int4 sel = (int4)(
-            (nib >> 0) & 1,
-            (nib >> 1) & 1,
-            (nib >> 2) & 1,
-            (nib >> 3) & 1
-        ) * -1;
-        sel = bitselect(DW1, DW2, (sel));
-
-        x_vec = digit_adc4(x_vec, sel, &carry);
+        x_vec = digit_adc4(x_vec, get_digit_width4(i), &carry);
         vstore4(x_vec, 0, x + i);
         if (carry == 0) return;
+    }
 
-        uint wrap = (off + 4U) >> 6;
-        ulong wrapMask = (ulong)0 - (ulong)wrap;
-        uint off_next = (off + 4U) & 63U;
+    ulong4 x_vec = vload4(0, x + end);
+    x_vec = digit_adc4_last(x_vec, get_digit_width4(end), &carry);
+    vstore4(x_vec, 0, x + end);
+}
 
-        ulong nextChunk = maskPacked[base + 2];
-        ulong inject = ((ulong)0 - (ulong)(off == 0)) & (hi << 60);
-        ulong cand0  = (merged >> 4) | inject;
+#if (LOCAL_PROPAGATION_DEPTH >= 4) && (LOCAL_PROPAGATION_DEPTH <= 32) && (LOCAL_PROPAGATION_DEPTH % 4 == 0)
+// Carry in one launch. After its local pass, a block of LOCAL_PROPAGATION_DEPTH
+// digits maps a carry-in cin to the carry-out c + (cin >= t): it holds at least
+// 64 bits (checked by the host) and cin < 2^64, so the carry-out takes two
+// values at most, and t = 2^B - (block value) is ULONG_MAX when it is >= 2^64.
+// These maps compose into one of the same form, so the carries are a prefix
+// scan: inside the work-group in local memory, across work-groups by a
+// decoupled lookback over state. The last group folds the final carry into
+// x[0] once all the others are done and resets state for the next launch.
+// state: aggregate c, aggregate t, inclusive carry (ulong x ngroups each),
+// then the flags (uint x ngroups), the ticket and the done count.
+inline ulong2 carry_compose(const ulong2 a, const ulong2 b)   // a, then b
+{
+    return (ulong2)(b.s0 + ((a.s0 >= b.s1) ? 1UL : 0UL), (a.s0 + 1 == b.s1) ? a.s1 : ULONG_MAX);
+}
 
-        ulong lo_n = select(lo, hi, wrapMask);
-        ulong hi_n = select(hi, nextChunk, wrapMask);
+inline ulong carry_apply(const ulong2 f, const ulong cin) { return f.s0 + ((cin >= f.s1) ? 1UL : 0UL); }
 
-        sh     = (ulong)((64 - off_next) & 63);
-        nzmask = (ulong)0 - (ulong)(off_next != 0);
-        ulong cand1    = (lo_n >> off_next) | ((hi_n << sh) & nzmask);
+__kernel void kernel_carry_lookahead(__global ulong* restrict x, __global ulong* restrict state)
+{
+    __local ulong2 scan[256];
+    __local uint group;
+    __local ulong group_cin, wrap;
+
+    const uint lid = get_local_id(0), ls = get_local_size(0);
+    const uint ngroups = CARRY_WORKER / ls;
+    volatile __global uint* flag = (volatile __global uint*)(state + 3 * ngroups);
+    volatile __global uint* ticket = flag + ngroups;
+    volatile __global uint* done = ticket + 1;
+
+    // groups are numbered in start order: the lookback only waits on running groups
+    if (lid == 0) group = atomic_inc(ticket);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    const uint g = group;
+    const uint start = (g * ls + lid) * LOCAL_PROPAGATION_DEPTH;
+
+    ulong4 d[LOCAL_PROPAGATION_DEPTH / 4];
+    int4 w[LOCAL_PROPAGATION_DEPTH / 4];
+    ulong c = 0;
+    #pragma unroll
+    for (uint q = 0; q < LOCAL_PROPAGATION_DEPTH / 4; ++q) {
+        w[q] = get_digit_width4(start + 4 * q);
+#if CARRY_SUB
+        d[q] = digit_adc4(vload4(q, x + start) + carry_sub4(start + 4 * q, w[q]), w[q], &c);
+#else
+        d[q] = digit_adc4(vload4(q, x + start), w[q], &c);
+#endif
+    }
 
-        merged = select(cand0, cand1, wrapMask);
+    // t - 1 is the complement of the block
+    ulong t = 0;
+    uint pos = 0;
+    bool far = false;
+    #pragma unroll
+    for (uint q = 0; q < LOCAL_PROPAGATION_DEPTH / 4; ++q) {
+        const ulong4 comp = (ulong4)((1UL << w[q].s0) - 1, (1UL << w[q].s1) - 1, (1UL << w[q].s2) - 1, (1UL << w[q].s3) - 1) - d[q];
+        const ulong cs[4] = { comp.s0, comp.s1, comp.s2, comp.s3 };
+        const int ws[4] = { w[q].s0, w[q].s1, w[q].s2, w[q].s3 };
+        for (uint k = 0; k < 4; ++k) {
+            if (cs[k] != 0) {
+                if ((pos < 64) && ((pos == 0) || ((cs[k] >> (64 - pos)) == 0))) t |= cs[k] << pos; else far = true;
+            }
+            pos += ws[k];
+        }
+    }
+    t = (far || (t == ULONG_MAX)) ? ULONG_MAX : t + 1;
+
+    scan[lid] = (ulong2)(c, t);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint off = 1; off < ls; off <<= 1) {
+        const ulong2 prev = (lid >= off) ? scan[lid - off] : (ulong2)(0, ULONG_MAX);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid >= off) scan[lid] = carry_compose(prev, scan[lid]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
 
-        off  = off_next;
-        base += wrap;
-        lo   = lo_n;
-        hi   = hi_n;
+    if (lid == 0) {
+        const ulong2 agg = scan[ls - 1];
+        ulong cin = 0;
+        if (g != 0) {
+            state[g] = agg.s0;
+            state[ngroups + g] = agg.s1;
+            write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+            atomic_xchg(&flag[g], 1u);
+
+            bool have = false;
+            ulong2 acc = agg;
+            for (int h = (int)g - 1; ; --h) {
+                uint f;
+                while ((f = atomic_or(&flag[h], 0u)) == 0) {}
+                read_mem_fence(CLK_GLOBAL_MEM_FENCE);
+                if (f == 2) {
+                    const ulong v = state[2 * ngroups + h];
+                    cin = have ? carry_apply(acc, v) : v;
+                    break;
+                }
+                const ulong2 fh = (ulong2)(state[h], state[ngroups + h]);
+                acc = have ? carry_compose(fh, acc) : fh;
+                have = true;
+            }
+        }
+        state[2 * ngroups + g] = carry_apply(agg, cin);
+        write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+        atomic_xchg(&flag[g], 2u);
+        group_cin = cin;
     }
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-    ulong4 x_vec = vload4(0, x + end);
+    ulong cin = (lid == 0) ? group_cin : carry_apply(scan[lid - 1], group_cin);
+    #pragma unroll
+    for (uint q = 0; q < LOCAL_PROPAGATION_DEPTH / 4; ++q) vstore4(digit_adc4(d[q], w[q], &cin), q, x + start);
 
-    base = (uint)(merged & 0xFULL);
-    int4 sel = (int4)(
-        (base >> 0) & 1,
-        (base >> 1) & 1,
-        (base >> 2) & 1,
-        (base >> 3) & 1
-    ) * -1;
+    if (lid == ls - 1) wrap = cin + c;
+    barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
 
+    if (lid == 0) {
+        if (g + 1 < ngroups) {
+            mem_fence(CLK_GLOBAL_MEM_FENCE);
+            atomic_inc(done);
+        } else {
+            while (atomic_or(done, 0u) != ngroups - 1) {}
+            read_mem_fence(CLK_GLOBAL_MEM_FENCE);
+            // 2^p = 1
+            ulong cw = wrap;
+            for (uint i = 0; cw != 0; i = (i + 1 == TRANSFORM_SIZE_N) ? 0 : i + 1)
+                x[i] = digit_adc(x[i], get_digit_width(i), &cw);
+            for (uint h = 0; h < ngroups; ++h) flag[h] = 0;
+            *ticket = 0;
+            *done = 0;
+        }
+    }
+}
+#endif
 
-    sel = bitselect(DW1, DW2, (sel));
+// Packs a carried residue into little-endian 32-bit words, E bits in all.
+// One work-item per carry block: the block is renormalized from a zero
+// carry-in and the carry leaving it goes to carry_out, to be folded in by
+// the host (it is almost always 0). words must be zeroed beforehand; the
+// words a block shares with its neighbours are merged with atomic_or.
+__kernel void kernel_pack_bits(__global const ulong* restrict x,
+                               __global uint* restrict words,
+                               __global ulong* restrict carry_out)
+{
+    const uint gid   = get_global_id(0);
+    const uint start = gid * LOCAL_PROPAGATION_DEPTH;
+    const uint end   = start + LOCAL_PROPAGATION_DEPTH;
+    const ulong first = ((ulong)MODULUS_P * start + TRANSFORM_SIZE_N - 1) / TRANSFORM_SIZE_N;
 
-    x_vec = digit_adc4_last(x_vec, sel, &carry);
-    vstore4(x_vec, 0, x + end);
+    ulong carry = 0UL;
+    ulong acc   = 0UL;
+    uint  have  = (uint)(first & 31);
+    uint  wi    = (uint)(first >> 5);
+
+    for (uint i = start; i < end; ++i) {
+        const int w = get_digit_width(i);
+        acc  |= digit_adc(x[i], w, &carry) << have;
+        have += (uint)w;
+        if (have >= 32) {
+            if (((ulong)wi << 5) >= first) words[wi] = (uint)acc;
+            else                           atomic_or(&words[wi], (uint)acc);
+            acc >>= 32;
+            have -= 32;
+            ++wi;
+        }
+    }
+    if (have > 0) atomic_or(&words[wi], (uint)acc);
+    carry_out[gid] = carry;
 }
 
 
@@ -1242,13 +1400,18 @@ typedef uint gid_t;
 typedef ulong gid_t;
 #endif
 
+// The stride m of a 2-steps stage is a power of two (the radix-5 pass comes
+// first and leaves n / 5): split the work-item index with a shift and a mask
+// instead of the integer division by a runtime m.
+inline uint stage_log2(const uint m) { return 31 - clz(m); }
+
 
 __kernel void kernel_ntt_radix4_inverse_mm_2steps(__global ulong* restrict x,
                                                   __global ulong* restrict wi,
                                                   const uint m) {
     const gid_t gid      = get_global_id(0);
-    const gid_t group    = gid / m;
-    const gid_t local_id = gid % m;
+    const gid_t group    = gid >> stage_log2(m);
+    const gid_t local_id = gid & (m - 1);
     uint k_first         = group * m * 4 + local_id;
 
     __local ulong shared_mem[LOCAL_SIZE2 * 16];
@@ -1257,8 +1420,9 @@ __kernel void kernel_ntt_radix4_inverse_mm_2steps(__global ulong* restrict x,
     uint write_index = 0;
     uint base        = 4 * (k_first - local_id) + local_id;
     const uint tw_offset = 6 * m + 3 * local_id;
-    ulong2 tw12     = vload2(0, wi + tw_offset);
-    ulong tw3       = wi[tw_offset + 2];
+    const ulong4 tw = stage_twiddles(wi, m, local_id);
+    ulong2 tw12     = tw.s01;
+    ulong tw3       = tw.s2;
     ulong r, r2;
 
     #pragma unroll 4
@@ -1303,8 +1467,9 @@ __kernel void kernel_ntt_radix4_inverse_mm_2steps(__global ulong* restrict x,
         const gid_t j2       = k_first & (new_m - 1);
         const gid_t base2    = 4 * (k_first - j2) + j2;
         const gid_t tw_off2  = 6 * new_m + 3 * j2;
-        tw12 = vload2(0, wi + tw_off2);
-        tw3  = wi[tw_off2 + 2];
+        const ulong4 tw2 = stage_twiddles(wi, new_m, j2);
+        tw12 = tw2.s01;
+        tw3  = tw2.s2;
 
         uint idx0 = ((write_index    ) % 4) * 4 + ((write_index    ) / 4);
         uint idx1 = ((write_index + 1) % 4) * 4 + ((write_index + 1) / 4);
@@ -1339,8 +1504,8 @@ __kernel void kernel_ntt_radix4_inverse_mm_2steps_last(__global ulong* restrict
                                                   __global ulong* restrict digit_invweight,
                                                   const uint m) {
     const gid_t gid      = get_global_id(0);
-    const gid_t group    = gid / m;
-    const gid_t local_id = gid % m;
+    const gid_t group    = gid >> stage_log2(m);
+    const gid_t local_id = gid & (m - 1);
     uint k_first         = group * m * 4 + local_id;
 
     __local ulong shared_mem[LOCAL_SIZE2 * 16];
@@ -1349,8 +1514,9 @@ __kernel void kernel_ntt_radix4_inverse_mm_2steps_last(__global ulong* restrict
     uint write_index = 0;
     uint base        = 4 * (k_first - local_id) + local_id;
     const uint tw_offset = 6 * m + 3 * local_id;
-    ulong2 tw12     = vload2(0, wi + tw_offset);
-    ulong tw3       = wi[tw_offset + 2];
+    const ulong4 tw = stage_twiddles(wi, m, local_id);
+    ulong2 tw12     = tw.s01;
+    ulong tw3       = tw.s2;
     ulong r, r2;
 
     #pragma unroll 4
@@ -1395,8 +1561,9 @@ __kernel void kernel_ntt_radix4_inverse_mm_2steps_last(__global ulong* restrict
         const gid_t j2       = k_first & (new_m - 1);
         const gid_t base2    = 4 * (k_first - j2) + j2;
         const gid_t tw_off2  = 6 * new_m + 3 * j2;
-        tw12 = vload2(0, wi + tw_off2);
-        tw3  = wi[tw_off2 + 2];
+        const ulong4 tw2 = stage_twiddles(wi, new_m, j2);
+        tw12 = tw2.s01;
+        tw3  = tw2.s2;
 
         uint idx0 = ((write_index    ) % 4) * 4 + ((write_index    ) / 4);
         uint idx1 = ((write_index + 1) % 4) * 4 + ((write_index + 1) / 4);
@@ -1426,13 +1593,145 @@ __kernel void kernel_ntt_radix4_inverse_mm_2steps_last(__global ulong* restrict
     }
 }
 
+#ifdef INVERSE_LAST_CARRY
+// kernel_ntt_radix4_inverse_mm_2steps_last followed by the first carry pass.
+// The 16 outputs of a work-group form 16 runs of LOCAL_SIZE2 contiguous
+// digits (run r starts at r*m), staged in local memory; each run is then
+// cut into LOCAL_PROPAGATION_DEPTH blocks exactly as kernel_carry does, so
+// only kernel_carry_2 is left to run.
+__kernel void kernel_ntt_radix4_inverse_mm_2steps_last_carry(__global ulong* restrict x,
+                                                  __global ulong* restrict wi,
+                                                  __global ulong* restrict digit_invweight,
+                                                  __global ulong* restrict carry_array,
+                                                  const uint m) {
+    const gid_t gid      = get_global_id(0);
+    const gid_t group    = gid >> stage_log2(m);
+    const gid_t local_id = gid & (m - 1);
+    const uint  lid      = get_local_id(0);
+    uint k_first         = group * m * 4 + local_id;
+
+    __local ulong shared_mem[LOCAL_SIZE2 * 16];
+    __local ulong* local_x = shared_mem + lid * 16;
+
+    uint write_index = 0;
+    uint base        = 4 * (k_first - local_id) + local_id;
+    const uint tw_offset = 6 * m + 3 * local_id;
+    const ulong4 tw = stage_twiddles(wi, m, local_id);
+    ulong2 tw12     = tw.s01;
+    ulong tw3       = tw.s2;
+    ulong r, r2;
+
+    #pragma unroll 4
+    for (uint pass = 0; pass < 4; ++pass) {
+        ulong a0 = x[base];
+        ulong a1 = modMul(x[base + m],           tw12.s1);
+        ulong a2 = modMul(x[base + (m << 1)],    tw12.s0);
+        ulong a3 = modMul(x[base + ((m << 1) + m)], tw3);
+
+        r  = modAdd(a0, a1);
+        r2 = modSub(a0, a1);
+        a0 = r; a1 = r2;
+
+        r  = modAdd(a2, a3);
+        r2 = modMuli(modSub(a3, a2));
+        a2 = r; a3 = r2;
+
+        r  = modAdd(a0, a2);
+        r2 = modSub(a0, a2);
+        a0 = r; a2 = r2;
+
+        r  = modAdd(a1, a3);
+        a3 = modSub(a1, a3);
+        a1 = r;
+
+        local_x[write_index    ] = a0;
+        local_x[write_index + 1] = a1;
+        local_x[write_index + 2] = a2;
+        local_x[write_index + 3] = a3;
+
+        write_index += 4;
+        base        += 4 * m;
+        k_first     += m;
+    }
+
+    const uint new_m = m * 4;
+    write_index     = 0;
+    k_first         = group * m * 4 + local_id;
+
+    // out[pass + 4*q] is the digit at base2 + q*new_m of this pass
+    ulong out[16];
+    #pragma unroll 4
+    for (uint pass = 0; pass < 4; ++pass) {
+        const gid_t j2       = k_first & (new_m - 1);
+        const gid_t base2    = 4 * (k_first - j2) + j2;
+        const gid_t tw_off2  = 6 * new_m + 3 * j2;
+        const ulong4 tw2 = stage_twiddles(wi, new_m, j2);
+        tw12 = tw2.s01;
+        tw3  = tw2.s2;
+
+        uint idx0 = ((write_index    ) % 4) * 4 + ((write_index    ) / 4);
+        uint idx1 = ((write_index + 1) % 4) * 4 + ((write_index + 1) / 4);
+        uint idx2 = ((write_index + 2) % 4) * 4 + ((write_index + 2) / 4);
+        uint idx3 = ((write_index + 3) % 4) * 4 + ((write_index + 3) / 4);
+
+        ulong b0 = local_x[idx0];
+        ulong b1 = modMul(local_x[idx1], tw12.s1);
+        ulong b2 = modMul(local_x[idx2], tw12.s0);
+        ulong b3 = modMul(local_x[idx3], tw3);
+
+        r  = modAdd(b0, b1);
+        r2 = modSub(b0, b1);
+        b0 = r; b1 = r2;
+
+        r  = modAdd(b2, b3);
+        r2 = modMuli(modSub(b3, b2));
+        b2 = r; b3 = r2;
+
+        out[pass     ] = modMul(modAdd(b0, b2), digit_invweight[base2]);
+        out[pass +  8] = modMul(modSub(b0, b2), digit_invweight[base2 + (new_m << 1)]);
+        out[pass +  4] = modMul(modAdd(b1, b3), digit_invweight[base2 + new_m]);
+        out[pass + 12] = modMul(modSub(b1, b3), digit_invweight[base2 + ((new_m << 1) + new_m)]);
+
+        write_index += 4;
+        k_first     += m;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    #pragma unroll 16
+    for (uint run = 0; run < 16; ++run)
+        shared_mem[run * LOCAL_SIZE2 + lid] = out[run];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const uint group_lo = (uint)gid - lid;
+    const uint blocks_per_run = LOCAL_SIZE2 / LOCAL_PROPAGATION_DEPTH;
+    for (uint blk = lid; blk < 16 * blocks_per_run; blk += LOCAL_SIZE2) {
+        const uint run   = blk / blocks_per_run;
+        const uint off   = (blk % blocks_per_run) * LOCAL_PROPAGATION_DEPTH;
+        const uint start = group_lo + run * m + off;
+        __local const ulong* src = shared_mem + run * LOCAL_SIZE2 + off;
+        ulong carry = 0UL;
+        for (uint d = 0; d < LOCAL_PROPAGATION_DEPTH; ++d) {
+            const int dw = get_digit_width(start + d);
+#if CARRY_SUB
+            const ulong v = src[d] + carry_sub_digit(start + d, dw) + carry;
+#else
+            const ulong v = src[d] + carry;
+#endif
+            x[start + d] = v & ((1UL << dw) - 1UL);
+            carry = v >> dw;
+        }
+        carry_array[start / LOCAL_PROPAGATION_DEPTH] = carry;
+    }
+}
+#endif
+
 __kernel void kernel_ntt_radix4_mm_2steps(__global ulong* restrict x,
                                           __global ulong* restrict w,
                                           const uint m) {
 
     const gid_t gid = get_global_id(0);
-    const gid_t group = gid / (m / 4);
-    const gid_t local_id = gid % (m / 4);
+    const gid_t group = gid >> (stage_log2(m) - 2);
+    const gid_t local_id = gid & ((m >> 2) - 1);
     uint k_first = group * m + local_id;
 
     __local ulong shared_mem[LOCAL_SIZE2 * 16];
@@ -1443,8 +1742,9 @@ __kernel void kernel_ntt_radix4_mm_2steps(__global ulong* restrict x,
         uint k0       = k_first + p * (m >> 2);
         uint j        = k0 & (m - 1);
         uint base     = 4 * (k0 - j) + j;
-        ulong2 tw12   = vload2(0, w + 6 * m + 3 * j);
-        ulong  tw3    = w[6 * m + 3 * j + 2];
+        const ulong4 tw = stage_twiddles(w, m, j);
+        ulong2 tw12   = tw.s01;
+        ulong  tw3    = tw.s2;
         ulong  a0     = x[base];
         ulong  a1     = x[base + m];
         ulong  a2     = x[base + (m << 1)];
@@ -1472,8 +1772,9 @@ __kernel void kernel_ntt_radix4_mm_2steps(__global ulong* restrict x,
     
     const uint twiddle_offset = 6 * new_m + 3 * local_id;
     k_first = 4 * (group * m) + local_id;
-    ulong2 twiddle1_2 = vload2(0, w + twiddle_offset);
-    ulong twiddle3 = w[twiddle_offset + 2];
+    const ulong4 tw2 = stage_twiddles(w, new_m, local_id);
+    ulong2 twiddle1_2 = tw2.s01;
+    ulong twiddle3 = tw2.s2;
     
     uint write_index = 0;
     #pragma unroll 4
@@ -1520,8 +1821,8 @@ __kernel void kernel_ntt_radix4_mm_2steps_first(__global ulong* restrict x,
 
 
     const gid_t gid = get_global_id(0);
-    const gid_t group = gid / (m / 4);
-    const gid_t local_id = gid % (m / 4);
+    const gid_t group = gid >> (stage_log2(m) - 2);
+    const gid_t local_id = gid & ((m >> 2) - 1);
     uint k_first = group * m + local_id;
 
     __local ulong shared_mem[LOCAL_SIZE2 * 16];
@@ -1532,8 +1833,9 @@ __kernel void kernel_ntt_radix4_mm_2steps_first(__global ulong* restrict x,
         uint k0       = k_first + p * (m >> 2);
         uint j        = k0 & (m - 1);
         uint base     = 4 * (k0 - j) + j;
-        ulong2 tw12   = vload2(0, w + 6 * m + 3 * j);
-        ulong  tw3    = w[6 * m + 3 * j + 2];
+        const ulong4 tw = stage_twiddles(w, m, j);
+        ulong2 tw12   = tw.s01;
+        ulong  tw3    = tw.s2;
         ulong  a0     = modMul(x[base],digit_weight[base]);
         ulong  a1     = modMul(x[base + m], digit_weight[base + m]);
         ulong  a2     = modMul(x[base + (m << 1)], digit_weight[base + (m << 1)]);
@@ -1561,8 +1863,9 @@ __kernel void kernel_ntt_radix4_mm_2steps_first(__global ulong* restrict x,
     
     const uint twiddle_offset = 6 * new_m + 3 * local_id;
     k_first = 4 * (group * m) + local_id;
-    ulong2 twiddle1_2 = vload2(0, w + twiddle_offset);
-    ulong twiddle3 = w[twiddle_offset + 2];
+    const ulong4 tw2 = stage_twiddles(w, new_m, local_id);
+    ulong2 twiddle1_2 = tw2.s01;
+    ulong twiddle3 = tw2.s2;
     
     uint write_index = 0;
     #pragma unroll 4
@@ -1601,6 +1904,182 @@ __kernel void kernel_ntt_radix4_mm_2steps_first(__global ulong* restrict x,
 }
 
 
+#ifdef LOCAL_STAGES_TILE
+// Four-step layout for the middle of the transform: the radix-4 stages of
+// strides mh, mh / 4, ..., ml in one pass over x. A butterfly of stride
+// m >= ml joins entries that agree mod ml, so the tile
+//   blk * 4mh + r0 + c + ml * s,  c < cols, s < 4mh / ml
+// is closed under all of them. It is gathered in local memory (cols
+// consecutive entries per row keep the reads coalesced), every stage runs
+// there with the usual twiddles, and it is written back in place. ml = 1
+// is the contiguous case, cols = ml makes the tile one block.
+
+inline gid_t local_stages_base(const uint mh, const uint ml, const uint cols, __private uint* r0)
+{
+    const uint tiles = ml / cols;
+    const gid_t g = get_group_id(0);
+    *r0 = (uint)(g % tiles) * cols;
+    return (g / tiles) * (gid_t)(4 * mh) + *r0;
+}
+
+__kernel __attribute__((reqd_work_group_size(LOCAL_STAGES_WG, 1, 1)))
+void kernel_ntt_radix4_local_stages(__global ulong* restrict x,
+                                    __global const ulong* restrict w,
+                                    const uint mh, const uint ml, const uint cols)
+{
+    __local ulong s[LOCAL_STAGES_TILE];
+    const uint lid = get_local_id(0);
+    const uint size = cols * (4 * mh / ml);
+    uint r0;
+    const gid_t base = local_stages_base(mh, ml, cols, &r0);
+
+    for (uint l = lid; l < size; l += LOCAL_STAGES_WG)
+        s[l] = x[base + (l % cols) + (gid_t)ml * (l / cols)];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint m = mh; m >= ml; m /= 4) {
+        const uint ms = m / ml, d = ms * cols;
+        for (uint b = lid; b < size / 4; b += LOCAL_STAGES_WG) {
+            const uint c = b % cols, u = b / cols;
+            const uint js = u & (ms - 1);
+            const uint i = (4 * (u - js) + js) * cols + c;
+            const ulong4 tw = stage_twiddles(w, m, r0 + c + ml * js);
+            const ulong a0 = modAdd(s[i], s[i + 2 * d]);
+            const ulong a1 = modAdd(s[i + d], s[i + 3 * d]);
+            const ulong a2 = modSub(s[i], s[i + 2 * d]);
+            const ulong a3 = modMuli(modSub(s[i + d], s[i + 3 * d]));
+            s[i]         = modAdd(a0, a1);
+            s[i + d]     = modMul(modSub(a0, a1), tw.s1);
+            s[i + 2 * d] = modMul(modAdd(a2, a3), tw.s0);
+            s[i + 3 * d] = modMul(modSub(a2, a3), tw.s2);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (uint l = lid; l < size; l += LOCAL_STAGES_WG)
+        x[base + (l % cols) + (gid_t)ml * (l / cols)] = s[l];
+}
+
+// The inverse stages ml, 4ml, ..., mh on the same tiles.
+__kernel __attribute__((reqd_work_group_size(LOCAL_STAGES_WG, 1, 1)))
+void kernel_inverse_ntt_radix4_local_stages(__global ulong* restrict x,
+                                            __global const ulong* restrict wi,
+                                            const uint mh, const uint ml, const uint cols)
+{
+    __local ulong s[LOCAL_STAGES_TILE];
+    const uint lid = get_local_id(0);
+    const uint size = cols * (4 * mh / ml);
+    uint r0;
+    const gid_t base = local_stages_base(mh, ml, cols, &r0);
+
+    for (uint l = lid; l < size; l += LOCAL_STAGES_WG)
+        s[l] = x[base + (l % cols) + (gid_t)ml * (l / cols)];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint m = ml; m <= mh; m *= 4) {
+        const uint ms = m / ml, d = ms * cols;
+        for (uint b = lid; b < size / 4; b += LOCAL_STAGES_WG) {
+            const uint c = b % cols, u = b / cols;
+            const uint js = u & (ms - 1);
+            const uint i = (4 * (u - js) + js) * cols + c;
+            const ulong4 tw = stage_twiddles(wi, m, r0 + c + ml * js);
+            const ulong b0 = s[i];
+            const ulong b1 = modMul(s[i + d], tw.s1);
+            const ulong b2 = modMul(s[i + 2 * d], tw.s0);
+            const ulong b3 = modMul(s[i + 3 * d], tw.s2);
+            const ulong a0 = modAdd(b0, b1);
+            const ulong a1 = modSub(b0, b1);
+            const ulong a2 = modAdd(b2, b3);
+            const ulong a3 = modMuli(modSub(b3, b2));
+            s[i]         = modAdd(a0, a2);
+            s[i + d]     = modAdd(a1, a3);
+            s[i + 2 * d] = modSub(a0, a2);
+            s[i + 3 * d] = modSub(a1, a3);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (uint l = lid; l < size; l += LOCAL_STAGES_WG)
+        x[base + (l % cols) + (gid_t)ml * (l / cols)] = s[l];
+}
+#endif
+
+#ifdef COALESCED_TILE
+// The radix-4 stages of small stride m (2, 4, 8): the four inputs of a
+// butterfly are m apart, so neighbouring work-items of kernel_ntt_radix4_mm_m*
+// read words that are 4m apart and a wavefront comes back to the same lines
+// several times. Here a work-group owns a contiguous tile of COALESCED_TILE
+// entries, a multiple of 4m: it is loaded and stored with neighbouring
+// work-items on neighbouring words and the butterflies run in local memory.
+// The layout of x, the weights and the twiddles are those of the mm kernels.
+__kernel __attribute__((reqd_work_group_size(COALESCED_WG, 1, 1)))
+void kernel_ntt_radix4_tiled(__global ulong2* restrict x,
+                             __global const ulong* restrict w,
+                             const uint m)
+{
+    __local ulong2 t[COALESCED_TILE / 2];
+    __local ulong* const s = (__local ulong*)t;
+    const uint lid = get_local_id(0);
+    const gid_t base = (gid_t)get_group_id(0) * (COALESCED_TILE / 2);
+
+    for (uint l = lid; l < COALESCED_TILE / 2; l += COALESCED_WG) t[l] = x[base + l];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint b = lid; b < COALESCED_TILE / 4; b += COALESCED_WG) {
+        const uint j = b & (m - 1);
+        const uint i = 4 * (b - j) + j;
+        const ulong4 tw = stage_twiddles(w, m, j);
+        const ulong a0 = modAdd(s[i], s[i + 2 * m]);
+        const ulong a1 = modAdd(s[i + m], s[i + 3 * m]);
+        const ulong a2 = modSub(s[i], s[i + 2 * m]);
+        const ulong a3 = modMuli(modSub(s[i + m], s[i + 3 * m]));
+        s[i]         = modAdd(a0, a1);
+        s[i + m]     = modMul(modSub(a0, a1), tw.s1);
+        s[i + 2 * m] = modMul(modAdd(a2, a3), tw.s0);
+        s[i + 3 * m] = modMul(modSub(a2, a3), tw.s2);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint l = lid; l < COALESCED_TILE / 2; l += COALESCED_WG) x[base + l] = t[l];
+}
+
+// The inverse stage of stride m on the same tiles.
+__kernel __attribute__((reqd_work_group_size(COALESCED_WG, 1, 1)))
+void kernel_inverse_ntt_radix4_tiled(__global ulong2* restrict x,
+                                     __global const ulong* restrict wi,
+                                     const uint m)
+{
+    __local ulong2 t[COALESCED_TILE / 2];
+    __local ulong* const s = (__local ulong*)t;
+    const uint lid = get_local_id(0);
+    const gid_t base = (gid_t)get_group_id(0) * (COALESCED_TILE / 2);
+
+    for (uint l = lid; l < COALESCED_TILE / 2; l += COALESCED_WG) t[l] = x[base + l];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint b = lid; b < COALESCED_TILE / 4; b += COALESCED_WG) {
+        const uint j = b & (m - 1);
+        const uint i = 4 * (b - j) + j;
+        const ulong4 tw = stage_twiddles(wi, m, j);
+        const ulong b0 = s[i];
+        const ulong b1 = modMul(s[i + m], tw.s1);
+        const ulong b2 = modMul(s[i + 2 * m], tw.s0);
+        const ulong b3 = modMul(s[i + 3 * m], tw.s2);
+        const ulong a0 = modAdd(b0, b1);
+        const ulong a1 = modSub(b0, b1);
+        const ulong a2 = modAdd(b2, b3);
+        const ulong a3 = modMuli(modSub(b3, b2));
+        s[i]         = modAdd(a0, a2);
+        s[i + m]     = modAdd(a1, a3);
+        s[i + 2 * m] = modSub(a0, a2);
+        s[i + 3 * m] = modSub(a1, a3);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint l = lid; l < COALESCED_TILE / 2; l += COALESCED_WG) x[base + l] = t[l];
+}
+#endif
+
 __kernel void kernel_ntt_radix2_square_radix2(__global ulong2* restrict x)
 {
     const uint gid = get_global_id(0);
@@ -1616,6 +2095,20 @@ __kernel void kernel_ntt_radix2_square_radix2(__global ulong2* restrict x)
     x[gid] = (ulong2)(modAdd(s, d), modSub(s, d));
 }
 
+// kernel_ntt_radix2, x *= y and kernel_ntt_radix2 again, y transformed.
+__kernel void kernel_ntt_radix2_mul_radix2(__global ulong2* restrict x,
+                                           __global const ulong2* restrict y)
+{
+    const uint gid = get_global_id(0);
+    ulong2 u = x[gid];
+    const ulong2 v = y[gid];
+
+    ulong s = modMul(modAdd(u.x, u.y), v.x);
+    ulong d = modMul(modSub(u.x, u.y), v.y);
+
+    x[gid] = (ulong2)(modAdd(s, d), modSub(s, d));
+}
+
 
 
 
@@ -1728,11 +2221,8 @@ __kernel void kernel_ntt_radix4_radix2_square_radix2_radix4(
 
 }
 
-__kernel void kernel_ntt_radix4_square_radix4(__global ulong4* restrict x)
+inline ulong4 radix4_square_radix4(ulong4 coeff)
 {
-    const uint k = get_global_id(0);
-    ulong4 coeff = x[k];
-    
     ulong a = modAdd(coeff.s0, coeff.s2);
     ulong b = modAdd(coeff.s1, coeff.s3);
     ulong c = modSub(coeff.s0, coeff.s2);
@@ -1751,16 +2241,257 @@ __kernel void kernel_ntt_radix4_square_radix4(__global ulong4* restrict x)
     ulong v1 = modSub(u.s0, u.s1);
     ulong v2 = modAdd(u.s2, u.s3);
     ulong v3 = modMuli(modSub(u.s3, u.s2));
-    ulong4 result = (ulong4)( modAdd(v0, v2),
-                              modAdd(v1, v3),
-                              modSub(v0, v2),
-                              modSub(v1, v3) );
-    x[k] = result;
+    return (ulong4)( modAdd(v0, v2),
+                     modAdd(v1, v3),
+                     modSub(v0, v2),
+                     modSub(v1, v3) );
+}
+
+__kernel void kernel_ntt_radix4_square_radix4(__global ulong4* restrict x)
+{
+    const uint k = get_global_id(0);
+    x[k] = radix4_square_radix4(x[k]);
+}
+
+// kernel_ntt_radix4_last_m1_nosquare, x *= y and kernel_inverse_ntt_radix4_m1
+// in one launch, y being the forward transform of the other operand: the
+// transform of x is multiplied in registers and never written out.
+__kernel void kernel_ntt_radix4_mul_radix4(__global ulong4* restrict x,
+                                           __global const ulong4* restrict y)
+{
+    const uint k = get_global_id(0);
+    ulong4 coeff = x[k];
+
+    ulong a = modAdd(coeff.s0, coeff.s2);
+    ulong b = modAdd(coeff.s1, coeff.s3);
+    ulong c = modSub(coeff.s0, coeff.s2);
+    ulong d = modMuli(modSub(coeff.s1, coeff.s3));
+
+    coeff.s0 = modAdd(a, b);
+    coeff.s1 = modSub(a, b);
+    coeff.s2 = modAdd(c, d);
+    coeff.s3 = modSub(c, d);
+    coeff = modMul3_2_w10(coeff);
+    coeff = modMul4(coeff, y[k]);
+
+    ulong4 u = modMul3_2(coeff,(ulong2)(WI6,WI7), WI8);
+
+    ulong v0 = modAdd(u.s0, u.s1);
+    ulong v1 = modSub(u.s0, u.s1);
+    ulong v2 = modAdd(u.s2, u.s3);
+    ulong v3 = modMuli(modSub(u.s3, u.s2));
+    x[k] = (ulong4)( modAdd(v0, v2),
+                     modAdd(v1, v3),
+                     modSub(v0, v2),
+                     modSub(v1, v3) );
+}
+
+#ifdef SUBGROUP_SHUFFLE
+#ifdef INTEL_SUBGROUPS
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+#define SG_SHUFFLE(v, l) intel_sub_group_shuffle(v, l)
+#else
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle : enable
+#define SG_SHUFFLE(v, l) sub_group_shuffle(v, l)
+#endif
+
+inline ulong sg_slot(const ulong4 v, const uint q)
+{
+    return (q == 0) ? v.s0 : (q == 1) ? v.s1 : (q == 2) ? v.s2 : v.s3;
+}
+
+// kernel_ntt_radix4_mm_m4 followed by kernel_ntt_radix4_square_radix4 in one
+// launch. Four consecutive lanes own a block of 16: lane j holds x[j + 4q] for
+// the m = 4 butterfly, the last stage needs x[4j + q]. The 4 x 4 transpose
+// stays in registers: in round s lane j sends its slot (j - s) & 3 and
+// receives slot j of lane (j + s) & 3. One work-item per 4 residues; the
+// sub-group size and the work-group size must be multiples of 4.
+__kernel void kernel_ntt_radix4_mm_m4_square_sg(__global ulong* restrict x,
+                                                __global const ulong* restrict w)
+{
+    const uint gid = get_global_id(0);
+    const uint j = gid & 3;
+    const uint i = 16 * (gid >> 2) + j;
+    const uint lane0 = get_sub_group_local_id() & ~3u;
+    const uint t = 24 + 3 * j;
+
+    const ulong c0 = x[i], c1 = x[i + 4], c2 = x[i + 8], c3 = x[i + 12];
+    const ulong a = modAdd(c0, c2);
+    const ulong b = modAdd(c1, c3);
+    const ulong c = modSub(c0, c2);
+    const ulong d = modMuli(modSub(c1, c3));
+    ulong4 v = (ulong4)(modAdd(a, b), modSub(a, b), modAdd(c, d), modSub(c, d));
+    v = modMul3_2(v, (ulong2)(w[t], w[t + 1]), w[t + 2]);
+
+    ulong4 q = v;
+    PRAGMA_UNROLL(4)
+    for (uint s = 0; s < 4; ++s) {
+        const uint src = (j + s) & 3;
+        const ulong r = SG_SHUFFLE(sg_slot(v, (j - s) & 3), lane0 + src);
+        q.s0 = (src == 0) ? r : q.s0;
+        q.s1 = (src == 1) ? r : q.s1;
+        q.s2 = (src == 2) ? r : q.s2;
+        q.s3 = (src == 3) ? r : q.s3;
+    }
+    vstore4(radix4_square_radix4(q), gid, x);
+}
+#endif
+
+
+
+
+
+#ifdef FUSED_SQUARE_LS
+// One full squaring for transforms that fit in local memory:
+// weight, forward NTT, square, inverse NTT, unweight and carry in a single
+// work-group. The carry uses the same LOCAL_PROPAGATION_DEPTH blocks as
+// kernel_carry + kernel_carry_2, so the output is bit-identical to the
+// multi-kernel path.
+
+static inline void fused_forward(__local ulong* s,
+                                 __global const ulong* restrict x,
+                                 __global const ulong* restrict w,
+                                 __global const ulong* restrict digit_weight,
+                                 const uint lid)
+{
+    for (uint i = lid; i < TRANSFORM_SIZE_N; i += FUSED_SQUARE_LS)
+        s[i] = modMul(x[i], digit_weight[i]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint m = TRANSFORM_SIZE_N / 4; m >= 1; m /= 4) {
+        for (uint k = lid; k < TRANSFORM_SIZE_N / 4; k += FUSED_SQUARE_LS) {
+            const uint j = k & (m - 1);
+            const uint i = 4 * (k - j) + j;
+            const uint t = 6 * m + 3 * j;
+            const ulong a = modAdd(s[i], s[i + 2 * m]);
+            const ulong b = modAdd(s[i + m], s[i + 3 * m]);
+            const ulong c = modSub(s[i], s[i + 2 * m]);
+            const ulong d = modMuli(modSub(s[i + m], s[i + 3 * m]));
+            s[i]         = modAdd(a, b);
+            s[i + m]     = modMul(modSub(a, b), w[t + 1]);
+            s[i + 2 * m] = modMul(modAdd(c, d), w[t]);
+            s[i + 3 * m] = modMul(modSub(c, d), w[t + 2]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+static inline void fused_inverse_carry(__local ulong* s,
+                                       __local ulong* block_carry,
+                                       __global ulong* restrict x,
+                                       __global const ulong* restrict wi,
+                                       __global const ulong* restrict digit_invweight,
+                                       const uint lid)
+{
+    for (uint m = 1; m <= TRANSFORM_SIZE_N / 4; m *= 4) {
+        for (uint k = lid; k < TRANSFORM_SIZE_N / 4; k += FUSED_SQUARE_LS) {
+            const uint j = k & (m - 1);
+            const uint i = 4 * (k - j) + j;
+            const uint t = 6 * m + 3 * j;
+            const ulong c0 = s[i];
+            const ulong c1 = modMul(s[i + m], wi[t + 1]);
+            const ulong c2 = modMul(s[i + 2 * m], wi[t]);
+            const ulong c3 = modMul(s[i + 3 * m], wi[t + 2]);
+            const ulong v0 = modAdd(c0, c1);
+            const ulong v1 = modSub(c0, c1);
+            const ulong v2 = modAdd(c2, c3);
+            const ulong v3 = modMuli(modSub(c3, c2));
+            s[i]         = modAdd(v0, v2);
+            s[i + m]     = modAdd(v1, v3);
+            s[i + 2 * m] = modSub(v0, v2);
+            s[i + 3 * m] = modSub(v1, v3);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // kernel_carry: normalise each block, keep its outgoing carry.
+    for (uint blk = lid; blk < CARRY_WORKER; blk += FUSED_SQUARE_LS) {
+        const uint start = blk * LOCAL_PROPAGATION_DEPTH;
+        ulong carry = 0UL;
+        for (uint i = start; i < start + LOCAL_PROPAGATION_DEPTH; ++i) {
+            const int dw = get_digit_width(i);
+#if CARRY_SUB
+            const ulong v = modMul(s[i], digit_invweight[i]) + carry_sub_digit(i, dw) + carry;
+#else
+            const ulong v = modMul(s[i], digit_invweight[i]) + carry;
+#endif
+            s[i]  = v & ((1UL << dw) - 1UL);
+            carry = v >> dw;
+        }
+        block_carry[blk] = carry;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // kernel_carry_2: push the previous block's carry, the last digit of a
+    // block absorbs whatever is left.
+    for (uint blk = lid; blk < CARRY_WORKER; blk += FUSED_SQUARE_LS) {
+        ulong carry = block_carry[(blk == 0) ? (CARRY_WORKER - 1) : (blk - 1)];
+        const uint start = blk * LOCAL_PROPAGATION_DEPTH;
+        const uint last  = start + LOCAL_PROPAGATION_DEPTH - 1;
+        for (uint i = start; carry != 0 && i < last; ++i) {
+            const int dw = get_digit_width(i);
+            const ulong v = s[i] + carry;
+            s[i]  = v & ((1UL << dw) - 1UL);
+            carry = v >> dw;
+        }
+        s[last] += carry;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint i = lid; i < TRANSFORM_SIZE_N; i += FUSED_SQUARE_LS)
+        x[i] = s[i];
 }
 
+__kernel __attribute__((reqd_work_group_size(FUSED_SQUARE_LS, 1, 1)))
+void kernel_ntt_fused_square(__global ulong* restrict x,
+                             __global const ulong* restrict w,
+                             __global const ulong* restrict wi,
+                             __global const ulong* restrict digit_weight,
+                             __global const ulong* restrict digit_invweight)
+{
+    __local ulong s[TRANSFORM_SIZE_N];
+    __local ulong block_carry[CARRY_WORKER];
+    const uint lid = get_local_id(0);
+
+    fused_forward(s, x, w, digit_weight, lid);
 
+    for (uint i = lid; i < TRANSFORM_SIZE_N; i += FUSED_SQUARE_LS)
+        s[i] = modMul(s[i], s[i]);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
+    fused_inverse_carry(s, block_carry, x, wi, digit_invweight, lid);
+}
 
+// acc = acc * x with x left untouched, same single work-group pipeline.
+// The transform of x is parked in xt (global scratch, n words); every
+// work-item reads back only the entries it wrote itself.
+__kernel __attribute__((reqd_work_group_size(FUSED_SQUARE_LS, 1, 1)))
+void kernel_ntt_fused_mul(__global ulong* restrict acc,
+                          __global const ulong* restrict x,
+                          __global ulong* restrict xt,
+                          __global const ulong* restrict w,
+                          __global const ulong* restrict wi,
+                          __global const ulong* restrict digit_weight,
+                          __global const ulong* restrict digit_invweight)
+{
+    __local ulong s[TRANSFORM_SIZE_N];
+    __local ulong block_carry[CARRY_WORKER];
+    const uint lid = get_local_id(0);
+
+    fused_forward(s, x, w, digit_weight, lid);
+    for (uint i = lid; i < TRANSFORM_SIZE_N; i += FUSED_SQUARE_LS)
+        xt[i] = s[i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    fused_forward(s, acc, w, digit_weight, lid);
+    for (uint i = lid; i < TRANSFORM_SIZE_N; i += FUSED_SQUARE_LS)
+        s[i] = modMul(s[i], xt[i]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    fused_inverse_carry(s, block_carry, acc, wi, digit_invweight, lid);
+}
+#endif
 
 __kernel void kernel_pointwise_mul(__global ulong* a,
                                    __global const ulong* b) {
@@ -1768,6 +2499,32 @@ __kernel void kernel_pointwise_mul(__global ulong* a,
   a[i] = modMul(a[i], b[i]);
 }
 
+// a *= b + c in the transformed domain: the NTT is linear, so b + c is the
+// transform of the digitwise sum of their inputs, left uncarried.
+__kernel void kernel_pointwise_add_mul(__global ulong* a,
+                                       __global const ulong* b,
+                                       __global const ulong* c) {
+  size_t i = get_global_id(0);
+  a[i] = modMul(a[i], modAdd(b[i], c[i]));
+}
+
+// Digitwise a += b. The result is not normalized: run the carry kernels.
+__kernel void kernel_add(__global ulong* restrict a,
+                         __global const ulong* restrict b) {
+  size_t i = get_global_id(0);
+  a[i] += b[i];
+}
+
+// Digitwise a = a + 4*Mp - b, i.e. a - b mod 2^p - 1. Digit i of 4*Mp is
+// 4*(2^w - 1), which keeps every digit non negative as long as b comes out
+// of the carry kernels (b[i] < 2^(w+1)). Not normalized: run the carry kernels.
+__kernel void kernel_sub_mod(__global ulong* restrict a,
+                             __global const ulong* restrict b) {
+  size_t i = get_global_id(0);
+  const ulong m4 = ((1UL << get_digit_width((uint)i)) - 1UL) << 2;
+  a[i] = a[i] + m4 - b[i];
+}
+
 
 __kernel void kernel_carry_mul_base(
     __global ulong* restrict x,
@@ -1779,14 +2536,10 @@ __kernel void kernel_carry_mul_base(
     const ulong end   = start + LOCAL_PROPAGATION_DEPTH;
     ulong carry = 0UL;
 
+    PRAGMA_UNROLL(LOCAL_PROPAGATION_DEPTH_DIV4)
     for (ulong i = start; i < end; i += 4) {
         ulong4 x_vec = vload4(0, x + i);
-        int4 digit_width_vec = (int4)(
-            get_digit_width(i),
-            get_digit_width(i + 1),
-            get_digit_width(i + 2),
-            get_digit_width(i + 3)
-        );
+        const int4 digit_width_vec = get_digit_width4((uint)i);
 
         ulong4 b4 = (ulong4)(base, base, base, base);
         x_vec = x_vec * b4;
@@ -1827,65 +2580,22 @@ static inline void doDiv9(uint E, __global uint* W, uint wordCount) {
 }
 
 
-static void compactBits(
-    __global const ulong* x,
-    uint                  digitCount,
-    uint                  E,
-    __global uint*        out,
-    uint*                 outCount)
-{
-    int carry = 0;
-    uint outWord = 0;
-    int haveBits = 0;
-    uint p = 0, o = 0;
-    uint totalWords = (E - 1) / 32 + 1;
-
-    for (uint i = 0; i < totalWords; ++i) out[i] = 0;
-
-    for (p = 0; p < digitCount; ++p) {
-        int w = get_digit_width(p);
-        ulong v64 = (ulong)carry + x[p];
-        carry = (int)(v64 >> w);
-        uint v = (uint)(v64 & (((ulong)1 << w) - 1));
-
-        int topBits = 32 - haveBits;
-        outWord |= v << haveBits;
-        if (w >= topBits) {
-            out[o++] = outWord;
-            outWord = (w > topBits) ? (v >> topBits) : 0;
-            haveBits = w - topBits;
-        } else {
-            haveBits += w;
-        }
-    }
-    if (haveBits > 0 || carry) {
-        out[o++] = outWord;
-        for (uint i = 1; carry && i < o; ++i) {
-            ulong sum = (ulong)out[i] + (ulong)carry;
-            out[i] = (uint)(sum & 0xFFFFFFFFUL);
-            carry = (int)(sum >> 32);
-        }
-    }
-    *outCount = o;
-}
-
-
+// Low 64 bits of the residue for the periodic display: only the digits
+// that start below bit 64 contribute, so one work-item reads a handful of
+// words and writes 8 bytes (out[0] = low, out[1] = high).
 __kernel void kernel_res64_display(
-    __global const ulong* x,             
-    uint                  exponent,   
-    uint                  digitCount,
-    uint                  mode,
-    uint                  iter,
+    __global const ulong* x,
     __global uint*        out
 ) {
     if (get_global_id(0) != 0) return;
-    uint wordCount;
-    compactBits(x, digitCount, exponent, out, &wordCount);
-    printf("Iter: %u | Res64: %08X%08X\n",
-           iter,        // itération courante
-           out[1],      // haut 32 bits
-           out[0]       // bas 32 bits
-    );
+    ulong r = 0;
+    for (uint p = 0; p < TRANSFORM_SIZE_N; ++p) {
+        const ulong off = ((ulong)MODULUS_P * p + TRANSFORM_SIZE_N - 1) / TRANSFORM_SIZE_N;
+        if (off >= 64) break;
+        r += x[p] << off;
+    }
+    out[0] = (uint)r;
+    out[1] = (uint)(r >> 32);
 }
 #define TRANSFORM_SIZE_N_DIV5        (TRANSFORM_SIZE_N / 5)
 #define C_2_TRANSFORM_SIZE_N_DIV5    (2*(TRANSFORM_SIZE_N / 5))
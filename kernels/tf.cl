@@ -0,0 +1,123 @@
+/*
+ * Trial factoring kernel for 2^p - 1
+ *
+ * Any factor of 2^p - 1 is q = 2kp + 1 with q = +/-1 (mod 8). The host
+ * splits k into TF_CLASSES residue classes, drops those where q is 3 or 5
+ * (mod 8) or divisible by 3, 5, 7 or 11, and launches one class at a time:
+ * work-item gid tests k = k0 + TF_CLASSES * gid. The next primes are sieved
+ * here: skip[slot * nprimes + i] is the gid residue mod primes[i] for which
+ * primes[i] divides q.
+ * The survivors get 2^p mod q by left-to-right binary powering in the
+ * Montgomery domain (R = 2^128, q < 2^96 as TrialFactor::maxBits caps it),
+ * and q divides 2^p - 1 exactly when the result is 1, i.e. R mod q in that
+ * domain.
+ *
+ * This code is released as free software.
+ */
+#ifndef TF_CLASSES
+#define TF_CLASSES 4620
+#endif
+
+typedef struct { ulong lo, hi; } u128;
+
+inline int u128_ge(const u128 a, const u128 b) {
+    return a.hi > b.hi || (a.hi == b.hi && a.lo >= b.lo);
+}
+
+inline u128 u128_sub(const u128 a, const u128 b) {
+    u128 r;
+    r.lo = a.lo - b.lo;
+    r.hi = a.hi - b.hi - (a.lo < b.lo ? 1 : 0);
+    return r;
+}
+
+// 2a mod q, a < q < 2^127
+inline u128 dbl_mod(const u128 a, const u128 q) {
+    u128 r;
+    r.hi = (a.hi << 1) | (a.lo >> 63);
+    r.lo = a.lo << 1;
+    return u128_ge(r, q) ? u128_sub(r, q) : r;
+}
+
+// a * b + c + d as hi:lo, which cannot overflow 128 bits
+inline ulong mad_wide(const ulong a, const ulong b, const ulong c, const ulong d, ulong* hi) {
+    ulong lo = a * b;
+    ulong h = mul_hi(a, b);
+    lo += c; h += (lo < c) ? 1 : 0;
+    lo += d; h += (lo < d) ? 1 : 0;
+    *hi = h;
+    return lo;
+}
+
+// a b 2^-128 mod q for a, b < q < 2^127 (CIOS, two 64-bit words);
+// qinv = -q^-1 mod 2^64.
+inline u128 mont_mul(const u128 a, const u128 b, const u128 q, const ulong qinv) {
+    ulong t0, t1, t2, c, m;
+
+    t0 = mad_wide(a.lo, b.lo, 0, 0, &c);
+    t1 = mad_wide(a.hi, b.lo, 0, c, &t2);
+    m  = t0 * qinv;
+    (void)mad_wide(m, q.lo, t0, 0, &c);
+    t0 = mad_wide(m, q.hi, t1, c, &c);
+    t1 = t2 + c;
+    t2 = (t1 < c) ? 1 : 0;
+
+    t0 = mad_wide(a.lo, b.hi, t0, 0, &c);
+    t1 = mad_wide(a.hi, b.hi, t1, c, &c);
+    t2 += c;
+    m  = t0 * qinv;
+    (void)mad_wide(m, q.lo, t0, 0, &c);
+    t0 = mad_wide(m, q.hi, t1, c, &c);
+    t1 = t2 + c;
+
+    u128 r;
+    r.lo = t0;
+    r.hi = t1;
+    return u128_ge(r, q) ? u128_sub(r, q) : r;
+}
+
+// True when q divides 2^p - 1.
+inline int tf_divides(const uint p, const u128 q) {
+    // q^-1 mod 2^64 by Newton: q * q = 1 (mod 8), each step doubles the bits
+    ulong inv = q.lo;
+    for (int i = 0; i < 5; ++i) inv *= 2 - q.lo * inv;
+    const ulong qinv = 0 - inv;
+
+    // one = R mod q, the Montgomery form of 1
+    u128 one;
+    one.lo = 1;
+    one.hi = 0;
+    for (int i = 0; i < 128; ++i) one = dbl_mod(one, q);
+
+    u128 x = one;
+    for (int bit = 31 - clz(p); bit >= 0; --bit) {
+        x = mont_mul(x, x, q, qinv);
+        if ((p >> bit) & 1) x = dbl_mod(x, q);
+    }
+    return x.lo == one.lo && x.hi == one.hi;
+}
+
+__kernel void kernel_tf(const uint p,
+                        const ulong k0,
+                        __global const uint* restrict primes,
+                        __global const uint* restrict skip,
+                        const uint nprimes,
+                        __global volatile uint* restrict found,
+                        const uint slot)
+{
+    const uint gid = get_global_id(0);
+    __global const uint* restrict s = skip + (size_t)slot * nprimes;
+    for (uint i = 0; i < nprimes; ++i) {
+        if (gid % primes[i] == s[i]) return;
+    }
+
+    const ulong k = k0 + (ulong)TF_CLASSES * gid;
+    if (k == 0) return;
+    const ulong twoP = 2 * (ulong)p;
+    u128 q;
+    // 2kp is even, so the + 1 never carries
+    q.lo = k * twoP + 1;
+    q.hi = mul_hi(k, twoP);
+
+    if (tf_divides(p, q)) atomic_min(&found[slot], gid);
+}
@@ -27,14 +27,34 @@
 #include "core/Printer.hpp"
 #include "core/ProofSet.hpp"
 #include "core/ProofSetMarin.hpp"
+#include "core/BenchReport.hpp"
+#include "core/Roofline.hpp"
+#include "core/CheckCadence.hpp"
+#include "core/JacobiCheck.hpp"
+#include "core/BackupCadence.hpp"
 #include "math/Carry.hpp"
+#include "math/PrimeSieve.hpp"
+#include "opencl/QueueThrottle.hpp"
+#include "core/Metrics.hpp"
+#include "util/Trace.hpp"
 #include "util/GmpUtils.hpp"
+#include "util/HostPool.hpp"
+#include "util/Fs.hpp"
+#include "util/Residue.hpp"
+#include "util/StringUtils.hpp"
 #include "io/WorktodoParser.hpp"
 #include "io/WorktodoManager.hpp"
+#include "io/ResultCache.hpp"
 #include "io/CurlClient.hpp"
+#include "math/TrialFactor.hpp"
+#include "math/Cofactor.hpp"
 #include "marin/engine.h"
+#include "marin/ibdwt.h"
 #include "marin/file.h"
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #include <cstdio>
 #include <map>
 #ifndef CL_TARGET_OPENCL_VERSION
@@ -59,10 +79,15 @@
 #include <tuple>
 #include <atomic>
 #include <fstream>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <cmath>
+#include <algorithm>
+#include <numeric>
 #include <thread>
+#include <future>
+#include <mutex>
 #include <gmp.h>
 #include <cstddef>
 #include <deque>
@@ -77,7 +102,26 @@ using namespace std::chrono;
 namespace core {
 
 static std::atomic<bool> interrupted{false};
-static void handle_sigint(int) { interrupted = true; }
+// The signal that set it. SIGTERM and SIGHUP are how a spot instance or a
+// batch scheduler takes the machine back, with a short grace period: the
+// stop path then writes the smallest checkpoint it can and says how long
+// that took.
+static std::atomic<int> stopSignal{0};
+static void handle_sigint(int sig) { stopSignal = sig; interrupted = true; }
+
+static const char* stopReason() {
+    switch (stopSignal.load()) {
+        case SIGINT:  return "SIGINT";
+        case SIGTERM: return "SIGTERM";
+#ifdef SIGHUP
+        case SIGHUP:  return "SIGHUP";
+#endif
+        default:      return "a stop request";
+    }
+}
+
+void App::requestStop(bool stop) noexcept { interrupted = stop; }
+bool App::stopRequested() noexcept { return interrupted; }
 
 static std::vector<std::string> parseConfigFile(const std::string& config_path) {
     std::ifstream config(config_path);
@@ -122,47 +166,6 @@ inline void writeStageResult(const std::string& file,
     out << message << '\n';
 }
 
-void restart_self(int argc, char* argv[]) {
-    std::vector<std::string> args(argv, argv + argc);
-
-    if (args.size() > 1 && args[1].find_first_not_of("0123456789") == std::string::npos) {
-        args.erase(args.begin() + 1); 
-    }
-
-#ifdef _WIN32
-    std::string command = "\"" + args[0] + "\"";
-    for (size_t i = 1; i < args.size(); ++i) {
-        command += " \"" + args[i] + "\"";
-    }
-    STARTUPINFO si = { sizeof(si) };
-    PROCESS_INFORMATION pi;
-    if (CreateProcessA(
-            NULL,
-            const_cast<char*>(command.c_str()),
-            NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
-        exit(0);
-    } else {
-        std::cerr << "Failed to restart program (CreateProcess failed)" << std::endl;
-    }
-
-#else
-    std::cout << "\nRestarting program without exponent:\n";
-    for (const auto& arg : args) {
-        std::cout << "   " << arg << std::endl;
-    }
-
-    std::vector<char*> exec_args;
-    for (auto& s : args) exec_args.push_back(const_cast<char*>(s.c_str()));
-    exec_args.push_back(nullptr);
-
-    execv(exec_args[0], exec_args.data());
-
-    std::cerr << "Failed to restart program (execv failed)" << std::endl;
-#endif
-}
-
 static int askExponentInteractively() {
   #ifdef _WIN32
     char buffer[32];
@@ -210,43 +213,65 @@ void App::tuneIterforce() {
 
     uint64_t low = 1, high = boundHigh;
     uint64_t best = low;
-    double bestIps = 0.0;
+    double bestIps = 0.0, bestJoules = 0.0, bestScore = 0.0;
+    const bool energy = options.tune_energy && powerMeter();
+    auto rate = [&](double ips, double j) {
+        std::ostringstream o;
+        o << "IPS=" << ips;
+        if (energy) o << " J/iter=" << j;
+        return o.str();
+    };
 
     while (low < high) {
         uint64_t mid = low + (high - low) / 2;
-        double ipsMid = measureIps(mid, testIters);
-        double ipsNext = measureIps(mid + 50, testIters);
-        std::cout << "iterforce=" << mid << " IPS=" << ipsMid
-                  << " | " << (mid+1) << " IPS=" << ipsNext << "\n";
-        if (ipsMid < ipsNext) {
+        double jMid = 0.0, jNext = 0.0;
+        double ipsMid = measureIps(mid, testIters, energy ? &jMid : nullptr);
+        double ipsNext = measureIps(mid + 50, testIters, energy ? &jNext : nullptr);
+        const double scoreMid = tuneScore(ipsMid, jMid), scoreNext = tuneScore(ipsNext, jNext);
+        std::cout << "iterforce=" << mid << " " << rate(ipsMid, jMid)
+                  << " | " << (mid+1) << " " << rate(ipsNext, jNext) << "\n";
+        if (scoreMid < scoreNext) {
             low = mid + 50;
-            if (ipsNext > bestIps) { bestIps = ipsNext; best = mid + 50; }
+            if (scoreNext > bestScore) { bestScore = scoreNext; bestIps = ipsNext; bestJoules = jNext; best = mid + 50; }
         } else {
             high = mid;
-            if (ipsMid > bestIps) { bestIps = ipsMid; best = mid; }
+            if (scoreMid > bestScore) { bestScore = scoreMid; bestIps = ipsMid; bestJoules = jMid; best = mid; }
         }
     }
-    std::cout << "Optimal iterforce=" << best << " IPS=" << bestIps << "\n";
+    std::cout << "Optimal iterforce=" << best << " " << rate(bestIps, bestJoules) << "\n";
     
 }
 
 
 
-double App::measureIps(uint64_t testIterforce, uint64_t testIters) {
+PowerMeter* App::powerMeter() {
+    if (!powerProbed_) {
+        powerProbed_ = true;
+        powerMeter_ = PowerMeter::open(PowerMeter::pciAddress(context.getDevice()));
+        if (powerMeter_) {
+            std::cout << "Board power read from " << powerMeter_->source() << "\n";
+        } else if (options.tune_energy) {
+            std::cerr << "Warning: no power reading for this device (NVML, ROCm SMI, hwmon), "
+                         "tuning for iterations per second" << std::endl;
+        }
+    }
+    return powerMeter_.get();
+}
+
+// A candidate whose energy could not be read loses under -tuneenergy.
+double App::tuneScore(double ips, double joulesPerIter) const {
+    if (!options.tune_energy || !powerMeter_) return ips;
+    return joulesPerIter > 0.0 ? 1.0 / joulesPerIter : 0.0;
+}
+
+double App::measureIps(uint64_t testIterforce, uint64_t testIters, double* joulesPerIter) {
     uint64_t oldIterforce = options.iterforce;
     options.iterforce = testIterforce;
 
     if (!buffers->input) {
         std::vector<uint64_t> x(precompute.getN(), 0ULL);
         x[0] = (options.mode == "prp") ? 3ULL : 4ULL;
-        cl_int err = CL_SUCCESS;
-        buffers->input = clCreateBuffer(
-            context.getContext(),
-            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-            x.size() * sizeof(uint64_t),
-            x.data(), &err
-        );
-        if (err != CL_SUCCESS) throw std::runtime_error("clCreateBuffer input failed");
+        buffers->input = buffers->arena.allocate("state", "input", x.size() * sizeof(uint64_t), x.data());
     }
 
     math::Carry carry(
@@ -254,28 +279,24 @@ double App::measureIps(uint64_t testIterforce, uint64_t testIters) {
         context.getQueue(),
         program->getProgram(),
         precompute.getN(),
-        precompute.getDigitWidth(),
-        buffers->digitWidthMaskBuf
-    );
+        precompute.getDigitWidth());
 
     const int barWidth = 40;
     uint64_t markInterval = std::max<uint64_t>(1, testIters / barWidth);
     std::cout << "    Running iterforce=" << testIterforce << ": [";
 
+    PowerMeter* meter = joulesPerIter ? powerMeter() : nullptr;
+    if (joulesPerIter) *joulesPerIter = 0.0;
+    if (meter) meter->start();
     auto start = high_resolution_clock::now();
     for (uint64_t iter = 1; iter <= testIters; ++iter) {
-        nttEngine->forward(buffers->input, iter - 1);
-        nttEngine->inverse(buffers->input, iter - 1);
-        carry.carryGPU(
-            buffers->input,
-            buffers->blockCarryBuf,
-            precompute.getN() * sizeof(uint64_t)
-        );
+        nttEngine->squareIteration(buffers->input, carry, iter - 1);
         if (iter % options.iterforce == 0) clFinish(context.getQueue());
         if (iter % markInterval == 0) std::cout << "." << std::flush;
     }
     clFinish(context.getQueue());
     auto end = high_resolution_clock::now();
+    if (meter) *joulesPerIter = meter->stop() / static_cast<double>(testIters);
     std::cout << "]\n";
 
     options.iterforce = oldIterforce;
@@ -286,8 +307,111 @@ double App::measureIps(uint64_t testIterforce, uint64_t testIters) {
 
 
 
-App::App(int argc, char** argv)
-  : argc_(argc)
+// The context outlives the App so that the next worktodo entry reuses the
+// platform, device and queue.
+// -cpu runs on the host engine alone: its context has no device.
+static opencl::Context& sessionContext(Session& session, const io::CliOptions& o) {
+    if (!session.context && o.cpu_engine)
+        session.context = std::make_unique<opencl::Context>(opencl::Context::HostOnly{}, o.debug);
+    if (!session.context)
+        session.context = std::make_unique<opencl::Context>(o.device_id, o.enqueue_max, o.cl_queue_throttle_active, o.debug, o.marin,
+                                                    (o.profiling || !o.trace_path.empty()) && !o.marin);
+    return *session.context;
+}
+
+// LL folds its -2 into the carry of the squaring (-DCARRY_SUB in prmers.cl)
+// when digit 0 is wide enough to take it; kernel_sub2 does it otherwise.
+static bool llSubInCarry(const io::CliOptions& o, const math::Precompute& pre) {
+    return o.mode == "ll" && !pre.getDigitWidth().empty() && pre.getDigitWidth()[0] >= 2;
+}
+
+// -progress, already checked by the parser
+static Spinner::Mode progressMode(const std::string& name) {
+    Spinner::Mode mode = Spinner::Mode::Console;
+    Spinner::parseMode(name, mode);
+    return mode;
+}
+
+// -proofcompress, already checked by the parser
+static ResidueCodec proofCodec(const std::string& name) {
+    ResidueCodec codec = ResidueCodec::None;
+    parseResidueCodec(name, codec);
+    return codec;
+}
+
+// The tuned marin geometry of `device` for 2^q -/+ 1, the built-in one when
+// planDb is empty or holds no plan for this device and transform size.
+static engine::geometry marinGeometry(const std::string& planDb, size_t device, uint32_t q,
+                                      bool negacyclic = false, size_t size = 0) {
+    engine::geometry g;
+    std::string name, driver;
+    if (planDb.empty() || !engine::gpu_device_key(device, name, driver)) return g;
+    PlanDb db(planDb);
+    if (!db.load()) return g;
+    const size_t n = (size != 0) ? size : ibdwt::transform_size(q, negacyclic);
+    if (auto plan = db.find(name, driver, static_cast<uint32_t>(n))) {
+        g.chunk16 = plan->chunk16; g.chunk64 = plan->chunk64; g.chunk256 = plan->chunk256;
+        g.blk16 = plan->blk16; g.blk64 = plan->blk64; g.cwm_wg_size = plan->cwm_wg_size;
+    }
+    return g;
+}
+
+static std::string marinPlanDb(const io::CliOptions& o) {
+    return (o.use_plan && !o.tune_plan) ? o.plan_db_path : std::string();
+}
+
+static std::string fmt_dhms(double s);
+
+// -autoengine: the backend of a PRP/LL test is the one the rates of the
+// plan database predict faster at the transform size of the exponent. The
+// choice and the predicted ETA are printed; nothing changes when either
+// backend has no rate near that size.
+static void selectEngine(io::CliOptions& o) {
+    if (!o.auto_engine || o.cpu_engine || o.wagstaff || o.tune_plan || o.bench || o.burnin_seconds) return;
+    if (o.mode != "prp" && o.mode != "ll") return;
+    std::string name, driver;
+    if (!engine::gpu_device_key(static_cast<size_t>(o.device_id), name, driver)) return;
+    PlanDb db(o.plan_db_path);
+    if (!db.load()) return;
+    const uint32_t p = static_cast<uint32_t>(o.exponent);
+    const auto marinIps = db.predictIps(name, driver, static_cast<uint32_t>(ibdwt::transform_size(p)), true);
+    const auto legacyIps = db.predictIps(name, driver, math::Precompute::transformSize(o.exponent), false);
+    if (!marinIps || !legacyIps) {
+        std::cout << "No " << (marinIps ? "legacy" : "marin") << " rate near M" << p
+                  << " in " << db.path() << ", staying on the " << (o.marin ? "marin" : "legacy") << " backend\n";
+        return;
+    }
+    o.marin = *marinIps >= *legacyIps;
+    const double ips = o.marin ? *marinIps : *legacyIps;
+    std::ostringstream line;
+    line << "Backend: " << (o.marin ? "marin" : "legacy") << std::fixed << std::setprecision(1)
+         << ", predicted " << 1e6 / *marinIps << " us/iter on marin, " << 1e6 / *legacyIps
+         << " us/iter on legacy, ETA " << fmt_dhms(double(p) / ips);
+    std::cout << line.str() << std::endl;
+}
+
+static std::string geometryString(const engine::geometry& g) {
+    std::ostringstream ss;
+    ss << "chunk16=" << g.chunk16 << " chunk64=" << g.chunk64 << " chunk256=" << g.chunk256
+       << " blk16=" << g.blk16 << " blk64=" << g.blk64 << " cwm=" << g.cwm_wg_size;
+    return ss.str();
+}
+
+// The proof is verified on a marin engine of its own, created on the
+// session's background thread, so the next entry does not wait for it.
+static std::function<engine*(uint32_t)> proofVerifierEngine(const io::CliOptions& o) {
+    return [cpu = o.cpu_engine, threads = o.cpu_threads, device = static_cast<size_t>(o.device_id),
+            chunk256 = o.chunk256, cache = o.kernel_cache_path, planDb = marinPlanDb(o)](uint32_t exponent) {
+        // 4 registers for the chains, 3 for the window of pow
+        return cpu ? engine::create_cpu(exponent, 7, threads)
+                   : engine::create_gpu(exponent, 7, device, false, chunk256, cache, 0, false,
+                                        marinGeometry(planDb, device, exponent));
+    };
+}
+
+App::App(int argc, char** argv, Session& session)
+  : session_(session)
+  , argc_(argc)
   , argv_(argv)
   ,options([&]{
      std::vector<std::string> merged;
@@ -309,15 +433,22 @@ App::App(int argc, char** argv)
       auto o = io::CliParser::parse(static_cast<int>(merged.size()), c_argv.data());
 
       io::WorktodoParser wp{o.worktodo_path};
-      if (auto e = wp.parse()) {
+      // a burn-in leaves the worktodo entries for the next run
+      if (auto e = o.burnin_seconds ? std::nullopt : wp.parse()) {
             o.exponent     = e->exponent;
-            o.mode         = e->prpTest ? "prp" : (e->llTest ? "ll" : (e->pm1Test ? "pm1" : ""));
+            o.mode         = e->prpTest ? "prp" : (e->llTest ? "ll" : (e->pm1Test ? "pm1" : (e->tfTest ? "tf" : "")));
             o.aid          = e->aid;
             o.knownFactors = e->knownFactors;
+            o.tf_from      = e->tfFrom;
             if (e->pm1Test) {
                 o.B1 = e->B1;
                 o.B2 = e->B2;
             }
+            if (e->tfTest) {
+                o.tf_bits = e->tfTo;
+                o.marin   = false;
+                o.proof   = false;
+            }
             hasWorktodoEntry_ = true;
       }
 
@@ -329,21 +460,25 @@ App::App(int argc, char** argv)
         o.mode = "prp";
         //std::exit(-1);
       }
+      selectEngine(o);
       return o;
   }())
-  , context(options.device_id,options.enqueue_max,options.cl_queue_throttle_active, options.debug,options.marin)
-  , precompute(options.exponent)
+  , context(sessionContext(session, options))
+  , precompute(session.take(options.exponent, options.kernel_cache_path))
   , backupManager(
         context.getQueue(),
+        context.getStaging(),
         options.backup_interval,
         precompute.getN(),
+        precompute.getDigitWidth(),
         options.save_path,
         options.exponent,
         options.mode,
         options.B1,
         options.B2,
         options.wagstaff,
-        options.marin
+        options.marin,
+        context.getTransferQueue()
     )
   , proofManager(
         options.exponent,
@@ -355,7 +490,9 @@ App::App(int argc, char** argv)
         context.getQueue(),
         precompute.getN(),
         precompute.getDigitWidth(),
-        options.knownFactors
+        options.knownFactors,
+        proofCodec(options.proofCodec),
+        context.getTransferQueue()
     ),
     proofManagerMarin(
         options.exponent,
@@ -367,73 +504,512 @@ App::App(int argc, char** argv)
         context.getQueue(),
         precompute.getN(),
         precompute.getDigitWidth(),
-        options.knownFactors
+        options.knownFactors,
+        proofCodec(options.proofCodec)
     )
-  , spinner()
+  , spinner(progressMode(options.progress))
   , logger(options.output_path)
   , timer()
   , timer2()
 {
+    if (!options.trace_path.empty()) util::Trace::open(options.trace_path);
+    if (!options.metrics_path.empty()) Metrics::start(options.metrics_path, options.metrics_interval);
     worktodoParser_ = std::make_unique<io::WorktodoParser>(options.worktodo_path);
     if (auto e = worktodoParser_->parse()) {
         hasWorktodoEntry_ = true;
     }
-    
+
+    // Explicit -l1/-l5 win over a stored plan.
+    if (options.use_plan && !options.tune_plan && !options.cpu_engine
+        && options.max_local_size1 == 0 && options.max_local_size5 == 0) {
+        PlanDb db(options.plan_db_path);
+        if (db.load()) {
+            if (auto plan = db.find(context.getDeviceName(), context.getDriverVersion(), precompute.getN())) {
+                options.max_local_size1 = plan->max_local_size1;
+                options.max_local_size5 = plan->max_local_size5;
+                options.twiddle_otf = options.twiddle_otf || plan->twiddle_otf;
+                options.lazy_reduce = options.lazy_reduce || plan->lazy_reduce;
+                options.four_step = options.four_step || plan->four_step;
+                options.coalesced = options.coalesced || plan->coalesced;
+                if (options.gen_tile == 0) options.gen_tile = plan->gen_tile;
+                if (options.debug)
+                    std::cout << "Using tuned NTT plan from " << db.path()
+                              << ": l1=" << plan->max_local_size1
+                              << " l5=" << plan->max_local_size5
+                              << (plan->twiddle_otf ? " twiddles=otf" : "")
+                              << (plan->lazy_reduce ? " lazy" : "")
+                              << (plan->four_step ? " fourstep" : "")
+                              << (plan->coalesced ? " coalesced" : "")
+                              << (plan->gen_tile ? " genkernels=" + std::to_string(plan->gen_tile) : "") << std::endl;
+            }
+        }
+    }
+    // the legacy program and buffers are never used by the host engine
+    if (!options.cpu_engine) buildNttResources();
+    // the host residues of this job are N limbs; those of the last are freed
+    util::HostPool::reserve(precompute.getN());
+
+    std::signal(SIGINT, handle_sigint);
+    std::signal(SIGTERM, handle_sigint);
+#ifdef SIGHUP
+    std::signal(SIGHUP, handle_sigint);
+#endif
+    if (options.gpu_share > 0 && !options.cpu_engine)
+        gpuShare_ = GpuShare::open(options.gpu_share_path.empty() ? GpuShare::defaultPath(options.device_id) : options.gpu_share_path,
+                                   options.gpu_share);
+}
+
+// Builds the tables of the next worktodo entry on a background thread while
+// this one reads back its result and writes its proof.
+void App::prefetchNextJob() {
+    if (!hasWorktodoEntry_) return;
+    if (auto next = worktodoParser_->parse(1))
+        session_.prefetch(next->exponent, options.kernel_cache_path);
+}
+
+// Moves the finished entry to worktodo_save.txt and tells main() whether
+// another one follows.
+void App::advanceWorktodo() {
+    if (!worktodoParser_->removeFirstProcessed()) {
+        std::cerr << "Failed to update " << options.worktodo_path << "\n";
+        std::exit(-1);
+    }
+    std::cout << "Entry removed from " << options.worktodo_path
+              << " and saved to worktodo_save.txt\n";
+    nextJob_ = !worktodoParser_->firstLine().empty();
+    if (nextJob_) std::cout << "Moving on to the next entry in " << options.worktodo_path << "\n";
+    else std::cout << "No more entries in " << options.worktodo_path << ", exiting.\n";
+}
+
+// Hands the result to the session's outbox, which sends it in the
+// background while the next entry runs.
+void App::queueSubmission(const std::string& json) {
+    if (!session_.outbox || session_.outbox->user() != options.user) {
+        session_.outbox.reset();
+        session_.outbox = std::make_unique<io::ResultOutbox>(options.save_path + "/outbox",
+                                                            options.user, options.password);
+    }
+    const std::string name = std::to_string(options.exponent) + "_" + options.mode;
+    if (!session_.outbox->enqueue(name, json)) {
+        std::cerr << "Submission to PrimeNet failed\n";
+    }
+}
+
+// -skipdone: the result of a test already in the save directory is printed
+// and queued again instead of being computed. Nothing when there is none.
+std::optional<int> App::reportCachedResult() {
+    const auto cached = io::ResultCache(options.save_path).find(options);
+    if (!cached) return std::nullopt;
+    std::cout << "M" << options.exponent << " already has a " << options.mode
+              << " result in " << cached->source << ", not run again:\n"
+              << cached->json << "\n";
+    if (options.submit) {
+        if (options.password.empty()) std::cerr << "No password provided; skipping submission.\n";
+        else queueSubmission(cached->json);
+    }
+    if (hasWorktodoEntry_) {
+        advanceWorktodo();
+        return 0;
+    }
+    return cached->status == "P" ? 0 : 1;
+}
+
+// Trial factoring of M(p) from 2^tf_from to 2^tf_bits, resumable per bit
+// level through <save>/<p>_tf.txt. Nothing when a PRP/LL test should follow.
+std::optional<int> App::runTrialFactor() {
+    const uint32_t p = static_cast<uint32_t>(options.exponent);
+    const std::string ckpt = options.save_path + "/" + std::to_string(p) + "_tf.txt";
+    unsigned from = options.tf_from;
+    {
+        std::ifstream in(ckpt);
+        unsigned done = 0;
+        if (in >> done && done > from) from = done;
+    }
+    unsigned to = options.tf_bits;
+    if (to > math::TrialFactor::maxBits(p)) {
+        to = math::TrialFactor::maxBits(p);
+        std::cerr << "Warning: trial factoring of M" << p << " is limited to 2^" << to << std::endl;
+    }
+    const bool tfOnly = options.mode == "tf";
+    if (from >= to) {
+        if (!tfOnly) return std::nullopt;
+        std::cout << "M" << p << " is already trial factored to 2^" << from << std::endl;
+        if (hasWorktodoEntry_) advanceWorktodo();
+        return 0;
+    }
+    if (from > options.tf_from)
+        std::cout << "Resuming trial factoring of M" << p << " from 2^" << from << std::endl;
+
+    std::cout << "Trial factoring M" << p << " from 2^" << from << " to 2^" << to << std::endl;
+    const std::string kernelFile = (fs::path(options.kernel_path).parent_path() / "tf.cl").string();
+    math::TrialFactor tf(context, kernelFile, options.kernel_cache_path);
+    Metrics::setRun(p, 0, "tf");
+    auto last = std::chrono::steady_clock::now();
+    const auto t0 = last;
+    auto r = tf.run(p, from, to, interrupted,
+        [&](unsigned bits, uint64_t done, uint64_t total) {
+            Metrics::setRun(p, total, "tf");
+            Metrics::iteration(done);
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last < std::chrono::seconds(2) && done != total) return;
+            last = now;
+            std::cout << "\rTF 2^" << bits << ": " << std::fixed << std::setprecision(1)
+                      << 100.0 * done / total << "%" << std::flush;
+        },
+        [&](unsigned bits) {
+            const std::string s = std::to_string(bits) + "\n";
+            if (!writeFileDurable(ckpt, {{s.data(), s.size()}}))
+                std::cerr << "Warning: cannot write " << ckpt << std::endl;
+            std::cout << "\rNo factor up to 2^" << bits << " ("
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count()
+                      << " s)          " << std::endl;
+        });
+    if (r.interrupted) {
+        std::cout << "\nInterrupted by user, trial factoring resumes from 2^" << r.bitsDone << std::endl;
+        return 0;
+    }
+    std::error_code ec;
+    fs::remove(ckpt, ec);
+
+    const std::string json = io::JsonBuilder::generateTrialFactor(options, options.tf_from, r.bitsDone, r.factor);
+    std::cout << "Manual submission JSON:\n" << json << "\n";
+    io::WorktodoManager wm(options);
+    wm.saveIndividualJson(options.exponent, "tf", json);
+    wm.appendToResultsTxt(json);
+    // no prompts in the middle of a worktodo file: sent when the credentials are known
+    if (options.submit && !options.user.empty() && !options.password.empty()) queueSubmission(json);
+
+    if (!r.factor.empty()) {
+        std::cout << "M" << p << " has a factor: " << r.factor
+                  << (tfOnly ? "" : ", the test is skipped") << std::endl;
+        if (hasWorktodoEntry_) {
+            advanceWorktodo();
+            return 0;
+        }
+        return 1;
+    }
+    if (tfOnly) {
+        if (hasWorktodoEntry_) advanceWorktodo();
+        return 0;
+    }
+    options.tf_from = r.bitsDone;
+    return std::nullopt;
+}
+
+// (Re)creates everything that depends on the launch sizes: the program is
+// compiled with them, so a new plan means new buffers, kernels and pipelines.
+void App::buildNttResources() {
+    nttEngine.reset();
+    kernels.reset();
+    program.reset();
+    buffers.reset();
+
     context.computeOptimalSizes(
         precompute.getN(),
         precompute.getDigitWidth(),
         options.exponent,
         options.debug,
         options.max_local_size1,
-        options.max_local_size5
+        options.max_local_size5,
+        options.four_step,
+        options.coalesced,
+        options.gen_tile
     );
     //if(!options.marin){
-        buffers.emplace(context, precompute);
-        program.emplace(context, context.getDevice(), options.kernel_path, precompute,options.build_options, options.debug);
+        // Residue-sized buffers the legacy paths take from the arena, so a
+        // plan that cannot fit the device fails here rather than mid-run.
+        std::vector<std::pair<std::string, std::size_t>> plan;
+        if (!options.marin) {
+            const std::size_t limbBytes = precompute.getN() * sizeof(uint64_t);
+            plan.emplace_back("state", limbBytes);
+            if (options.mode == "prp" && options.gerbiczli) plan.emplace_back("gerbicz-li", 5 * limbBytes);
+            if (options.mode == "ll" && options.jacobi_interval != 0) plan.emplace_back("jacobi", 2 * limbBytes);
+            if (options.mode == "pm1" && options.B2 > options.B1) plan.emplace_back("pm1-stage2", 4 * limbBytes);
+        }
+        buffers.emplace(context, precompute, static_cast<std::size_t>(options.vram_mb << 20), plan);
+        program.emplace(context, context.getDevice(), options.kernel_path, precompute,
+                        options.build_options + (options.twiddle_otf ? " -DTWIDDLE_OTF=1" : "")
+                                              + (options.lazy_reduce ? " -DLAZY_REDUCTION=1" : "")
+                                              + (llSubInCarry(options, precompute) ? " -DCARRY_SUB=2" : ""),
+                        options.debug, options.kernel_cache_path);
         kernels.emplace(program->getProgram(), context.getQueue());
         
 
 
-        std::vector<std::string> kernelNames = {
-            "kernel_sub2",
-            "kernel_sub1",
-            "kernel_carry",
-            "kernel_carry_2",
-            "kernel_inverse_ntt_radix4_mm",
-            "kernel_ntt_radix4_last_m1_n4",
-            "kernel_ntt_radix4_last_m1_n4_nosquare",
-            "kernel_inverse_ntt_radix4_mm_last",
-            "kernel_ntt_radix4_last_m1",
-            "kernel_ntt_radix4_last_m1_nosquare",
-            "kernel_ntt_radix4_mm_first",
-            "kernel_ntt_radix4_mm_m8",
-            "kernel_ntt_radix4_mm_m4",
-            "kernel_ntt_radix4_mm_m2",
-            "kernel_ntt_radix4_mm_m16",
-            "kernel_ntt_radix4_mm_m32",
-            "kernel_inverse_ntt_radix4_m1",
-            "kernel_inverse_ntt_radix4_m1_n4",
-            "kernel_ntt_radix4_inverse_mm_2steps",
-            "kernel_ntt_radix4_inverse_mm_2steps_last",
-            "kernel_ntt_radix4_mm_2steps",
-            "kernel_ntt_radix4_mm_2steps_first",
-            "kernel_ntt_radix2_square_radix2",
-            "kernel_ntt_radix4_radix2_square_radix2_radix4",
-            "kernel_ntt_radix4_square_radix4",
-            "kernel_pointwise_mul",
-            "kernel_ntt_radix2",
-            "kernel_res64_display",
-            "kernel_ntt_radix5_mm_first",
-            "kernel_ntt_inverse_radix5_mm_last",
-            "check_equal"
-        };
-        for (auto& name : kernelNames) {
-            kernels->createKernel(name);
-        }
+        kernels->createEngineKernels();
         nttEngine.emplace(context, *kernels, *buffers, precompute, options.mode == "pm1", options.debug);
+        if (options.proof && !options.marin)
+            proofManager.attachPacker(kernels->getKernel("kernel_pack_bits"), context.getWorkersCarry(),
+                                      context.hasUnifiedMemory());
     //}
+}
 
-    std::signal(SIGINT, handle_sigint);
+// Sweeps the launch parameters of the legacy NTT for the current N: the
+// local-size caps, the twiddle and reduction variants, the four-step,
+// coalesced and generated passes. The radix decomposition is not swept: the
+// pipeline builders derive the stage sequence from N, so it is neither in
+// NttPlan nor in the database key, and is left for a later change.
+int App::runPlanTune() {
+    const uint32_t n = precompute.getN();
+    NttPlan best;
+    best.device = context.getDeviceName();
+    best.driver = context.getDriverVersion();
+    best.n      = n;
+    best.ips    = -1.0;
+
+    std::cout << "Tuning NTT plan for N=" << n << " on " << best.device
+              << " (driver " << best.driver << ")\n";
+
+    const std::vector<int> sizes = { 0, 32, 64, 128, 256 };
+    const std::vector<int> sizes5 = (n % 5 == 0) ? sizes : std::vector<int>{ 0 };
+    const int l1 = options.max_local_size1, l5 = options.max_local_size5;
+    const bool otf = options.twiddle_otf, lazy = options.lazy_reduce, fourStep = options.four_step;
+    const bool coalesced = options.coalesced;
+    const uint32_t genTile = options.gen_tile;
+    options.coalesced = false;
+    options.gen_tile = 0;
+
+    double sampleIps = measureIps(options.iterforce, 100);
+    uint64_t testIters = static_cast<uint64_t>(sampleIps * 2.0);
+    testIters = std::clamp<uint64_t>(testIters, 200, 20000);
+    // -tuneenergy ranks the plans by iterations per joule
+    const bool energy = options.tune_energy && powerMeter();
+    double bestScore = -1.0, bestJoules = 0.0;
+    auto joules = [&](double j) { return energy ? " J/iter=" + std::to_string(j) : std::string(); };
+
+    // Table twiddles cost bandwidth, derived ones cost two or three modmuls: which wins depends on the device.
+    // So does lazy reduction, which trades a compare against p - b for a carry test and a rare second fold.
+    // The four-step passes only pay once the middle stages no longer fit in cache: large N only.
+    for (int variant = 0; variant < 8; ++variant) {
+        const bool t = (variant & 1) != 0, lz = (variant & 2) != 0, fs = (variant & 4) != 0;
+        if (fs && n < (1u << 20)) continue;
+        for (int s1 : sizes) {
+            if (s1 > 0 && static_cast<size_t>(s1) > context.getMaxWorkGroupSize()) continue;
+            for (int s5 : sizes5) {
+                if (s5 > 0 && static_cast<size_t>(s5) > context.getMaxWorkGroupSize()) continue;
+                options.max_local_size1 = s1;
+                options.max_local_size5 = s5;
+                options.twiddle_otf = t;
+                options.lazy_reduce = lz;
+                options.four_step = fs;
+                const std::string tw = std::string(t ? " twiddles=otf" : "") + (lz ? " lazy" : "")
+                                     + (fs ? " fourstep" : "");
+                try {
+                    buildNttResources();
+                } catch (const std::exception& e) {
+                    std::cerr << "  l1=" << s1 << " l5=" << s5 << tw << " skipped: " << e.what() << std::endl;
+                    continue;
+                }
+                double j = 0.0;
+                const double ips = measureIps(options.iterforce, testIters, energy ? &j : nullptr);
+                std::cout << "  l1=" << s1 << " l5=" << s5 << tw
+                          << " (local sizes " << context.getLocalSize() << "/" << context.getLocalSize5()
+                          << ") IPS=" << ips << joules(j) << "\n";
+                if (tuneScore(ips, j) > bestScore) {
+                    bestScore = tuneScore(ips, j);
+                    bestJoules = j;
+                    best.ips = ips;
+                    best.max_local_size1 = s1;
+                    best.max_local_size5 = s5;
+                    best.twiddle_otf = t;
+                    best.lazy_reduce = lz;
+                    best.four_step = fs;
+                }
+            }
+        }
+    }
+    // The tiles only change the stages of stride 2 to 8: tried once, on the best plan.
+    if (best.ips > 0.0) {
+        options.max_local_size1 = best.max_local_size1;
+        options.max_local_size5 = best.max_local_size5;
+        options.twiddle_otf = best.twiddle_otf;
+        options.lazy_reduce = best.lazy_reduce;
+        options.four_step = best.four_step;
+        options.coalesced = true;
+        try {
+            buildNttResources();
+            if (context.getCoalescedTile() != 0) {
+                double j = 0.0;
+                const double ips = measureIps(options.iterforce, testIters, energy ? &j : nullptr);
+                std::cout << "  best plan + coalesced (tile " << context.getCoalescedTile() << ") IPS=" << ips << joules(j) << "\n";
+                if (tuneScore(ips, j) > bestScore) {
+                    bestScore = tuneScore(ips, j);
+                    bestJoules = j;
+                    best.ips = ips;
+                    best.coalesced = true;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "  coalesced skipped: " << e.what() << std::endl;
+        }
+        // so do the generated passes, which replace the middle and last stages
+        options.coalesced = best.coalesced;
+        for (uint32_t tile : { 1024u, 2048u, 4096u }) {
+            options.gen_tile = tile;
+            try {
+                buildNttResources();
+                if (context.getGenTile() != tile || !nttEngine || !nttEngine->usesGeneratedKernels()) continue;
+                double j = 0.0;
+                const double ips = measureIps(options.iterforce, testIters, energy ? &j : nullptr);
+                std::cout << "  best plan + genkernels (tile " << tile << ") IPS=" << ips << joules(j) << "\n";
+                if (tuneScore(ips, j) > bestScore) {
+                    bestScore = tuneScore(ips, j);
+                    bestJoules = j;
+                    best.ips = ips;
+                    best.gen_tile = tile;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "  genkernels " << tile << " skipped: " << e.what() << std::endl;
+            }
+        }
+    }
+    options.max_local_size1 = l1;
+    options.max_local_size5 = l5;
+    options.twiddle_otf = otf;
+    options.lazy_reduce = lazy;
+    options.four_step = fourStep;
+    options.coalesced = coalesced;
+    options.gen_tile = genTile;
+
+    if (best.ips <= 0.0) {
+        std::cerr << "No NTT plan could be measured" << std::endl;
+        return 1;
+    }
+    std::cout << "Best plan: l1=" << best.max_local_size1 << " l5=" << best.max_local_size5
+              << (best.twiddle_otf ? " twiddles=otf" : "")
+              << (best.lazy_reduce ? " lazy" : "")
+              << (best.four_step ? " fourstep" : "")
+              << (best.coalesced ? " coalesced" : "")
+              << (best.gen_tile ? " genkernels=" + std::to_string(best.gen_tile) : "")
+              << " IPS=" << best.ips << joules(bestJoules) << "\n";
+
+    PlanDb db(options.plan_db_path);
+    db.load();
+    if (auto old = db.find(best.device, best.driver, best.n)) {
+        best.chunk16 = old->chunk16; best.chunk64 = old->chunk64; best.chunk256 = old->chunk256;
+        best.blk16 = old->blk16; best.blk64 = old->blk64; best.cwm_wg_size = old->cwm_wg_size;
+        best.marin_ips = old->marin_ips;
+    }
+    db.put(best);
+    if (!db.save()) {
+        std::cerr << "Failed to write " << db.path() << std::endl;
+        return 1;
+    }
+    std::cout << "Plan saved to " << db.path() << "\n";
+    return 0;
+}
+
+// Coordinate descent over the marin kernel geometry: each size in turn goes
+// through the powers of two up to its built-in value, the others held at the
+// best found so far. A different geometry is a different program, compiled
+// once and kept in the kernel cache.
+int App::runPlanTuneMarin() {
+    const uint32_t p = static_cast<uint32_t>(options.exponent);
+    const size_t device = static_cast<size_t>(options.device_id);
+    NttPlan best;
+    if (!engine::gpu_device_key(device, best.device, best.driver)) {
+        std::cerr << "No OpenCL device " << device << std::endl;
+        return 1;
+    }
+    best.n = static_cast<uint32_t>(ibdwt::transform_size(p));
+
+    std::cout << "Tuning marin kernel geometry for N=" << best.n << " on " << best.device
+              << " (driver " << best.driver << ")\n";
+
+    // -tuneenergy ranks the geometries by iterations per joule
+    const bool energy = options.tune_energy && powerMeter();
+    auto joules = [&](double j) { return energy ? " J/iter=" + std::to_string(j) : std::string(); };
+    auto measure = [&](const engine::geometry& g, double& joulesPerIter) -> double {
+        joulesPerIter = 0.0;
+        std::unique_ptr<engine> eng;
+        try {
+            eng.reset(engine::create_gpu(p, 2, device, false, options.chunk256, options.kernel_cache_path, 0, false, g));
+        } catch (const std::exception& e) {
+            std::cerr << "  " << geometryString(g) << " skipped: " << e.what() << std::endl;
+            return -1.0;
+        }
+        eng->set(1, 1);
+        eng->set(0, 3);
+        for (int i = 0; i < 64; ++i) eng->square_mul(0);
+        eng->is_equal(0, 1);
+        PowerMeter* meter = energy ? powerMeter() : nullptr;
+        if (meter) meter->start();
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        uint64_t iters = 0;
+        double elapsed = 0.0;
+        // the check reads the register back: the queue is empty when it returns
+        for (uint64_t block = 64; elapsed < 2.0; block *= 2) {
+            for (uint64_t i = 0; i < block; ++i) eng->square_mul(0);
+            eng->is_equal(0, 1);
+            iters += block;
+            elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        }
+        if (meter) joulesPerIter = meter->stop() / double(iters);
+        return double(iters) / elapsed;
+    };
+
+    std::unique_ptr<engine> probe(engine::create_gpu(p, 2, device, false, options.chunk256, options.kernel_cache_path));
+    const engine::geometry builtin = probe->get_geometry();
+    probe.reset();
+
+    engine::geometry cur = builtin;
+    double bestJoules = 0.0;
+    best.marin_ips = measure(cur, bestJoules);
+    if (best.marin_ips <= 0.0) {
+        std::cerr << "No marin geometry could be measured" << std::endl;
+        return 1;
+    }
+    double bestScore = tuneScore(best.marin_ips, bestJoules);
+    std::cout << "  built-in " << geometryString(cur) << " IPS=" << best.marin_ips << joules(bestJoules) << "\n";
+
+    size_t engine::geometry::*const sizes[] = {
+        &engine::geometry::chunk16, &engine::geometry::chunk64, &engine::geometry::chunk256,
+        &engine::geometry::blk16, &engine::geometry::blk64, &engine::geometry::cwm_wg_size
+    };
+    for (auto field : sizes) {
+        const size_t top = builtin.*field;
+        // a carry work-group below an eighth of the built-in one starves the device
+        const size_t low = (field == &engine::geometry::cwm_wg_size) ? std::max<size_t>(top / 8, 1) : 1;
+        for (size_t v = low; v < top; v *= 2) {
+            engine::geometry g = cur;
+            g.*field = v;
+            double j = 0.0;
+            const double ips = measure(g, j);
+            if (ips <= 0.0) continue;
+            std::cout << "  " << geometryString(g) << " IPS=" << ips << joules(j) << "\n";
+            if (tuneScore(ips, j) > bestScore) {
+                bestScore = tuneScore(ips, j);
+                bestJoules = j;
+                best.marin_ips = ips;
+                cur = g;
+            }
+        }
+    }
+
+    std::cout << "Best geometry: " << geometryString(cur) << " IPS=" << best.marin_ips << joules(bestJoules) << "\n";
+    // the built-in values are stored as 0 so that a later change of them is followed
+    best.chunk16 = (cur.chunk16 == builtin.chunk16) ? 0 : static_cast<uint32_t>(cur.chunk16);
+    best.chunk64 = (cur.chunk64 == builtin.chunk64) ? 0 : static_cast<uint32_t>(cur.chunk64);
+    best.chunk256 = (cur.chunk256 == builtin.chunk256) ? 0 : static_cast<uint32_t>(cur.chunk256);
+    best.blk16 = (cur.blk16 == builtin.blk16) ? 0 : static_cast<uint32_t>(cur.blk16);
+    best.blk64 = (cur.blk64 == builtin.blk64) ? 0 : static_cast<uint32_t>(cur.blk64);
+    best.cwm_wg_size = (cur.cwm_wg_size == builtin.cwm_wg_size) ? 0 : static_cast<uint32_t>(cur.cwm_wg_size);
+
+    PlanDb db(options.plan_db_path);
+    db.load();
+    if (auto old = db.find(best.device, best.driver, best.n)) {
+        best.max_local_size1 = old->max_local_size1; best.max_local_size5 = old->max_local_size5;
+        best.twiddle_otf = old->twiddle_otf; best.lazy_reduce = old->lazy_reduce;
+        best.four_step = old->four_step; best.coalesced = old->coalesced; best.gen_tile = old->gen_tile;
+        best.ips = old->ips;
+    }
+    db.put(best);
+    if (!db.save()) {
+        std::cerr << "Failed to write " << db.path() << std::endl;
+        return 1;
+    }
+    std::cout << "Plan saved to " << db.path() << "\n";
+    return 0;
 }
 
 static inline std::vector<uint32_t> pack_words_from_eng_digits(const engine::digit& d, uint32_t E) {
@@ -472,38 +1048,102 @@ static inline std::vector<uint64_t> helperu(const engine::digit& d) {
 }
 
 
-static inline uint32_t mod3_words(const std::vector<uint32_t>& W) {
-    uint32_t r = 0; for (uint32_t w : W) r = (r + (w % 3)) % 3; return r;
+// The Gerbicz-Li failure rate is learned per device, across jobs.
+static CheckCadence makeCadence(const io::CliOptions& o, const opencl::Context& ctx, uint64_t B) {
+    const std::string device = o.cpu_engine ? std::string("cpu") : ctx.getDeviceName() + " #" + std::to_string(o.device_id);
+    return CheckCadence((fs::path(o.save_path) / "gerbicz_rates.json").string(), device, B, o.checklevel);
+}
+
+// The crash rate is learned per node (the -computer name, else the host
+// name), across jobs; `bytes` is the size of one checkpoint.
+static std::unique_ptr<BackupCadence> makeBackupCadence(const io::CliOptions& o, uint64_t bytes) {
+    std::string node = o.computer_name;
+#ifndef _WIN32
+    char host[256] = {};
+    if (node.empty() && ::gethostname(host, sizeof(host) - 1) == 0) node = host;
+#endif
+    if (node.empty()) node = "localhost";
+    return std::make_unique<BackupCadence>((fs::path(o.save_path) / "crash_rates.json").string(), node,
+                                           o.backup_interval_fixed ? double(o.backup_interval) : 0.0,
+                                           double(o.backup_interval_max), bytes);
 }
-static inline void div3_words(uint32_t E, std::vector<uint32_t>& W) {
-    uint32_t r = (3 - mod3_words(W)) % 3;
-    int topBits = int(E % 32);
-    { uint64_t t = (uint64_t(r) << topBits) + W.back(); W.back() = uint32_t(t / 3); r = uint32_t(t % 3); }
-    for (auto it = W.rbegin() + 1; it != W.rend(); ++it) { uint64_t t = (uint64_t(r) << 32) + *it; *it = uint32_t(t / 3); r = uint32_t(t % 3); }
+
+// `ckpt_file` is the checkpoint the run used: m_, wagstaff_m_ or wagstaff_n_.
+static inline void delete_checkpoints(const std::string& ckpt_file)
+{
+    std::error_code ec;
+    fs::remove(ckpt_file, ec);
+    fs::remove(ckpt_file + ".old", ec);
+    fs::remove(ckpt_file + ".new", ec);
 }
-static inline void prp3_div9(uint32_t E, std::vector<uint32_t>& W) { div3_words(E, W); div3_words(E, W); }
 
-static inline std::string format_res64_hex(const std::vector<uint32_t>& W) {
-    uint64_t r64 = (uint64_t(W.size() > 1 ? W[1] : 0) << 32) | (W.empty() ? 0u : W[0]);
-    std::ostringstream oss; oss << std::hex << std::uppercase << std::setw(16) << std::setfill('0') << r64; return oss.str();
+// P-1 checkpoints use the marin layout (version, p, iteration, elapsed time,
+// payload, crc32), the payload being the carried digits of `regs`: unlike
+// the PRP state they are a few registers of a larger engine.
+static int read_marin_regs(const std::string& file, uint32_t p, const engine* eng,
+                           const std::vector<engine::Reg>& regs, uint32_t& ri, double& et)
+{
+    File f(file);
+    if (!f.exists()) return -1;
+    int version = 0; if (!f.read(reinterpret_cast<char*>(&version), sizeof(version))) return -2;
+    if (version != 1) return -2;
+    uint32_t rp = 0; if (!f.read(reinterpret_cast<char*>(&rp), sizeof(rp))) return -2;
+    if (rp != p) return -2;
+    if (!f.read(reinterpret_cast<char*>(&ri), sizeof(ri))) return -2;
+    if (!f.read(reinterpret_cast<char*>(&et), sizeof(et))) return -2;
+    std::vector<std::vector<uint64_t>> data(regs.size(), std::vector<uint64_t>(eng->get_size()));
+    for (auto& d : data) {
+        if (!f.read(reinterpret_cast<char*>(d.data()), d.size() * sizeof(uint64_t))) return -2;
+    }
+    if (!f.check_crc32()) return -2;
+    for (size_t i = 0; i < regs.size(); ++i) eng->set_digits(regs[i], data[i].data());
+    return 0;
 }
-static inline std::string format_res2048_hex(const std::vector<uint32_t>& W) {
-    std::ostringstream oss; oss << std::hex << std::nouppercase << std::setfill('0');
-    for (int i = 63; i >= 0; --i) {
-        uint32_t w = (i < int(W.size())) ? W[i] : 0u;
-        oss << std::setw(8) << w;
+
+static void save_marin_regs(const std::string& file, uint32_t p, const engine* eng,
+                            const std::vector<engine::Reg>& regs, uint32_t i, double et)
+{
+    const std::string oldf = file + ".old", newf = file + ".new";
+    {
+        File f(newf, "wb");
+        int version = 1;
+        if (!f.write(reinterpret_cast<const char*>(&version), sizeof(version))) return;
+        if (!f.write(reinterpret_cast<const char*>(&p), sizeof(p))) return;
+        if (!f.write(reinterpret_cast<const char*>(&i), sizeof(i))) return;
+        if (!f.write(reinterpret_cast<const char*>(&et), sizeof(et))) return;
+        std::vector<uint64_t> d(eng->get_size());
+        for (const engine::Reg r : regs) {
+            const engine::digit digit(eng, r);
+            for (size_t k = 0; k < d.size(); ++k) d[k] = digit.val(k);
+            if (!f.write(reinterpret_cast<const char*>(d.data()), d.size() * sizeof(uint64_t))) return;
+        }
+        f.write_crc32();
     }
-    return oss.str();
+    std::remove(oldf.c_str());
+    struct stat st;
+    if ((stat(file.c_str(), &st) == 0) && (std::rename(file.c_str(), oldf.c_str()) != 0)) return;
+    std::rename(newf.c_str(), file.c_str());
 }
 
-static inline void delete_checkpoints(uint32_t p, bool wagstaff, const std::string& dir = ".")
+static void remove_marin_ckpt(const std::string& file)
 {
-    const std::string prefix = wagstaff ? "wagstaff_" : "";
-    fs::path base = fs::path(dir) / (prefix + "m_" + std::to_string(p) + ".ckpt");
     std::error_code ec;
-    fs::remove(base, ec);
-    fs::remove(base.string() + ".old", ec);
-    fs::remove(base.string() + ".new", ec);
+    fs::remove(file, ec);
+    fs::remove(file + ".old", ec);
+    fs::remove(file + ".new", ec);
+}
+
+// gcd(src - a, 2^p - 1), a being 1 after stage 1 and 0 after stage 2.
+static mpz_class marin_gcd(const engine* eng, engine::Reg src, uint32_t p, unsigned long a)
+{
+    const std::vector<uint32_t> words = pack_words_from_eng_digits(engine::digit(eng, src), p);
+    mpz_class x;
+    mpz_import(x.get_mpz_t(), words.size(), -1, sizeof(uint32_t), 0, 0, words.data());
+    const mpz_class Mp = (mpz_class(1) << p) - 1;
+    x -= a;
+    mpz_class g;
+    mpz_gcd(g.get_mpz_t(), x.get_mpz_t(), Mp.get_mpz_t());
+    return g;
 }
 
 
@@ -515,11 +1155,57 @@ int App::runPrpOrLlMarin()
     const uint32_t p = static_cast<uint32_t>(options.exponent);
     const bool verbose = options.debug;
 
-    engine* eng = engine::create_gpu(p, static_cast<size_t>(6), static_cast<size_t>(options.device_id), verbose,  options.chunk256);
+    std::ostringstream ck;
+    if (options.wagstaff) ck << "wagstaff_";
+    ck << "m_" << p << ".ckpt";
+    std::string ckpt_file = ck.str();
+
+    // Wagstaff runs modulo 2^q + 1 on a negacyclic transform, half the size
+    // of the cyclic one modulo 2^(2q) - 1; a checkpoint of a cyclic run keeps
+    // its mode.
+    const bool negacyclic = options.wagstaff && !fs::exists(ckpt_file) && !fs::exists(ckpt_file + ".old");
+    const uint32_t q = negacyclic ? p / 2 : p;
+    if (negacyclic) ckpt_file = "wagstaff_n_" + std::to_string(q) + ".ckpt";
+
+    // A checkpoint holds 6 registers of n words between a 20-byte header and a crc32:
+    // keep the size it was written with if the size rule has changed since.
+    size_t resume_size = 0;
+    if (!options.cpu_engine) {
+        for (const std::string& file : { ckpt_file, ckpt_file + ".old" }) {
+            std::error_code ec;
+            const uintmax_t bytes = fs::file_size(file, ec);
+            if (ec || (bytes <= 24) || ((bytes - 24) % (6 * sizeof(uint64_t)) != 0)) continue;
+            const size_t n = static_cast<size_t>((bytes - 24) / (6 * sizeof(uint64_t)));
+            if ((n > ibdwt::transform_size(q, negacyclic)) && ibdwt::is_supported(n)) resume_size = n;
+            break;
+        }
+    }
+
+    // -hostrollback: R4 and R5, the last verified state, are host slots 0 and 1
+    const bool hostRollback = options.hostRollback;
+    const size_t regCount = hostRollback ? 4 : 6;
+    engine* eng = options.cpu_engine
+        ? engine::create_cpu(q, regCount, options.cpu_threads, negacyclic)
+        : engine::create_gpu(q, regCount, static_cast<size_t>(options.device_id), verbose,  options.chunk256, options.kernel_cache_path, resume_size, negacyclic,
+                             marinGeometry(marinPlanDb(options), static_cast<size_t>(options.device_id), q, negacyclic, resume_size));
+    if (resume_size != 0)
+        std::cout << "Keeping the transform size of the checkpoint (" << resume_size << ")" << std::endl;
+    if (options.cpu_engine)
+        std::cout << "Host two-prime (p x M61) engine: " << eng->get_size() / 2 << " digits of "
+                  << (q + eng->get_size() / 2 - 1) / (eng->get_size() / 2) << " bits at most" << std::endl;
 
     auto to_hex16 = [](uint64_t u){ std::stringstream ss; ss << std::uppercase << std::hex << std::setfill('0') << std::setw(16) << u; return ss.str(); };
 
-    if (verbose) std::cout << "Testing 2^" << p << " - 1, " << eng->get_size() << " 64-bit words..." << std::endl;
+    if (verbose) std::cout << "Testing 2^" << q << (negacyclic ? " + 1, " : " - 1, ") << eng->get_size() << " 64-bit words..." << std::endl;
+    if (options.profiling) eng->set_profiling(true);
+    uint64_t profileStart = 0;
+    auto dumpProfile = [&](uint64_t iter) {
+        if (!options.profiling || iter <= profileStart) return;
+        std::cout << "\nKernel profile at iteration " << iter << " (per iteration: launches, share, ns (ns per launch))" << std::endl;
+        eng->display_profiles(static_cast<size_t>(iter - profileStart));
+        eng->set_profiling(true);    // next window
+        profileStart = iter;
+    };
 
     if (options.proof) {
         uint32_t proofPower = options.manual_proofPower ? options.proofPower : ProofSetMarin::bestPower(options.exponent);
@@ -528,47 +1214,68 @@ int App::runPrpOrLlMarin()
         std::cout << "Proof of power " << proofPower << " requires about "
                   << std::fixed << std::setprecision(2) << diskUsageGB << "GB of disk space" << std::endl;
     }
-    std::ostringstream ck;
-    if (options.wagstaff) ck << "wagstaff_";
-    ck << "m_" << p << ".ckpt";
-    const std::string ckpt_file = ck.str();
-
     auto read_ckpt = [&](const std::string& file, uint32_t& ri, double& et)->int{
         File f(file);
         if (!f.exists()) return -1;
         int version = 0; if (!f.read(reinterpret_cast<char*>(&version), sizeof(version))) return -2;
         if (version != 1) return -2;
         uint32_t rp = 0; if (!f.read(reinterpret_cast<char*>(&rp), sizeof(rp))) return -2;
-        if (rp != p) return -2;
+        if (rp != q) return -2;
         if (!f.read(reinterpret_cast<char*>(&ri), sizeof(ri))) return -2;
         if (!f.read(reinterpret_cast<char*>(&et), sizeof(et))) return -2;
         const size_t cksz = eng->get_checkpoint_size();
         std::vector<char> data(cksz);
         if (!f.read(data.data(), cksz)) return -2;
         if (!eng->set_checkpoint(data)) return -2;
+        // the registers the device does not hold follow, as in a file of six
+        if (hostRollback) {
+            std::vector<char> slot(cksz / regCount);
+            for (size_t k = 0; k < 2; ++k) {
+                if (!f.read(slot.data(), slot.size())) return -2;
+                if (!eng->set_host(k, slot)) return -2;
+            }
+        }
         if (!f.check_crc32()) return -2;
         return 0;
     };
 
-    auto save_ckpt = [&](uint32_t i, double et){
-        const std::string oldf = ckpt_file + ".old", newf = ckpt_file + ".new";
-        {
-            File f(newf, "wb");
-            int version = 1;
-            if (!f.write(reinterpret_cast<const char*>(&version), sizeof(version))) return;
-            if (!f.write(reinterpret_cast<const char*>(&p), sizeof(p))) return;
-            if (!f.write(reinterpret_cast<const char*>(&i), sizeof(i))) return;
-            if (!f.write(reinterpret_cast<const char*>(&et), sizeof(et))) return;
-            const size_t cksz = eng->get_checkpoint_size();
-            std::vector<char> data(cksz);
-            if (!eng->get_checkpoint(data)) return;
-            if (!f.write(data.data(), cksz)) return;
-            f.write_crc32();
-        }
-        std::remove(oldf.c_str());
-        struct stat s;
-        if ((stat(ckpt_file.c_str(), &s) == 0) && (std::rename(ckpt_file.c_str(), oldf.c_str()) != 0)) return;
-        std::rename(newf.c_str(), ckpt_file.c_str());
+    // The registers are snapshot on the device and the file is written on a
+    // background thread while the iterations go on; the next save, or the end
+    // of the loop, waits for it.
+    std::vector<char> ckptData, ckptHost[2];
+    struct CkptWriter { std::thread t; void wait() { if (t.joinable()) t.join(); } ~CkptWriter() { wait(); } } ckptWriter;
+    auto save_ckpt = [&](uint32_t i, double et, bool async = false){
+        ckptWriter.wait();
+        ckptData.resize(eng->get_checkpoint_size());
+        if (!eng->begin_checkpoint(ckptData)) return;
+        if (hostRollback && !(eng->get_host(0, ckptHost[0]) && eng->get_host(1, ckptHost[1]))) return;
+        auto write = [&, i, et]{
+            const auto t0 = std::chrono::steady_clock::now();
+            const std::string oldf = ckpt_file + ".old", newf = ckpt_file + ".new";
+            {
+                File f(newf, "wb");
+                int version = 1;
+                if (!f.write(reinterpret_cast<const char*>(&version), sizeof(version))) return;
+                if (!f.write(reinterpret_cast<const char*>(&q), sizeof(q))) return;
+                if (!f.write(reinterpret_cast<const char*>(&i), sizeof(i))) return;
+                if (!f.write(reinterpret_cast<const char*>(&et), sizeof(et))) return;
+                if (!eng->end_checkpoint(ckptData)) return;
+                if (!f.write(ckptData.data(), ckptData.size())) return;
+                if (hostRollback) {
+                    for (const std::vector<char>& slot : ckptHost)
+                        if (!f.write(slot.data(), slot.size())) return;
+                }
+                f.write_crc32();
+            }
+            std::remove(oldf.c_str());
+            struct stat s;
+            if ((stat(ckpt_file.c_str(), &s) == 0) && (std::rename(ckpt_file.c_str(), oldf.c_str()) != 0)) return;
+            std::rename(newf.c_str(), ckpt_file.c_str());
+            Metrics::checkpoint(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(),
+                                ckptData.size() + (hostRollback ? ckptHost[0].size() + ckptHost[1].size() : 0));
+        };
+        if (async) ckptWriter.t = std::thread(write);
+        else write();
     };
 
     const size_t R0 = 0, R1 = 1, R2 = 2, R3 = 3, R4 = 4, R5 = 5;
@@ -584,8 +1291,26 @@ int App::runPrpOrLlMarin()
         eng->set(R0, (options.mode == "prp") ? 3 : 4);
     }
 
-    eng->copy(R4, R0);//Last correct state
-    eng->copy(R5, R1);//Last correct bufd
+    // R4, R5 = R0, R1: the last verified state
+    auto keepVerified = [&](size_t state, size_t bufd) {
+        if (hostRollback) {
+            eng->to_host(0, state);
+            eng->to_host(1, bufd);
+        } else {
+            eng->copy(R4, state);//Last correct state
+            eng->copy(R5, bufd);//Last correct bufd
+        }
+    };
+    auto restoreVerified = [&]() {
+        if (hostRollback) {
+            eng->from_host(R0, 0);
+            eng->from_host(R1, 1);
+        } else {
+            eng->copy(R0, R4);
+            eng->copy(R1, R5);
+        }
+    };
+    keepVerified(R0, R1);
     logger.logStart(options);
     timer.start();
     timer2.start();
@@ -594,6 +1319,8 @@ int App::runPrpOrLlMarin()
     const auto start_clock = std::chrono::high_resolution_clock::now();
     auto lastBackup = start_clock;
     auto lastDisplay = start_clock;
+    auto backupCadence = makeBackupCadence(options, eng->get_checkpoint_size());
+    double backupSeconds = backupCadence->interval();
 
     uint64_t totalIters = options.mode == "prp" ? p : p - 2;
     
@@ -609,16 +1336,23 @@ int App::runPrpOrLlMarin()
 
     uint64_t L = options.exponent;
     uint64_t B = (uint64_t)(std::sqrt((double)L));
-    double desiredIntervalSeconds = 600.0;
     uint64_t checkpass = 0;
 
-    uint64_t checkpasslevel_auto = (uint64_t)((1000 * desiredIntervalSeconds) / (double)B);
-    if (checkpasslevel_auto == 0) checkpasslevel_auto = (totalIters/B)/((uint64_t)(std::sqrt((double)B)));
-    uint64_t checkpasslevel = (options.checklevel > 0)
-        ? options.checklevel
-        : checkpasslevel_auto;
-    if(checkpasslevel==0)
-        checkpasslevel=1;
+    // 1000 iterations per second until the first verification has measured them
+    CheckCadence cadence = makeCadence(options, context, B);
+    uint64_t checkpasslevel = cadence.level(1000.0);
+    uint64_t itersSinceCheck = 0;
+    auto lastCheck = start_clock;
+    // the squaring time the verification covered, and the speed it ran at
+    auto recordCheck = [&](bool ok) {
+        const auto t = std::chrono::high_resolution_clock::now();
+        const double seconds = std::chrono::duration<double>(t - lastCheck).count();
+        if (ok) cadence.passed(seconds); else cadence.failed(seconds);
+        cadence.save();
+        checkpasslevel = cadence.level(seconds > 0 ? double(itersSinceCheck) / seconds : 0.0);
+        itersSinceCheck = 0;
+        lastCheck = t;
+    };
     uint64_t resumeIter = ri;
     uint64_t startIter  = ri;
     uint64_t lastIter   = ri ? ri - 1 : 0;
@@ -631,31 +1365,101 @@ int App::runPrpOrLlMarin()
         std::cout << "[WAGSTAFF MODE] This test will check if (2^" << options.exponent/2 << " + 1)/3 is PRP prime" << std::endl;
     }
     
+    // A verification squares R3 on the side of the next iterations and is compared with R1 at the next
+    // block, before R1 changes; R2 keeps R0 of the verified iteration meanwhile. Only a mismatch rolls back.
+    bool checkPending = false;
+    uint64_t checkIter = 0, checkJ = 0;
+    auto resolveCheck = [&](uint64_t& iter, uint64_t& j) -> bool {
+        checkPending = false;
+        eng->join_side();
+        if (eng->is_equal(R3, R1)) {
+            std::cout << "[Gerbicz Li] Check passed! iter=" << checkIter << "\n";
+            Metrics::gerbiczCheck(true);
+            recordCheck(true);
+            keepVerified(R2, R1);
+            itersave = checkIter;
+            jsave = checkJ;
+            return true;
+        }
+        std::cout << "[Gerbicz Li] Mismatch \n"
+            << "[Gerbicz Li] Check FAILED! iter=" << checkIter << "\n"
+            << "[Gerbicz Li] Restore iter=" << itersave << " (j=" << jsave << ")\n";
+        j = jsave;
+        iter = itersave;
+        lastIter = iter;
+        if (iter == 0) {
+            iter = iter - 1;
+            j = j + 1;
+        }
+        checkpass = 0;
+        options.gerbicz_error_count += 1;
+        Metrics::gerbiczCheck(false);
+        recordCheck(false);
+        restoreVerified();
+        return false;
+    };
+
+    // LL has no Gerbicz-Li check: every -jacobi iterations R0 is copied to R2
+    // and read back, and its Jacobi symbol computed on a host thread while
+    // the iterations go on. A residue that passes is kept as the verified
+    // state of R4 (host slot 0), where a failure rolls back to.
+    std::unique_ptr<JacobiCheck> jacobi;
+    if (options.mode == "ll" && options.jacobi_interval != 0 && !options.wagstaff)
+        jacobi = std::make_unique<JacobiCheck>(q);
+    uint64_t jacobiGoodIter = resumeIter;
+    auto jacobiRollback = [&](const JacobiCheck::Result& res, uint64_t& iter, uint64_t& j) {
+        if (res.ok) {
+            std::cout << "[Jacobi] Check passed! iter=" << res.iter << "\n";
+            keepVerified(R2, R1);
+            jacobiGoodIter = res.iter;
+            return false;
+        }
+        std::cout << "[Jacobi] Check FAILED! iter=" << res.iter << "\n"
+                  << "[Jacobi] Restore iter=" << jacobiGoodIter << "\n";
+        restoreVerified();
+        iter = jacobiGoodIter - 1;
+        j = totalIters - jacobiGoodIter;
+        lastIter = jacobiGoodIter == 0 ? 0 : jacobiGoodIter - 1;
+        options.gerbicz_error_count += 1;
+        return true;
+    };
+
+    Metrics::setRun(p, totalIters, options.mode);
     for (uint64_t iter = resumeIter, j= totalIters-resumeIter-1; iter < totalIters; ++iter, --j) {
         lastJ = j;
         lastIter = iter;
         if (interrupted)
         {
-            const double elapsed_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_clock).count() + restored_time;
+            const auto stopStart = std::chrono::high_resolution_clock::now();
+            const double elapsed_time = std::chrono::duration<double>(stopStart - start_clock).count() + restored_time;
             save_ckpt(iter, elapsed_time);
+            const double stopSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - stopStart).count();
             delete eng;
-            std::cout << "\nInterrupted by user, state saved at iteration " << iter << " j=" << j << std::endl;
+            std::cout << "\nInterrupted by " << stopReason() << ", state saved at iteration " << iter << " j=" << j
+                      << " in " << std::fixed << std::setprecision(3) << stopSeconds << " s" << std::endl;
             logger.logEnd(elapsed_time);
             return 0;
         }
         auto now0 = std::chrono::high_resolution_clock::now();
 
-        if (now0 - lastBackup >= std::chrono::seconds(options.backup_interval))
+        if (now0 - lastBackup >= std::chrono::duration<double>(backupSeconds))
         {
             const double elapsed_time = std::chrono::duration<double>(now0 - start_clock).count() + restored_time;
-            save_ckpt(iter, elapsed_time);
+            save_ckpt(iter, elapsed_time, true);
             lastBackup = now0;
+            backupCadence->save();
+            backupSeconds = backupCadence->interval();
             spinner.displayBackupInfo(iter + 1, totalIters, timer.elapsed(), res64_x);
         }
-        eng->square_mul(R0);
         if (options.mode == "ll") {
-            eng->sub(R0, 2);
+            eng->square_sub(R0, 2);
+        } else {
+            eng->square_mul(R0);
         }
+        ++itersSinceCheck;
+        Metrics::iteration(iter + 1);
+        // res64 waits for the queue
+        if (gpuShare_) gpuShare_->yield([&] { (void)eng->res64(R0); });
 
         if (options.erroriter > 0 && (iter + 1) == options.erroriter && !errordone) {
             errordone = true;
@@ -664,15 +1468,33 @@ int App::runPrpOrLlMarin()
             std::cout << "Injected error at iteration " << (iter + 1) << std::endl;
         }
 
+        if (jacobi) {
+            util::TraceSpan jacobiSpan("jacobi_check");
+            // the last residue is checked before the result is derived from it
+            const bool last = iter + 1 == totalIters;
+            auto done = last ? jacobi->wait() : jacobi->poll();
+            if (done && jacobiRollback(*done, iter, j)) continue;
+            if (!jacobi->busy() && ((iter + 1) % options.jacobi_interval == 0 || last)) {
+                eng->copy(R2, R0);
+                jacobi->submit(iter + 1, pack_words_from_eng_digits(engine::digit(eng, R2), q));
+                if (last && (done = jacobi->wait()) && jacobiRollback(*done, iter, j)) continue;
+            }
+        }
+
         if (options.mode == "prp" && options.gerbiczli && ((j != 0 && (j % B == 0)) || iter == totalIters - 1)) {
-            checkpass += 1;
-            eng->copy(R3, R1);
-            eng->set_multiplicand(R2, R0);
-            eng->mul(R1, R2);
-            bool condcheck = !(checkpass != checkpasslevel && (iter != totalIters - 1));
-            
-            if (condcheck) {
+            util::TraceSpan glSpan("gerbicz_check");
+            // the verification queued at the previous block is due before R1 and R2 change
+            if (!checkPending || resolveCheck(iter, j)) {
+                checkpass += 1;
+                eng->copy(R3, R1);
+                eng->set_multiplicand(R2, R0);
+                eng->mul(R1, R2);
+                bool condcheck = !(checkpass != checkpasslevel && (iter != totalIters - 1));
+
+                if (condcheck) {
                     checkpass = 0;
+                    eng->copy(R2, R0);
+                    eng->begin_side();
                     for (uint64_t z = 0; z < B - (options.exponent % B) - 1; ++z) {
                         eng->square_mul(R3);
                     }
@@ -680,37 +1502,20 @@ int App::runPrpOrLlMarin()
                     for (uint64_t z = 0; z < (options.exponent % B); ++z) {
                         eng->square_mul(R3);
                     }
-                    if (!eng->is_equal(R3, R1)) 
-                    { 
-                        //delete eng; 
-                        //throw std::runtime_error("Gerbicz-Li error checking failed!"); 
-                        std::cout << "[Gerbicz Li] Mismatch \n"
-                            << "[Gerbicz Li] Check FAILED! iter=" << iter << "\n"
-                            << "[Gerbicz Li] Restore iter=" << itersave << " (j=" << jsave << ")\n";
-                        j = jsave;
-                        iter = itersave;
-                        lastIter = itersave;
-                        lastIter = iter;
-                        if (iter == 0) {
-                            iter = iter - 1;
-                            j = j + 1;
-                        }
-                        checkpass = 0;
-                        options.gerbicz_error_count += 1;
-                        eng->copy(R0, R4);
-                        eng->copy(R1, R5);
-                    }
-                    else{
-                        std::cout << "[Gerbicz Li] Check passed! iter=" << iter << "\n";
-                        eng->copy(R4, R0);//Last correct state
-                        eng->copy(R5, R1);//Last correct bufd
-                        itersave = iter;
-                        jsave = j;
-                        cl_event postEvt;
-                    }
+                    eng->end_side();
+                    checkPending = true;
+                    checkIter = iter;
+                    checkJ = j;
+                    if (iter == totalIters - 1) resolveCheck(iter, j);
+                }
             }
+        }
 
-        } 
+        if (options.res64_display_interval != 0 && ((iter + 1) % options.res64_display_interval) == 0) {
+            std::ostringstream oss;
+            oss << std::hex << std::setw(16) << std::setfill('0') << eng->res64(R0);
+            res64_x = oss.str();
+        }
 
         auto now = std::chrono::high_resolution_clock::now();
 
@@ -731,11 +1536,21 @@ int App::runPrpOrLlMarin()
             resumeIter = iter + 1;
         }
 
+        if (options.profile_interval != 0 && (iter + 1) % options.profile_interval == 0) dumpProfile(iter + 1);
+
         if (options.proof && (iter + 1) < totalIters && proofManagerMarin.shouldCheckpoint(iter+1)) {
             engine::digit d(eng, R0);
             proofManagerMarin.checkpointMarin(d, iter + 1);
         }
     }
+    if (gpuShare_) {
+        gpuShare_->release();
+        std::cout << "GPU share: waited " << std::fixed << std::setprecision(1) << gpuShare_->waited() << " s for the device" << std::endl;
+    }
+    ckptWriter.wait();
+
+    dumpProfile(totalIters);
+    prefetchNextJob();
 
     if (options.proof) {
         engine::digit d(eng, R0);
@@ -743,19 +1558,33 @@ int App::runPrpOrLlMarin()
     }
 
     bool is_prp_prime = false;
-    engine::digit digit(eng, R0);
-    std::vector<uint64_t> d = helperu(digit);
     if (options.mode == "ll") {
-        is_prp_prime = (digit.equal_to(0) || digit.equal_to_Mp());
+        is_prp_prime = (eng->equal_to(R0, 0) || eng->is_Mp(R0));
     }
     else{
-        is_prp_prime = digit.equal_to(9);
+        is_prp_prime = eng->equal_to(R0, 9);
+    }
+    engine::digit digit(eng, R0);
+    std::vector<uint64_t> d = helperu(digit);
+    std::vector<uint32_t> words = pack_words_from_eng_digits(digit, q);
+    // The res64 of a Wagstaff test is 3^(2^w) mod 2^w + 1 as it stands, 9
+    // for a PRP, whichever the transform: a cyclic run (resumed, or on the
+    // legacy kernels) reduces its residue mod 2^(2w) - 1 first. It is not
+    // divided by 9, which has no inverse: 3 divides 2^w + 1 for w odd. The
+    // residue of the negacyclic run is its top digit 2^w when it is 2^q = -1.
+    mpz_class rF;
+    if (options.wagstaff) {
+        const mpz_class Fp = (mpz_class(1) << (p / 2)) + 1;
+        const size_t top = digit.get_size() - 1;
+        if (!negacyclic) rF = util::convertToGMP(words) % Fp;
+        else rF = ((digit.val(top) >> digit.width(top)) != 0) ? mpz_class(Fp - 1) : util::convertToGMP(words);
+        words = util::convertFromGMP(rF);
+    } else if (options.mode == "prp") {
+        util::div9(p, words);
     }
-    std::vector<uint32_t> words = pack_words_from_eng_digits(digit, p);
-    if (options.mode == "prp") prp3_div9(p, words);
 
-    std::string res64_hex    = format_res64_hex(words);
-    std::string res2048_hex  = format_res2048_hex(words);
+    std::string res64_hex    = util::res64Hex(words);
+    std::string res2048_hex  = util::res2048Hex(words);
 
 
     
@@ -773,21 +1602,17 @@ int App::runPrpOrLlMarin()
     );
 
     if (options.wagstaff) {
-            mpz_class Mp = (mpz_class(1) << options.exponent) - 1;
-            mpz_class Fp = (mpz_class(1) << options.exponent/2) + 1;
-            mpz_class rM = util::vectToMpz(d,
-                                        precompute.getDigitWidth(),
-                                        Mp);
-            mpz_class rF = rM % Fp;
             bool isWagstaffPRP = (rF == 9);
             const double elapsed_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_clock).count() + restored_time;
             if (isWagstaffPRP) {
                 std::cout << "Wagstaff PRP confirmed: (2^"<< options.exponent/2 <<"+1)/3 is a probable prime.\n";
             } else {
-                std::cout << "Not a Wagstaff PRP.\n";
+                std::cout << "Not a Wagstaff PRP, res64 = " << res64_hex << ".\n";
             }
 
             logger.logEnd(elapsed_time);
+            delete_checkpoints(ckpt_file);
+            delete eng;
             return isWagstaffPRP ? 0 : 1;
     }
     
@@ -801,30 +1626,33 @@ int App::runPrpOrLlMarin()
     logger.logEnd(elapsed_time);
 
     if (options.proof) {
-        cl_command_queue queue   = context.getQueue();
-        math::Carry carry(
-            context,
-            queue,
-            program->getProgram(),
-            precompute.getN(),
-            precompute.getDigitWidth(),
-            buffers->digitWidthMaskBuf
-        );
         try {
             std::cout << "\nGenerating PRP proof file..." << std::endl;
-            auto proofFilePath = proofManager.proof(context, *nttEngine, carry);
+            // The tree runs on the marin engine; the test is over and d holds
+            // the final residue, so its registers are free.
+            auto proofFilePath = proofManagerMarin.proof(eng);
             options.proofFile = proofFilePath.string();  // Set proof file path
             std::cout << "Proof file saved: " << proofFilePath << std::endl;
+            session_.verifyProof(proofFilePath, proofVerifierEngine(options));
         } catch (const std::exception& e) {
             std::cerr << "Warning: Proof generation failed: " << e.what() << std::endl;
         }
     }
     
-    auto [isPrime, res64, res2048] = io::JsonBuilder::computeResultMarin(d, options);
+    // 3^(KF-1) for the cofactor check, on the engine: the host then only compares
+    std::vector<uint32_t> kfPower;
+    if (options.mode == "prp" && !options.knownFactors.empty()) {
+        const mpz_class e = math::Cofactor::knownFactorsProduct(options.knownFactors) - 1;
+        eng->set(R2, 1);
+        for (size_t i = mpz_sizeinbase(e.get_mpz_t(), 2); i-- > 0; )
+            eng->square_mul(R2, mpz_tstbit(e.get_mpz_t(), i) ? 3 : 1);
+        kfPower = pack_words_from_eng_digits(engine::digit(eng, R2), p);
+    }
+    auto [isPrime, res64, res2048] = io::JsonBuilder::computeResultMarin(d, options, kfPower);
     is_prp_prime = isPrime;
     std::string json = io::JsonBuilder::generate(
         options,
-        static_cast<int>(context.getTransformSize()),
+        static_cast<int>(precompute.getN()),
         isPrime,
         res64,
         res2048
@@ -861,14 +1689,7 @@ int App::runPrpOrLlMarin()
                 if (!noAsk && options.password.empty()) {
                     options.password = io::CurlClient::promptHiddenPassword();
                 }
-                bool success = io::CurlClient::sendManualResultWithLogin(
-                    json,
-                    options.user,
-                    options.password
-                );
-                if (!success) {
-                    std::cerr << "Submission to PrimeNet failed\n";
-                }
+                queueSubmission(json);
             }
         }
     }
@@ -877,30 +1698,12 @@ int App::runPrpOrLlMarin()
     io::WorktodoManager wm(options);
     wm.saveIndividualJson(options.exponent, options.mode, json);
     wm.appendToResultsTxt(json);
-    delete_checkpoints(p, options.wagstaff); 
+    delete_checkpoints(ckpt_file);
     backupManager.clearState();
     if (hasWorktodoEntry_) {
-        if (worktodoParser_->removeFirstProcessed()) {
-            std::cout << "Entry removed from " << options.worktodo_path
-                      << " and saved to worktodo_save.txt\n";
-            std::ifstream f(options.worktodo_path);
-            std::string l;
-            bool more = false;
-            while (std::getline(f, l)) {
-                if (!l.empty() && l[0] != '#') { more = true; break; }
-            }
-            f.close();
-            if (more) {
-                std::cout << "Restarting for next entry in worktodo.txt\n";
-                restart_self(argc_, argv_);
-            } else {
-                std::cout << "No more entries in worktodo.txt, exiting.\n";
-                std::exit(0);
-            }
-        } else {
-            std::cerr << "Failed to update " << options.worktodo_path << "\n";
-            std::exit(-1);
-        }
+        advanceWorktodo();
+        delete eng;
+        return 0;
     }
 
     delete eng;
@@ -926,7 +1729,8 @@ int App::runPrpOrLl() {
     }
 
 
-    std::vector<uint64_t> x(precompute.getN(), 0ULL);
+    util::HostPool::Lease xLease = util::HostPool::acquire(precompute.getN());
+    std::vector<uint64_t>& x = *xLease;
     uint64_t resumeIter = backupManager.loadState(x);
     if (resumeIter == 0) {
         x[0] = (options.mode == "prp") ? 3ULL : 4ULL;
@@ -936,12 +1740,8 @@ int App::runPrpOrLl() {
                     << " mode)" << std::endl;
         }
     }
-    buffers->input = clCreateBuffer(
-        context.getContext(),
-        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-        x.size() * sizeof(uint64_t),
-        x.data(), nullptr
-    );
+    if (!buffers->input)
+        buffers->input = buffers->arena.allocate("state", "input", x.size() * sizeof(uint64_t), x.data());
     std::cout << "Sampling 100 iterations for IPS estimation...\n";
     double sampleIps = measureIps(options.iterforce, 100);
     std::cout << "Estimated IPS: " << sampleIps << "\n";
@@ -949,14 +1749,7 @@ int App::runPrpOrLl() {
         tuneIterforce();
         return 0;
     }
-    clEnqueueWriteBuffer(
-            context.getQueue(),
-            buffers->input,
-            CL_TRUE, 0,
-            x.size() * sizeof(uint64_t),
-            x.data(),
-            0, nullptr, nullptr
-        );
+    context.getStaging().write(buffers->input, x.data(), x.size() * sizeof(uint64_t));
     
 
     math::Carry carry(
@@ -964,9 +1757,14 @@ int App::runPrpOrLl() {
         queue,
         program->getProgram(),
         precompute.getN(),
-        precompute.getDigitWidth(),
-        buffers->digitWidthMaskBuf
-    );
+        precompute.getDigitWidth());
+    nttEngine->bind(buffers->input);
+    if (options.cmdbuf) {
+        bool recorded = nttEngine->recordSquaring(buffers->input, carry);
+        if (options.debug)
+            std::cout << (recorded ? "Squaring iteration recorded in a command buffer"
+                                   : "Command buffers unavailable, using direct enqueue") << std::endl;
+    }
 
     // Display proof disk usage estimate at start of computation
     if (options.proof) {
@@ -986,6 +1784,10 @@ int App::runPrpOrLl() {
     auto lastDisplay = startTime;
     uint64_t lastIter = resumeIter;
     uint64_t startIter = resumeIter;
+    // the packed state, and the three Gerbicz-Li residues
+    auto backupCadence = makeBackupCadence(options, uint64_t((p + 31) / 32) * sizeof(uint32_t)
+                                                    * ((options.mode == "prp" && options.gerbiczli) ? 4 : 1));
+    double backupSeconds = backupCadence->interval();
     
     uint64_t L = options.exponent;
     uint64_t B = (uint64_t)(std::sqrt((double)L));
@@ -994,94 +1796,72 @@ int App::runPrpOrLl() {
     size_t limbBytes = limbs * sizeof(uint64_t);
     cl_int err;
     //cl_mem r2,save,bufd,buf3;
+    // With r2 and last_correct_bufd bound, the Gerbicz-Li check squares r2
+    // in place and a passing r2 becomes last_correct_bufd by a handle swap.
+    bool glRotate = false;
 
     if(options.mode=="prp" && options.gerbiczli){
         // See: An Efficient Modular Exponentiation Proof Scheme, 
         //§2, Darren Li, Yves Gallot, https://arxiv.org/abs/2209.15623
-        std::vector<uint64_t> hotsd(precompute.getN(), 0ULL);
+        util::HostPool::Lease hotsdLease = util::HostPool::acquire(precompute.getN());
+        std::vector<uint64_t>& hotsd = *hotsdLease;
         hotsd[0] = 1ULL;
         backupManager.loadGerbiczLiBufDState(hotsd);
     
-        buffers->bufd = clCreateBuffer(
-            context.getContext(),
-            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-            hotsd.size() * sizeof(uint64_t),
-            hotsd.data(),  &err
-        );
-        if (err != CL_SUCCESS) {
-            std::cerr << "Failed to allocate bufd: " << err << std::endl;
-            exit(1);
-        }
+        buffers->bufd = buffers->arena.allocate("gerbicz-li", "bufd", hotsd.size() * sizeof(uint64_t), hotsd.data());
         
         backupManager.loadGerbiczLiCorrectBufDState(hotsd);
         
-        buffers->last_correct_bufd = clCreateBuffer(
-            context.getContext(),
-            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-            hotsd.size() * sizeof(uint64_t),
-            hotsd.data(),  &err
-        );
-        if (err != CL_SUCCESS) {
-            std::cerr << "Failed to allocate last_correct_bufd: " << err << std::endl;
-            exit(1);
-        }
-        std::vector<uint64_t> hots3(precompute.getN(), 0ULL);
+        buffers->last_correct_bufd = buffers->arena.allocate("gerbicz-li", "last_correct_bufd", hotsd.size() * sizeof(uint64_t), hotsd.data());
+        util::HostPool::Lease hots3Lease = util::HostPool::acquire(precompute.getN());
+        std::vector<uint64_t>& hots3 = *hots3Lease;
         hots3[0] = 3ULL;
         
-        buffers->r2 = clCreateBuffer(
-            context.getContext(),
-            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-            hots3.size() * sizeof(uint64_t),
-            hots3.data(),  &err
-            );
-            if (err != CL_SUCCESS) {
-            std::cerr << "Failed to allocate r2: " << err << std::endl;
-            exit(1);
-        }
+        buffers->r2 = buffers->arena.allocate("gerbicz-li", "r2", hots3.size() * sizeof(uint64_t), hots3.data());
 
 
-        buffers->save = clCreateBuffer(
-            context.getContext(),
-            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-            hots3.size() * sizeof(uint64_t),
-            hots3.data(),  &err
-            );
-        if (err != CL_SUCCESS) {
-            std::cerr << "Failed to allocate save: " << err << std::endl;
-            exit(1);
-        }
+        buffers->save = buffers->arena.allocate("gerbicz-li", "save", hots3.size() * sizeof(uint64_t), hots3.data());
         
         backupManager.loadGerbiczLiCorrectState(hots3);
             
-        buffers->last_correct_state = clCreateBuffer(
-            context.getContext(),
-            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-            hots3.size() * sizeof(uint64_t),
-            hots3.data(),  &err
-        );
-        if (err != CL_SUCCESS) {
-            std::cerr << "Failed to allocate last_correct_state: " << err << std::endl;
-            exit(1);
-        }
+        buffers->last_correct_state = buffers->arena.allocate("gerbicz-li", "last_correct_state", hots3.size() * sizeof(uint64_t), hots3.data());
+        nttEngine->bind(buffers->bufd);
+        nttEngine->bind(buffers->save);
+        glRotate = nttEngine->bind(buffers->r2) && nttEngine->bind(buffers->last_correct_bufd);
+    }
+    // LL has no Gerbicz-Li check: every -jacobi iterations the residue is
+    // copied to jacobiSnap, read back without blocking and its Jacobi symbol
+    // computed on a host thread. A residue that passes becomes jacobiGood,
+    // where a failure rolls back to; the start state is the first one.
+    std::unique_ptr<JacobiCheck> jacobi;
+    if (options.mode == "ll" && options.jacobi_interval != 0 && !options.wagstaff) {
+        jacobi = std::make_unique<JacobiCheck>(static_cast<uint32_t>(p), precompute.getDigitWidth());
+        if (!buffers->jacobiSnap) buffers->jacobiSnap = buffers->arena.allocate("jacobi", "snapshot", limbBytes);
+        if (!buffers->jacobiGood) buffers->jacobiGood = buffers->arena.allocate("jacobi", "last_good", limbBytes);
+        context.getStaging().write(buffers->jacobiGood, x.data(), limbBytes);
+    }
+    buffers->arena.report(std::cout);
+    // the start state is on the device now
+    xLease.reset();
 
-        
-    }
-   
-    std::vector<uint64_t> hostR2(precompute.getN());
-   
     //gchk.init(buffers->input, resumeIter);
     bool errordone = false;
     //uint64_t checkpasslevel = (totalIters/B)/((uint64_t)(std::sqrt((double)B)));
 
-    double desiredIntervalSeconds = 600.0;
-    uint64_t checkpasslevel_auto = (uint64_t)((sampleIps * desiredIntervalSeconds) / (double)B);
-
-    if (checkpasslevel_auto == 0) checkpasslevel_auto = (totalIters/B)/((uint64_t)(std::sqrt((double)B)));
-
-    uint64_t checkpasslevel = (options.checklevel > 0)
-        ? options.checklevel
-        : checkpasslevel_auto;
-
+    CheckCadence cadence = makeCadence(options, context, B);
+    uint64_t checkpasslevel = cadence.level(sampleIps);
+    uint64_t itersSinceCheck = 0;
+    auto lastCheck = startTime;
+    // the squaring time the verification covered, and the speed it ran at
+    auto recordCheck = [&](bool ok) {
+        const auto t = high_resolution_clock::now();
+        const double seconds = std::chrono::duration<double>(t - lastCheck).count();
+        if (ok) cadence.passed(seconds); else cadence.failed(seconds);
+        cadence.save();
+        checkpasslevel = cadence.level(seconds > 0 ? double(itersSinceCheck) / seconds : sampleIps);
+        itersSinceCheck = 0;
+        lastCheck = t;
+    };
 
 
     uint64_t itersave =  backupManager.loadGerbiczIterSave();
@@ -1117,11 +1897,98 @@ int App::runPrpOrLl() {
             std::cerr << "Failed to allocate outIdxBuf: " << err << std::endl;
             exit(1);
     }
-    
+
+    // Res64 display: kernel_res64_display reduces the low 64 bits on the
+    // device and only those 8 bytes are read back, without blocking. The
+    // line is printed once the read has landed.
+    cl_mem res64Buf = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, 2 * sizeof(cl_uint), nullptr, &err);
+    if (err != CL_SUCCESS) {
+            std::cerr << "Failed to allocate res64Buf: " << err << std::endl;
+            exit(1);
+    }
+    cl_uint  res64Words[2] = {0, 0};
+    cl_event res64Evt      = nullptr;
+    uint64_t res64Iter     = 0;
+    auto printRes64 = [&](bool wait) {
+        if (res64Evt == nullptr) return;
+        if (wait) {
+            util::TraceSpan span("res64_wait");
+            clWaitForEvents(1, &res64Evt);
+        } else {
+            cl_int status = CL_QUEUED;
+            clGetEventInfo(res64Evt, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+            if (status != CL_COMPLETE) return;
+        }
+        clReleaseEvent(res64Evt);
+        res64Evt = nullptr;
+        std::ostringstream oss;
+        oss << std::hex << std::uppercase << std::setw(16) << std::setfill('0')
+            << ((uint64_t(res64Words[1]) << 32) | res64Words[0]);
+        std::cout << "Iter: " << res64Iter << "| Res64: " << oss.str() << std::endl;
+    };
+    auto requestRes64 = [&](uint64_t displayIter) {
+        printRes64(true);
+        kernels->runRes64Display(buffers->input, res64Buf);
+        // res64Buf is not written again before printRes64 has waited for it
+        context.readAfterCompute(res64Buf, 0, sizeof(res64Words), res64Words, &res64Evt);
+        res64Iter = displayIter;
+    };
+
+    std::vector<uint64_t> jacobiHost;
+    cl_event jacobiEvt  = nullptr;   // read of jacobiSnap, then the worker has it
+    uint64_t jacobiIter = 0;
+    uint64_t jacobiGoodIter = resumeIter;
+    auto jacobiBusy = [&]() { return jacobiEvt != nullptr || jacobi->busy(); };
+    auto jacobiSnapshot = [&](uint64_t snapIter) {
+        nttEngine->copy(buffers->input, buffers->jacobiSnap, limbBytes);
+        jacobiHost.assign(limbs, 0);
+        context.readAfterCompute(buffers->jacobiSnap, 0, limbBytes, jacobiHost.data(), &jacobiEvt);
+        jacobiIter = snapIter;
+    };
+    auto jacobiCollect = [&](bool wait) -> std::optional<JacobiCheck::Result> {
+        if (jacobiEvt != nullptr) {
+            if (wait) {
+                clWaitForEvents(1, &jacobiEvt);
+            } else {
+                cl_int status = CL_QUEUED;
+                clGetEventInfo(jacobiEvt, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+                if (status != CL_COMPLETE) return std::nullopt;
+            }
+            clReleaseEvent(jacobiEvt);
+            jacobiEvt = nullptr;
+            jacobi->submitDigits(jacobiIter, std::move(jacobiHost));
+        }
+        return wait ? jacobi->wait() : jacobi->poll();
+    };
+    // True when the run was rolled back to jacobiGoodIter: iter and j
+    // are then those of the iteration before it.
+    auto jacobiRollback = [&](const JacobiCheck::Result& res, uint64_t& iter, uint64_t& j) {
+        if (res.ok) {
+            std::cout << "[Jacobi] Check passed! iter=" << res.iter << "\n";
+            // jacobiSnap is not written again before the next snapshot
+            nttEngine->copy(buffers->jacobiSnap, buffers->jacobiGood, limbBytes);
+            jacobiGoodIter = res.iter;
+            return false;
+        }
+        std::cout << "[Jacobi] Check FAILED! iter=" << res.iter << "\n"
+                  << "[Jacobi] Restore iter=" << jacobiGoodIter << "\n";
+        nttEngine->copy(buffers->jacobiGood, buffers->input, limbBytes);
+        iter = jacobiGoodIter - 1;
+        j = totalIters - jacobiGoodIter;
+        lastIter = jacobiGoodIter == 0 ? 0 : jacobiGoodIter - 1;
+        options.gerbicz_error_count += 1;
+        return true;
+    };
+
+    // Keeps a bounded number of iterations queued (at most -iterforce)
+    // instead of draining the queue with a blocking read.
+    opencl::QueueThrottle throttle(context.getQueue(), options.iterforce);
+    Metrics::setRun(p, totalIters, options.mode);
     
     for (uint64_t iter = resumeIter, j= totalIters-resumeIter-1; iter < totalIters && !interrupted; ++iter, --j) {
         lastJ = j;
         lastIter = iter;
+        ++itersSinceCheck;
         if (options.erroriter > 0 && iter + 1 == options.erroriter && !errordone) {
             errordone = true;
             uint64_t limb0;
@@ -1140,124 +2007,27 @@ int App::runPrpOrLl() {
                 CL_TRUE, 0,
                 sizeof(uint64_t),
                 &limb0,
-                0, nullptr, nullptr
-            );
-            std::cout << "Injected error at iteration " << (iter + 1) << std::endl;
-        }
-        
-        queued += nttEngine->forward(buffers->input, iter);
-        queued += nttEngine->inverse(buffers->input, iter);
-        carry.carryGPU(
-            buffers->input,
-            buffers->blockCarryBuf,
-            precompute.getN() * sizeof(uint64_t)
-        );
-        queued += 2;
-        
-        if ((options.res64_display_interval != 0)&& ( ((iter+1) % options.res64_display_interval) == 0 )) {
-
-            std::vector<uint64_t> hostData(precompute.getN());
-            std::string res64_x;  
-
-            {
-                clEnqueueReadBuffer(
-                    context.getQueue(),
-                    buffers->input,
-                    CL_TRUE, 0,
-                    hostData.size() * sizeof(uint64_t),
-                    hostData.data(),
-                    0, nullptr, nullptr
-                );
-
-                
-                bool debug = false;
-                if(debug){
-                    for (size_t i = 0; i < hostData.size(); ++i)
-                    {
-                        std::cout << hostData[i] << " ";
-                    }
-                    std::cout << std::endl;
-                }
-                {
-                    auto dataCopy       = hostData;
-                    auto elapsed        = timer.elapsed();
-                    auto transformSize  = static_cast<int>(context.getTransformSize());
-                    auto optsCopy       = options;
-                    auto digitWidth     = precompute.getDigitWidth();
-                    auto iterCopy       = iter;
-
-                    std::thread([dataCopy, optsCopy, digitWidth, elapsed, transformSize, iterCopy]() {
-                        auto localRes64 = io::JsonBuilder::computeRes64Iter(
-                            dataCopy,
-                            optsCopy,
-                            digitWidth,
-                            elapsed,
-                            transformSize
-                        );
-                        std::cout << "Iter: " << iterCopy + 1 << "| Res64: " << localRes64 << std::endl;
-                    }).detach();
-                }
-
-
-            }    
-        }
-        auto now = high_resolution_clock::now();
-          
-        if ((options.iterforce > 0 && (iter+1)%options.iterforce == 0 && iter>0) || (((iter+1)%options.iterforce == 0))) { 
-            
-            if((iter+1)%1000000000 != 0){
-                char dummy;
-                clEnqueueReadBuffer(
-                        context.getQueue(),
-                        buffers->input,
-                        CL_TRUE, 0,
-                        sizeof(dummy),
-                        &dummy,
-                        0, nullptr, nullptr
-                    );
-            }
-            else{
-                std::vector<uint64_t> hostData(precompute.getN());
-                std::string res64_x;  
-                clEnqueueReadBuffer(
-                    context.getQueue(),
-                    buffers->input,
-                    CL_TRUE, 0,
-                    hostData.size() * sizeof(uint64_t),
-                    hostData.data(),
-                    0, nullptr, nullptr
-                );
-
-                
-                bool debug = false;
-                if(debug){
-                    for (size_t i = 0; i < hostData.size(); ++i)
-                    {
-                        std::cout << hostData[i] << " ";
-                    }
-                    std::cout << std::endl;
-                }
-                {
-                    auto dataCopy       = hostData;
-                    auto elapsed        = timer.elapsed();
-                    auto transformSize  = static_cast<int>(context.getTransformSize());
-                    auto optsCopy       = options;
-                    auto digitWidth     = precompute.getDigitWidth();
-                    auto iterCopy       = iter;
-
-                    std::thread([dataCopy, optsCopy, digitWidth, elapsed, transformSize, iterCopy]() {
-                        auto localRes64 = io::JsonBuilder::computeRes64Iter(
-                            dataCopy,
-                            optsCopy,
-                            digitWidth,
-                            elapsed,
-                            transformSize
-                        );
-                        std::cout << "Iter: " << iterCopy + 1 << "| Res64: " << localRes64 << std::endl;
-                    }).detach();
-                }
-
-
+                0, nullptr, nullptr
+            );
+            std::cout << "Injected error at iteration " << (iter + 1) << std::endl;
+        }
+        
+        queued += nttEngine->squareIteration(buffers->input, carry, iter);
+        
+        if ((options.res64_display_interval != 0)&& ( ((iter+1) % options.res64_display_interval) == 0 )) {
+            requestRes64(iter + 1);
+        }
+        printRes64(false);
+        auto now = high_resolution_clock::now();
+          
+        throttle.tick();
+        Metrics::iteration(iter + 1);
+        Metrics::queueDepth(throttle.pending());
+        if (gpuShare_) gpuShare_->yield([&] { throttle.drain(); });
+        if ((options.iterforce > 0 && (iter+1)%options.iterforce == 0 && iter>0) || (((iter+1)%options.iterforce == 0))) { 
+            
+            if((iter+1)%1000000000 == 0){
+                requestRes64(iter + 1);
             } 
             
             
@@ -1283,21 +2053,38 @@ int App::runPrpOrLl() {
         }
         
         
-        if (options.mode == "ll") {
+        if (options.mode == "ll" && !llSubInCarry(options, precompute)) {
             kernels->runSub2(buffers->input);
         }
 
+        if (jacobi) {
+            util::TraceSpan jacobiSpan("jacobi_check");
+            // the last residue is checked before the result is derived from it
+            const bool last = iter + 1 == totalIters;
+            auto done = jacobiCollect(last);
+            if (done && jacobiRollback(*done, iter, j)) continue;
+            if (!jacobiBusy() && ((iter + 1) % options.jacobi_interval == 0 || last)) {
+                jacobiSnapshot(iter + 1);
+                if (last && (done = jacobiCollect(true)) && jacobiRollback(*done, iter, j)) continue;
+            }
+        }
+
+        if (auto* prof = context.getProfiler();
+            prof && options.profiling && options.profile_interval != 0 && (iter + 1) % options.profile_interval == 0) {
+            prof->report(std::cout, "at iteration " + std::to_string(iter + 1));
+        }
 
         if (options.proof && iter + 1 < totalIters) {
             proofManager.checkpoint(buffers->input, iter + 1);
         }
 
         if (options.mode == "prp" && options.gerbiczli && ((j != 0 && (j % B == 0)) || iter == totalIters - 1)) {
+            util::TraceSpan glSpan("gerbicz_check");
             // See: An Efficient Modular Exponentiation Proof Scheme, 
             //§2, Darren Li, Yves Gallot, https://arxiv.org/abs/2209.15623
             auto printLine = [&](cl_mem& bufz, const std::string& name) {
                 std::vector<uint64_t> buf(precompute.getN());
-                clEnqueueReadBuffer(context.getQueue(), bufz, CL_TRUE, 0, limbBytes, buf.data(), 0, nullptr, nullptr);
+                context.getStaging().read(bufz, buf.data(), limbBytes);
                 std::ostringstream oss;
                 oss << name << ": ";
                 for (size_t idx = 0; idx < buf.size(); ++idx) {
@@ -1309,41 +2096,28 @@ int App::runPrpOrLl() {
 
             checkpass += 1;
             bool condcheck = !(checkpass != checkpasslevel && (iter != totalIters - 1));
-            nttEngine->copy(buffers->input, buffers->save, limbBytes);
             if (condcheck) nttEngine->copy(buffers->bufd, buffers->r2, limbBytes);
-            nttEngine->forward_simple(buffers->bufd, 0);
-            nttEngine->forward_simple(buffers->save, 0);
-            nttEngine->pointwiseMul(buffers->bufd, buffers->save);
-            nttEngine->inverse_simple(buffers->bufd, 0);
-            carry.carryGPU(buffers->bufd, buffers->blockCarryBuf, limbBytes);
+            // bufd *= input, save is the scratch for the transform of input
+            nttEngine->mulAccumulate(buffers->bufd, buffers->input, buffers->save, carry);
 
             if (condcheck) {
-                nttEngine->copy(buffers->input, buffers->save, limbBytes);
-
                 checkpass = 0;
-                nttEngine->copy(buffers->r2, buffers->input, limbBytes);
+                cl_mem chk = buffers->r2;
+                if (!glRotate) {
+                    nttEngine->copy(buffers->input, buffers->save, limbBytes);
+                    nttEngine->copy(buffers->r2, buffers->input, limbBytes);
+                    chk = buffers->input;
+                }
                 for (uint64_t z = 0; z < B - (options.exponent % B); ++z) {
-                    nttEngine->forward(buffers->input, iter);
-                    nttEngine->inverse(buffers->input, iter);
-                    carry.carryGPU(
-                        buffers->input,
-                        buffers->blockCarryBuf,
-                        precompute.getN() * sizeof(uint64_t)
-                    );
+                    nttEngine->squareIteration(chk, carry, iter);
                 }
                 carry.carryGPU3(
-                    buffers->input,
+                    chk,
                     buffers->blockCarryBuf,
                     precompute.getN() * sizeof(uint64_t)
                 );
                 for (uint64_t z = 0; z < (options.exponent % B); ++z) {
-                    nttEngine->forward(buffers->input, iter);
-                    nttEngine->inverse(buffers->input, iter);
-                    carry.carryGPU(
-                        buffers->input,
-                        buffers->blockCarryBuf,
-                        precompute.getN() * sizeof(uint64_t)
-                    );
+                    nttEngine->squareIteration(chk, carry, iter);
                 }
 
                 cl_uint ok = 1u;
@@ -1351,7 +2125,7 @@ int App::runPrpOrLl() {
                 
                 kernels->runCheckEqual(
                     buffers->bufd,
-                    buffers->input,
+                    chk,
                     outOkBuf,
                     static_cast<cl_uint>(precompute.getN())
                 );
@@ -1362,9 +2136,17 @@ int App::runPrpOrLl() {
 
                 if (ok == 1u) {
                     std::cout << "[Gerbicz Li] Check passed! iter=" << iter << "\n";
-                    nttEngine->copy(buffers->save, buffers->input, limbBytes);
-                    nttEngine->copy(buffers->save, buffers->last_correct_state, limbBytes);
-                    nttEngine->copy(buffers->bufd, buffers->last_correct_bufd, limbBytes);
+                    Metrics::gerbiczCheck(true);
+                    recordCheck(true);
+                    if (glRotate) {
+                        nttEngine->copy(buffers->input, buffers->last_correct_state, limbBytes);
+                        // r2 == bufd digit for digit: it is the new last correct bufd
+                        std::swap(buffers->r2, buffers->last_correct_bufd);
+                    } else {
+                        nttEngine->copy(buffers->save, buffers->input, limbBytes);
+                        nttEngine->copy(buffers->save, buffers->last_correct_state, limbBytes);
+                        nttEngine->copy(buffers->bufd, buffers->last_correct_bufd, limbBytes);
+                    }
                     itersave = iter;
                     jsave = j;
                     cl_event postEvt;
@@ -1384,6 +2166,8 @@ int App::runPrpOrLl() {
                     }
                     checkpass = 0;
                     options.gerbicz_error_count += 1;
+                    Metrics::gerbiczCheck(false);
+                    recordCheck(false);
                     nttEngine->copy(buffers->last_correct_state, buffers->input, limbBytes);
                     nttEngine->copy(buffers->last_correct_bufd, buffers->bufd, limbBytes);
                     cl_event postEvt;
@@ -1396,32 +2180,27 @@ int App::runPrpOrLl() {
 
 
 
-        if ((now - lastBackup >= seconds(options.backup_interval))) {
+        if ((now - lastBackup >= duration<double>(backupSeconds))) {
                 std::string res64_x;
-                backupManager.saveState(buffers->input, iter);
-                backupManager.saveGerbiczLiState(buffers->last_correct_state ,buffers->bufd,buffers->last_correct_bufd , itersave, jsave);
+                backupManager.saveCheckpointAsync(buffers->input, iter,
+                                                  buffers->last_correct_state, buffers->bufd, buffers->last_correct_bufd,
+                                                  itersave, jsave);
                 lastBackup = now;
+                backupCadence->save();
+                backupSeconds = backupCadence->interval();
                 double backupElapsed = timer.elapsed();
-                std::vector<uint64_t> hostData(precompute.getN());
-                clEnqueueReadBuffer(
-                    context.getQueue(),
-                    buffers->input,
-                    CL_TRUE, 0,
-                    hostData.size() * sizeof(uint64_t),
-                    hostData.data(),
-                    0, nullptr, nullptr
-                );
+                util::HostPool::Lease hostData = util::HostPool::acquire(precompute.getN(), false);
+                context.getStaging().read(buffers->input, hostData.data(), hostData.size() * sizeof(uint64_t));
                 {
-                    auto dataCopy       = hostData;
                     auto elapsed        = timer.elapsed();
                     auto transformSize  = static_cast<int>(context.getTransformSize());
                     auto optsCopy       = options;
                     auto digitWidth     = precompute.getDigitWidth();
                     auto iterCopy       = iter;
 
-                    std::thread([dataCopy, optsCopy, digitWidth, elapsed, transformSize, iterCopy]() {
+                    std::thread([data = std::move(hostData), optsCopy, digitWidth, elapsed, transformSize, iterCopy]() {
                         auto localRes64 = io::JsonBuilder::computeRes64Iter(
-                            dataCopy,
+                            *data,
                             optsCopy,
                             digitWidth,
                             elapsed,
@@ -1441,18 +2220,37 @@ int App::runPrpOrLl() {
         
 
     }
+    if (gpuShare_) {
+        gpuShare_->release();
+        std::cout << "GPU share: waited " << std::fixed << std::setprecision(1) << gpuShare_->waited() << " s for the device" << std::endl;
+    }
+    printRes64(true);
+    if (jacobiEvt != nullptr) {
+        // jacobiHost is still the target of the read
+        clWaitForEvents(1, &jacobiEvt);
+        clReleaseEvent(jacobiEvt);
+    }
+    if (auto* prof = context.getProfiler(); prof && options.profiling) prof->report(std::cout, "at exit (" + std::to_string(lastIter + 1) + " iterations)");
     if (outOkBuf != nullptr)  clReleaseMemObject(outOkBuf);
     if (outIdxBuf != nullptr) clReleaseMemObject(outIdxBuf);
+    if (res64Buf != nullptr)  clReleaseMemObject(res64Buf);
 
     if (interrupted) {
-        std::cout << "\nInterrupted signal received\n " << std::endl;
+        // the loop stopped between two iterations: what is queued ends on a
+        // state the checkpoint can hold, and only the buffers of the run are
+        // read back and packed (the state alone for LL)
+        const auto stopStart = high_resolution_clock::now();
+        std::cout << "\nInterrupted signal received (" << stopReason() << ")\n " << std::endl;
         clFinish(queue);
         queued = 0;
-        backupManager.saveState(buffers->input, lastIter);
-        backupManager.saveGerbiczLiState(buffers->last_correct_state ,buffers->bufd,buffers->last_correct_bufd , itersave, jsave);
+        backupManager.saveCheckpoint(buffers->input, lastIter,
+                                     buffers->last_correct_state, buffers->bufd, buffers->last_correct_bufd,
+                                     itersave, jsave);
+        const double stopSeconds = std::chrono::duration<double>(high_resolution_clock::now() - stopStart).count();
         
-        std::cout << "\nInterrupted by user, state saved at iteration "
-                  << lastIter << " last j = " << lastJ << std::endl;
+        std::cout << "\nInterrupted by " << stopReason() << ", state saved at iteration "
+                  << lastIter << " last j = " << lastJ << " in "
+                  << std::fixed << std::setprecision(3) << stopSeconds << " s" << std::endl;
         
         return 0;
     }
@@ -1460,20 +2258,15 @@ int App::runPrpOrLl() {
         clFinish(queue);
         queued = 0;
     }
-    std::vector<uint64_t> hostData(precompute.getN());
+    prefetchNextJob();
+    util::HostPool::Lease hostLease = util::HostPool::acquire(precompute.getN(), false);
+    std::vector<uint64_t>& hostData = *hostLease;
     std::string res64_x;  
     
 
 
     {
-        clEnqueueReadBuffer(
-            context.getQueue(),
-            buffers->input,
-            CL_TRUE, 0,
-            hostData.size() * sizeof(uint64_t),
-            hostData.data(),
-            0, nullptr, nullptr
-        );
+        context.getStaging().read(buffers->input, hostData.data(), hostData.size() * sizeof(uint64_t));
 
          
         carry.handleFinalCarry(hostData,
@@ -1510,20 +2303,15 @@ int App::runPrpOrLl() {
             if (isWagstaffPRP) {
                 std::cout << "Wagstaff PRP confirmed: (2^"<< options.exponent/2 <<"+1)/3 is a probable prime.\n";
             } else {
-                std::cout << "Not a Wagstaff PRP.\n";
+                // the res64 of the marin path, 3^(2^w) mod 2^w + 1
+                std::cout << "Not a Wagstaff PRP, res64 = " << util::res64Hex(util::convertFromGMP(rF)) << ".\n";
             }
 
+            backupManager.clearState();
             return isWagstaffPRP ? 0 : 1;
         }
 
-        clEnqueueWriteBuffer(
-            context.getQueue(),
-            buffers->input,
-            CL_TRUE, 0,
-            hostData.size() * sizeof(uint64_t),
-            hostData.data(),
-            0, nullptr, nullptr
-        );
+        context.getStaging().write(buffers->input, hostData.data(), hostData.size() * sizeof(uint64_t));
 
         // Checkpoint the final result at iteration totalIters (after all p iterations are complete)
         if (options.proof) {
@@ -1556,8 +2344,9 @@ int App::runPrpOrLl() {
                         startIter,
                         res64_x
                     );
-        backupManager.saveState(buffers->input, lastIter);
-        backupManager.saveGerbiczLiState(buffers->last_correct_state ,buffers->bufd,buffers->last_correct_bufd , itersave, jsave);
+        backupManager.saveCheckpoint(buffers->input, lastIter,
+                                     buffers->last_correct_state, buffers->bufd, buffers->last_correct_bufd,
+                                     itersave, jsave);
         
                 
     }
@@ -1569,9 +2358,10 @@ int App::runPrpOrLl() {
     if (options.proof) {
         try {
             std::cout << "\nGenerating PRP proof file..." << std::endl;
-            auto proofFilePath = proofManager.proof(context, *nttEngine, carry);
+            auto proofFilePath = proofManager.proof(context, *nttEngine, carry, false);
             options.proofFile = proofFilePath.string();  // Set proof file path
             std::cout << "Proof file saved: " << proofFilePath << std::endl;
+            session_.verifyProof(proofFilePath, proofVerifierEngine(options));
         } catch (const std::exception& e) {
             std::cerr << "Warning: Proof generation failed: " << e.what() << std::endl;
         }
@@ -1582,17 +2372,25 @@ int App::runPrpOrLl() {
     logger.logEnd(finalElapsed);
 
     std::vector<uint64_t> hostResult(precompute.getN());
-    clEnqueueReadBuffer(
-        context.getQueue(),
-        buffers->input,
-        CL_TRUE, 0,
-        hostResult.size() * sizeof(uint64_t),
-        hostResult.data(),
-        0, nullptr, nullptr
-    );
-
-
-    auto [isPrime, res64, res2048] = io::JsonBuilder::computeResult(hostResult, options, precompute.getDigitWidth());
+    context.getStaging().read(buffers->input, hostResult.data(), hostResult.size() * sizeof(uint64_t));
+
+
+    // 3^(KF-1) for the cofactor check, on the GPU from the now free input buffer
+    std::vector<uint32_t> kfPower;
+    if (options.mode == "prp" && !options.knownFactors.empty()) {
+        const mpz_class e = math::Cofactor::knownFactorsProduct(options.knownFactors) - 1;
+        const size_t bytes = hostResult.size() * sizeof(uint64_t);
+        std::vector<uint64_t> x(hostResult.size(), 0);
+        x[0] = 1;
+        context.getStaging().write(buffers->input, x.data(), bytes);
+        for (size_t i = mpz_sizeinbase(e.get_mpz_t(), 2); i-- > 0; ) {
+            nttEngine->squareIteration(buffers->input, carry, 0);
+            if (mpz_tstbit(e.get_mpz_t(), i)) carry.carryGPU3(buffers->input, buffers->blockCarryBuf, bytes);
+        }
+        context.getStaging().read(buffers->input, x.data(), bytes);
+        kfPower = util::packResidue(x, precompute.getDigitWidth(), static_cast<uint32_t>(options.exponent));
+    }
+    auto [isPrime, res64, res2048] = io::JsonBuilder::computeResult(hostResult, options, precompute.getDigitWidth(), kfPower);
 
     std::string json = io::JsonBuilder::generate(
         options,
@@ -1640,14 +2438,7 @@ int App::runPrpOrLl() {
                     options.password = io::CurlClient::promptHiddenPassword();
                 }
 
-                bool success = io::CurlClient::sendManualResultWithLogin(
-                    json,
-                    options.user,
-                    options.password
-                );
-                if (!success) {
-                    std::cerr << "Submission to PrimeNet failed\n";
-                }
+                queueSubmission(json);
             }
         }
     }
@@ -1659,32 +2450,8 @@ int App::runPrpOrLl() {
     wm.appendToResultsTxt(json);
 
     if (hasWorktodoEntry_) {
-        if (worktodoParser_->removeFirstProcessed()) {
-            std::cout << "Entry removed from " << options.worktodo_path
-                      << " and saved to worktodo_save.txt\n";
-
-            std::ifstream f(options.worktodo_path);
-            std::string    l;
-            bool           more = false;
-            while (std::getline(f, l)) {
-                if (!l.empty() && l[0] != '#') {
-                    more = true;
-                    break;
-                }
-            }
-            f.close();
-
-            if (more) {
-                std::cout << "Restarting for next entry in worktodo.txt\n";
-                restart_self(argc_, argv_);
-            } else {
-                std::cout << "No more entries in worktodo.txt, exiting.\n";
-                std::exit(0);
-            }
-        } else {
-            std::cerr << "Failed to update " << options.worktodo_path << "\n";
-            std::exit(-1);
-        }
+        advanceWorktodo();
+        return 0;
     }
 
 
@@ -1695,84 +2462,89 @@ int App::runPrpOrLl() {
 
 
 
+// Product of v[lo, hi) as a balanced tree, so both operands of every
+// multiplication have about the same size and GMP can use its FFT product.
+static mpz_class productTree(const std::vector<mpz_class>& v, size_t lo, size_t hi) {
+    if (hi == lo) return 1;
+    if (hi - lo == 1) return v[lo];
+    const size_t mid = lo + (hi - lo) / 2;
+    return productTree(v, lo, mid) * productTree(v, mid, hi);
+}
+
+// E = the product of the largest powers of the primes <= B1 not above B1.
+// The segmented sieve hands the primes out in order; their powers are
+// packed into 64-bit leaves, and each thread multiplies a contiguous run of
+// leaves as a product tree before the partial products are combined
+// pairwise, one level at a time, on the same threads.
 mpz_class buildE(uint64_t B1) {
     using clock = std::chrono::steady_clock;
     auto t0 = clock::now(), last = t0;
+    auto status = [&](int pct, bool force = false) {
+        const auto now = clock::now();
+        if (!force && now - last < std::chrono::milliseconds(500)) return;
+        const double prog = pct / 100.0;
+        const double eta = prog > 0 ? std::chrono::duration<double>(now - t0).count() * (1.0 - prog) / prog : 0.0;
+        const long sec = long(eta + 0.5);
+        const int h = int(sec / 3600), m = int((sec % 3600) / 60), sc = int(sec % 60);
+        std::cout << "\rBuilding E: " << std::setw(3) << pct << "%  ETA "
+                  << std::setw(2) << std::setfill('0') << h << ':'
+                  << std::setw(2) << m << ':'
+                  << std::setw(2) << sc << std::setfill(' ')
+                  << std::flush;
+        last = now;
+    };
 
-    std::vector<uint8_t> sieve((B1 >> 1) + 1, 1);
-    std::vector<uint64_t> primes;
-    primes.reserve(B1 ? B1 / std::log(double(B1)) : 1);
-    for (uint64_t i = 3; i <= B1; i += 2) {
-        if (sieve[i >> 1]) {
-            primes.push_back(i);
-            if (uint64_t ii = uint64_t(i) * i; ii <= B1)
-                for (uint64_t j = ii; j <= B1; j += (i << 1))
-                    sieve[j >> 1] = 0;
+    std::vector<mpz_class> leaves;
+    leaves.reserve(B1 ? static_cast<size_t>(B1 / std::log(double(B1)) / 3) + 1 : 1);
+    auto pushLeaf = [&](uint64_t v) {
+        mpz_class z;
+        mpz_import(z.get_mpz_t(), 1, 1, sizeof(v), 0, 0, &v);
+        leaves.push_back(std::move(z));
+    };
+    std::cout << "Building E:   0%  ETA  --:--:--" << std::flush;
+    uint64_t acc = 1;
+    if (B1 >= 2) {
+        math::PrimeSieve sieve(2, B1);
+        for (uint64_t q = sieve.next(); q != 0 && !interrupted; q = sieve.next()) {
+            uint64_t pw = q;
+            while (pw <= B1 / q) pw *= q;
+            if (acc > UINT64_MAX / pw) { pushLeaf(acc); acc = 1; }
+            acc *= pw;
+            if ((leaves.size() & 1023) == 0) status(int(q * 90 / B1));
         }
     }
+    pushLeaf(acc);
 
-    size_t total = primes.size();
-    std::atomic<size_t> next{0}, done{0};
     unsigned th = std::thread::hardware_concurrency();
     if (!th) th = 4;
-    std::vector<mpz_class> part(th, 1);
-    std::vector<std::thread> workers;
-
-    for (unsigned t = 0; t < th; ++t)
-        workers.emplace_back([&, t] {
-            while (true) {
-                size_t idx = next.fetch_add(1);
-                if (idx >= total) break;
-                uint64_t p = primes[idx];
-                mpz_class pw;
-                mpz_set_ui(pw.get_mpz_t(), static_cast<unsigned long>(p));
-                unsigned long lim1 = static_cast<unsigned long>(B1 / p);
-                mpz_class limit(lim1);
-                //while (pw <= limit) pw *= mpz_class(p);
-                while (pw <= limit) pw *= mpz_class(static_cast<unsigned long>(p));
-                part[t] *= pw;
-                done.fetch_add(1, std::memory_order_relaxed);
-                if (interrupted) return;
-            }
-        });
-
-    mpz_class E = 1;
-    mpz_class pw2 = 2;
-    unsigned long lim2 = static_cast<unsigned long>(B1 / 2);
-    mpz_class limit2(lim2);
-    while (pw2 <= limit2) pw2 *= 2;
-    E *= pw2;
-
-    std::cout << "Building E:   0%  ETA  --:--:--" << std::flush;
-    while (done.load() < total && !interrupted) {
-        auto now = clock::now();
-        if (now - last >= std::chrono::milliseconds(500)) {
-            double prog = double(done.load()) / total;
-            double eta = prog ? std::chrono::duration<double>(now - t0).count() * (1.0 - prog) / prog : 0.0;
-            long sec = long(eta + 0.5);
-            int h = int(sec / 3600), m = int((sec % 3600) / 60), s = int(sec % 60);
-            std::cout << "\rBuilding E: " << std::setw(3) << int(prog * 100)
-                      << "%  ETA "
-                      << std::setw(2) << std::setfill('0') << h << ':'
-                      << std::setw(2) << m << ':'
-                      << std::setw(2) << s << std::setfill(' ')
-                      << std::flush;
-            last = now;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    }
+    th = static_cast<unsigned>(std::min<size_t>(th, leaves.size()));
+    std::vector<mpz_class> part(th);
+    {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < th; ++t)
+            workers.emplace_back([&, t] {
+                part[t] = productTree(leaves, leaves.size() * t / th, leaves.size() * (t + 1) / th);
+            });
+        for (auto& w : workers) w.join();
+    }
+    leaves.clear();
+    status(95, true);
+    while (part.size() > 1) {
+        std::vector<mpz_class> next((part.size() + 1) / 2);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i + 1 < part.size(); i += 2)
+            workers.emplace_back([&, i] { next[i / 2] = part[i] * part[i + 1]; });
+        if (part.size() & 1) next.back() = std::move(part.back());
+        for (auto& w : workers) w.join();
+        part.swap(next);
+    }
+    mpz_class E = std::move(part[0]);
 
-    for (auto &w : workers) w.join();
-    for (auto &p : part) E *= p;
     if (interrupted) {
         std::cout << "\n\nInterrupted signal received — using partial E computed so far.\n\n";
-        for (auto &w : workers)
-            if (w.joinable()) w.join();
-
-        for (auto &p : part) E *= p;
         mp_bitcnt_t bits = mpz_sizeinbase(E.get_mpz_t(), 2);
         std::cout << "\nlog2(E) ≈ " << bits << " bits" << std::endl;
-        interrupted = false; 
+        interrupted = false;
         return E;
     }
 
@@ -1783,10 +2555,19 @@ mpz_class buildE(uint64_t B1) {
 
 
 
-static unsigned long evenGapBound(const mpz_class& B2) {
-    double ln = std::log(mpz_get_d(B2.get_mpz_t()));
-    double bound = std::ceil((ln * ln) / 2.0);
-    return bound < 2 ? 1 : static_cast<unsigned long>(bound);
+// Pairing modulus for P-1 stage 2: the largest primorial whose prime factors
+// are all <= B1 (so every stage 2 prime is coprime to it), no larger than
+// sqrt(2*(B2-B1)) so the baby table stays cheap next to the giant steps, and
+// whose baby table fits in maxEntries buffers. D = 2 needs a single entry.
+static uint64_t pm1Stage2Modulus(uint64_t B1, uint64_t B2, uint64_t maxEntries) {
+    // {D, largest prime factor, baby table size}
+    static const uint64_t cand[][3] = {{2310, 11, 240}, {210, 7, 24}, {30, 5, 4}, {6, 3, 1}};
+    const double balance = std::sqrt(2.0 * static_cast<double>(B2 - B1));
+    for (const auto& c : cand) {
+        if (c[1] > B1 || static_cast<double>(c[0]) > balance || c[2] > maxEntries) continue;
+        return c[0];
+    }
+    return 2;
 }
 
 static size_t primeCountApprox(const mpz_class& low, const mpz_class& high) {
@@ -1802,197 +2583,305 @@ static size_t primeCountApprox(const mpz_class& low, const mpz_class& high) {
 
 
 
-int App::runPM1Stage2() {
+int App::runPM1Stage2(const std::function<bool()>& stop) {
     using namespace std::chrono;
-    bool debug = false;
     mpz_class B1(static_cast<unsigned long>(options.B1));
     mpz_class B2(static_cast<unsigned long>(options.B2));
     if (B2 <= B1) { std::cerr << "Stage 2 error B2 < B1.\n"; return -1; }
 
-    if (debug) std::cout << "[DEBUG] Stage 2 Bounds: B1 = " << B1 << ", B2 = " << B2 << std::endl;
     std::cout << "\nStart a P-1 factoring : Stage 2 Bounds: B1 = " << B1 << ", B2 = " << B2 << std::endl;
 
-    unsigned long nbEven = evenGapBound(B2);
     size_t limbs = precompute.getN();
     size_t limbBytes = limbs * sizeof(uint64_t);
+    const std::vector<int>& widths = precompute.getDigitWidth();
 
     cl_int err;
-    buffers->Hbuf = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
+    auto newBuffer = [&]() {
+        cl_mem b = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
+        if (err != CL_SUCCESS) throw std::runtime_error("Failed to create stage 2 buffer");
+        return b;
+    };
+    buffers->Hbuf = buffers->arena.allocate("pm1-stage2", "Hbuf", limbBytes);
     clEnqueueCopyBuffer(context.getQueue(), buffers->input, buffers->Hbuf, 0, 0, limbBytes, 0, nullptr, nullptr);
 
     math::Carry carry(context, context.getQueue(), program->getProgram(),
-                      precompute.getN(), precompute.getDigitWidth(), buffers->digitWidthMaskBuf);
+                      precompute.getN(), precompute.getDigitWidth());
     mpz_class Mp = (mpz_class(1) << options.exponent) - 1;
 
-    buffers->evenPow.resize(nbEven, nullptr);
-    std::cout << "Stage 2: Will precompute " << nbEven << " powers of H^2, H^.." << "." << std::endl;
-
-    nttEngine->forward(buffers->input, 0);
-    nttEngine->inverse(buffers->input, 0);
-    carry.carryGPU(buffers->input, buffers->blockCarryBuf, limbBytes);
-
-    buffers->evenPow[0] = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
-    nttEngine->copy(buffers->input, buffers->evenPow[0], limbBytes);
-    auto ensureEvenPow = [&](unsigned long needIdx) {
-        while (buffers->evenPow.size() <= needIdx) {
-            size_t kPrev = buffers->evenPow.size() - 1;
-            cl_mem buf = clCreateBuffer(context.getContext(),
-                                        CL_MEM_READ_WRITE,
-                                        limbBytes, nullptr, &err);
-
-            nttEngine->copy(buffers->evenPow[kPrev], buf, limbBytes);
-            nttEngine->mulInPlace(buf, buffers->evenPow[0], carry, limbBytes);
-            buffers->evenPow.push_back(buf);
+    buffers->Qbuf = buffers->arena.allocate("pm1-stage2", "Qbuf", limbBytes);
+    std::vector<uint64_t> one(limbs, 0ULL); one[0] = 1ULL;
+    context.getStaging().write(buffers->Qbuf, one.data(), limbBytes);
+
+    // Every stage 2 prime is written q = kD + r with -D/2 <= r < D/2 and
+    // gcd(|r|, D) = 1. With G_k = H^(kD) + H^(-kD) and B_j = H^j + H^(-j),
+    // H^q = 1 (mod f) gives G_k = B_|r| (mod f), so one product
+    // Q *= G_k - B_j covers both kD - j and kD + j.
+    std::vector<uint64_t> hostH(limbs);
+    context.getStaging().read(buffers->Hbuf, hostH.data(), limbBytes);
+    carry.handleFinalCarry(hostH, widths);
+    mpz_class H = util::vectToMpz(hostH, widths, Mp);
+    mpz_class Hinv;
+    if (mpz_invert(Hinv.get_mpz_t(), H.get_mpz_t(), Mp.get_mpz_t()) == 0) {
+        // gcd(H, Mp) != 1: the factor is already there, Q = H hands it to the gcd.
+        std::cout << "Stage 2: H is not invertible mod Mp, going straight to the gcd" << std::endl;
+        nttEngine->copy(buffers->Hbuf, buffers->Qbuf, limbBytes);
+    } else {
+        // The baby table lives in one slab carved into sub-buffers, sized from
+        // -stage2mem (or 80% of the -vram budget) minus the stage 2 working
+        // set, and bounded by the largest single allocation.
+        cl_ulong globalMem = 0, maxAlloc = 0;
+        cl_uint alignBits = 0;
+        clGetDeviceInfo(context.getDevice(), CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMem), &globalMem, nullptr);
+        clGetDeviceInfo(context.getDevice(), CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, nullptr);
+        clGetDeviceInfo(context.getDevice(), CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(alignBits), &alignBits, nullptr);
+        if (buffers->arena.budget()) globalMem = std::min<cl_ulong>(globalMem, buffers->arena.budget());
+        uint64_t budget = globalMem / 10 * 8;
+        if (options.stage2_mem_mb > 0) {
+            budget = options.stage2_mem_mb << 20;
+            if (globalMem && budget > globalMem) budget = globalMem;
         }
-    };
-    int pct = -1;
-    std::cout << "Precomputing H powers: 0%" << std::flush;
-    for (unsigned long k = 1; k < nbEven; ++k) {
-        buffers->evenPow[k] = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
-        nttEngine->copy(buffers->evenPow[k - 1], buffers->evenPow[k], limbBytes);
-        nttEngine->mulInPlace(buffers->evenPow[k], buffers->evenPow[0], carry, limbBytes);
-        
-        int newPct = int((k + 1) * 100 / nbEven);
-        if (newPct > pct) { pct = newPct; std::cout << "\rPrecomputing H powers: " << pct << "%" << std::flush; }
-    }
-    for (unsigned long k = 0; k < nbEven; ++k) {
-        
-        nttEngine->copy(buffers->evenPow[k], buffers->input, limbBytes);
-        nttEngine->forward_simple(buffers->input,0);
-        nttEngine->copy(buffers->input, buffers->evenPow[k], limbBytes);
-        
-    }
-
-    std::cout << "\rPrecomputing H powers: 100%" << std::endl;
-   
-
-    buffers->Hq = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
-    nttEngine->copy(buffers->Hbuf, buffers->input, limbBytes);
-
-    mpz_class p_prev;
-    mpz_class p;
-    mpz_nextprime(p_prev.get_mpz_t(), B1.get_mpz_t());
-    p = p_prev;
-
-    size_t bitlen = mpz_sizeinbase(p.get_mpz_t(), 2);
-    for (int64_t i = static_cast<int64_t>(bitlen) - 2; i >= 0; --i) {
-        nttEngine->forward(buffers->input, 0);
-        nttEngine->inverse(buffers->input, 0);
-        carry.carryGPU(buffers->input, buffers->blockCarryBuf, limbBytes);
-        if (mpz_tstbit(p.get_mpz_t(), i)) {
-            nttEngine->mulInPlace(buffers->input, buffers->Hbuf, carry, limbBytes);
+        const uint64_t working = 12 * static_cast<uint64_t>(limbBytes);
+        const uint64_t align = std::max<uint64_t>(alignBits / 8, 1);
+        const uint64_t stride = (limbBytes + align - 1) / align * align;
+        uint64_t capacity = budget > working ? (budget - working) / stride : 0;
+        if (maxAlloc) capacity = std::min<uint64_t>(capacity, maxAlloc / stride);
+        if (capacity == 0) {
+            std::cerr << "Warning: stage 2 memory budget of " << (budget >> 20)
+                      << " MiB is below the working set, using a single baby step" << std::endl;
         }
-    }
-    nttEngine->copy(buffers->input, buffers->Hq, limbBytes);
-
-    buffers->Qbuf = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
-    std::vector<uint64_t> one(limbs, 0ULL); one[0] = 1ULL;
-    clEnqueueWriteBuffer(context.getQueue(), buffers->Qbuf, CL_TRUE, 0, limbBytes, one.data(), 0, nullptr, nullptr);
-
-    buffers->tmp = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
-
-    size_t     idx     = 0;
-    //uint64_t resumeIdx = 0;
-    uint64_t resumeIdx = backupManager.loadStatePM1S2(buffers->Hq, buffers->Qbuf, limbBytes);
-
-    mpz_nextprime(p_prev.get_mpz_t(), B1.get_mpz_t());
-    p = p_prev;
-    idx = 0;
-    for (; idx < resumeIdx; ++idx) {
-        p_prev = p;
-        mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
-    }
-
-
-    std::cout << "\r[DEBUG] p_prev=" << p_prev << std::endl;
-    std::cout << "\r[DEBUG] p=" << p << std::endl;
-    std::cout << "\r[DEBUG] idx=" << idx << std::endl;
-    
-    
-    size_t totalPrimes = primeCountApprox(B1, B2);
-
-    timer.start(); timer2.start();
-    auto start = high_resolution_clock::now();
-    auto lastDisplay = start;
-    auto lastBackup  = start;
-
-    for (; p <= B2; ++idx) {
-        if (idx) {
-            mpz_class d = p - p_prev;
-            unsigned long idxGap = mpz_get_ui(d.get_mpz_t()) / 2 - 1;
-            ensureEvenPow(idxGap);
-            
-            nttEngine->forward_simple(buffers->Hq, 0);
-            nttEngine->pointwiseMul(buffers->Hq, buffers->evenPow[idxGap]);
-            nttEngine->inverse_simple(buffers->Hq, 0);
-            carry.carryGPU(buffers->Hq, buffers->blockCarryBuf, limbBytes);
-            
+        const uint64_t D = pm1Stage2Modulus(options.B1, options.B2, capacity);
+        std::vector<int> babyIndex(D / 2 + 1, -1);
+        size_t nbBaby = 0;
+        for (uint64_t j = 1; j <= D / 2; ++j) {
+            if (std::gcd(j, D) == 1) babyIndex[j] = static_cast<int>(nbBaby++);
         }
 
-        nttEngine->copy(buffers->Hq, buffers->tmp, limbBytes);
-        nttEngine->subOne(buffers->tmp);
-        nttEngine->forward_simple(buffers->tmp, 0);
-        nttEngine->forward_simple(buffers->Qbuf, 0);
-        nttEngine->pointwiseMul(buffers->Qbuf, buffers->tmp);
-        nttEngine->inverse_simple(buffers->Qbuf, 0);
-        carry.carryGPU(buffers->Qbuf, buffers->blockCarryBuf, limbBytes);
-        
-        auto now = high_resolution_clock::now();
-        if (duration_cast<seconds>(now - lastDisplay).count() >= 3) {
-            double done = static_cast<double>(idx + 1);
-            double doneSinceResume = static_cast<double>(idx + 1 - resumeIdx);
-            double percent = totalPrimes ? done / static_cast<double>(totalPrimes) * 100.0 : 0.0;
-            double elapsedSec = duration<double>(now - start).count();
-            double ips = doneSinceResume > 0 ? doneSinceResume / elapsedSec : 0.0;
-
-            double remaining = totalPrimes > done ? static_cast<double>(totalPrimes) - done : 0.0;
-            double etaSec = ips > 0.0 ? remaining / ips : 0.0;
-            int days = static_cast<int>(etaSec) / 86400;
-            int hours = (static_cast<int>(etaSec) % 86400) / 3600;
-            int minutes = (static_cast<int>(etaSec) % 3600) / 60;
-            int seconds = static_cast<int>(etaSec) % 60;
-            std::cout << "Progress: " << std::fixed << std::setprecision(2) << percent << "% | "
-                      << "prime: " << p.get_ui() << " | "
-                      << "Iter: " << (idx + 1) << " | "
-                      << "Elapsed: " << std::fixed << std::setprecision(2) << elapsedSec << "s | "
-                      << "IPS: " << std::fixed << std::setprecision(2) << ips << " | "
-                      << "ETA: " << days << "d " << hours << "h " << minutes << "m " << seconds << "s\r"
-                      << std::endl;
-            lastDisplay = now;
+        // With a bit to spare over the squaring bound, G + (Mp - B_j) goes
+        // into Q uncarried: the table holds Mp - B_j transformed, G is
+        // transformed once per giant step, and a product costs Q's forward
+        // and inverse transforms around one pointwise kernel.
+        const int maxWidth = *std::max_element(widths.begin(), widths.end());
+        const bool hatTable = std::log2(static_cast<long double>(limbs)) + 2.0L * maxWidth + 1 < 64.0L;
+
+        hostH = util::mpzToVect(Hinv, widths);
+        cl_mem hInv = newBuffer();
+        context.getStaging().write(hInv, hostH.data(), limbBytes);
+
+        // up / down walk H^j and H^-j over odd j by the pretransformed H^2 and
+        // H^-2; they are reused for the giant step below.
+        cl_mem up = newBuffer();
+        cl_mem down = newBuffer();
+        nttEngine->bind(up);
+        nttEngine->bind(down);
+        nttEngine->copy(buffers->Hbuf, up, limbBytes);
+        nttEngine->squareInPlace(up, carry, limbBytes);
+        cl_mem h2Hat = nttEngine->pretransform(up, limbBytes);
+        nttEngine->copy(hInv, down, limbBytes);
+        nttEngine->squareInPlace(down, carry, limbBytes);
+        cl_mem hm2Hat = nttEngine->pretransform(down, limbBytes);
+        nttEngine->copy(buffers->Hbuf, up, limbBytes);
+        nttEngine->copy(hInv, down, limbBytes);
+
+        std::cout << "Stage 2: D = " << D << ", will precompute " << nbBaby << " baby steps H^j + H^-j ("
+                  << ((nbBaby * stride) >> 20) << " of " << (budget >> 20) << " MiB)." << std::endl;
+        buffers->babySlab = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE, nbBaby * stride, nullptr, &err);
+        if (err != CL_SUCCESS) throw std::runtime_error("Failed to create stage 2 table slab");
+        buffers->babyPow.assign(nbBaby, nullptr);
+        cl_mem babyTmp = hatTable ? newBuffer() : nullptr;
+        int pct = -1;
+        std::cout << "Precomputing H powers: 0%" << std::flush;
+        for (uint64_t j = 1; j <= D / 2; j += 2) {
+            if (j > 1) {
+                nttEngine->mulByTransformed(up, h2Hat, carry, limbBytes);
+                nttEngine->mulByTransformed(down, hm2Hat, carry, limbBytes);
+            }
+            const int bi = babyIndex[j];
+            if (bi < 0) continue;
+            cl_buffer_region region{ static_cast<size_t>(bi * stride), limbBytes };
+            buffers->babyPow[bi] = clCreateSubBuffer(buffers->babySlab, CL_MEM_READ_WRITE,
+                                                     CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+            if (err != CL_SUCCESS) throw std::runtime_error("Failed to create stage 2 table entry");
+            if (hatTable) {
+                nttEngine->copy(up, babyTmp, limbBytes);
+                nttEngine->add(babyTmp, down);
+                carry.carryGPU(babyTmp, buffers->blockCarryBuf, limbBytes);
+                const cl_ulong zero = 0;
+                clEnqueueFillBuffer(context.getQueue(), buffers->babyPow[bi], &zero, sizeof(zero), 0, limbBytes, 0, nullptr, nullptr);
+                nttEngine->subMod(buffers->babyPow[bi], babyTmp);
+                carry.carryGPU(buffers->babyPow[bi], buffers->blockCarryBuf, limbBytes);
+                nttEngine->forward_simple(buffers->babyPow[bi], 0);
+            } else {
+                nttEngine->copy(up, buffers->babyPow[bi], limbBytes);
+                nttEngine->add(buffers->babyPow[bi], down);
+                carry.carryGPU(buffers->babyPow[bi], buffers->blockCarryBuf, limbBytes);
+            }
+
+            int newPct = int((bi + 1) * 100 / nbBaby);
+            if (newPct > pct) { pct = newPct; std::cout << "\rPrecomputing H powers: " << pct << "%" << std::flush; }
         }
-        /*if (duration_cast<seconds>(now - lastBackup).count() >= 180) {
-            backupManager.saveStatePM1S2(Hq, Qbuf, idx, limbBytes);
-            lastBackup = now;
-        }*/
-        if (options.iterforce2 > 0 && (idx + 1) % options.iterforce2 == 0) {
-            char dummy;
-            clEnqueueReadBuffer(context.getQueue(), buffers->input, CL_TRUE, 0, sizeof(dummy), &dummy, 0, nullptr, nullptr);
+        std::cout << "\rPrecomputing H powers: 100%" << std::endl;
+        if (babyTmp) clReleaseMemObject(babyTmp);
+        clReleaseMemObject(h2Hat);
+        clReleaseMemObject(hm2Hat);
+
+        // Giant step: G advances by the pretransformed H^D and H^-D.
+        nttEngine->powInPlace(up, buffers->Hbuf, D, carry, limbBytes);
+        cl_mem stepHat = nttEngine->pretransform(up, limbBytes);
+        nttEngine->powInPlace(down, hInv, D, carry, limbBytes);
+        cl_mem stepInvHat = nttEngine->pretransform(down, limbBytes);
+
+        buffers->Hq  = buffers->arena.allocate("pm1-stage2", "Hq", limbBytes);
+        buffers->tmp = buffers->arena.allocate("pm1-stage2", "tmp", limbBytes);
+        nttEngine->bind(buffers->Hq);
+        nttEngine->bind(buffers->Qbuf);
+        nttEngine->bind(buffers->tmp);
+
+        // The checkpoint holds Q and the bound below which every prime is
+        // already folded in; the giant step is rebuilt from it, so the
+        // resumed run may even pick another D.
+        uint64_t resumeP = backupManager.loadStatePM1S2(buffers->Hq, buffers->Qbuf, limbBytes);
+        if (resumeP > 0 && resumeP <= options.B1) {
+            std::cerr << "Warning: ignoring stage 2 checkpoint at p = " << resumeP
+                      << " below B1" << std::endl;
+            resumeP = 0;
+            context.getStaging().write(buffers->Qbuf, one.data(), limbBytes);
         }
+        math::PrimeSieve sieve(resumeP > 0 ? resumeP : options.B1 + 1, options.B2);
+        uint64_t p = sieve.next();
+        const uint64_t kLast = (options.B2 + D / 2) / D;
+        const uint64_t k0    = p ? (p + D / 2) / D : kLast + 1;
+        nttEngine->powInPlace(buffers->Hq, up, k0, carry, limbBytes);
+        nttEngine->powInPlace(down, down, k0, carry, limbBytes);
+
+        cl_mem& Gp = buffers->Hq;
+        cl_mem& Gm = down;
+        cl_mem& giant = up;
+        auto releaseStage2 = [&]() {
+            nttEngine->unbind(up);
+            nttEngine->unbind(down);
+            clReleaseMemObject(stepHat);
+            clReleaseMemObject(stepInvHat);
+            clReleaseMemObject(up);
+            clReleaseMemObject(down);
+            clReleaseMemObject(hInv);
+        };
 
+        size_t totalPrimes = primeCountApprox(B1, B2);
+        size_t donePrimes = resumeP > 0 ? primeCountApprox(B1, mpz_class(static_cast<unsigned long>(resumeP))) : 0;
+        const size_t resumePrimes = donePrimes;
+        uint64_t products = 0;
+        std::vector<uint8_t> hit(nbBaby);
+
+        timer.start(); timer2.start();
+        auto start = high_resolution_clock::now();
+        auto lastDisplay = start, lastBackup = start;
+        // at most -iterforce2 giant steps queued
+        opencl::QueueThrottle throttle(context.getQueue(), options.iterforce2);
+        Metrics::setRun(options.exponent, kLast, "pm1_stage2");
+
+        for (uint64_t k = k0; k <= kLast; ++k) {
+            const uint64_t kD = k * D;
+            std::fill(hit.begin(), hit.end(), 0);
+            bool any = false;
+            while (p != 0 && p < kD + D / 2) {
+                // bi < 0 only for a prime dividing D, which is <= B1
+                const int bi = babyIndex[p >= kD ? p - kD : kD - p];
+                if (bi >= 0) { hit[bi] = 1; any = true; }
+                ++donePrimes;
+                p = sieve.next();
+            }
 
-        p_prev = p;
-        mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
-        /*if (interrupted) {
-            clFinish(context.getQueue());
-            backupManager.saveStatePM1S2(Hq, Qbuf, idx, limbBytes);
-            std::cout << "\r[DEBUG] p_prev=" << p_prev << std::endl;
-            std::cout << "\r[DEBUG] p=" << p << std::endl;
-             std::cout << "\r[DEBUG] idx=" << idx << std::endl;
-            return 0;
-        }*/
-        if (interrupted) {
-            clFinish(context.getQueue());
-            backupManager.saveStatePM1S2(buffers->Hq, buffers->Qbuf, idx, limbBytes);
-            return 0;
+            if (any) {
+                nttEngine->copy(Gp, giant, limbBytes);
+                nttEngine->add(giant, Gm);
+                carry.carryGPU(giant, buffers->blockCarryBuf, limbBytes);
+                if (hatTable) nttEngine->forward_simple(giant, 0);
+                for (size_t i = 0; i < nbBaby; ++i) {
+                    if (!hit[i]) continue;
+                    if (hatTable) {
+                        nttEngine->forward_simple(buffers->Qbuf, 0);
+                        nttEngine->pointwiseAddMul(buffers->Qbuf, giant, buffers->babyPow[i]);
+                        nttEngine->inverse_simple(buffers->Qbuf, 0);
+                        carry.carryGPU(buffers->Qbuf, buffers->blockCarryBuf, limbBytes);
+                        ++products;
+                        continue;
+                    }
+                    nttEngine->copy(giant, buffers->tmp, limbBytes);
+                    nttEngine->subMod(buffers->tmp, buffers->babyPow[i]);
+                    carry.carryGPU(buffers->tmp, buffers->blockCarryBuf, limbBytes);
+                    nttEngine->forward_simple(buffers->tmp, 0);
+                    nttEngine->forward_simple(buffers->Qbuf, 0);
+                    nttEngine->pointwiseMul(buffers->Qbuf, buffers->tmp);
+                    nttEngine->inverse_simple(buffers->Qbuf, 0);
+                    carry.carryGPU(buffers->Qbuf, buffers->blockCarryBuf, limbBytes);
+                    ++products;
+                }
+            }
+            nttEngine->mulByTransformed(Gp, stepHat, carry, limbBytes);
+            nttEngine->mulByTransformed(Gm, stepInvHat, carry, limbBytes);
+
+            auto now = high_resolution_clock::now();
+            if (duration_cast<seconds>(now - lastDisplay).count() >= 3) {
+                double done = static_cast<double>(donePrimes);
+                double doneSinceResume = static_cast<double>(donePrimes - resumePrimes);
+                double percent = totalPrimes ? done / static_cast<double>(totalPrimes) * 100.0 : 0.0;
+                double elapsedSec = duration<double>(now - start).count();
+                double ips = doneSinceResume > 0 ? doneSinceResume / elapsedSec : 0.0;
+
+                double remaining = totalPrimes > done ? static_cast<double>(totalPrimes) - done : 0.0;
+                double etaSec = ips > 0.0 ? remaining / ips : 0.0;
+                int days = static_cast<int>(etaSec) / 86400;
+                int hours = (static_cast<int>(etaSec) % 86400) / 3600;
+                int minutes = (static_cast<int>(etaSec) % 3600) / 60;
+                int seconds = static_cast<int>(etaSec) % 60;
+                std::cout << "Progress: " << std::fixed << std::setprecision(2) << percent << "% | "
+                          << "prime: " << p << " | "
+                          << "Giant step: " << k << "/" << kLast << " | "
+                          << "Products: " << products << " | "
+                          << "Elapsed: " << std::fixed << std::setprecision(2) << elapsedSec << "s | "
+                          << "IPS: " << std::fixed << std::setprecision(2) << ips << " | "
+                          << "ETA: " << days << "d " << hours << "h " << minutes << "m " << seconds << "s\r"
+                          << std::endl;
+                lastDisplay = now;
+            }
+            throttle.tick();
+            Metrics::iteration(k);
+            Metrics::queueDepth(throttle.pending());
+            if (interrupted) {
+                clFinish(context.getQueue());
+                backupManager.saveStatePM1S2(Gp, buffers->Qbuf, kD + D / 2, limbBytes);
+                releaseStage2();
+                return 0;
+            }
+            if (stop && stop()) {
+                clFinish(context.getQueue());
+                std::cout << "\nStage 2 stopped at p = " << kD + D / 2 << ", stage 1 found a factor" << std::endl;
+                releaseStage2();
+                backupManager.clearStatePM1S2();
+                return 0;
+            }
+            // every prime below kD + D/2 is in Q now; the snapshot is queued
+            // behind this giant step and written while the next ones run
+            if (now - lastBackup >= seconds(options.backup_interval)) {
+                backupManager.saveStatePM1S2Async(Gp, buffers->Qbuf, kD + D / 2, limbBytes);
+                lastBackup = now;
+            }
         }
-
+        std::cout << "Stage 2: " << donePrimes << " primes folded in " << products << " products" << std::endl;
+        releaseStage2();
     }
 
     std::vector<uint64_t> hostQ(limbs);
-    clEnqueueReadBuffer(context.getQueue(), buffers->Qbuf, CL_TRUE, 0, limbBytes, hostQ.data(), 0, nullptr, nullptr);
+    context.getStaging().read(buffers->Qbuf, hostQ.data(), limbBytes);
     carry.handleFinalCarry(hostQ, precompute.getDigitWidth());
     mpz_class Q = util::vectToMpz(hostQ, precompute.getDigitWidth(), Mp);
-    mpz_class g; mpz_gcd(g.get_mpz_t(), Q.get_mpz_t(), Mp.get_mpz_t());
+    // the gcd runs while the last checkpoint is waited for and removed
+    std::future<mpz_class> gcd = std::async(std::launch::async, [&Q, &Mp] {
+        mpz_class g; mpz_gcd(g.get_mpz_t(), Q.get_mpz_t(), Mp.get_mpz_t());
+        return g;
+    });
+    backupManager.clearStatePM1S2();
+    const mpz_class g = gcd.get();
     bool found = g != 1 && g != Mp;
     std::string filename = "stage2_result_B2_" + B2.get_str() +
                         "_p_" + std::to_string(options.exponent) + ".txt";
@@ -2045,9 +2934,10 @@ int App::runPM1() {
         x[0] = 1ULL;
         resumeIter = bits;
     }
-    buffers->input = clCreateBuffer(context.getContext(), CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, x.size() * sizeof(uint64_t), x.data(), nullptr);
+    buffers->input = buffers->arena.allocate("state", "input", x.size() * sizeof(uint64_t), x.data());
+    buffers->arena.report(std::cout);
 
-    math::Carry carry(context, context.getQueue(), program->getProgram(), precompute.getN(), precompute.getDigitWidth(), buffers->digitWidthMaskBuf);
+    math::Carry carry(context, context.getQueue(), program->getProgram(), precompute.getN(), precompute.getDigitWidth());
 
 
     timer.start();
@@ -2069,6 +2959,9 @@ int App::runPM1() {
                     resumeIter,
                     ""
                 );
+    // at most -iterforce iterations queued
+    opencl::QueueThrottle throttle(context.getQueue(), options.iterforce);
+    Metrics::setRun(options.exponent, bits, "pm1");
     for (mp_bitcnt_t i = resumeIter; i > 0; --i) {
         lastIter = i;
         if (interrupted) {
@@ -2082,37 +2975,18 @@ int App::runPM1() {
         }
         nttEngine->forward(buffers->input, 0);
         nttEngine->inverse(buffers->input, 0);
-        carry.carryGPU(buffers->input, buffers->blockCarryBuf, precompute.getN() * sizeof(uint64_t));
-
-
-
-        if (mpz_tstbit(E.get_mpz_t(), i - 1)) {
+        // a set bit of E: kernel_carry_mul_3 carries the square and scales it by 3
+        if (mpz_tstbit(E.get_mpz_t(), i - 1))
             carry.carryGPU3(buffers->input, buffers->blockCarryBuf, precompute.getN() * sizeof(uint64_t));
-            
-        }
-        if ((options.iterforce > 0 && (i+1)%options.iterforce == 0 && i>0) || (((i+1)%options.iterforce == 0))) { 
-            
-            //if((i+1)%100000 != 0){
-
-                char dummy;
-                clEnqueueReadBuffer(
-                        context.getQueue(),
-                        buffers->input,
-                        CL_TRUE, 0,
-                        sizeof(dummy),
-                        &dummy,
-                        0, nullptr, nullptr
-                    );
-                
-            
-            //}
-
-            
-        }
+        else
+            carry.carryGPU(buffers->input, buffers->blockCarryBuf, precompute.getN() * sizeof(uint64_t));
+        throttle.tick();
+        Metrics::iteration(bits - i + 1);
+        Metrics::queueDepth(throttle.pending());
         
         auto now = high_resolution_clock::now();
         if ((((now - lastDisplay >= seconds(180)))) ) {
-                    backupManager.saveState(buffers->input, lastIter-1);
+                    backupManager.saveStateAsync(buffers->input, lastIter-1);
         }
         if ((((now - lastDisplay >= seconds(10)))) ) {
                 std::string res64_x;
@@ -2148,13 +3022,12 @@ int App::runPM1() {
         res64_x
     );
     backupManager.saveState(buffers->input, lastIter, &E);
+    prefetchNextJob();
     
     std::cout << "\nStart get result from GPU" << std::endl;
     std::vector<uint64_t> hostData(precompute.getN());
 
-    clEnqueueReadBuffer(context.getQueue(), buffers->input, CL_TRUE, 0,
-                        hostData.size() * sizeof(uint64_t), hostData.data(),
-                        0, nullptr, nullptr);
+    context.getStaging().read(buffers->input, hostData.data(), hostData.size() * sizeof(uint64_t));
     std::cout << "Handle final carry start" << std::endl;
 
     carry.handleFinalCarry(hostData, precompute.getDigitWidth());
@@ -2169,59 +3042,46 @@ int App::runPM1() {
 
     X -= 1;
 
-    mpz_class g;
-    mpz_gcd(g.get_mpz_t(), X.get_mpz_t(), Mp.get_mpz_t());
-
-
-/*
-    mpz_t Mp;  mpz_init(Mp);
-    mpz_ui_pow_ui(Mp, 2, options.exponent);
-    mpz_sub_ui(Mp, Mp, 1);
-
-    mpz_t r;   mpz_init(r);
-    vectToResidue(r, hostData, precompute.getDigitWidth(), Mp);
-    std::cout << "\n GCD start\n" << std::endl;
-
-    mpz_sub_ui(r, r, 1);
-    mpz_t g;   mpz_init(g);
-    mpz_gcd(g, r, Mp);*/
-
-    //gmp_printf("GCD(x - 1, 2^%u - 1) = %Zd\n", options.exponent, g);
-
-    bool factorFound = g != 1 && g != Mp;
+    // The stage 1 gcd runs on its own thread while stage 2 precomputes and
+    // accumulates; stage 2 is stopped as soon as it shows a factor.
+    std::future<mpz_class> gcd = std::async(std::launch::async, [X, Mp] {
+        mpz_class g;
+        mpz_gcd(g.get_mpz_t(), X.get_mpz_t(), Mp.get_mpz_t());
+        return g;
+    });
 
     std::string filename = "stage1_result_B1_" + std::to_string(B1) +
                         "_p_" + std::to_string(options.exponent) + ".txt";
-
-    if (factorFound) {
-        char* fstr = mpz_get_str(nullptr, 10, g.get_mpz_t());
-        writeStageResult(filename, "B1=" + std::to_string(B1) + "  factor=" + std::string(fstr));
-        std::free(fstr);
-    } else {
-        writeStageResult(filename, "No factor up to B1=" + std::to_string(B1));
-    }
-
-
-    if (factorFound) {
-        char* fstr = mpz_get_str(nullptr, 10, g.get_mpz_t());
-        std::cout << "\nP-1 factor stage 1 found: " << fstr << std::endl;
-        options.knownFactors.push_back(std::string(fstr));
-        std::free(fstr);
-        std::cout << "\n";
-        if(options.B2>0){
-            runPM1Stage2();
-        }
-//        else{
-            //backupManager.clearState();
-//        }
-        //return 0;
-    }
-    else{
-        std::cout << "\nNo P-1 (stage 1) factor up to B1=" << B1 << "\n" << std::endl;
-        if(options.B2>0){
-            runPM1Stage2();
+    bool factorFound = false;
+    auto reportStage1 = [&]() {
+        const mpz_class g = gcd.get();
+        factorFound = g != 1 && g != Mp;
+        if (factorFound) {
+            char* fstr = mpz_get_str(nullptr, 10, g.get_mpz_t());
+            writeStageResult(filename, "B1=" + std::to_string(B1) + "  factor=" + std::string(fstr));
+            std::cout << "\nP-1 factor stage 1 found: " << fstr << std::endl;
+            options.knownFactors.push_back(std::string(fstr));
+            std::free(fstr);
+            std::cout << "\n";
+        } else {
+            writeStageResult(filename, "No factor up to B1=" + std::to_string(B1));
+            std::cout << "\nNo P-1 (stage 1) factor up to B1=" << B1 << "\n" << std::endl;
         }
+    };
+
+    if (options.B2 > 0) {
+        bool stage2Stopped = false;
+        runPM1Stage2([&]() {
+            if (gcd.valid() && gcd.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                reportStage1();
+                stage2Stopped = factorFound;
+            }
+            return stage2Stopped;
+        });
+        // the result covers B1 only
+        if (stage2Stopped) options.B2 = options.B1;
     }
+    if (gcd.valid()) reportStage1();
 /*    else{
             backupManager.clearState();
     }
@@ -2239,32 +3099,8 @@ int App::runPM1() {
     wm.appendToResultsTxt(json);
     
      if (hasWorktodoEntry_) {
-        if (worktodoParser_->removeFirstProcessed()) {
-            std::cout << "Entry removed from " << options.worktodo_path
-                      << " and saved to worktodo_save.txt\n";
-
-            std::ifstream f(options.worktodo_path);
-            std::string    l;
-            bool           more = false;
-            while (std::getline(f, l)) {
-                if (!l.empty() && l[0] != '#') {
-                    more = true;
-                    break;
-                }
-            }
-            f.close();
-
-            if (more) {
-                std::cout << "Restarting for next entry in worktodo.txt\n";
-                restart_self(argc_, argv_);
-            } else {
-                std::cout << "No more entries in worktodo.txt, exiting.\n";
-                std::exit(0);
-            }
-        } else {
-            std::cerr << "Failed to update " << options.worktodo_path << "\n";
-            std::exit(-1);
-        }
+        advanceWorktodo();
+        return 0;
     }
     return 1;
 }
@@ -2285,6 +3121,339 @@ static std::string fmt_dhms(double s) {
     return o.str();
 }
 
+// P-1 on the marin engine. Stage 1 is x = 3^E, one square_mul per bit of E
+// with the multiplier 3 on the set bits. Stage 2 walks the primes q of
+// (B1, B2] with X = H^q, stepping X by the prime gap from a table of
+// multiplicands H^2, H^4, ..., H^2T, and accumulates Q *= X - 1 (the engine
+// has no register addition, so the legacy kD +/- j pairing is not
+// available). Stage 2 checkpoints at spans of kSpan above B1.
+int App::runPM1Marin() {
+    const uint32_t p = static_cast<uint32_t>(options.exponent);
+    const uint64_t B1 = options.B1, B2 = options.B2;
+    const bool stage2 = B2 > B1;
+    const std::string s1_file = "m_" + std::to_string(p) + "_pm1_" + std::to_string(B1) + ".ckpt";
+    const std::string s2_file = "m_" + std::to_string(p) + "_pm1_" + std::to_string(B1) + "_s2.ckpt";
+    using clock = std::chrono::high_resolution_clock;
+    auto create = [&](size_t regs) {
+        return options.cpu_engine
+            ? engine::create_cpu(p, regs, options.cpu_threads)
+            : engine::create_gpu(p, regs, static_cast<size_t>(options.device_id), options.debug, options.chunk256, options.kernel_cache_path, 0, false,
+                                 marinGeometry(marinPlanDb(options), static_cast<size_t>(options.device_id), p));
+    };
+    auto seconds_since = [](clock::time_point t) { return std::chrono::duration<double>(clock::now() - t).count(); };
+
+    const engine::Reg RQ = 0, RH = 1, RX = 2, RT = 3, RTab = 4;
+    // the table takes what -stage2mem leaves after the four working registers
+    size_t T = 32;
+    if (stage2 && options.stage2_mem_mb > 0) {
+        const uint64_t regBytes = uint64_t(ibdwt::transform_size(p)) * sizeof(uint64_t);
+        const uint64_t fit = (options.stage2_mem_mb << 20) / regBytes;
+        T = static_cast<size_t>(std::clamp<uint64_t>(fit > 4 ? fit - 4 : 1, 1, 256));
+    }
+
+    uint32_t span0 = 0; double s2_time = 0;
+    std::unique_ptr<engine> eng;
+    if (stage2) {
+        eng.reset(create(4 + T));
+        if (read_marin_regs(s2_file, p, eng.get(), { RQ, RH }, span0, s2_time) == 0 ||
+            read_marin_regs(s2_file + ".old", p, eng.get(), { RQ, RH }, span0, s2_time) == 0) {
+            std::cout << "Resuming P-1 stage 2 from a checkpoint." << std::endl;
+        } else {
+            eng.reset();
+        }
+    }
+    logger.logStart(options);
+    const auto start_clock = clock::now();
+
+    double total_time = s2_time;
+    if (!eng) {
+        std::cout << "Start a P-1 factoring stage 1 up to B1=" << B1 << std::endl;
+        // E is built on the host while the engine compiles its kernels
+        auto futureE = std::async(std::launch::async, buildE, B1);
+        std::unique_ptr<engine> eng1(create(1));
+        mpz_class E = futureE.get();
+        E *= mpz_class(2) * mpz_class(static_cast<unsigned long>(p));
+        const uint32_t bits = static_cast<uint32_t>(mpz_sizeinbase(E.get_mpz_t(), 2));
+
+        const engine::Reg R0 = 0;
+        uint32_t done = 0; double restored_time = 0;
+        if (read_marin_regs(s1_file, p, eng1.get(), { R0 }, done, restored_time) == 0 ||
+            read_marin_regs(s1_file + ".old", p, eng1.get(), { R0 }, done, restored_time) == 0) {
+            std::cout << "Resuming from a checkpoint." << std::endl;
+        } else {
+            done = 0;
+            restored_time = 0;
+            eng1->set(R0, 1);
+        }
+        if (options.profiling) eng1->set_profiling(true);
+
+        timer.start();
+        timer2.start();
+        auto lastBackup = clock::now(), lastDisplay = lastBackup;
+        uint64_t resumeIter = done;
+        const uint64_t startIter = done;
+        spinner.displayProgress(done, bits, 0.0, 0.0, p, resumeIter, startIter, "");
+        Metrics::setRun(p, bits, "pm1");
+        for (uint32_t i = done; i < bits; ++i) {
+            if (interrupted) {
+                save_marin_regs(s1_file, p, eng1.get(), { R0 }, i, seconds_since(start_clock) + restored_time);
+                std::cout << "\nInterrupted by user, state saved at iteration " << i << std::endl;
+                logger.logEnd(seconds_since(start_clock) + restored_time);
+                return 0;
+            }
+            eng1->square_mul(R0, mpz_tstbit(E.get_mpz_t(), bits - 1 - i) ? 3 : 1);
+            Metrics::iteration(i + 1);
+
+            const auto now = clock::now();
+            if (now - lastBackup >= std::chrono::seconds(options.backup_interval)) {
+                save_marin_regs(s1_file, p, eng1.get(), { R0 }, i + 1, seconds_since(start_clock) + restored_time);
+                lastBackup = now;
+                spinner.displayBackupInfo(i + 1, bits, timer.elapsed(), "");
+            }
+            if (now - lastDisplay >= std::chrono::seconds(10)) {
+                spinner.displayProgress(i + 1, bits, timer.elapsed(), timer2.elapsed(), p, resumeIter, startIter, "");
+                timer2.start();
+                lastDisplay = now;
+                resumeIter = i + 1;
+            }
+        }
+        spinner.displayProgress(bits, bits, timer.elapsed(), timer2.elapsed(), p, resumeIter, startIter, "");
+        if (options.profiling) eng1->display_profiles(bits - startIter);
+        if (!stage2) prefetchNextJob();
+
+        const mpz_class g = marin_gcd(eng1.get(), R0, p, 1);
+        const mpz_class Mp = (mpz_class(1) << p) - 1;
+        const bool factorFound = g != 1 && g != Mp;
+        const std::string filename = "stage1_result_B1_" + std::to_string(B1) + "_p_" + std::to_string(p) + ".txt";
+        if (factorFound) {
+            writeStageResult(filename, "B1=" + std::to_string(B1) + "  factor=" + g.get_str());
+            std::cout << "\nP-1 factor stage 1 found: " << g.get_str() << "\n" << std::endl;
+            options.knownFactors.push_back(g.get_str());
+        } else {
+            writeStageResult(filename, "No factor up to B1=" + std::to_string(B1));
+            std::cout << "\nNo P-1 (stage 1) factor up to B1=" << B1 << "\n" << std::endl;
+        }
+
+        if (stage2) {
+            // H moves to the stage 2 engine; from here its checkpoint replaces the stage 1 one
+            const engine::digit h(eng1.get(), R0);
+            std::vector<uint64_t> d(h.get_size());
+            for (size_t k = 0; k < d.size(); ++k) d[k] = h.val(k);
+            s2_time = seconds_since(start_clock) + restored_time;
+            eng1.reset();
+            eng.reset(create(4 + T));
+            eng->set_digits(RH, d.data());
+            eng->set(RQ, 1);
+            save_marin_regs(s2_file, p, eng.get(), { RQ, RH }, 0, s2_time);
+        }
+        total_time = seconds_since(start_clock) + restored_time;
+        remove_marin_ckpt(s1_file);
+    }
+
+    if (stage2) {
+        // kSpan wide ranges of primes above B1, the unit of the checkpoint
+        constexpr uint64_t kSpan = 4096;
+        const uint64_t spans = (B2 - B1 + kSpan - 1) / kSpan;
+        std::cout << "Start a P-1 factoring stage 2 up to B2=" << B2 << ", table of " << T << " powers of H" << std::endl;
+        std::mutex outMutex;
+
+        // Q *= H^q - 1 over the primes of spans [span, end) on e, from RQ and
+        // RH; false when interrupted, the state being saved to `file`. A
+        // part of a split run also saves its finished state, span = end.
+        auto runRange = [&](engine* e, uint64_t span, const uint64_t begin, const uint64_t end,
+                            const std::string& file, const double time0, const std::string& tag,
+                            uint64_t& products) -> bool {
+            if (span >= end) return true;
+            // RTab + i = H^(2(i + 1)) as a multiplicand
+            e->copy(RTab, RH);
+            e->square_mul(RTab);
+            e->copy(RT, RTab);
+            e->set_multiplicand(RT, RT);
+            for (size_t i = 1; i < T; ++i) {
+                e->copy(RTab + i, RTab + i - 1);
+                e->mul(RTab + i, RT);
+            }
+            for (size_t i = 0; i < T; ++i) e->set_multiplicand(RTab + i, RTab + i);
+
+            const uint64_t first = span;
+            math::PrimeSieve sieve(B1 + span * kSpan + 1, std::min(B2, B1 + end * kSpan));
+            uint64_t q = sieve.next(), prev = 0;
+            auto lastBackup = clock::now(), lastDisplay = lastBackup;
+            const auto start = lastBackup;
+            for (;;) {
+                while (q == 0 ? span < end : q > B1 + (span + 1) * kSpan) {
+                    ++span;
+                    if (tag.empty()) Metrics::iteration(span);
+                    const auto now = clock::now();
+                    if (span == end) {
+                        if (!tag.empty()) save_marin_regs(file, p, e, { RQ, RH }, static_cast<uint32_t>(span), time0 + seconds_since(start));
+                        break;
+                    }
+                    if (interrupted || now - lastBackup >= std::chrono::seconds(options.backup_interval)) {
+                        save_marin_regs(file, p, e, { RQ, RH }, static_cast<uint32_t>(span), time0 + seconds_since(start));
+                        lastBackup = now;
+                        if (interrupted) {
+                            std::lock_guard<std::mutex> lock(outMutex);
+                            std::cout << "\nInterrupted by user, stage 2 " << tag << "state saved at p = " << B1 + span * kSpan << std::endl;
+                            return false;
+                        }
+                    }
+                    if (now - lastDisplay >= std::chrono::seconds(10)) {
+                        const double elapsed = seconds_since(start);
+                        const double rate = (span - first) / elapsed;
+                        std::lock_guard<std::mutex> lock(outMutex);
+                        std::cout << tag << "Progress: " << std::fixed << std::setprecision(2) << 100.0 * (span - begin) / (end - begin) << "% | "
+                                  << "prime: " << q << " | Products: " << products << " | "
+                                  << "Elapsed: " << elapsed << "s | ETA: " << fmt_dhms(rate > 0 ? (end - span) / rate : 0)
+                                  << std::endl;
+                        lastDisplay = now;
+                    }
+                }
+                if (q == 0) break;
+                if (prev == 0) {
+                    e->copy(RT, RH);
+                    e->pow(RX, RT, q);
+                } else {
+                    uint64_t gap = q - prev;
+                    for (; gap > 2 * T; gap -= 2 * T) e->mul(RX, RTab + T - 1);
+                    e->mul(RX, RTab + gap / 2 - 1);
+                }
+                e->copy(RT, RX);
+                e->sub(RT, 1);
+                e->set_multiplicand(RT, RT);
+                e->mul(RQ, RT);
+                ++products;
+                prev = q;
+                q = sieve.next();
+            }
+            return true;
+        };
+
+        // -s2devices: disjoint span ranges, one engine and thread per device,
+        // each with a checkpoint of its own; the partial Q are multiplied
+        // together before the gcd.
+        std::vector<size_t> devices;
+        for (const auto& d : util::split(options.stage2_devices, ',')) {
+            if (!d.empty()) devices.push_back(static_cast<size_t>(std::strtoul(d.c_str(), nullptr, 10)));
+        }
+        if (devices.size() > 1 && (options.cpu_engine || span0 != 0)) {
+            std::cerr << "Warning: " << (options.cpu_engine ? "-cpu" : "a resumed single-device stage 2")
+                      << " runs stage 2 on one device, -s2devices ignored" << std::endl;
+            devices.clear();
+        }
+        const size_t parts = std::max<size_t>(devices.size(), 1);
+        std::vector<std::string> partFiles;
+        for (size_t k = 0; parts > 1 && k < parts; ++k)
+            partFiles.push_back(s2_file + ".part" + std::to_string(k) + "of" + std::to_string(parts));
+
+        uint64_t products = 0;
+        const auto s2_start = clock::now();
+        Metrics::setRun(p, spans, "pm1_stage2");
+        if (parts == 1) {
+            if (options.profiling) eng->set_profiling(true);
+            if (!runRange(eng.get(), span0, 0, spans, s2_file, s2_time, "", products)) {
+                logger.logEnd(s2_time + seconds_since(s2_start));
+                return 0;
+            }
+        } else {
+            // every part starts from H; the stage 2 engine makes way for theirs
+            const engine::digit h(eng.get(), RH);
+            std::vector<uint64_t> hd(h.get_size());
+            for (size_t k = 0; k < hd.size(); ++k) hd[k] = h.val(k);
+            eng.reset();
+            std::vector<std::unique_ptr<engine>> engs;
+            std::vector<uint64_t> from(parts), done(parts, 0);
+            std::vector<double> times(parts, s2_time);
+            std::cout << "Stage 2 split in " << parts << " ranges on devices " << options.stage2_devices << std::endl;
+            for (size_t k = 0; k < parts; ++k) {
+                engs.emplace_back(engine::create_gpu(p, 4 + T, devices[k], options.debug, options.chunk256, options.kernel_cache_path, 0, false,
+                                                     marinGeometry(marinPlanDb(options), devices[k], p)));
+                uint32_t at = 0;
+                if (read_marin_regs(partFiles[k], p, engs[k].get(), { RQ, RH }, at, times[k]) == 0 ||
+                    read_marin_regs(partFiles[k] + ".old", p, engs[k].get(), { RQ, RH }, at, times[k]) == 0) {
+                    from[k] = at;
+                } else {
+                    from[k] = spans * k / parts;
+                    engs[k]->set_digits(RH, hd.data());
+                    engs[k]->set(RQ, 1);
+                }
+            }
+            // the parts run side by side: the slowest one sets the time
+            s2_time = *std::max_element(times.begin(), times.end());
+            std::vector<char> finished(parts, 0);
+            std::vector<std::exception_ptr> errors(parts);
+            std::vector<std::thread> workers;
+            for (size_t k = 0; k < parts; ++k) {
+                workers.emplace_back([&, k] {
+                    try {
+                        const std::string tag = "[part " + std::to_string(k + 1) + "/" + std::to_string(parts) + "] ";
+                        finished[k] = runRange(engs[k].get(), from[k], spans * k / parts, spans * (k + 1) / parts,
+                                               partFiles[k], times[k], tag, done[k]);
+                    } catch (...) {
+                        errors[k] = std::current_exception();
+                        interrupted = true;   // the other parts save and stop
+                    }
+                });
+            }
+            for (auto& w : workers) w.join();
+            for (const auto& err : errors) if (err) std::rethrow_exception(err);
+            if (std::find(finished.begin(), finished.end(), 0) != finished.end()) {
+                logger.logEnd(s2_time + seconds_since(s2_start));
+                return 0;
+            }
+            // the merge: Q = Q_0 Q_1 ... on the first engine
+            eng = std::move(engs[0]);
+            for (size_t k = 1; k < parts; ++k) {
+                const engine::digit qk(engs[k].get(), RQ);
+                for (size_t i = 0; i < hd.size(); ++i) hd[i] = qk.val(i);
+                engs[k].reset();
+                eng->set_digits(RT, hd.data());
+                eng->set_multiplicand(RT, RT);
+                eng->mul(RQ, RT);
+            }
+            for (const uint64_t n : done) products += n;
+        }
+        if (options.profiling) eng->display_profiles(static_cast<size_t>(products));
+        prefetchNextJob();
+        std::cout << "Stage 2: " << products << " primes folded in" << std::endl;
+
+        const mpz_class g = marin_gcd(eng.get(), RQ, p, 0);
+        const mpz_class Mp = (mpz_class(1) << p) - 1;
+        const bool found = g != 1 && g != Mp;
+        const std::string filename = "stage2_result_B2_" + std::to_string(B2) + "_p_" + std::to_string(p) + ".txt";
+        if (found) {
+            writeStageResult(filename, "B2=" + std::to_string(B2) + "  factor=" + g.get_str());
+            std::cout << "\n>>>  Factor P-1 (stage 2) found : " << g.get_str() << '\n';
+            options.knownFactors.push_back(g.get_str());
+        } else {
+            writeStageResult(filename, "No factor P-1 up to B2=" + std::to_string(B2));
+            std::cout << "\nNo factor P-1 (stage 2) until B2 = " << B2 << '\n';
+        }
+        total_time = s2_time + seconds_since(s2_start);
+        remove_marin_ckpt(s2_file);
+        for (const auto& f : partFiles) remove_marin_ckpt(f);
+    }
+    logger.logEnd(total_time);
+
+    std::string json = io::JsonBuilder::generate(
+        options,
+        static_cast<int>(eng ? eng->get_size() : ibdwt::transform_size(p)),
+        false,
+        "",
+        ""
+    );
+    std::cout << "Manual submission JSON:\n" << json << "\n";
+    io::WorktodoManager wm(options);
+    wm.saveIndividualJson(options.exponent, options.mode, json);
+    wm.appendToResultsTxt(json);
+
+    if (hasWorktodoEntry_) {
+        advanceWorktodo();
+        return 0;
+    }
+    return 1;
+}
+
 uint32_t transformsize_custom(uint64_t exponent) {
     uint64_t log_n = 0;
     uint64_t w = 0;
@@ -2308,6 +3477,15 @@ uint32_t transformsize_custom(uint64_t exponent) {
 
 
 int App::runGpuBenchmarkMarin() {
+    std::optional<std::vector<BenchResult>> baseline;
+    if (!options.bench_baseline.empty()) {
+        baseline = BenchReport::load(options.bench_baseline);
+        if (!baseline) {
+            std::cerr << "Error: cannot read benchmark baseline " << options.bench_baseline << std::endl;
+            return 1;
+        }
+    }
+
     auto fmt_pct = [&](double x){ std::ostringstream o; o<<std::fixed<<std::setprecision(1)<<x*100.0<<"%"; return o.str(); };
 
     std::string gpu_name = "Unknown";
@@ -2360,8 +3538,16 @@ int App::runGpuBenchmarkMarin() {
     tasks.reserve(exps.size());
     for (auto p : exps) tasks.push_back({transformsize_custom(p), p});
 
-    struct Row { uint32_t ts; uint32_t p; double ips; double eta_prp; };
+    struct Row { uint32_t ts; uint32_t p; double ips; double eta_prp; double joules_per_iter; };
     std::vector<Row> rows;
+    // the energy of each size next to its rate, when the board power can be read
+    PowerMeter* meter = powerMeter();
+    // -roofline: the launches of a squaring are counted in profiling mode,
+    // each one reading and writing the register once
+    const bool roofline = !options.roofline_csv.empty();
+    Roofline::Peaks peaks;
+    std::vector<Roofline::Row> roofRows;
+    if (roofline) peaks = Roofline::measure(context.getContext(), context.getDevice(), context.getQueue());
 
     auto print_live = [&](size_t i, size_t n, uint32_t ts, uint32_t p, double frac, double ips_live, double eta_all){
         std::ostringstream o;
@@ -2380,7 +3566,8 @@ int App::runGpuBenchmarkMarin() {
         if (prmers_bench_stop) break;
         uint32_t p = tasks[ti].p;
         engine* eng = nullptr;
-        try { eng = engine::create_gpu(p, static_cast<size_t>(6), static_cast<size_t>(options.device_id), false, options.chunk256); } catch (...) { eng = nullptr; }
+        try { eng = engine::create_gpu(p, static_cast<size_t>(6), static_cast<size_t>(options.device_id), false, options.chunk256, options.kernel_cache_path, 0, false,
+                                       marinGeometry(marinPlanDb(options), static_cast<size_t>(options.device_id), p)); } catch (...) { eng = nullptr; }
         if (!eng) continue;
         eng->set(R1, 1);
         eng->set(R0, 3);
@@ -2391,6 +3578,7 @@ int App::runGpuBenchmarkMarin() {
         uint32_t ts =  eng->get_size();
         double target = (ts >= 33554432u) ? 10.0 : (ts >= 8388608u ? 8.0 : (ts >= 2621440u ? 6.0 : 5.0));
 
+        if (meter) meter->start();
         auto t0 = std::chrono::high_resolution_clock::now();
         uint64_t cnt = 0;
         double last_update = 0.0;
@@ -2410,13 +3598,24 @@ int App::runGpuBenchmarkMarin() {
         }
 
         auto t1 = std::chrono::high_resolution_clock::now();
+        const double joules = meter ? meter->stop() : 0.0;
         double elapsed = std::chrono::duration<double>(t1 - t0).count();
         sum_time += elapsed;
 
         if (!prmers_bench_stop) {
             double ips = cnt / std::max(1e-9, elapsed);
             double eta_prp = (double)p / std::max(1e-9, ips);
-            rows.push_back({ts, p, ips, eta_prp});
+            rows.push_back({ts, p, ips, eta_prp, cnt ? joules / double(cnt) : 0.0});
+            if (roofline) {
+                constexpr uint32_t kPassIters = 16;
+                eng->set_profiling(true);
+                for (uint32_t i = 0; i < kPassIters; ++i) eng->square_mul(R0);
+                uint64_t launches = 0;
+                for (const auto& k : eng->get_profiles()) launches += k.count;
+                eng->set_profiling(false);
+                const double passes = double(launches) / kPassIters;
+                roofRows.push_back({"marin", p, ts, passes, passes * 2.0 * sizeof(uint64_t) * ts, 1e6 / std::max(1e-9, ips)});
+            }
         }
 
         delete eng;
@@ -2425,11 +3624,14 @@ int App::runGpuBenchmarkMarin() {
 
     std::signal(SIGINT, old_handler);
     std::cout << "\n";
-    std::cout << "Transform  Exponent      Iter/s       PRP_ETA\n";
+    std::cout << "Transform  Exponent      Iter/s    us/iter       PRP_ETA" << (meter ? "      J/iter" : "") << "\n";
     for (auto &r : rows) {
         std::cout << std::setw(9) << r.ts << "  " << std::setw(10) << r.p
                   << "  " << std::fixed << std::setprecision(2) << std::setw(10) << r.ips
-                  << "  " << std::setw(14) << fmt_dhms(r.eta_prp) << "\n";
+                  << "  " << std::setw(9) << 1e6 / std::max(1e-9, r.ips)
+                  << "  " << std::setw(12) << fmt_dhms(r.eta_prp);
+        if (meter) std::cout << "  " << std::setprecision(6) << std::setw(10) << r.joules_per_iter;
+        std::cout << "\n";
     }
     double prmers_score_val = 0.0;
     if (!rows.empty()) {
@@ -2450,18 +3652,192 @@ int App::runGpuBenchmarkMarin() {
     std::cout << "\nPRMERS_SCORE|" << std::fixed << std::setprecision(2) << prmers_score_val << "/100\n";
     std::cout << gpu_vendor << " " << gpu_name << " has a PRMERS SCORE OF " << std::fixed << std::setprecision(2) << prmers_score_val << "/100\n";
 
+    BenchDevice dev;
+    dev.vendor = gpu_vendor; dev.name = gpu_name; dev.driver = driver_ver; dev.fp64 = fp64;
+    dev.compute_units = cu; dev.vram = vram; dev.local_mem = lmem;
+    std::vector<BenchResult> results;
+    results.reserve(rows.size());
+    for (const auto& r : rows) {
+        const double us = 1e6 / std::max(1e-9, r.ips);
+        results.push_back({ r.p, r.ts, r.ips, us, BenchReport::bandwidthGBps(r.ts, us), r.joules_per_iter });
+    }
+    if (!options.bench_json.empty()) BenchReport::writeJson(options.bench_json, dev, results, prmers_score_val);
+    if (!options.bench_csv.empty())  BenchReport::writeCsv(options.bench_csv, dev, results);
+    if (roofline) {
+        std::cout << "\n";
+        Roofline::print(std::cout, peaks, roofRows);
+        Roofline::writeCsv(options.roofline_csv, gpu_vendor + " " + gpu_name, peaks, roofRows);
+    }
+
+    // the rate of each transform size, for the predictions of -autoengine
+    std::string planDevice, planDriver;
+    if (!rows.empty() && engine::gpu_device_key(static_cast<size_t>(options.device_id), planDevice, planDriver)) {
+        PlanDb db(options.plan_db_path);
+        db.load();
+        for (const auto& r : rows) {
+            NttPlan plan = db.find(planDevice, planDriver, r.ts).value_or(NttPlan{});
+            plan.device = planDevice;
+            plan.driver = planDriver;
+            plan.n = r.ts;
+            plan.marin_ips = r.ips;
+            db.put(plan);
+        }
+        if (db.save()) std::cout << "Marin rates saved to " << db.path() << "\n";
+        else std::cerr << "Warning: cannot write " << db.path() << std::endl;
+    }
 
+    if (baseline) {
+        const size_t regressions = BenchReport::compare(*baseline, results, options.bench_threshold, std::cout);
+        if (prmers_bench_stop) {
+            std::cerr << "Benchmark interrupted, the baseline check is incomplete" << std::endl;
+            return 1;
+        }
+        return regressions == 0 ? 0 : 1;
+    }
     return 0;
 }
 
 
+// -burnin: PRP iterations at one exponent, every block of B iterations
+// verified by Gerbicz-Li, for a given time. With d = x0 = 3 and
+// d *= x after each block, d' = d^(2^B) * 3; a mismatch rolls x and d back
+// to the last block that passed and counts an error. A check squares as
+// much as its block, so the rate counts both, per window of kWindow
+// seconds: their spread shows a device that slows down as it heats up. Each verification also feeds the failure rate of the
+// device that -checklevel's adaptive cadence starts from.
+int App::runBurnIn() {
+    constexpr double kWindow = 10.0;
+    const uint32_t p = static_cast<uint32_t>(options.burnin_exponent);
+    const uint64_t B = std::max<uint64_t>(options.burnin_block, 2);
+    const double duration = double(options.burnin_seconds);
+    const size_t R0 = 0, R1 = 1, R2 = 2, R3 = 3, R4 = 4, R5 = 5;
+    using clock = std::chrono::steady_clock;
+
+    std::unique_ptr<engine> eng;
+    try {
+        eng.reset(options.cpu_engine
+            ? engine::create_cpu(p, 6, options.cpu_threads)
+            : engine::create_gpu(p, 6, static_cast<size_t>(options.device_id), options.debug, options.chunk256, options.kernel_cache_path, 0, false,
+                                 marinGeometry(marinPlanDb(options), static_cast<size_t>(options.device_id), p)));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: cannot create the engine for the burn-in: " << e.what() << std::endl;
+        return 1;
+    }
+    CheckCadence cadence = makeCadence(options, context, B);
+
+    std::cout << "Burn-in: p=" << p << " (transform size " << eng->get_size() << "), a Gerbicz-Li check every "
+              << B << " iterations, for " << fmt_dhms(duration) << std::endl;
+    eng->set(R0, 3);
+    eng->set(R1, 3);
+    eng->copy(R4, R0);
+    eng->copy(R5, R1);
+
+    std::vector<double> windows;              // squarings per second of each window
+    uint64_t iters = 0, checks = 0, errors = 0, squarings = 0, windowSquarings = 0;
+    double squaring = 0;                      // seconds of the blocks and their checks
+    const auto start = clock::now();
+    auto windowStart = start;
+    for (;;) {
+        const auto t0 = clock::now();
+        const double elapsed = std::chrono::duration<double>(t0 - start).count();
+        if (interrupted || elapsed >= duration) break;
+
+        for (uint64_t i = 0; i < B; ++i) eng->square_mul(R0);
+        eng->copy(R3, R1);
+        eng->set_multiplicand(R2, R0);
+        eng->mul(R1, R2);
+        for (uint64_t i = 0; i + 1 < B; ++i) eng->square_mul(R3);
+        eng->square_mul(R3, 3);
+        const bool ok = eng->is_equal(R3, R1);
+        const auto t1 = clock::now();
+        const double seconds = std::chrono::duration<double>(t1 - t0).count();
+
+        ++checks;
+        squaring += seconds;
+        squarings += 2 * B;
+        windowSquarings += 2 * B;
+        Metrics::gerbiczCheck(ok);
+        // half of it is the block the check covers
+        if (ok) {
+            cadence.passed(seconds / 2);
+            eng->copy(R4, R0);
+            eng->copy(R5, R1);
+            iters += B;
+        } else {
+            cadence.failed(seconds / 2);
+            ++errors;
+            std::cout << "[Burn-in] Check FAILED after " << iters << " iterations, restored the last verified block" << std::endl;
+            eng->copy(R0, R4);
+            eng->copy(R1, R5);
+        }
+
+        const double w = std::chrono::duration<double>(t1 - windowStart).count();
+        if (w >= kWindow) {
+            const double ips = double(windowSquarings) / w;
+            windows.push_back(ips);
+            std::cout << "[Burn-in] " << fmt_dhms(std::chrono::duration<double>(t1 - start).count())
+                      << "  " << std::fixed << std::setprecision(2) << ips << " iter/s"
+                      << "  " << 1e6 / std::max(1e-9, ips) << " us/iter"
+                      << "  errors " << errors << std::endl;
+            // the rate so far survives a burn-in that is killed
+            cadence.save();
+            windowSquarings = 0;
+            windowStart = t1;
+        }
+    }
+    cadence.save();
+
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    const double hours = std::max(elapsed, 1e-9) / 3600.0;
+    std::cout << "\nBurn-in " << (interrupted ? "stopped" : "done") << " after " << fmt_dhms(elapsed)
+              << ": " << iters << " iterations, " << checks << " checks\n"
+              << "  errors:    " << errors << " (" << std::fixed << std::setprecision(2) << double(errors) / hours << " per hour)\n";
+    if (squarings) std::cout << "  sustained: " << 1e6 * squaring / double(squarings) << " us/iter\n";
+    if (windows.size() >= 2) {
+        const auto [lo, hi] = std::minmax_element(windows.begin(), windows.end());
+        const double drift = 100.0 * (windows.back() / windows.front() - 1.0);
+        std::cout << "  rate:      " << windows.front() << " iter/s in the first window, " << windows.back()
+                  << " in the last (" << std::showpos << drift << std::noshowpos << "%), "
+                  << *lo << " to " << *hi << "\n";
+        if (drift < -5.0)
+            std::cerr << "Warning: the rate fell by " << -drift << "% during the burn-in, the device is likely throttling" << std::endl;
+    }
+    std::cout << "  the failure rate of this device is in " << (fs::path(options.save_path) / "gerbicz_rates.json").string() << std::endl;
+    return errors ? 1 : 0;
+}
+
 
 
 int App::run() {
+    // the trace and the last metrics sample are written whichever way the run ends
+    struct TraceWriter { ~TraceWriter() { util::Trace::write(); Metrics::stop(); } } traceWriter;
+    if (options.cpu_engine && (options.tune_plan || options.bench)) {
+        std::cerr << "Error: -tuneplan and -bench measure a GPU, not the host engine (-cpu)" << std::endl;
+        return 1;
+    }
+    if(options.tune_plan){
+        return options.marin ? runPlanTuneMarin() : runPlanTune();
+    }
     if(options.bench){
         return runGpuBenchmarkMarin();
     }
+    if(options.burnin_seconds){
+        return runBurnIn();
+    }
+    if (options.skipDone && !options.crossCheck) {
+        if (auto rc = reportCachedResult()) return *rc;
+    }
+    // cofactor and Wagstaff tests start from known factors or another form
+    const bool test = (options.mode == "prp" || options.mode == "ll") && !options.wagstaff && options.knownFactors.empty();
+    if (options.mode == "tf" || (test && options.tf_bits > options.tf_from)) {
+        if (auto rc = runTrialFactor()) return *rc;
+    }
     if(options.marin){
+        if (options.mode == "pm1") {
+            if (options.exponent > 89) return runPM1Marin();
+            std::cout << "P-1 factoring (stage 1) need exponent > 89" << std::endl;
+            return 1;
+        }
         return runPrpOrLlMarin();
     }
     if(options.mode == "prp" || options.mode == "ll"){
@@ -2469,7 +3845,9 @@ int App::run() {
     }
     else if(options.mode == "pm1"){
         if(options.exponent > 89){
-            return runPM1();
+            const int rc = runPM1();
+            if (auto* prof = context.getProfiler(); prof && options.profiling) prof->report(std::cout, "at exit (P-1)");
+            return rc;
         }
         else{
             std::cout << "P-1 factoring (stage 1) need exponent > 89" << std::endl;
@@ -0,0 +1,134 @@
+// src/core/BackupCadence.cpp
+#include "core/BackupCadence.hpp"
+#include "core/Metrics.hpp"
+#include "util/JsonFile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+namespace {
+
+struct Node {
+    double seconds = 0, crashes = 0;
+    std::vector<long> open;    // process ids of the runs not ended yet
+};
+
+long processId() {
+#ifdef _WIN32
+    return 0;
+#else
+    return static_cast<long>(::getpid());
+#endif
+}
+
+// A process that is gone left its runs open: they crashed.
+bool alive(long pid) {
+#ifdef _WIN32
+    (void)pid;
+    return true;
+#else
+    return pid == processId() || ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+std::map<std::string, Node> parse(const std::string& text) {
+    std::map<std::string, Node> nodes;
+    for (const auto& obj : util::jsonObjects(text)) {
+        const std::string name = util::jsonField(obj, "node").value_or("");
+        if (name.empty()) continue;
+        Node& n = nodes[name];
+        n.seconds = std::strtod(util::jsonField(obj, "seconds").value_or("").c_str(), nullptr);
+        n.crashes = std::strtod(util::jsonField(obj, "crashes").value_or("").c_str(), nullptr);
+        std::istringstream ids(util::jsonField(obj, "open").value_or(""));
+        for (std::string id; std::getline(ids, id, ','); )
+            if (const long v = std::strtol(id.c_str(), nullptr, 10); v > 0) n.open.push_back(v);
+    }
+    return nodes;
+}
+
+} // namespace
+
+BackupCadence::BackupCadence(std::string path, std::string node, double fixed, double cap, uint64_t checkpointBytes)
+    : path_(std::move(path)), node_(std::move(node)), fixed_(fixed), cap_(cap),
+      priorCost_(double(checkpointBytes) / kPriorBandwidth), last_(std::chrono::steady_clock::now())
+{
+    update(+1, true);
+}
+
+BackupCadence::~BackupCadence() {
+    update(-1, false);
+}
+
+double BackupCadence::interval() const {
+    double t = fixed_;
+    if (!(t > 0)) {
+        const double measured = Metrics::checkpointCost();
+        const double C = measured > 0 ? measured : priorCost_;
+        const double run = std::chrono::duration<double>(std::chrono::steady_clock::now() - last_).count();
+        const double M = (seconds_ + run + kPriorSeconds) / (crashes_ + 1);
+        t = (C < M / 2) ? std::sqrt(2 * C * M) * (1 + std::sqrt(C / (2 * M)) / 3 + C / (18 * M)) - C : M;
+        t = std::max(t, kMinInterval);
+        if (cap_ > 0) t = std::min(t, cap_);
+    }
+    Metrics::backupInterval(t);
+    return t;
+}
+
+bool BackupCadence::save() {
+    return update(0, false);
+}
+
+// open: +1 when the run starts, -1 when it ends; counted: the runs of gone
+// processes are counted as crashes first.
+bool BackupCadence::update(int open, bool counted) {
+    const bool ok = util::updateJsonFile(path_, [&](const std::string& current) {
+        // another run may have saved since: add to what the file holds now
+        auto nodes = parse(current);
+        Node& n = nodes[node_];
+        const auto now = std::chrono::steady_clock::now();
+        n.seconds += std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        if (counted) {
+            const auto gone = std::remove_if(n.open.begin(), n.open.end(), [](long pid) { return !alive(pid); });
+            n.crashes += double(n.open.end() - gone);
+            n.open.erase(gone, n.open.end());
+        }
+        if (open > 0) n.open.push_back(processId());
+        if (open < 0) {
+            if (auto it = std::find(n.open.begin(), n.open.end(), processId()); it != n.open.end()) n.open.erase(it);
+        }
+        seconds_ = n.seconds;
+        crashes_ = n.crashes;
+
+        std::ostringstream out;
+        out << "{\n  \"nodes\": [\n";
+        size_t i = 0;
+        for (const auto& [name, node] : nodes) {
+            out << "    { \"node\": \"" << util::jsonEscape(name) << "\""
+                << ", \"seconds\": " << std::fixed << std::setprecision(1) << node.seconds
+                << ", \"crashes\": " << std::setprecision(0) << node.crashes
+                << ", \"open\": [";
+            for (size_t k = 0; k < node.open.size(); ++k) out << (k ? ", " : "") << node.open[k];
+            out << "] }" << (++i < nodes.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return out.str();
+    });
+    if (!ok) std::cerr << "Warning: cannot write crash rates " << path_ << std::endl;
+    return ok;
+}
+
+} // namespace core
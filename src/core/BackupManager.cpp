@@ -21,6 +21,13 @@
  * This code is released as free software. 
  */
 #include "core/BackupManager.hpp"
+#include "core/Metrics.hpp"
+#include "util/Trace.hpp"
+#include "util/Fs.hpp"
+#include "util/HostPool.hpp"
+#include "io/JsonBuilder.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
@@ -36,19 +43,38 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 namespace core {
 
+namespace {
+
+constexpr uint32_t kSectionState        = io::checkpointTag('M','E','R','S');
+constexpr uint32_t kSectionBufD         = io::checkpointTag('B','U','F','D');
+constexpr uint32_t kSectionLastBufD     = io::checkpointTag('L','B','F','D');
+constexpr uint32_t kSectionCorrectState = io::checkpointTag('G','L','I','C');
+constexpr uint32_t kSectionStage2Hq     = io::checkpointTag('S','2','H','Q');
+constexpr uint32_t kSectionStage2Q      = io::checkpointTag('S','2','Q','A');
+const std::string  kModeStage2          = "pm1s2";
+
+} // namespace
+
 BackupManager::BackupManager(cl_command_queue queue,
+                             opencl::Staging& staging,
                              unsigned interval,
                              size_t vectorSize,
+                             const std::vector<int>& digitWidth,
                              const std::string& savePath,
                              unsigned exponent,
                              const std::string& mode,
                              const uint64_t b1,
                              const uint64_t b2,
                              bool wagstaff,
-                             bool marin)
+                             bool marin,
+                             cl_command_queue transferQueue)
   : queue_(queue)
+  , transferQueue_(transferQueue ? transferQueue : queue)
+  , staging_(staging)
   , backupInterval_(interval)
   , vectorSize_(vectorSize)
   , savePath_(savePath.empty() ? "." : savePath)
@@ -58,7 +84,9 @@ BackupManager::BackupManager(cl_command_queue queue,
   , b2_(b2)
   , wagstaff_(wagstaff)
   , marin_(marin)
+  , digitWidth_(digitWidth)
 {
+    for (int w : digitWidth_) packedBits_ += static_cast<uint32_t>(w);
     if(!marin_){
         std::filesystem::create_directories(savePath_);
         auto base = std::to_string(exponent_) + mode_;
@@ -74,6 +102,7 @@ BackupManager::BackupManager(cl_command_queue queue,
         GerbiczLiJSaveFilename_ = savePath_ + "/" + base + ".jsav";
         GerbiczLiLastBufDFilename_ = savePath_ + "/" + base + ".lbufd";
         mersFilename_ = savePath_ + "/" + base + ".mers";
+        ckptFilename_ = savePath_ + "/" + base + ".ckpt";
         loopFilename_ = savePath_ + "/" + base + ".loop";
         exponentFilename_ = savePath_ + "/" + base + ".exponent";
         if(b2_>0){
@@ -81,11 +110,277 @@ BackupManager::BackupManager(cl_command_queue queue,
             hqFilename_   = savePath_ + "/" + base + ".hq";
             qFilename_    = savePath_ + "/" + base + ".q";
             loop2Filename_= savePath_ + "/" + base + ".loop2";
+            s2CkptFilename_ = savePath_ + "/" + base + ".s2.ckpt";
         }
     }
     
 }
 
+BackupManager::~BackupManager() {
+    flush();
+    releaseAsync();
+}
+
+void BackupManager::flush() {
+    if (!asyncWriter_.joinable()) return;
+    util::TraceSpan span("checkpoint_flush");
+    asyncWriter_.join();
+}
+
+void BackupManager::releaseAsync() {
+    for (int i = 0; i < kAsyncSlots; ++i) {
+        cl_mem mapped = asyncPinned_[i] ? asyncPinned_[i] : asyncSnap_[i];
+        if (asyncHost_[i]) clEnqueueUnmapMemObject(queue_, mapped, asyncHost_[i], 0, nullptr, nullptr);
+        asyncHost_[i] = nullptr;
+    }
+    if (queue_) clFinish(queue_);
+    for (int i = 0; i < kAsyncSlots; ++i) {
+        if (asyncPinned_[i]) clReleaseMemObject(asyncPinned_[i]);
+        if (asyncSnap_[i])   clReleaseMemObject(asyncSnap_[i]);
+        asyncPinned_[i] = asyncSnap_[i] = nullptr;
+    }
+}
+
+bool BackupManager::startAsync(const std::vector<cl_mem>& buffers,
+                               std::function<void(const std::vector<const void*>&)> write)
+{
+    util::TraceSpan span("checkpoint_snapshot");
+    flush();
+    if (buffers.size() > static_cast<size_t>(kAsyncSlots)) return false;
+    const size_t bytes = vectorSize_ * sizeof(uint64_t);
+
+    cl_context ctx = nullptr;
+    clGetCommandQueueInfo(queue_, CL_QUEUE_CONTEXT, sizeof(ctx), &ctx, nullptr);
+    if (staging_.unified()) return startAsyncMapped(ctx, buffers, std::move(write));
+    // mapped snapshots from before a failed map: start over with pinned ones
+    if (asyncHost_[0] && !asyncPinned_[0]) releaseAsync();
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (asyncHost_[i]) continue;
+        cl_int err = CL_SUCCESS;
+        if (!asyncSnap_[i])
+            asyncSnap_[i] = clCreateBuffer(ctx, CL_MEM_READ_WRITE, bytes, nullptr, &err);
+        if (err == CL_SUCCESS && !asyncPinned_[i])
+            asyncPinned_[i] = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, nullptr, &err);
+        if (err == CL_SUCCESS)
+            asyncHost_[i] = clEnqueueMapBuffer(queue_, asyncPinned_[i], CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                               0, bytes, 0, nullptr, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Warning: cannot allocate async checkpoint buffers, saving synchronously" << std::endl;
+            releaseAsync();
+            return false;
+        }
+    }
+
+    // The copies stay on queue_, in order with the kernels; the reads wait
+    // for them on the transfer queue and run while the next kernels do.
+    // Nothing writes the snapshots again before flush() has seen the reads.
+    std::vector<cl_event> reads(buffers.size(), nullptr);
+    std::vector<const void*> host;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        cl_event copied = nullptr;
+        clEnqueueCopyBuffer(queue_, buffers[i], asyncSnap_[i], 0, 0, bytes, 0, nullptr, &copied);
+        clEnqueueReadBuffer(transferQueue_, asyncSnap_[i], CL_FALSE, 0, bytes, asyncHost_[i],
+                            copied ? 1 : 0, copied ? &copied : nullptr, &reads[i]);
+        if (copied) clReleaseEvent(copied);
+        host.push_back(asyncHost_[i]);
+    }
+    clFlush(queue_);
+    if (transferQueue_ != queue_) clFlush(transferQueue_);
+
+    asyncWriter_ = std::thread([reads, host = std::move(host), write = std::move(write)]() {
+        util::TraceSpan span("checkpoint_write");
+        if (!reads.empty()) clWaitForEvents(static_cast<cl_uint>(reads.size()), reads.data());
+        for (cl_event e : reads) clReleaseEvent(e);
+        write(host);
+    });
+    return true;
+}
+
+// Unified memory: the snapshots are host memory, mapped once the copy is
+// done; they are unmapped again before the next copy into them.
+bool BackupManager::startAsyncMapped(cl_context ctx, const std::vector<cl_mem>& buffers,
+                                     std::function<void(const std::vector<const void*>&)> write)
+{
+    const size_t bytes = vectorSize_ * sizeof(uint64_t);
+    std::vector<cl_event> reads(buffers.size(), nullptr);
+    std::vector<const void*> host;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (asyncHost_[i]) clEnqueueUnmapMemObject(queue_, asyncSnap_[i], asyncHost_[i], 0, nullptr, nullptr);
+        asyncHost_[i] = nullptr;
+        cl_int err = CL_SUCCESS;
+        if (!asyncSnap_[i])
+            asyncSnap_[i] = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, nullptr, &err);
+        if (err == CL_SUCCESS)
+            err = clEnqueueCopyBuffer(queue_, buffers[i], asyncSnap_[i], 0, 0, bytes, 0, nullptr, nullptr);
+        if (err == CL_SUCCESS)
+            asyncHost_[i] = clEnqueueMapBuffer(queue_, asyncSnap_[i], CL_FALSE, CL_MAP_READ,
+                                               0, bytes, 0, nullptr, &reads[i], &err);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Warning: cannot map async checkpoint buffers, saving synchronously" << std::endl;
+            clFinish(queue_);
+            for (cl_event e : reads) if (e) clReleaseEvent(e);
+            releaseAsync();
+            return false;
+        }
+        host.push_back(asyncHost_[i]);
+    }
+    clFlush(queue_);
+
+    asyncWriter_ = std::thread([reads, host = std::move(host), write = std::move(write)]() {
+        util::TraceSpan span("checkpoint_write");
+        if (!reads.empty()) clWaitForEvents(static_cast<cl_uint>(reads.size()), reads.data());
+        for (cl_event e : reads) clReleaseEvent(e);
+        write(host);
+    });
+    return true;
+}
+
+void BackupManager::saveStateAsync(cl_mem buffer, uint64_t iter) {
+    const size_t bytes = vectorSize_ * sizeof(uint64_t);
+    const std::string mers = mersFilename_, loop = loopFilename_;
+    const std::string next = std::to_string(iter + 1);
+    auto write = [bytes, mers, loop, next](const std::vector<const void*>& host) {
+        const auto t0 = std::chrono::steady_clock::now();
+        if (!writeFileDurable(mers, {{host[0], bytes}}))
+            std::cerr << "Error saving state to " << mers << std::endl;
+        if (!writeFileDurable(loop, {{next.data(), next.size()}}))
+            std::cerr << "Error saving loop state to " << loop << std::endl;
+        Metrics::checkpoint(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(),
+                            bytes + next.size());
+    };
+    if (!startAsync({buffer}, write)) {
+        saveState(buffer, iter);
+        return;
+    }
+    std::cout << "\nCheckpoint at iteration " << iter + 1 << " queued to " << mersFilename_ << std::endl;
+}
+
+io::CheckpointHeader BackupManager::makeCheckpointHeader(uint64_t iter, uint64_t itersave, uint64_t jsave) const {
+    io::CheckpointHeader h;
+    h.exponent      = exponent_;
+    h.transformSize = static_cast<uint32_t>(vectorSize_);
+    h.engine        = 0;
+    h.mode          = mode_;
+    h.iteration     = iter + 1;
+    h.j             = jsave;
+    h.itersave      = itersave;
+    return h;
+}
+
+// Digits are fully carried first (with the 2^E = 1 wrap), so compactBits
+// sees no overflow and expandBits gives back the same residue.
+std::vector<uint32_t> BackupManager::packResidue(const uint64_t* limbs) const {
+    util::HostPool::Lease lease = util::HostPool::acquire(vectorSize_, false);
+    std::vector<uint64_t>& x = *lease;
+    std::copy(limbs, limbs + vectorSize_, x.begin());
+    uint64_t c = 0;
+    do {
+        x[0] += c;
+        c = 0;
+        for (size_t i = 0; i < vectorSize_; ++i) {
+            const int w = digitWidth_[i];
+            const uint64_t s = x[i] + c;
+            x[i] = s & ((1ULL << w) - 1);
+            c = (s >> w) + (s < c ? (1ULL << (64 - w)) : 0);
+        }
+    } while (c != 0);
+    return io::JsonBuilder::compactBits(x, digitWidth_, packedBits_);
+}
+
+// The sections of the buffers a run has, in the order {state, bufd, last
+// bufd, last correct state}: an LL run or one without Gerbicz-Li only saves
+// its state.
+std::vector<uint32_t> BackupManager::checkpointSections(const cl_mem (&src)[4], std::vector<cl_mem>& present) {
+    static const uint32_t tags[4] = {kSectionState, kSectionBufD, kSectionLastBufD, kSectionCorrectState};
+    std::vector<uint32_t> out;
+    present.clear();
+    for (int i = 0; i < 4; ++i) {
+        if (!src[i]) continue;
+        present.push_back(src[i]);
+        out.push_back(tags[i]);
+    }
+    return out;
+}
+
+void BackupManager::writeCheckpointFrom(const std::vector<const void*>& host, const std::vector<uint32_t>& tags,
+                                        const io::CheckpointHeader& header) const
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::vector<uint32_t>> packed;
+    std::vector<io::CheckpointSection> sections;
+    for (size_t i = 0; i < tags.size(); ++i)
+        packed.push_back(packResidue(static_cast<const uint64_t*>(host[i])));
+    uint64_t total = 0;
+    for (size_t i = 0; i < tags.size(); ++i) {
+        sections.push_back({tags[i], packed[i].data(), packed[i].size() * sizeof(uint32_t)});
+        total += packed[i].size() * sizeof(uint32_t);
+    }
+    if (!io::writeCheckpoint(ckptFilename_, header, sections))
+        std::cerr << "Error saving checkpoint to " << ckptFilename_ << std::endl;
+    else
+        Metrics::checkpoint(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(), total);
+}
+
+void BackupManager::saveCheckpoint(cl_mem buffer, uint64_t iter,
+                                   cl_mem correctbuffer, cl_mem bufferd, cl_mem last_correctbufferd,
+                                   uint64_t itersave, uint64_t jsave)
+{
+    util::TraceSpan span("checkpoint_save");
+    flush();
+    const size_t bytes = vectorSize_ * sizeof(uint64_t);
+    std::vector<cl_mem> src;
+    const std::vector<uint32_t> tags = checkpointSections({buffer, bufferd, last_correctbufferd, correctbuffer}, src);
+    std::vector<util::HostPool::Lease> x;
+    std::vector<const void*> host;
+    for (size_t i = 0; i < src.size(); ++i) {
+        x.push_back(util::HostPool::acquire(vectorSize_, false));
+        staging_.read(src[i], x[i].data(), bytes);
+        host.push_back(x[i].data());
+    }
+    writeCheckpointFrom(host, tags, makeCheckpointHeader(iter, itersave, jsave));
+    std::cout << "\nCheckpoint at iteration " << iter + 1 << " saved to " << ckptFilename_ << std::endl;
+}
+
+void BackupManager::saveCheckpointAsync(cl_mem buffer, uint64_t iter,
+                                        cl_mem correctbuffer, cl_mem bufferd, cl_mem last_correctbufferd,
+                                        uint64_t itersave, uint64_t jsave)
+{
+    const io::CheckpointHeader header = makeCheckpointHeader(iter, itersave, jsave);
+    std::vector<cl_mem> src;
+    const std::vector<uint32_t> tags = checkpointSections({buffer, bufferd, last_correctbufferd, correctbuffer}, src);
+    auto write = [this, header, tags](const std::vector<const void*>& host) {
+        writeCheckpointFrom(host, tags, header);
+    };
+    if (!startAsync(src, write)) {
+        saveCheckpoint(buffer, iter, correctbuffer, bufferd, last_correctbufferd, itersave, jsave);
+        return;
+    }
+    std::cout << "\nCheckpoint at iteration " << iter + 1 << " queued to " << ckptFilename_ << std::endl;
+}
+
+bool BackupManager::loadCheckpointSection(uint32_t tag, std::vector<uint64_t>& x, const char* what) const {
+    if (!ckptLoaded_) return false;
+    auto it = ckptSections_.find(tag);
+    if (it == ckptSections_.end() || !unpackResidue(it->second, x)) return false;
+    std::cout << "Loaded " << what << " from " << std::filesystem::absolute(ckptFilename_) << std::endl;
+    return true;
+}
+
+bool BackupManager::unpackResidue(const std::vector<uint8_t>& data, std::vector<uint64_t>& x) const {
+    const size_t packedBytes = ((packedBits_ + 31) / 32) * sizeof(uint32_t);
+    if (data.size() == packedBytes && x.size() == digitWidth_.size()) {
+        std::vector<uint32_t> words(packedBytes / sizeof(uint32_t));
+        std::memcpy(words.data(), data.data(), packedBytes);
+        x = io::JsonBuilder::expandBits(words, digitWidth_, packedBits_);
+    } else if (data.size() == x.size() * sizeof(uint64_t)) {
+        // raw limbs, as written before residues were packed
+        std::memcpy(x.data(), data.data(), data.size());
+    } else {
+        return false;
+    }
+    return true;
+}
+
 uint64_t BackupManager::loadStatePM1S2(cl_mem hqBuf,
                                        cl_mem qBuf,
                                        size_t bytes)
@@ -93,21 +388,47 @@ uint64_t BackupManager::loadStatePM1S2(cl_mem hqBuf,
     
     uint64_t resume = 0;
     if(!marin_){
+        // the container first, then the .hq/.q/.loop2 files of older runs
+        io::CheckpointHeader h;
+        std::map<uint32_t, std::vector<uint8_t>> sections;
+        if (std::filesystem::exists(s2CkptFilename_) && io::readCheckpoint(s2CkptFilename_, h, sections)) {
+            std::vector<uint64_t> hq(vectorSize_), q(vectorSize_);
+            auto hqIt = sections.find(kSectionStage2Hq), qIt = sections.find(kSectionStage2Q);
+            if (h.exponent == exponent_ && h.mode == kModeStage2 && h.transformSize == vectorSize_ &&
+                bytes == vectorSize_ * sizeof(uint64_t) && hqIt != sections.end() && qIt != sections.end() &&
+                unpackResidue(hqIt->second, hq) && unpackResidue(qIt->second, q)) {
+                staging_.write(hqBuf, hq.data(), bytes);
+                staging_.write(qBuf, q.data(), bytes);
+                std::cout << "Stage-2 resume at p = " << h.iteration << " from "
+                          << std::filesystem::absolute(s2CkptFilename_) << std::endl;
+                return h.iteration;
+            }
+            std::cerr << "Warning: ignoring " << s2CkptFilename_
+                      << " (exponent or transform size differ)" << std::endl;
+        }
         std::ifstream loopIn(loop2Filename_);
-        if (loopIn >> resume && resume > 0) {
-            std::cout << "Stage-2 resume at iteration " << resume << std::endl;
+        std::string tag;
+        // "p=<next prime bound>"; older files only held a counter and cannot
+        // be mapped to a position in (B1, B2].
+        if (loopIn >> tag && tag.rfind("p=", 0) != 0) {
+            std::cerr << "Warning: ignoring old stage 2 checkpoint " << loop2Filename_ << std::endl;
+            return 0;
+        }
+        if (!tag.empty()) resume = std::strtoull(tag.c_str() + 2, nullptr, 10);
+        if (resume > 0) {
+            std::cout << "Stage-2 resume at p = " << resume << std::endl;
             std::vector<uint64_t> tmp(bytes / sizeof(uint64_t));
 
             std::ifstream hqIn(hqFilename_, std::ios::binary);
             if (hqIn) {
                 hqIn.read(reinterpret_cast<char*>(tmp.data()), bytes);
-                clEnqueueWriteBuffer(queue_, hqBuf, CL_TRUE, 0, bytes, tmp.data(), 0, nullptr, nullptr);
+                staging_.write(hqBuf, tmp.data(), bytes);
             }
 
             std::ifstream qIn(qFilename_, std::ios::binary);
             if (qIn) {
                 qIn.read(reinterpret_cast<char*>(tmp.data()), bytes);
-                clEnqueueWriteBuffer(queue_, qBuf, CL_TRUE, 0, bytes, tmp.data(), 0, nullptr, nullptr);
+                staging_.write(qBuf, tmp.data(), bytes);
             }
             std::cout << "Stage-2 buffers restored" << std::endl;
         }
@@ -117,6 +438,7 @@ uint64_t BackupManager::loadStatePM1S2(cl_mem hqBuf,
 
 void BackupManager::loadGerbiczLiBufDState(std::vector<uint64_t>& x) {
     if(!marin_){
+        if (loadCheckpointSection(kSectionBufD, x, "GerbiczLiBufD")) return;
         std::ifstream in(GerbiczLiBufDFilename_, std::ios::binary);
         if (in) {
             in.read(reinterpret_cast<char*>(x.data()), x.size() * sizeof(uint64_t));
@@ -132,6 +454,7 @@ void BackupManager::loadGerbiczLiBufDState(std::vector<uint64_t>& x) {
 
 void BackupManager::loadGerbiczLiCorrectState(std::vector<uint64_t>& x) {
     if(!marin_){
+        if (loadCheckpointSection(kSectionCorrectState, x, "GerbiczLiCorrectBuf")) return;
         std::ifstream in(GerbiczLiCorrectBufFilename_, std::ios::binary);
         if (in) {
             in.read(reinterpret_cast<char*>(x.data()), x.size() * sizeof(uint64_t));
@@ -146,6 +469,7 @@ void BackupManager::loadGerbiczLiCorrectState(std::vector<uint64_t>& x) {
 
 void BackupManager::loadGerbiczLiCorrectBufDState(std::vector<uint64_t>& x) {
     if(!marin_){
+        if (loadCheckpointSection(kSectionLastBufD, x, "GerbiczLiLastBufD")) return;
         std::ifstream in(GerbiczLiLastBufDFilename_, std::ios::binary);
         if (in) {
             in.read(reinterpret_cast<char*>(x.data()), x.size() * sizeof(uint64_t));
@@ -161,6 +485,10 @@ void BackupManager::loadGerbiczLiCorrectBufDState(std::vector<uint64_t>& x) {
 uint64_t core::BackupManager::loadGerbiczIterSave() {
     uint64_t v = 0;
     if(!marin_){
+        if (ckptLoaded_) {
+            std::cout << "Loaded GerbiczLiIterSave: " << ckptHeader_.itersave << " from " << std::filesystem::absolute(ckptFilename_) << std::endl;
+            return ckptHeader_.itersave;
+        }
         std::ifstream in(GerbiczLiIterSaveFilename_);
         if (in) {
             in >> v;
@@ -175,6 +503,10 @@ uint64_t core::BackupManager::loadGerbiczIterSave() {
 uint64_t core::BackupManager::loadGerbiczJSave() {
     uint64_t v = 0;
     if(!marin_){
+        if (ckptLoaded_) {
+            std::cout << "Loaded GerbiczLiJSave: " << ckptHeader_.j << " from " << std::filesystem::absolute(ckptFilename_) << std::endl;
+            return ckptHeader_.j;
+        }
         std::ifstream in(GerbiczLiJSaveFilename_);
         if (in) {
             in >> v;
@@ -186,33 +518,77 @@ uint64_t core::BackupManager::loadGerbiczJSave() {
     return v;
 }
 
+// host = {Hq, Q}; iteration holds the bound below which every prime is in Q.
+void BackupManager::writeStage2From(const std::vector<const void*>& host, uint64_t nextP) const {
+    const auto t0 = std::chrono::steady_clock::now();
+    io::CheckpointHeader h;
+    h.exponent      = exponent_;
+    h.transformSize = static_cast<uint32_t>(vectorSize_);
+    h.mode          = kModeStage2;
+    h.iteration     = nextP;
+    const std::vector<uint32_t> hq = packResidue(static_cast<const uint64_t*>(host[0]));
+    const std::vector<uint32_t> q  = packResidue(static_cast<const uint64_t*>(host[1]));
+    const uint64_t total = (hq.size() + q.size()) * sizeof(uint32_t);
+    if (!io::writeCheckpoint(s2CkptFilename_, h, {{kSectionStage2Hq, hq.data(), hq.size() * sizeof(uint32_t)},
+                                                  {kSectionStage2Q,  q.data(),  q.size()  * sizeof(uint32_t)}})) {
+        std::cerr << "Error saving stage 2 checkpoint to " << s2CkptFilename_ << std::endl;
+        return;
+    }
+    Metrics::checkpoint(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(), total);
+}
+
 void BackupManager::saveStatePM1S2(cl_mem hqBuf,
                                    cl_mem qBuf,
-                                   uint64_t idx,
+                                   uint64_t nextP,
                                    size_t bytes)
 {
+    flush();
     if(!marin_){
-        std::vector<uint64_t> tmp(bytes / sizeof(uint64_t));
-
-        clEnqueueReadBuffer(queue_, hqBuf, CL_TRUE, 0, bytes, tmp.data(), 0, nullptr, nullptr);
-        std::ofstream hqOut(hqFilename_, std::ios::binary);
-        if (hqOut) hqOut.write(reinterpret_cast<char*>(tmp.data()), bytes);
-
-        clEnqueueReadBuffer(queue_, qBuf, CL_TRUE, 0, bytes, tmp.data(), 0, nullptr, nullptr);
-        std::ofstream qOut(qFilename_, std::ios::binary);
-        if (qOut) qOut.write(reinterpret_cast<char*>(tmp.data()), bytes);
-
-        std::ofstream loopOut(loop2Filename_);
-        if (loopOut) loopOut << (idx + 1);
+        util::HostPool::Lease hq = util::HostPool::acquire(bytes / sizeof(uint64_t), false);
+        util::HostPool::Lease q  = util::HostPool::acquire(bytes / sizeof(uint64_t), false);
+        staging_.read(hqBuf, hq.data(), bytes);
+        staging_.read(qBuf, q.data(), bytes);
+        writeStage2From({hq.data(), q.data()}, nextP);
+        std::cout << "Stage-2 backup saved at p = " << nextP << std::endl;
+    }
+}
 
-        std::cout << "Stage-2 backup saved at iteration " << idx + 1 << std::endl;
+void BackupManager::saveStatePM1S2Async(cl_mem hqBuf, cl_mem qBuf, uint64_t nextP, size_t bytes) {
+    if (marin_) return;
+    auto write = [this, nextP](const std::vector<const void*>& host) { writeStage2From(host, nextP); };
+    if (!startAsync({hqBuf, qBuf}, write)) {
+        saveStatePM1S2(hqBuf, qBuf, nextP, bytes);
+        return;
     }
+    std::cout << "Stage-2 backup at p = " << nextP << " queued to " << s2CkptFilename_ << std::endl;
 }
 
 
 uint64_t BackupManager::loadState(std::vector<uint64_t>& x) {
+    util::TraceSpan span("state_load");
     uint64_t resume = 0;
 
+    // Single-file checkpoint first; it also feeds the Gerbicz-Li loaders.
+    if (!marin_ && !ckptFilename_.empty() && std::filesystem::exists(ckptFilename_)) {
+        io::CheckpointHeader h;
+        std::map<uint32_t, std::vector<uint8_t>> sections;
+        if (io::readCheckpoint(ckptFilename_, h, sections)) {
+            if (h.exponent == exponent_ && h.mode == mode_ && h.transformSize == vectorSize_ && h.iteration > 0) {
+                ckptHeader_   = h;
+                ckptSections_ = std::move(sections);
+                ckptLoaded_   = true;
+                if (loadCheckpointSection(kSectionState, x, "state")) {
+                    std::cout << "Resuming from iteration " << h.iteration << std::endl;
+                    return h.iteration;
+                }
+                ckptLoaded_ = false;
+            } else {
+                std::cerr << "Warning: ignoring " << ckptFilename_
+                          << " (exponent, mode or transform size differ)" << std::endl;
+            }
+        }
+    }
+
     // 1) Debug : afficher le chemin absolu du .loop
     auto absLoop = std::filesystem::absolute(loopFilename_);
     std::cout << "Looking for loop file at " << absLoop << std::endl;
@@ -250,10 +626,11 @@ uint64_t BackupManager::loadState(std::vector<uint64_t>& x) {
 
 
 void BackupManager::saveState(cl_mem buffer, uint64_t iter, const mpz_class* E_ptr) {
-    std::vector<uint64_t> x(vectorSize_);
-    clEnqueueReadBuffer(queue_, buffer, CL_TRUE,
-                        0, vectorSize_ * sizeof(uint64_t),
-                        x.data(), 0, nullptr, nullptr);
+    util::TraceSpan span("state_save");
+    flush();
+    const auto t0 = std::chrono::steady_clock::now();
+    util::HostPool::Lease x = util::HostPool::acquire(vectorSize_, false);
+    staging_.read(buffer, x.data(), vectorSize_ * sizeof(uint64_t));
 
     std::ofstream mersOut(mersFilename_, std::ios::binary);
     if (mersOut) {
@@ -271,6 +648,8 @@ void BackupManager::saveState(cl_mem buffer, uint64_t iter, const mpz_class* E_p
     } else {
         std::cerr << "Error saving loop state to " << loopFilename_ << std::endl;
     }
+    Metrics::checkpoint(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(),
+                        vectorSize_ * sizeof(uint64_t));
 
    if (mode_ == "pm1" && E_ptr != nullptr) {
         std::atomic<bool> done{false};
@@ -301,10 +680,10 @@ void BackupManager::saveState(cl_mem buffer, uint64_t iter, const mpz_class* E_p
 }
 
 void BackupManager::saveGerbiczLiState(cl_mem correctbuffer,cl_mem bufferd,cl_mem last_correctbufferd, uint64_t itersave, uint64_t jsave, const mpz_class* E_ptr) {
-    std::vector<uint64_t> x(vectorSize_);
-    clEnqueueReadBuffer(queue_, bufferd, CL_TRUE,
-                        0, vectorSize_ * sizeof(uint64_t),
-                        x.data(), 0, nullptr, nullptr);
+    util::TraceSpan span("gerbicz_state_save");
+    flush();
+    util::HostPool::Lease x = util::HostPool::acquire(vectorSize_, false);
+    staging_.read(bufferd, x.data(), vectorSize_ * sizeof(uint64_t));
     std::ofstream mersOut(GerbiczLiBufDFilename_, std::ios::binary);
     if (mersOut) {
         mersOut.write(reinterpret_cast<const char*>(x.data()),
@@ -313,9 +692,7 @@ void BackupManager::saveGerbiczLiState(cl_mem correctbuffer,cl_mem bufferd,cl_me
     } else {
         std::cerr << "Error saving GerbiczLiBufD to " << GerbiczLiBufDFilename_ << std::endl;
     }
-    clEnqueueReadBuffer(queue_, last_correctbufferd, CL_TRUE,
-                        0, vectorSize_ * sizeof(uint64_t),
-                        x.data(), 0, nullptr, nullptr);
+    staging_.read(last_correctbufferd, x.data(), vectorSize_ * sizeof(uint64_t));
     std::ofstream mersOut3(GerbiczLiLastBufDFilename_, std::ios::binary);
     if (mersOut3) {
         mersOut3.write(reinterpret_cast<const char*>(x.data()),
@@ -325,9 +702,7 @@ void BackupManager::saveGerbiczLiState(cl_mem correctbuffer,cl_mem bufferd,cl_me
         std::cerr << "Error saving GerbiczLiLastBufD to " << GerbiczLiLastBufDFilename_ << std::endl;
     }
 
-    clEnqueueReadBuffer(queue_, correctbuffer, CL_TRUE,
-                        0, vectorSize_ * sizeof(uint64_t),
-                        x.data(), 0, nullptr, nullptr);
+    staging_.read(correctbuffer, x.data(), vectorSize_ * sizeof(uint64_t));
     std::ofstream  mersOut2(GerbiczLiCorrectBufFilename_, std::ios::binary);
     
     if (mersOut2) {
@@ -372,6 +747,16 @@ mpz_class BackupManager::loadExponent() const {
 }
 
 
+void BackupManager::clearStatePM1S2() {
+    flush();
+    if(!marin_){
+        std::error_code ec;
+        for (const std::string& f : {s2CkptFilename_, hqFilename_, qFilename_, loop2Filename_}) {
+            if (!f.empty()) std::filesystem::remove(f, ec);
+        }
+    }
+}
+
 void BackupManager::clearState() const {
     if(!marin_){
         std::error_code ec;
@@ -381,12 +766,14 @@ void BackupManager::clearState() const {
                 std::cout << "Removed file: " << f << std::endl;
             }
         };
+        rm(ckptFilename_);
         rm(mersFilename_);
         rm(loopFilename_);
         rm(exponentFilename_);
         rm(hqFilename_);
         rm(qFilename_);
         rm(loop2Filename_);
+        rm(s2CkptFilename_);
         rm(GerbiczLiBufDFilename_);
         rm(GerbiczLiCorrectBufFilename_);
         rm(GerbiczLiIterSaveFilename_);
@@ -0,0 +1,216 @@
+// src/core/BenchReport.cpp
+#include "core/BenchReport.hpp"
+#include "util/JsonFile.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace core {
+
+namespace {
+
+// CSV cells never contain quotes here, commas are dropped from free text.
+std::string csvCell(const std::string& s) {
+    std::string out;
+    for (char c : s)
+        if (c != ',' && c != '"' && static_cast<unsigned char>(c) >= 0x20) out += c;
+    return out;
+}
+
+// Numeric value of "key" inside one flat JSON object.
+std::optional<double> number(const std::string& obj, const std::string& key) {
+    const std::string tag = "\"" + key + "\"";
+    size_t pos = obj.find(tag);
+    if (pos == std::string::npos) return std::nullopt;
+    pos = obj.find(':', pos + tag.size());
+    if (pos == std::string::npos) return std::nullopt;
+    const char* begin = obj.c_str() + pos + 1;
+    char* end = nullptr;
+    const double v = std::strtod(begin, &end);
+    if (end == begin) return std::nullopt;
+    return v;
+}
+
+std::vector<std::string> split(const std::string& line) {
+    std::vector<std::string> out;
+    std::stringstream ss(line);
+    std::string cell;
+    while (std::getline(ss, cell, ',')) {
+        while (!cell.empty() && std::isspace(static_cast<unsigned char>(cell.back()))) cell.pop_back();
+        out.push_back(cell);
+    }
+    return out;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size()
+        && std::equal(suffix.rbegin(), suffix.rend(), s.rbegin(),
+                      [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+}
+
+std::optional<std::vector<BenchResult>> loadJson(const std::string& text) {
+    size_t pos = text.find("\"results\"");
+    if (pos == std::string::npos) return std::nullopt;
+    std::vector<BenchResult> rows;
+    while ((pos = text.find('{', pos)) != std::string::npos) {
+        size_t end = text.find('}', pos);
+        if (end == std::string::npos) break;
+        const std::string obj = text.substr(pos, end - pos + 1);
+        pos = end + 1;
+
+        auto p = number(obj, "exponent"), us = number(obj, "us_per_iter");
+        if (!p || !us) continue;
+        BenchResult r;
+        r.exponent    = static_cast<uint32_t>(*p);
+        r.us_per_iter = *us;
+        if (auto v = number(obj, "transform")) r.transform = static_cast<uint32_t>(*v);
+        if (auto v = number(obj, "ips"))       r.ips = *v;
+        if (auto v = number(obj, "gbps"))      r.gbps = *v;
+        if (auto v = number(obj, "joules_per_iter")) r.joules_per_iter = *v;
+        rows.push_back(r);
+    }
+    return rows;
+}
+
+std::optional<std::vector<BenchResult>> loadCsv(std::istream& in) {
+    std::string line;
+    std::map<std::string, size_t> col;
+    std::vector<BenchResult> rows;
+    while (std::getline(in, line)) {
+        const auto cells = split(line);
+        if (cells.empty()) continue;
+        // header, possibly repeated when several files were concatenated
+        if (std::find(cells.begin(), cells.end(), "exponent") != cells.end()) {
+            col.clear();
+            for (size_t i = 0; i < cells.size(); ++i) col[cells[i]] = i;
+            continue;
+        }
+        if (!col.count("exponent") || !col.count("us_per_iter")) continue;
+        auto get = [&](const char* key) -> double {
+            auto it = col.find(key);
+            if (it == col.end() || it->second >= cells.size()) return 0.0;
+            return std::strtod(cells[it->second].c_str(), nullptr);
+        };
+        BenchResult r;
+        r.exponent    = static_cast<uint32_t>(get("exponent"));
+        r.transform   = static_cast<uint32_t>(get("transform"));
+        r.ips         = get("ips");
+        r.us_per_iter = get("us_per_iter");
+        r.gbps        = get("gbps");
+        r.joules_per_iter = get("joules_per_iter");
+        if (r.exponent != 0 && r.us_per_iter > 0.0) rows.push_back(r);
+    }
+    if (col.empty()) return std::nullopt;
+    return rows;
+}
+
+} // namespace
+
+double BenchReport::bandwidthGBps(uint32_t n, double usPerIter) {
+    if (usPerIter <= 0.0) return 0.0;
+    const double bytes = 3.0 * 2.0 * 8.0 * static_cast<double>(n);
+    return bytes / (usPerIter * 1e3);
+}
+
+bool BenchReport::writeJson(const std::string& path, const BenchDevice& dev,
+                            const std::vector<BenchResult>& rows, double score)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Warning: cannot write benchmark results to " << path << std::endl;
+        return false;
+    }
+    out << "{\n  \"device\": {"
+        << " \"vendor\": \"" << util::jsonEscape(dev.vendor) << "\","
+        << " \"name\": \"" << util::jsonEscape(dev.name) << "\","
+        << " \"driver\": \"" << util::jsonEscape(dev.driver) << "\","
+        << " \"compute_units\": " << dev.compute_units << ","
+        << " \"vram_bytes\": " << dev.vram << ","
+        << " \"local_mem_bytes\": " << dev.local_mem << ","
+        << " \"fp64\": \"" << util::jsonEscape(dev.fp64) << "\" },\n"
+        << "  \"score\": " << std::fixed << std::setprecision(2) << score << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const auto& r = rows[i];
+        out << "    { \"exponent\": " << r.exponent
+            << ", \"transform\": " << r.transform
+            << ", \"ips\": " << std::setprecision(3) << r.ips
+            << ", \"us_per_iter\": " << std::setprecision(4) << r.us_per_iter
+            << ", \"gbps\": " << std::setprecision(2) << r.gbps
+            << ", \"joules_per_iter\": " << std::setprecision(6) << r.joules_per_iter << " }"
+            << (i + 1 < rows.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+bool BenchReport::writeCsv(const std::string& path, const BenchDevice& dev,
+                           const std::vector<BenchResult>& rows)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Warning: cannot write benchmark results to " << path << std::endl;
+        return false;
+    }
+    out << "vendor,name,driver,compute_units,vram_bytes,local_mem_bytes,fp64,"
+           "exponent,transform,ips,us_per_iter,gbps,joules_per_iter\n";
+    for (const auto& r : rows) {
+        out << csvCell(dev.vendor) << ',' << csvCell(dev.name) << ',' << csvCell(dev.driver) << ','
+            << dev.compute_units << ',' << dev.vram << ',' << dev.local_mem << ',' << csvCell(dev.fp64) << ','
+            << r.exponent << ',' << r.transform << ','
+            << std::fixed << std::setprecision(3) << r.ips << ','
+            << std::setprecision(4) << r.us_per_iter << ','
+            << std::setprecision(2) << r.gbps << ','
+            << std::setprecision(6) << r.joules_per_iter << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+std::optional<std::vector<BenchResult>> BenchReport::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return std::nullopt;
+    if (endsWith(path, ".csv")) return loadCsv(in);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return loadJson(ss.str());
+}
+
+size_t BenchReport::compare(const std::vector<BenchResult>& baseline,
+                            const std::vector<BenchResult>& current,
+                            double thresholdPct, std::ostream& os)
+{
+    std::map<uint32_t, const BenchResult*> base;
+    for (const auto& r : baseline) base[r.exponent] = &r;
+
+    size_t regressions = 0, compared = 0;
+    const auto flags = os.flags();
+    const auto prec  = os.precision();
+    os << "\nExponent   Transform  base us/iter  now us/iter   change\n";
+    for (const auto& r : current) {
+        auto it = base.find(r.exponent);
+        if (it == base.end() || it->second->us_per_iter <= 0.0) continue;
+        const BenchResult& b = *it->second;
+        const double change = 100.0 * (r.us_per_iter / b.us_per_iter - 1.0);
+        const bool slower = change > thresholdPct;
+        ++compared;
+        if (slower) ++regressions;
+        os << std::setw(10) << r.exponent << " " << std::setw(10) << r.transform
+           << std::fixed << std::setprecision(2)
+           << std::setw(14) << b.us_per_iter << std::setw(13) << r.us_per_iter
+           << std::setw(8) << std::showpos << change << std::noshowpos << "%"
+           << (slower ? "  REGRESSION" : "")
+           << (b.transform != 0 && b.transform != r.transform ? "  (transform changed)" : "") << "\n";
+    }
+    os << compared << " exponent(s) compared, " << regressions
+       << " slower than the baseline by more than " << std::setprecision(1) << thresholdPct << "%\n";
+    os.flags(flags);
+    os.precision(prec);
+    return regressions;
+}
+
+} // namespace core
@@ -0,0 +1,93 @@
+// src/core/CheckCadence.cpp
+#include "core/CheckCadence.hpp"
+#include "util/JsonFile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+namespace core {
+
+namespace {
+
+// device -> (seconds, failures)
+std::map<std::string, std::pair<double, double>> parse(const std::string& text) {
+    std::map<std::string, std::pair<double, double>> rates;
+    for (const auto& obj : util::jsonObjects(text)) {
+        const std::string dev = util::jsonField(obj, "device").value_or("");
+        if (dev.empty()) continue;
+        rates[dev] = { std::strtod(util::jsonField(obj, "seconds").value_or("").c_str(), nullptr),
+                       std::strtod(util::jsonField(obj, "failures").value_or("").c_str(), nullptr) };
+    }
+    return rates;
+}
+
+} // namespace
+
+CheckCadence::CheckCadence(std::string path, std::string device, uint64_t B, uint64_t fixed)
+    : path_(std::move(path)), device_(std::move(device)), B_(std::max<uint64_t>(B, 1)), fixed_(fixed)
+{
+    const auto rates = parse(util::readJsonFile(path_));
+    if (auto it = rates.find(device_); it != rates.end()) {
+        seconds_  = it->second.first;
+        failures_ = it->second.second;
+    }
+}
+
+uint64_t CheckCadence::level(double ips) const {
+    if (fixed_ != 0) return fixed_;
+    if (!(ips > 0)) return 1;
+    const double lambda = (failures_ + newFailures_ + 1) / (seconds_ + newSeconds_ + kPriorSeconds);
+    const double cost = double(B_) / ips;
+    const double interval = std::min(std::sqrt(2 * cost / lambda), kMaxInterval) * scale_;
+    return std::max<uint64_t>(uint64_t(interval * ips / double(B_)), 1);
+}
+
+void CheckCadence::passed(double seconds) {
+    newSeconds_ += seconds;
+    scale_ = std::min(scale_ * 2, 1.0);
+}
+
+void CheckCadence::failed(double seconds) {
+    newSeconds_ += seconds;
+    newFailures_ += 1;
+    scale_ /= 2;
+}
+
+bool CheckCadence::save() {
+    if (newSeconds_ == 0 && newFailures_ == 0) return true;
+    std::pair<double, double> saved;
+    const bool ok = util::updateJsonFile(path_, [&](const std::string& current) {
+        // another run may have saved since: add to what the file holds now
+        auto rates = parse(current);
+        auto& r = rates[device_];
+        r.first  += newSeconds_;
+        r.second += newFailures_;
+        saved = r;
+        std::ostringstream out;
+        out << "{\n  \"devices\": [\n";
+        size_t i = 0;
+        for (const auto& [dev, rate] : rates) {
+            out << "    { \"device\": \"" << util::jsonEscape(dev) << "\""
+                << ", \"seconds\": " << std::fixed << std::setprecision(1) << rate.first
+                << ", \"failures\": " << std::setprecision(0) << rate.second
+                << " }" << (++i < rates.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return out.str();
+    });
+    if (!ok) {
+        std::cerr << "Warning: cannot write Gerbicz-Li rates " << path_ << std::endl;
+        return false;
+    }
+    seconds_  = saved.first;
+    failures_ = saved.second;
+    newSeconds_ = newFailures_ = 0;
+    return true;
+}
+
+} // namespace core
@@ -0,0 +1,294 @@
+// src/core/Daemon.cpp
+#include "core/Daemon.hpp"
+#include "core/App.hpp"
+#include "core/Metrics.hpp"
+#include "io/CliParser.hpp"
+#include "io/JsonBuilder.hpp"
+#include "io/WorktodoParser.hpp"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+#ifndef _WIN32
+namespace {
+
+volatile std::sig_atomic_t signalled = 0;
+void handle_signal(int) { signalled = 1; App::requestStop(); }
+
+// The App of an entry fails this many times in a row before the entry is
+// set aside in <worktodo>.failed, so one bad assignment does not wedge the daemon.
+constexpr int kMaxFailures = 3;
+
+struct State {
+    std::mutex              mutex;
+    std::condition_variable wake, idle;
+    bool                    quit = false;
+    bool                    preempting = false;
+    std::string             current;     // line of the running entry, empty when idle
+    std::string             handedBack;  // line given up by the last preempt
+    std::string             lastError;
+    uint64_t                completed = 0;
+};
+
+// The first line an App would run, empty when the file has none.
+std::string firstEntry(const std::string& path) {
+    return io::WorktodoParser(path).firstLine();
+}
+
+// Removes the first copy of `line` from `path`.
+void dropEntry(const std::string& path, const std::string& line) {
+    if (!io::WorktodoParser(path).drop(line))
+        std::cerr << "Cannot update " << path << "\n";
+}
+
+std::string reply(bool ok, const std::string& fields = {}) {
+    return std::string("{\"ok\":") + (ok ? "true" : "false") + (fields.empty() ? "" : "," + fields) + "}";
+}
+
+std::string error(const std::string& what) {
+    return reply(false, "\"error\":" + io::JsonBuilder::quote(what));
+}
+
+std::string handle(State& st, io::WorktodoParser& shared, const std::string& worktodo, const std::string& request) {
+    const auto cmd = io::JsonBuilder::stringField(request, "cmd");
+    if (!cmd) return error("missing cmd");
+
+    if (*cmd == "assign") {
+        const auto line = io::JsonBuilder::stringField(request, "line");
+        if (!line || line->find('\n') != std::string::npos || !io::WorktodoParser::parseLine(*line))
+            return error("not a worktodo entry");
+        if (!shared.append(*line)) return error("cannot write " + worktodo);
+        std::lock_guard<std::mutex> lock(st.mutex);
+        st.wake.notify_all();
+        return reply(true, "\"queued\":" + std::to_string(shared.pendingCount()));
+    }
+
+    if (*cmd == "status") {
+        std::ostringstream f;
+        std::lock_guard<std::mutex> lock(st.mutex);
+        const char* state = st.quit ? "stopping" : (st.preempting ? "preempting" : (st.current.empty() ? "idle" : "running"));
+        f << "\"state\":\"" << state << "\"";
+        if (!st.current.empty()) {
+            const Metrics::Progress p = Metrics::progress();
+            f << ",\"line\":" << io::JsonBuilder::quote(st.current)
+              << ",\"exponent\":" << p.exponent
+              << ",\"mode\":" << io::JsonBuilder::quote(p.mode)
+              << ",\"iteration\":" << p.iteration
+              << ",\"iterations\":" << p.iterations;
+        }
+        f << ",\"queued\":" << shared.pendingCount()
+          << ",\"completed\":" << st.completed;
+        if (!st.lastError.empty()) f << ",\"last_error\":" << io::JsonBuilder::quote(st.lastError);
+        return reply(true, f.str());
+    }
+
+    if (*cmd == "preempt") {
+        std::unique_lock<std::mutex> lock(st.mutex);
+        if (st.current.empty() || st.quit) return reply(true, "\"line\":\"\"");
+        st.preempting = true;
+        App::requestStop();
+        st.idle.wait(lock, [&] { return !st.preempting; });
+        return reply(true, "\"line\":" + io::JsonBuilder::quote(st.handedBack));
+    }
+
+    if (*cmd == "stop") {
+        std::lock_guard<std::mutex> lock(st.mutex);
+        st.quit = true;
+        App::requestStop();
+        st.wake.notify_all();
+        return reply(true, "\"state\":\"stopping\"");
+    }
+
+    return error("unknown cmd " + *cmd);
+}
+
+// Control thread: one client at a time, one JSON request per line.
+void serve(State& st, int listenFd, io::WorktodoParser& shared, const std::string& worktodo) {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(st.mutex);
+            if (st.quit && st.current.empty()) return;
+        }
+        pollfd pfd{ listenFd, POLLIN, 0 };
+        if (::poll(&pfd, 1, 500) <= 0) continue;
+        const int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) continue;
+        std::string buf;
+        char chunk[4096];
+        for (;;) {
+            const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n <= 0) break;
+            buf.append(chunk, static_cast<std::size_t>(n));
+            std::size_t eol;
+            while ((eol = buf.find('\n')) != std::string::npos) {
+                const std::string request = buf.substr(0, eol);
+                buf.erase(0, eol + 1);
+                const std::string out = handle(st, shared, worktodo, request) + "\n";
+                if (::write(fd, out.data(), out.size()) < 0) break;
+            }
+            if (buf.size() > 65536) break;
+        }
+        ::close(fd);
+    }
+}
+
+} // namespace
+#endif
+
+std::optional<int> Daemon::run(int argc, char** argv) {
+    bool daemon = false, exclusive = false;
+    io::CliOptions defaults;
+    std::string worktodo = defaults.worktodo_path, savePath = defaults.save_path, socketPath;
+    // The Apps get every argument but these (and a leading exponent).
+    std::vector<std::string> passed{ argv[0] };
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--daemon") == 0 || std::strcmp(argv[i], "-daemon") == 0) { daemon = true; continue; }
+        if (std::strcmp(argv[i], "-socket") == 0 && hasValue) { socketPath = argv[++i]; continue; }
+        if (std::strcmp(argv[i], "-worktodo") == 0 && hasValue) { worktodo = argv[++i]; continue; }
+        if (std::strcmp(argv[i], "-f") == 0 && hasValue) savePath = argv[i + 1];
+        if (std::strcmp(argv[i], "-devices") == 0 || std::strcmp(argv[i], "-batch") == 0) exclusive = true;
+        if (i == 1 && std::strspn(argv[i], "0123456789") == std::strlen(argv[i])) continue;
+        passed.emplace_back(argv[i]);
+    }
+    if (!daemon) return std::nullopt;
+    if (exclusive) {
+        std::cerr << "Error: --daemon cannot be combined with -devices or -batch" << std::endl;
+        return 1;
+    }
+#ifdef _WIN32
+    std::cerr << "Error: --daemon is not supported on Windows" << std::endl;
+    return 1;
+#else
+    std::error_code ec;
+    std::filesystem::create_directories(savePath, ec);
+    if (socketPath.empty()) socketPath = (std::filesystem::path(savePath) / "prmers.sock").string();
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path " << socketPath << " is too long" << std::endl;
+        return 1;
+    }
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    const int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Error: cannot create the control socket: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    // a socket left behind by a killed daemon
+    ::unlink(socketPath.c_str());
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, 8) != 0) {
+        std::cerr << "Error: cannot listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        ::close(listenFd);
+        return 1;
+    }
+    // only this user may hand out work
+    ::chmod(socketPath.c_str(), 0600);
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    const std::string own = worktodo + ".daemon";
+    passed.insert(passed.end(), { "-worktodo", own });
+    std::vector<char*> c_argv;
+    for (auto& a : passed) c_argv.push_back(const_cast<char*>(a.c_str()));
+    c_argv.push_back(nullptr);
+
+    State st;
+    io::WorktodoParser shared(worktodo);
+    std::thread control(serve, std::ref(st), listenFd, std::ref(shared), std::cref(worktodo));
+    std::cout << "Daemon listening on " << socketPath << ", entries from " << worktodo << std::endl;
+
+    Session session;
+    int failures = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(st.mutex);
+            // a signal while idle; an App installs its own SIGINT handler
+            if (signalled || App::stopRequested()) st.quit = true;
+            if (st.quit) break;
+        }
+        std::string line = firstEntry(own);
+        if (line.empty() && shared.pendingCount() != 0) {
+            if (auto entry = shared.claimFirst(own)) line = entry->rawLine;
+        }
+        if (line.empty()) {
+            std::unique_lock<std::mutex> lock(st.mutex);
+            st.wake.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        {
+            // a preempt from now on stops this entry
+            std::lock_guard<std::mutex> lock(st.mutex);
+            App::requestStop(false);
+            st.current = line;
+        }
+        std::string failure;
+        try {
+            App app(static_cast<int>(passed.size()), c_argv.data(), session);
+            app.run();
+        } catch (const std::exception& e) {
+            failure = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(st.mutex);
+        const bool finished = firstEntry(own) != line;
+        st.current.clear();
+        if (st.preempting) {
+            if (!finished) dropEntry(own, line);
+            st.handedBack = finished ? std::string() : line;
+            st.preempting = false;
+            App::requestStop(false);
+            st.idle.notify_all();
+            failures = 0;
+            continue;
+        }
+        if (finished) {
+            ++st.completed;
+            failures = 0;
+        } else if (!failure.empty()) {
+            st.lastError = failure;
+            std::cerr << "Daemon: " << line << " failed: " << failure << std::endl;
+            if (++failures >= kMaxFailures) {
+                dropEntry(own, line);
+                std::ofstream(worktodo + ".failed", std::ios::app) << line << "\n";
+                std::cerr << "Daemon: moved " << line << " to " << worktodo << ".failed" << std::endl;
+                failures = 0;
+            }
+        } else if (App::stopRequested()) {
+            // Ctrl-C or SIGTERM while testing: the entry stays in the daemon file
+            st.quit = true;
+        }
+    }
+
+    control.join();
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+    std::cout << "Daemon stopped" << (firstEntry(own).empty() ? "" : ", the running entry stays in " + own) << std::endl;
+    return 0;
+#endif
+}
+
+} // namespace core
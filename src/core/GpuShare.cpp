@@ -0,0 +1,231 @@
+// src/core/GpuShare.cpp
+#include "core/GpuShare.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+#ifndef _WIN32
+namespace {
+
+enum State : int32_t { Free = 0, Idle = 1, Waiting = 2, Holding = 3 };
+
+struct Slot {
+    int64_t pid;
+    double  weight;
+    double  vtime;      // seconds of device time held, per unit of weight
+    int32_t state;
+    int32_t pad;
+};
+
+constexpr uint32_t kMagic = 0x50534855;    // "UHSP"
+
+template <int N>
+struct Table {
+    uint32_t magic;
+    uint32_t count;
+    Slot     slots[N];
+};
+
+// The table stays locked while it lives; the lock goes with the process.
+class Locked {
+public:
+    explicit Locked(int fd) : fd_(fd) {
+        while (::flock(fd_, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+    ~Locked() { ::flock(fd_, LOCK_UN); }
+    Locked(const Locked&) = delete;
+    Locked& operator=(const Locked&) = delete;
+private:
+    int fd_;
+};
+
+template <int N>
+Table<N> load(int fd) {
+    Table<N> t;
+    if (::pread(fd, &t, sizeof(t), 0) != static_cast<ssize_t>(sizeof(t)) || t.magic != kMagic || t.count != N) {
+        std::memset(&t, 0, sizeof(t));
+        t.magic = kMagic;
+        t.count = N;
+    }
+    // the slots of the jobs that are gone, the token too if one held it
+    for (Slot& s : t.slots) {
+        if (s.state == Free) continue;
+        const pid_t pid = static_cast<pid_t>(s.pid);
+        if (pid != ::getpid() && ::kill(pid, 0) != 0 && errno != EPERM) s = Slot{};
+    }
+    return t;
+}
+
+template <int N>
+void store(int fd, const Table<N>& t) {
+    if (::pwrite(fd, &t, sizeof(t), 0) != static_cast<ssize_t>(sizeof(t)))
+        std::cerr << "Warning: cannot write the GPU share table" << std::endl;
+}
+
+// The least vtime of the jobs other than `self`, +inf when there is none.
+template <int N>
+double othersMin(const Table<N>& t, int self) {
+    double m = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < N; ++i)
+        if (i != self && t.slots[i].state != Free) m = std::min(m, t.slots[i].vtime);
+    return m;
+}
+
+} // namespace
+#endif
+
+std::string GpuShare::defaultPath(int device) {
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+    if (ec) dir = ".";
+    return (dir / ("prmers_gpu" + std::to_string(device) + ".share")).string();
+}
+
+#ifdef _WIN32
+
+std::unique_ptr<GpuShare> GpuShare::open(const std::string&, double weight) {
+    if (weight > 0) std::cerr << "Warning: -gpushare is not available on this platform" << std::endl;
+    return nullptr;
+}
+GpuShare::GpuShare(int fd, int slot, double weight) : fd_(fd), slot_(slot), weight_(weight) {}
+GpuShare::~GpuShare() {}
+void GpuShare::yield(const std::function<void()>&) {}
+void GpuShare::release() {}
+void GpuShare::acquire() {}
+double GpuShare::sinceTurn() const { return 0; }
+
+#else
+
+std::unique_ptr<GpuShare> GpuShare::open(const std::string& path, double weight) {
+    if (!(weight > 0)) return nullptr;
+    std::error_code ec;
+    const auto parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        std::cerr << "Warning: cannot open the GPU share table " << path << ", the GPU is not shared" << std::endl;
+        return nullptr;
+    }
+    int slot = -1;
+    {
+        Locked lock(fd);
+        auto t = load<kSlots>(fd);
+        for (int i = 0; i < kSlots && slot < 0; ++i)
+            if (t.slots[i].state == Free) slot = i;
+        if (slot >= 0) {
+            // a newcomer starts level with the others, not owed their past
+            const double m = othersMin(t, slot);
+            t.slots[slot] = Slot{static_cast<int64_t>(::getpid()), weight, std::isfinite(m) ? m : 0.0, Idle, 0};
+            store(fd, t);
+        }
+    }
+    if (slot < 0) {
+        std::cerr << "Warning: " << kSlots << " jobs already share " << path << ", this one does not" << std::endl;
+        ::close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<GpuShare>(new GpuShare(fd, slot, weight));
+}
+
+GpuShare::GpuShare(int fd, int slot, double weight) : fd_(fd), slot_(slot), weight_(weight) {}
+
+GpuShare::~GpuShare() {
+    release();
+    {
+        Locked lock(fd_);
+        auto t = load<kSlots>(fd_);
+        t.slots[slot_] = Slot{};
+        store(fd_, t);
+    }
+    ::close(fd_);
+}
+
+double GpuShare::sinceTurn() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - turn_).count();
+}
+
+void GpuShare::acquire() {
+    const auto t0 = std::chrono::steady_clock::now();
+    bool first = true;
+    for (;;) {
+        {
+            Locked lock(fd_);
+            auto t = load<kSlots>(fd_);
+            Slot& me = t.slots[slot_];
+            if (me.state == Free) me = Slot{static_cast<int64_t>(::getpid()), weight_, 0.0, Idle, 0};
+            if (first) {
+                // a job back from other work is owed one slice at most
+                const double m = othersMin(t, slot_);
+                if (std::isfinite(m)) me.vtime = std::max(me.vtime, m - kSliceMs * 1e-3);
+                first = false;
+            }
+            me.state = Waiting;
+            bool next = true;
+            for (int i = 0; i < kSlots && next; ++i) {
+                const Slot& s = t.slots[i];
+                if (i == slot_ || s.state == Free) continue;
+                if (s.state == Holding) next = false;
+                if (s.state == Waiting && (s.vtime < me.vtime || (s.vtime == me.vtime && i < slot_))) next = false;
+            }
+            if (next) me.state = Holding;
+            store(fd_, t);
+            if (next) break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(kPollUs));
+    }
+    turn_ = std::chrono::steady_clock::now();
+    waited_ += std::chrono::duration<double>(turn_ - t0).count();
+    holding_ = true;
+}
+
+void GpuShare::release() {
+    if (!holding_) return;
+    Locked lock(fd_);
+    auto t = load<kSlots>(fd_);
+    t.slots[slot_].vtime += sinceTurn() / weight_;
+    t.slots[slot_].state = Idle;
+    store(fd_, t);
+    holding_ = false;
+}
+
+void GpuShare::yield(const std::function<void()>& drain) {
+    if (!holding_) {
+        acquire();
+        return;
+    }
+    if (sinceTurn() * 1e3 < kSliceMs * weight_) return;
+    {
+        Locked lock(fd_);
+        auto t = load<kSlots>(fd_);
+        const bool waiting = std::any_of(std::begin(t.slots), std::end(t.slots), [](const Slot& s) { return s.state == Waiting; });
+        if (!waiting) {
+            // alone: a new slice without leaving the device idle
+            t.slots[slot_].vtime += sinceTurn() / weight_;
+            store(fd_, t);
+            turn_ = std::chrono::steady_clock::now();
+            return;
+        }
+    }
+    // the next job gets the device, not the tail of this one's queue
+    if (drain) drain();
+    release();
+    acquire();
+}
+
+#endif
+
+} // namespace core
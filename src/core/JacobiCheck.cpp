@@ -0,0 +1,100 @@
+// src/core/JacobiCheck.cpp
+#include "core/JacobiCheck.hpp"
+#include "util/GmpUtils.hpp"
+#include "util/Residue.hpp"
+#include <stdexcept>
+#include <utility>
+
+namespace core {
+
+JacobiCheck::JacobiCheck(uint32_t exponent, std::vector<int> widths)
+    : exponent_(exponent), widths_(std::move(widths))
+{
+    worker_ = std::thread(&JacobiCheck::workerLoop, this);
+}
+
+JacobiCheck::~JacobiCheck() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void JacobiCheck::submit(uint64_t iter, std::vector<uint32_t> words) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_) throw std::runtime_error("JacobiCheck: a residue is already being checked");
+    iter_ = iter;
+    words_ = std::move(words);
+    digits_.clear();
+    pending_ = queued_ = true;
+    done_ = false;
+    cv_.notify_all();
+}
+
+void JacobiCheck::submitDigits(uint64_t iter, std::vector<uint64_t> digits) {
+    if (digits.size() != widths_.size()) throw std::runtime_error("JacobiCheck: digit and width counts differ");
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_) throw std::runtime_error("JacobiCheck: a residue is already being checked");
+    iter_ = iter;
+    words_.clear();
+    digits_ = std::move(digits);
+    pending_ = queued_ = true;
+    done_ = false;
+    cv_.notify_all();
+}
+
+bool JacobiCheck::busy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+std::optional<JacobiCheck::Result> JacobiCheck::poll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_ || !done_) return std::nullopt;
+    pending_ = false;
+    return result_;
+}
+
+std::optional<JacobiCheck::Result> JacobiCheck::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!pending_) return std::nullopt;
+    cv_.wait(lock, [&] { return done_; });
+    pending_ = false;
+    return result_;
+}
+
+int JacobiCheck::symbol(const std::vector<uint32_t>& words, uint32_t exponent) {
+    const mpz_class Mp = (mpz_class(1) << exponent) - 1;
+    mpz_class x = util::convertToGMP(words) - 2;
+    if (x < 0) x += Mp;
+    return mpz_jacobi(x.get_mpz_t(), Mp.get_mpz_t());
+}
+
+void JacobiCheck::workerLoop() {
+    for (;;) {
+        std::vector<uint32_t> words;
+        std::vector<uint64_t> digits;
+        uint64_t iter = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return stop_ || queued_; });
+            if (stop_) return;
+            queued_ = false;
+            iter = iter_;
+            words.swap(words_);
+            digits.swap(digits_);
+        }
+        if (!digits.empty()) words = util::packResidue(digits, widths_, exponent_);
+        const bool ok = expected(iter, symbol(words, exponent_));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            result_ = Result{iter, ok};
+            done_ = true;
+        }
+        cv_.notify_all();
+    }
+}
+
+} // namespace core
@@ -23,18 +23,27 @@
 #include "core/Logger.hpp"
 #include "io/CliParser.hpp"
 #include <fstream>
-#include <vector>
 #include <string>
 #include <iostream>
 #include <cstdarg>
+#include <cstdio>
 
 namespace core {
 
-static std::vector<std::string> s_messages;
-
 Logger::Logger(const std::string& logFile)
   : _logFile(logFile)
-{}
+  , _ring(new Slot[kSlots])
+{
+    for (size_t i = 0; i < kSlots; ++i) _ring[i].seq.store(i, std::memory_order_relaxed);
+    _writer = std::thread(&Logger::writerLoop, this);
+}
+
+Logger::~Logger() {
+    _stop.store(true, std::memory_order_release);
+    _wake.fetch_add(1, std::memory_order_release);
+    _wake.notify_one();
+    _writer.join();
+}
 
 void Logger::logStart(const io::CliOptions& options) {
     logmsg("=== Début : exponent=%u, mode=%s\n",
@@ -48,20 +57,62 @@ void Logger::logEnd(double elapsed) {
 }
 
 void Logger::logmsg(const char* fmt, ...) {
+    // slot pos is free when its sequence is pos, written while pos + 1
+    uint64_t pos = _head.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &_ring[pos & (kSlots - 1)];
+        const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq == pos) {
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else {
+            // full: the writer still holds the slot of pos - kSlots
+            if (seq < pos) std::this_thread::yield();
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+
     va_list ap;
     va_start(ap, fmt);
-    char buf[1024];
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    vsnprintf(slot->text, kText, fmt, ap);
     va_end(ap);
-    s_messages.emplace_back(buf);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    _wake.fetch_add(1, std::memory_order_release);
+    _wake.notify_one();
 }
 
 void Logger::flush_log() {
-    std::ofstream out(_logFile, std::ios::app);
-    for (auto& m : s_messages) {
-        out << m;
+    const uint64_t target = _head.load(std::memory_order_acquire);
+    for (uint64_t w = _written.load(std::memory_order_acquire); w < target;
+         w = _written.load(std::memory_order_acquire))
+        _written.wait(w, std::memory_order_acquire);
+}
+
+void Logger::writerLoop() {
+    std::ofstream out;
+    for (;;) {
+        const uint64_t wake = _wake.load(std::memory_order_acquire);
+        bool wrote = false;
+        for (;;) {
+            Slot& slot = _ring[_tail & (kSlots - 1)];
+            if (slot.seq.load(std::memory_order_acquire) != _tail + 1) break;
+            if (!out.is_open()) out.open(_logFile, std::ios::app);
+            out << slot.text;
+            slot.seq.store(_tail + kSlots, std::memory_order_release);
+            ++_tail;
+            wrote = true;
+        }
+        if (wrote) {
+            out.flush();
+            _written.store(_tail, std::memory_order_release);
+            _written.notify_all();
+        }
+        if (_stop.load(std::memory_order_acquire)) {
+            if (_tail == _head.load(std::memory_order_acquire)) return;
+            continue;
+        }
+        _wake.wait(wake, std::memory_order_acquire);
     }
-    s_messages.clear();
 }
 
 } // namespace core
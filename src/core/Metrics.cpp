@@ -0,0 +1,199 @@
+// src/core/Metrics.cpp
+#include "core/Metrics.hpp"
+#include "util/Fs.hpp"
+#include "util/HostPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+namespace core {
+
+namespace {
+
+struct State {
+    std::string             path;
+    unsigned                interval = 10;
+    std::thread             writer;
+    std::mutex              mutex;
+    std::condition_variable wake;
+    bool                    stopping = false;
+    std::atomic<bool>       enabled{false};
+
+    std::string             mode;          // guarded by mutex
+    std::atomic<uint64_t>   exponent{0}, totalIters{0}, iter{0}, queueDepth{0};
+    std::atomic<uint64_t>   glChecks{0}, glFailures{0};
+    std::atomic<uint64_t>   ckptCount{0}, ckptBytes{0}, ckptBytesTotal{0};
+    std::atomic<double>     ckptSeconds{0.0}, ckptSecondsTotal{0.0}, ckptCost{0.0};
+    std::atomic<double>     backupInterval{0.0};
+
+    // writer thread only
+    uint64_t lastIter = 0;
+    std::chrono::steady_clock::time_point lastTime{};
+    double   ips = 0.0;
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+void addDouble(std::atomic<double>& a, double v) {
+    double cur = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed)) {}
+}
+
+void sample(State& s) {
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t iter = s.iter.load(std::memory_order_relaxed);
+    const uint64_t total = s.totalIters.load(std::memory_order_relaxed);
+    if (s.lastTime != std::chrono::steady_clock::time_point{}) {
+        const double dt = std::chrono::duration<double>(now - s.lastTime).count();
+        // a Gerbicz-Li rollback moves the counter backwards: keep the last rate
+        if (dt > 0.0 && iter >= s.lastIter) {
+            const double cur = (iter - s.lastIter) / dt;
+            s.ips = (s.ips == 0.0) ? cur : 0.3 * cur + 0.7 * s.ips;
+        }
+    }
+    s.lastIter = iter;
+    s.lastTime = now;
+    const double eta = (s.ips > 0.0 && total > iter) ? (total - iter) / s.ips : 0.0;
+
+    std::string mode;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        mode = s.mode;
+    }
+    const std::string labels = "{exponent=\"" + std::to_string(s.exponent.load()) + "\",mode=\"" + mode + "\"}";
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    auto gauge = [&](const char* name, const char* type, const char* help, auto value) {
+        out << "# HELP prmers_" << name << ' ' << help << "\n"
+            << "# TYPE prmers_" << name << ' ' << type << "\n"
+            << "prmers_" << name << labels << ' ' << value << "\n";
+    };
+    gauge("iteration", "gauge", "Current iteration.", iter);
+    gauge("iterations_total", "gauge", "Iterations of the test.", total);
+    gauge("iterations_per_second", "gauge", "Smoothed iteration rate.", s.ips);
+    gauge("eta_seconds", "gauge", "Estimated time to completion.", eta);
+    gauge("gerbicz_checks_total", "counter", "Gerbicz-Li checks run.", s.glChecks.load());
+    gauge("gerbicz_failures_total", "counter", "Gerbicz-Li checks that failed and rolled back.", s.glFailures.load());
+    gauge("checkpoints_total", "counter", "Checkpoints written.", s.ckptCount.load());
+    gauge("checkpoint_last_seconds", "gauge", "Duration of the last checkpoint write.", s.ckptSeconds.load());
+    gauge("checkpoint_last_bytes", "gauge", "Size of the last checkpoint.", s.ckptBytes.load());
+    gauge("checkpoint_seconds_total", "counter", "Time spent writing checkpoints.", s.ckptSecondsTotal.load());
+    gauge("checkpoint_bytes_total", "counter", "Bytes of checkpoints written.", s.ckptBytesTotal.load());
+    gauge("backup_interval_seconds", "gauge", "Interval between two checkpoints, chosen from their cost and the crash rate.", s.backupInterval.load());
+    gauge("queue_depth", "gauge", "Iterations queued on the device.", s.queueDepth.load());
+    gauge("host_resident_bytes", "gauge", "Resident set size of the process.", util::residentBytes());
+    gauge("host_pool_bytes", "gauge", "Host residue buffers held by the pool, leased or free.", util::HostPool::bytes());
+
+    const std::string text = out.str();
+    if (!writeFileDurable(s.path, {{text.data(), text.size()}}))
+        std::cerr << "Warning: cannot write metrics to " << s.path << std::endl;
+}
+
+void writerLoop(State& s) {
+    std::unique_lock<std::mutex> lock(s.mutex);
+    while (!s.stopping) {
+        s.wake.wait_for(lock, std::chrono::seconds(s.interval), [&] { return s.stopping; });
+        lock.unlock();
+        sample(s);
+        lock.lock();
+    }
+}
+
+} // namespace
+
+bool Metrics::start(const std::string& path, unsigned intervalSec) {
+    State& s = state();
+    if (s.enabled) return true;
+    s.path = path;
+    s.interval = intervalSec == 0 ? 1 : intervalSec;
+    s.stopping = false;
+    s.enabled = true;
+    sample(s);
+    try {
+        s.writer = std::thread(writerLoop, std::ref(s));
+    } catch (const std::system_error& e) {
+        std::cerr << "Warning: cannot start the metrics writer: " << e.what() << std::endl;
+        s.enabled = false;
+        return false;
+    }
+    return true;
+}
+
+void Metrics::stop() {
+    State& s = state();
+    if (!s.enabled) return;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.stopping = true;
+    }
+    s.wake.notify_all();
+    if (s.writer.joinable()) s.writer.join();
+    s.enabled = false;
+}
+
+bool Metrics::enabled() noexcept { return state().enabled.load(std::memory_order_relaxed); }
+
+void Metrics::setRun(uint64_t exponent, uint64_t totalIters, const std::string& mode) {
+    State& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.mode = mode;
+    }
+    s.exponent = exponent;
+    s.totalIters = totalIters;
+}
+
+void Metrics::iteration(uint64_t iter) noexcept {
+    state().iter.store(iter, std::memory_order_relaxed);
+}
+
+void Metrics::queueDepth(std::size_t depth) noexcept {
+    state().queueDepth.store(depth, std::memory_order_relaxed);
+}
+
+void Metrics::gerbiczCheck(bool passed) noexcept {
+    State& s = state();
+    s.glChecks.fetch_add(1, std::memory_order_relaxed);
+    if (!passed) s.glFailures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::checkpoint(double seconds, uint64_t bytes) noexcept {
+    State& s = state();
+    s.ckptCount.fetch_add(1, std::memory_order_relaxed);
+    s.ckptSeconds.store(seconds, std::memory_order_relaxed);
+    s.ckptBytes.store(bytes, std::memory_order_relaxed);
+    addDouble(s.ckptSecondsTotal, seconds);
+    s.ckptBytesTotal.fetch_add(bytes, std::memory_order_relaxed);
+    // one slow write (a cold disk cache) should not set the interval alone
+    const double cost = s.ckptCost.load(std::memory_order_relaxed);
+    s.ckptCost.store(cost == 0.0 ? seconds : 0.3 * seconds + 0.7 * cost, std::memory_order_relaxed);
+}
+
+double Metrics::checkpointCost() noexcept {
+    return state().ckptCost.load(std::memory_order_relaxed);
+}
+
+void Metrics::backupInterval(double seconds) noexcept {
+    state().backupInterval.store(seconds, std::memory_order_relaxed);
+}
+
+Metrics::Progress Metrics::progress() {
+    State& s = state();
+    Progress p{ s.exponent.load(), s.iter.load(std::memory_order_relaxed), s.totalIters.load(), {} };
+    std::lock_guard<std::mutex> lock(s.mutex);
+    p.mode = s.mode;
+    return p;
+}
+
+} // namespace core
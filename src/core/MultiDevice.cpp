@@ -0,0 +1,224 @@
+// src/core/MultiDevice.cpp
+#include "core/MultiDevice.hpp"
+#include "core/App.hpp"
+#include "io/CliParser.hpp"
+#include "io/WorktodoParser.hpp"
+#include "opencl/Context.hpp"
+#include "util/StringUtils.hpp"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+namespace {
+
+volatile std::sig_atomic_t stopping = 0;
+void handle_sigint(int) { stopping = 1; }
+
+std::mutex outMutex;
+
+void say(std::size_t worker, const std::string& msg, const char* kind = "device") {
+    std::lock_guard<std::mutex> lock(outMutex);
+    std::cout << "[" << kind << ' ' << worker << "] " << msg << std::endl;
+}
+
+// A child fails this many times in a row on one entry before its device is
+// dropped, so a broken GPU does not spin on the same assignment.
+constexpr int kMaxFailures = 3;
+
+// The first line a child would run, empty when the file has none.
+std::string firstEntry(const std::string& path) {
+    return io::WorktodoParser(path).firstLine();
+}
+
+#ifndef _WIN32
+// Runs args with stdout and stderr appended to logPath; returns the wait status.
+int spawn(const std::vector<std::string>& args, const std::string& logPath) {
+    std::vector<char*> c_argv;
+    for (const auto& a : args) c_argv.push_back(const_cast<char*>(a.c_str()));
+    c_argv.push_back(nullptr);
+    const pid_t pid = ::fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        const int fd = ::open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) { ::dup2(fd, 1); ::dup2(fd, 2); ::close(fd); }
+        ::execvp(c_argv[0], c_argv.data());
+        ::_exit(127);
+    }
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return status;
+}
+#endif
+
+// -batch: the worker runs its entries through an App of its own, with its
+// own Session (context, queues, marin engine), in this process.
+void runBatchSlot(std::size_t slot, const std::vector<std::string>& passed,
+                  io::WorktodoParser& shared, const std::string& own, std::atomic<int>& failed) {
+    std::vector<std::string> args = passed;
+    args.insert(args.end(), { "-worktodo", own });
+    std::vector<char*> c_argv;
+    for (auto& a : args) c_argv.push_back(const_cast<char*>(a.c_str()));
+    c_argv.push_back(nullptr);
+    Session session;
+    while (!stopping) {
+        std::string line = firstEntry(own);
+        if (line.empty()) {
+            auto entry = shared.claimFirst(own);
+            if (!entry) break;
+            line = entry->rawLine;
+            say(slot, "claimed M" + std::to_string(entry->exponent), "slot");
+        }
+        try {
+            App app(static_cast<int>(args.size()), c_argv.data(), session);
+            app.run();
+        } catch (const std::exception& e) {
+            say(slot, std::string("failed: ") + e.what() + ", leaving " + own + " for a restart", "slot");
+            failed = 1;
+            break;
+        }
+        // an interrupted App keeps its entry
+        if (firstEntry(own) == line) break;
+    }
+}
+
+} // namespace
+
+std::optional<int> MultiDevice::run(int argc, char** argv) {
+    std::string devices, device = "0";
+    std::size_t batch = 0;
+    bool observed = false;
+    io::CliOptions defaults;
+    std::string worktodo = defaults.worktodo_path, savePath = defaults.save_path;
+    // The workers get every argument but these (and a leading exponent).
+    std::vector<std::string> passed{ argv[0] };
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "-devices") == 0 && hasValue) { devices = argv[++i]; continue; }
+        if (std::strcmp(argv[i], "-batch") == 0 && hasValue) { batch = std::strtoul(argv[++i], nullptr, 10); continue; }
+        if (std::strcmp(argv[i], "-worktodo") == 0 && hasValue) { worktodo = argv[++i]; continue; }
+        if (std::strcmp(argv[i], "-d") == 0 && hasValue) { device = argv[++i]; continue; }
+        if (std::strcmp(argv[i], "-f") == 0 && hasValue) savePath = argv[i + 1];
+        if (std::strcmp(argv[i], "-trace") == 0 || std::strcmp(argv[i], "-metrics") == 0) observed = true;
+        if (i == 1 && std::strspn(argv[i], "0123456789") == std::strlen(argv[i])) continue;
+        passed.emplace_back(argv[i]);
+    }
+    if (devices.empty() && batch <= 1) return std::nullopt;
+    if (!devices.empty() && batch > 1) {
+        std::cerr << "Error: -batch and -devices cannot be combined" << std::endl;
+        return 1;
+    }
+    if (batch > 1 && observed) {
+        // Trace and Metrics describe a single run
+        std::cerr << "Error: -batch cannot be combined with -trace or -metrics" << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    if (!devices.empty()) {
+        std::cerr << "Error: -devices is not supported on Windows, run one prmers per -d instead" << std::endl;
+        return 1;
+    }
+#endif
+    std::vector<std::size_t> ids;
+    const std::size_t count = opencl::Context::deviceCount();
+    if (devices == "all") {
+        for (std::size_t d = 0; d < count; ++d) ids.push_back(d);
+    } else if (!devices.empty()) {
+        for (const auto& s : util::split(devices, ',')) {
+            char* end = nullptr;
+            const unsigned long d = std::strtoul(s.c_str(), &end, 10);
+            if (s.empty() || *end != '\0' || d >= count) {
+                std::cerr << "Error: invalid device '" << s << "' in -devices (" << count << " GPU devices)" << std::endl;
+                return 1;
+            }
+            ids.push_back(d);
+        }
+        if (ids.empty()) {
+            std::cerr << "Error: no OpenCL GPU device for -devices" << std::endl;
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(savePath, ec);
+    // Ctrl-C reaches the children too; they write their checkpoints and the
+    // workers stop handing out entries. In-process App workers install their
+    // own handler and keep their entry when interrupted.
+    std::signal(SIGINT, handle_sigint);
+    std::signal(SIGTERM, handle_sigint);
+
+    io::WorktodoParser shared(worktodo);
+    std::atomic<int> failed{0};
+    std::vector<std::thread> workers;
+    if (batch > 1) {
+        std::cout << "Running " << worktodo << " as " << batch << " concurrent entries on device " << device << std::endl;
+        passed.insert(passed.end(), { "-d", device });
+        for (std::size_t slot = 0; slot < batch; ++slot) {
+            const std::string own = worktodo + ".b" + std::to_string(slot);
+            workers.emplace_back(runBatchSlot, slot, std::cref(passed), std::ref(shared), own, std::ref(failed));
+        }
+        for (auto& w : workers) w.join();
+        std::cout << "Batch finished, unfinished entries stay in " << worktodo << ".b<i>" << std::endl;
+        return failed.load();
+    }
+
+#ifndef _WIN32
+    std::cout << "Running " << worktodo << " on " << ids.size() << " device(s)" << std::endl;
+    for (const std::size_t d : ids) {
+        workers.emplace_back([&, d] {
+            const std::string own = worktodo + ".d" + std::to_string(d);
+            const std::string log = (std::filesystem::path(savePath) / ("device" + std::to_string(d) + ".log")).string();
+            std::vector<std::string> args = passed;
+            args.insert(args.end(), { "-d", std::to_string(d), "-worktodo", own });
+            int failures = 0;
+            while (!stopping) {
+                std::string line = firstEntry(own);
+                if (line.empty()) {
+                    auto entry = shared.claimFirst(own);
+                    if (!entry) break;
+                    line = entry->rawLine;
+                    say(d, "claimed M" + std::to_string(entry->exponent) + ", log in " + log);
+                }
+                const int status = spawn(args, log);
+                if (stopping) break;
+                // 0 and 1 are the PRP/LL verdicts, and a finished child has
+                // moved its entry to worktodo_save.txt.
+                if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) <= 1 && firstEntry(own) != line) {
+                    failures = 0;
+                    say(d, "entry done");
+                    continue;
+                }
+                if (++failures >= kMaxFailures) {
+                    say(d, "worker failed " + std::to_string(failures) + " times in a row, leaving " + own + " for a restart");
+                    failed = 1;
+                    break;
+                }
+                say(d, "worker failed, retrying from the last checkpoint");
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    std::cout << (stopping ? "Interrupted, claimed entries stay in " + worktodo + ".d<i>" : "No more entries in " + worktodo) << std::endl;
+#endif
+    return failed.load();
+}
+
+} // namespace core
@@ -0,0 +1,132 @@
+// src/core/PlanDb.cpp
+#include "core/PlanDb.hpp"
+#include "util/JsonFile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace core {
+
+PlanDb::PlanDb(std::string path)
+    : path_(std::move(path))
+{}
+
+bool PlanDb::load() {
+    plans_.clear();
+    const std::string text = util::readJsonFile(path_);
+    if (text.find('[') == std::string::npos) return false;
+    for (const auto& obj : util::jsonObjects(text)) {
+        auto dev = util::jsonField(obj, "device"), drv = util::jsonField(obj, "driver"), n = util::jsonField(obj, "n");
+        if (!dev || !drv || !n) continue;
+        NttPlan p;
+        p.device = *dev;
+        p.driver = *drv;
+        p.n      = static_cast<uint32_t>(std::strtoul(n->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "max_local_size1")) p.max_local_size1 = std::atoi(v->c_str());
+        if (auto v = util::jsonField(obj, "max_local_size5")) p.max_local_size5 = std::atoi(v->c_str());
+        if (auto v = util::jsonField(obj, "twiddle_otf"))     p.twiddle_otf = (*v == "true");
+        if (auto v = util::jsonField(obj, "lazy_reduce"))     p.lazy_reduce = (*v == "true");
+        if (auto v = util::jsonField(obj, "four_step"))       p.four_step = (*v == "true");
+        if (auto v = util::jsonField(obj, "coalesced"))       p.coalesced = (*v == "true");
+        if (auto v = util::jsonField(obj, "gen_tile"))        p.gen_tile = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "ips"))             p.ips = std::strtod(v->c_str(), nullptr);
+        if (auto v = util::jsonField(obj, "chunk16"))         p.chunk16 = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "chunk64"))         p.chunk64 = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "chunk256"))        p.chunk256 = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "blk16"))           p.blk16 = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "blk64"))           p.blk64 = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "cwm_wg_size"))     p.cwm_wg_size = static_cast<uint32_t>(std::strtoul(v->c_str(), nullptr, 10));
+        if (auto v = util::jsonField(obj, "marin_ips"))       p.marin_ips = std::strtod(v->c_str(), nullptr);
+        plans_.push_back(std::move(p));
+    }
+    return true;
+}
+
+bool PlanDb::save() const {
+    std::ostringstream out;
+    out << "{\n  \"plans\": [\n";
+    for (size_t i = 0; i < plans_.size(); ++i) {
+        const auto& p = plans_[i];
+        out << "    { \"device\": \"" << util::jsonEscape(p.device) << "\""
+            << ", \"driver\": \"" << util::jsonEscape(p.driver) << "\""
+            << ", \"n\": " << p.n
+            << ", \"max_local_size1\": " << p.max_local_size1
+            << ", \"max_local_size5\": " << p.max_local_size5
+            << ", \"twiddle_otf\": " << (p.twiddle_otf ? "true" : "false")
+            << ", \"lazy_reduce\": " << (p.lazy_reduce ? "true" : "false")
+            << ", \"four_step\": " << (p.four_step ? "true" : "false")
+            << ", \"coalesced\": " << (p.coalesced ? "true" : "false")
+            << ", \"gen_tile\": " << p.gen_tile
+            << ", \"ips\": " << std::fixed << std::setprecision(2) << p.ips
+            << ", \"chunk16\": " << p.chunk16
+            << ", \"chunk64\": " << p.chunk64
+            << ", \"chunk256\": " << p.chunk256
+            << ", \"blk16\": " << p.blk16
+            << ", \"blk64\": " << p.blk64
+            << ", \"cwm_wg_size\": " << p.cwm_wg_size
+            << ", \"marin_ips\": " << std::fixed << std::setprecision(2) << p.marin_ips
+            << " }" << (i + 1 < plans_.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    const std::string text = out.str();
+    if (!util::updateJsonFile(path_, [&](const std::string&) { return text; })) {
+        std::cerr << "Warning: cannot write plan database " << path_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::optional<NttPlan> PlanDb::find(const std::string& device,
+                                    const std::string& driver,
+                                    uint32_t n) const
+{
+    for (const auto& p : plans_)
+        if (p.n == n && p.device == device && p.driver == driver) return p;
+    return std::nullopt;
+}
+
+void PlanDb::put(const NttPlan& plan) {
+    for (auto& p : plans_) {
+        if (p.n == plan.n && p.device == plan.device && p.driver == plan.driver) {
+            p = plan;
+            return;
+        }
+    }
+    plans_.push_back(plan);
+}
+
+std::optional<double> PlanDb::predictIps(const std::string& device,
+                                         const std::string& driver,
+                                         uint32_t n, bool marin) const
+{
+    // (log2 n, µs per n log2 n word) of the measured sizes
+    std::vector<std::pair<double, double>> cost;
+    for (const auto& p : plans_) {
+        const double ips = marin ? p.marin_ips : p.ips;
+        if (p.device != device || p.driver != driver || p.n < 2 || !(ips > 0.0)) continue;
+        const double lg = std::log2(double(p.n));
+        cost.emplace_back(lg, 1e6 / ips / (double(p.n) * lg));
+    }
+    if (cost.empty() || n < 2) return std::nullopt;
+    std::sort(cost.begin(), cost.end());
+
+    const double lg = std::log2(double(n));
+    const auto hi = std::lower_bound(cost.begin(), cost.end(), std::make_pair(lg, 0.0));
+    double c;
+    if (hi == cost.begin() || hi == cost.end()) {
+        const auto& nearest = (hi == cost.end()) ? cost.back() : cost.front();
+        if (std::abs(nearest.first - lg) > 2.0) return std::nullopt;
+        c = nearest.second;
+    } else {
+        const auto& a = *(hi - 1);
+        const auto& b = *hi;
+        if (b.first - a.first < 1e-9) c = b.second;
+        else c = a.second + (b.second - a.second) * (lg - a.first) / (b.first - a.first);
+    }
+    return 1e6 / (c * double(n) * lg);
+}
+
+} // namespace core
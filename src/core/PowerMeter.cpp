@@ -0,0 +1,295 @@
+// src/core/PowerMeter.cpp
+#include "core/PowerMeter.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <vector>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#ifndef CL_DEVICE_PCI_BUS_INFO_KHR
+#define CL_DEVICE_PCI_BUS_INFO_KHR 0x410F
+#endif
+#ifndef CL_DEVICE_TOPOLOGY_AMD
+#define CL_DEVICE_TOPOLOGY_AMD 0x4037
+#endif
+#ifndef CL_DEVICE_PCI_BUS_ID_NV
+#define CL_DEVICE_PCI_BUS_ID_NV 0x4008
+#endif
+#ifndef CL_DEVICE_PCI_SLOT_ID_NV
+#define CL_DEVICE_PCI_SLOT_ID_NV 0x4009
+#endif
+
+namespace core {
+
+// Power in watts and, when the source keeps one, an energy counter in joules.
+struct PowerMeter::Source {
+    virtual ~Source() = default;
+    virtual const char* name() const = 0;
+    virtual std::optional<double> watts() = 0;
+    virtual std::optional<double> joules() { return std::nullopt; }
+};
+
+namespace {
+
+struct Pci { unsigned domain = 0, bus = 0, device = 0, function = 0; };
+
+std::optional<Pci> parsePci(const std::string& s) {
+    Pci p;
+    if (std::sscanf(s.c_str(), "%x:%x:%x.%x", &p.domain, &p.bus, &p.device, &p.function) == 4) return p;
+    return std::nullopt;
+}
+
+#ifndef _WIN32
+// A shared library from its first name that loads, closed with the source.
+struct Library {
+    void* handle = nullptr;
+    explicit Library(std::initializer_list<const char*> names) {
+        for (const char* n : names) if ((handle = ::dlopen(n, RTLD_NOW | RTLD_LOCAL))) break;
+    }
+    ~Library() { if (handle) ::dlclose(handle); }
+    template <typename F> F get(const char* sym) const {
+        return handle ? reinterpret_cast<F>(::dlsym(handle, sym)) : nullptr;
+    }
+};
+
+class Nvml final : public PowerMeter::Source {
+public:
+    static std::unique_ptr<Nvml> open(const std::optional<Pci>& pci) {
+        auto s = std::unique_ptr<Nvml>(new Nvml);
+        if (!s->lib_.handle || !s->init_ || !s->power_ || s->init_() != 0) return nullptr;
+        s->up_ = true;
+        if (pci) {
+            char bus[32];
+            std::snprintf(bus, sizeof(bus), "%08x:%02x:%02x.%x", pci->domain, pci->bus, pci->device, pci->function);
+            if (!s->byPci_ || s->byPci_(bus, &s->dev_) != 0) return nullptr;
+        } else {
+            unsigned count = 0;
+            if (!s->count_ || !s->byIndex_ || s->count_(&count) != 0 || count != 1 || s->byIndex_(0, &s->dev_) != 0) return nullptr;
+        }
+        if (!s->watts()) return nullptr;
+        return s;
+    }
+    ~Nvml() override { if (up_ && shutdown_) shutdown_(); }
+
+    const char* name() const override { return "NVML"; }
+    std::optional<double> watts() override {
+        unsigned mw = 0;
+        if (power_(dev_, &mw) != 0) return std::nullopt;
+        return mw * 1e-3;
+    }
+    // Volta and later
+    std::optional<double> joules() override {
+        unsigned long long mj = 0;
+        if (!energy_ || energy_(dev_, &mj) != 0) return std::nullopt;
+        return double(mj) * 1e-3;
+    }
+
+private:
+    using Device = void*;
+    Library lib_{"libnvidia-ml.so.1", "libnvidia-ml.so"};
+    int (*init_)()                                  = lib_.get<int (*)()>("nvmlInit_v2");
+    int (*shutdown_)()                              = lib_.get<int (*)()>("nvmlShutdown");
+    int (*count_)(unsigned*)                        = lib_.get<int (*)(unsigned*)>("nvmlDeviceGetCount_v2");
+    int (*byIndex_)(unsigned, Device*)              = lib_.get<int (*)(unsigned, Device*)>("nvmlDeviceGetHandleByIndex_v2");
+    int (*byPci_)(const char*, Device*)             = lib_.get<int (*)(const char*, Device*)>("nvmlDeviceGetHandleByPciBusId_v2");
+    int (*power_)(Device, unsigned*)                = lib_.get<int (*)(Device, unsigned*)>("nvmlDeviceGetPowerUsage");
+    int (*energy_)(Device, unsigned long long*)     = lib_.get<int (*)(Device, unsigned long long*)>("nvmlDeviceGetTotalEnergyConsumption");
+    Device dev_ = nullptr;
+    bool   up_ = false;
+};
+
+class RocmSmi final : public PowerMeter::Source {
+public:
+    static std::unique_ptr<RocmSmi> open(const std::optional<Pci>& pci) {
+        auto s = std::unique_ptr<RocmSmi>(new RocmSmi);
+        if (!s->lib_.handle || !s->init_ || !s->count_ || s->init_(0) != 0) return nullptr;
+        s->up_ = true;
+        uint32_t count = 0;
+        if (s->count_(&count) != 0 || count == 0) return nullptr;
+        if (pci) {
+            // BDFID = domain << 32 | bus << 8 | device << 3 | function
+            const uint64_t want = (uint64_t(pci->domain) << 32) | ((pci->bus & 0xff) << 8)
+                                | ((pci->device & 0x1f) << 3) | (pci->function & 0x7);
+            bool found = false;
+            for (uint32_t i = 0; i < count && !found; ++i) {
+                uint64_t id = 0;
+                if (s->pciId_ && s->pciId_(i, &id) == 0 && id == want) { s->index_ = i; found = true; }
+            }
+            if (!found) return nullptr;
+        } else if (count != 1) {
+            return nullptr;
+        }
+        if (!s->watts()) return nullptr;
+        return s;
+    }
+    ~RocmSmi() override { if (up_ && shutdown_) shutdown_(); }
+
+    const char* name() const override { return "ROCm SMI"; }
+    std::optional<double> watts() override {
+        uint64_t uw = 0;
+        if (powerAve_ && powerAve_(index_, 0, &uw) == 0) return uw * 1e-6;
+        int type = 0;
+        if (power_ && power_(index_, &uw, &type) == 0) return uw * 1e-6;
+        return std::nullopt;
+    }
+    std::optional<double> joules() override {
+        uint64_t count = 0, stamp = 0;
+        float resolution = 0;   // microjoules per count
+        if (!energy_ || energy_(index_, &count, &resolution, &stamp) != 0 || resolution <= 0) return std::nullopt;
+        return double(count) * resolution * 1e-6;
+    }
+
+private:
+    Library lib_{"librocm_smi64.so.1", "librocm_smi64.so", "/opt/rocm/lib/librocm_smi64.so"};
+    int (*init_)(uint64_t)                                  = lib_.get<int (*)(uint64_t)>("rsmi_init");
+    int (*shutdown_)()                                      = lib_.get<int (*)()>("rsmi_shut_down");
+    int (*count_)(uint32_t*)                                = lib_.get<int (*)(uint32_t*)>("rsmi_num_monitor_devices");
+    int (*pciId_)(uint32_t, uint64_t*)                      = lib_.get<int (*)(uint32_t, uint64_t*)>("rsmi_dev_pci_id_get");
+    int (*powerAve_)(uint32_t, uint32_t, uint64_t*)         = lib_.get<int (*)(uint32_t, uint32_t, uint64_t*)>("rsmi_dev_power_ave_get");
+    int (*power_)(uint32_t, uint64_t*, int*)                = lib_.get<int (*)(uint32_t, uint64_t*, int*)>("rsmi_dev_power_get");
+    int (*energy_)(uint32_t, uint64_t*, float*, uint64_t*)  = lib_.get<int (*)(uint32_t, uint64_t*, float*, uint64_t*)>("rsmi_dev_energy_count_get");
+    uint32_t index_ = 0;
+    bool     up_ = false;
+};
+#endif
+
+// The hwmon directory of the device: power1_average or power1_input in
+// microwatts, energy1_input in microjoules.
+class Hwmon final : public PowerMeter::Source {
+public:
+    static std::unique_ptr<Hwmon> open(const std::optional<Pci>& pci) {
+        namespace fs = std::filesystem;
+        std::vector<fs::path> dirs;
+        std::error_code ec;
+        if (pci) {
+            char addr[32];
+            std::snprintf(addr, sizeof(addr), "%04x:%02x:%02x.%x", pci->domain, pci->bus, pci->device, pci->function);
+            dirs.push_back(fs::path("/sys/bus/pci/devices") / addr / "hwmon");
+        } else {
+            for (const auto& card : fs::directory_iterator("/sys/class/drm", ec)) {
+                const std::string n = card.path().filename().string();
+                if (n.rfind("card", 0) == 0 && n.find('-') == std::string::npos)
+                    dirs.push_back(card.path() / "device" / "hwmon");
+            }
+        }
+        std::vector<std::unique_ptr<Hwmon>> found;
+        for (const auto& d : dirs) {
+            for (const auto& h : fs::directory_iterator(d, ec)) {
+                auto s = std::unique_ptr<Hwmon>(new Hwmon);
+                for (const char* f : {"power1_average", "power1_input"})
+                    if (fs::exists(h.path() / f, ec)) { s->power_ = h.path() / f; break; }
+                if (fs::exists(h.path() / "energy1_input", ec)) s->energy_ = h.path() / "energy1_input";
+                if ((!s->power_.empty() && s->watts()) || (!s->energy_.empty() && s->joules())) found.push_back(std::move(s));
+            }
+        }
+        if (found.size() != 1) return nullptr;
+        return std::move(found.front());
+    }
+
+    const char* name() const override { return "hwmon"; }
+    std::optional<double> watts() override {
+        if (power_.empty()) return std::nullopt;
+        if (auto v = read(power_)) return *v * 1e-6;
+        return std::nullopt;
+    }
+    std::optional<double> joules() override {
+        if (energy_.empty()) return std::nullopt;
+        if (auto v = read(energy_)) return *v * 1e-6;
+        return std::nullopt;
+    }
+
+private:
+    std::filesystem::path power_, energy_;
+    static std::optional<double> read(const std::filesystem::path& p) {
+        std::ifstream in(p);
+        double v = 0;
+        if (!(in >> v)) return std::nullopt;
+        return v;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<PowerMeter> PowerMeter::open(const std::string& pciAddress) {
+    const std::optional<Pci> pci = parsePci(pciAddress);
+    std::unique_ptr<Source> src;
+#ifndef _WIN32
+    if (!src) src = Nvml::open(pci);
+    if (!src) src = RocmSmi::open(pci);
+#endif
+    if (!src) src = Hwmon::open(pci);
+    if (!src) return nullptr;
+    return std::unique_ptr<PowerMeter>(new PowerMeter(std::move(src)));
+}
+
+std::string PowerMeter::pciAddress(cl_device_id device) {
+    char out[32] = {};
+    struct { cl_uint domain, bus, device, function; } khr{};
+    if (clGetDeviceInfo(device, CL_DEVICE_PCI_BUS_INFO_KHR, sizeof(khr), &khr, nullptr) == CL_SUCCESS) {
+        std::snprintf(out, sizeof(out), "%04x:%02x:%02x.%x", khr.domain, khr.bus, khr.device, khr.function);
+        return out;
+    }
+    // cl_device_topology_amd: the type, 17 unused bytes, then bus, device, function
+    union { struct { cl_uint type; cl_uint data[5]; } raw; struct { cl_uint type; cl_uchar unused[17]; cl_uchar bus, device, function; } pcie; } amd{};
+    if (clGetDeviceInfo(device, CL_DEVICE_TOPOLOGY_AMD, sizeof(amd), &amd, nullptr) == CL_SUCCESS && amd.raw.type == 1) {
+        std::snprintf(out, sizeof(out), "0000:%02x:%02x.%x", unsigned(amd.pcie.bus),
+                      unsigned(amd.pcie.device), unsigned(amd.pcie.function));
+        return out;
+    }
+    // NVIDIA gives the slot as device << 3 | function
+    cl_uint bus = 0, slot = 0;
+    if (clGetDeviceInfo(device, CL_DEVICE_PCI_BUS_ID_NV, sizeof(bus), &bus, nullptr) == CL_SUCCESS &&
+        clGetDeviceInfo(device, CL_DEVICE_PCI_SLOT_ID_NV, sizeof(slot), &slot, nullptr) == CL_SUCCESS) {
+        std::snprintf(out, sizeof(out), "0000:%02x:%02x.%x", bus, slot >> 3, slot & 7);
+        return out;
+    }
+    return {};
+}
+
+PowerMeter::PowerMeter(std::unique_ptr<Source> src)
+    : src_(std::move(src)), name_(src_->name()) {}
+
+PowerMeter::~PowerMeter() {
+    sampling_ = false;
+    if (sampler_.joinable()) sampler_.join();
+}
+
+void PowerMeter::start() {
+    stop();
+    joules_ = 0.0;
+    counter0_ = src_->joules();
+    if (counter0_) return;
+    sampling_ = true;
+    sampler_ = std::thread([this] {
+        using clock = std::chrono::steady_clock;
+        auto last = clock::now();
+        std::optional<double> w0 = src_->watts();
+        while (sampling_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kSampleMs));
+            const auto now = clock::now();
+            const std::optional<double> w = src_->watts();
+            if (w && w0) joules_ = joules_ + 0.5 * (*w + *w0) * std::chrono::duration<double>(now - last).count();
+            w0 = w;
+            last = now;
+        }
+    });
+}
+
+double PowerMeter::stop() {
+    if (counter0_) {
+        const std::optional<double> c = src_->joules();
+        const double j = (c && *c >= *counter0_) ? *c - *counter0_ : 0.0;
+        counter0_.reset();
+        return j;
+    }
+    sampling_ = false;
+    if (sampler_.joinable()) sampler_.join();
+    return joules_;
+}
+
+} // namespace core
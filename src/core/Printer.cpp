@@ -25,6 +25,7 @@
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <string>
 #include <algorithm>
 
 namespace core {
@@ -34,7 +35,8 @@ void Printer::banner(const io::CliOptions& o) {
               << "Testing exponent : " << (o.wagstaff ? o.exponent / 2 : o.exponent) << "\n"
               << "Device OpenCL ID : " << o.device_id << "\n"
               << "Mode : " << (o.mode=="prp"?"PRP":"Lucas Lehmer") << "\n"
-              << "Backup interval : " << o.backup_interval << " s\n"
+              << "Backup interval : " << (o.backup_interval_fixed ? std::to_string(o.backup_interval) + " s"
+                                                           : "auto, at most " + std::to_string(o.backup_interval_max) + " s") << "\n"
               << "Save/Load path: " << o.save_path << "\n";
     if (o.profiling) {
         std::cout << "\n Kernel profiling is activated. Performance metrics will be displayed.\n";
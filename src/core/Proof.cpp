@@ -24,7 +24,9 @@
 #include "opencl/Context.hpp"
 #include "opencl/NttEngine.hpp"
 #include "math/Carry.hpp"
+#include "io/JsonBuilder.hpp"
 #include "io/Sha3Hash.h"
+#include "marin/engine.h"
 #include "util/Timer.hpp"
 #include <filesystem>
 #include <fstream>
@@ -244,6 +246,17 @@ uint64_t Proof::res64(const std::vector<uint32_t>& words) {
   return result;
 }
 
+std::vector<uint64_t> Proof::challenges() const {
+  std::vector<uint64_t> h;
+  h.reserve(middles.size());
+  auto hash = hashWords(E, B);
+  for (const auto& M : middles) {
+    hash = hashWords(E, hash, M);
+    h.push_back(hash[0]);
+  }
+  return h;
+}
+
 bool Proof::verify(const GpuContext& gpu) const {
   uint32_t power = middles.size();
   if (power == 0) {
@@ -276,7 +289,7 @@ bool Proof::verify(const GpuContext& gpu) const {
   
   bool verificationResult = false;
   
-  auto hash = hashWords(E, B);
+  const auto hashes = challenges();
   uint32_t span = E;
 
   std::cout << "Starting proof verification for M" << E;
@@ -289,8 +302,7 @@ bool Proof::verify(const GpuContext& gpu) const {
 
   for (uint32_t i = 0; i < power; ++i, span = (span + 1) / 2) {
     const auto& M = middles[i];
-    hash = hashWords(E, hash, M);
-    uint64_t h = hash[0];
+    uint64_t h = hashes[i];
 
     bool doSquareB = (span % 2 != 0);
     
@@ -354,4 +366,74 @@ bool Proof::verify(const GpuContext& gpu) const {
   return verificationResult;
 }
 
+// The marin engine keeps every value in its registers: a middle is
+// uploaded once per chain and nothing is read back until the comparison.
+// With the challenges taken first the B chain no longer waits on the A
+// chain, and A^(2^span), the only long sequential run, follows the A
+// exponentiations with no host round trip in between.
+bool Proof::verify(engine& eng) const {
+  const uint32_t power = middles.size();
+  if (power == 0) {
+    throw std::runtime_error("Invalid proof: no middle residues");
+  }
+
+  util::Timer timer;
+  const auto hashes = challenges();
+
+  std::cout << "Starting proof verification for M" << E;
+  for (const auto& factor : knownFactors) std::cout << "/" << factor;
+  std::cout << " with power " << power << std::endl;
+
+  std::vector<int> widths(eng.get_size());
+  {
+    const engine::digit d(&eng, 0);
+    for (size_t i = 0; i < widths.size(); ++i) widths[i] = d.width(i);
+  }
+  auto upload = [&](engine::Reg r, const std::vector<uint32_t>& w) {
+    const std::vector<uint64_t> digits = io::JsonBuilder::expandBits(w, widths, E);
+    eng.set_digits(r, digits.data());
+  };
+
+  engine::Reg a = 0, t = 3;
+  const engine::Reg b = 1, m = 2;
+  // the registers above t hold the odd powers of the sliding window of pow
+  const engine::Reg spare = 4;
+  const size_t spares = eng.get_reg_count() > spare ? eng.get_reg_count() - spare : 0;
+
+  // B = M^h * (B^2 if span odd else B)
+  upload(b, B);
+  uint32_t span = E;
+  for (uint32_t i = 0; i < power; ++i, span = (span + 1) / 2) {
+    if (span % 2 != 0) eng.square_mul(b);
+    upload(m, middles[i]);
+    eng.pow(t, m, hashes[i], spare, spares);
+    eng.set_multiplicand(t, t);
+    eng.mul(b, t);
+  }
+
+  // A = A^h * M, from A = 3
+  eng.set(a, 3);
+  for (uint32_t i = 0; i < power; ++i) {
+    eng.pow(t, a, hashes[i], spare, spares);
+    upload(m, middles[i]);
+    eng.set_multiplicand(m, m);
+    eng.mul(t, m);
+    std::swap(a, t);
+  }
+
+  // Final step: A = A^(2^span)
+  const uint32_t logStep = 100000;
+  for (uint32_t k = 1; k <= span; ++k) {
+    eng.square_mul(a);
+    if (span > logStep && k % logStep == 0) {
+      std::cout << "Verification: " << k << " / " << span << " iterations completed" << std::endl;
+    }
+  }
+
+  const bool verificationResult = eng.is_equal(a, b);
+  std::cout << "Verification result: " << (verificationResult ? "SUCCESS" : "FAIL") << std::endl;
+  std::cout << "Proof verified in " << std::fixed << std::setprecision(2) << timer.elapsed() << " seconds." << std::endl;
+  return verificationResult;
+}
+
 } // namespace core
@@ -21,96 +21,339 @@
  * This code is released as free software. 
  */
 #include "core/ProofManager.hpp"
+#include "util/Trace.hpp"
 #include "io/JsonBuilder.hpp"
+#include "util/Crc32.hpp"
+#include "util/HostPool.hpp"
 #include <vector>
 #include <iostream>
+#include <stdexcept>
 
 namespace core {
 
 ProofManager::ProofManager(uint32_t exponent, int proofLevel,
                            cl_command_queue queue, uint32_t n,
                            const std::vector<int>& digitWidth,
-                           const std::vector<std::string>& knownFactors)
-  : proofSet_(exponent, proofLevel, knownFactors)
+                           const std::vector<std::string>& knownFactors,
+                           ResidueCodec codec,
+                           cl_command_queue transferQueue)
+  : proofSet_(exponent, proofLevel, knownFactors, codec)
   , queue_(queue)
+  , transferQueue_(transferQueue ? transferQueue : queue)
   , n_(n)
   , exponent_(exponent)
   , digitWidth_(digitWidth)
 {}
 
+ProofManager::~ProofManager() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (writer_.joinable()) writer_.join();
+    releasePacker();
+}
+
+namespace {
+
+// Adds c at bit position `bit` of an E-bit residue, modulo 2^E - 1.
+void addAtBit(std::vector<uint32_t>& words, uint32_t E, uint64_t bit, uint64_t c) {
+    const size_t   top     = words.size() - 1;
+    const unsigned topBits = E - 32u * static_cast<unsigned>(top);
+    while (c != 0) {
+        size_t i = static_cast<size_t>(bit >> 5);
+        const unsigned sh = static_cast<unsigned>(bit & 31);
+        uint64_t s = uint64_t(words[i]) + ((c << sh) & 0xFFFFFFFFull);
+        uint64_t carry = (c >> (32 - sh)) + (s >> 32);
+        words[i] = uint32_t(s);
+        for (++i; carry != 0 && i <= top; ++i) {
+            s = uint64_t(words[i]) + (carry & 0xFFFFFFFFull);
+            words[i] = uint32_t(s);
+            carry = (carry >> 32) + (s >> 32);
+        }
+        // Whatever reached bit E or beyond comes back at bit 0.
+        c = carry << (32 - topBits);
+        if (topBits < 32) {
+            c += words[top] >> topBits;
+            words[top] &= (1u << topBits) - 1;
+        }
+        bit = 0;
+    }
+}
+
+} // namespace
+
+void ProofManager::attachPacker(cl_kernel packKernel, size_t workersCarry, bool unifiedMemory) {
+    flush();
+    releasePacker();
+
+    cl_context ctx = nullptr;
+    clGetCommandQueueInfo(queue_, CL_QUEUE_CONTEXT, sizeof(ctx), &ctx, nullptr);
+    const size_t wordBytes  = wordCount() * sizeof(uint32_t);
+    const size_t carryBytes = workersCarry * sizeof(uint64_t);
+    slotBytes_ = carryBytes + wordBytes;
+
+    cl_int err = CL_SUCCESS;
+    if (unifiedMemory) {
+        const cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR;
+        for (size_t k = 0; k < kMaxPending && err == CL_SUCCESS; ++k) {
+            slotWords_[k] = clCreateBuffer(ctx, flags, wordBytes, nullptr, &err);
+            if (err == CL_SUCCESS)
+                slotCarries_[k] = clCreateBuffer(ctx, flags, carryBytes, nullptr, &err);
+        }
+    } else {
+        packedWords_ = clCreateBuffer(ctx, CL_MEM_READ_WRITE, wordBytes, nullptr, &err);
+        if (err == CL_SUCCESS)
+            packedCarries_ = clCreateBuffer(ctx, CL_MEM_READ_WRITE, carryBytes, nullptr, &err);
+        if (err == CL_SUCCESS)
+            pinned_ = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, kMaxPending * slotBytes_, nullptr, &err);
+        if (err == CL_SUCCESS)
+            pinnedHost_ = static_cast<char*>(clEnqueueMapBuffer(queue_, pinned_, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                                                0, kMaxPending * slotBytes_, 0, nullptr, nullptr, &err));
+    }
+    if (err != CL_SUCCESS) {
+        std::cerr << "Warning: cannot allocate proof packing buffers, packing residues on the host" << std::endl;
+        releasePacker();
+        return;
+    }
+    packKernel_     = packKernel;
+    workersCarry_   = workersCarry;
+    unified_        = unifiedMemory;
+}
+
+// The writer is done with the slot: its buffers can take the next point.
+void ProofManager::unmapSlot(size_t slot) {
+    const cl_mem mem[2] = {slotCarries_[slot], slotWords_[slot]};
+    for (int b = 0; b < 2; ++b) {
+        if (slotMapped_[slot][b]) clEnqueueUnmapMemObject(queue_, mem[b], slotMapped_[slot][b], 0, nullptr, nullptr);
+        slotMapped_[slot][b] = nullptr;
+    }
+}
+
+void ProofManager::releasePacker() {
+    if (lastRead_) {
+        clWaitForEvents(1, &lastRead_);
+        clReleaseEvent(lastRead_);
+        lastRead_ = nullptr;
+    }
+    if (pinnedHost_) clEnqueueUnmapMemObject(queue_, pinned_, pinnedHost_, 0, nullptr, nullptr);
+    if (pinned_) clReleaseMemObject(pinned_);
+    if (packedCarries_) clReleaseMemObject(packedCarries_);
+    if (packedWords_) clReleaseMemObject(packedWords_);
+    pinnedHost_ = nullptr;
+    pinned_ = packedCarries_ = packedWords_ = nullptr;
+    for (size_t k = 0; k < kMaxPending; ++k) unmapSlot(k);
+    if (slotWords_[0]) clFinish(queue_);
+    for (size_t k = 0; k < kMaxPending; ++k) {
+        if (slotWords_[k]) clReleaseMemObject(slotWords_[k]);
+        if (slotCarries_[k]) clReleaseMemObject(slotCarries_[k]);
+        slotWords_[k] = slotCarries_[k] = nullptr;
+    }
+    unified_ = false;
+    packKernel_ = nullptr;
+}
+
+void ProofManager::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return pending_.empty() && !writing_; });
+}
+
+void ProofManager::enqueue(PendingPoint point) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!writer_.joinable())
+        writer_ = std::thread(&ProofManager::writerLoop, this);
+    cv_.wait(lock, [this] { return pending_.size() < kMaxPending; });
+    pending_.push_back(std::move(point));
+    lock.unlock();
+    cv_.notify_all();
+}
+
 void ProofManager::checkpoint(cl_mem buf, uint32_t iter) {
     if (! proofSet_.shouldCheckpoint(iter)) return;
+    util::TraceSpan span("proof_checkpoint");
 
-    // read back the buffer from GPU
-    std::vector<uint64_t> host(n_);
-    clEnqueueReadBuffer(queue_, buf, CL_TRUE, 0,
-                        n_ * sizeof(uint64_t),
-                        host.data(), 0, nullptr, nullptr);
+    if (!packKernel_) {
+        // read back the buffer from GPU
+        util::HostPool::Lease host = util::HostPool::acquire(n_, false);
+        clEnqueueReadBuffer(queue_, buf, CL_TRUE, 0,
+                            n_ * sizeof(uint64_t),
+                            host.data(), 0, nullptr, nullptr);
+        enqueue({iter, nullptr, 0, io::JsonBuilder::compactBits(*host, digitWidth_, exponent_)});
+        return;
+    }
 
-    // Get residue from NTT buffer using compactBits
-    auto words = io::JsonBuilder::compactBits(host, digitWidth_, exponent_);
-    
-    // Save in PRPLL-compatible format
-    proofSet_.save(iter, words);
-    
-    // Verify the checkpoint by loading it back and comparing
-    try {
-        auto loadedWords = proofSet_.load(iter);
-        
-        // Compare the saved and loaded data
-        if (words.size() != loadedWords.size()) {
-            std::cerr << "Warning: Checkpoint validation failed: size mismatch (" 
-                      << words.size() << " vs " << loadedWords.size() << ")" << std::endl;
-            return;
-        }
-        
-        for (size_t i = 0; i < words.size(); ++i) {
-            if (words[i] != loadedWords[i]) {
-                std::cerr << "Warning: Checkpoint validation failed: data mismatch at word " 
-                          << i << " (0x" << words[i] << " vs 0x" << loadedWords[i] << ")" << std::endl;
-                return;
+    // Slots are handed back by the writer; with kMaxPending slots and as
+    // many queued points at most, one is free once the queue has room.
+    size_t slot = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return pending_.size() < kMaxPending; });
+        while (slotBusy_[slot]) {
+            if (++slot == kMaxPending) {
+                slot = 0;
+                cv_.wait(lock);
             }
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Warning: Checkpoint validation failed at iteration " << iter 
-                  << ": " << e.what() << std::endl;
+        slotBusy_[slot] = true;
+    }
+
+    const size_t wordBytes  = wordCount() * sizeof(uint32_t);
+    const size_t carryBytes = workersCarry_ * sizeof(uint64_t);
+    if (unified_) unmapSlot(slot);
+    cl_mem words   = unified_ ? slotWords_[slot]   : packedWords_;
+    cl_mem carries = unified_ ? slotCarries_[slot] : packedCarries_;
+    const cl_uint zero = 0;
+    // the shared packing buffers may still be read on the transfer queue
+    const cl_uint waits = (!unified_ && lastRead_) ? 1 : 0;
+    cl_int err = clEnqueueFillBuffer(queue_, words, &zero, sizeof(zero), 0, wordBytes,
+                                     waits, waits ? &lastRead_ : nullptr, nullptr);
+    err |= clSetKernelArg(packKernel_, 0, sizeof(cl_mem), &buf);
+    err |= clSetKernelArg(packKernel_, 1, sizeof(cl_mem), &words);
+    err |= clSetKernelArg(packKernel_, 2, sizeof(cl_mem), &carries);
+    cl_event packed = nullptr;
+    err |= clEnqueueNDRangeKernel(queue_, packKernel_, 1, nullptr, &workersCarry_, nullptr, 0, nullptr,
+                                  unified_ ? nullptr : &packed);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to enqueue kernel_pack_bits");
     }
+
+    cl_event done = nullptr;
+    if (unified_) {
+        slotMapped_[slot][0] = clEnqueueMapBuffer(queue_, carries, CL_FALSE, CL_MAP_READ, 0, carryBytes,
+                                                  0, nullptr, nullptr, &err);
+        if (err == CL_SUCCESS)
+            slotMapped_[slot][1] = clEnqueueMapBuffer(queue_, words, CL_FALSE, CL_MAP_READ, 0, wordBytes,
+                                                      0, nullptr, &done, &err);
+        if (err != CL_SUCCESS) {
+            throw std::runtime_error("Failed to map the proof packing buffers");
+        }
+    } else {
+        // read by the copy engine once packed, while the next squarings run
+        char* host = pinnedHost_ + slot * slotBytes_;
+        clFlush(queue_);
+        clEnqueueReadBuffer(transferQueue_, carries, CL_FALSE, 0, carryBytes, host, 1, &packed, nullptr);
+        clEnqueueReadBuffer(transferQueue_, words, CL_FALSE, 0, wordBytes, host + carryBytes, 1, &packed, &done);
+        clReleaseEvent(packed);
+        if (lastRead_) clReleaseEvent(lastRead_);
+        lastRead_ = done;
+        clRetainEvent(lastRead_);
+        clFlush(transferQueue_);
+    }
+    clFlush(queue_);
+    enqueue({iter, done, slot, {}});
 }
+
 void ProofManager::checkpointMarin(std::vector<uint64_t> host, uint32_t iter) {
     if (! proofSet_.shouldCheckpoint(iter)) return;
+    util::TraceSpan span("proof_checkpoint");
 
     // Get residue from NTT buffer using compactBits
-    auto words = io::JsonBuilder::compactBits(host, digitWidth_, exponent_);
-    
-    // Save in PRPLL-compatible format
-    proofSet_.save(iter, words);
-    
-    // Verify the checkpoint by loading it back and comparing
-    try {
-        auto loadedWords = proofSet_.load(iter);
-        
-        // Compare the saved and loaded data
-        if (words.size() != loadedWords.size()) {
-            std::cerr << "Warning: Checkpoint validation failed: size mismatch (" 
-                      << words.size() << " vs " << loadedWords.size() << ")" << std::endl;
-            return;
-        }
-        
-        for (size_t i = 0; i < words.size(); ++i) {
-            if (words[i] != loadedWords[i]) {
-                std::cerr << "Warning: Checkpoint validation failed: data mismatch at word " 
-                          << i << " (0x" << words[i] << " vs 0x" << loadedWords[i] << ")" << std::endl;
-                return;
+    enqueue({iter, nullptr, 0, io::JsonBuilder::compactBits(host, digitWidth_, exponent_)});
+}
+
+std::vector<uint32_t> ProofManager::unpack(const uint64_t* carries, const uint32_t* packed) const {
+    std::vector<uint32_t> words(packed, packed + wordCount());
+    const uint64_t blockDigits = n_ / workersCarry_;
+    for (size_t g = 0; g < workersCarry_; ++g) {
+        if (carries[g] == 0) continue;
+        // The carry leaving block g belongs at the first bit of block g + 1.
+        const uint64_t bit = (uint64_t(exponent_) * (g + 1) * blockDigits + n_ - 1) / n_;
+        addAtBit(words, exponent_, bit % exponent_, carries[g]);
+    }
+    return words;
+}
+
+void ProofManager::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        if (pending_.empty()) return;
+        PendingPoint point = std::move(pending_.front());
+        pending_.pop_front();
+        writing_ = true;
+        lock.unlock();
+        cv_.notify_all();
+
+        util::TraceSpan span("proof_write");
+        if (point.done) {
+            clWaitForEvents(1, &point.done);
+            clReleaseEvent(point.done);
+            if (unified_) {
+                point.words = unpack(static_cast<const uint64_t*>(slotMapped_[point.slot][0]),
+                                     static_cast<const uint32_t*>(slotMapped_[point.slot][1]));
+            } else {
+                // slot layout: the block carries, then the packed words
+                const char* host = pinnedHost_ + point.slot * slotBytes_;
+                point.words = unpack(reinterpret_cast<const uint64_t*>(host),
+                                     reinterpret_cast<const uint32_t*>(host + workersCarry_ * sizeof(uint64_t)));
             }
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Warning: Checkpoint validation failed at iteration " << iter 
-                  << ": " << e.what() << std::endl;
+        uint32_t crc = 0;
+        bool ok = true;
+        try {
+            // Save in PRPLL-compatible format
+            crc = proofSet_.save(point.iter, point.words);
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: " << e.what() << std::endl;
+            ok = false;
+        }
+
+        lock.lock();
+        if (point.done) slotBusy_[point.slot] = false;
+        if (ok) written_[point.iter] = crc;
+        else    failed_.push_back(point.iter);
+        writing_ = false;
+        cv_.notify_all();
     }
 }
 
-std::filesystem::path ProofManager::proof(const opencl::Context& ctx, opencl::NttEngine& ntt, math::Carry& carry, bool verify) const {
+std::vector<uint32_t> ProofManager::verifyPoints() {
+    flush();
+    std::map<uint32_t, uint32_t> written;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        written.swap(written_);
+    }
+
+    std::vector<uint32_t> bad;
+    for (const auto& [iter, crc] : written) {
+        try {
+            // load checks the file against its own CRC, the recorded one
+            // catches a file that is whole but not the one written.
+            auto words = proofSet_.load(iter);
+            if (computeCRC32(words.data(), words.size() * sizeof(uint32_t)) == crc) continue;
+            std::cerr << "Warning: Checkpoint validation failed at iteration " << iter
+                      << ": content differs from what was written" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Checkpoint validation failed at iteration " << iter
+                      << ": " << e.what() << std::endl;
+        }
+        std::error_code ec;
+        std::filesystem::remove(ProofSet::proofPath(exponent_) / std::to_string(iter), ec);
+        bad.push_back(iter);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_.insert(failed_.end(), bad.begin(), bad.end());
+    return failed_;
+}
+
+std::vector<uint32_t> ProofManager::failedPoints() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+std::filesystem::path ProofManager::proof(const opencl::Context& ctx, opencl::NttEngine& ntt, math::Carry& carry, bool verify) {
+    util::TraceSpan span("proof_build");
     try {
+        // Every point must be on disk and intact before the proof is built.
+        auto failed = verifyPoints();
+        if (!failed.empty()) {
+            std::string list;
+            for (uint32_t iter : failed) list += (list.empty() ? "" : ", ") + std::to_string(iter);
+            throw std::runtime_error("proof points must be recomputed, bad residue at iteration(s) " + list);
+        }
                     
         // Calculate limbBytes for GPU proof generation
         size_t limbBytes = n_ * sizeof(uint64_t);
@@ -21,6 +21,7 @@
  * This code is released as free software. 
  */
 #include "core/ProofManagerMarin.hpp"
+#include "util/Trace.hpp"
 #include "io/JsonBuilder.hpp"
 #include <vector>
 #include <iostream>
@@ -30,8 +31,9 @@ namespace core {
 ProofManagerMarin::ProofManagerMarin(uint32_t exponent, int proofLevel,
                            cl_command_queue queue, uint32_t n,
                            const std::vector<int>& digitWidth,
-                           const std::vector<std::string>& knownFactors)
-  : proofSet_(exponent, proofLevel, knownFactors)
+                           const std::vector<std::string>& knownFactors,
+                           ResidueCodec codec)
+  : proofSet_(exponent, proofLevel, knownFactors, codec)
   , queue_(queue)
   , n_(n)
   , exponent_(exponent)
@@ -40,6 +42,7 @@ ProofManagerMarin::ProofManagerMarin(uint32_t exponent, int proofLevel,
 
 void ProofManagerMarin::checkpoint(cl_mem buf, uint32_t iter) {
     if (! proofSet_.shouldCheckpoint(iter)) return;
+    util::TraceSpan span("proof_checkpoint");
 
     // read back the buffer from GPU
     std::vector<uint64_t> host(n_);
@@ -121,10 +124,10 @@ void ProofManagerMarin::checkpointMarin(engine::digit host, uint32_t iter)
 }
 
 
-std::filesystem::path ProofManagerMarin::proof() const {
+std::filesystem::path ProofManagerMarin::proof(engine* eng) const {
     try {
         // Generate proof from collected checkpoints
-        ProofMarin proof = proofSet_.computeProof();
+        ProofMarin proof = eng ? proofSet_.computeProof(*eng) : proofSet_.computeProof();
         
         // Create proof file name: {exponent}-{power}.proof
         std::string filename = std::to_string(exponent_) + "-" + 
@@ -23,15 +23,24 @@
 #include "io/Sha3Hash.h"
 #include "util/Crc32.hpp"
 #include "util/Timer.hpp"
+#include "util/Fs.hpp"
+#include "util/MappedFile.hpp"
 #include "opencl/NttEngine.hpp"
 #include "math/Carry.hpp"
 #include "io/JsonBuilder.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <future>
+#include <mutex>
+#include <thread>
 
 #ifndef CL_TARGET_OPENCL_VERSION
 #define CL_TARGET_OPENCL_VERSION 300
@@ -64,8 +73,9 @@ Words Words::fromUint64(const std::vector<uint64_t>& host, uint32_t exponent) {
 }
 
 // ProofSet
-ProofSet::ProofSet(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors)
-  : E{exponent}, power{proofLevel}, knownFactors{std::move(factors)} {
+ProofSet::ProofSet(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors,
+                   ResidueCodec codec)
+  : E{exponent}, power{proofLevel}, knownFactors{std::move(factors)}, codec_{codec} {
   // Create proof directory
   std::filesystem::create_directories(proofPath(E));
 
@@ -103,29 +113,19 @@ bool ProofSet::shouldCheckpoint(uint32_t iter) const {
   return isInPoints(E, power, iter);
 }
 
-void ProofSet::save(uint32_t iter, const std::vector<uint32_t>& words) {
+uint32_t ProofSet::save(uint32_t iter, const std::vector<uint32_t>& words) {
   if (!shouldCheckpoint(iter)) {
-    return;
+    return 0;
   }
 
   // Create the file path for this iteration
   auto filePath = proofPath(E) / std::to_string(iter);
   
-  // Write the words data to file
-  std::ofstream file(filePath, std::ios::binary);
-  if (!file) {
-    throw std::runtime_error("Cannot create proof checkpoint file: " + filePath.string());
-  }
-  
-  // Write CRC32 first, then the data
+  // CRC32 first, then the data (compressed with codec_); synced and
+  // renamed into place
   uint32_t crc = computeCRC32(words.data(), words.size() * sizeof(uint32_t));
-  file.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
-  file.write(reinterpret_cast<const char*>(words.data()), 
-             words.size() * sizeof(uint32_t));
-  
-  if (!file.good()) {
-    throw std::runtime_error("Error writing proof checkpoint file: " + filePath.string());
-  }
+  writeResidue(filePath.string(), words, crc, codec_);
+  return crc;
 }
 
 Words ProofSet::fromUint64(const std::vector<uint64_t>& host, uint32_t exponent) {
@@ -185,37 +185,94 @@ std::vector<uint32_t> ProofSet::load(uint32_t iter) const {
     throw std::runtime_error("Attempt to load non-checkpoint iteration: " + std::to_string(iter));
   }
 
-  auto filePath = proofPath(E) / std::to_string(iter);
-  std::ifstream file(filePath, std::ios::binary);
-  if (!file) {
-    throw std::runtime_error("Cannot open proof checkpoint file: " + filePath.string());
+  return readResidue((proofPath(E) / std::to_string(iter)).string(), E);
+}
+
+namespace {
+
+// Feeds the multiply tree: on a worker thread, each residue file is mapped
+// (the next one is prefetched meanwhile), decompressed from the mapping,
+// checked and expanded to limbs,
+// keeping at most kAhead residues ready so the GPU does not wait on disk.
+class ResidueStream {
+public:
+  ResidueStream(std::vector<uint32_t> iterations, uint32_t E, const std::vector<int>& digitWidth)
+    : iterations_(std::move(iterations)), E_(E), digitWidth_(digitWidth),
+      worker_([this] { run(); }) {}
+
+  ~ResidueStream() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
   }
 
-  // Read CRC32 first
-  uint32_t crc;
-  file.read(reinterpret_cast<char*>(&crc), sizeof(crc));
-  if (!file.good()) {
-    throw std::runtime_error("Error reading CRC32 from proof checkpoint file: " + filePath.string());
+  // Limbs of the next residue, in the order the iterations were given.
+  std::vector<uint64_t> next() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !ready_.empty(); });
+    Item item = std::move(ready_.front());
+    ready_.pop_front();
+    lock.unlock();
+    cv_.notify_all();
+    if (item.error) std::rethrow_exception(item.error);
+    return std::move(item.limbs);
   }
 
-  // Calculate expected file size in 32-bit words: (E + 31) / 32
-  uint32_t expectedWords = (E + 31) / 32;
-  
-  // Read the 32-bit words data
-  std::vector<uint32_t> words(expectedWords);
-  file.read(reinterpret_cast<char*>(words.data()), expectedWords * sizeof(uint32_t));
-  if (!file.good()) {
-    throw std::runtime_error("Error reading data from proof checkpoint file: " + filePath.string());
+private:
+  static constexpr size_t kAhead = 4;
+
+  struct Item {
+    std::vector<uint64_t> limbs;
+    std::exception_ptr    error;
+  };
+
+  std::vector<uint32_t>   iterations_;
+  uint32_t                E_;
+  const std::vector<int>& digitWidth_;
+  std::mutex              mutex_;
+  std::condition_variable cv_;
+  std::deque<Item>        ready_;
+  bool                    stop_ = false;
+  std::thread             worker_;
+
+  util::MappedFile open(size_t i) const {
+    util::MappedFile f((ProofSet::proofPath(E_) / std::to_string(iterations_[i])).string());
+    f.prefetch();
+    return f;
   }
 
-  // Verify CRC32
-  uint32_t computedCrc = computeCRC32(words.data(), words.size() * sizeof(uint32_t));
-  if (crc != computedCrc) {
-    throw std::runtime_error("CRC32 mismatch in proof checkpoint file: " + filePath.string());
+  void run() {
+    util::MappedFile ahead;
+    std::exception_ptr aheadError;
+    for (size_t i = 0; i < iterations_.size(); ++i) {
+      Item item;
+      try {
+        if (aheadError) std::rethrow_exception(aheadError);
+        util::MappedFile cur = (i == 0) ? open(0) : std::move(ahead);
+        aheadError = nullptr;
+        if (i + 1 < iterations_.size()) {
+          try { ahead = open(i + 1); } catch (...) { aheadError = std::current_exception(); }
+        }
+        const std::string path = (ProofSet::proofPath(E_) / std::to_string(iterations_[i])).string();
+        item.limbs = io::JsonBuilder::expandBits(decodeResidue(cur.data(), cur.size(), E_, path), digitWidth_, E_);
+      } catch (...) {
+        item.error = std::current_exception();
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || ready_.size() < kAhead; });
+      if (stop_) return;
+      ready_.push_back(std::move(item));
+      lock.unlock();
+      cv_.notify_all();
+    }
   }
+};
 
-  return words;
-}
+} // namespace
 
 Proof ProofSet::computeProof(const GpuContext& gpu) const {
   // Start timing proof generation
@@ -224,9 +281,42 @@ Proof ProofSet::computeProof(const GpuContext& gpu) const {
   std::vector<std::vector<uint32_t>> middles;
   std::vector<uint64_t> hashes;
 
+  // Residues in the order the tree consumes them, all levels back to back,
+  // so loading runs ahead across level boundaries.
+  // PRPLL's formula: level p loads checkpoint at points[s * (i * 2 + 1) - 1]
+  std::vector<std::vector<uint32_t>> levelIters(power);
+  std::vector<uint32_t> order;
+  for (uint32_t p = 0; p < power; ++p) {
+    uint32_t s = (1u << (power - p - 1));
+    for (uint32_t i = 0; i < (1u << p); ++i) {
+      uint32_t checkpointIndex = s * (i * 2 + 1) - 1;
+      uint32_t iteration = checkpointIndex < points.size() ? points[checkpointIndex] : uint32_t(-1);
+      levelIters[p].push_back(iteration);
+      if (iteration <= E && shouldCheckpoint(iteration)) order.push_back(iteration);
+    }
+  }
+  ResidueStream stream(std::move(order), E, gpu.digitWidth);
+
   // Initial hash of the final residue B
   auto B = load(E);
-  auto hash = Proof::hashWords(E, B);
+
+  // SHA3 of each middle runs on the side and is only waited for by the
+  // first expMul of the next level.
+  std::future<std::array<uint64_t, 4>> pendingHash =
+      std::async(std::launch::async, [this, &B] { return Proof::hashWords(E, B); });
+  std::array<uint64_t, 4> hash{};
+  auto awaitHash = [&]() {
+    if (!pendingHash.valid()) return;
+    hash = pendingHash.get();
+    if (!middles.empty()) {
+      uint64_t newHash = hash[0]; // The first 64 bits of the hash
+      hashes.push_back(newHash);
+      // Show middle and hash for the previous level
+      uint64_t middleRes64 = Proof::res64(middles.back());
+      std::cout << "proof [" << middles.size() - 1 << "] : M " << std::hex << std::setfill('0') << std::setw(16) << middleRes64 
+                << ", h " << std::setw(16) << newHash << std::dec << std::endl;
+    }
+  };
 
   // Pre-allocate maximum needed buffer pool (power levels use 2^p buffers max)
   uint32_t maxBuffers = (1u << power);
@@ -248,35 +338,37 @@ Proof ProofSet::computeProof(const GpuContext& gpu) const {
     }
   }
 
+  std::deque<std::pair<cl_event, std::vector<uint64_t>>> uploads;
+
   // Main computation loop
   for (uint32_t p = 0; p < power; ++p) {
-    assert(p == hashes.size());
-    
-    uint32_t s = (1u << (power - p - 1)); // Step size for this level
     uint32_t levelBuffers = (1u << p); // Number of buffers needed for this level
     uint32_t bufIndex = 0;
     
     // Load residues and apply binary tree algorithm
     for (uint32_t i = 0; i < levelBuffers; ++i) {
-      // PRPLL's formula: load checkpoint at points[s * (i * 2 + 1) - 1]
-      uint32_t checkpointIndex = s * (i * 2 + 1) - 1;
-      
-      if (checkpointIndex >= points.size()) {
-        continue;
-      }
-      
-      uint32_t iteration = points[checkpointIndex];
+      uint32_t iteration = levelIters[p][i];
       
       if (iteration > E || !shouldCheckpoint(iteration)) {
         continue;
       }
       
-      auto w = load(iteration);
-      gpu.write(bufferPool[bufIndex], w);
+      // Uploads do not block; the host copy lives until its write is done.
+      uploads.emplace_back(nullptr, stream.next());
+      gpu.writeLimbs(bufferPool[bufIndex], uploads.back().second, &uploads.back().first);
+      while (uploads.size() > 2 || (!uploads.empty() && !uploads.front().first)) {
+        if (uploads.front().first) {
+          clWaitForEvents(1, &uploads.front().first);
+          clReleaseEvent(uploads.front().first);
+        }
+        uploads.pop_front();
+      }
       bufIndex++;
       
       // Apply hashes from previous levels
       for (uint32_t k = 0; i & (1u << k); ++k) {
+        awaitHash();
+        assert(p == hashes.size());
         assert(k <= p - 1);
         if (bufIndex < 2) {
           std::cerr << "Error: need at least 2 buffers for expMul, have " << bufIndex << std::endl;
@@ -296,27 +388,24 @@ Proof ProofSet::computeProof(const GpuContext& gpu) const {
       std::cerr << "Warning: expected bufIndex=1, got " << bufIndex << std::endl;
     }
     
-    // Convert the final result to words format
+    // Convert the final result to words format (the read drains the queue)
 
     auto levelResult = gpu.read(bufferPool[0]);
+    for (auto& u : uploads) clReleaseEvent(u.first);
+    uploads.clear();
     
     if (levelResult.empty()) {
       throw std::runtime_error("Read ZERO during proof generation at level " + std::to_string(p));
     }
     
-    // Store the result as middle for this level
+    // Store the result as middle for this level and chain its hash
+    awaitHash();
     middles.push_back(levelResult);
-    
-    // Update hash chain with this level's middle
-    hash = Proof::hashWords(E, hash, levelResult);
-    uint64_t newHash = hash[0]; // The first 64 bits of the hash
-    hashes.push_back(newHash);
-    
-    // Show middle and hash for the current level
-    uint64_t middleRes64 = Proof::res64(levelResult);
-    std::cout << "proof [" << p << "] : M " << std::hex << std::setfill('0') << std::setw(16) << middleRes64 
-              << ", h " << std::setw(16) << newHash << std::dec << std::endl;
+    pendingHash = std::async(std::launch::async, [this, prefix = hash, &middles] {
+      return Proof::hashWords(E, prefix, middles.back());
+    });
   }
+  awaitHash();
   
   // Clean up GPU buffers
   for (uint32_t i = 0; i < maxBuffers; ++i) {
@@ -340,15 +429,23 @@ double ProofSet::diskUsageGB(uint32_t E, uint32_t power) {
 }
 
 void GpuContext::write(cl_mem buffer, const std::vector<uint32_t>& data) const {
-  std::vector<uint64_t> gpu_data = io::JsonBuilder::expandBits(data, digitWidth, exponent);
-  
+  writeLimbs(buffer, io::JsonBuilder::expandBits(data, digitWidth, exponent), nullptr);
+}
+
+void GpuContext::writeLimbs(cl_mem buffer, const std::vector<uint64_t>& limbs, cl_event* done) const {
   // Ensure we have the correct size for the GPU buffer
   size_t numWords = limbBytes / sizeof(uint64_t);
-  if (gpu_data.size() != numWords) {
+  if (limbs.size() != numWords) {
+    std::vector<uint64_t> gpu_data(limbs);
     gpu_data.resize(numWords, 0);
+    if (done) *done = nullptr;
+    writeLimbs(buffer, gpu_data, nullptr);
+    return;
   }
   
-  cl_int err = clEnqueueWriteBuffer(ctx.getQueue(), buffer, CL_TRUE, 0, limbBytes, gpu_data.data(), 0, nullptr, nullptr);
+  // an async upload keeps the pageable source, it must outlive the copy
+  cl_int err = done ? clEnqueueWriteBuffer(ctx.getQueue(), buffer, CL_FALSE, 0, limbBytes, limbs.data(), 0, nullptr, done)
+                    : ctx.getStaging().write(buffer, limbs.data(), limbBytes);
   if (err != CL_SUCCESS) {
     throw std::runtime_error("Failed to upload data to GPU buffer");
   }
@@ -357,7 +454,7 @@ void GpuContext::write(cl_mem buffer, const std::vector<uint32_t>& data) const {
 std::vector<uint32_t> GpuContext::read(cl_mem buffer) const {
   size_t numWords = limbBytes / sizeof(uint64_t);
   std::vector<uint64_t> gpu_data(numWords);
-  cl_int err = clEnqueueReadBuffer(ctx.getQueue(), buffer, CL_TRUE, 0, limbBytes, gpu_data.data(), 0, nullptr, nullptr);
+  cl_int err = ctx.getStaging().read(buffer, gpu_data.data(), limbBytes);
   if (err != CL_SUCCESS) {
     throw std::runtime_error("Failed to download data from GPU buffer");
   }
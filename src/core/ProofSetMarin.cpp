@@ -24,6 +24,8 @@
 #include "util/Crc32.hpp"
 #include "util/Timer.hpp"
 #include "util/GmpUtils.hpp"
+#include "io/JsonBuilder.hpp"
+#include "marin/engine.h"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
@@ -53,8 +55,9 @@ WordsMarin WordsMarin::fromUint64(const std::vector<uint64_t>& host, uint32_t ex
 }
 
 // ProofSetMarin
-ProofSetMarin::ProofSetMarin(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors)
-  : E{exponent}, power{proofLevel}, knownFactors{std::move(factors)} {
+ProofSetMarin::ProofSetMarin(uint32_t exponent, uint32_t proofLevel, std::vector<std::string> factors,
+                             ResidueCodec codec)
+  : E{exponent}, power{proofLevel}, knownFactors{std::move(factors)}, codec_{codec} {
   if(exponent%2!=0){
       assert(E & 1); // E is supposed to be prime
     
@@ -104,21 +107,9 @@ void ProofSetMarin::save(uint32_t iter, const std::vector<uint32_t>& words) {
   // Create the file path for this iteration
   auto filePath = proofPath(E) / std::to_string(iter);
   
-  // Write the words data to file
-  std::ofstream file(filePath, std::ios::binary);
-  if (!file) {
-    throw std::runtime_error("Cannot create proof checkpoint file: " + filePath.string());
-  }
-  
-  // Write CRC32 first, then the data
+  // CRC32 first, then the data (compressed with codec_)
   uint32_t crc = computeCRC32(words.data(), words.size() * sizeof(uint32_t));
-  file.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
-  file.write(reinterpret_cast<const char*>(words.data()), 
-             words.size() * sizeof(uint32_t));
-  
-  if (!file.good()) {
-    throw std::runtime_error("Error writing proof checkpoint file: " + filePath.string());
-  }
+  writeResidue(filePath.string(), words, crc, codec_);
 }
 
 WordsMarin ProofSetMarin::fromUint64(const std::vector<uint64_t>& host, uint32_t exponent) {
@@ -178,36 +169,7 @@ std::vector<uint32_t> ProofSetMarin::load(uint32_t iter) const {
     throw std::runtime_error("Attempt to load non-checkpoint iteration: " + std::to_string(iter));
   }
 
-  auto filePath = proofPath(E) / std::to_string(iter);
-  std::ifstream file(filePath, std::ios::binary);
-  if (!file) {
-    throw std::runtime_error("Cannot open proof checkpoint file: " + filePath.string());
-  }
-
-  // Read CRC32 first
-  uint32_t crc;
-  file.read(reinterpret_cast<char*>(&crc), sizeof(crc));
-  if (!file.good()) {
-    throw std::runtime_error("Error reading CRC32 from proof checkpoint file: " + filePath.string());
-  }
-
-  // Calculate expected file size in 32-bit words: (E + 31) / 32
-  uint32_t expectedWords = (E + 31) / 32;
-  
-  // Read the 32-bit words data
-  std::vector<uint32_t> words(expectedWords);
-  file.read(reinterpret_cast<char*>(words.data()), expectedWords * sizeof(uint32_t));
-  if (!file.good()) {
-    throw std::runtime_error("Error reading data from proof checkpoint file: " + filePath.string());
-  }
-
-  // Verify CRC32
-  uint32_t computedCrc = computeCRC32(words.data(), words.size() * sizeof(uint32_t));
-  if (crc != computedCrc) {
-    throw std::runtime_error("CRC32 mismatch in proof checkpoint file: " + filePath.string());
-  }
-
-  return words;
+  return readResidue((proofPath(E) / std::to_string(iter)).string(), E);
 }
 
 ProofMarin ProofSetMarin::computeProof() const {
@@ -310,6 +272,124 @@ ProofMarin ProofSetMarin::computeProof() const {
   return ProofMarin{E, std::move(B), std::move(middles), knownFactors};
 }
 
+// Same tree on the marin engine. Only the top of the stack lives in a
+// register; entries below it wait on the host as packed words, so three
+// registers (0-2, overwritten) are enough at any power. Every product is
+// taken modulo 2^E - 1 and read back fully carried, so the middles match the
+// host computation bit for bit.
+ProofMarin ProofSetMarin::computeProof(engine& eng) const {
+  // Start timing proof generation
+  util::Timer timer;
+
+  std::vector<std::vector<uint32_t>> middles;
+  std::vector<uint64_t> hashes;
+
+  // Initial hash of the final residue B
+  auto B = load(E);
+  auto hash = ProofMarin::hashWords(E, B);
+
+  engine::Reg top = 0, spare = 1;
+  const engine::Reg base = 2;
+  // any register above base holds odd powers for the sliding window of pow
+  const engine::Reg window = 3;
+  const size_t windowRegs = eng.get_reg_count() > window ? eng.get_reg_count() - window : 0;
+
+  std::vector<int> widths(eng.get_size());
+  {
+    const engine::digit d(&eng, top);
+    for (size_t i = 0; i < widths.size(); ++i) widths[i] = d.width(i);
+  }
+  auto upload = [&](engine::Reg r, const std::vector<uint32_t>& w) {
+    const std::vector<uint64_t> digits = io::JsonBuilder::expandBits(w, widths, E);
+    eng.set_digits(r, digits.data());
+  };
+  auto download = [&](engine::Reg r) {
+    const engine::digit d(&eng, r);
+    std::vector<uint64_t> digits(d.get_size());
+    for (size_t i = 0; i < digits.size(); ++i) digits[i] = d.val(i);
+    return io::JsonBuilder::compactBits(digits, widths, E);
+  };
+
+  // Main computation loop
+  for (uint32_t p = 0; p < power; ++p) {
+    assert(p == hashes.size());
+    
+    uint32_t s = (1u << (power - p - 1)); // Step size for this level
+    uint32_t levelBuffers = (1u << p); // Number of buffers needed for this level
+    std::vector<std::vector<uint32_t>> below; // stack under the register
+    bool haveTop = false;
+    
+    // Load residues and apply binary tree algorithm
+    for (uint32_t i = 0; i < levelBuffers; ++i) {
+      // PRPLL's formula: load checkpoint at points[s * (i * 2 + 1) - 1]
+      uint32_t checkpointIndex = s * (i * 2 + 1) - 1;
+      
+      if (checkpointIndex >= points.size()) {
+        continue;
+      }
+      
+      uint32_t iteration = points[checkpointIndex];
+      
+      if (iteration > E || !shouldCheckpoint(iteration)) {
+        continue;
+      }
+      
+      if (haveTop) below.push_back(download(top));
+      upload(top, load(iteration));
+      haveTop = true;
+      
+      // Apply hashes from previous levels
+      for (uint32_t k = 0; i & (1u << k); ++k) {
+        assert(k <= p - 1);
+        if (below.empty()) {
+          std::cerr << "Error: need at least 2 buffers for expMul, have 1" << std::endl;
+          continue;
+        }
+        
+        uint64_t h = hashes[p - 1 - k]; // Hash from previous level
+        
+        // PRPLL's expMul: A := A^h * B, B being the register on top
+        upload(base, below.back());
+        below.pop_back();
+        eng.pow(spare, base, h, window, windowRegs);
+        eng.set_multiplicand(top, top);
+        eng.mul(spare, top);
+        std::swap(top, spare);
+      }
+    }
+    
+    if (!haveTop || !below.empty()) {
+      std::cerr << "Warning: expected bufIndex=1, got " << below.size() + (haveTop ? 1 : 0) << std::endl;
+    }
+    
+    // Convert the final result to words format
+    auto levelResult = download(top);
+    
+    if (levelResult.empty()) {
+      throw std::runtime_error("Read ZERO during proof generation at level " + std::to_string(p));
+    }
+    
+    // Store the result as middle for this level
+    middles.push_back(levelResult);
+    
+    // Update hash chain with this level's middle
+    hash = ProofMarin::hashWords(E, hash, levelResult);
+    uint64_t newHash = hash[0]; // The first 64 bits of the hash
+    hashes.push_back(newHash);
+    
+    // Show middle and hash for the current level
+    uint64_t middleRes64 = ProofMarin::res64(levelResult);
+    std::cout << "proof [" << p << "] : M " << std::hex << std::setfill('0') << std::setw(16) << middleRes64 
+              << ", h " << std::setw(16) << newHash << std::dec << std::endl;
+  }
+  
+  // Display proof generation time
+  double elapsed = timer.elapsed();
+  std::cout << "Proof generated in " << std::fixed << std::setprecision(2) << elapsed << " seconds." << std::endl;
+  
+  return ProofMarin{E, std::move(B), std::move(middles), knownFactors};
+}
+
 double ProofSetMarin::diskUsageGB(uint32_t E, uint32_t power) {
   // Calculate disk usage in GB for proof files
   // Formula from PRPLL: ldexp(E, -33 + int(power)) * 1.05
@@ -0,0 +1,174 @@
+// src/core/ResidueFile.cpp
+#include "core/ResidueFile.hpp"
+#include "util/Crc32.hpp"
+#include "util/Fs.hpp"
+#include "util/MappedFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace core {
+
+namespace {
+
+constexpr unsigned char kMagic[3] = {'P', 'R', 'Z'};
+constexpr std::size_t   kHeader   = sizeof(kMagic) + 1 + sizeof(uint32_t);
+
+constexpr unsigned kHashBits  = 16;
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kMaxOffset = 65535;
+// the last bytes are always literals, so a match never reads past the end
+constexpr std::size_t kTail = 12;
+
+void putLength(std::vector<unsigned char>& out, std::size_t len) {
+    for (; len >= 255; len -= 255) out.push_back(255);
+    out.push_back(static_cast<unsigned char>(len));
+}
+
+// Sequences of: token (literal length << 4 | match length - 4), literal
+// length extension, literals, little-endian offset, match length extension;
+// the last sequence has literals only. A run without matches searches ever
+// fewer positions, so a residue that does not compress costs little.
+std::vector<unsigned char> lzCompress(const unsigned char* in, std::size_t n) {
+    std::vector<unsigned char> out;
+    out.reserve(n + n / 255 + 16);
+    std::vector<uint32_t> table(std::size_t(1) << kHashBits, 0);   // position + 1
+
+    std::size_t anchor = 0, i = 0;
+    const std::size_t limit = n > kTail ? n - kTail : 0;
+    while (i < limit) {
+        uint32_t v;
+        std::memcpy(&v, in + i, sizeof(v));
+        const uint32_t h = (v * 2654435761u) >> (32 - kHashBits);
+        const std::size_t cand = table[h];
+        table[h] = static_cast<uint32_t>(i + 1);
+        uint32_t c = 0;
+        if (cand != 0) std::memcpy(&c, in + cand - 1, sizeof(c));
+        if (cand == 0 || i + 1 - cand > kMaxOffset || c != v) {
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+        const std::size_t ref = cand - 1;
+        std::size_t len = kMinMatch;
+        while (i + len < n - kTail / 2 && in[ref + len] == in[i + len]) ++len;
+
+        const std::size_t lit = i - anchor, ml = len - kMinMatch;
+        out.push_back(static_cast<unsigned char>((std::min<std::size_t>(lit, 15) << 4)
+                                                 | std::min<std::size_t>(ml, 15)));
+        if (lit >= 15) putLength(out, lit - 15);
+        out.insert(out.end(), in + anchor, in + i);
+        const std::size_t off = i - ref;
+        out.push_back(static_cast<unsigned char>(off));
+        out.push_back(static_cast<unsigned char>(off >> 8));
+        if (ml >= 15) putLength(out, ml - 15);
+        i += len;
+        anchor = i;
+    }
+    const std::size_t lit = n - anchor;
+    out.push_back(static_cast<unsigned char>(std::min<std::size_t>(lit, 15) << 4));
+    if (lit >= 15) putLength(out, lit - 15);
+    out.insert(out.end(), in + anchor, in + n);
+    return out;
+}
+
+bool lzDecompress(const unsigned char* in, std::size_t n, unsigned char* out, std::size_t outSize) {
+    std::size_t ip = 0, op = 0;
+    auto getLength = [&](std::size_t& len) {
+        unsigned char b;
+        do {
+            if (ip >= n) return false;
+            b = in[ip++];
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+    while (ip < n) {
+        const unsigned token = in[ip++];
+        std::size_t lit = token >> 4;
+        if (lit == 15 && !getLength(lit)) return false;
+        if (lit > n - ip || lit > outSize - op) return false;
+        std::memcpy(out + op, in + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break;
+        if (n - ip < 2) return false;
+        const std::size_t off = in[ip] | (std::size_t(in[ip + 1]) << 8);
+        ip += 2;
+        std::size_t ml = token & 15;
+        if (ml == 15 && !getLength(ml)) return false;
+        ml += kMinMatch;
+        if (off == 0 || off > op || ml > outSize - op) return false;
+        // the match may overlap what it writes
+        for (const std::size_t end = op + ml; op < end; ++op) out[op] = out[op - off];
+    }
+    return op == outSize;
+}
+
+} // namespace
+
+bool parseResidueCodec(const std::string& name, ResidueCodec& codec) {
+    if (name == "none") codec = ResidueCodec::None;
+    else if (name == "lz") codec = ResidueCodec::Lz;
+    else return false;
+    return true;
+}
+
+void writeResidue(const std::string& path, const std::vector<uint32_t>& words,
+                  uint32_t crc, ResidueCodec codec)
+{
+    const std::size_t bytes = words.size() * sizeof(uint32_t);
+    std::vector<unsigned char> packed;
+    if (codec == ResidueCodec::Lz)
+        packed = lzCompress(reinterpret_cast<const unsigned char*>(words.data()), bytes);
+
+    bool ok;
+    if (codec != ResidueCodec::None && kHeader + packed.size() < sizeof(crc) + bytes) {
+        unsigned char head[sizeof(kMagic) + 1];
+        std::memcpy(head, kMagic, sizeof(kMagic));
+        head[sizeof(kMagic)] = static_cast<unsigned char>(codec);
+        ok = writeFileDurable(path, {{head, sizeof(head)}, {&crc, sizeof(crc)},
+                                     {packed.data(), packed.size()}});
+    } else {
+        ok = writeFileDurable(path, {{&crc, sizeof(crc)}, {words.data(), bytes}});
+    }
+    if (!ok) throw std::runtime_error("Error writing proof checkpoint file: " + path);
+}
+
+std::vector<uint32_t> decodeResidue(const unsigned char* data, std::size_t size,
+                                    uint32_t E, const std::string& path)
+{
+    const std::size_t expectedWords = (E + 31) / 32;
+    const std::size_t bytes = expectedWords * sizeof(uint32_t);
+    std::vector<uint32_t> words(expectedWords);
+    uint32_t crc;
+    if (size == sizeof(crc) + bytes) {
+        std::memcpy(&crc, data, sizeof(crc));
+        std::memcpy(words.data(), data + sizeof(crc), bytes);
+    } else {
+        if (size < kHeader || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("Error reading data from proof checkpoint file: " + path);
+        }
+        std::memcpy(&crc, data + sizeof(kMagic) + 1, sizeof(crc));
+        const auto codec = static_cast<ResidueCodec>(data[sizeof(kMagic)]);
+        if (codec != ResidueCodec::Lz
+            || !lzDecompress(data + kHeader, size - kHeader, reinterpret_cast<unsigned char*>(words.data()), bytes)) {
+            throw std::runtime_error("Error decompressing proof checkpoint file: " + path);
+        }
+    }
+    if (crc != computeCRC32(words.data(), bytes)) {
+        throw std::runtime_error("CRC32 mismatch in proof checkpoint file: " + path);
+    }
+    return words;
+}
+
+std::vector<uint32_t> readResidue(const std::string& path, uint32_t E) {
+    util::MappedFile file;
+    try {
+        file = util::MappedFile(path);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Cannot open proof checkpoint file: " + path);
+    }
+    return decodeResidue(file.data(), file.size(), E, path);
+}
+
+} // namespace core
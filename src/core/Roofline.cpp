@@ -0,0 +1,191 @@
+// src/core/Roofline.cpp
+#include "core/Roofline.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace core {
+
+namespace {
+
+// The reduction of the kernels, without their PTX and AMD variants: four
+// independent chains keep the multipliers busy.
+const char* kModmulSource = R"CLC(
+#define MOD_MP64 0xffffffffu
+inline ulong mod_mul(const ulong lhs, const ulong rhs)
+{
+	const ulong lo = lhs * rhs, hi = mul_hi(lhs, rhs);
+	const uint hi_hi = (uint)(hi >> 32), hi_lo = (uint)(hi);
+	ulong t = lo - hi_hi;
+	if (lo < hi_hi) t -= MOD_MP64;
+	const ulong u = (ulong)(hi_lo) * MOD_MP64;
+	ulong r = t + u;
+	if (r < u) r += MOD_MP64;
+	return r;
+}
+__kernel void roofline_modmul(__global ulong * const out, const uint loops)
+{
+	const ulong id = get_global_id(0), m = 0x12345678abcdefUL;
+	ulong a = id + 3, b = id ^ 0x9e3779b97f4a7c15UL, c = id * 7 + 1, d = ~id;
+	for (uint i = 0; i < loops; ++i) { a = mod_mul(a, m); b = mod_mul(b, m); c = mod_mul(c, m); d = mod_mul(d, m); }
+	out[id] = a ^ b ^ c ^ d;
+}
+)CLC";
+
+constexpr int kRuns = 3;
+
+double seconds(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+double copyPeak(cl_context context, cl_device_id device, cl_command_queue queue) {
+    cl_ulong maxAlloc = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, nullptr);
+    const size_t bytes = static_cast<size_t>(std::min<cl_ulong>(cl_ulong(256) << 20, maxAlloc / 2));
+    if (bytes < (size_t(1) << 20)) return 0.0;
+    cl_int err = CL_SUCCESS;
+    cl_mem src = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, nullptr, &err);
+    cl_mem dst = err == CL_SUCCESS ? clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, nullptr, &err) : nullptr;
+    double best = 0.0;
+    if (err == CL_SUCCESS) {
+        const cl_uchar zero = 0;
+        clEnqueueFillBuffer(queue, src, &zero, 1, 0, bytes, 0, nullptr, nullptr);
+        clEnqueueCopyBuffer(queue, src, dst, 0, 0, bytes, 0, nullptr, nullptr);    // warm-up
+        clFinish(queue);
+        for (int r = 0; r < kRuns; ++r) {
+            const auto t0 = std::chrono::steady_clock::now();
+            for (int k = 0; k < 4; ++k) clEnqueueCopyBuffer(queue, src, dst, 0, 0, bytes, 0, nullptr, nullptr);
+            if (clFinish(queue) != CL_SUCCESS) break;
+            best = std::max(best, 4.0 * 2.0 * double(bytes) / seconds(t0) / 1e9);
+        }
+    }
+    if (dst) clReleaseMemObject(dst);
+    if (src) clReleaseMemObject(src);
+    return best;
+}
+
+double modmulPeak(cl_context context, cl_device_id device, cl_command_queue queue) {
+    cl_int err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithSource(context, 1, &kModmulSource, nullptr, &err);
+    if (err != CL_SUCCESS) return 0.0;
+    double best = 0.0;
+    cl_kernel kernel = nullptr;
+    cl_mem out = nullptr;
+    if (clBuildProgram(program, 1, &device, "", nullptr, nullptr) == CL_SUCCESS
+        && (kernel = clCreateKernel(program, "roofline_modmul", &err)) != nullptr && err == CL_SUCCESS) {
+        cl_uint cus = 1;
+        clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cus), &cus, nullptr);
+        const size_t global = size_t(std::max<cl_uint>(cus, 1)) * 4096;
+        out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, global * sizeof(cl_ulong), nullptr, &err);
+        const cl_uint loops = 4096;
+        if (err == CL_SUCCESS) {
+            clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+            clSetKernelArg(kernel, 1, sizeof(cl_uint), &loops);
+            clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &global, nullptr, 0, nullptr, nullptr);    // warm-up
+            clFinish(queue);
+            for (int r = 0; r < kRuns; ++r) {
+                const auto t0 = std::chrono::steady_clock::now();
+                if (clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &global, nullptr, 0, nullptr, nullptr) != CL_SUCCESS
+                    || clFinish(queue) != CL_SUCCESS) break;
+                best = std::max(best, double(global) * loops * 4.0 / seconds(t0));
+            }
+        }
+    }
+    if (out) clReleaseMemObject(out);
+    if (kernel) clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    return best;
+}
+
+struct Point {
+    double gbps, modmulPerSec, bwShare, mulShare;
+    const char* bound;
+};
+
+Point point(const Roofline::Peaks& peaks, const Roofline::Row& r) {
+    Point p{};
+    const double s = r.us_per_iter * 1e-6;
+    if (s <= 0.0) { p.bound = "unknown"; return p; }
+    p.gbps = r.bytes / s / 1e9;
+    p.modmulPerSec = Roofline::modmulsPerIter(r.transform) / s;
+    p.bwShare = peaks.gbps > 0.0 ? p.gbps / peaks.gbps : 0.0;
+    p.mulShare = peaks.modmulPerSec > 0.0 ? p.modmulPerSec / peaks.modmulPerSec : 0.0;
+    p.bound = (p.bwShare == 0.0 && p.mulShare == 0.0) ? "unknown" : (p.bwShare >= p.mulShare ? "memory" : "compute");
+    return p;
+}
+
+// CSV cells never contain quotes here, commas are dropped from free text.
+std::string csvCell(const std::string& s) {
+    std::string out;
+    for (char c : s)
+        if (c != ',' && c != '"' && static_cast<unsigned char>(c) >= 0x20) out += c;
+    return out;
+}
+
+} // namespace
+
+Roofline::Peaks Roofline::measure(cl_context context, cl_device_id device, cl_command_queue queue) {
+    Peaks peaks;
+    peaks.gbps = copyPeak(context, device, queue);
+    peaks.modmulPerSec = modmulPeak(context, device, queue);
+    if (peaks.gbps == 0.0) std::cerr << "Warning: cannot measure the copy bandwidth of the device" << std::endl;
+    if (peaks.modmulPerSec == 0.0) std::cerr << "Warning: cannot measure the modular product rate of the device" << std::endl;
+    return peaks;
+}
+
+double Roofline::modmulsPerIter(uint32_t n) {
+    if (n < 2) return 0.0;
+    const double N = double(n);
+    return 2.0 * (3.0 / 4.0) * N * (std::log2(N) / 2.0) + 3.0 * N;
+}
+
+void Roofline::print(std::ostream& os, const Peaks& peaks, const std::vector<Row>& rows) {
+    os << "Peaks: " << std::fixed << std::setprecision(1) << peaks.gbps << " GB/s (copy), "
+       << std::setprecision(2) << peaks.modmulPerSec / 1e9 << " Gmodmul/s\n"
+       << "Backend  Transform  Passes    MB/iter   us/iter      GB/s  %peak   Gmodmul/s  %peak  Bound\n";
+    for (const auto& r : rows) {
+        const Point p = point(peaks, r);
+        os << std::left << std::setw(7) << r.backend << std::right
+           << "  " << std::setw(9) << r.transform
+           << "  " << std::setprecision(1) << std::setw(6) << r.passes
+           << "  " << std::setprecision(2) << std::setw(9) << r.bytes / 1e6
+           << "  " << std::setw(8) << r.us_per_iter
+           << "  " << std::setprecision(1) << std::setw(8) << p.gbps
+           << "  " << std::setw(5) << 100.0 * p.bwShare
+           << "  " << std::setprecision(2) << std::setw(10) << p.modmulPerSec / 1e9
+           << "  " << std::setprecision(1) << std::setw(5) << 100.0 * p.mulShare
+           << "  " << p.bound << "\n";
+    }
+    os << std::flush;
+}
+
+void Roofline::writeCsv(std::ostream& os, const std::string& device, const Peaks& peaks, const std::vector<Row>& rows) {
+    os << "device,backend,exponent,transform,passes,bytes_per_iter,us_per_iter,gbps,peak_gbps,bw_share,"
+          "modmul_per_iter,modmul_per_s,peak_modmul_per_s,modmul_share,bound\n";
+    for (const auto& r : rows) {
+        const Point p = point(peaks, r);
+        os << csvCell(device) << ',' << r.backend << ',' << r.exponent << ',' << r.transform << ','
+           << std::fixed << std::setprecision(2) << r.passes << ','
+           << std::setprecision(0) << r.bytes << ','
+           << std::setprecision(4) << r.us_per_iter << ','
+           << std::setprecision(2) << p.gbps << ',' << peaks.gbps << ','
+           << std::setprecision(4) << p.bwShare << ','
+           << std::setprecision(0) << modmulsPerIter(r.transform) << ',' << p.modmulPerSec << ',' << peaks.modmulPerSec << ','
+           << std::setprecision(4) << p.mulShare << ',' << p.bound << '\n';
+    }
+}
+
+bool Roofline::writeCsv(const std::string& path, const std::string& device, const Peaks& peaks, const std::vector<Row>& rows) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Warning: cannot write the roofline to " << path << std::endl;
+        return false;
+    }
+    writeCsv(out, device, peaks, rows);
+    return static_cast<bool>(out);
+}
+
+} // namespace core
@@ -0,0 +1,55 @@
+// src/core/Session.cpp
+#include "core/Session.hpp"
+#include "core/Proof.hpp"
+#include "marin/engine.h"
+#include <chrono>
+#include <iostream>
+
+namespace core {
+
+void Session::prefetch(uint64_t exponent, const std::string& cacheDir) {
+    if (next_.valid()) return;
+    nextExponent_ = exponent;
+    next_ = std::async(std::launch::async, [exponent, cacheDir] { return math::Precompute(exponent, cacheDir); });
+}
+
+math::Precompute Session::take(uint64_t exponent, const std::string& cacheDir) {
+    if (next_.valid()) {
+        const bool match = nextExponent_ == exponent;
+        try {
+            math::Precompute pre = next_.get();
+            if (match) return pre;
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: prefetching the tables of " << nextExponent_ << " failed: " << e.what() << std::endl;
+        }
+    }
+    return math::Precompute(exponent, cacheDir);
+}
+
+Session::~Session() {
+    finishVerification();
+}
+
+void Session::verifyProof(const std::filesystem::path& proofFile,
+                          std::function<engine*(uint32_t exponent)> makeEngine) {
+    finishVerification();
+    verify_ = std::async(std::launch::async, [proofFile, makeEngine = std::move(makeEngine)] {
+        try {
+            const Proof proof = Proof::load(proofFile);
+            std::unique_ptr<engine> eng(makeEngine(proof.E));
+            if (!proof.verify(*eng))
+                std::cerr << "Warning: proof file " << proofFile.string() << " does not verify" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Proof file verification failed: " << e.what() << std::endl;
+        }
+    });
+}
+
+void Session::finishVerification() {
+    if (!verify_.valid()) return;
+    if (verify_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        std::cout << "Waiting for the proof verification to finish..." << std::endl;
+    verify_.get();
+}
+
+} // namespace core
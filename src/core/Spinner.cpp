@@ -21,10 +21,13 @@
  * This code is released as free software. 
  */
 #include "core/Spinner.hpp"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <thread>
 #include <chrono>
+#include <cstring>
 
 #ifdef _WIN32
   // Sur Windows (avant Win10 ou si ANSI non activé), on neutralise les couleurs
@@ -46,6 +49,121 @@ using namespace std::chrono;
 
 namespace core {
 
+namespace {
+
+// One write per line, so a line is not cut by output of other threads.
+void emit(const std::ostringstream& line) {
+    const std::string s = line.str();
+    std::cout.write(s.data(), static_cast<std::streamsize>(s.size()));
+    std::cout.flush();
+}
+
+void etaParts(double remaining, uint64_t& days, uint64_t& hrs, uint64_t& min, uint64_t& sec) {
+    sec  = static_cast<uint64_t>(remaining);
+    days = sec / 86400; sec %= 86400;
+    hrs  = sec / 3600;  sec %= 3600;
+    min  = sec / 60;    sec %= 60;
+}
+
+} // namespace
+
+void Spinner::Frame::publish(const Values& v) {
+    const uint64_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    iter.store(v.iter, std::memory_order_relaxed);
+    totalIters.store(v.totalIters, std::memory_order_relaxed);
+    expo.store(v.expo, std::memory_order_relaxed);
+    resumeIter.store(v.resumeIter, std::memory_order_relaxed);
+    elapsedTime.store(v.elapsedTime, std::memory_order_relaxed);
+    elapsedTime2.store(v.elapsedTime2, std::memory_order_relaxed);
+    for (size_t i = 0; i < kRes64Words; ++i) {
+        uint64_t w;
+        std::memcpy(&w, v.res64 + 8 * i, sizeof(w));
+        res64[i].store(w, std::memory_order_relaxed);
+    }
+    seq.store(s + 2, std::memory_order_release);
+}
+
+bool Spinner::Frame::read(uint64_t seen, Values& v, uint64_t& version) const {
+    for (;;) {
+        const uint64_t s1 = seq.load(std::memory_order_acquire);
+        if (s1 == seen) return false;
+        if (s1 & 1) { std::this_thread::yield(); continue; }
+        v.iter         = iter.load(std::memory_order_relaxed);
+        v.totalIters   = totalIters.load(std::memory_order_relaxed);
+        v.expo         = expo.load(std::memory_order_relaxed);
+        v.resumeIter   = resumeIter.load(std::memory_order_relaxed);
+        v.elapsedTime  = elapsedTime.load(std::memory_order_relaxed);
+        v.elapsedTime2 = elapsedTime2.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kRes64Words; ++i) {
+            const uint64_t w = res64[i].load(std::memory_order_relaxed);
+            std::memcpy(v.res64 + 8 * i, &w, sizeof(w));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) != s1) continue;
+        v.res64[kRes64Words * 8] = '\0';
+        version = s1;
+        return true;
+    }
+}
+
+void Spinner::Frame::waitShown() const {
+    const uint64_t target = seq.load(std::memory_order_acquire);
+    for (uint64_t s = shown.load(std::memory_order_acquire); s < target;
+         s = shown.load(std::memory_order_acquire))
+        shown.wait(s, std::memory_order_acquire);
+}
+
+bool Spinner::parseMode(const std::string& name, Mode& mode) {
+    if (name == "console") mode = Mode::Console;
+    else if (name == "quiet") mode = Mode::Quiet;
+    else if (name == "json") mode = Mode::Json;
+    else return false;
+    return true;
+}
+
+Spinner::Spinner(Mode mode)
+    : mode_(mode)
+{
+    if (mode_ != Mode::Quiet) ui_ = std::thread(&Spinner::uiLoop, this);
+}
+
+Spinner::~Spinner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (ui_.joinable()) ui_.join();
+}
+
+void Spinner::uiLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        const bool stop = cv_.wait_for(lock, milliseconds(kTickMs), [this] { return stop_; });
+        lock.unlock();
+        render();
+        if (stop) return;
+        lock.lock();
+    }
+}
+
+void Spinner::render() {
+    Values v;
+    uint64_t version;
+    if (backup_.read(backup_.shown.load(std::memory_order_relaxed), v, version)) {
+        printBackup(v);
+        backup_.shown.store(version, std::memory_order_release);
+        backup_.shown.notify_all();
+    }
+    if (progress_.read(progress_.shown.load(std::memory_order_relaxed), v, version)) {
+        printProgress(v);
+        progress_.shown.store(version, std::memory_order_release);
+        progress_.shown.notify_all();
+    }
+}
+
 void Spinner::displayProgress(uint64_t iter,
                               uint64_t totalIters,
                               double elapsedTime,
@@ -55,84 +173,126 @@ void Spinner::displayProgress(uint64_t iter,
                               uint64_t startIter,
                               std::string res64)
 {
+    (void)startIter;
+    if (mode_ == Mode::Quiet) return;
+    Values v;
+    v.iter = iter; v.totalIters = totalIters; v.expo = expo; v.resumeIter = resumeIter;
+    v.elapsedTime = elapsedTime; v.elapsedTime2 = elapsedTime2;
+    std::memcpy(v.res64, res64.data(), std::min(res64.size(), sizeof(v.res64) - 1));
+    progress_.publish(v);
+    if (iter >= totalIters) progress_.waitShown();
+}
+
+void Spinner::displayBackupInfo(uint64_t iter,
+                                uint64_t totalIters,
+                                double elapsedTime,
+                                std::string res64)
+{
+    if (mode_ == Mode::Quiet) return;
+    Values v;
+    v.iter = iter; v.totalIters = totalIters; v.elapsedTime = elapsedTime;
+    std::memcpy(v.res64, res64.data(), std::min(res64.size(), sizeof(v.res64) - 1));
+    backup_.publish(v);
+}
+
+void Spinner::printProgress(const Values& v) {
+    const uint64_t iter = v.iter, totalIters = v.totalIters;
     double pct = totalIters
                ? (100.0 * iter) / totalIters
                : 100.0;
 
-    uint64_t deltaIter = (iter > resumeIter) ? (iter - resumeIter) : iter;
+    uint64_t deltaIter = (iter > v.resumeIter) ? (iter - v.resumeIter) : iter;
 
-    double currentIPS = (elapsedTime2 > 0)
-                      ? deltaIter / elapsedTime2
+    double currentIPS = (v.elapsedTime2 > 0)
+                      ? deltaIter / v.elapsedTime2
                       : 0.0;
 
-    static double smoothedIPS = 0.0;
     constexpr double alpha    = 0.05;
-//    constexpr double alpha = 1;
-    if (smoothedIPS == 0.0) {
-        smoothedIPS = currentIPS;
+    if (smoothedIPS_ == 0.0) {
+        smoothedIPS_ = currentIPS;
     } else {
-        smoothedIPS = alpha * currentIPS
-                    + (1.0 - alpha) * smoothedIPS;
+        smoothedIPS_ = alpha * currentIPS
+                     + (1.0 - alpha) * smoothedIPS_;
     }
 
-    double remaining = smoothedIPS > 0
-                     ? (totalIters - iter) / smoothedIPS
+    double remaining = smoothedIPS_ > 0
+                     ? (totalIters - iter) / smoothedIPS_
                      : 0.0;
 
+    std::ostringstream out;
+    if (mode_ == Mode::Json) {
+        out << "{\"event\": \"progress\", \"exponent\": " << v.expo
+            << ", \"iter\": " << iter << ", \"total\": " << totalIters
+            << std::fixed << std::setprecision(2)
+            << ", \"percent\": " << pct << ", \"elapsed\": " << v.elapsedTime
+            << ", \"ips\": " << currentIPS << ", \"eta\": " << std::setprecision(0) << remaining;
+        if (v.res64[0]) out << ", \"res64\": \"" << v.res64 << "\"";
+        out << "}\n";
+        emit(out);
+        return;
+    }
+
     const char* color = (pct < 50.0) ? COLOR_RED
                         : (pct < 90.0) ? COLOR_YELLOW
                                        : COLOR_GREEN;
 
-    uint64_t sec  = static_cast<uint64_t>(remaining);
-    uint64_t days = sec / 86400; sec %= 86400;
-    uint64_t hrs  = sec / 3600;  sec %= 3600;
-    uint64_t min  = sec / 60;    sec %= 60;
+    uint64_t days, hrs, min, sec;
+    etaParts(remaining, days, hrs, min, sec);
 
-    std::cout
+    out
     << "\r" << color
     << "Progress: "  << std::fixed << std::setprecision(2) << pct << "% | "
-    << "Exp: "       << expo                                << " | "
+    << "Exp: "       << v.expo                              << " | "
     << "Iter: "      << iter                                << " | "
-    << "Elapsed: "   << std::fixed << elapsedTime           << "s | "
+    << "Elapsed: "   << std::fixed << v.elapsedTime         << "s | "
     << "IPS: "       << std::fixed << std::setprecision(2)
                     << currentIPS                          << " | "
     << "ETA: "       << days << "d " << hrs << "h "
                     << min  << "m " << sec << "s";
-    
-    if (!res64.empty()) {
-    std::cout << " | RES64: " << res64;
-    }
 
-    std::cout << COLOR_RESET << std::endl;
+    if (v.res64[0]) {
+    out << " | RES64: " << v.res64;
+    }
 
+    out << COLOR_RESET << "\n";
+    emit(out);
 }
 
-
-void Spinner::displayBackupInfo(uint64_t iter,
-                                uint64_t totalIters,
-                                double elapsedTime,
-                                std::string res64)
-{
+void Spinner::printBackup(const Values& v) {
+    const uint64_t iter = v.iter, totalIters = v.totalIters;
+    const double elapsedTime = v.elapsedTime;
     double pct       = totalIters ? (100.0 * iter) / totalIters : 100.0;
     double ips       = elapsedTime > 0 ? iter / elapsedTime : 0.0;
     double remaining = ips > 0 ? (totalIters - iter) / ips : 0.0;
-    uint64_t sec  = static_cast<uint64_t>(remaining);
-    uint64_t days = sec / 86400; sec %= 86400;
-    uint64_t hrs  = sec / 3600;  sec %= 3600;
-    uint64_t min  = sec / 60;    sec %= 60;
 
-    std::cout
+    std::ostringstream out;
+    if (mode_ == Mode::Json) {
+        out << "{\"event\": \"backup\", \"iter\": " << iter << ", \"total\": " << totalIters
+            << std::fixed << std::setprecision(2)
+            << ", \"percent\": " << pct << ", \"elapsed\": " << elapsedTime
+            << ", \"ips\": " << ips << ", \"eta\": " << std::setprecision(0) << remaining;
+        if (v.res64[0]) out << ", \"res64\": \"" << v.res64 << "\"";
+        out << "}\n";
+        emit(out);
+        return;
+    }
+
+    uint64_t days, hrs, min, sec;
+    etaParts(remaining, days, hrs, min, sec);
+
+    out
       << "\r" << COLOR_MAGENTA
-      << "[Backup] " 
+      << "[Backup] "
       << std::fixed << std::setprecision(2) << pct << "% | "
       << "Elapsed: " << elapsedTime << "s | "
       << "IPS: "     << std::fixed << ips << " | "
       << "ETA: "       << days << "d " << hrs << "h "
                        << min  << "m " << sec << "s";
-    if (!res64.empty()) {
-        std::cout << " | RES64: " << res64;
+    if (v.res64[0]) {
+        out << " | RES64: " << v.res64;
     }
-    std::cout << COLOR_RESET << std::endl;
+    out << COLOR_RESET << "\n";
+    emit(out);
 }
 
 void Spinner::displaySpinner(std::atomic<bool>& waiting,
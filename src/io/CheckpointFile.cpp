@@ -0,0 +1,122 @@
+#include "io/CheckpointFile.hpp"
+#include "util/Crc32.hpp"
+#include "util/Fs.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace io {
+
+namespace {
+
+constexpr char     kMagic[8] = {'P','R','M','C','K','P','T','\0'};
+constexpr uint32_t kVersion  = 1;
+constexpr size_t   kModeLen  = 8;
+
+// Fixed-size header image: exponent, transformSize, engine, mode[8],
+// iteration, j, itersave.
+constexpr size_t kHeaderBytes = 3 * sizeof(uint32_t) + kModeLen + 3 * sizeof(uint64_t);
+
+void putHeader(const CheckpointHeader& h, unsigned char* out) {
+    std::memset(out, 0, kHeaderBytes);
+    std::memcpy(out + 0, &h.exponent, 4);
+    std::memcpy(out + 4, &h.transformSize, 4);
+    std::memcpy(out + 8, &h.engine, 4);
+    std::memcpy(out + 12, h.mode.data(), std::min(h.mode.size(), kModeLen));
+    std::memcpy(out + 20, &h.iteration, 8);
+    std::memcpy(out + 28, &h.j, 8);
+    std::memcpy(out + 36, &h.itersave, 8);
+}
+
+void getHeader(const unsigned char* in, CheckpointHeader& h) {
+    std::memcpy(&h.exponent, in + 0, 4);
+    std::memcpy(&h.transformSize, in + 4, 4);
+    std::memcpy(&h.engine, in + 8, 4);
+    const char* mode = reinterpret_cast<const char*>(in + 12);
+    h.mode.assign(mode, strnlen(mode, kModeLen));
+    std::memcpy(&h.iteration, in + 20, 8);
+    std::memcpy(&h.j, in + 28, 8);
+    std::memcpy(&h.itersave, in + 36, 8);
+}
+
+} // namespace
+
+bool writeCheckpoint(const std::string& path,
+                     const CheckpointHeader& header,
+                     const std::vector<CheckpointSection>& sections)
+{
+    unsigned char head[kHeaderBytes];
+    putHeader(header, head);
+    const uint32_t headCrc = computeCRC32(head, kHeaderBytes);
+    const uint32_t count = static_cast<uint32_t>(sections.size());
+
+    // One {tag, size, crc} record per section, kept alive for the write.
+    struct Record { uint32_t tag; uint64_t size; uint32_t crc; };
+    std::vector<Record> records;
+    records.reserve(sections.size());
+    for (const auto& s : sections)
+        records.push_back({s.tag, s.size, computeCRC32(s.data, static_cast<size_t>(s.size))});
+
+    std::vector<std::pair<const void*, std::size_t>> parts = {
+        {kMagic, sizeof(kMagic)}, {&kVersion, sizeof(kVersion)},
+        {head, kHeaderBytes}, {&headCrc, sizeof(headCrc)}, {&count, sizeof(count)}
+    };
+    for (size_t i = 0; i < sections.size(); ++i) {
+        parts.push_back({&records[i].tag, sizeof(uint32_t)});
+        parts.push_back({&records[i].size, sizeof(uint64_t)});
+        parts.push_back({&records[i].crc, sizeof(uint32_t)});
+        parts.push_back({sections[i].data, static_cast<std::size_t>(sections[i].size)});
+    }
+    return writeFileDurable(path, parts);
+}
+
+bool readCheckpoint(const std::string& path,
+                    CheckpointHeader& header,
+                    std::map<uint32_t, std::vector<uint8_t>>& sections)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    char magic[8];
+    uint32_t version = 0, headCrc = 0, count = 0;
+    unsigned char head[kHeaderBytes];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(head), kHeaderBytes);
+    in.read(reinterpret_cast<char*>(&headCrc), sizeof(headCrc));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version != kVersion) {
+        std::cerr << "Warning: " << path << " is not a checkpoint of this version" << std::endl;
+        return false;
+    }
+    if (computeCRC32(head, kHeaderBytes) != headCrc) {
+        std::cerr << "Warning: corrupt checkpoint header in " << path << std::endl;
+        return false;
+    }
+    getHeader(head, header);
+
+    std::map<uint32_t, std::vector<uint8_t>> out;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t tag = 0, crc = 0;
+        uint64_t size = 0;
+        in.read(reinterpret_cast<char*>(&tag), sizeof(tag));
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        in.read(reinterpret_cast<char*>(&crc), sizeof(crc));
+        if (!in || size > (uint64_t(1) << 36)) {
+            std::cerr << "Warning: truncated checkpoint " << path << std::endl;
+            return false;
+        }
+        std::vector<uint8_t> data(static_cast<size_t>(size));
+        in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size));
+        if (!in || computeCRC32(data.data(), data.size()) != crc) {
+            std::cerr << "Warning: corrupt section in checkpoint " << path << std::endl;
+            return false;
+        }
+        out[tag] = std::move(data);
+    }
+    sections = std::move(out);
+    return true;
+}
+
+} // namespace io
@@ -25,6 +25,7 @@
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include "util/PathUtils.hpp"
 #include <filesystem>
 #include "opencl/Context.hpp"
@@ -46,15 +47,24 @@ void printUsage(const char* progName) {
     std::cout << std::endl;
     std::cout << "  <p>       : Exponent to test (required unless -worktodo is used)" << std::endl;
     std::cout << "  -d <device_id>       : (Optional) Specify OpenCL device ID (default: 0)" << std::endl;
+    std::cout << "  -devices all|<i,j>   : (Optional) one worker per GPU sharing the worktodo file; each claims entries into <worktodo>.d<i> and logs to <-f path>/device<i>.log" << std::endl;
+    std::cout << "  -batch <K>           : (Optional) test K worktodo entries at once on the -d device, each with its own queues and Gerbicz-Li check (small exponents)" << std::endl;
+    std::cout << "  -tf <bits>           : (Optional) trial factor on the GPU up to 2^bits before a PRP/LL test and skip the test when a factor is found" << std::endl;
+    std::cout << "  -tfonly              : (Optional) only trial factor (mode of worktodo Factor= lines), up to -tf <bits>" << std::endl;
+    std::cout << "  --daemon             : (Optional) stay up with a warm OpenCL context and take assignments, status queries and stop requests as JSON lines on a Unix socket" << std::endl;
+    std::cout << "  -socket <path>       : (Optional) control socket of --daemon (default: <-f path>/prmers.sock)" << std::endl;
     std::cout << "  -c <depth>           : (Optional) Set local carry propagation depth (default: 8)" << std::endl;
-    //std::cout << "  -profile             : (Optional) Enable kernel execution profiling" << std::endl;
+    std::cout << "  -profile [<iter>]    : (Optional) Time every kernel (profiling queue) and print p50/p99 and GB/s per NTT stage and carry kernel every <iter> iterations (default: 100000) and at exit" << std::endl;
+    std::cout << "  -trace <file>        : (Optional) record host work (checkpoints, proof, Gerbicz-Li, JSON, submission) and GPU kernels as a Chrome trace (chrome://tracing, Perfetto); marin kernels need -profile" << std::endl;
+    std::cout << "  -metrics <file> [s]  : (Optional) rewrite <file> every s seconds (default 10) with Prometheus metrics: iteration, iterations/s, ETA, Gerbicz-Li checks and failures, checkpoint time and size, queue depth" << std::endl;
     std::cout << "  -prp                 : (Optional) Run in PRP mode (default). Uses initial value 3; final result must equal 9" << std::endl;
     std::cout << "  -ll                  : (Optional) Run in Lucas-Lehmer mode. Uses initial value 4 and p-2 iterations" << std::endl;
     std::cout << "  -factors <factor1,factor2,...> : (Optional) Specify known factors to run PRP test on the Mersenne cofactor" << std::endl;
     std::cout << "  -pm1                 : (Optional) Run factoring P-1" << std::endl;
     std::cout << "  -b1                  : (Optional) B1 for factoring P-1" << std::endl;
     std::cout << "  -b2                  : (Optional) B2 for factoring P-1" << std::endl;
-    std::cout << "  -t <seconds>         : (Optional) Specify backup interval in seconds (default: 120)" << std::endl;
+    std::cout << "  -t <seconds>         : (Optional) Specify backup interval in seconds (default: chosen from the measured checkpoint cost and the crash rate of the node)" << std::endl;
+    std::cout << "  -tmax <seconds>      : (Optional) upper bound of the chosen backup interval (default: 3000)" << std::endl;
     std::cout << "  -f <path>            : (Optional) Specify path for saving/loading checkpoint files (default: current directory)" << std::endl;
     std::cout << "  -l1 <value>          : (Optional) Force local size max for NTT kernels" << std::endl;
     std::cout << "  -l5 <value>          : (Optional) Force local size max for NTT kernels radix 5" << std::endl;
@@ -62,6 +72,8 @@ void printUsage(const char* progName) {
     //std::cout << "  -l2 <value>          : (Optional) Force local size for 2-step radix-16 NTT kernel" << std::endl;
     //std::cout << "  -l3 <value>          : (Optional) Force local size for mixed radix NTT kernel" << std::endl;
     std::cout << "  -submit              : (Optional) activate the possibility to send results to PrimeNet (prompt or autosend)" << std::endl;
+    std::cout << "  -skipdone            : (Optional) an exponent whose result is already in the save directory is reported again instead of being run" << std::endl;
+    std::cout << "  -crosscheck          : (Optional) run it anyway and compare the new residue with the saved one" << std::endl;
     std::cout << "  --noask              : (Optional) Automatically send results to PrimeNet without prompting" << std::endl;
     std::cout << "  -user <username>     : (Optional) PrimeNet username to auto-fill during result submission" << std::endl;
     std::cout << "  -password <password> : (Optional) PrimeNet password to autosubmit the result without prompt (used only when -no-ask is set)" << std::endl;
@@ -69,16 +81,47 @@ void printUsage(const char* progName) {
     std::cout << "  -worktodo <path>     : (Optional) Load exponent from specified worktodo.txt (default: ./worktodo.txt)" << std::endl;
     std::cout << "  -config <path>       : (Optional) Load config file from specified path" << std::endl;
     std::cout << "  -proof <level>       : (Optional) Set proof power between 1 and 12 or 0 to disable proof generation (default: optimal proof power selected automatically)" << std::endl;
+    std::cout << "  -proofcompress <c>   : (Optional) compress the proof residue files: none or lz (default: none)" << std::endl;
     std::cout << "  -erroriter <iter>    : (Optional) injects an error at iteration <iter> to test Gerbicz-Li error detection mechanism." << std::endl;
-    std::cout << "  -iterforce <iter>    : (Optional) forces a GPU queue synchronization (clFinish) every <iter> iterations to improve stability or allow interruption checks." << std::endl;
-    std::cout << "  -iterforce2 <iter>   : (Optional) forces a GPU queue synchronization in P-1 stage 2 (clFinish) every <iter> iterations to improve stability or allow interruption checks." << std::endl;
+    std::cout << "  -iterforce <iter>    : (Optional) caps the number of iterations queued on the GPU ahead of the host (the depth adapts to ~50 ms of work below it)." << std::endl;
+    std::cout << "  -iterforce2 <iter>   : (Optional) same cap for the giant steps of P-1 stage 2." << std::endl;
     std::cout << "  -gerbiczli           : (Optional) deactivate gerbicz li error check" << std::endl;
-    std::cout << "  -checklevel <value>  : (Optional) Will force gerbicz check every B*<value> by default check is done every 10 min and at the end." << std::endl;
+    std::cout << "  -hostrollback        : (Optional) marin: keep the last verified gerbicz li state in host memory, two registers less on the GPU" << std::endl;
+    std::cout << "  -jacobi <iters>      : (Optional) LL: check the Jacobi symbol of the residue every <iters> iterations on a host thread and roll back on failure (0 = off, default = 1000000)" << std::endl;
+    std::cout << "  -checklevel <value>  : (Optional) Will force gerbicz check every B*<value>, by default the interval follows the failure rate of the device, and at the end." << std::endl;
     std::cout << "  -wagstaff            : (Optional) will check PRP if (2^p + 1)/3 is probably prime" << std::endl;
     std::cout << "  -marin               : (Optional) deactivate use of marin backend" << std::endl;
+    std::cout << "  -cpu                 : (Optional) run the marin path on the host two-prime engine (Solinas x GF(M61^2) CRT, digits up to 62 bits), no OpenCL device needed" << std::endl;
+    std::cout << "  -cputhreads <n>      : (Optional) threads of the -cpu engine (default: one per hardware thread)" << std::endl;
+    std::cout << "  -progress <mode>     : (Optional) progress lines: console, quiet or json (one JSON object per line, for headless workers) (default: console)" << std::endl;
     std::cout << "  -res64_display_interval <N> : (Optional) (only in -marin mode) Display Res64 every N iterations (0 = disabled or > 0, default = 100000)" << std::endl;
     std::cout << "  -bench               : (Optional) run benchmark on all NTT transform sizes" << std::endl;
+    std::cout << "  -bench-json <file>   : (Optional) also write the -bench results (device, transform size, us/iter, GB/s, J/iter) as JSON" << std::endl;
+    std::cout << "  -bench-csv <file>    : (Optional) same as CSV, one row per exponent" << std::endl;
+    std::cout << "  -bench-baseline <file> : (Optional) compare -bench with a previous JSON/CSV result and exit with 1 on a regression" << std::endl;
+    std::cout << "  -bench-threshold <%> : (Optional) slowdown in us/iter tolerated by -bench-baseline (default: 5)" << std::endl;
+    std::cout << "  -roofline <file>     : (Optional) with -bench, measure the copy bandwidth and modmul rate of the device and write bytes/iter, GB/s and modmul/s of each size against them as CSV" << std::endl;
+    std::cout << "  -burnin <seconds>    : (Optional) qualify the device: Gerbicz-Li checked PRP iterations at the given exponent (default 136279841), reporting errors per hour, us/iter and the rate drift" << std::endl;
+    std::cout << "  -burninblock <iters> : (Optional) iterations between two checks of -burnin (default: 64)" << std::endl;
+    std::cout << "  -gpushare <weight>   : (Optional) take turns on the GPU with the other -gpushare jobs of the device, slices of 25 ms per unit of weight (default: off)" << std::endl;
+    std::cout << "  -gpusharefile <path> : (Optional) the turn table of -gpushare (default: prmers_gpu<device>.share in the temporary directory)" << std::endl;
     std::cout << "  -chunk256 <1..4>     : (Optional) cap for CHUNK256; lower can help on Radeon VII/GCN (default: auto)" << std::endl;
+    std::cout << "  -kernelcache <dir>   : (Optional) directory of the compiled OpenCL program and weight/twiddle cache (default: <save path>/kernel_cache)" << std::endl;
+    std::cout << "  -nokernelcache       : (Optional) always rebuild OpenCL programs and tables from source" << std::endl;
+    std::cout << "  -nocmdbuf            : (Optional) (only in -marin mode) do not replay iterations through cl_khr_command_buffer" << std::endl;
+    std::cout << "  -tuneplan            : (Optional) benchmark NTT local sizes (-marin mode) or the marin kernel geometry for this exponent and store the fastest plan" << std::endl;
+    std::cout << "  -tuneenergy          : (Optional) make -tune and -tuneplan choose the most iterations per joule of board power (NVML, ROCm SMI or hwmon) instead of per second" << std::endl;
+    std::cout << "  -plandb <file>       : (Optional) NTT plan database (default: <save path>/ntt_plans.json)" << std::endl;
+    std::cout << "  -noplan              : (Optional) ignore the stored NTT plan and use the built-in sizing" << std::endl;
+    std::cout << "  -autoengine          : (Optional) run a PRP/LL test on the marin or the legacy backend, whichever the rates of the plan database (-bench, -tuneplan) predict faster for its transform size" << std::endl;
+    std::cout << "  -twiddleotf          : (Optional) derive the radix-4 stage twiddles from two short table rows instead of streaming the table (default: from the plan)" << std::endl;
+    std::cout << "  -lazyreduce          : (Optional) keep butterfly results in [0, 2^64) and reduce them at the digit weights only (default: from the plan)" << std::endl;
+    std::cout << "  -fourstep            : (Optional) (only in -marin mode) run the middle NTT stages as a few local-memory tile passes, for very large transforms (default: from the plan)" << std::endl;
+    std::cout << "  -coalesced           : (Optional) (only in -marin mode) run the radix-4 stages of stride 2 to 8 on contiguous local-memory tiles, so that neighbouring work-items read neighbouring words (default: from the plan)" << std::endl;
+    std::cout << "  -genkernels [tile]   : (Optional) (only in -marin mode) run the unweighted NTT stages as passes generated for the transform size, the square or product fused with the last forward and first inverse stages, on tiles of up to <tile> residues (default 4096; default: from the plan)" << std::endl;
+    std::cout << "  -stage2mem <MiB>     : (Optional) device memory budget of P-1 stage 2: the prime-pairing table of the legacy backend, the table of powers of H on marin (default: 80% of the device on legacy, 32 powers on marin)" << std::endl;
+    std::cout << "  -s2devices <i,j,...> : (Optional) split P-1 stage 2 of the Marin backend in one prime range per device, merged before the gcd" << std::endl;
+    std::cout << "  -vram <MiB>          : (Optional) (only in -marin mode) device memory budget of this process; a plan that does not fit is refused at startup (default: the whole device)" << std::endl;
     //std::cout << "  -throttle_low        : (Optional) Enable CL_QUEUE_THROTTLE_LOW_KHR if OpenCL >= 2.2 (default: disabled)" << std::endl;
     //std::cout << "  -tune               : (Optional) Automatically determine the best pacing (iterForce) and how often to call clFinish() to synchronize kernels (default: disabled)" << std::endl;
     std::cout << std::endl;
@@ -123,11 +166,20 @@ CliOptions CliParser::parse(int argc, char** argv ) {
         }
         else if (std::strcmp(argv[i], "-pm1") == 0) {
             opts.mode = "pm1";
-            opts.marin = false;
             opts.proof = false;
         }
         else if (std::strcmp(argv[i], "-profile") == 0) {
             opts.profiling = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                opts.profile_interval = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+            opts.trace_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-metrics") == 0 && i + 1 < argc) {
+            opts.metrics_path = argv[++i];
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                opts.metrics_interval = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
         }
         else if (std::strcmp(argv[i], "-debug") == 0) {
             opts.debug = true;
@@ -135,9 +187,22 @@ CliOptions CliParser::parse(int argc, char** argv ) {
         else if (std::strcmp(argv[i], "-marin") == 0) {
             opts.marin = false;
         }
+        else if (std::strcmp(argv[i], "-cpu") == 0) {
+            opts.cpu_engine = true;
+            opts.marin = true;
+        }
+        else if (std::strcmp(argv[i], "-cputhreads") == 0 && i + 1 < argc) {
+            opts.cpu_threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
         else if (std::strcmp(argv[i], "-submit") == 0) {
             opts.submit = true;
         }
+        else if (std::strcmp(argv[i], "-skipdone") == 0) {
+            opts.skipDone = true;
+        }
+        else if (std::strcmp(argv[i], "-crosscheck") == 0) {
+            opts.crossCheck = true;
+        }
         else if (std::strcmp(argv[i], "-bench") == 0) {
             opts.bench = true;
             opts.exponent = 127;
@@ -145,6 +210,12 @@ CliOptions CliParser::parse(int argc, char** argv ) {
         else if (std::strcmp(argv[i], "-throttle_low") == 0) {
             opts.cl_queue_throttle_active = true;
         }
+        else if (std::strcmp(argv[i], "-gpushare") == 0 && i + 1 < argc) {
+            opts.gpu_share = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "-gpusharefile") == 0 && i + 1 < argc) {
+            opts.gpu_share_path = argv[++i];
+        }
         else if (std::strcmp(argv[i], "-proof") == 0 && i + 1 < argc) {
             int level = std::atoi(argv[++i]);
             if (level == 0) {
@@ -157,11 +228,22 @@ CliOptions CliParser::parse(int argc, char** argv ) {
                 std::exit(EXIT_FAILURE);
             }
         }
+        else if (std::strcmp(argv[i], "-proofcompress") == 0 && i + 1 < argc) {
+            opts.proofCodec = argv[++i];
+            if (opts.proofCodec != "none" && opts.proofCodec != "lz") {
+                std::cerr << "Error: -proofcompress must be none or lz. Given: " << opts.proofCodec << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
         else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
             opts.localCarryPropagationDepth = std::atoi(argv[++i]);
         }
         else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
             opts.backup_interval = std::atoi(argv[++i]);
+            opts.backup_interval_fixed = true;
+        }
+        else if (std::strcmp(argv[i], "-tmax") == 0 && i + 1 < argc) {
+            opts.backup_interval_max = std::atoi(argv[++i]);
         }
         else if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
             opts.save_path = argv[++i];
@@ -205,6 +287,13 @@ CliOptions CliParser::parse(int argc, char** argv ) {
         else if (std::strcmp(argv[i], "-enqueue_max") == 0 && i + 1 < argc) {
             opts.enqueue_max = std::atoi(argv[++i]);
         }
+        else if (std::strcmp(argv[i], "-progress") == 0 && i + 1 < argc) {
+            opts.progress = argv[++i];
+            if (opts.progress != "console" && opts.progress != "quiet" && opts.progress != "json") {
+                std::cerr << "Error: -progress must be console, quiet or json. Given: " << opts.progress << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
         else if (std::strcmp(argv[i], "-res64_display_interval") == 0 && i + 1 < argc) {
             int v = std::atoi(argv[++i]);
             if (v < 0) {
@@ -240,9 +329,106 @@ CliOptions CliParser::parse(int argc, char** argv ) {
         else if (std::strcmp(argv[i], "-kernelpath") == 0 && i + 1 < argc) {
             opts.kernel_path = argv[++i];
         }
+        else if (std::strcmp(argv[i], "-kernelcache") == 0 && i + 1 < argc) {
+            opts.kernel_cache_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-nokernelcache") == 0) {
+            opts.kernel_cache = false;
+        }
+        else if (std::strcmp(argv[i], "-nocmdbuf") == 0) {
+            opts.cmdbuf = false;
+        }
+        else if (std::strcmp(argv[i], "-tuneplan") == 0) {
+            opts.tune_plan = true;
+        }
+        else if (std::strcmp(argv[i], "-tuneenergy") == 0) {
+            opts.tune_energy = true;
+        }
+        else if (std::strcmp(argv[i], "-plandb") == 0 && i + 1 < argc) {
+            opts.plan_db_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-noplan") == 0) {
+            opts.use_plan = false;
+        }
+        else if (std::strcmp(argv[i], "-autoengine") == 0) {
+            opts.auto_engine = true;
+        }
+        else if (std::strcmp(argv[i], "-twiddleotf") == 0) {
+            opts.twiddle_otf = true;
+        }
+        else if (std::strcmp(argv[i], "-lazyreduce") == 0) {
+            opts.lazy_reduce = true;
+        }
+        else if (std::strcmp(argv[i], "-fourstep") == 0) {
+            opts.four_step = true;
+        }
+        else if (std::strcmp(argv[i], "-coalesced") == 0) {
+            opts.coalesced = true;
+        }
+        else if (std::strcmp(argv[i], "-genkernels") == 0) {
+            opts.gen_tile = 4096;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                opts.gen_tile = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "-bench-json") == 0 && i + 1 < argc) {
+            opts.bench_json = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-bench-csv") == 0 && i + 1 < argc) {
+            opts.bench_csv = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "-bench-baseline") == 0 || std::strcmp(argv[i], "--bench-baseline") == 0) && i + 1 < argc) {
+            opts.bench_baseline = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-burnin") == 0 && i + 1 < argc) {
+            opts.burnin_seconds = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "-burninblock") == 0 && i + 1 < argc) {
+            opts.burnin_block = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "-roofline") == 0 && i + 1 < argc) {
+            opts.roofline_csv = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-bench-threshold") == 0 && i + 1 < argc) {
+            opts.bench_threshold = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "-stage2mem") == 0 && i + 1 < argc) {
+            opts.stage2_mem_mb = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "-s2devices") == 0 && i + 1 < argc) {
+            opts.stage2_devices = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-vram") == 0 && i + 1 < argc) {
+            opts.vram_mb = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "-devices") == 0 && i + 1 < argc) {
+            opts.devices = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-batch") == 0 && i + 1 < argc) {
+            opts.batch = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "-tf") == 0 && i + 1 < argc) {
+            opts.tf_bits = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "-tfonly") == 0) {
+            opts.mode = "tf";
+            opts.marin = false;
+            opts.proof = false;
+        }
+        else if (std::strcmp(argv[i], "--daemon") == 0 || std::strcmp(argv[i], "-daemon") == 0) {
+            opts.daemon = true;
+        }
+        else if (std::strcmp(argv[i], "-socket") == 0 && i + 1 < argc) {
+            opts.socket_path = argv[++i];
+        }
         else if (std::strcmp(argv[i], "-gerbiczli") == 0 || std::strcmp(argv[i], "-gerbiczli") == 0) {
             opts.gerbiczli = false;
         }
+        else if (std::strcmp(argv[i], "-hostrollback") == 0) {
+            opts.hostRollback = true;
+        }
+        else if (std::strcmp(argv[i], "-jacobi") == 0 && i + 1 < argc) {
+            opts.jacobi_interval = std::strtoull(argv[++i], nullptr, 10);
+        }
         else if (strcmp(argv[i], "-factors") == 0 && i + 1 < argc) {
             opts.knownFactors = util::split(argv[++i], ',');
         }
@@ -258,6 +444,12 @@ CliOptions CliParser::parse(int argc, char** argv ) {
             std::cerr << "Warning: Unknown option '" << argv[i] << "'\n";
         }
     }
+    // like -bench, -burnin builds its own engine and leaves the job at p = 127
+    if (opts.burnin_seconds) {
+        opts.burnin_exponent = opts.exponent ? opts.exponent : 136279841;
+        opts.exponent = 127;
+        opts.wagstaff = false;
+    }
     if(opts.wagstaff){
         //std::cout << "[WAGSTAFF MODE] This test will check if (2^)" << options.exponent << " + 1)/3 is PRP prime" << std::endl;
         //p  = p*2;
@@ -320,6 +512,15 @@ CliOptions CliParser::parse(int argc, char** argv ) {
         }
     }
 
+    if (!opts.kernel_cache) {
+        opts.kernel_cache_path.clear();
+    } else if (opts.kernel_cache_path.empty()) {
+        opts.kernel_cache_path = (std::filesystem::path(opts.save_path) / "kernel_cache").string();
+    }
+    if (opts.plan_db_path.empty()) {
+        opts.plan_db_path = (std::filesystem::path(opts.save_path) / "ntt_plans.json").string();
+    }
+
     unsigned int detectedPort = 0;
     #if defined(__APPLE__)
         #if defined(__x86_64__)
@@ -1,4 +1,5 @@
 #include "io/CurlClient.hpp"
+#include "util/Trace.hpp"
 #include <curl/curl.h>
 #include <iostream>
 #include <sstream>
@@ -51,24 +52,101 @@ std::string CurlClient::promptHiddenPassword() {
     return pwd;
 }
 
-bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
-                                           const std::string& username,
-                                           const std::string& password)
-{
+namespace {
 
+// Prints the results section of the manual_result reply.
+void printSummary(const std::string& response) {
+    std::cout << "✅ Server response:...\n";
+    std::string startTag = "<h2>Manually check in your results</h2>";
+    std::string endTagA = "<a href=\"/manual_result/\">Submit more results</a>";
+    std::string endTagB = "Aborting processing.</div>";
 
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "❌ Failed to initialize CURL.\n";
-        return false;
+    auto startPos = response.find(startTag);
+    size_t endPos = std::string::npos;
+    std::string chosenEndTag;
+    bool usedFallback = false;
+
+    if (startPos != std::string::npos) {
+        endPos = response.find(endTagA, startPos);
+        chosenEndTag = endTagA;
+
+        if (endPos == std::string::npos) {
+            endPos = response.find(endTagB, startPos);
+            chosenEndTag = endTagB;
+        }
+
+        if (endPos == std::string::npos && response.size() > startPos + 1000) {
+            endPos = startPos + 1000;
+            usedFallback = true;
+        }
+
+        if (endPos != std::string::npos) {
+            std::string htmlChunk = response.substr(startPos, endPos - startPos + (usedFallback ? 0 : chosenEndTag.length()));
+
+            std::string readable;
+            bool insideTag = false;
+            for (char c : htmlChunk) {
+                if (c == '<') {
+                    insideTag = true;
+                    continue;
+                }
+                if (c == '>') {
+                    insideTag = false;
+                    readable += ' ';
+                    continue;
+                }
+                if (!insideTag) readable += c;
+            }
+
+            std::regex spaceRegex("\\s+");
+            readable = std::regex_replace(readable, spaceRegex, " ");
+
+            std::cout << "\n📝 Parsed PrimeNet Result Summary:\n" << readable << "\n";
+        } else {
+            std::cout << "⚠️ Could not find an end marker. Raw response:\n\n" << response << "\n";
+        }
+    } else {
+        std::cout << "⚠️ Could not find start of results section. Raw response:\n\n" << response << "\n";
     }
 
-    FILE* trace = nullptr;
+}
+
+} // namespace
+
+PrimeNetSession::PrimeNetSession()
+  : curl_(curl_easy_init())
+{
+    if (!curl_) {
+        std::cerr << "❌ Failed to initialize CURL.\n";
+        return;
+    }
     #ifdef _WIN32
-        fopen_s(&trace, "curl_trace.txt", "w");
+        fopen_s(&trace_, "curl_trace.txt", "w");
     #else
-        trace = fopen("curl_trace.txt", "w");
+        trace_ = fopen("curl_trace.txt", "w");
     #endif
+    CURL* curl = static_cast<CURL*>(curl_);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    curl_easy_setopt(curl, CURLOPT_STDERR, trace_);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_COOKIEFILE, ""); 
+    curl_easy_setopt(curl, CURLOPT_COOKIEJAR, "cookies.txt");
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0");
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlClient::WriteCallback);
+}
+
+PrimeNetSession::~PrimeNetSession() {
+    if (curl_) curl_easy_cleanup(static_cast<CURL*>(curl_));
+    if (trace_) fclose(trace_);
+}
+
+bool PrimeNetSession::login(const std::string& username, const std::string& password)
+{
+    uid_.clear();
+    if (!curl_) return false;
+    CURL* curl = static_cast<CURL*>(curl_);
+
     // Headers simulant un navigateur réel
     struct curl_slist* headers = nullptr;
     headers = curl_slist_append(headers, "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8");
@@ -77,20 +155,10 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
     headers = curl_slist_append(headers, "Referer: https://www.mersenne.org/login.php");
     headers = curl_slist_append(headers, "Upgrade-Insecure-Requests: 1");
     headers = curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
-
-
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_STDERR, trace);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_COOKIEFILE, ""); 
-    curl_easy_setopt(curl, CURLOPT_COOKIEJAR, "cookies.txt");
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0");
 
     std::string loginResponse;
     curl_easy_setopt(curl, CURLOPT_URL, "https://www.mersenne.org/login.php");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &loginResponse);
     curl_easy_setopt(curl, CURLOPT_POST, 1L);
 
@@ -104,6 +172,8 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
     // Exécution de la requête de login
     std::cerr << "[TRACE] Sending login with user: " << username << std::endl;
     CURLcode loginRes = curl_easy_perform(curl);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
+    curl_slist_free_all(headers);
 
     // Sauvegarde de la réponse HTML pour vérification
     std::ofstream htmlOut("login_response_debug.html");
@@ -112,9 +182,6 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
 
     if (loginRes != CURLE_OK) {
         std::cerr << "❌ Login failed: " << curl_easy_strerror(loginRes) << "\n";
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        fclose(trace);
         return false;
     }
 
@@ -132,42 +199,25 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
 
     if (!hasSession) {
         std::cerr << "❌ Login failed: no session cookie received.\n";
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        fclose(trace);
+        std::cerr << "💡 Login HTML saved to login_response_debug.html\n";
         return false;
     }
 
     std::cerr << "✅ Login successful, session cookie received.\n";
 
-    if (loginRes != CURLE_OK) {
-        std::cerr << "❌ Login failed or session not recognized.\n";
-        //std::cerr << loginData.str().c_str() << "\n";
-        std::ofstream htmlOut("login_response_debug.html");
-        htmlOut << loginResponse;
-        htmlOut.close();
-        std::cerr << "💡 Login HTML saved to login_response_debug.html\n";
-        curl_easy_cleanup(curl);
-        fclose(trace);
-        return false;
-    }
-
     std::string htmlFormPage;
     curl_easy_setopt(curl, CURLOPT_URL, "https://www.mersenne.org/manual_result/");
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, nullptr);     // clear POST data
     curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);              // force GET
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &htmlFormPage);
 
     CURLcode pageRes = curl_easy_perform(curl);
     if (pageRes != CURLE_OK) {
         std::cerr << "❌ Failed to get manual_result page: " << curl_easy_strerror(pageRes) << "\n";
-        curl_easy_cleanup(curl);
-        fclose(trace);
         return false;
     }
 
-    std::string uid = extractUID(htmlFormPage);
+    std::string uid = CurlClient::extractUID(htmlFormPage);
     std::cerr << "[TRACE] Extracted was_logged_in_as UID: " << uid << "\n";
     if (uid.empty()) {
         std::ofstream htmlOut("login_response_manual_debug.html");
@@ -176,10 +226,17 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
         std::cerr << "💡 Login HTML saved to login_response_manual_debug.html\n";
         
         std::cerr << "❌ Could not find was_logged_in_as value in form page.\n";
-        curl_easy_cleanup(curl);
-        fclose(trace);
         return false;
     }
+    uid_ = uid;
+    return true;
+}
+
+bool PrimeNetSession::submit(const std::string& jsonResult)
+{
+    util::TraceSpan span("primenet_submit");
+    if (!curl_ || uid_.empty()) return false;
+    CURL* curl = static_cast<CURL*>(curl_);
 
     curl_mime* form = curl_mime_init(curl);
 
@@ -189,7 +246,7 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
 
     field = curl_mime_addpart(form);
     curl_mime_name(field, "was_logged_in_as");
-    curl_mime_data(field, uid.c_str(), CURL_ZERO_TERMINATED);
+    curl_mime_data(field, uid_.c_str(), CURL_ZERO_TERMINATED);
 
     field = curl_mime_addpart(form);
     curl_mime_name(field, "data");
@@ -197,79 +254,34 @@ bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
 
     std::string response;
     curl_easy_setopt(curl, CURLOPT_URL, "https://www.mersenne.org/manual_result/");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
     curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
 
-    std::cerr << "[TRACE] Sending manual result with was_logged_in_as = " << uid << std::endl;
+    std::cerr << "[TRACE] Sending manual result with was_logged_in_as = " << uid_ << std::endl;
 
     CURLcode res = curl_easy_perform(curl);
-    fflush(trace);
-    fclose(trace);
+    if (trace_) fflush(trace_);
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, nullptr);
     curl_mime_free(form);
-    curl_easy_cleanup(curl);
 
     if (res != CURLE_OK) {
         std::cerr << "❌ Failed to send result: " << curl_easy_strerror(res) << "\n";
+        // the next attempt logs in again
+        uid_.clear();
         return false;
     }
 
     std::cerr << "[TRACE] Server response size: " << response.size() << " bytes\n";
-    std::cout << "✅ Server response:...\n";
-    std::string startTag = "<h2>Manually check in your results</h2>";
-    std::string endTagA = "<a href=\"/manual_result/\">Submit more results</a>";
-    std::string endTagB = "Aborting processing.</div>";
-
-    auto startPos = response.find(startTag);
-    size_t endPos = std::string::npos;
-    std::string chosenEndTag;
-    bool usedFallback = false;
-
-    if (startPos != std::string::npos) {
-        endPos = response.find(endTagA, startPos);
-        chosenEndTag = endTagA;
-
-        if (endPos == std::string::npos) {
-            endPos = response.find(endTagB, startPos);
-            chosenEndTag = endTagB;
-        }
-
-        if (endPos == std::string::npos && response.size() > startPos + 1000) {
-            endPos = startPos + 1000;
-            usedFallback = true;
-        }
-
-        if (endPos != std::string::npos) {
-            std::string htmlChunk = response.substr(startPos, endPos - startPos + (usedFallback ? 0 : chosenEndTag.length()));
-
-            std::string readable;
-            bool insideTag = false;
-            for (char c : htmlChunk) {
-                if (c == '<') {
-                    insideTag = true;
-                    continue;
-                }
-                if (c == '>') {
-                    insideTag = false;
-                    readable += ' ';
-                    continue;
-                }
-                if (!insideTag) readable += c;
-            }
-
-            std::regex spaceRegex("\\s+");
-            readable = std::regex_replace(readable, spaceRegex, " ");
-
-            std::cout << "\n📝 Parsed PrimeNet Result Summary:\n" << readable << "\n";
-        } else {
-            std::cout << "⚠️ Could not find an end marker. Raw response:\n\n" << response << "\n";
-        }
-    } else {
-        std::cout << "⚠️ Could not find start of results section. Raw response:\n\n" << response << "\n";
-    }
-
+    printSummary(response);
     return true;
 }
 
+bool CurlClient::sendManualResultWithLogin(const std::string& jsonResult,
+                                           const std::string& username,
+                                           const std::string& password)
+{
+    PrimeNetSession session;
+    return session.login(username, password) && session.submit(jsonResult);
+}
+
 } // namespace io
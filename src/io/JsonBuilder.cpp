@@ -20,9 +20,11 @@
  * This code is released as free software. 
  */
 #include "io/JsonBuilder.hpp"
+#include "util/Trace.hpp"
 #include "io/CliParser.hpp"          // for CliOptions
 #include "math/Cofactor.hpp"
 #include "util/GmpUtils.hpp"
+#include "util/Residue.hpp"
 #include "core/Version.hpp"
 #ifndef CL_TARGET_OPENCL_VERSION
 #define CL_TARGET_OPENCL_VERSION 300
@@ -50,124 +52,55 @@
 
 
 namespace io{
-    //-----------------------------------------------------------------------------
-    // mod3, doDiv3 et doDiv9 : pour PRP-3 on divise deux fois par 3
-    //-----------------------------------------------------------------------------
-    static uint32_t mod3(const std::vector<uint32_t>& W) {
-        uint32_t r = 0;
-        for (uint32_t w : W) r = (r + (w % 3)) % 3;
-        return r;
-    }
-
-    static void doDiv3(uint32_t E, std::vector<uint32_t>& W) {
-        uint32_t r = (3 - mod3(W)) % 3;
-        int topBits = E % 32;
-        // mot de poids fort
-        {
-            uint64_t t = (uint64_t(r) << topBits) + W.back();
-            W.back() = uint32_t(t / 3);
-            r        = uint32_t(t % 3);
-        }
-        // descente sur les mots inférieurs
-        for (auto it = W.rbegin() + 1; it != W.rend(); ++it) {
-            uint64_t t = (uint64_t(r) << 32) + *it;
-            *it       = uint32_t(t / 3);
-            r         = uint32_t(t % 3);
-        }
-    }
-
-    static void doDiv9(uint32_t E, std::vector<uint32_t>& W) {
-        doDiv3(E, W);
-        doDiv3(E, W);
-    }
-
-std::tuple<bool, std::string, std::string> JsonBuilder::computeResult(
-    const std::vector<uint64_t>& hostResult,
-    const CliOptions& opts,
-    const std::vector<int>& digit_width) {
-    
-    mpz_class Mp = (mpz_class(1) << opts.exponent) - 1;
-    mpz_class finalResidue = util::vectToMpz(hostResult, digit_width, Mp);
-    
+// The final residue from 32-bit words: res64 and res2048 are read off the
+// words, and only a cofactor test needs the residue as an mpz.
+static std::tuple<bool, std::string, std::string> resultFromWords(std::vector<uint32_t>& words,
+                                                                 const CliOptions& opts,
+                                                                 const std::vector<uint32_t>& kfPower) {
+    const uint32_t E = static_cast<uint32_t>(opts.exponent);
     bool isPrime;
     if (opts.mode == "prp") {
-        mpz_class inv9; // The inverse of 9 in the ring modulo Mp
-        mpz_invert(inv9.get_mpz_t(), mpz_class(9).get_mpz_t(), Mp.get_mpz_t());
-        finalResidue = (finalResidue * inv9) % Mp;
-
-        if (!opts.knownFactors.empty()) {
-            // Mersenne cofactor PRP
-            isPrime = math::Cofactor::isCofactorPRP(opts.exponent, opts.knownFactors, finalResidue);
-        } else {
-            // Mersenne number PRP
-            isPrime = (finalResidue == 1);
-        }
+        util::div9(E, words);
+        isPrime = opts.knownFactors.empty()
+            ? util::isResidue(words, 1)
+            : kfPower.empty()
+                ? math::Cofactor::isCofactorPRP(opts.exponent, opts.knownFactors, util::convertToGMP(words))
+                : math::Cofactor::isCofactorPRP(opts.exponent, opts.knownFactors, util::convertToGMP(words),
+                                                util::convertToGMP(kfPower));
     } else {
-        // Mersenne number LL
-        isPrime = (finalResidue == 0);
+        isPrime = util::isResidue(words, 0);
     }
-    
-    mpz_class mod2_64 = mpz_class(1) << 64;
-    mpz_class mod2_2048 = mpz_class(1) << 2048;
-    
-    mpz_class res64_val = finalResidue % mod2_64;
-    mpz_class res2048_val = finalResidue % mod2_2048;
-    
-    std::ostringstream oss64;
-    oss64 << std::hex << std::uppercase << std::setw(16) << std::setfill('0') << res64_val;
-    std::string res64 = oss64.str();
-    
-    std::ostringstream oss2048;
-    oss2048 << std::hex << std::nouppercase << std::setw(512) << std::setfill('0') << res2048_val;
-    std::string res2048 = oss2048.str();
+    return std::make_tuple(isPrime, util::res64Hex(words), util::res2048Hex(words));
+}
 
-    return std::make_tuple(isPrime, res64, res2048);
+std::tuple<bool, std::string, std::string> JsonBuilder::computeResult(
+    const std::vector<uint64_t>& hostResult,
+    const CliOptions& opts,
+    const std::vector<int>& digit_width,
+    const std::vector<uint32_t>& kfPower) {
+    util::TraceSpan span("json_compute_result");
+    auto words = util::packResidue(hostResult, digit_width, static_cast<uint32_t>(opts.exponent));
+    return resultFromWords(words, opts, kfPower);
 }
 
 std::tuple<bool, std::string, std::string> JsonBuilder::computeResultMarin(
     const std::vector<uint64_t>& hostResult,
-    const CliOptions& opts)
+    const CliOptions& opts,
+    const std::vector<uint32_t>& kfPower)
 {
+    util::TraceSpan span("json_compute_result");
+    // marin digits hold the value in the low word and the width in the high one
     std::vector<uint64_t> digits(hostResult.size());
     std::vector<int> digit_width(hostResult.size());
     for (size_t i = 0; i < hostResult.size(); ++i) {
-        uint64_t x = hostResult[i];
-        uint32_t v = static_cast<uint32_t>(x);
-        uint32_t w = static_cast<uint8_t>(x >> 32);
+        const uint64_t x = hostResult[i];
+        const uint32_t v = static_cast<uint32_t>(x);
+        const uint32_t w = static_cast<uint8_t>(x >> 32);
         digit_width[i] = static_cast<int>(w);
-        if (w == 0) digits[i] = 0;
-        else if (w >= 32) digits[i] = static_cast<uint64_t>(v);
-        else digits[i] = static_cast<uint64_t>(v & ((1u << w) - 1));
+        digits[i] = (w >= 32) ? v : (v & ((1u << w) - 1));
     }
-
-    mpz_class Mp = (mpz_class(1) << opts.exponent) - 1;
-    mpz_class finalResidue = util::vectToMpz(digits, digit_width, Mp);
-
-    bool isPrime;
-    if (opts.mode == "prp") {
-        mpz_class inv9;
-        mpz_invert(inv9.get_mpz_t(), mpz_class(9).get_mpz_t(), Mp.get_mpz_t());
-        finalResidue = (finalResidue * inv9) % Mp;
-        if (!opts.knownFactors.empty()) {
-            isPrime = math::Cofactor::isCofactorPRP(opts.exponent, opts.knownFactors, finalResidue);
-        } else {
-            isPrime = (finalResidue == 1);
-        }
-    } else {
-        isPrime = (finalResidue == 0);
-    }
-
-    mpz_class res64_val = finalResidue & ((mpz_class(1) << 64) - 1);
-    mpz_class res2048_val = finalResidue & ((mpz_class(1) << 2048) - 1);
-
-    std::string s64 = res64_val.get_str(16);
-    if (s64.size() < 16) s64.insert(s64.begin(), 16 - s64.size(), '0');
-    for (auto& c : s64) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
-
-    std::string s2048 = res2048_val.get_str(16);
-    if (s2048.size() < 512) s2048.insert(s2048.begin(), 512 - s2048.size(), '0');
-
-    return std::make_tuple(isPrime, s64, s2048);
+    auto words = util::packResidue(digits, digit_width, static_cast<uint32_t>(opts.exponent));
+    return resultFromWords(words, opts, kfPower);
 }
 
 
@@ -401,12 +334,92 @@ static std::string generatePrimeNetJson(
     return oss.str();
 }
 
+std::string JsonBuilder::generateTrialFactor(const CliOptions& opts,
+                                             unsigned bitLo,
+                                             unsigned bitHi,
+                                             const std::string& factor)
+{
+    util::TraceSpan span("json_generate");
+    std::time_t now = std::time(nullptr);
+    std::tm timeinfo{};
+    #ifdef _WIN32
+        gmtime_s(&timeinfo, &now);
+    #else
+        std::tm* tmp = std::gmtime(&now);
+        if (tmp != nullptr) timeinfo = *tmp;
+    #endif
+    char timestampBuf[32];
+    std::strftime(timestampBuf, sizeof(timestampBuf), "%Y-%m-%d %H:%M:%S", &timeinfo);
+
+    std::ostringstream oss;
+    oss << "{"
+        << "\"status\":\"" << (factor.empty() ? "NF" : "F") << "\","
+        << "\"exponent\":" << opts.exponent << ","
+        << "\"worktype\":\"TF\",";
+    if (!factor.empty()) oss << "\"factors\":[" << jsonEscape(factor) << "],";
+    oss << "\"bitlo\":" << bitLo << ","
+        << "\"bithi\":" << bitHi << ","
+        << "\"rangecomplete\":" << (factor.empty() ? "true" : "false") << ","
+        << "\"program\":{"
+        << "\"name\":\"prmers\","
+        << "\"version\":" << jsonEscape(core::PRMERS_VERSION) << ","
+        << "\"port\":" << opts.portCode
+        << "},"
+        << "\"os\":{"
+        << "\"os\":" << jsonEscape(opts.osName)
+        << ",\"architecture\":" << jsonEscape(opts.osArch)
+        << "},"
+        << "\"timestamp\":" << jsonEscape(timestampBuf) << ","
+        << "\"user\":" << jsonEscape(opts.user.empty() ? "cherubrock" : opts.user);
+    if (!opts.computer_name.empty())
+        oss << ",\"computer\":" << jsonEscape(opts.computer_name);
+    if (!opts.aid.empty())
+        oss << ",\"aid\":" << jsonEscape(opts.aid);
+    oss << "}";
+    return oss.str();
+}
+
+std::string JsonBuilder::quote(const std::string& s) {
+    return jsonEscape(s);
+}
+
+std::optional<std::string> JsonBuilder::stringField(const std::string& json,
+                                                    const std::string& key)
+{
+    const std::string name = "\"" + key + "\"";
+    for (size_t pos = json.find(name); pos != std::string::npos; pos = json.find(name, pos + 1)) {
+        size_t i = json.find_first_not_of(" \t\r\n", pos + name.size());
+        if (i == std::string::npos || json[i] != ':') continue;
+        i = json.find_first_not_of(" \t\r\n", i + 1);
+        if (i == std::string::npos || json[i] != '"') return std::nullopt;
+        std::string value;
+        for (++i; i < json.size() && json[i] != '"'; ++i) {
+            char c = json[i];
+            if (c == '\\' && i + 1 < json.size()) {
+                switch (json[++i]) {
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    default:  c = json[i]; break;
+                }
+            }
+            value += c;
+        }
+        if (i == json.size()) return std::nullopt;
+        return value;
+    }
+    return std::nullopt;
+}
+
 std::string JsonBuilder::generate(const CliOptions& opts,
                                   int transform_size,
                                   bool isPrime,
                                   const std::string& res64,
                                   const std::string& res2048) 
 {
+    util::TraceSpan span("json_generate");
     // timestamp UTC
     std::time_t now = std::time(nullptr);
     std::tm timeinfo;
@@ -498,7 +511,7 @@ std::string JsonBuilder::computeRes64(
     int /*transform_size*/)
 {
     auto words = JsonBuilder::compactBits(x, digit_width, opts.exponent);
-    if (opts.mode == "prp") doDiv9(opts.exponent, words);
+    if (opts.mode == "prp") util::div9(opts.exponent, words);
     uint64_t finalRes64 = (uint64_t(words[1]) << 32) | words[0];
     std::ostringstream oss;
     oss << std::hex << std::uppercase << std::setw(16) << std::setfill('0')
@@ -514,7 +527,7 @@ std::string JsonBuilder::computeRes64Iter(
     int /*transform_size*/)
 {
     auto words = JsonBuilder::compactBits(x, digit_width, opts.exponent);
-    //if (opts.mode == "prp") doDiv9(opts.exponent, words);
+    //if (opts.mode == "prp") util::div9(opts.exponent, words);
     uint64_t finalRes64 = (uint64_t(words[1]) << 32) | words[0];
     std::ostringstream oss;
     oss << std::hex << std::uppercase << std::setw(16) << std::setfill('0')
@@ -531,7 +544,7 @@ std::string JsonBuilder::computeRes2048(
     int /*transform_size*/)
 {
     auto words = JsonBuilder::compactBits(x, digit_width, opts.exponent);
-    if (opts.mode == "prp") doDiv9(opts.exponent, words);
+    if (opts.mode == "prp") util::div9(opts.exponent, words);
     std::ostringstream oss;
     for (int i = 63; i >= 0; --i) {
         oss << std::hex << std::nouppercase << std::setw(8) << std::setfill('0')
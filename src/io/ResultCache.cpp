@@ -0,0 +1,136 @@
+// src/io/ResultCache.cpp
+#include "io/ResultCache.hpp"
+#include "io/CliParser.hpp"
+#include "io/JsonBuilder.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace io {
+
+namespace {
+
+// The unsigned value of `key` in a flat JSON object, 0 when it has none.
+uint64_t number(const std::string& json, const std::string& key) {
+    const std::string name = "\"" + key + "\"";
+    const size_t pos = json.find(name);
+    if (pos == std::string::npos) return 0;
+    size_t i = json.find_first_not_of(" \t\r\n", pos + name.size());
+    if (i == std::string::npos || json[i] != ':') return 0;
+    i = json.find_first_not_of(" \t\r\n", i + 1);
+    uint64_t v = 0;
+    for (; i < json.size() && json[i] >= '0' && json[i] <= '9'; ++i) v = v * 10 + uint64_t(json[i] - '0');
+    return v;
+}
+
+// The strings of the array `key`, empty when there is none.
+std::vector<std::string> strings(const std::string& json, const std::string& key) {
+    std::vector<std::string> out;
+    const std::string name = "\"" + key + "\"";
+    const size_t pos = json.find(name);
+    if (pos == std::string::npos) return out;
+    size_t i = json.find_first_not_of(" \t\r\n", pos + name.size());
+    if (i == std::string::npos || json[i] != ':') return out;
+    i = json.find_first_not_of(" \t\r\n", i + 1);
+    if (i == std::string::npos || json[i] != '[') return out;
+    const size_t end = json.find(']', i);
+    if (end == std::string::npos) return out;
+    for (i = json.find('"', i); i < end; i = json.find('"', i)) {
+        const size_t close = json.find('"', i + 1);
+        if (close == std::string::npos || close > end) break;
+        out.push_back(json.substr(i + 1, close - i - 1));
+        i = close + 1;
+    }
+    return out;
+}
+
+std::string modeOf(const std::string& worktype) {
+    if (worktype.rfind("PRP", 0) == 0) return "prp";
+    if (worktype.rfind("LL", 0) == 0)  return "ll";
+    if (worktype == "P-1")             return "pm1";
+    return {};
+}
+
+} // namespace
+
+ResultCache::ResultCache(const std::string& savePath) {
+    namespace fs = std::filesystem;
+    const fs::path dir(savePath);
+    std::ifstream in(dir / "results.txt");
+    for (std::string line; std::getline(in, line); )
+        add(line, (dir / "results.txt").string());
+
+    // a result whose append to results.txt failed still has its own file
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        const std::string suffix = "_result.json";
+        if (name.size() <= suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        std::ifstream f(it->path());
+        std::stringstream ss;
+        ss << f.rdbuf();
+        const std::string json = ss.str();
+        const std::string k = keyOf(json);
+        if (!k.empty() && entries_.count(k) == 0) add(json, it->path().string());
+    }
+}
+
+std::string ResultCache::key(uint64_t exponent, const std::string& mode,
+                             uint64_t B1, uint64_t B2,
+                             std::vector<std::string> knownFactors)
+{
+    if (exponent == 0 || (mode != "prp" && mode != "ll" && mode != "pm1")) return {};
+    std::ostringstream k;
+    k << exponent << ";" << mode;
+    if (mode == "pm1") {
+        // the factors of a P-1 result are what it found, not what it was given
+        k << ";" << B1 << ";" << B2;
+    } else {
+        std::sort(knownFactors.begin(), knownFactors.end());
+        k << ";";
+        for (const auto& f : knownFactors) k << f << ",";
+    }
+    return k.str();
+}
+
+std::string ResultCache::keyOf(const std::string& json) {
+    const auto worktype = JsonBuilder::stringField(json, "worktype");
+    if (!worktype) return {};
+    return key(number(json, "exponent"), modeOf(*worktype),
+               number(json, "b1"), number(json, "b2"), strings(json, "known-factors"));
+}
+
+CachedResult ResultCache::parse(const std::string& json, const std::string& source) {
+    CachedResult r;
+    r.json   = json;
+    r.source = source;
+    r.status = JsonBuilder::stringField(json, "status").value_or("");
+    r.res64  = JsonBuilder::stringField(json, "res64").value_or("");
+    return r;
+}
+
+void ResultCache::add(const std::string& json, const std::string& source) {
+    const std::string k = keyOf(json);
+    if (k.empty()) return;
+    entries_[k] = parse(json, source);
+}
+
+std::optional<CachedResult> ResultCache::find(const CliOptions& opts) const {
+    // a Wagstaff result has the worktype of a Mersenne one
+    if (opts.wagstaff) return std::nullopt;
+    const std::string k = key(opts.exponent, opts.mode, opts.B1, opts.B2, opts.knownFactors);
+    if (k.empty()) return std::nullopt;
+    if (auto it = entries_.find(k); it != entries_.end()) return it->second;
+    return std::nullopt;
+}
+
+std::optional<CachedResult> ResultCache::find(const std::string& json) const {
+    const std::string k = keyOf(json);
+    if (k.empty()) return std::nullopt;
+    if (auto it = entries_.find(k); it != entries_.end()) return it->second;
+    return std::nullopt;
+}
+
+} // namespace io
@@ -0,0 +1,145 @@
+// src/io/ResultOutbox.cpp
+#include "io/ResultOutbox.hpp"
+#include "io/CurlClient.hpp"
+#include "util/Fs.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace io {
+
+namespace {
+
+constexpr std::chrono::seconds kMinBackoff{30};
+constexpr std::chrono::seconds kMaxBackoff{3600};
+constexpr std::chrono::seconds kDrainSeconds{60};
+
+} // namespace
+
+ResultOutbox::ResultOutbox(std::string dir, std::string user, std::string password)
+  : dir_(std::move(dir)), user_(std::move(user)), password_(std::move(password))
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    // the first pass sends what an earlier run left behind
+    thread_ = std::thread(&ResultOutbox::loop, this);
+}
+
+ResultOutbox::~ResultOutbox() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!failing_ && !pendingFiles().empty()) {
+            std::cout << "Waiting for the PrimeNet submissions in " << dir_ << std::endl;
+            kick_ = true;
+            wake_.notify_all();
+            idle_.wait_for(lock, kDrainSeconds, [&] { return failing_ || (!busy_ && !kick_); });
+        }
+        stop_ = true;
+        wake_.notify_all();
+    }
+    thread_.join();
+    const std::size_t left = pendingFiles().size();
+    if (left != 0) {
+        std::cerr << left << " result(s) not yet accepted by PrimeNet stay in " << dir_
+                  << " and are sent by the next run that submits\n";
+    }
+}
+
+bool ResultOutbox::enqueue(const std::string& name, const std::string& jsonResult) {
+    std::ostringstream path;
+    path << dir_ << "/" << name << "_" << std::time(nullptr) << ".json";
+    if (!writeFileDurable(path.str(), {{jsonResult.data(), jsonResult.size()}})) {
+        std::cerr << "Cannot write " << path.str() << "\n";
+        return false;
+    }
+    std::cout << "Result queued for PrimeNet in " << path.str() << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    kick_ = true;
+    wake_.notify_all();
+    return true;
+}
+
+std::vector<std::string> ResultOutbox::pendingFiles() const {
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto& e : std::filesystem::directory_iterator(dir_, ec)) {
+        if (e.is_regular_file(ec) && e.path().extension() == ".json") files.push_back(e.path().string());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool ResultOutbox::drain() {
+    if (pendingFiles().empty()) return true;
+#ifndef _WIN32
+    const std::string lockPath = dir_ + "/.lock";
+    const int fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ::flock(fd, LOCK_EX) != 0) {
+        if (fd >= 0) ::close(fd);
+        std::cerr << "Cannot lock " << lockPath << "\n";
+        return false;
+    }
+    struct Unlock { int fd; ~Unlock() { ::flock(fd, LOCK_UN); ::close(fd); } } unlock{fd};
+#endif
+    // another process may have sent them while we waited for the lock
+    const std::vector<std::string> files = pendingFiles();
+    if (files.empty()) return true;
+
+    if (!session_) session_ = std::make_unique<PrimeNetSession>();
+    if (!session_->login(user_, password_)) return false;
+    for (const std::string& file : files) {
+        if (stop_) return true;
+        std::ifstream in(file);
+        std::stringstream json;
+        json << in.rdbuf();
+        if (!session_->submit(json.str())) return false;
+        try {
+            markJsonAsSent(file);
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Warning: " << file << " was sent but cannot be marked: " << e.what() << "\n";
+        }
+    }
+    return true;
+}
+
+void ResultOutbox::loop() {
+    std::chrono::seconds backoff{0};
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (!kick_ && backoff.count() == 0) {
+            busy_ = false;
+            idle_.notify_all();
+            wake_.wait(lock, [&] { return stop_ || kick_; });
+            if (stop_) break;
+        }
+        busy_ = true;
+        kick_ = false;
+        lock.unlock();
+        const bool done = drain();
+        lock.lock();
+        if (done) {
+            backoff = std::chrono::seconds{0};
+            failing_ = false;
+            continue;
+        }
+        // a new result does not cut the backoff short
+        backoff = backoff.count() == 0 ? kMinBackoff : std::min(backoff * 2, kMaxBackoff);
+        failing_ = true;
+        idle_.notify_all();
+        std::cerr << "PrimeNet submission failed, retrying in " << backoff.count() << " s\n";
+        wake_.wait_for(lock, backoff, [&] { return stop_.load(); });
+    }
+    busy_ = false;
+    idle_.notify_all();
+}
+
+} // namespace io
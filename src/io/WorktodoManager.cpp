@@ -22,6 +22,7 @@
 // src/io/WorktodoManager.cpp
 #include "io/WorktodoManager.hpp"
 #include "io/CliParser.hpp"
+#include "io/ResultCache.hpp"
 #include <fstream>
 #include <iostream>
 #include <iomanip>
@@ -36,6 +37,7 @@ void WorktodoManager::saveIndividualJson(uint32_t p,
                                          const std::string& mode,
                                          const std::string& jsonResult) const
 {
+    if (options_.crossCheck) crossCheck(jsonResult);
     // ex: ./save/100003_prp_result.json
     std::string file = options_.save_path + "/"
                      + std::to_string(p) + "_" + mode + "_result.json";
@@ -48,6 +50,24 @@ void WorktodoManager::saveIndividualJson(uint32_t p,
     std::cout << "JSON result written to: " << file << "\n";
 }
 
+// Before the new result is written: the saved one is still on disk.
+void WorktodoManager::crossCheck(const std::string& jsonResult) const
+{
+    const auto cached = ResultCache(options_.save_path).find(jsonResult);
+    if (!cached) return;
+    const CachedResult fresh = ResultCache::parse(jsonResult);
+    const bool pm1 = fresh.res64.empty();
+    const std::string& was = pm1 ? cached->status : cached->res64;
+    const std::string& now = pm1 ? fresh.status : fresh.res64;
+    if (was == now) {
+        std::cout << "Cross-check: " << (pm1 ? "status " : "res64 ") << now
+                  << " matches the result in " << cached->source << "\n";
+    } else {
+        std::cerr << "Warning: cross-check failed, " << (pm1 ? "status " : "res64 ") << now
+                  << " but " << was << " in " << cached->source << "\n";
+    }
+}
+
 void WorktodoManager::appendToResultsTxt(const std::string& jsonResult) const
 {
     // ex: ./save/results.txt
@@ -23,16 +23,27 @@
 #include "io/WorktodoParser.hpp"
 #include "math/Cofactor.hpp"
 #include "util/StringUtils.hpp"
+#include "util/Fs.hpp"
+#include "util/FileLock.hpp"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
 #include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace io {
 
 WorktodoParser::WorktodoParser(const std::string& filename)
-  : filename_(filename)
+  : filename_(filename), journal_(filename + ".journal")
 {}
 
 static bool isHex(const std::string& s) {
@@ -84,12 +95,12 @@ static std::vector<std::string> parseFactors(const std::string& factorStr) {
     return factors;
 }
 
-std::optional<WorktodoEntry> WorktodoParser::parse() {
-    std::ifstream file(filename_);
-    if (!file.is_open()) {
-        std::cerr << "Cannot open " << filename_ << "\n";
-        return std::nullopt;
-    }
+std::optional<WorktodoEntry> WorktodoParser::parseLine(const std::string& line) {
+    std::istringstream in(line);
+    return parseStream(in, 0);
+}
+
+std::optional<WorktodoEntry> WorktodoParser::parseStream(std::istream& file, std::size_t skip) {
     auto trim_inplace = [](std::string& s){
         size_t a = s.find_first_not_of(" \t\r\n");
         size_t b = s.find_last_not_of(" \t\r\n");
@@ -107,7 +118,8 @@ std::optional<WorktodoEntry> WorktodoParser::parse() {
         bool isLL   = (top[0] == "Test" || top[0] == "DoubleCheck");
         bool isPF   = (top[0] == "PFactor");
         bool isPM1  = (top[0] == "Pminus1");
-        if (!(isPRP || isLL || isPF || isPM1)) continue;
+        bool isTF   = (top[0] == "Factor");
+        if (!(isPRP || isLL || isPF || isPM1 || isTF)) continue;
 
         auto parts = splitRespectingQuotes(top[1], ',');
         if (!parts.empty() && (parts[0].empty() || parts[0] == "N/A"))
@@ -122,6 +134,29 @@ std::optional<WorktodoEntry> WorktodoParser::parse() {
 
         try {
 
+            if (isTF) {
+                // Factor=[AID,]p,how_far_factored,bit_to_factor_to
+                if (parts.size() < 3) continue;
+                uint32_t exp = static_cast<uint32_t>(std::stoul(parts[0]));
+                if (exp == 0) continue;
+
+                WorktodoEntry entry;
+                entry.tfTest   = true;
+                entry.exponent = exp;
+                entry.rawLine  = line;
+                entry.aid      = aid;
+                entry.tfFrom   = static_cast<uint32_t>(std::stoul(parts[1]));
+                entry.tfTo     = static_cast<uint32_t>(std::stoul(parts[2]));
+                if (entry.tfTo <= entry.tfFrom) continue;
+
+                std::cout << "Loaded entry: Factor exponent=" << entry.exponent
+                          << " from 2^" << entry.tfFrom << " to 2^" << entry.tfTo
+                          << (aid.empty() ? "" : " (AID=" + aid + ")") << "\n";
+                if (skip == 0) return entry;
+                --skip;
+                continue;
+            }
+
             if (isPF) {
                 if (parts.size() < 6) continue;
                 if (parts[0] != "1" || parts[1] != "2" || parts[3] != "-1") continue;
@@ -166,7 +201,9 @@ std::optional<WorktodoEntry> WorktodoParser::parse() {
                     }
                     std::cout << "\n";
                 }
-                return entry;
+                if (skip == 0) return entry;
+                --skip;
+                continue;
             }
 
             if (isPM1) {
@@ -213,7 +250,9 @@ std::optional<WorktodoEntry> WorktodoParser::parse() {
                     }
                     std::cout << "\n";
                 }
-                return entry;
+                if (skip == 0) return entry;
+                --skip;
+                continue;
             }
 
 
@@ -232,6 +271,10 @@ std::optional<WorktodoEntry> WorktodoParser::parse() {
             entry.exponent  = exp;
             entry.rawLine   = line;
             entry.aid       = aid;
+            // PRP=AID,k,b,n,c,how_far_factored,tests_saved[,"factors"]
+            if (parts.size() >= 6 && !parts[4].empty()
+                && parts[4].find_first_not_of("0123456789") == std::string::npos)
+                entry.tfFrom = static_cast<uint32_t>(std::stoul(parts[4]));
             std::cout << "Loaded entry: "
                       << (entry.prpTest ? "PRP" : "LL")
                       << " exponent=" << entry.exponent
@@ -259,48 +302,285 @@ std::optional<WorktodoEntry> WorktodoParser::parse() {
                 std::cerr << "Warning: Use PRP test for Mersenne cofactors instead." << std::endl;
                 continue;
             }
-            return entry;
+            if (skip == 0) return entry;
+            --skip;
+            continue;
         }
         catch (...) {
             continue;
         }
     }
-
-    std::cerr << "No valid entry found in " << filename_ << "\n";
     return std::nullopt;
 }
 
 
-bool WorktodoParser::removeFirstProcessed() {
-    std::ifstream inFile(filename_);
-    std::ofstream tempFile(filename_ + ".tmp");
-    std::ofstream saveFile("worktodo_save.txt", std::ios::app);
+namespace {
 
-    if (!inFile || !tempFile || !saveFile)
-        return false;
+using util::FileLock;
 
-    std::string line;
-    bool skipped = false;
+constexpr const char* kJournalHeader = "#journal ";
 
-    while (std::getline(inFile, line)) {
-        if (!skipped && !line.empty()) {
-            skipped = true;
-            saveFile << line << "\n";
-            continue;
+std::uintmax_t sizeOf(const std::string& path) {
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+}
+
+// The inode of path, 0 when unknown.
+uint64_t fileId(const std::string& path) {
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) return static_cast<uint64_t>(st.st_ino);
+#else
+    (void)path;
+#endif
+    return 0;
+}
+
+// Bytes [from, to) of path, fewer if it is shorter now.
+std::string readRange(const std::string& path, std::uintmax_t from, std::uintmax_t to) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data(static_cast<std::size_t>(to - from), '\0');
+    in.seekg(static_cast<std::streamoff>(from));
+    in.read(data.data(), static_cast<std::streamsize>(data.size()));
+    data.resize(static_cast<std::size_t>(std::max<std::streamsize>(in.gcount(), 0)));
+    return data;
+}
+
+// Appends data to path and syncs it: a consumed line is on disk before its
+// entry runs elsewhere.
+bool appendDurable(const std::string& path, const std::string& data) {
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+    const bool ok = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size())
+                 && ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    std::ofstream out(path, std::ios::app | std::ios::binary);
+    out << data;
+    out.close();
+    return static_cast<bool>(out);
+#endif
+}
+
+} // namespace
+
+void WorktodoParser::reset() {
+    lines_.clear();
+    pending_.clear();
+    first_ = 0;
+    scanned_ = journalRead_ = consumedBytes_ = 0;
+    tornFile_ = tornJournal_ = false;
+}
+
+void WorktodoParser::refresh() {
+    const std::uintmax_t journalSize = sizeOf(journal_);
+    uint64_t generation = 0;
+    if (journalSize > 0) {
+        std::ifstream in(journal_);
+        std::string header;
+        std::getline(in, header);
+        if (header.rfind(kJournalHeader, 0) == 0)
+            generation = std::strtoull(header.c_str() + std::strlen(kJournalHeader), nullptr, 10);
+    }
+    const std::uintmax_t fileSize = sizeOf(filename_);
+    // a rewrite (compaction, or an edit) renames a new file over the old one
+    const uint64_t id = fileId(filename_);
+    if (generation != generation_ || id != fileId_ || fileSize < scanned_ || journalSize < journalRead_
+        || tornFile_ || tornJournal_) {
+        reset();
+        generation_ = generation;
+        fileId_ = id;
+    }
+
+    // A last line without a newline is completed, under the lock, before
+    // anything is appended after it; without the lock it is indexed as it
+    // is and everything is read again next time.
+    auto lines = [](std::string data, const std::string& path, bool& torn) {
+        if (!data.empty() && data.back() != '\n') {
+            torn = !appendDurable(path, "\n");
+            data += '\n';
+        }
+        return data;
+    };
+    if (fileSize > scanned_) {
+        const std::string data = lines(readRange(filename_, scanned_, fileSize), filename_, tornFile_);
+        scanned_ += data.size();
+        for (std::size_t pos = 0, end; (end = data.find('\n', pos)) != std::string::npos; pos = end + 1) {
+            std::string text = data.substr(pos, end - pos);
+            if (!text.empty()) pending_[text].push_back(lines_.size());
+            lines_.push_back({std::move(text)});
         }
-        tempFile << line << "\n";
     }
+    if (journalSize > journalRead_) {
+        const std::string data = lines(readRange(journal_, journalRead_, journalSize), journal_, tornJournal_);
+        journalRead_ += data.size();
+        for (std::size_t pos = 0, end; (end = data.find('\n', pos)) != std::string::npos; pos = end + 1) {
+            const std::string text = data.substr(pos, end - pos);
+            if (text.rfind(kJournalHeader, 0) != 0) markConsumed(text);
+        }
+    }
+}
+
+// A record consumes the first unconsumed copy of its line, the one every
+// lookup below picks.
+void WorktodoParser::markConsumed(const std::string& text) {
+    auto it = pending_.find(text);
+    if (it == pending_.end() || it->second.empty()) return;
+    lines_[it->second.front()].consumed = true;
+    it->second.pop_front();
+    consumedBytes_ += text.size() + 1;
+    while (first_ < lines_.size() && (lines_[first_].consumed || lines_[first_].text.empty())) ++first_;
+}
+
+bool WorktodoParser::consume(const std::string& text) {
+    // a small file without a journal is rewritten at once, as it always was
+    if (journalRead_ == 0 && scanned_ <= kCompactBytes) {
+        markConsumed(text);
+        return compact();
+    }
+    std::string record;
+    if (journalRead_ == 0) record = kJournalHeader + std::to_string(generation_) + "\n";
+    record += text + "\n";
+    if (!appendDurable(journal_, record)) return false;
+    journalRead_ += record.size();
+    markConsumed(text);
+    if (consumedBytes_ * 2 >= scanned_ || scanned_ <= kCompactBytes) compact();
+    return true;
+}
+
+// The journal is emptied first: a crash before the file is rewritten runs
+// the consumed entries again rather than losing any.
+bool WorktodoParser::compact() {
+    std::string rest;
+    for (const Line& l : lines_) {
+        if (!l.consumed) rest += l.text + "\n";
+    }
+    const bool journaled = journalRead_ > 0;
+    if (journaled) {
+        const std::string header = kJournalHeader + std::to_string(generation_ + 1) + "\n";
+        if (!writeFileDurable(journal_, {{header.data(), header.size()}})) return false;
+    }
+    const bool ok = writeFileDurable(filename_, {{rest.data(), rest.size()}});
+    if (!ok) std::cerr << "Cannot update " << filename_ << (journaled ? ", consumed entries may run again" : "") << "\n";
+    reset();
+    if (journaled) generation_ += 1;
+    refresh();
+    return ok;
+}
+
+std::optional<WorktodoEntry> WorktodoParser::parse(std::size_t skip) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!std::filesystem::exists(filename_)) {
+        std::cerr << "Cannot open " << filename_ << "\n";
+        return std::nullopt;
+    }
+    FileLock lock(filename_);
+    refresh();
+    for (std::size_t i = first_; i < lines_.size(); ++i) {
+        if (lines_[i].consumed || lines_[i].text.empty()) continue;
+        if (auto entry = parseLine(lines_[i].text)) {
+            if (skip == 0) return entry;
+            --skip;
+        }
+    }
+    std::cerr << "No valid entry found in " << filename_ << "\n";
+    return std::nullopt;
+}
 
-    inFile.close();
-    tempFile.close();
-    saveFile.close();
+bool WorktodoParser::removeFirstProcessed() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    FileLock lock(filename_);
+    if (!lock.held()) return false;
+    refresh();
+    for (std::size_t i = first_; i < lines_.size(); ++i) {
+        if (lines_[i].consumed || lines_[i].text.empty()) continue;
+        const std::string text = lines_[i].text;
+        std::ofstream saveFile("worktodo_save.txt", std::ios::app);
+        saveFile << text << "\n";
+        saveFile.close();
+        if (!saveFile) return false;
+        return consume(text);
+    }
+    return false;
+}
+
+std::optional<WorktodoEntry> WorktodoParser::claimFirst(const std::string& target) {
+#ifdef _WIN32
+    (void)target;
+    std::cerr << "Claiming worktodo entries is not supported on Windows\n";
+    return std::nullopt;
+#else
+    std::lock_guard<std::mutex> guard(mutex_);
+    FileLock lock(filename_);
+    if (!lock.held()) return std::nullopt;
+    refresh();
+    for (std::size_t i = first_; i < lines_.size(); ++i) {
+        if (!isEntry(lines_[i])) continue;
+        auto entry = parseLine(lines_[i].text);
+        if (!entry) continue;
+
+        // The entry reaches the worker's file before it leaves the shared one:
+        // a crash in between runs it twice rather than losing it.
+        std::ofstream out(target, std::ios::app);
+        out << entry->rawLine << "\n";
+        out.close();
+        if (!out) {
+            std::cerr << "Cannot write " << target << "\n";
+            return std::nullopt;
+        }
+        if (!consume(lines_[i].text)) {
+            std::cerr << "Cannot update " << journal_ << ", the entry stays claimed by " << target << "\n";
+        }
+        return entry;
+    }
+    std::cerr << "No valid entry found in " << filename_ << "\n";
+    return std::nullopt;
+#endif
+}
 
-    std::remove(filename_.c_str());
-    std::rename((filename_ + ".tmp").c_str(), filename_.c_str());
+bool WorktodoParser::append(const std::string& line) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    FileLock lock(filename_);
+    if (!lock.held()) return false;
+    refresh();  // completes a last line without a newline
+    std::ofstream out(filename_, std::ios::app);
+    out << line << "\n";
+    out.close();
+    return static_cast<bool>(out);
+}
 
-    return skipped;
+std::string WorktodoParser::firstLine() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!std::filesystem::exists(filename_)) return {};
+    FileLock lock(filename_);
+    refresh();
+    for (std::size_t i = first_; i < lines_.size(); ++i) {
+        if (isEntry(lines_[i])) return lines_[i].text;
+    }
+    return {};
 }
 
+std::size_t WorktodoParser::pendingCount() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!std::filesystem::exists(filename_)) return 0;
+    FileLock lock(filename_);
+    refresh();
+    std::size_t n = 0;
+    for (std::size_t i = first_; i < lines_.size(); ++i) n += isEntry(lines_[i]) ? 1 : 0;
+    return n;
+}
 
+bool WorktodoParser::drop(const std::string& line) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    FileLock lock(filename_);
+    if (!lock.held()) return false;
+    refresh();
+    auto it = pending_.find(line);
+    if (it == pending_.end() || it->second.empty()) return false;
+    return consume(line);
+}
 
 } // namespace io
@@ -20,7 +20,17 @@
  * This code is released as free software. 
  */
 #include "core/App.hpp"
+#include "core/Daemon.hpp"
+#include "core/MultiDevice.hpp"
 
 int main(int argc, char** argv) {
-    return core::App(argc, argv).run();
+    if (auto rc = core::Daemon::run(argc, argv)) return *rc;
+    if (auto rc = core::MultiDevice::run(argc, argv)) return *rc;
+    // One App per worktodo entry; the OpenCL context is kept between them.
+    core::Session session;
+    for (;;) {
+        core::App app(argc, argv, session);
+        const int rc = app.run();
+        if (!app.hasNextJob()) return rc;
+    }
 }
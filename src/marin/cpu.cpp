@@ -0,0 +1,9 @@
+// src/marin/cpu.cpp
+#include <cstdint>
+
+#include "marin/engine_cpu.h"
+
+engine * engine::create_cpu(const uint32_t q, const size_t reg_count, const size_t threads, const bool negacyclic)
+{
+	return new engine_cpu(q, reg_count, threads, negacyclic);
+}
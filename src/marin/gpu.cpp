@@ -9,4 +9,24 @@ Please give feedback to the authors if improvement is realized. It is distribute
 
 #include "marin/engine_gpu.h"
 
-engine * engine::create_gpu(const uint32_t p, const size_t reg_count, const size_t device, const bool verbose, const size_t chunk256_max) { return new engine_gpu(p, reg_count, device, verbose, chunk256_max); }
\ No newline at end of file
+engine * engine::create_gpu(const uint32_t p, const size_t reg_count, const size_t device, const bool verbose, const size_t chunk256_max,
+	const std::string & cache_path, const size_t size, const bool negacyclic, const geometry & geom)
+{
+	return new engine_gpu(p, reg_count, device, verbose, chunk256_max, cache_path, size, negacyclic, geom);
+}
+
+bool engine::gpu_device_key(const size_t device, std::string & name, std::string & driver)
+{
+	try
+	{
+		const ocl::platform eng_platform = ocl::platform();
+		if (device >= eng_platform.get_device_count()) return false;
+		const cl_device_id id = eng_platform.get_device(device);
+		char device_name[1024], driver_version[1024];
+		if (clGetDeviceInfo(id, CL_DEVICE_NAME, sizeof(device_name), device_name, nullptr) != CL_SUCCESS) return false;
+		if (clGetDeviceInfo(id, CL_DRIVER_VERSION, sizeof(driver_version), driver_version, nullptr) != CL_SUCCESS) return false;
+		name = device_name; driver = driver_version;
+		return true;
+	}
+	catch (const std::exception &) { return false; }
+}
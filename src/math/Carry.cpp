@@ -22,17 +22,17 @@
 // Carry.cpp
 #include "math/Carry.hpp"
 #include "opencl/Context.hpp"
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
 
 namespace math {
 
-Carry::Carry(const opencl::Context& ctx, cl_command_queue queue, cl_program program, size_t vectorSize, std::vector<int> digitWidth, cl_mem digitWidthMaskBuf)
+Carry::Carry(const opencl::Context& ctx, cl_command_queue queue, cl_program program, size_t vectorSize, std::vector<int> digitWidth)
     : context_(ctx)
     , queue_(queue)
     , digitWidth_(digitWidth)
-    , digitWidthMaskBuf_(digitWidthMaskBuf)
 {
     cl_int err;
     carryKernel_ = clCreateKernel(program, "kernel_carry", &err);
@@ -54,6 +54,62 @@ Carry::Carry(const opencl::Context& ctx, cl_command_queue queue, cl_program prog
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to create kernel_carry_mul_3");
     }
+
+    // One-launch carry: every worker holds LOCAL_PROPAGATION_DEPTH digits and
+    // each holds 64 bits at least, so that a block's carry-out is one of two values.
+    const size_t n = context_.getTransformSize();
+    const size_t workers = context_.getWorkersCarry();
+    const size_t depth = static_cast<size_t>(context_.getLocalCarryPropagationDepth());
+    const int minWidth = digitWidth_.empty() ? 0 : *std::min_element(digitWidth_.begin(), digitWidth_.end());
+    if (workers * depth == n && depth % 4 == 0 && depth >= 4 && depth <= 32 && depth * size_t(minWidth) >= 64) {
+        size_t local = 1;
+        const size_t maxLocal = std::min<size_t>(256, context_.getMaxWorkGroupSize());
+        while (2 * local <= maxLocal && workers % (2 * local) == 0) local *= 2;
+        lookaheadKernel_ = clCreateKernel(program, "kernel_carry_lookahead", &err);
+        if (err == CL_SUCCESS) {
+            const size_t groups = workers / local;
+            const size_t bytes = 3 * groups * sizeof(uint64_t) + (groups + 2) * sizeof(uint32_t);
+            lookaheadState_ = clCreateBuffer(context_.getContext(), CL_MEM_READ_WRITE, bytes, nullptr, &err);
+            if (err == CL_SUCCESS) {
+                const uint32_t zero = 0;
+                err = clEnqueueFillBuffer(queue_, lookaheadState_, &zero, sizeof(zero), 0, bytes, 0, nullptr, nullptr);
+            }
+            if (err == CL_SUCCESS) {
+                lookaheadLocal_ = local;
+            } else {
+                std::cerr << "Warning: cannot set up kernel_carry_lookahead (" << err << "), using the two-pass carry" << std::endl;
+            }
+        } else {
+            lookaheadKernel_ = nullptr;
+        }
+    }
+}
+
+Carry::~Carry()
+{
+    if (lookaheadState_) clReleaseMemObject(lookaheadState_);
+    if (lookaheadKernel_) clReleaseKernel(lookaheadKernel_);
+}
+
+bool Carry::useLookahead(cl_mem buffer)
+{
+    if (lookaheadLocal_ == 0) return false;
+    cl_int err = clSetKernelArg(lookaheadKernel_, 0, sizeof(cl_mem), &buffer);
+    err |= clSetKernelArg(lookaheadKernel_, 1, sizeof(cl_mem), &lookaheadState_);
+    if (err != CL_SUCCESS) throw std::runtime_error("Failed to set kernel_carry_lookahead args");
+    return true;
+}
+
+cl_int Carry::enqueue(cl_kernel kernel, size_t workers, const char* name, const size_t* local)
+{
+    opencl::Profiler* profiler = context_.getProfiler();
+    cl_event evt = nullptr;
+    cl_int err = clEnqueueNDRangeKernel(queue_, kernel, 1, nullptr, &workers, local, 0, nullptr,
+                                        profiler ? &evt : nullptr);
+    // a carry pass reads and writes every digit once
+    if (profiler && err == CL_SUCCESS)
+        profiler->record(name, evt, 2 * size_t(context_.getTransformSize()) * sizeof(uint64_t));
+    return err;
 }
 
 void Carry::carryGPU(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
@@ -61,16 +117,25 @@ void Carry::carryGPU(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
     cl_int err;
     size_t workersCarry = context_.getWorkersCarry();
 
+    if (useLookahead(buffer)) {
+        err = enqueue(lookaheadKernel_, workersCarry, "kernel_carry_lookahead", &lookaheadLocal_);
+        if (err != CL_SUCCESS) {
+            std::ostringstream oss;
+            oss << "Failed to enqueue kernel_carry_lookahead, error code: " << err;
+            throw std::runtime_error(oss.str());
+        }
+        return;
+    }
+
     err  = clSetKernelArg(carryKernel_, 0, sizeof(cl_mem), &buffer);
     err |= clSetKernelArg(carryKernel_, 1, sizeof(cl_mem), &blockCarryBuffer);
-    err |= clSetKernelArg(carryKernel_, 2, sizeof(cl_mem), &digitWidthMaskBuf_);
      
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to set kernel_carry args");
     }
     if (err != CL_SUCCESS) throw std::runtime_error("Failed to enqueue kernel_carry");
     
-    err = clEnqueueNDRangeKernel(queue_, carryKernel_, 1, nullptr, &workersCarry, nullptr, 0, nullptr, nullptr/*&evt1*/);
+    err = enqueue(carryKernel_, workersCarry, "kernel_carry");
     if (err != CL_SUCCESS) {
         std::ostringstream oss;
         oss << "Failed to enqueue kernel_carry, error code: " << err;
@@ -81,12 +146,11 @@ void Carry::carryGPU(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
 
     err  = clSetKernelArg(carryKernel2_, 0, sizeof(cl_mem), &buffer);
     err |= clSetKernelArg(carryKernel2_, 1, sizeof(cl_mem), &blockCarryBuffer);
-    err |= clSetKernelArg(carryKernel2_, 2, sizeof(cl_mem), &digitWidthMaskBuf_);
     
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to set kernel_carry_2 args");
     }
-    err = clEnqueueNDRangeKernel(queue_, carryKernel2_, 1, nullptr, &workersCarry, nullptr, 0, nullptr, nullptr);
+    err = enqueue(carryKernel2_, workersCarry, "kernel_carry_2");
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to enqueue kernel_carry_2");
     }
@@ -120,6 +184,43 @@ void Carry::carryGPU(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
 
 }
 
+void Carry::carryFixupGPU(cl_mem buffer, cl_mem blockCarryBuffer)
+{
+    cl_int err;
+    size_t workersCarry = context_.getWorkersCarry();
+
+    err  = clSetKernelArg(carryKernel2_, 0, sizeof(cl_mem), &buffer);
+    err |= clSetKernelArg(carryKernel2_, 1, sizeof(cl_mem), &blockCarryBuffer);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to set kernel_carry_2 args");
+    }
+    err = enqueue(carryKernel2_, workersCarry, "kernel_carry_2");
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to enqueue kernel_carry_2");
+    }
+}
+
+// Same kernels as carryGPU, recorded instead of enqueued.
+bool Carry::recordCarryGPU(opencl::CommandBuffer& cb, cl_mem buffer, cl_mem blockCarryBuffer, bool fixupOnly)
+{
+    cl_int err;
+    size_t workersCarry = context_.getWorkersCarry();
+
+    if (!fixupOnly && useLookahead(buffer))
+        return cb.ndrange(lookaheadKernel_, workersCarry, &lookaheadLocal_);
+
+    if (!fixupOnly) {
+        err  = clSetKernelArg(carryKernel_, 0, sizeof(cl_mem), &buffer);
+        err |= clSetKernelArg(carryKernel_, 1, sizeof(cl_mem), &blockCarryBuffer);
+            if (err != CL_SUCCESS || !cb.ndrange(carryKernel_, workersCarry, nullptr)) return false;
+    }
+
+    err  = clSetKernelArg(carryKernel2_, 0, sizeof(cl_mem), &buffer);
+    err |= clSetKernelArg(carryKernel2_, 1, sizeof(cl_mem), &blockCarryBuffer);
+    if (err != CL_SUCCESS || !cb.ndrange(carryKernel2_, workersCarry, nullptr)) return false;
+    return true;
+}
+
 void Carry::carryGPU3(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
 {
     cl_int err;
@@ -127,14 +228,13 @@ void Carry::carryGPU3(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
 
     err  = clSetKernelArg(carryKernelMul3_, 0, sizeof(cl_mem), &buffer);
     err |= clSetKernelArg(carryKernelMul3_, 1, sizeof(cl_mem), &blockCarryBuffer);
-    err |= clSetKernelArg(carryKernelMul3_, 2, sizeof(cl_mem), &digitWidthMaskBuf_);
      
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to set kernel_carry args");
     }
     if (err != CL_SUCCESS) throw std::runtime_error("Failed to enqueue kernel_carry");
     
-    err = clEnqueueNDRangeKernel(queue_, carryKernelMul3_, 1, nullptr, &workersCarry, nullptr, 0, nullptr, nullptr/*&evt1*/);
+    err = enqueue(carryKernelMul3_, workersCarry, "kernel_carry_mul_3");
     if (err != CL_SUCCESS) {
         std::ostringstream oss;
         oss << "Failed to enqueue kernel_carry, error code: " << err;
@@ -143,12 +243,11 @@ void Carry::carryGPU3(cl_mem buffer, cl_mem blockCarryBuffer, size_t bufferSize)
 
     err  = clSetKernelArg(carryKernel2_, 0, sizeof(cl_mem), &buffer);
     err |= clSetKernelArg(carryKernel2_, 1, sizeof(cl_mem), &blockCarryBuffer);
-    err |= clSetKernelArg(carryKernel2_, 2, sizeof(cl_mem), &digitWidthMaskBuf_);
     
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to set kernel_carry_2 args");
     }
-    err = clEnqueueNDRangeKernel(queue_, carryKernel2_, 1, nullptr, &workersCarry, nullptr, 0, nullptr, nullptr);
+    err = enqueue(carryKernel2_, workersCarry, "kernel_carry_2");
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to enqueue kernel_carry_2");
     }
@@ -200,7 +299,7 @@ void Carry::carryGPU_mul_base(cl_mem buffer, cl_mem blockCarryBuffer, size_t buf
     }
     //cl_event evt1;
     //size_t globalWorkSize = bufferSize / sizeof(cl_ulong4);
-    err = clEnqueueNDRangeKernel(queue_, carryKernel3_, 1, nullptr, &workersCarry, nullptr, 0, nullptr,nullptr/* &evt1*/);
+    err = enqueue(carryKernel3_, workersCarry, "kernel_carry_mul_base");
     if (err != CL_SUCCESS) {
         std::ostringstream oss;
         oss << "Failed to enqueue kernel_carry, error code: " << err;
@@ -211,7 +310,7 @@ void Carry::carryGPU_mul_base(cl_mem buffer, cl_mem blockCarryBuffer, size_t buf
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to set kernel_carry_2 args");
     }
-    err = clEnqueueNDRangeKernel(queue_, carryKernel2_, 1, nullptr, &workersCarry, nullptr, 0, nullptr, nullptr/*&evt2*/);
+    err = enqueue(carryKernel2_, workersCarry, "kernel_carry_2");
     if (err != CL_SUCCESS) {
         throw std::runtime_error("Failed to enqueue kernel_carry_2");
     }
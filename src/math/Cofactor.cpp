@@ -6,9 +6,8 @@
 namespace math {
 
 // Check that factors actually divide the Mersenne number
+// (2^p = 1 mod factor, without building 2^p - 1)
 bool Cofactor::validateFactors(uint32_t exponent, const std::vector<std::string>& factors) {
-    mpz_class mersenne = (mpz_class{1} << exponent) - 1; // Compute 2^p - 1
-    
     for (const auto& factorStr : factors) {
       if (factorStr.empty()) {
         std::cout << "Factor validation failed: empty factor string" << std::endl;
@@ -21,7 +20,9 @@ bool Cofactor::validateFactors(uint32_t exponent, const std::vector<std::string>
         return false;
       }
       
-      if (mersenne % factor != 0) {
+      mpz_class r;
+      mpz_powm_ui(r.get_mpz_t(), mpz_class{2}.get_mpz_t(), exponent, factor.get_mpz_t());
+      if (r != 1) {
         std::cout << "Factor validation failed: " << factorStr << " does not divide 2^" << exponent << "-1" << std::endl;
         return false;
       }      
@@ -41,11 +42,7 @@ bool Cofactor::isCofactorPRP(uint32_t exponent,
   try {
     mpz_class baseGmp{base};
     
-    mpz_class knownFactorsProduct{1};
-    for (const auto& factorStr : factors) {
-      mpz_class factor{factorStr};
-      knownFactorsProduct *= factor;
-    }
+    const mpz_class knownFactorsProduct = Cofactor::knownFactorsProduct(factors);
     
     mpz_class mersenne = (mpz_class{1} << exponent) - 1;
     mpz_class cofactor = mersenne / knownFactorsProduct;
@@ -64,4 +61,26 @@ bool Cofactor::isCofactorPRP(uint32_t exponent,
   }
 }
 
+bool Cofactor::isCofactorPRP(uint32_t exponent,
+                             const std::vector<std::string>& factors,
+                             const mpz_class& finalResidue,
+                             const mpz_class& kfPower) {
+  try {
+    const mpz_class mersenne = (mpz_class{1} << exponent) - 1;
+    mpz_class d = finalResidue - kfPower;
+    if (d < 0) d += mersenne;
+    const mpz_class t = util::mersenneReduce(d * knownFactorsProduct(factors), exponent);
+    return mpz_divisible_p(t.get_mpz_t(), mersenne.get_mpz_t()) != 0;
+  } catch (const std::exception& e) {
+    std::cout << "Cofactor PRP error:" << e.what() << std::endl;
+    return false;
+  }
+}
+
+mpz_class Cofactor::knownFactorsProduct(const std::vector<std::string>& factors) {
+  mpz_class product{1};
+  for (const auto& factorStr : factors) product *= mpz_class{factorStr};
+  return product;
+}
+
 } // namespace math
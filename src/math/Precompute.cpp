@@ -22,9 +22,15 @@
 // src/math/Precompute.cpp
 #include "math/Precompute.hpp"
 #include "math/Mod64.hpp"
+#include "util/Fs.hpp"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <cstdint>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 
 namespace math {
 
@@ -54,6 +60,40 @@ uint32_t transformsize(uint64_t exponent) {
     return n2;
 }
 
+namespace {
+
+// Runs body(begin, end) over [0, count) on the host threads. The tables
+// below are pure functions of the index, so any split gives the same bytes.
+template <typename Body>
+void parallel_for(size_t count, Body body)
+{
+    const size_t grain = 1u << 14;
+    const size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                            (count + grain - 1) / grain);
+    if (threads <= 1) { body(size_t(0), count); return; }
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    const size_t chunk = (count + threads - 1) / threads;
+    for (size_t t = 1; t < threads; ++t) {
+        const size_t b = std::min(count, t * chunk), e = std::min(count, b + chunk);
+        pool.emplace_back([=] { body(b, e); });
+    }
+    body(size_t(0), std::min(count, chunk));
+    for (auto& th : pool) th.join();
+}
+
+// Transforms below this size are built faster than they are read back.
+constexpr uint32_t kCacheMinN = 1u << 20;
+constexpr uint32_t kCacheMagic = 0x43504d50u;   // "PMPC"
+constexpr uint32_t kCacheVersion = 1;
+
+std::string cache_file(const std::string& dir, uint64_t exponent, uint32_t n)
+{
+    return (std::filesystem::path(dir) / ("precompute_" + std::to_string(exponent) + "_" + std::to_string(n) + ".bin")).string();
+}
+
+} // namespace
+
 static void prepare_radix_twiddles(uint32_t n,
                                    std::vector<uint64_t>& w4,
                                    std::vector<uint64_t>& iw4,
@@ -69,18 +109,22 @@ static void prepare_radix_twiddles(uint32_t n,
     w5.resize(4 * m);
     iw5.resize(4 * m);
     if(n%5==0){
-        for (uint32_t j = 0; j < m; ++j) {
-            uint64_t w1  = powModP(root, j);
-            uint64_t iw1 = powModP(invroot, j);
-            uint64_t w2  = mulModP(w1,  w1);
-            uint64_t iw2 = mulModP(iw1, iw1);
-            uint64_t w3  = mulModP(w2,  w1);
-            uint64_t iw3 = mulModP(iw2, iw1);
-            uint64_t w4v = mulModP(w3,  w1);
-            uint64_t iw4v= mulModP(iw3, iw1);
-            w5 [4*j]     = w1;  w5 [4*j+1] = w2;  w5 [4*j+2] = w3;  w5 [4*j+3] = w4v;
-            iw5[4*j]     = iw1; iw5[4*j+1] = iw2; iw5[4*j+2] = iw3; iw5[4*j+3] = iw4v;
-        }
+        parallel_for(m, [&](size_t b, size_t e) {
+            uint64_t w1  = powModP(root, b);
+            uint64_t iw1 = powModP(invroot, b);
+            for (size_t j = b; j < e; ++j) {
+                uint64_t w2  = mulModP(w1,  w1);
+                uint64_t iw2 = mulModP(iw1, iw1);
+                uint64_t w3  = mulModP(w2,  w1);
+                uint64_t iw3 = mulModP(iw2, iw1);
+                uint64_t w4v = mulModP(w3,  w1);
+                uint64_t iw4v= mulModP(iw3, iw1);
+                w5 [4*j]     = w1;  w5 [4*j+1] = w2;  w5 [4*j+2] = w3;  w5 [4*j+3] = w4v;
+                iw5[4*j]     = iw1; iw5[4*j+1] = iw2; iw5[4*j+2] = iw3; iw5[4*j+3] = iw4v;
+                w1  = mulModP(w1,  root);
+                iw1 = mulModP(iw1, invroot);
+            }
+        });
     }
 
     uint32_t n5 = n;
@@ -95,40 +139,54 @@ static void prepare_radix_twiddles(uint32_t n,
     for (size_t m = n5 / 2, s = 1; m >= 1; m /= 2, s *= 2){
         root = powModP(7ULL, (MOD_P - 1) / (2*m));
         invroot = invModP(root);
-        for (size_t j = 0; j < m; j++)
-		{
-            uint64_t r1  = powModP(root, j);
-            uint64_t ir1 = powModP(invroot, j);
-            uint64_t r2  = mulModP(r1,  r1);
-            uint64_t ir2 = mulModP(ir1, ir1);
-            uint64_t r3  = mulModP(r2,  r1);
-            uint64_t ir3 = mulModP(ir2, ir1);
-            w4 [3 * (m + j) + 0]     = r1;  w4 [3 * (m + j) + 1] = r2;  w4 [3 * (m + j) + 2] = r3;
-            iw4[3 * (m + j) + 0]     = ir1; iw4[3 * (m + j) + 1] = ir2; iw4[3 * (m + j) + 2] = ir3;
-        }
+        parallel_for(m, [&](size_t b, size_t e) {
+            uint64_t r1  = powModP(root, b);
+            uint64_t ir1 = powModP(invroot, b);
+            for (size_t j = b; j < e; j++)
+            {
+                uint64_t r2  = mulModP(r1,  r1);
+                uint64_t ir2 = mulModP(ir1, ir1);
+                uint64_t r3  = mulModP(r2,  r1);
+                uint64_t ir3 = mulModP(ir2, ir1);
+                w4 [3 * (m + j) + 0]     = r1;  w4 [3 * (m + j) + 1] = r2;  w4 [3 * (m + j) + 2] = r3;
+                iw4[3 * (m + j) + 0]     = ir1; iw4[3 * (m + j) + 1] = ir2; iw4[3 * (m + j) + 2] = ir3;
+                r1  = mulModP(r1,  root);
+                ir1 = mulModP(ir1, invroot);
+            }
+        });
 
     }
 }
 
 
-
-void precalc_for_p(uint64_t p,
-                   std::vector<uint64_t>& digitWeight,
-                   std::vector<uint64_t>& digitInvWeight,
-                   std::vector<int>&      digitWidth,
-                   std::vector<uint64_t>& twiddles,
-                   std::vector<uint64_t>& invTwiddles,
-                   uint64_t& digitWidthValue1,
-                   uint64_t& digitWidthValue2,
-                   std::vector<bool>& digitWidthMask
-
-                   )
+static void digit_widths(uint64_t p, uint32_t n,
+                         std::vector<int>&      digitWidth,
+                         uint64_t& digitWidthValue1,
+                         uint64_t& digitWidthValue2)
 {
-    uint32_t n = transformsize(p);
-    std::cout << "Transform Size = " << n << std::endl;
-    
-    if (n < 4) n = 4;
+    uint64_t prev = 0;
+    for (uint64_t j = 1; j <= n; ++j) {
+        uint64_t qj = uint64_t(p) * j;
+        uint64_t ceil_qj_n = (qj == 0) ? 0 : uint64_t((qj - 1) / n + 1);
+        digitWidth[j - 1]  = int(ceil_qj_n - prev);
+        prev               = ceil_qj_n;
+    }
+    uint64_t w1 = static_cast<uint64_t>(digitWidth[0]);
+    uint64_t w2 = 0;
+    for (int w : digitWidth) {
+        if (uint64_t(w) != w1) {
+            w2 = uint64_t(w);
+            break;
+        }
+    }
+    digitWidthValue1 = w1;
+    digitWidthValue2 = w2;
+}
 
+static void digit_weights(uint64_t p, uint32_t n,
+                          std::vector<uint64_t>& digitWeight,
+                          std::vector<uint64_t>& digitInvWeight)
+{
     #ifdef _MSC_VER
         uint64_t high = 0, low = MOD_P - 1ULL;
         uint64_t tmp1 = _udiv128(high, low, 192ULL, &low);
@@ -146,49 +204,73 @@ void precalc_for_p(uint64_t p,
     digitWeight[0]    = 1ULL;
     digitInvWeight[0] = inv_n;
 
-    uint64_t prev = 0;
-    for (uint64_t j = 1; j <= n; ++j) {
-        uint64_t qj = uint64_t(p) * j;
-        //uint64_t qq = qj - 1;
-        uint64_t ceil_qj_n = (qj == 0) ? 0 : uint64_t((qj - 1) / n + 1);
-        digitWidth[j - 1]  = int(ceil_qj_n - prev);
-        prev               = ceil_qj_n;
-
-        if (j < n) {
-            uint64_t r = uint64_t(qj % n);
+    parallel_for(n - 1, [&](size_t b, size_t e) {
+        for (uint64_t j = b + 1; j < e + 1; ++j) {
+            uint64_t r = uint64_t((uint64_t(p) * j) % n);
             uint64_t nr2r = r
                 ? powModP(nr2, (uint64_t)(n - r))
                 : 1ULL;
             digitWeight[j]    = nr2r;
             digitInvWeight[j] = mulModP(invModP(nr2r), inv_n);
         }
-    }
-    uint64_t w1 = static_cast<uint64_t>(digitWidth[0]);
-    uint64_t w2 = 0;
-    for (int w : digitWidth) {
-        if (uint64_t(w) != w1) {
-            w2 = uint64_t(w);
-            break;
-        }
-    }
-    digitWidthValue1 = w1;
-    digitWidthValue2 = w2;
+    });
+}
 
-    digitWidthMask.resize(n);
-    for (size_t i = 0; i < n; ++i) {
-        digitWidthMask[i] = (uint64_t(digitWidth[i]) == w2);
-    }
 
+bool Precompute::loadCache(const std::string& path, uint64_t exponent)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    uint32_t magic = 0, version = 0, n = 0;
+    uint64_t p = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&p), sizeof(p));
+    in.read(reinterpret_cast<char*>(&n), sizeof(n));
+    if (!in || magic != kCacheMagic || version != kCacheVersion || p != exponent || n != n_) return false;
 
-    if(n%5 == 0){
-        n = n/5;
-    }
+    const uint32_t n5 = (n_ % 5 == 0) ? n_ / 5 : n_;
+    const uint32_t m5 = std::max<uint32_t>(n_ / 5, 1);
+    w4_.resize(3 * n5); iw4_.resize(3 * n5);
+    w5_.resize(4 * m5); iw5_.resize(4 * m5);
+    for (std::vector<uint64_t>* v : { &digitWeight_, &digitInvWeight_, &w4_, &iw4_, &w5_, &iw5_ })
+        in.read(reinterpret_cast<char*>(v->data()), std::streamsize(v->size() * sizeof(uint64_t)));
+    if (!in || in.peek() != std::ifstream::traits_type::eof()) return false;
 
+    // A stale or damaged file must not reach the GPU: w * w^-1 = 1/n and the
+    // twiddle rows are powers of their first entry.
+    const uint64_t inv_n = invModP(n_);
+    std::atomic<bool> good{digitWeight_[0] == 1};
+    parallel_for(n_, [&](size_t b, size_t e) {
+        for (size_t j = b; j < e && good.load(std::memory_order_relaxed); ++j)
+            if (mulModP(digitWeight_[j], digitInvWeight_[j]) != inv_n) good = false;
+    });
+    bool ok = good;
+    for (size_t j = 3; j < w4_.size(); j += 3)
+        ok = ok && (mulModP(w4_[j], w4_[j]) == w4_[j + 1]) && (mulModP(w4_[j], iw4_[j]) == 1);
+    if (n_ % 5 == 0)
+        for (size_t j = 0; j < w5_.size(); j += 4)
+            ok = ok && (mulModP(w5_[j], w5_[j]) == w5_[j + 1]) && (mulModP(w5_[j], iw5_[j]) == 1);
+    return ok;
+}
 
+void Precompute::storeCache(const std::string& path, uint64_t exponent) const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    const uint32_t header[2] = { kCacheMagic, kCacheVersion };
+    const uint32_t n = n_;
+    const bool ok = writeFileDurable(path, {
+        { header, sizeof(header) }, { &exponent, sizeof(exponent) }, { &n, sizeof(n) },
+        { digitWeight_.data(), digitWeight_.size() * sizeof(uint64_t) },
+        { digitInvWeight_.data(), digitInvWeight_.size() * sizeof(uint64_t) },
+        { w4_.data(), w4_.size() * sizeof(uint64_t) }, { iw4_.data(), iw4_.size() * sizeof(uint64_t) },
+        { w5_.data(), w5_.size() * sizeof(uint64_t) }, { iw5_.data(), iw5_.size() * sizeof(uint64_t) } });
+    if (!ok) std::cerr << "Warning: cannot write precompute cache " << path << std::endl;
 }
 
 
-Precompute::Precompute(uint64_t exponent)
+Precompute::Precompute(uint64_t exponent, const std::string& cacheDir)
   : n_{ transformsize(exponent) }
 , digitWeight_()
 , digitInvWeight_()
@@ -200,25 +282,26 @@ Precompute::Precompute(uint64_t exponent)
 , w5_()
 , iw5_()
 {
+    std::cout << "Transform Size = " << n_ << std::endl;
     if (n_ < 4) n_ = 4;
     digitWeight_.resize(n_);
     digitInvWeight_.resize(n_);
     digitWidth_   .resize(n_);
-    digitWidthMask_   .resize(n_);
     twiddles_     .resize(3 * n_);
     invTwiddles_  .resize(3 * n_);
-    precalc_for_p(exponent,
-                  digitWeight_,
-                  digitInvWeight_,
-                  digitWidth_,
-                  twiddles_,
-                  invTwiddles_,
-                  digitWidthValue1_,
-                  digitWidthValue2_,
-                  digitWidthMask_
-                  );
+    digit_widths(exponent, n_, digitWidth_, digitWidthValue1_, digitWidthValue2_);
+
+    const bool cached = !cacheDir.empty() && n_ >= kCacheMinN;
+    const std::string path = cached ? cache_file(cacheDir, exponent, n_) : std::string();
+    if (cached && loadCache(path, exponent)) return;
+
+    digit_weights(exponent, n_, digitWeight_, digitInvWeight_);
     prepare_radix_twiddles(n_, w4_, iw4_, w5_, iw5_);
-    
+    if (cached) storeCache(path, exponent);
+}
+
+uint32_t Precompute::transformSize(uint64_t exponent) {
+    return std::max<uint32_t>(transformsize(exponent), 4);
 }
 
 uint32_t Precompute::getN() const { return n_; }
@@ -229,7 +312,6 @@ const std::vector<uint64_t>& Precompute::twiddles() const { return twiddles_; }
 const std::vector<uint64_t>& Precompute::invTwiddles() const { return invTwiddles_; }
 uint64_t Precompute::getDigitWidthValue1() const {return digitWidthValue1_;}
 uint64_t Precompute::getDigitWidthValue2() const {return digitWidthValue2_;}
-const std::vector<bool>& Precompute::getDigitWidthMask() const {return digitWidthMask_;}
 const std::vector<uint64_t>&          Precompute::twiddlesRadix4()      const { return w4_; }
 const std::vector<uint64_t>&          Precompute::invTwiddlesRadix4()   const { return iw4_; }
 const std::vector<uint64_t>&          Precompute::twiddlesRadix5()      const { return w5_; }
@@ -0,0 +1,107 @@
+#include "math/PrimeSieve.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace math {
+
+PrimeSieve::PrimeSieve(uint64_t from, uint64_t to, std::size_t segmentSize)
+    : from_(from), to_(to), segment_(std::max<std::size_t>(segmentSize, 64))
+{
+    worker_ = std::thread([this] { run(); });
+}
+
+PrimeSieve::~PrimeSieve() {
+    stop_.store(true, std::memory_order_release);
+    if (worker_.joinable()) worker_.join();
+}
+
+uint64_t PrimeSieve::next() {
+    while (pos_ >= current_.offsets.size()) {
+        if (!pop(current_)) return 0;
+        pos_ = 0;
+    }
+    return current_.low + current_.offsets[pos_++];
+}
+
+void PrimeSieve::push(Batch&& batch) {
+    const std::size_t h = head_.load(std::memory_order_relaxed);
+    while (h - tail_.load(std::memory_order_acquire) >= kSlots) {
+        if (stop_.load(std::memory_order_acquire)) return;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    ring_[h % kSlots] = std::move(batch);
+    head_.store(h + 1, std::memory_order_release);
+}
+
+bool PrimeSieve::pop(Batch& out) {
+    for (;;) {
+        const std::size_t t = tail_.load(std::memory_order_relaxed);
+        if (t != head_.load(std::memory_order_acquire)) {
+            out = std::move(ring_[t % kSlots]);
+            tail_.store(t + 1, std::memory_order_release);
+            return true;
+        }
+        // done_ is raised after the last push, so look at head_ once more.
+        if (done_.load(std::memory_order_acquire)) {
+            if (t != head_.load(std::memory_order_acquire)) continue;
+            return false;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void PrimeSieve::run() {
+    if (to_ < from_ || to_ < 2) {
+        done_.store(true, std::memory_order_release);
+        return;
+    }
+
+    // Odd base primes up to sqrt(to).
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(to_)));
+    while (root * root > to_) --root;
+    while ((root + 1) * (root + 1) <= to_) ++root;
+    std::vector<uint8_t> small(root + 1, 1);
+    std::vector<uint32_t> base;
+    for (uint64_t i = 3; i <= root; i += 2) {
+        if (!small[i]) continue;
+        base.push_back(static_cast<uint32_t>(i));
+        for (uint64_t m = i * i; m <= root; m += 2 * i) small[m] = 0;
+    }
+
+    uint64_t low = from_;
+    if (low <= 2) {
+        Batch two;
+        two.low = 2;
+        two.offsets.push_back(0);
+        push(std::move(two));
+        low = 3;
+    }
+    if ((low & 1) == 0) ++low;
+
+    // A segment covers the odd numbers low, low + 2, ..., high.
+    std::vector<uint8_t> mark;
+    while (low <= to_ && !stop_.load(std::memory_order_acquire)) {
+        const uint64_t high = std::min<uint64_t>(to_, low + 2 * (segment_ - 1));
+        const std::size_t count = static_cast<std::size_t>((high - low) / 2 + 1);
+        mark.assign(count, 1);
+        for (uint32_t p : base) {
+            const uint64_t pp = static_cast<uint64_t>(p) * p;
+            if (pp > high) break;
+            uint64_t m = std::max(pp, (low + p - 1) / p * p);
+            if ((m & 1) == 0) m += p;
+            for (; m <= high; m += 2 * static_cast<uint64_t>(p)) mark[(m - low) / 2] = 0;
+        }
+
+        Batch batch;
+        batch.low = low;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (mark[i]) batch.offsets.push_back(static_cast<uint32_t>(2 * i));
+        }
+        push(std::move(batch));
+        low = high + 2;
+    }
+    done_.store(true, std::memory_order_release);
+}
+
+} // namespace math
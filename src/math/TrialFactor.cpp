@@ -0,0 +1,224 @@
+// TrialFactor.cpp
+#include "math/TrialFactor.hpp"
+#include "opencl/ProgramCache.hpp"
+#include <gmpxx.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace math {
+
+namespace {
+
+unsigned bitLength(uint64_t x) {
+    unsigned n = 0;
+    while (x) { ++n; x >>= 1; }
+    return n;
+}
+
+uint32_t invMod(uint32_t a, uint32_t m) {
+    int64_t t = 0, newT = 1, r = m, newR = a % m;
+    while (newR != 0) {
+        const int64_t q = r / newR;
+        t -= q * newT; std::swap(t, newT);
+        r -= q * newR; std::swap(r, newR);
+    }
+    return static_cast<uint32_t>(t < 0 ? t + m : t);
+}
+
+mpz_class fromU64(uint64_t x) {
+    mpz_class r;
+    mpz_import(r.get_mpz_t(), 1, -1, sizeof(x), 0, 0, &x);
+    return r;
+}
+
+uint64_t toU64(const mpz_class& x) {
+    uint64_t r = 0;
+    std::size_t count = 0;
+    mpz_export(&r, &count, -1, sizeof(r), 0, 0, x.get_mpz_t());
+    return count == 0 ? 0 : r;
+}
+
+// Shared by every cl call of run(): they either succeed or end the search.
+void check(cl_int err, const char* what) {
+    if (err != CL_SUCCESS) throw std::runtime_error(std::string("trial factoring: ") + what + " failed (" + std::to_string(err) + ")");
+}
+
+} // namespace
+
+TrialFactor::TrialFactor(const opencl::Context& ctx, const std::string& kernelFile,
+                         const std::string& cacheDir)
+  : ctx_(ctx)
+{
+    std::ifstream file(kernelFile);
+    if (!file) throw std::runtime_error("Cannot open kernel source file: " + kernelFile);
+    std::ostringstream oss;
+    oss << file.rdbuf();
+    const std::string source = oss.str();
+    const std::string options = "-DTF_CLASSES=" + std::to_string(kClasses);
+
+    cl_device_id device = ctx.getDevice();
+    opencl::ProgramCache cache(cacheDir);
+    const std::string key = cache.enabled() ? cache.makeKey(device, source, options) : "";
+    program_ = cache.load(ctx.getContext(), device, key, options);
+    if (!program_) {
+        const char* src = source.c_str();
+        const size_t length = source.size();
+        cl_int err = CL_SUCCESS;
+        program_ = clCreateProgramWithSource(ctx.getContext(), 1, &src, &length, &err);
+        check(err, "clCreateProgramWithSource");
+        err = clBuildProgram(program_, 1, &device, options.c_str(), nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            size_t logSize = 0;
+            clGetProgramBuildInfo(program_, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+            std::string log(logSize, '\0');
+            clGetProgramBuildInfo(program_, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], nullptr);
+            std::cerr << "Build log of " << kernelFile << ":\n" << log << std::endl;
+            clReleaseProgram(program_);
+            throw std::runtime_error("Failed to build " + kernelFile);
+        }
+        cache.store(program_, key);
+    }
+    cl_int err = CL_SUCCESS;
+    kernel_ = clCreateKernel(program_, "kernel_tf", &err);
+    if (err != CL_SUCCESS) {
+        clReleaseProgram(program_);
+        throw std::runtime_error("Failed to create kernel_tf");
+    }
+}
+
+TrialFactor::~TrialFactor() {
+    if (kernel_) clReleaseKernel(kernel_);
+    if (program_) clReleaseProgram(program_);
+}
+
+unsigned TrialFactor::maxBits(uint32_t p) {
+    return std::min(96u, bitLength(2 * static_cast<uint64_t>(p)) + 62);
+}
+
+TrialFactor::Result TrialFactor::run(uint32_t p, unsigned fromBits, unsigned toBits,
+                                     const std::atomic<bool>& stop, const Progress& progress,
+                                     const std::function<void(unsigned)>& levelDone)
+{
+    Result result;
+    result.bitsDone = fromBits;
+    toBits = std::min(toBits, maxBits(p));
+    if (fromBits >= toBits) return result;
+
+    const uint64_t twoP = 2 * static_cast<uint64_t>(p);
+    const mpz_class twoPz = fromU64(twoP);
+    // classes where q can be a factor: q = +/-1 (mod 8), and not a multiple
+    // of 3, 5, 7 or 11 (unless q is that prime, which 2p + 1 > 11 rules out)
+    std::vector<uint32_t> classes;
+    for (uint32_t c = 0; c < kClasses; ++c) {
+        const uint64_t q = twoP * c + 1;
+        if (q % 8 != 1 && q % 8 != 7) continue;
+        if (twoP + 1 > 11 && (q % 3 == 0 || q % 5 == 0 || q % 7 == 0 || q % 11 == 0)) continue;
+        classes.push_back(c);
+    }
+    // device sieve primes, all below 2p + 1 so that no candidate is one of them
+    std::vector<uint32_t> primes, kZero, invClasses;
+    for (uint32_t s = 13; primes.size() < kSievePrimes && s < twoP + 1; s += 2) {
+        bool prime = true;
+        for (uint32_t d = 3; d * d <= s; d += 2) if (s % d == 0) { prime = false; break; }
+        if (!prime) continue;
+        primes.push_back(s);
+        const uint32_t twoPmod = static_cast<uint32_t>(twoP % s);
+        // s | q for k = -(2p)^-1 (mod s); never when s = p
+        kZero.push_back(twoPmod == 0 ? s : (s - invMod(twoPmod, s)) % s);
+        invClasses.push_back(invMod(kClasses % s, s));
+    }
+    const cl_uint nprimes = static_cast<cl_uint>(primes.size());
+    const std::size_t slots = classes.size();
+
+    cl_context context = ctx_.getContext();
+    cl_command_queue queue = ctx_.getQueue();
+    cl_int err = CL_SUCCESS;
+    cl_mem primesBuf = clCreateBuffer(context, CL_MEM_READ_ONLY, std::max<std::size_t>(1, nprimes) * sizeof(cl_uint), nullptr, &err);
+    check(err, "clCreateBuffer(primes)");
+    cl_mem skipBuf = clCreateBuffer(context, CL_MEM_READ_ONLY, std::max<std::size_t>(1, slots * nprimes) * sizeof(cl_uint), nullptr, &err);
+    if (err != CL_SUCCESS) { clReleaseMemObject(primesBuf); check(err, "clCreateBuffer(skip)"); }
+    cl_mem foundBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, slots * sizeof(cl_uint), nullptr, &err);
+    if (err != CL_SUCCESS) { clReleaseMemObject(primesBuf); clReleaseMemObject(skipBuf); check(err, "clCreateBuffer(found)"); }
+    struct Release {
+        cl_mem a, b, c;
+        ~Release() { clReleaseMemObject(a); clReleaseMemObject(b); clReleaseMemObject(c); }
+    } release{ primesBuf, skipBuf, foundBuf };
+
+    if (nprimes) check(clEnqueueWriteBuffer(queue, primesBuf, CL_TRUE, 0, nprimes * sizeof(cl_uint), primes.data(), 0, nullptr, nullptr), "upload primes");
+    const cl_uint pArg = p;
+    check(clSetKernelArg(kernel_, 0, sizeof(cl_uint), &pArg), "clSetKernelArg");
+    check(clSetKernelArg(kernel_, 2, sizeof(cl_mem), &primesBuf), "clSetKernelArg");
+    check(clSetKernelArg(kernel_, 3, sizeof(cl_mem), &skipBuf), "clSetKernelArg");
+    check(clSetKernelArg(kernel_, 4, sizeof(cl_uint), &nprimes), "clSetKernelArg");
+    check(clSetKernelArg(kernel_, 5, sizeof(cl_mem), &foundBuf), "clSetKernelArg");
+
+    std::vector<cl_uint> skip(slots * nprimes), found(slots);
+    const std::vector<cl_uint> none(slots, std::numeric_limits<cl_uint>::max());
+    const uint64_t blockK = kClasses * static_cast<uint64_t>(kBlock);
+
+    for (unsigned bits = std::max(fromBits + 1, 1u); bits <= toBits; ++bits) {
+        // q = 2kp + 1 in [2^(bits-1), 2^bits)
+        const mpz_class lo = mpz_class(1) << (bits - 1), hi = mpz_class(1) << bits;
+        const uint64_t kMin = toU64((lo - 1) / twoPz);
+        const uint64_t kEnd = toU64((hi - 2) / twoPz + 1);
+        const uint64_t first = kMin / kClasses * kClasses;
+        const uint64_t blocks = kEnd > first ? (kEnd - first + blockK - 1) / blockK : 0;
+
+        for (uint64_t b = 0; b < blocks; ++b) {
+            if (stop) { result.interrupted = true; return result; }
+            const uint64_t base = first + b * blockK;
+            const uint64_t left = (kEnd - base + kClasses - 1) / kClasses;
+            const size_t count = static_cast<size_t>(std::min<uint64_t>(kBlock, left));
+
+            for (std::size_t slot = 0; slot < slots; ++slot) {
+                const uint64_t k0 = base + classes[slot];
+                for (cl_uint i = 0; i < nprimes; ++i) {
+                    const uint32_t s = primes[i];
+                    if (kZero[i] == s) { skip[slot * nprimes + i] = s; continue; }
+                    // k0 + kClasses * gid = kZero (mod s)
+                    const uint64_t d = (kZero[i] + s - k0 % s) % s;
+                    skip[slot * nprimes + i] = static_cast<cl_uint>(d * invClasses[i] % s);
+                }
+            }
+            if (nprimes) check(clEnqueueWriteBuffer(queue, skipBuf, CL_FALSE, 0, skip.size() * sizeof(cl_uint), skip.data(), 0, nullptr, nullptr), "upload skip");
+            check(clEnqueueWriteBuffer(queue, foundBuf, CL_FALSE, 0, slots * sizeof(cl_uint), none.data(), 0, nullptr, nullptr), "reset found");
+            for (std::size_t slot = 0; slot < slots; ++slot) {
+                const cl_ulong k0 = base + classes[slot];
+                const cl_uint s = static_cast<cl_uint>(slot);
+                check(clSetKernelArg(kernel_, 1, sizeof(cl_ulong), &k0), "clSetKernelArg");
+                check(clSetKernelArg(kernel_, 6, sizeof(cl_uint), &s), "clSetKernelArg");
+                check(clEnqueueNDRangeKernel(queue, kernel_, 1, nullptr, &count, nullptr, 0, nullptr, nullptr), "kernel_tf");
+            }
+            check(clEnqueueReadBuffer(queue, foundBuf, CL_TRUE, 0, slots * sizeof(cl_uint), found.data(), 0, nullptr, nullptr), "read found");
+
+            mpz_class best;
+            for (std::size_t slot = 0; slot < slots; ++slot) {
+                if (found[slot] == std::numeric_limits<cl_uint>::max()) continue;
+                const uint64_t k = base + classes[slot] + static_cast<uint64_t>(kClasses) * found[slot];
+                const mpz_class q = fromU64(k) * twoPz + 1;
+                mpz_class r;
+                mpz_powm_ui(r.get_mpz_t(), mpz_class(2).get_mpz_t(), p, q.get_mpz_t());
+                if (r != 1) {
+                    std::cerr << "Warning: trial factoring reported " << q.get_str() << " which does not divide M" << p << std::endl;
+                    continue;
+                }
+                if (best == 0 || q < best) best = q;
+            }
+            if (best != 0) {
+                result.factor = best.get_str();
+                result.bitsDone = static_cast<unsigned>(mpz_sizeinbase(best.get_mpz_t(), 2));
+                return result;
+            }
+            if (progress) progress(bits, b + 1, blocks);
+        }
+        result.bitsDone = bits;
+        if (levelDone) levelDone(bits);
+    }
+    return result;
+}
+
+} // namespace math
@@ -0,0 +1,160 @@
+// src/opencl/Arena.cpp
+#include "opencl/Arena.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace opencl {
+
+namespace {
+
+std::string mib(std::size_t bytes) {
+    std::ostringstream s;
+    s << std::fixed << std::setprecision(1) << bytes / 1048576.0 << " MiB";
+    return s.str();
+}
+
+} // namespace
+
+Arena::Arena(const Context& ctx, std::size_t budgetBytes)
+  : ctx_(ctx)
+{
+    cl_ulong globalMem = 0, maxAlloc = 0;
+    cl_uint alignBits = 0;
+    clGetDeviceInfo(ctx.getDevice(), CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMem), &globalMem, nullptr);
+    clGetDeviceInfo(ctx.getDevice(), CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, nullptr);
+    clGetDeviceInfo(ctx.getDevice(), CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(alignBits), &alignBits, nullptr);
+    globalMem_ = static_cast<std::size_t>(globalMem);
+    maxAlloc_  = static_cast<std::size_t>(maxAlloc);
+    // sub-buffer origins must be multiples of CL_DEVICE_MEM_BASE_ADDR_ALIGN
+    align_     = std::max<std::size_t>(alignBits / 8, 1);
+    budget_    = globalMem_;
+    if (budgetBytes != 0 && (budget_ == 0 || budgetBytes < budget_)) budget_ = budgetBytes;
+    if (maxAlloc_ == 0) maxAlloc_ = budget_;
+    maxAlloc_ = maxAlloc_ / align_ * align_;
+}
+
+Arena::~Arena() {
+    for (Slab& s : slabs_) {
+        if (s.mem) clReleaseMemObject(s.mem);
+    }
+}
+
+void Arena::reserve(const std::string& subsystem, std::size_t bytes) {
+    usage_[subsystem].planned += round(bytes);
+}
+
+std::size_t Arena::planned() const noexcept {
+    std::size_t total = 0;
+    for (const auto& u : usage_) total += u.second.planned;
+    return total;
+}
+
+void Arena::checkPlan() const {
+    const std::size_t total = planned();
+    if (budget_ != 0 && total > budget_) {
+        report(std::cerr);
+        throw std::runtime_error("device memory plan of " + mib(total)
+                                 + " exceeds the budget of " + mib(budget_));
+    }
+}
+
+cl_mem Arena::allocate(const std::string& subsystem, const std::string& name,
+                       std::size_t bytes, const void* host)
+{
+    const std::size_t size = round(bytes);
+    if (size > maxAlloc_) {
+        throw std::runtime_error("buffer " + name + " of " + mib(size)
+                                 + " exceeds the largest device allocation of " + mib(maxAlloc_));
+    }
+
+    std::size_t slab = 0;
+    while (slab < slabs_.size() && slabs_[slab].top + size > slabs_[slab].size) ++slab;
+    if (slab == slabs_.size()) {
+        // A new slab takes the rest of the plan, so a run that reserved its
+        // buffers up front holds one slab per CL_DEVICE_MAX_MEM_ALLOC_SIZE.
+        std::size_t total = 0;
+        for (const Slab& s : slabs_) total += s.size;
+        const std::size_t rest = planned() > total ? planned() - total : 0;
+        const std::size_t slabSize = std::min(std::max(size, rest), maxAlloc_);
+        if (budget_ != 0 && total + slabSize > budget_) {
+            report(std::cerr);
+            throw std::runtime_error("buffer " + name + " of " + mib(size)
+                                     + " does not fit the device memory budget of " + mib(budget_));
+        }
+        cl_int err = CL_SUCCESS;
+        // on unified memory the slab is host memory the device can use as is,
+        // so the residues and checkpoints can be mapped without a copy
+        const cl_mem_flags flags = CL_MEM_READ_WRITE | (ctx_.hasUnifiedMemory() ? CL_MEM_ALLOC_HOST_PTR : 0);
+        cl_mem mem = clCreateBuffer(ctx_.getContext(), flags, slabSize, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Failed to create a " << mib(slabSize) << " device memory slab for " << name << ": " << err << std::endl;
+            throw std::runtime_error("createBuffer " + name);
+        }
+        slabs_.push_back({ mem, slabSize, 0 });
+    }
+
+    Slab& s = slabs_[slab];
+    cl_buffer_region region{ s.top, bytes };
+    cl_int err = CL_SUCCESS;
+    cl_mem mem = clCreateSubBuffer(s.mem, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Failed to create buffer " << name << ": " << err << std::endl;
+        throw std::runtime_error("createBuffer " + name);
+    }
+    if (host) {
+        err = ctx_.getStaging().write(mem, host, bytes);
+        if (err != CL_SUCCESS) {
+            clReleaseMemObject(mem);
+            std::cerr << "Failed to upload buffer " << name << ": " << err << std::endl;
+            throw std::runtime_error("createBuffer " + name);
+        }
+    }
+
+    blocks_[mem] = { slab, s.top, size, subsystem };
+    s.top += size;
+    Usage& u = usage_[subsystem];
+    u.used += size;
+    u.peak = std::max(u.peak, u.used);
+    ++u.buffers;
+    used_ += size;
+    peak_ = std::max(peak_, used_);
+    return mem;
+}
+
+void Arena::release(cl_mem mem) {
+    auto it = blocks_.find(mem);
+    if (it == blocks_.end()) return;
+    const Block& b = it->second;
+    Usage& u = usage_[b.subsystem];
+    u.used -= b.size;
+    --u.buffers;
+    used_ -= b.size;
+    Slab& s = slabs_[b.slab];
+    if (b.offset + b.size == s.top) s.top = b.offset;
+    blocks_.erase(it);
+}
+
+void Arena::report(std::ostream& out) const {
+    std::size_t total = 0;
+    for (const Slab& s : slabs_) total += s.size;
+    out << "Device memory: budget " << mib(budget_) << " of " << mib(globalMem_)
+        << ", largest allocation " << mib(maxAlloc_) << ", " << slabs_.size()
+        << (slabs_.size() == 1 ? " slab" : " slabs") << " of " << mib(total) << std::endl;
+    for (const auto& e : usage_) {
+        const Usage& u = e.second;
+        out << "  " << std::left << std::setw(12) << e.first << std::right
+            << " planned " << std::setw(12) << mib(u.planned)
+            << "  used " << std::setw(12) << mib(u.used)
+            << "  peak " << std::setw(12) << mib(u.peak)
+            << "  (" << u.buffers << (u.buffers == 1 ? " buffer)" : " buffers)") << std::endl;
+    }
+    out << "  " << std::left << std::setw(12) << "total" << std::right
+        << " planned " << std::setw(12) << mib(planned())
+        << "  used " << std::setw(12) << mib(used_)
+        << "  peak " << std::setw(12) << mib(peak_) << std::endl;
+}
+
+} // namespace opencl
@@ -26,100 +26,81 @@
 
 namespace opencl {
 
-Buffers::Buffers(const opencl::Context& ctx, const math::Precompute& pre)
-  : input(nullptr), twiddle5Buf(nullptr), invTwiddle5Buf(nullptr),Hbuf(nullptr),Hq(nullptr),Qbuf(nullptr),tmp(nullptr),r2(nullptr),save(nullptr),bufd(nullptr),buf3(nullptr),last_correct_state(nullptr),last_correct_bufd(nullptr)
+Buffers::Buffers(const opencl::Context& ctx, const math::Precompute& pre,
+                 std::size_t budgetBytes,
+                 const std::vector<std::pair<std::string, std::size_t>>& plan)
+  : arena(ctx, budgetBytes), input(nullptr), twiddle5Buf(nullptr), invTwiddle5Buf(nullptr),Hbuf(nullptr),Hq(nullptr),Qbuf(nullptr),tmp(nullptr),r2(nullptr),save(nullptr),bufd(nullptr),buf3(nullptr),last_correct_state(nullptr),last_correct_bufd(nullptr),jacobiSnap(nullptr),jacobiGood(nullptr),babySlab(nullptr)
 {
     const size_t n = pre.getN();
     const size_t twiddle4Size = (n % 5 == 0) ? 3 * n / 5 : 3 * n;
     const size_t twiddle5Size = 4 * n / 5;
 
-    digitWeightBuf = createBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-        n * sizeof(uint64_t),
-        pre.digitWeight().data(), "digitWeight");
+    arena.reserve("ntt", 2 * n * sizeof(uint64_t));
+    arena.reserve("ntt", 2 * twiddle4Size * sizeof(uint64_t));
+    if (n % 5 == 0) arena.reserve("ntt", 2 * twiddle5Size * sizeof(uint64_t));
+    arena.reserve("carry", ctx.getWorkersCarry() * sizeof(uint64_t));
+    for (const auto& p : plan) arena.reserve(p.first, p.second);
+    arena.checkPlan();
 
-    digitInvWeightBuf = createBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-        n * sizeof(uint64_t),
-        pre.digitInvWeight().data(), "digitInvWeight");
+    digitWeightBuf = arena.allocate("ntt", "digitWeight",
+        n * sizeof(uint64_t), pre.digitWeight().data());
 
-    twiddle4Buf = createBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-        twiddle4Size * sizeof(uint64_t),
-        pre.twiddlesRadix4().data(), "twiddles4");
+    digitInvWeightBuf = arena.allocate("ntt", "digitInvWeight",
+        n * sizeof(uint64_t), pre.digitInvWeight().data());
 
-    invTwiddle4Buf = createBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-        twiddle4Size * sizeof(uint64_t),
-        pre.invTwiddlesRadix4().data(), "invTwiddles4");
-    if(n%5==0){
-        twiddle5Buf = createBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            twiddle5Size * sizeof(uint64_t),
-            pre.twiddlesRadix5().data(), "twiddles5");
-
-        invTwiddle5Buf = createBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            twiddle5Size * sizeof(uint64_t),
-            pre.invTwiddlesRadix5().data(), "invTwiddles5");
-    }
-    /*else{
-        clReleaseMemObject(invTwiddle5Buf);
-        clReleaseMemObject(twiddle5Buf);
-
-    }*/
+    twiddle4Buf = arena.allocate("ntt", "twiddles4",
+        twiddle4Size * sizeof(uint64_t), pre.twiddlesRadix4().data());
 
-    blockCarryBuf = createBuffer(ctx, CL_MEM_READ_WRITE,
-        ctx.getWorkersCarry() * sizeof(uint64_t),
-        nullptr, "blockCarry");
-
-    const auto& maskBits = pre.getDigitWidthMask();
-    size_t maskN = maskBits.size();
-    size_t chunks = (maskN + 63) / 64;
-    size_t chunks_padded = ((chunks + 3) & ~size_t(3));
-    bool add_guard = true;
-    if (add_guard) chunks_padded += 1;
+    invTwiddle4Buf = arena.allocate("ntt", "invTwiddles4",
+        twiddle4Size * sizeof(uint64_t), pre.invTwiddlesRadix4().data());
+    if(n%5==0){
+        twiddle5Buf = arena.allocate("ntt", "twiddles5",
+            twiddle5Size * sizeof(uint64_t), pre.twiddlesRadix5().data());
 
-    std::vector<uint64_t> maskPacked(chunks_padded, 0ULL);
-    for (size_t i = 0; i < maskN; ++i) {
-        if (maskBits[i]) {
-            size_t blk = i >> 6;
-            size_t bit = i & 63;
-            maskPacked[blk] |= (1ULL << bit);
-        }
+        invTwiddle5Buf = arena.allocate("ntt", "invTwiddles5",
+            twiddle5Size * sizeof(uint64_t), pre.invTwiddlesRadix5().data());
     }
 
-
-    digitWidthMaskBuf = createBuffer(ctx,
-        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-        maskPacked.size() * sizeof(uint64_t),
-        maskPacked.data(),
-        "digitWidthMaskPacked");
+    blockCarryBuf = arena.allocate("carry", "blockCarry",
+        ctx.getWorkersCarry() * sizeof(uint64_t));
 }
 
 
 Buffers::~Buffers() {
-    if (input)              clReleaseMemObject(input);
-    if (digitWeightBuf)     clReleaseMemObject(digitWeightBuf);
-    if (digitInvWeightBuf)  clReleaseMemObject(digitInvWeightBuf);
-    if (twiddle4Buf)         clReleaseMemObject(twiddle4Buf);
-    if (invTwiddle4Buf)      clReleaseMemObject(invTwiddle4Buf);
-    if (twiddle5Buf)         clReleaseMemObject(twiddle5Buf);
-    if (invTwiddle5Buf)      clReleaseMemObject(invTwiddle5Buf);
-    if (blockCarryBuf)      clReleaseMemObject(blockCarryBuf);
-    if (digitWidthMaskBuf)      clReleaseMemObject(digitWidthMaskBuf);
-    if (Hbuf)      clReleaseMemObject(Hbuf);
-    if (Hq)      clReleaseMemObject(Hq);
-    if (Qbuf)      clReleaseMemObject(Qbuf);
-    if (tmp)      clReleaseMemObject(tmp);
-    if (r2)      clReleaseMemObject(r2);
-    if (save)      clReleaseMemObject(save);
-    if (bufd)      clReleaseMemObject(bufd);
-    if (buf3)      clReleaseMemObject(buf3);
-    if (last_correct_state)      clReleaseMemObject(last_correct_state);
-    if (last_correct_bufd)      clReleaseMemObject(last_correct_bufd);
-    if (!evenPow.empty()) {
-        for (cl_mem buf : evenPow) {
+    auto drop = [this](cl_mem buf) {
+        if (!buf) return;
+        arena.release(buf);
+        clReleaseMemObject(buf);
+    };
+    drop(input);
+    drop(digitWeightBuf);
+    drop(digitInvWeightBuf);
+    drop(twiddle4Buf);
+    drop(invTwiddle4Buf);
+    drop(twiddle5Buf);
+    drop(invTwiddle5Buf);
+    drop(blockCarryBuf);
+    drop(Hbuf);
+    drop(Hq);
+    drop(Qbuf);
+    drop(tmp);
+    drop(r2);
+    drop(save);
+    drop(bufd);
+    drop(buf3);
+    drop(last_correct_state);
+    drop(last_correct_bufd);
+    drop(jacobiSnap);
+    drop(jacobiGood);
+    if (!babyPow.empty()) {
+        for (cl_mem buf : babyPow) {
             if (buf != nullptr) {
                 clReleaseMemObject(buf);
             }
         }
-        evenPow.clear();
+        babyPow.clear();
     }
+    if (babySlab)      clReleaseMemObject(babySlab);
 
 }
 
@@ -0,0 +1,72 @@
+// opencl/CommandBuffer.cpp
+#include "opencl/CommandBuffer.hpp"
+#include "util/OpenCLError.hpp"
+#include <iostream>
+
+namespace opencl {
+
+CommandBuffer::CommandBuffer(const Context& ctx)
+    : queue_(ctx.getQueue())
+{
+    if (!ctx.hasExtension("cl_khr_command_buffer"))
+        return;
+
+    cl_platform_id plat = ctx.getPlatform();
+    create_   = reinterpret_cast<CreateFn>(clGetExtensionFunctionAddressForPlatform(plat, "clCreateCommandBufferKHR"));
+    record_   = reinterpret_cast<NDRangeFn>(clGetExtensionFunctionAddressForPlatform(plat, "clCommandNDRangeKernelKHR"));
+    finalize_ = reinterpret_cast<FinalizeFn>(clGetExtensionFunctionAddressForPlatform(plat, "clFinalizeCommandBufferKHR"));
+    enqueue_  = reinterpret_cast<EnqueueFn>(clGetExtensionFunctionAddressForPlatform(plat, "clEnqueueCommandBufferKHR"));
+    release_  = reinterpret_cast<ReleaseFn>(clGetExtensionFunctionAddressForPlatform(plat, "clReleaseCommandBufferKHR"));
+    if (!create_ || !record_ || !finalize_ || !enqueue_ || !release_)
+        return;
+
+    cl_int err = CL_SUCCESS;
+    cmdbuf_ = create_(1, &queue_, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        cmdbuf_ = nullptr;
+    }
+}
+
+CommandBuffer::~CommandBuffer() {
+    if (cmdbuf_ && release_) release_(cmdbuf_);
+}
+
+bool CommandBuffer::ndrange(cl_kernel kernel, std::size_t global, const std::size_t* local) {
+    if (!valid() || finalized_) return false;
+    sync_t sp = 0;
+    cl_int err = record_(cmdbuf_, nullptr, nullptr, kernel, 1, nullptr, &global, local,
+                         recorded_ ? 1u : 0u, recorded_ ? &last_ : nullptr, &sp, nullptr);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Command buffer record failed: " << util::getCLErrorString(err)
+                  << " (" << err << ")\n";
+        failed_ = true;
+        return false;
+    }
+    last_ = sp;
+    ++recorded_;
+    return true;
+}
+
+bool CommandBuffer::finalize() {
+    if (!valid() || finalized_ || recorded_ == 0) return false;
+    if (finalize_(cmdbuf_) != CL_SUCCESS) {
+        failed_ = true;
+        return false;
+    }
+    finalized_ = true;
+    return true;
+}
+
+bool CommandBuffer::enqueue() {
+    if (!finalized_ || failed_) return false;
+    cl_int err = enqueue_(1, &queue_, cmdbuf_, 0, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Command buffer enqueue failed: " << util::getCLErrorString(err)
+                  << " (" << err << ")\n";
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+} // namespace opencl
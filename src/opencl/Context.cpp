@@ -39,7 +39,7 @@
 #endif
 namespace opencl {
 
-Context::Context(int deviceIndex, std::size_t enqueueMax, bool cl_queue_throttle_active, bool debug, bool marin)
+Context::Context(int deviceIndex, std::size_t enqueueMax, bool cl_queue_throttle_active, bool debug, bool marin, bool profiling)
     : platform_(nullptr), device_(nullptr),
       context_(nullptr), queue_(nullptr),
       queueSize_(0),
@@ -48,18 +48,42 @@ Context::Context(int deviceIndex, std::size_t enqueueMax, bool cl_queue_throttle
       localSize_(0), localSize2_(0), localSize3_(0),
       localSizeCarry_(0), workersCarry_(2), localCarryPropagationDepth_(8),
       evenExponent_(true),
-      debug_(debug)
+      debug_(debug),
+      profiler_(profiling ? std::make_unique<Profiler>() : nullptr)
 {
     pickPlatformAndDevice(deviceIndex);
     createContext();
     //if(!marin){
         createQueue(enqueueMax, cl_queue_throttle_active);
     //}
+    createTransferQueue();
     queryDeviceCapabilities(); 
+    staging_ = std::make_unique<Staging>(queue_, unifiedMemory_);
+}
+
+Context::Context(HostOnly, bool debug)
+    : platform_(nullptr), device_(nullptr),
+      context_(nullptr), queue_(nullptr),
+      transformSize_(0), workGroupCount_(0),
+      queueSize_(0),
+      maxWorkGroupSize_(0),
+      localMemSize_(0),
+      localSize_(0), localSize2_(0), localSize3_(0), localSize4_(0),
+      localSizeCarry_(0), localSize5_(0), workersCarry_(2), localCarryPropagationDepth_(8),
+      exponent_(0),
+      evenExponent_(true),
+      debug_(debug),
+      staging_(std::make_unique<Staging>(nullptr))
+{
 }
 
 
 Context::~Context() {
+    staging_.reset();
+    if (transferQueue_) {
+        clFinish(transferQueue_);
+        clReleaseCommandQueue(transferQueue_);
+    }
     if (queue_)   clReleaseCommandQueue(queue_);
     if (context_) clReleaseContext(context_);
 }
@@ -94,6 +118,19 @@ void Context::pickPlatformAndDevice(int globalIndex) {
     device_   = allDevices[globalIndex].dev;
 }
 
+std::size_t Context::deviceCount() {
+    cl_uint numPlat = 0;
+    if (clGetPlatformIDs(0, nullptr, &numPlat) != CL_SUCCESS || numPlat == 0) return 0;
+    std::vector<cl_platform_id> platforms(numPlat);
+    clGetPlatformIDs(numPlat, platforms.data(), nullptr);
+    std::size_t count = 0;
+    for (auto &plat : platforms) {
+        cl_uint ndev = 0;
+        if (clGetDeviceIDs(plat, CL_DEVICE_TYPE_GPU, 0, nullptr, &ndev) == CL_SUCCESS) count += ndev;
+    }
+    return count;
+}
+
 void Context::listAllOpenCLDevices() {
     std::cout << "\nUsage: prmers [options] -d <device_index>\n\n";
     std::cout << "Select a GPU device by index from the list below:\n\n";
@@ -187,9 +224,11 @@ void Context::createContext() {
 void Context::createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active) {
     cl_int err = CL_SUCCESS;
     bool useThrottle = false;
-    
+    // profiling timestamps are not free on every driver: only with -profile
+    const cl_command_queue_properties qprops = profiler_ ? CL_QUEUE_PROFILING_ENABLE : 0;
+
 #if defined(__APPLE__)
-    queue_ = clCreateCommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE, &err);
+    queue_ = clCreateCommandQueue(context_, device_, qprops, &err);
 #else
     unsigned ver = queryCLVersion();
     if (ver >= 200){
@@ -208,7 +247,7 @@ void Context::createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active)
             }
             else{
                 const cl_queue_properties props[] = {
-                    CL_QUEUE_PROPERTIES,            CL_QUEUE_PROFILING_ENABLE,
+                    CL_QUEUE_PROPERTIES,            qprops,
                     0
                 };
                 queue_ = clCreateCommandQueueWithProperties(context_, device_,
@@ -231,7 +270,7 @@ void Context::createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active)
                 if(debug_)
                     std::cout << "Setting CL_QUEUE_SIZE=" << enqueueMax << std::endl;
                 const cl_queue_properties props[] = {
-                    CL_QUEUE_PROPERTIES, 0,
+                    CL_QUEUE_PROPERTIES, qprops,
                     CL_QUEUE_SIZE,       enqueueMax,
                     0
                 };
@@ -240,7 +279,7 @@ void Context::createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active)
             }
             else{
                 const cl_queue_properties props[] = {
-                    CL_QUEUE_PROPERTIES, 0,
+                    CL_QUEUE_PROPERTIES, qprops,
                     0
                 };
                 queue_ = clCreateCommandQueueWithProperties(context_, device_,
@@ -256,7 +295,7 @@ void Context::createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active)
         #pragma GCC diagnostic push
         #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
         #endif
-        queue_ = clCreateCommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE, &err);
+        queue_ = clCreateCommandQueue(context_, device_, qprops, &err);
         #if defined(_MSC_VER)
         #pragma warning(pop)
         #elif defined(__GNUC__) || defined(__clang__)
@@ -316,6 +355,40 @@ void Context::createQueue(std::size_t enqueueMax, bool cl_queue_throttle_active)
         std::cout << "Queue preferred size = " << queueSize_ << std::endl;
 }
 
+void Context::createTransferQueue() {
+    // in order, and with the properties of the compute queue so that -profile
+    // times the copies too; no CL_QUEUE_SIZE, copies are few
+    const cl_command_queue_properties qprops = profiler_ ? CL_QUEUE_PROFILING_ENABLE : 0;
+    cl_int err = CL_SUCCESS;
+#if defined(__APPLE__)
+    transferQueue_ = clCreateCommandQueue(context_, device_, qprops, &err);
+#else
+    if (queryCLVersion() >= 200) {
+        const cl_queue_properties props[] = { CL_QUEUE_PROPERTIES, qprops, 0 };
+        transferQueue_ = clCreateCommandQueueWithProperties(context_, device_, props, &err);
+    } else {
+        #if defined(_MSC_VER)
+        #pragma warning(push)
+        #pragma warning(disable: 4996)
+        #elif defined(__GNUC__) || defined(__clang__)
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+        #endif
+        transferQueue_ = clCreateCommandQueue(context_, device_, qprops, &err);
+        #if defined(_MSC_VER)
+        #pragma warning(pop)
+        #elif defined(__GNUC__) || defined(__clang__)
+        #pragma GCC diagnostic pop
+        #endif
+    }
+#endif
+    if (err != CL_SUCCESS) {
+        transferQueue_ = nullptr;
+        if (debug_)
+            std::cout << "No transfer queue, device reads stay on the compute queue" << std::endl;
+    }
+}
+
 void Context::queryDeviceCapabilities() {
     clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE,
                     sizeof(maxWorkGroupSize_), &maxWorkGroupSize_, nullptr);
@@ -327,13 +400,20 @@ void Context::queryDeviceCapabilities() {
 
     clGetDeviceInfo(device_, CL_DEVICE_LOCAL_MEM_SIZE,
                     sizeof(localMemSize_), &localMemSize_, nullptr);
+
+    // deprecated by OpenCL 2.0 but still answered; SVM is not used
+    cl_bool unified = CL_FALSE;
+    if (clGetDeviceInfo(device_, CL_DEVICE_HOST_UNIFIED_MEMORY,
+                        sizeof(unified), &unified, nullptr) == CL_SUCCESS)
+        unifiedMemory_ = (unified == CL_TRUE);
     if(debug_){
     std::cout << "Max CL_DEVICE_MAX_WORK_GROUP_SIZE = " << maxWorkGroupSize_ << std::endl;
     std::cout << "Max CL_DEVICE_MAX_WORK_ITEM_SIZES = "
               << maxWorkItemSizes_[0] << ", "
               << maxWorkItemSizes_[1] << ", "
               << maxWorkItemSizes_[2] << std::endl;
-    std::cout << "Max CL_DEVICE_LOCAL_MEM_SIZE = " << localMemSize_ << " bytes" << std::endl;}
+    std::cout << "Max CL_DEVICE_LOCAL_MEM_SIZE = " << localMemSize_ << " bytes" << std::endl;
+    std::cout << "CL_DEVICE_HOST_UNIFIED_MEMORY = " << (unifiedMemory_ ? "true" : "false") << std::endl;}
 }
 
 void Context::computeOptimalSizes(std::size_t n,
@@ -341,7 +421,10 @@ void Context::computeOptimalSizes(std::size_t n,
                                   uint64_t p,
                                   bool debug,
                                   int localMaxSize,
-                                  int localMaxSize5)
+                                  int localMaxSize5,
+                                  bool localStages,
+                                  bool coalesced,
+                                  std::size_t genTile)
 {
 
     transformSize_ = static_cast<cl_uint>(n);
@@ -370,6 +453,7 @@ void Context::computeOptimalSizes(std::size_t n,
     size_t maxWork = std::min({ limit_mem, limit_hw, limit_n, static_cast<size_t>(256) });
 
     if (maxWork < 128) maxWork = 128;
+    if (localMaxSize > 0 && static_cast<size_t>(localMaxSize) < maxWork) maxWork = localMaxSize;
 
     if (maxWork > maxWorkGroupSize_) maxWork = maxWorkGroupSize_;
     std::size_t workers = n;
@@ -458,6 +542,72 @@ void Context::computeOptimalSizes(std::size_t n,
 
     
     workGroupCount_ = (transformSize_ < localSize_) ? 1u : transformSize_ / static_cast<cl_uint>(localSize_);
+
+    // Small power-of-4 transforms: the whole squaring (both NTTs and the
+    // carry) runs in a single work-group when x and the block carries fit
+    // in local memory.
+    fusedSquareLocalSize_ = 0;
+    {
+        std::size_t log2n = 0;
+        while ((std::size_t(1) << log2n) < n) ++log2n;
+        const bool pow4   = (std::size_t(1) << log2n) == n && (log2n % 2) == 0;
+        const bool blocks = workersCarry_ * static_cast<std::size_t>(localCarryPropagationDepth_) == n
+                            && localCarryPropagationDepth_ >= 4;
+        const cl_ulong need = (n + workersCarry_) * sizeof(cl_ulong);
+        if (transformSize_ >= 16 && pow4 && blocks && need <= localMemSize_) {
+            std::size_t ls = std::min<std::size_t>({ n / 4, maxWorkGroupSize_, 256 });
+            while (ls & (ls - 1)) ls &= ls - 1;
+            fusedSquareLocalSize_ = ls;
+        }
+    }
+
+    // Four-step passes for the middle radix-4 stages: a tile of up to 4096
+    // residues per work-group, within the device local memory.
+    localStagesTile_ = localStagesWorkGroup_ = 0;
+    if (localStages && n >= 4096) {
+        std::size_t tile = std::min<std::size_t>(4096, static_cast<std::size_t>(localMemSize_ / sizeof(cl_ulong)));
+        while (tile & (tile - 1)) tile &= tile - 1;
+        std::size_t wg = std::min<std::size_t>({ tile / 4, maxWorkGroupSize_, 256 });
+        while (wg & (wg - 1)) wg &= wg - 1;
+        if (tile >= 256) {
+            localStagesTile_ = tile;
+            localStagesWorkGroup_ = wg;
+        }
+    }
+
+    // Contiguous tiles for the radix-4 stages of stride 2 to 8: one butterfly
+    // per work-item, 4 residues each.
+    coalescedTile_ = coalescedWorkGroup_ = 0;
+    if (coalesced) {
+        std::size_t wg = std::min<std::size_t>({ n / 4, maxWorkGroupSize_, 256 });
+        while (wg & (wg - 1)) wg &= wg - 1;
+        while (wg >= 8 && (n % (4 * wg) != 0 || 4 * wg * sizeof(cl_ulong) > localMemSize_)) wg /= 2;
+        if (wg >= 8) {
+            coalescedTile_ = 4 * wg;
+            coalescedWorkGroup_ = wg;
+        }
+    }
+
+    // Generated passes: tiles of up to genTile residues, as the four-step ones.
+    genTile_ = genWorkGroup_ = 0;
+    if (genTile != 0 && n >= 1024) {
+        std::size_t tile = std::min<std::size_t>(genTile, static_cast<std::size_t>(localMemSize_ / sizeof(cl_ulong)));
+        while (tile & (tile - 1)) tile &= tile - 1;
+        std::size_t wg = std::min<std::size_t>({ tile / 4, maxWorkGroupSize_, 256 });
+        while (wg & (wg - 1)) wg &= wg - 1;
+        if (tile >= 256) {
+            genTile_ = tile;
+            genWorkGroup_ = wg;
+        }
+    }
+
+    {
+        const std::size_t lpd = static_cast<std::size_t>(localCarryPropagationDepth_);
+        inverseCarryFused_ = (n % 5 != 0) && n >= 64
+                          && workersCarry_ * lpd == n && lpd >= 4
+                          && lpd <= localSize2_ && localSize2_ % lpd == 0
+                          && (n / 16) % lpd == 0;
+    }
     //localSize_ = 0;
     
     if (debug_) {
@@ -466,6 +616,11 @@ void Context::computeOptimalSizes(std::size_t n,
                   << " carryDepth=" << localCarryPropagationDepth_
                   << " workersCarry=" << workersCarry_
                   << " localSizeCarry=" << localSizeCarry_
+                  << " fusedSquareLocalSize=" << fusedSquareLocalSize_
+                  << " inverseCarryFused=" << inverseCarryFused_
+                  << " localStagesTile=" << localStagesTile_
+                  << " coalescedTile=" << coalescedTile_
+                  << " genTile=" << genTile_
                   << std::endl;
     }
 }
@@ -489,8 +644,27 @@ int Context::getLocalCarryPropagationDepth() const noexcept { return localCarryP
 int Context::getExponent() const noexcept { return exponent_; }
 
 cl_context Context::getContext() const noexcept { return context_; }
+cl_platform_id Context::getPlatform() const noexcept { return platform_; }
 cl_device_id Context::getDevice() const noexcept { return device_; }
 cl_command_queue Context::getQueue() const noexcept { return queue_; }
+cl_command_queue Context::getTransferQueue() const noexcept { return transferQueue_ ? transferQueue_ : queue_; }
+
+cl_int Context::readAfterCompute(cl_mem mem, std::size_t offset, std::size_t bytes, void* host,
+                                 cl_event* done) const {
+    if (!transferQueue_) {
+        const cl_int err = clEnqueueReadBuffer(queue_, mem, CL_FALSE, offset, bytes, host, 0, nullptr, done);
+        clFlush(queue_);
+        return err;
+    }
+    cl_event computed = nullptr;
+    cl_int err = clEnqueueMarkerWithWaitList(queue_, 0, nullptr, &computed);
+    if (err != CL_SUCCESS) return err;
+    clFlush(queue_);
+    err = clEnqueueReadBuffer(transferQueue_, mem, CL_FALSE, offset, bytes, host, 1, &computed, done);
+    clReleaseEvent(computed);
+    clFlush(transferQueue_);
+    return err;
+}
 std::size_t Context::getQueueSize() const noexcept { return queueSize_; }
 cl_uint Context::getTransformSize() const noexcept { return transformSize_; }
 
@@ -502,6 +676,38 @@ cl_uint Context::getWorkGroupCount() const noexcept {
     return workGroupCount_;
 }
 
+std::size_t Context::getFusedSquareLocalSize() const noexcept {
+    return fusedSquareLocalSize_;
+}
+
+bool Context::canFuseInverseCarry() const noexcept {
+    return inverseCarryFused_;
+}
+
+std::size_t Context::getLocalStagesTile() const noexcept {
+    return localStagesTile_;
+}
+
+std::size_t Context::getLocalStagesWorkGroup() const noexcept {
+    return localStagesWorkGroup_;
+}
+
+std::size_t Context::getGenTile() const noexcept {
+    return genTile_;
+}
+
+std::size_t Context::getGenWorkGroup() const noexcept {
+    return genWorkGroup_;
+}
+
+std::size_t Context::getCoalescedTile() const noexcept {
+    return coalescedTile_;
+}
+
+std::size_t Context::getCoalescedWorkGroup() const noexcept {
+    return coalescedWorkGroup_;
+}
+
 unsigned Context::queryCLVersion() const {
     char buf[128] = {0};
     if (clGetDeviceInfo(device_, CL_DEVICE_VERSION, sizeof(buf), buf, nullptr) != CL_SUCCESS)
@@ -517,6 +723,7 @@ unsigned Context::queryCLVersion() const {
 
 
 std::string Context::queryDeviceString(cl_device_info info) const {
+    if (!device_) return {};
     size_t sz = 0;
     clGetDeviceInfo(device_, info, 0, nullptr, &sz);
     std::string s(sz, '\0');
@@ -525,4 +732,27 @@ std::string Context::queryDeviceString(cl_device_info info) const {
     return s;
 }
 
+std::string Context::getDeviceName() const {
+    return queryDeviceString(CL_DEVICE_NAME);
+}
+
+std::string Context::getDeviceVendor() const {
+    return queryDeviceString(CL_DEVICE_VENDOR);
+}
+
+std::string Context::getDriverVersion() const {
+    return queryDeviceString(CL_DRIVER_VERSION);
+}
+
+bool Context::hasExtension(const std::string& name) const {
+    const std::string ext = " " + queryDeviceString(CL_DEVICE_EXTENSIONS) + " ";
+    return ext.find(" " + name + " ") != std::string::npos;
+}
+
+bool Context::hasSubgroupShuffle() const {
+    if (hasExtension("cl_intel_subgroups")) return true;
+    return queryCLVersion() >= 200
+        && hasExtension("cl_khr_subgroups") && hasExtension("cl_khr_subgroup_shuffle");
+}
+
 } // namespace opencl
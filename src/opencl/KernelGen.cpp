@@ -0,0 +1,308 @@
+// opencl/KernelGen.cpp
+#include "opencl/KernelGen.hpp"
+#include "opencl/Kernels.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace opencl {
+
+namespace {
+
+// The stride below the first forward stage, when the others all are middle
+// stages and the last one is the m = 1 stage the tail replaces.
+cl_uint forwardTop(const std::vector<NttStage>& v, bool square) {
+    if (v.size() < 2) return 0;
+    const std::string& last = v.back().name;
+    const bool sg = square && last.rfind("kernel_ntt_radix4_mm_m4_square_sg(", 0) == 0;
+    const char* end = square ? "kernel_ntt_radix4_square_radix4(" : "kernel_ntt_radix4_last_m1_nosquare(";
+    if (!sg && last.rfind(end, 0) != 0) return 0;
+    for (size_t i = 1; i + 1 < v.size(); ++i)
+        if (!isMiddleStage(v[i], false)) return 0;
+    if (v.size() == 2) return sg ? 4 : 1;
+    return stageStride(v[1].name);
+}
+
+// The highest stride of the inverse middle stages, which have to start at
+// m = 4 (after the m = 1 stage of a simple pipeline) and end on a weighted
+// last stage.
+cl_uint inverseTop(const std::vector<NttStage>& v, bool simple) {
+    size_t s = 0;
+    if (simple) {
+        if (v.empty() || v[0].name.rfind("kernel_inverse_ntt_radix4_m1(", 0) != 0) return 0;
+        s = 1;
+    }
+    if (v.size() < s + 1 || v.back().name.find("_last(") == std::string::npos) return 0;
+    const size_t e = v.size() - 1;
+    for (size_t i = s; i < e; ++i)
+        if (!isMiddleStage(v[i], true)) return 0;
+    if (e == s) return 1;
+    if (stageStride(v[s].name) != 4) return 0;
+    const std::string& z = v[e - 1].name;
+    return stageStride(z) * (z.find("2_steps") != std::string::npos ? 4 : 1);
+}
+
+cl_uint passSize(const GenPass& p) { return p.cols * (4 * (p.hi / p.lo)); }
+
+const char* const kPreamble = R"(
+// ---- generated radix-4 passes (opencl/KernelGen.cpp) ----
+// the m = 1 stages of kernel_ntt_radix4_last_m1_nosquare and
+// kernel_inverse_ntt_radix4_m1
+inline ulong4 gen_forward_m1(ulong4 c)
+{
+    const ulong a = modAdd(c.s0, c.s2);
+    const ulong b = modAdd(c.s1, c.s3);
+    const ulong e = modSub(c.s0, c.s2);
+    const ulong d = modMuli(modSub(c.s1, c.s3));
+    c = (ulong4)(modAdd(a, b), modSub(a, b), modAdd(e, d), modSub(e, d));
+    return modMul3_2_w10(c);
+}
+
+inline ulong4 gen_inverse_m1(const ulong4 c)
+{
+    const ulong4 u = modMul3_2(c, (ulong2)(WI6, WI7), WI8);
+    const ulong v0 = modAdd(u.s0, u.s1);
+    const ulong v1 = modSub(u.s0, u.s1);
+    const ulong v2 = modAdd(u.s2, u.s3);
+    const ulong v3 = modMuli(modSub(u.s3, u.s2));
+    return (ulong4)(modAdd(v0, v2), modAdd(v1, v3), modSub(v0, v2), modSub(v1, v3));
+}
+)";
+
+// The radix-4 stages of strides from .. to (forward: decreasing, inverse:
+// increasing) of the tile s of pass p, as in kernel_[inverse_]ntt_radix4_local_stages.
+void emitStages(std::ostream& o, const GenPass& p, bool inverse, cl_uint from, cl_uint to, cl_uint wg) {
+    const cl_uint quarter = passSize(p) / 4;
+    for (cl_uint m = from; inverse ? m <= to : m >= to; m = inverse ? m * 4 : m / 4) {
+        const cl_uint ms = m / p.lo, d = ms * p.cols;
+        o << "    // m = " << m << "\n"
+          << "    for (uint b = lid; b < " << quarter << "u; b += " << wg << "u) {\n"
+          << "        const uint c = b % " << p.cols << "u, u = b / " << p.cols << "u;\n"
+          << "        const uint js = u & " << (ms - 1) << "u;\n"
+          << "        const uint i = (4 * (u - js) + js) * " << p.cols << "u + c;\n"
+          << "        const ulong4 tw = stage_twiddles(" << (inverse ? "wi" : "w") << ", " << m
+          << "u, r0 + c + " << p.lo << "u * js);\n";
+        if (!inverse) {
+            o << "        const ulong a0 = modAdd(s[i], s[i + " << 2 * d << "]);\n"
+              << "        const ulong a1 = modAdd(s[i + " << d << "], s[i + " << 3 * d << "]);\n"
+              << "        const ulong a2 = modSub(s[i], s[i + " << 2 * d << "]);\n"
+              << "        const ulong a3 = modMuli(modSub(s[i + " << d << "], s[i + " << 3 * d << "]));\n"
+              << "        s[i] = modAdd(a0, a1);\n"
+              << "        s[i + " << d << "] = modMul(modSub(a0, a1), tw.s1);\n"
+              << "        s[i + " << 2 * d << "] = modMul(modAdd(a2, a3), tw.s0);\n"
+              << "        s[i + " << 3 * d << "] = modMul(modSub(a2, a3), tw.s2);\n";
+        } else {
+            o << "        const ulong b0 = s[i];\n"
+              << "        const ulong b1 = modMul(s[i + " << d << "], tw.s1);\n"
+              << "        const ulong b2 = modMul(s[i + " << 2 * d << "], tw.s0);\n"
+              << "        const ulong b3 = modMul(s[i + " << 3 * d << "], tw.s2);\n"
+              << "        const ulong a0 = modAdd(b0, b1);\n"
+              << "        const ulong a1 = modSub(b0, b1);\n"
+              << "        const ulong a2 = modAdd(b2, b3);\n"
+              << "        const ulong a3 = modMuli(modSub(b3, b2));\n"
+              << "        s[i] = modAdd(a0, a2);\n"
+              << "        s[i + " << d << "] = modAdd(a1, a3);\n"
+              << "        s[i + " << 2 * d << "] = modSub(a0, a2);\n"
+              << "        s[i + " << 3 * d << "] = modSub(a1, a3);\n";
+        }
+        o << "    }\n"
+          << "    barrier(CLK_LOCAL_MEM_FENCE);\n";
+    }
+}
+
+void emitPass(std::ostream& o, const GenPass& p, cl_uint wg) {
+    using Op = GenPass::Op;
+    const cl_uint size = passSize(p);
+    const bool tail = (p.lo == 1);
+    o << "\n__kernel __attribute__((reqd_work_group_size(" << wg << ", 1, 1)))\n"
+      << "void " << generatedName(p) << "(__global ulong* restrict x";
+    if (p.op == Op::Mul)     o << ", __global const ulong* restrict y";
+    if (p.op != Op::Inverse) o << ", __global const ulong* restrict w";
+    if (p.op != Op::Forward) o << ", __global const ulong* restrict wi";
+    o << ")\n{\n"
+      << "    __local ulong s[" << size << "];\n"
+      << "    const uint lid = get_local_id(0);\n"
+      << "    const gid_t g = get_group_id(0);\n";
+    std::string at;
+    if (tail) {
+        o << "    const uint r0 = 0;\n"
+          << "    const gid_t base = g * (gid_t)" << size << ";\n";
+        at = "base + l";
+    } else {
+        const cl_uint tiles = p.lo / p.cols;
+        o << "    const uint r0 = (uint)(g % " << tiles << "u) * " << p.cols << "u;\n"
+          << "    const gid_t base = (g / " << tiles << "u) * (gid_t)" << 4 * p.hi << " + r0;\n";
+        at = "base + (l % " + std::to_string(p.cols) + "u) + (gid_t)" + std::to_string(p.lo)
+           + " * (l / " + std::to_string(p.cols) + "u)";
+    }
+    const std::string load  = "    for (uint l = lid; l < " + std::to_string(size) + "u; l += "
+                            + std::to_string(wg) + "u)\n        s[l] = x[" + at + "];\n"
+                            + "    barrier(CLK_LOCAL_MEM_FENCE);\n";
+    const std::string store = "    for (uint l = lid; l < " + std::to_string(size) + "u; l += "
+                            + std::to_string(wg) + "u)\n        x[" + at + "] = s[l];\n";
+    const std::string quads = "    for (uint q = lid; q < " + std::to_string(size / 4) + "u; q += "
+                            + std::to_string(wg) + "u)";
+
+    if (!tail) {
+        o << load;
+        emitStages(o, p, p.op == Op::Inverse, p.op == Op::Inverse ? p.lo : p.hi,
+                   p.op == Op::Inverse ? p.hi : p.lo, wg);
+        o << store << "}\n";
+        return;
+    }
+    switch (p.op) {
+    case Op::Forward:
+        o << load;
+        if (p.hi >= 4) emitStages(o, p, false, p.hi, 4, wg);
+        o << quads << "\n        vstore4(gen_forward_m1(vload4(q, s)), 0, x + base + 4 * q);\n";
+        break;
+    case Op::Inverse:
+        o << quads << "\n        vstore4(gen_inverse_m1(vload4(0, x + base + 4 * q)), q, s);\n"
+          << "    barrier(CLK_LOCAL_MEM_FENCE);\n";
+        if (p.hi >= 4) emitStages(o, p, true, 4, p.hi, wg);
+        o << store;
+        break;
+    case Op::Square:
+    case Op::Mul:
+        o << load;
+        if (p.hi >= 4) emitStages(o, p, false, p.hi, 4, wg);
+        o << quads << " {\n"
+          << "        const ulong4 f = gen_forward_m1(vload4(q, s));\n"
+          << "        vstore4(gen_inverse_m1(modMul4(f, "
+          << (p.op == Op::Square ? "f" : "vload4(0, y + base + 4 * q)") << ")), q, s);\n"
+          << "    }\n"
+          << "    barrier(CLK_LOCAL_MEM_FENCE);\n";
+        if (p.hi >= 4) emitStages(o, p, true, 4, p.hi, wg);
+        o << store;
+        break;
+    }
+    o << "}\n";
+}
+
+} // namespace
+
+std::vector<GenPass> GenPlan::passes() const {
+    using Op = GenPass::Op;
+    std::vector<GenPass> out;
+    if (empty()) return out;
+    for (const LocalPass& m : middle)        out.push_back({ Op::Forward, m.hi, m.lo, m.cols });
+    for (const LocalPass& m : inverseMiddle) out.push_back({ Op::Inverse, m.hi, m.lo, m.cols });
+    for (Op op : { Op::Forward, Op::Inverse, Op::Square, Op::Mul })
+        out.push_back({ op, tail, 1, 1 });
+    return out;
+}
+
+GenPlan planGenerated(cl_uint n, cl_uint tile, cl_uint wg) {
+    GenPlan plan;
+    if (wg == 0 || tile < 4 * wg) return plan;
+
+    // stage names only: no kernel is touched
+    const std::vector<NttStage> fwd = buildForwardPipeline(n, nullptr, nullptr,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+        nullptr, nullptr, nullptr, nullptr, false);
+    const cl_uint hi = forwardTop(fwd, true);
+    if (hi < 4) return plan;
+    const std::vector<NttStage> inv = buildInversePipeline(n, nullptr, nullptr,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+        nullptr, nullptr, nullptr, nullptr, nullptr, fwd.back().outputInverse, nullptr, false);
+    // the first forward stage may run two strides where the last inverse one runs one
+    const cl_uint inverseHi = inverseTop(inv, false);
+    if (inverseHi < 4) return plan;
+
+    cl_uint tail = 4;
+    while (4 * tail <= std::min(hi, inverseHi) && 16 * tail <= tile) tail *= 4;
+    if (4 * tail < wg || n % (4 * tail) != 0) return plan;
+
+    auto passes = [&](cl_uint top, std::vector<LocalPass>& out) {
+        if (top < 4 * tail) return true;
+        out = planLocalPasses(top, 4 * tail, tile);
+        for (const LocalPass& p : out) {
+            const cl_uint size = p.cols * (4 * (p.hi / p.lo));
+            if (size < wg || size > tile || n % size != 0) return false;
+        }
+        return true;
+    };
+    if (!passes(hi, plan.middle) || !passes(inverseHi, plan.inverseMiddle)) return GenPlan{};
+    plan.hi = hi;
+    plan.inverseHi = inverseHi;
+    plan.tail = tail;
+    plan.wg = wg;
+    return plan;
+}
+
+std::string generatedName(const GenPass& p) {
+    switch (p.op) {
+    case GenPass::Op::Forward: return "gen_ntt_radix4_" + std::to_string(p.hi) + "_" + std::to_string(p.lo);
+    case GenPass::Op::Inverse: return "gen_inverse_ntt_radix4_" + std::to_string(p.hi) + "_" + std::to_string(p.lo);
+    case GenPass::Op::Square:  return "gen_ntt_radix4_square_" + std::to_string(p.hi);
+    case GenPass::Op::Mul:     return "gen_ntt_radix4_mul_" + std::to_string(p.hi);
+    }
+    return {};
+}
+
+std::string generatedSource(const GenPlan& plan) {
+    if (plan.empty()) return {};
+    std::ostringstream o;
+    o << kPreamble;
+    for (const GenPass& p : plan.passes()) emitPass(o, p, plan.wg);
+    return o.str();
+}
+
+bool useGeneratedStages(std::vector<NttStage>& v, GenPipeline which, const GenPlan& plan,
+                        Kernels& kernels, cl_mem buf_w, cl_mem buf_wi,
+                        const size_t* wg, bool debug)
+{
+    using Op = GenPass::Op;
+    if (plan.empty()) return false;
+    cl_uint top = 0;
+    switch (which) {
+    case GenPipeline::Forward:       top = forwardTop(v, true);  break;
+    case GenPipeline::ForwardSimple: top = forwardTop(v, false); break;
+    case GenPipeline::Inverse:       top = inverseTop(v, false); break;
+    case GenPipeline::InverseSimple: top = inverseTop(v, true);  break;
+    }
+    const bool inverse = (which == GenPipeline::Inverse || which == GenPipeline::InverseSimple);
+    if (top != (inverse ? plan.inverseHi : plan.hi)) return false;
+
+    const cl_mem unbound = nullptr;
+    auto stage = [&](const GenPass& p) {
+        const std::string name = generatedName(p);
+        NttStage s;
+        try {
+            s.kernel = kernels.getKernel(name);
+        } catch (const std::runtime_error&) {
+            kernels.createKernel(name);
+            s.kernel = kernels.getKernel(name);
+        }
+        s.args = { { sizeof(cl_mem), toBytes(unbound), true } };
+        if (p.op != Op::Inverse) s.args.push_back({ sizeof(cl_mem), toBytes(buf_w), false });
+        if (p.op != Op::Forward) s.args.push_back({ sizeof(cl_mem), toBytes(buf_wi), false });
+        s.globalScale = static_cast<int>(passSize(p) / *wg);
+        s.localSize = wg;
+        s.name = name + "(m=" + std::to_string(p.hi) + ".." + std::to_string(p.lo) + ")";
+        s.outputInverse = 0;
+        return s;
+    };
+
+    std::vector<NttStage> repl;
+    if (which == GenPipeline::InverseSimple) repl.push_back(stage({ Op::Inverse, plan.tail, 1, 1 }));
+    if (!inverse) {
+        for (const LocalPass& m : plan.middle) repl.push_back(stage({ Op::Forward, m.hi, m.lo, m.cols }));
+        repl.push_back(stage({ which == GenPipeline::Forward ? Op::Square : Op::Forward, plan.tail, 1, 1 }));
+        repl.back().outputInverse = v.back().outputInverse;
+        v.erase(v.begin() + 1, v.end());
+        v.insert(v.end(), repl.begin(), repl.end());
+    } else {
+        for (auto m = plan.inverseMiddle.rbegin(); m != plan.inverseMiddle.rend(); ++m)
+            repl.push_back(stage({ Op::Inverse, m->hi, m->lo, m->cols }));
+        v.erase(v.begin(), v.end() - 1);
+        v.insert(v.begin(), repl.begin(), repl.end());
+    }
+    if (debug)
+        for (const NttStage& s : repl) std::cout << s.name << " (generated)" << std::endl;
+    return true;
+}
+
+} // namespace opencl
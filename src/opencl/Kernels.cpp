@@ -42,6 +42,47 @@ void Kernels::createKernel(const std::string& name) {
     kernels_[name] = kernel;
 }
 
+void Kernels::createEngineKernels() {
+    static const char* const names[] = {
+        "kernel_sub2",
+        "kernel_sub1",
+        "kernel_carry",
+        "kernel_carry_2",
+        "kernel_inverse_ntt_radix4_mm",
+        "kernel_ntt_radix4_last_m1_n4",
+        "kernel_ntt_radix4_last_m1_n4_nosquare",
+        "kernel_inverse_ntt_radix4_mm_last",
+        "kernel_ntt_radix4_last_m1",
+        "kernel_ntt_radix4_last_m1_nosquare",
+        "kernel_ntt_radix4_mm_first",
+        "kernel_ntt_radix4_mm_m8",
+        "kernel_ntt_radix4_mm_m4",
+        "kernel_ntt_radix4_mm_m2",
+        "kernel_ntt_radix4_mm_m16",
+        "kernel_ntt_radix4_mm_m32",
+        "kernel_inverse_ntt_radix4_m1",
+        "kernel_inverse_ntt_radix4_m1_n4",
+        "kernel_ntt_radix4_inverse_mm_2steps",
+        "kernel_ntt_radix4_inverse_mm_2steps_last",
+        "kernel_ntt_radix4_mm_2steps",
+        "kernel_ntt_radix4_mm_2steps_first",
+        "kernel_ntt_radix2_square_radix2",
+        "kernel_ntt_radix4_radix2_square_radix2_radix4",
+        "kernel_ntt_radix4_square_radix4",
+        "kernel_pointwise_mul",
+        "kernel_pointwise_add_mul",
+        "kernel_add",
+        "kernel_sub_mod",
+        "kernel_pack_bits",
+        "kernel_ntt_radix2",
+        "kernel_res64_display",
+        "kernel_ntt_radix5_mm_first",
+        "kernel_ntt_inverse_radix5_mm_last",
+        "check_equal"
+    };
+    for (const char* name : names) createKernel(name);
+}
+
 cl_kernel Kernels::getKernel(const std::string& name) const {
     auto it = kernels_.find(name);
     if (it == kernels_.end()) {
@@ -74,6 +115,14 @@ void Kernels::runSub1(cl_mem buf) {
     //clFinish(queue_);
 }
 
+void Kernels::runRes64Display(cl_mem buf, cl_mem out) {
+    cl_kernel k = getKernel("kernel_res64_display");
+    clSetKernelArg(k, 0, sizeof(buf), &buf);
+    clSetKernelArg(k, 1, sizeof(out), &out);
+    size_t global = 1, local = 1;
+    clEnqueueNDRangeKernel(queue_, k, 1, nullptr, &global, &local, 0, nullptr, nullptr);
+}
+
 void Kernels::runCheckEqual(cl_mem a, cl_mem b,
                             cl_mem outOk,
                             cl_uint n, size_t wg)
@@ -1,10 +1,13 @@
 #include "opencl/NttEngine.hpp"
 #include "opencl/Buffers.hpp"
 #include "opencl/Kernels.hpp"
+#include "opencl/KernelGen.hpp"
+#include "math/Mod64.hpp"
 #include "util/OpenCLError.hpp"
 #include "math/Carry.hpp"
 #include <iostream>
 #include <algorithm>
+#include <bit>
 #ifndef CL_TARGET_OPENCL_VERSION
 #define CL_TARGET_OPENCL_VERSION 300
 #endif
@@ -67,6 +70,45 @@ NttEngine::NttEngine(const Context& ctx,
             ls5,
             debug
         );
+
+        // m = 4 stage + square stage as a single launch, the transpose
+        // between them through sub-group shuffles
+        const size_t nf = forward_pipeline.size();
+        if (ctx_.hasSubgroupShuffle() && nf >= 2
+            && forward_pipeline[nf - 2].name == "kernel_ntt_radix4_mm_m4(m=4)"
+            && forward_pipeline[nf - 1].name.rfind("kernel_ntt_radix4_square_radix4(", 0) == 0) {
+            size_t ls = std::min<size_t>({ size_t(n / 4), ctx_.getMaxWorkGroupSize(), 256 });
+            while (ls & (ls - 1)) ls &= ls - 1;
+            cl_kernel k = nullptr;
+            try {
+                kernels_.createKernel("kernel_ntt_radix4_mm_m4_square_sg");
+                k = kernels_.getKernel("kernel_ntt_radix4_mm_m4_square_sg");
+            } catch (const std::runtime_error&) {
+                std::cerr << "Warning: kernel_ntt_radix4_mm_m4_square_sg unavailable, using two stages" << std::endl;
+            }
+#ifdef CL_VERSION_2_1
+            size_t sg = 0;
+            if (k && clGetKernelSubGroupInfo(k, ctx_.getDevice(), CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE,
+                                             sizeof(ls), &ls, sizeof(sg), &sg, nullptr) == CL_SUCCESS
+                && sg % 4 != 0)
+                k = nullptr;
+#endif
+            if (k && ls >= 4) {
+                sgLs_ = ls;
+                const cl_mem unbound = nullptr;
+                NttStage s;
+                s.kernel = k;
+                s.args = { { sizeof(cl_mem), toBytes(unbound), true },
+                           { sizeof(cl_mem), toBytes(buf_w4), false } };
+                s.globalScale = 4;
+                s.localSize = &sgLs_;
+                s.name = "kernel_ntt_radix4_mm_m4_square_sg(m=1)";
+                s.outputInverse = forward_pipeline.back().outputInverse;
+                forward_pipeline.pop_back();
+                forward_pipeline.back() = s;
+                if (debug) std::cout << s.name << " (sub-group shuffles)" << std::endl;
+            }
+        }
     }
     
     {
@@ -187,6 +229,281 @@ NttEngine::NttEngine(const Context& ctx,
             );
         }
     //}
+
+    genWg_ = ctx_.getGenWorkGroup();
+    if (ctx_.getGenTile() != 0) useGenerated(debug);
+
+    localStagesWg_ = ctx_.getLocalStagesWorkGroup();
+    if (ctx_.getLocalStagesTile() != 0) {
+        kernels_.createKernel("kernel_ntt_radix4_local_stages");
+        kernels_.createKernel("kernel_inverse_ntt_radix4_local_stages");
+        cl_kernel kf = kernels_.getKernel("kernel_ntt_radix4_local_stages");
+        cl_kernel ki = kernels_.getKernel("kernel_inverse_ntt_radix4_local_stages");
+        const cl_uint tile = static_cast<cl_uint>(ctx_.getLocalStagesTile());
+        bool any = false;
+        any |= useLocalStages(forward_pipeline, false, n, kf, buffers_.twiddle4Buf, tile, &localStagesWg_, debug);
+        any |= useLocalStages(inverse_pipeline, true, n, ki, buffers_.invTwiddle4Buf, tile, &localStagesWg_, debug);
+        any |= useLocalStages(forward_simple_pipeline, false, n, kf, buffers_.twiddle4Buf, tile, &localStagesWg_);
+        any |= useLocalStages(inverse_simple_pipeline, true, n, ki, buffers_.invTwiddle4Buf, tile, &localStagesWg_);
+        if (!any)
+            std::cerr << "Warning: -fourstep has no middle stages to regroup for N=" << n << std::endl;
+        else if (debug)
+            std::cout << "Four-step middle passes: tile " << tile << ", local size " << localStagesWg_ << std::endl;
+    }
+
+    coalescedWg_ = ctx_.getCoalescedWorkGroup();
+    if (ctx_.getCoalescedTile() != 0) {
+        kernels_.createKernel("kernel_ntt_radix4_tiled");
+        kernels_.createKernel("kernel_inverse_ntt_radix4_tiled");
+        cl_kernel kf = kernels_.getKernel("kernel_ntt_radix4_tiled");
+        cl_kernel ki = kernels_.getKernel("kernel_inverse_ntt_radix4_tiled");
+        bool any = false;
+        any |= useTiledStages(forward_pipeline, false, kf, buffers_.twiddle4Buf, &coalescedWg_, debug);
+        any |= useTiledStages(inverse_pipeline, true, ki, buffers_.invTwiddle4Buf, &coalescedWg_, debug);
+        any |= useTiledStages(forward_simple_pipeline, false, kf, buffers_.twiddle4Buf, &coalescedWg_);
+        any |= useTiledStages(inverse_simple_pipeline, true, ki, buffers_.invTwiddle4Buf, &coalescedWg_);
+        if (!any && debug)
+            std::cout << "Coalesced tiles: no stage of stride 2 to 8 for N=" << n << std::endl;
+        else if (debug)
+            std::cout << "Coalesced tiles of " << ctx_.getCoalescedTile() << ", local size " << coalescedWg_ << std::endl;
+    }
+
+    fusedSquareLs_ = ctx_.getFusedSquareLocalSize();
+    if (fusedSquareLs_ != 0) {
+        kernels_.createKernel("kernel_ntt_fused_square");
+        fusedSquare_ = kernels_.getKernel("kernel_ntt_fused_square");
+        cl_int err = CL_SUCCESS;
+        err |= clSetKernelArg(fusedSquare_, 1, sizeof(cl_mem), &buffers_.twiddle4Buf);
+        err |= clSetKernelArg(fusedSquare_, 2, sizeof(cl_mem), &buffers_.invTwiddle4Buf);
+        err |= clSetKernelArg(fusedSquare_, 3, sizeof(cl_mem), &buffers_.digitWeightBuf);
+        err |= clSetKernelArg(fusedSquare_, 4, sizeof(cl_mem), &buffers_.digitInvWeightBuf);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Warning: fused squaring kernel disabled (" << err << ")" << std::endl;
+            fusedSquare_ = nullptr;
+        } else if (debug) {
+            std::cout << "Fused squaring kernel: local size " << fusedSquareLs_ << std::endl;
+        }
+    }
+    if (fusedSquare_) {
+        kernels_.createKernel("kernel_ntt_fused_mul");
+        fusedMul_ = kernels_.getKernel("kernel_ntt_fused_mul");
+        cl_int err = CL_SUCCESS;
+        err |= clSetKernelArg(fusedMul_, 3, sizeof(cl_mem), &buffers_.twiddle4Buf);
+        err |= clSetKernelArg(fusedMul_, 4, sizeof(cl_mem), &buffers_.invTwiddle4Buf);
+        err |= clSetKernelArg(fusedMul_, 5, sizeof(cl_mem), &buffers_.digitWeightBuf);
+        err |= clSetKernelArg(fusedMul_, 6, sizeof(cl_mem), &buffers_.digitInvWeightBuf);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Warning: fused multiply kernel disabled (" << err << ")" << std::endl;
+            fusedMul_ = nullptr;
+        }
+    }
+
+    // Products of the simple pipelines: the last forward stage and the first
+    // inverse one both work on blocks of 4 (or 2) at m = 1, so the pointwise
+    // product can sit between them in registers.
+    if (!lastMulFirst_ && !forward_simple_pipeline.empty() && !inverse_simple_pipeline.empty()) {
+        const std::string& last  = forward_simple_pipeline.back().name;
+        const std::string& first = inverse_simple_pipeline.front().name;
+        if (last.rfind("kernel_ntt_radix4_last_m1_nosquare(", 0) == 0
+            && first.rfind("kernel_inverse_ntt_radix4_m1(", 0) == 0) {
+            kernels_.createKernel("kernel_ntt_radix4_mul_radix4");
+            lastMulFirst_      = kernels_.getKernel("kernel_ntt_radix4_mul_radix4");
+            lastSquareFirst_   = kernels_.getKernel("kernel_ntt_radix4_square_radix4");
+            lastMulFirstScale_ = 4;
+            lastMulFirstName_    = "kernel_ntt_radix4_mul_radix4";
+            lastSquareFirstName_ = "kernel_ntt_radix4_square_radix4";
+        } else if (last.rfind("kernel_ntt_radix2(", 0) == 0
+                   && first.rfind("kernel_ntt_radix2(", 0) == 0) {
+            kernels_.createKernel("kernel_ntt_radix2_mul_radix2");
+            lastMulFirst_      = kernels_.getKernel("kernel_ntt_radix2_mul_radix2");
+            lastSquareFirst_   = kernels_.getKernel("kernel_ntt_radix2_square_radix2");
+            lastMulFirstScale_ = 2;
+            lastMulFirstName_    = "kernel_ntt_radix2_mul_radix2";
+            lastSquareFirstName_ = "kernel_ntt_radix2_square_radix2";
+        }
+        if (lastMulFirst_ && debug)
+            std::cout << "Products fused between " << last << " and " << first << std::endl;
+    }
+
+    // Squaring path with the first carry pass folded into the last inverse
+    // stage: same stages, the final 2-step kernel also writes the block
+    // carries (args x, wi, diw, m -> x, wi, diw, carries, mask, m).
+    if (!fusedSquare_ && ctx_.canFuseInverseCarry() && !inverse_pipeline.empty()
+        && inverse_pipeline.back().name.rfind("kernel_ntt_radix4_inverse_mm_2steps_last(", 0) == 0) {
+        kernels_.createKernel("kernel_ntt_radix4_inverse_mm_2steps_last_carry");
+        inverse_carry_pipeline = inverse_pipeline;
+        NttStage& last = inverse_carry_pipeline.back();
+        last.kernel = kernels_.getKernel("kernel_ntt_radix4_inverse_mm_2steps_last_carry");
+        last.name.replace(0, last.name.find('('), "kernel_ntt_radix4_inverse_mm_2steps_last_carry");
+        last.args.insert(last.args.begin() + 3,
+            { sizeof(cl_mem), toBytes(buffers_.blockCarryBuf), false });
+        if (debug) std::cout << last.name << " (carry fused)" << std::endl;
+    }
+}
+
+bool NttEngine::useGenerated(bool debug) {
+    const cl_uint n = pre_.getN();
+    const GenPlan plan = planGenerated(n, static_cast<cl_uint>(ctx_.getGenTile()), static_cast<cl_uint>(genWg_));
+    if (plan.empty()) {
+        std::cerr << "Warning: -genkernels has no plan for N=" << n << ", using the built-in kernels" << std::endl;
+        return false;
+    }
+    const std::vector<NttStage> f0 = forward_pipeline, i0 = inverse_pipeline;
+    const std::vector<NttStage> fs0 = forward_simple_pipeline, is0 = inverse_simple_pipeline;
+    auto restore = [&] {
+        forward_pipeline = f0;
+        inverse_pipeline = i0;
+        forward_simple_pipeline = fs0;
+        inverse_simple_pipeline = is0;
+    };
+    cl_mem w = buffers_.twiddle4Buf, wi = buffers_.invTwiddle4Buf;
+    bool square = false, simple = false;
+    cl_kernel mul = nullptr, sq = nullptr;
+    try {
+        square = useGeneratedStages(forward_pipeline, GenPipeline::Forward, plan, kernels_, w, wi, &genWg_, debug)
+              && useGeneratedStages(inverse_pipeline, GenPipeline::Inverse, plan, kernels_, w, wi, &genWg_, debug);
+        if (!square) {
+            forward_pipeline = f0;
+            inverse_pipeline = i0;
+        }
+        simple = useGeneratedStages(forward_simple_pipeline, GenPipeline::ForwardSimple, plan, kernels_, w, wi, &genWg_)
+              && useGeneratedStages(inverse_simple_pipeline, GenPipeline::InverseSimple, plan, kernels_, w, wi, &genWg_);
+        if (!simple) {
+            forward_simple_pipeline = fs0;
+            inverse_simple_pipeline = is0;
+        } else {
+            const std::string mulName = generatedName({ GenPass::Op::Mul, plan.tail, 1, 1 });
+            const std::string sqName  = generatedName({ GenPass::Op::Square, plan.tail, 1, 1 });
+            auto kernel = [&](const std::string& name) {
+                try {
+                    return kernels_.getKernel(name);
+                } catch (const std::runtime_error&) {
+                    kernels_.createKernel(name);
+                    return kernels_.getKernel(name);
+                }
+            };
+            mul = kernel(mulName);
+            sq  = kernel(sqName);
+            cl_int err = CL_SUCCESS;
+            err |= clSetKernelArg(mul, 2, sizeof(cl_mem), &w);
+            err |= clSetKernelArg(mul, 3, sizeof(cl_mem), &wi);
+            err |= clSetKernelArg(sq, 1, sizeof(cl_mem), &w);
+            err |= clSetKernelArg(sq, 2, sizeof(cl_mem), &wi);
+            if (err != CL_SUCCESS) throw std::runtime_error("cannot set the generated product arguments");
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Warning: generated kernels unavailable (" << e.what() << "), using the built-in ones" << std::endl;
+        restore();
+        return false;
+    }
+    if (!square && !simple) {
+        std::cerr << "Warning: -genkernels does not fit the pipelines of N=" << n << std::endl;
+        return false;
+    }
+    if (!sameAsBuiltIn(f0, i0, fs0, is0, square, simple, mul)) {
+        std::cerr << "Warning: the generated kernels do not match the built-in ones for N=" << n
+                  << ", using the built-in kernels" << std::endl;
+        restore();
+        return false;
+    }
+    if (simple) {
+        lastMulFirst_      = mul;
+        lastSquareFirst_   = sq;
+        lastMulFirstScale_ = static_cast<int>(4 * plan.tail / genWg_);
+        lastMulFirstName_    = generatedName({ GenPass::Op::Mul, plan.tail, 1, 1 });
+        lastSquareFirstName_ = generatedName({ GenPass::Op::Square, plan.tail, 1, 1 });
+    }
+    generated_ = true;
+    if (debug)
+        std::cout << "Generated passes: tile " << ctx_.getGenTile() << ", local size " << genWg_
+                  << ", tail of " << 4 * plan.tail << (square ? "" : ", products only")
+                  << (simple ? "" : ", squaring only") << std::endl;
+    return true;
+}
+
+// Same inputs through the built-in and the generated stages: the squaring
+// path, forward_simple, inverse_simple and the fused product. Values are
+// compared mod p, LAZY_REDUCTION leaving them below 2^64 only.
+bool NttEngine::sameAsBuiltIn(const std::vector<NttStage>& fwd, const std::vector<NttStage>& inv,
+                              const std::vector<NttStage>& fwdSimple, const std::vector<NttStage>& invSimple,
+                              bool square, bool simple, cl_kernel mul)
+{
+    const cl_uint n = pre_.getN();
+    const size_t bytes = size_t(n) * sizeof(uint64_t);
+    std::vector<uint64_t> x(n), y(n), ra(n), rb(n);
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (auto* v : { &x, &y })
+        for (auto& e : *v) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            e = seed % MOD_P;
+        }
+
+    cl_int err = CL_SUCCESS;
+    cl_mem buf[3] = {};
+    for (auto& b : buf) {
+        b = clCreateBuffer(ctx_.getContext(), CL_MEM_READ_WRITE, bytes, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            for (auto& c : buf) if (c) clReleaseMemObject(c);
+            std::cerr << "Warning: no scratch buffers to check the generated kernels" << std::endl;
+            return false;
+        }
+    }
+    cl_mem a = buf[0], b = buf[1], c = buf[2];
+    auto put = [&](cl_mem m, const std::vector<uint64_t>& h) {
+        err |= clEnqueueWriteBuffer(queue_, m, CL_TRUE, 0, bytes, h.data(), 0, nullptr, nullptr);
+    };
+    auto run = [&](std::vector<NttStage> stages, cl_mem m, size_t skipFirst = 0, size_t skipLast = 0) {
+        for (size_t i = skipFirst; i + skipLast < stages.size(); ++i) {
+            setStageArgs2(stages[i], m);
+            const size_t workers = n / static_cast<size_t>(stages[i].globalScale);
+            err |= clEnqueueNDRangeKernel(queue_, stages[i].kernel, 1, nullptr, &workers,
+                                          stages[i].localSize, 0, nullptr, nullptr);
+        }
+    };
+    auto same = [&](cl_mem p, cl_mem q) {
+        err |= clEnqueueReadBuffer(queue_, p, CL_TRUE, 0, bytes, ra.data(), 0, nullptr, nullptr);
+        err |= clEnqueueReadBuffer(queue_, q, CL_TRUE, 0, bytes, rb.data(), 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) return false;
+        for (size_t i = 0; i < n; ++i)
+            if (ra[i] % MOD_P != rb[i] % MOD_P) return false;
+        return true;
+    };
+
+    bool ok = true;
+    if (square) {
+        put(a, x); put(b, x);
+        run(fwd, a); run(inv, a);
+        run(forward_pipeline, b); run(inverse_pipeline, b);
+        ok = same(a, b);
+    }
+    if (ok && simple) {
+        // c = built-in transform of y, b = generated one
+        put(c, y); put(b, y);
+        run(fwdSimple, c);
+        run(forward_simple_pipeline, b);
+        ok = same(b, c);
+        if (ok) {
+            put(a, x); put(b, x);
+            run(invSimple, a);
+            run(inverse_simple_pipeline, b);
+            ok = same(a, b);
+        }
+        if (ok) {
+            put(a, x); put(b, x);
+            run(fwdSimple, a);
+            pointwiseMul(a, c);
+            run(invSimple, a);
+            run(forward_simple_pipeline, b, 0, 1);
+            err |= clSetKernelArg(mul, 0, sizeof(cl_mem), &b);
+            err |= clSetKernelArg(mul, 1, sizeof(cl_mem), &c);
+            const size_t workers = n / static_cast<size_t>(forward_simple_pipeline.back().globalScale);
+            err |= clEnqueueNDRangeKernel(queue_, mul, 1, nullptr, &workers, &genWg_, 0, nullptr, nullptr);
+            run(inverse_simple_pipeline, b, 1, 0);
+            ok = same(a, b);
+        }
+    }
+    for (auto& m : buf) clReleaseMemObject(m);
+    return ok && err == CL_SUCCESS;
 }
 
 static void executeKernelAndDisplay(cl_command_queue queue,
@@ -195,7 +512,7 @@ static void executeKernelAndDisplay(cl_command_queue queue,
                                     size_t workers,
                                     const size_t* localSize,
                                     const std::string& kernelName,
-                                    bool profiling,
+                                    Profiler* profiler,
                                     bool debug,
                                     cl_uint n)
 {
@@ -229,9 +546,13 @@ static void executeKernelAndDisplay(cl_command_queue queue,
 
     //const size_t* actualLocalSize = (localSize && localSize[0] != 0) ? localSize : nullptr;
 
+    cl_event evt = nullptr;
     cl_int err = clEnqueueNDRangeKernel(
         queue, kernel, 1, nullptr, &workers, localSize,
-        0, nullptr, nullptr);
+        0, nullptr, profiler ? &evt : nullptr);
+    // each stage reads and writes the n words of buf_x once
+    if (profiler && err == CL_SUCCESS)
+        profiler->record(kernelName, evt, 2 * size_t(n) * sizeof(uint64_t));
     //std::cerr << "Kernel " << kernelName << " Actual actualLocalSize=" << actualLocalSize << " nullptr = " << nullptr << std::endl;
 
     if (err != CL_SUCCESS) {
@@ -263,7 +584,83 @@ static void executeKernelAndDisplay(cl_command_queue queue,
     }
 }
 
+NttEngine::~NttEngine() {
+    squaring_.reset();
+    for (auto& b : bound_) releaseBound(b);
+}
+
+void NttEngine::releaseBound(BoundPipelines& b) {
+    for (auto* v : { &b.forward, &b.inverse, &b.forwardSimple, &b.inverseSimple, &b.inverseCarry })
+        for (auto& st : *v)
+            if (st.kernel) clReleaseKernel(st.kernel);
+}
+
+const NttEngine::BoundPipelines* NttEngine::findBound(cl_mem buf_x) const {
+    for (const auto& b : bound_)
+        if (b.buf == buf_x) return &b;
+    return nullptr;
+}
+
+bool NttEngine::bind(cl_mem buf_x) {
+    if (buf_x == nullptr) return false;
+    if (findBound(buf_x)) return true;
+
+    BoundPipelines b;
+    b.buf = buf_x;
+    const std::pair<const std::vector<NttStage>*, std::vector<NttStage>*> todo[] = {
+        { &forward_pipeline,        &b.forward },
+        { &inverse_pipeline,        &b.inverse },
+        { &forward_simple_pipeline, &b.forwardSimple },
+        { &inverse_simple_pipeline, &b.inverseSimple },
+        { &inverse_carry_pipeline,  &b.inverseCarry },
+    };
+    for (auto& [src, dst] : todo) {
+        dst->reserve(src->size());
+        for (const auto& st : *src) {
+            NttStage armed;
+            if (!bindStage(st, buf_x, armed)) {
+                std::cerr << "Warning: cannot bind NTT stage " << st.name
+                          << ", keeping per-call arguments" << std::endl;
+                releaseBound(b);
+                return false;
+            }
+            dst->push_back(std::move(armed));
+        }
+    }
+    bound_.push_back(std::move(b));
+    return true;
+}
+
+void NttEngine::unbind(cl_mem buf_x) {
+    for (auto it = bound_.begin(); it != bound_.end(); ++it) {
+        if (it->buf == buf_x) {
+            releaseBound(*it);
+            bound_.erase(it);
+            return;
+        }
+    }
+}
+
+int NttEngine::runBound(const std::vector<NttStage>& stages, cl_mem buf_x) {
+    cl_uint n = pre_.getN();
+    for (const auto& stage : stages) {
+        executeKernelAndDisplay(
+            queue_,
+            stage.kernel,
+            buf_x,
+            n / static_cast<size_t>(stage.globalScale),
+            stage.localSize,
+            stage.name,
+            ctx_.getProfiler(),
+            true,
+            n
+        );
+    }
+    return static_cast<int>(stages.size());
+}
+
 int NttEngine::forward(cl_mem buf_x, uint64_t /*iter*/) {
+    if (auto* b = findBound(buf_x)) return runBound(b->forward, buf_x);
     cl_uint n = pre_.getN();
     int executed = 0;
     for (auto& stage : forward_pipeline) {
@@ -281,7 +678,7 @@ int NttEngine::forward(cl_mem buf_x, uint64_t /*iter*/) {
             workers,
             stage.localSize,
             stage.name,
-            false,
+            ctx_.getProfiler(),
             true,
             n
         );
@@ -292,6 +689,7 @@ int NttEngine::forward(cl_mem buf_x, uint64_t /*iter*/) {
 
 
 int NttEngine::forward_simple(cl_mem buf_x, uint64_t /*iter*/) {
+    if (auto* b = findBound(buf_x)) return runBound(b->forwardSimple, buf_x);
     cl_uint n = pre_.getN();
     int executed = 0;
     for (auto& stage : forward_simple_pipeline) {
@@ -309,7 +707,7 @@ int NttEngine::forward_simple(cl_mem buf_x, uint64_t /*iter*/) {
             workers,
             stage.localSize,
             stage.name,
-            false,
+            ctx_.getProfiler(),
             true,
             n
         );
@@ -320,6 +718,7 @@ int NttEngine::forward_simple(cl_mem buf_x, uint64_t /*iter*/) {
 
 
 int NttEngine::inverse(cl_mem buf_x, uint64_t /*iter*/) {
+    if (auto* b = findBound(buf_x)) return runBound(b->inverse, buf_x);
     cl_uint n = pre_.getN();
     
     int executed = 0;
@@ -338,7 +737,7 @@ int NttEngine::inverse(cl_mem buf_x, uint64_t /*iter*/) {
             workers,
             stage.localSize,
             stage.name,
-            false,
+            ctx_.getProfiler(),
             true,
             n
         );
@@ -348,6 +747,7 @@ int NttEngine::inverse(cl_mem buf_x, uint64_t /*iter*/) {
 }
 
 int NttEngine::inverse_simple(cl_mem buf_x, uint64_t /*iter*/) {
+    if (auto* b = findBound(buf_x)) return runBound(b->inverseSimple, buf_x);
     cl_uint n = pre_.getN();
     
     int executed = 0;
@@ -366,7 +766,7 @@ int NttEngine::inverse_simple(cl_mem buf_x, uint64_t /*iter*/) {
             workers,
             stage.localSize,
             stage.name,
-            false,
+            ctx_.getProfiler(),
             true,
             n
         );
@@ -376,6 +776,90 @@ int NttEngine::inverse_simple(cl_mem buf_x, uint64_t /*iter*/) {
 }
 
 
+int NttEngine::inverseCarry(cl_mem buf_x) {
+    if (auto* b = findBound(buf_x)) return runBound(b->inverseCarry, buf_x);
+    cl_uint n = pre_.getN();
+    for (auto& stage : inverse_carry_pipeline) {
+        setStageArgs2(stage, buf_x);
+        executeKernelAndDisplay(
+            queue_,
+            stage.kernel,
+            buf_x,
+            n / static_cast<size_t>(stage.globalScale),
+            stage.localSize,
+            stage.name,
+            ctx_.getProfiler(),
+            true,
+            n
+        );
+    }
+    return static_cast<int>(inverse_carry_pipeline.size());
+}
+
+bool NttEngine::recordSquaring(cl_mem buf_x, math::Carry& carry) {
+    squaring_.reset();
+    squaringBuf_ = nullptr;
+    // a single fused launch gains nothing from a replay
+    if (fusedSquare_) return false;
+    // a replay has no per-stage events to time
+    if (ctx_.getProfiler()) return false;
+
+    auto cb = std::make_unique<CommandBuffer>(ctx_);
+    if (!cb->valid()) return false;
+
+    const size_t n = pre_.getN();
+    const bool carryFused = !inverse_carry_pipeline.empty();
+    if (auto* b = findBound(buf_x)) {
+        for (auto* pipeline : { &b->forward, carryFused ? &b->inverseCarry : &b->inverse })
+            for (const auto& stage : *pipeline)
+                if (!cb->ndrange(stage.kernel, n / static_cast<size_t>(stage.globalScale), stage.localSize))
+                    return false;
+    } else {
+        for (auto& stage : forward_pipeline) {
+            setStageArgs(stage, buf_x);
+            if (!cb->ndrange(stage.kernel, n / static_cast<size_t>(stage.globalScale), stage.localSize))
+                return false;
+        }
+        for (auto& stage : carryFused ? inverse_carry_pipeline : inverse_pipeline) {
+            if (carryFused) setStageArgs2(stage, buf_x);
+            else            setStageArgs(stage, buf_x);
+            if (!cb->ndrange(stage.kernel, n / static_cast<size_t>(stage.globalScale), stage.localSize))
+                return false;
+        }
+    }
+    if (!carry.recordCarryGPU(*cb, buf_x, buffers_.blockCarryBuf, carryFused) || !cb->finalize())
+        return false;
+
+    squaring_    = std::move(cb);
+    squaringBuf_ = buf_x;
+    return true;
+}
+
+int NttEngine::squareIteration(cl_mem buf_x, math::Carry& carry, uint64_t iter) {
+    if (fusedSquare_) {
+        clSetKernelArg(fusedSquare_, 0, sizeof(cl_mem), &buf_x);
+        executeKernelAndDisplay(queue_, fusedSquare_, buf_x, fusedSquareLs_, &fusedSquareLs_,
+                                "kernel_ntt_fused_square", ctx_.getProfiler(), false, pre_.getN());
+        return 1;
+    }
+    if (squaring_ && buf_x == squaringBuf_) {
+        if (squaring_->enqueue())
+            return static_cast<int>(squaring_->size());
+        // driver refused the replay: drop it for good and take the plain path
+        squaring_.reset();
+        squaringBuf_ = nullptr;
+    }
+    int queued = forward(buf_x, iter);
+    if (!inverse_carry_pipeline.empty()) {
+        queued += inverseCarry(buf_x);
+        carry.carryFixupGPU(buf_x, buffers_.blockCarryBuf);
+        return queued + 1;
+    }
+    queued += inverse(buf_x, iter);
+    carry.carryGPU(buf_x, buffers_.blockCarryBuf, pre_.getN() * sizeof(uint64_t));
+    return queued + 2;
+}
+
 int NttEngine::pointwiseMul(cl_mem a, cl_mem b)
 {
     cl_kernel k = kernels_.getKernel("kernel_pointwise_mul");
@@ -391,12 +875,62 @@ int NttEngine::pointwiseMul(cl_mem a, cl_mem b)
         n,
         ls0,
         "kernel_pointwise_mul",
-        false,
+        ctx_.getProfiler(),
         false,
         n);
     return 1;
 }
 
+int NttEngine::pointwiseAddMul(cl_mem a, cl_mem b, cl_mem c)
+{
+    cl_kernel k = kernels_.getKernel("kernel_pointwise_add_mul");
+    clSetKernelArg(k, 0, sizeof(cl_mem), &a);
+    clSetKernelArg(k, 1, sizeof(cl_mem), &b);
+    clSetKernelArg(k, 2, sizeof(cl_mem), &c);
+    size_t n = pre_.getN();
+    size_t ls0_val = ctx_.getLocalSize();
+    executeKernelAndDisplay(queue_, k, a, n, &ls0_val, "kernel_pointwise_add_mul", ctx_.getProfiler(), false, n);
+    return 1;
+}
+
+int NttEngine::mulTransformed(cl_mem a, cl_mem bHat)
+{
+    if (!lastMulFirst_) {
+        int queued = forward_simple(a, 0);
+        queued += pointwiseMul(a, bHat ? bHat : a);
+        return queued + inverse_simple(a, 0);
+    }
+    const cl_uint n = pre_.getN();
+    int executed = 0;
+    auto run = [&](NttStage& stage) {
+        setStageArgs2(stage, a);
+        executeKernelAndDisplay(queue_, stage.kernel, a, n / static_cast<size_t>(stage.globalScale),
+                                stage.localSize, stage.name, ctx_.getProfiler(), true, n);
+        ++executed;
+    };
+    auto runBoundStage = [&](const NttStage& stage) {
+        executeKernelAndDisplay(queue_, stage.kernel, a, n / static_cast<size_t>(stage.globalScale),
+                                stage.localSize, stage.name, ctx_.getProfiler(), true, n);
+        ++executed;
+    };
+    const BoundPipelines* b = findBound(a);
+    if (b) std::for_each(b->forwardSimple.begin(), b->forwardSimple.end() - 1, runBoundStage);
+    else   std::for_each(forward_simple_pipeline.begin(), forward_simple_pipeline.end() - 1, run);
+
+    cl_kernel k = bHat ? lastMulFirst_ : lastSquareFirst_;
+    clSetKernelArg(k, 0, sizeof(cl_mem), &a);
+    if (bHat) clSetKernelArg(k, 1, sizeof(cl_mem), &bHat);
+    executeKernelAndDisplay(queue_, k, a, n / static_cast<size_t>(lastMulFirstScale_),
+                            forward_simple_pipeline.back().localSize,
+                            bHat ? lastMulFirstName_ : lastSquareFirstName_,
+                            ctx_.getProfiler(), true, n);
+    ++executed;
+
+    if (b) std::for_each(b->inverseSimple.begin() + 1, b->inverseSimple.end(), runBoundStage);
+    else   std::for_each(inverse_simple_pipeline.begin() + 1, inverse_simple_pipeline.end(), run);
+    return executed;
+}
+
 void NttEngine::squareInPlace(cl_mem A, math::Carry& carry, size_t limbBytes) {
     cl_int err;
     
@@ -411,9 +945,7 @@ void NttEngine::squareInPlace(cl_mem A, math::Carry& carry, size_t limbBytes) {
                         0, 0, limbBytes,
                         0, nullptr, nullptr);
     
-    forward_simple(tmpA, 0);
-    pointwiseMul(tmpA, tmpA);
-    inverse_simple(tmpA, 0);
+    mulTransformed(tmpA, nullptr);
     carry.carryGPU(tmpA, buffers_.blockCarryBuf, limbBytes);
     
     clEnqueueCopyBuffer(queue_, tmpA, A,
@@ -423,10 +955,44 @@ void NttEngine::squareInPlace(cl_mem A, math::Carry& carry, size_t limbBytes) {
     clReleaseMemObject(tmpA);
 }
 
+int NttEngine::mulAccumulate(cl_mem acc, cl_mem x, cl_mem scratch, math::Carry& carry) {
+    if (fusedMul_) {
+        clSetKernelArg(fusedMul_, 0, sizeof(cl_mem), &acc);
+        clSetKernelArg(fusedMul_, 1, sizeof(cl_mem), &x);
+        clSetKernelArg(fusedMul_, 2, sizeof(cl_mem), &scratch);
+        executeKernelAndDisplay(queue_, fusedMul_, acc, fusedSquareLs_, &fusedSquareLs_,
+                                "kernel_ntt_fused_mul", ctx_.getProfiler(), false, pre_.getN());
+        return 1;
+    }
+    const size_t limbBytes = pre_.getN() * sizeof(uint64_t);
+    copy(x, scratch, limbBytes);
+    int queued = 1;
+    queued += forward_simple(scratch, 0);
+    queued += mulTransformed(acc, scratch);
+    carry.carryGPU(acc, buffers_.blockCarryBuf, limbBytes);
+    return queued + 2;
+}
+
 void NttEngine::copy(cl_mem src, cl_mem dst, size_t bytes) {
     clEnqueueCopyBuffer(queue_, src, dst, 0, 0, bytes, 0, nullptr, nullptr);
 }
 
+cl_mem NttEngine::pretransform(cl_mem src, size_t limbBytes) {
+    cl_int err;
+    cl_mem hat = clCreateBuffer(ctx_.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to create pretransformed operand buffer");
+    }
+    copy(src, hat, limbBytes);
+    forward_simple(hat, 0);
+    return hat;
+}
+
+void NttEngine::mulByTransformed(cl_mem A, cl_mem Bhat, math::Carry& carry, size_t limbBytes) {
+    mulTransformed(A, Bhat);
+    carry.carryGPU(A, buffers_.blockCarryBuf, limbBytes);
+}
+
 void NttEngine::mulInPlace(cl_mem A, cl_mem B, math::Carry& carry, size_t limbBytes) {
     copy(A, buffers_.input, limbBytes);
     cl_int err;
@@ -441,18 +1007,14 @@ void NttEngine::mulInPlace(cl_mem A, cl_mem B, math::Carry& carry, size_t limbBy
     copy(buffers_.input, temp, limbBytes);
    
     copy(B, buffers_.input, limbBytes);
-    forward_simple(buffers_.input, 0);
-    pointwiseMul(buffers_.input, temp);
-    inverse_simple(buffers_.input, 0);
+    mulTransformed(buffers_.input, temp);
     carry.carryGPU(buffers_.input, buffers_.blockCarryBuf, limbBytes);
     copy(buffers_.input, A, limbBytes);
     clReleaseMemObject(temp);
 }
 
 void NttEngine::mulInPlace2(cl_mem A, cl_mem B, math::Carry& carry, size_t limbBytes) {
-    forward_simple(buffers_.input, 0);
-    pointwiseMul(buffers_.input, B);
-    inverse_simple(buffers_.input, 0);
+    mulTransformed(buffers_.input, B);
     carry.carryGPU(buffers_.input, buffers_.blockCarryBuf, limbBytes);
 }
 
@@ -470,9 +1032,7 @@ void NttEngine::mulInPlace3(cl_mem A, cl_mem B, math::Carry& carry, size_t limbB
     copy(A, temp, limbBytes);
    
     copy(B, buffers_.input, limbBytes);
-    forward_simple(buffers_.input, 0);
-    pointwiseMul(buffers_.input, temp);
-    inverse_simple(buffers_.input, 0);
+    mulTransformed(buffers_.input, temp);
     carry.carryGPU(buffers_.input, buffers_.blockCarryBuf, limbBytes);
     copy(buffers_.input, A, limbBytes);
     clReleaseMemObject(temp);
@@ -502,10 +1062,8 @@ void NttEngine::mulInPlace5(cl_mem A, cl_mem B, math::Carry& carry, size_t limbB
                         0, 0, limbBytes,
                         0, nullptr, nullptr);
 
-    forward_simple(tmpA, 0);
     forward_simple(tmpB, 0);
-    pointwiseMul(tmpA, tmpB);
-    inverse_simple(tmpA, 0);
+    mulTransformed(tmpA, tmpB);
     carry.carryGPU(tmpA, buffers_.blockCarryBuf, limbBytes);
 
     clEnqueueCopyBuffer(queue_, tmpA, A,
@@ -535,54 +1093,93 @@ void NttEngine::powInPlace(cl_mem result, cl_mem base, uint64_t exp, math::Carry
         return;
     }
     
-    // For binary exponentiation, we need to preserve the base value
-    // Create temporary buffers for safe computation
-    cl_int err;
-    
-    cl_mem base_copy_buf = clCreateBuffer(ctx_.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
-    if (err != CL_SUCCESS) {
-        throw std::runtime_error("Failed to create base copy buffer");
+    // Left-to-right sliding window: the odd powers base^1, base^3, ...,
+    // base^(2m-1) are transformed once, and each window of up to w bits
+    // ending with a set bit costs one NTT pair instead of one per set bit.
+    // The table is sized from the exponent, within an eighth of the VRAM.
+    const int l = std::bit_width(exp);
+    cl_ulong memSize = 0;
+    clGetDeviceInfo(ctx_.getDevice(), CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(memSize), &memSize, nullptr);
+    const size_t maxTable = static_cast<size_t>(std::min<cl_ulong>(16, memSize / (8 * limbBytes)));
+    int w = 1;
+    for (int v = 2; v <= 5 && (size_t(1) << (v - 1)) <= maxTable; ++v) {
+        if (l / (v + 1) + (1 << (v - 1)) < l / (w + 1) + (1 << (w - 1))) w = v;
     }
-    
+    const size_t m = size_t(1) << (w - 1);
+
+    cl_int err;
     cl_mem accumulator_buf = clCreateBuffer(ctx_.getContext(), CL_MEM_READ_WRITE, limbBytes, nullptr, &err);
     if (err != CL_SUCCESS) {
-        clReleaseMemObject(base_copy_buf);
         throw std::runtime_error("Failed to create accumulator buffer");
     }
-    
-    // Copy base to temporary buffer to preserve it
-    copy(base, base_copy_buf, limbBytes);
-    
-    // Initialize accumulator with 1
-    size_t numWords = limbBytes / sizeof(uint64_t);
-    std::vector<uint64_t> one_data(numWords, 0);
-    one_data[0] = 1;
-    clEnqueueWriteBuffer(queue_, accumulator_buf, CL_TRUE, 0, limbBytes, one_data.data(), 0, nullptr, nullptr);
-    
-    // Binary exponentiation: result = base^exp mod (2^E - 1)
-    while (exp > 0) {
-        if (exp & 1) {
-            // accumulator = accumulator * base_copy mod (2^E - 1)
-            mulInPlace5(accumulator_buf, base_copy_buf, carry, limbBytes);
+    std::vector<cl_mem> odd;  // odd[k] = transformed base^(2k+1)
+    cl_mem square_hat = nullptr;
+    auto release = [&]() {
+        for (cl_mem hat : odd) clReleaseMemObject(hat);
+        if (square_hat) clReleaseMemObject(square_hat);
+        clReleaseMemObject(accumulator_buf);
+    };
+    try {
+        odd.push_back(pretransform(base, limbBytes));
+        if (m > 1) {
+            copy(base, accumulator_buf, limbBytes);
+            mulTransformed(accumulator_buf, nullptr);
+            carry.carryGPU(accumulator_buf, buffers_.blockCarryBuf, limbBytes);
+            square_hat = pretransform(accumulator_buf, limbBytes);
+            copy(base, accumulator_buf, limbBytes);
+            for (size_t k = 1; k < m; ++k) {
+                mulByTransformed(accumulator_buf, square_hat, carry, limbBytes);
+                odd.push_back(pretransform(accumulator_buf, limbBytes));
+            }
         }
-        
-        exp >>= 1;
-        if (exp > 0) {
-            // base_copy = base_copy * base_copy mod (2^E - 1)
-            squareInPlace(base_copy_buf, carry, limbBytes);
+    } catch (...) {
+        release();
+        throw;
+    }
+
+    // the top bit is base itself
+    copy(base, accumulator_buf, limbBytes);
+    for (int i = l - 2; i >= 0; ) {
+        if (((exp >> i) & 1) == 0) {
+            mulTransformed(accumulator_buf, nullptr);
+            carry.carryGPU(accumulator_buf, buffers_.blockCarryBuf, limbBytes);
+            --i;
+            continue;
+        }
+        int j = std::max(i - w + 1, 0);
+        while (((exp >> j) & 1) == 0) ++j;
+        for (int k = i; k >= j; --k) {
+            mulTransformed(accumulator_buf, nullptr);
+            carry.carryGPU(accumulator_buf, buffers_.blockCarryBuf, limbBytes);
         }
+        mulByTransformed(accumulator_buf, odd[((exp >> j) & ((uint64_t(2) << (i - j)) - 1)) >> 1], carry, limbBytes);
+        i = j - 1;
     }
-    
-    // Copy final result to result buffer
+
     copy(accumulator_buf, result, limbBytes);
-    
-    // Clean up temporary buffers
-    clReleaseMemObject(base_copy_buf);
-    clReleaseMemObject(accumulator_buf);
+    release();
 }
 
 void NttEngine::subOne(cl_mem buf) {
     kernels_.runSub1(buf);
 }
 
+void NttEngine::add(cl_mem a, cl_mem b) {
+    cl_kernel k = kernels_.getKernel("kernel_add");
+    clSetKernelArg(k, 0, sizeof(cl_mem), &a);
+    clSetKernelArg(k, 1, sizeof(cl_mem), &b);
+    size_t n = pre_.getN();
+    size_t ls0_val = ctx_.getLocalSize();
+    executeKernelAndDisplay(queue_, k, a, n, &ls0_val, "kernel_add", ctx_.getProfiler(), false, n);
+}
+
+void NttEngine::subMod(cl_mem a, cl_mem b) {
+    cl_kernel k = kernels_.getKernel("kernel_sub_mod");
+    clSetKernelArg(k, 0, sizeof(cl_mem), &a);
+    clSetKernelArg(k, 1, sizeof(cl_mem), &b);
+    size_t n = pre_.getN();
+    size_t ls0_val = ctx_.getLocalSize();
+    executeKernelAndDisplay(queue_, k, a, n, &ls0_val, "kernel_sub_mod", ctx_.getProfiler(), false, n);
+}
+
 } // namespace opencl
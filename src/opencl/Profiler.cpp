@@ -0,0 +1,154 @@
+// opencl/Profiler.cpp
+#include "opencl/Profiler.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
+namespace opencl {
+
+namespace {
+
+constexpr std::size_t kFoldBatch  = 256;
+constexpr std::size_t kMaxPending = 8192;
+
+bool isComplete(cl_event evt) {
+    cl_int status = CL_QUEUED;
+    if (clGetEventInfo(evt, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr) != CL_SUCCESS)
+        return true;    // let fold() drop it
+    return status <= CL_COMPLETE;
+}
+
+} // namespace
+
+Profiler::~Profiler() {
+    for (auto& p : pending_) clReleaseEvent(p.evt);
+}
+
+void Profiler::record(const std::string& name, cl_event evt, std::size_t bytes) {
+    if (evt == nullptr) return;
+    if (util::Trace::enabled() && !util::Trace::gpuCalibrated()) calibrateTrace(evt);
+    auto it = stats_.try_emplace(name).first;
+    pending_.push_back({ &it->first, &it->second, evt, bytes });
+    if (pending_.size() % kFoldBatch == 0) collect(false);
+    // the device is far behind: wait rather than hold events forever
+    while (pending_.size() > kMaxPending) {
+        clWaitForEvents(1, &pending_.front().evt);
+        fold(pending_.front());
+        pending_.pop_front();
+    }
+}
+
+void Profiler::collect(bool wait) {
+    if (wait && !pending_.empty()) {
+        std::vector<cl_event> evts;
+        evts.reserve(pending_.size());
+        for (auto& p : pending_) evts.push_back(p.evt);
+        clWaitForEvents(static_cast<cl_uint>(evts.size()), evts.data());
+    }
+    // the queue is in order, so the completed launches are at the front
+    while (!pending_.empty() && (wait || isComplete(pending_.front().evt))) {
+        fold(pending_.front());
+        pending_.pop_front();
+    }
+}
+
+void Profiler::fold(const Pending& p) {
+    cl_ulong start = 0, end = 0;
+    const bool ok = clGetEventProfilingInfo(p.evt, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) == CL_SUCCESS
+                 && clGetEventProfilingInfo(p.evt, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) == CL_SUCCESS;
+    clReleaseEvent(p.evt);
+    if (!ok || end < start) return;
+    util::Trace::gpu(*p.name, start, end);
+
+    Stats& s = *p.stats;
+    const double ns = static_cast<double>(end - start);
+    s.bins[binOf(ns)]++;
+    s.minNs = (s.count == 0) ? ns : std::min(s.minNs, ns);
+    s.maxNs = std::max(s.maxNs, ns);
+    s.totalNs += ns;
+    s.bytes = p.bytes;
+    s.count++;
+}
+
+void Profiler::calibrateTrace(cl_event evt) {
+    cl_command_queue queue = nullptr;
+    if (clGetEventInfo(evt, CL_EVENT_COMMAND_QUEUE, sizeof(queue), &queue, nullptr) != CL_SUCCESS || !queue)
+        return;
+    // the host wakes up a few us after the marker ends: close enough for a timeline
+    cl_event marker = nullptr;
+    if (clEnqueueMarkerWithWaitList(queue, 0, nullptr, &marker) != CL_SUCCESS) return;
+    cl_ulong end = 0;
+    if (clWaitForEvents(1, &marker) == CL_SUCCESS
+        && clGetEventProfilingInfo(marker, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) == CL_SUCCESS)
+        util::Trace::setGpuOffset(static_cast<int64_t>(util::Trace::nowNs()) - static_cast<int64_t>(end));
+    clReleaseEvent(marker);
+}
+
+int Profiler::binOf(double ns) {
+    if (ns <= 1.0) return 0;
+    const int b = static_cast<int>(std::log2(ns) * kBinsPerOctave);
+    return std::min(b, kBins - 1);
+}
+
+double Profiler::percentile(const Stats& s, double q) {
+    const uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(s.count)));
+    uint64_t seen = 0;
+    for (int b = 0; b < kBins; ++b) {
+        seen += s.bins[b];
+        if (seen >= rank && s.bins[b] != 0) {
+            // geometric centre of the bin, clamped to what was observed
+            const double ns = std::exp2((b + 0.5) / kBinsPerOctave);
+            return std::clamp(ns, s.minNs, s.maxNs);
+        }
+    }
+    return s.maxNs;
+}
+
+std::vector<Profiler::Summary> Profiler::summary() {
+    collect(true);
+
+    std::vector<Summary> rows;
+    for (const auto& [name, s] : stats_) {
+        if (s.count == 0) continue;
+        rows.push_back({ name, s.count, percentile(s, 0.50), percentile(s, 0.99), s.totalNs, s.bytes });
+    }
+    std::sort(rows.begin(), rows.end(),
+              [](const Summary& a, const Summary& b) { return a.totalNs > b.totalNs; });
+    return rows;
+}
+
+void Profiler::reset() {
+    collect(true);
+    stats_.clear();
+}
+
+void Profiler::report(std::ostream& os, const std::string& when) {
+    const auto rows = summary();
+    if (rows.empty()) return;
+    double total = 0.0;
+    for (const auto& r : rows) total += r.totalNs;
+
+    const auto flags = os.flags();
+    const auto prec  = os.precision();
+    os << "\nKernel profile " << when << "\n"
+       << std::left << std::setw(64) << "  kernel" << std::right
+       << std::setw(12) << "calls" << std::setw(8) << "time%"
+       << std::setw(11) << "p50 us" << std::setw(11) << "p99 us" << std::setw(9) << "GB/s" << "\n";
+    os << std::fixed;
+    for (const auto& r : rows) {
+        os << "  " << std::left << std::setw(62) << r.name << std::right
+           << std::setw(12) << r.count
+           << std::setw(8)  << std::setprecision(1) << 100.0 * r.totalNs / total
+           << std::setw(11) << std::setprecision(2) << r.p50Ns * 1e-3
+           << std::setw(11) << r.p99Ns * 1e-3
+           << std::setw(9)  << std::setprecision(1) << (r.p50Ns > 0.0 ? r.bytes / r.p50Ns : 0.0)
+           << "\n";
+    }
+    os.flags(flags);
+    os.precision(prec);
+    os << std::flush;
+}
+
+} // namespace opencl
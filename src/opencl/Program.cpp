@@ -36,6 +36,8 @@
 
 #include "opencl/Program.hpp"
 #include "opencl/Context.hpp"
+#include "opencl/ProgramCache.hpp"
+#include "opencl/KernelGen.hpp"
 #include <fstream>
 #include <sstream>
 #include <vector>
@@ -48,22 +50,22 @@ namespace opencl {
 
 Program::Program(const opencl::Context& context, cl_device_id device,
                  const std::string& filePath,const math::Precompute& pre,
-                 const std::string& buildOptions, bool debug
+                 const std::string& buildOptions, bool debug,
+                 const std::string& cacheDir
                  )
     : program_(nullptr),
     context_(context)
     
 {
     std::string source = loadKernelSource(filePath);
+    // the generated passes are part of the source, so of the cache key
+    if (context.getGenTile() != 0)
+        source += generatedSource(planGenerated(context.getTransformSize(),
+                                                static_cast<cl_uint>(context.getGenTile()),
+                                                static_cast<cl_uint>(context.getGenWorkGroup())));
     const char* src = source.c_str();
     size_t length = source.size();
 
-    cl_int err;
-    program_ = clCreateProgramWithSource(context.getContext(), 1, &src, &length, &err);
-    if (err != CL_SUCCESS) {
-        throw std::runtime_error("Failed to create OpenCL program from source.");
-    }
-
     // fetch all of our tuning parameters from Context
     cl_uint n          = context.getTransformSize();
     cl_uint wg         = context.getWorkGroupCount();
@@ -94,8 +96,6 @@ Program::Program(const opencl::Context& context, cl_device_id device,
     std::ostringstream ss;
     ss << buildOptions;
     ss 
-      << " -DDIGIT_WIDTH_VALUE_1=" << pre.getDigitWidthValue1()
-      << " -DDIGIT_WIDTH_VALUE_2=" << pre.getDigitWidthValue2()
       << " -DWG_SIZE="                     << wg
       << " -DLOCAL_PROPAGATION_DEPTH="     << lpd
       << " -DCARRY_WORKER="                << wCarry
@@ -111,6 +111,29 @@ Program::Program(const opencl::Context& context, cl_device_id device,
       << " -DLOCAL_SIZE2="                 << ls2
       << " -DLOCAL_SIZE3="                 << ls3
       << " -DLOCAL_SIZE5="                 << ls5;
+    if (context.getFusedSquareLocalSize() != 0)
+        ss << " -DFUSED_SQUARE_LS=" << context.getFusedSquareLocalSize();
+    if (context.canFuseInverseCarry())
+        ss << " -DINVERSE_LAST_CARRY=1";
+    if (context.getLocalStagesTile() != 0)
+        ss << " -DLOCAL_STAGES_TILE=" << context.getLocalStagesTile()
+           << " -DLOCAL_STAGES_WG=" << context.getLocalStagesWorkGroup();
+    if (context.getCoalescedTile() != 0)
+        ss << " -DCOALESCED_TILE=" << context.getCoalescedTile()
+           << " -DCOALESCED_WG=" << context.getCoalescedWorkGroup();
+    // vendor-specific modMul (PTX carries, AMD 32 x 32 + 64 mads); others keep the portable one
+    std::string vendor = context.getDeviceVendor();
+    std::transform(vendor.begin(), vendor.end(), vendor.begin(), ::tolower);
+    if (vendor.find("nvidia") != std::string::npos)
+        ss << " -DVENDOR_NVIDIA=1";
+    else if (vendor.find("advanced micro devices") != std::string::npos || vendor.find("amd") != std::string::npos)
+        ss << " -DVENDOR_AMD=1";
+    // register transpose in kernel_ntt_radix4_mm_m4_square_sg
+    if (context.hasSubgroupShuffle()) {
+        ss << " -DSUBGROUP_SHUFFLE=1";
+        if (context.hasExtension("cl_intel_subgroups")) ss << " -DINTEL_SUBGROUPS=1";
+        else ss << " -cl-std=CL2.0";
+    }
     size_t idx1 = 1 * 2;
     size_t idx2 = 2 * 2;
     size_t idx3 = 3 * 2;
@@ -180,14 +203,34 @@ Program::Program(const opencl::Context& context, cl_device_id device,
     if(debug)
         std::cout << "Building OpenCL program with options: " << buildOptions2 << std::endl;
 
-    
-    err = clBuildProgram(program_, 1, &device, buildOptions2.c_str(), nullptr, nullptr);
-    if (err != CL_SUCCESS) {
-        checkBuildError(program_, device);
-        throw std::runtime_error("Failed to build OpenCL program.");
+    ProgramCache cache(cacheDir);
+    const std::string cacheKey = cache.enabled() ? cache.makeKey(device, source, buildOptions2) : "";
+    program_ = cache.load(context.getContext(), device, cacheKey, buildOptions2);
+    if (program_) {
+        if(debug)
+            std::cout << "OpenCL program loaded from kernel cache (" << cacheKey << ")" << std::endl;
+    }
+    else if ((program_ = cache.loadIL(context.getContext(), device, source, buildOptions2))) {
+        if(debug)
+            std::cout << "OpenCL program built from SPIR-V" << std::endl;
+        cache.store(program_, cacheKey);
+    }
+    else {
+        cl_int err;
+        program_ = clCreateProgramWithSource(context.getContext(), 1, &src, &length, &err);
+        if (err != CL_SUCCESS) {
+            throw std::runtime_error("Failed to create OpenCL program from source.");
+        }
+        err = clBuildProgram(program_, 1, &device, buildOptions2.c_str(), nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            checkBuildError(program_, device);
+            throw std::runtime_error("Failed to build OpenCL program.");
+        }
+        if(debug)
+            std::cout << "OpenCL program built successfully from: " << filePath << std::endl;
+        cache.store(program_, cacheKey);
+        cache.requestIL(source, buildOptions2);
     }
-    if(debug)
-        std::cout << "OpenCL program built successfully from: " << filePath << std::endl;
     cl_uint numKernels = 0;
     clCreateKernelsInProgram(program_, 0, nullptr, &numKernels);
     std::vector<cl_kernel> kernels(numKernels);
@@ -0,0 +1,202 @@
+// opencl/ProgramCache.cpp
+#include "opencl/ProgramCache.hpp"
+#include "io/Sha3Hash.h"
+#include "util/Crc32.hpp"
+#include "util/Fs.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+namespace opencl {
+
+namespace {
+
+constexpr char     kMagic[8] = {'P','R','M','C','L','B','I','N'};
+constexpr uint32_t kVersion  = 1;
+
+std::string deviceString(cl_device_id device, cl_device_info param) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        return "";
+    std::string s(size, '\0');
+    clGetDeviceInfo(device, param, size, s.data(), nullptr);
+    while (!s.empty() && s.back() == '\0') s.pop_back();
+    return s;
+}
+
+std::string hashKey(const std::string& ident, const std::string& buildOptions,
+                    const std::string& source)
+{
+    io::Sha3Hash h;
+    h.update(ident.data(), static_cast<uint32_t>(ident.size()));
+    h.update(buildOptions.data(), static_cast<uint32_t>(buildOptions.size()));
+    h.update("\n", 1);
+    h.update(source.data(), static_cast<uint32_t>(source.size()));
+    auto d = std::move(h).finish();
+
+    std::ostringstream ss;
+    ss << std::hex << std::setfill('0')
+       << std::setw(16) << d[0] << std::setw(16) << d[1];
+    return ss.str();
+}
+
+} // namespace
+
+ProgramCache::ProgramCache(std::string dir)
+    : dir_(std::move(dir))
+{}
+
+std::string ProgramCache::makeKey(cl_device_id device,
+                                  const std::string& source,
+                                  const std::string& buildOptions) const
+{
+    const std::string ident = deviceString(device, CL_DEVICE_NAME)    + '\n'
+                            + deviceString(device, CL_DEVICE_VENDOR)  + '\n'
+                            + deviceString(device, CL_DEVICE_VERSION) + '\n'
+                            + deviceString(device, CL_DRIVER_VERSION) + '\n';
+
+    return hashKey(ident, buildOptions, source);
+}
+
+std::string ProgramCache::entryPath(const std::string& key) const {
+    return (std::filesystem::path(dir_) / (key + ".clbin")).string();
+}
+
+cl_program ProgramCache::load(cl_context context, cl_device_id device,
+                              const std::string& key,
+                              const std::string& buildOptions) const
+{
+    if (!enabled()) return nullptr;
+
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in) return nullptr;
+
+    char     magic[8];
+    uint32_t version = 0, crc = 0;
+    uint64_t size = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    in.read(reinterpret_cast<char*>(&crc), sizeof(crc));
+    if (!in || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0
+            || version != kVersion || size == 0 || size > (1ull << 30))
+        return nullptr;
+
+    std::vector<unsigned char> bin(size);
+    in.read(reinterpret_cast<char*>(bin.data()), static_cast<std::streamsize>(size));
+    if (!in || computeCRC32(bin.data(), bin.size()) != crc) {
+        std::cerr << "Warning: ignoring corrupt kernel cache entry " << entryPath(key) << std::endl;
+        return nullptr;
+    }
+
+    const unsigned char* bins[1] = { bin.data() };
+    const size_t lengths[1] = { bin.size() };
+    cl_int binStatus = CL_SUCCESS, err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, lengths, bins, &binStatus, &err);
+    if (err != CL_SUCCESS || binStatus != CL_SUCCESS || program == nullptr) {
+        if (program) clReleaseProgram(program);
+        return nullptr;
+    }
+    // Binaries still have to be "built" before kernels can be created.
+    if (clBuildProgram(program, 1, &device, buildOptions.c_str(), nullptr, nullptr) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return nullptr;
+    }
+    return program;
+}
+
+void ProgramCache::store(cl_program program, const std::string& key) const {
+    if (!enabled()) return;
+
+    cl_uint numDevices = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(numDevices), &numDevices, nullptr) != CL_SUCCESS
+        || numDevices != 1)
+        return;
+
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, nullptr) != CL_SUCCESS || size == 0)
+        return;
+    std::vector<unsigned char> bin(size);
+    unsigned char* bins[1] = { bin.data() };
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(bins), bins, nullptr) != CL_SUCCESS)
+        return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    const std::string path = entryPath(key);
+    const uint64_t size64 = size;
+    const uint32_t crc = computeCRC32(bin.data(), bin.size());
+    if (!writeFileDurable(path, {{kMagic, sizeof(kMagic)}, {&kVersion, sizeof(kVersion)},
+                                 {&size64, sizeof(size64)}, {&crc, sizeof(crc)}, {bin.data(), size}}))
+        std::cerr << "Warning: cannot write kernel cache entry " << path << std::endl;
+}
+
+std::string ProgramCache::ilPath(const std::string& source,
+                                 const std::string& buildOptions) const
+{
+    return (std::filesystem::path(dir_) / "spirv" / hashKey("", buildOptions, source)).string();
+}
+
+cl_program ProgramCache::loadIL(cl_context context, cl_device_id device,
+                                const std::string& source,
+                                const std::string& buildOptions) const
+{
+#ifdef CL_VERSION_2_1
+    if (!enabled()) return nullptr;
+    const std::string path = ilPath(source, buildOptions) + ".spv";
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+    // an error on a 1.x device, which has no IL at all
+    if (deviceString(device, CL_DEVICE_IL_VERSION).find("SPIR-V") == std::string::npos)
+        return nullptr;
+
+    const std::vector<char> il((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (il.empty()) return nullptr;
+    cl_int err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithIL(context, il.data(), il.size(), &err);
+    if (err != CL_SUCCESS || program == nullptr) {
+        if (program) clReleaseProgram(program);
+        return nullptr;
+    }
+    if (clBuildProgram(program, 1, &device, buildOptions.c_str(), nullptr, nullptr) != CL_SUCCESS) {
+        std::cerr << "Warning: cannot build SPIR-V " << path << ", building from source" << std::endl;
+        clReleaseProgram(program);
+        return nullptr;
+    }
+    return program;
+#else
+    (void)context; (void)device; (void)source; (void)buildOptions;
+    return nullptr;
+#endif
+}
+
+void ProgramCache::requestIL(const std::string& source, const std::string& buildOptions) const {
+    if (!enabled()) return;
+    std::error_code ec;
+    if (!std::filesystem::is_directory(std::filesystem::path(dir_) / "spirv", ec)) return;
+    const std::string base = ilPath(source, buildOptions);
+    if (std::filesystem::exists(base + ".spv", ec) || std::filesystem::exists(base + ".cl", ec)) return;
+
+    // the options first: `make spirv` takes a .cl once its .opts is there
+    bool ok;
+    {
+        std::ofstream opts(base + ".opts", std::ios::trunc);
+        opts << buildOptions << '\n';
+        ok = bool(opts);
+    }
+    if (ok) {
+        std::ofstream cl(base + ".cl", std::ios::binary | std::ios::trunc);
+        cl << source;
+        ok = bool(cl);
+    }
+    if (!ok)
+        std::cerr << "Warning: cannot write SPIR-V request " << base << ".cl" << std::endl;
+}
+
+} // namespace opencl
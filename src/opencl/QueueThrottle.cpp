@@ -0,0 +1,66 @@
+// opencl/QueueThrottle.cpp
+#include "opencl/QueueThrottle.hpp"
+#include <algorithm>
+
+namespace opencl {
+
+QueueThrottle::QueueThrottle(cl_command_queue queue, std::size_t maxDepth,
+                             double targetLatencyMs, std::size_t initialDepth)
+    : queue_(queue)
+    , depth_(std::clamp<std::size_t>(initialDepth, 1, std::max<std::size_t>(maxDepth, 1)))
+    , maxDepth_(std::max<std::size_t>(maxDepth, 1))
+    , targetMs_(targetLatencyMs)
+{}
+
+QueueThrottle::~QueueThrottle() {
+    for (cl_event e : markers_) clReleaseEvent(e);
+}
+
+void QueueThrottle::tick() {
+    cl_event marker = nullptr;
+    if (clEnqueueMarkerWithWaitList(queue_, 0, nullptr, &marker) != CL_SUCCESS) {
+        // no marker: fall back to a plain sync so the queue stays bounded
+        clFinish(queue_);
+        return;
+    }
+    markers_.push_back(marker);
+    clFlush(queue_);
+    while (markers_.size() > depth_) retireOldest(true);
+}
+
+void QueueThrottle::drain() {
+    while (!markers_.empty()) retireOldest(false);
+}
+
+void QueueThrottle::retireOldest(bool adapt) {
+    cl_event e = markers_.front();
+    markers_.pop_front();
+
+    cl_int status = CL_QUEUED;
+    clGetEventInfo(e, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+    const bool ready = (status == CL_COMPLETE || status < 0);
+    if (!ready) clWaitForEvents(1, &e);
+    clReleaseEvent(e);
+
+    const auto prev = lastRetire_;
+    const auto now = std::chrono::steady_clock::now();
+    const bool waited = !ready && haveRetire_;
+    lastRetire_ = now;
+    haveRetire_ = true;
+    if (!waited) return;
+
+    // the host was blocked, so the gap between retirements is the device
+    // time of one tick; a gap that spans a host-side stall (checkpoint,
+    // Gerbicz-Li check) says nothing about the device and is skipped
+    const double dt = std::chrono::duration<double, std::milli>(now - prev).count();
+    if (tickMs_ > 0.0 && dt > 8.0 * tickMs_) return;
+    tickMs_ = (tickMs_ == 0.0) ? dt : 0.9 * tickMs_ + 0.1 * dt;
+    if (adapt && tickMs_ > 0.0) {
+        const double want = targetMs_ / tickMs_;
+        const std::size_t lo = std::min<std::size_t>(2, maxDepth_);
+        depth_ = (want >= static_cast<double>(maxDepth_)) ? maxDepth_
+               : std::max(lo, static_cast<std::size_t>(want));
+    }
+}
+
+} // namespace opencl
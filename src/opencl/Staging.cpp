@@ -0,0 +1,105 @@
+// opencl/Staging.cpp
+#include "opencl/Staging.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace opencl {
+
+Staging::Staging(cl_command_queue mapQueue, bool unified)
+    : queue_(mapQueue), unified_(unified)
+{}
+
+Staging::~Staging() {
+    release();
+}
+
+void Staging::release() {
+    if (host_) clEnqueueUnmapMemObject(queue_, pinned_, host_, 0, nullptr, nullptr);
+    if (pinned_) {
+        clFinish(queue_);
+        clReleaseMemObject(pinned_);
+    }
+    host_ = nullptr;
+    pinned_ = nullptr;
+    size_ = 0;
+}
+
+std::size_t Staging::reserve(std::size_t bytes) {
+    if (bytes < kMinBytes || failed_) return 0;
+    const std::size_t want = std::min(bytes, kMaxBlock);
+    if (want <= size_) return size_;
+
+    release();
+    cl_context ctx = nullptr;
+    clGetCommandQueueInfo(queue_, CL_QUEUE_CONTEXT, sizeof(ctx), &ctx, nullptr);
+    cl_int err = CL_SUCCESS;
+    pinned_ = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, want, nullptr, &err);
+    if (err == CL_SUCCESS)
+        host_ = clEnqueueMapBuffer(queue_, pinned_, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                   0, want, 0, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Warning: cannot allocate a pinned staging buffer, transfers stay pageable" << std::endl;
+        release();
+        failed_ = true;
+        return 0;
+    }
+    size_ = want;
+    return size_;
+}
+
+bool Staging::mapped(cl_command_queue queue, cl_mem mem, void* host, const void* in,
+                     std::size_t bytes, std::size_t offset)
+{
+    cl_int err = CL_SUCCESS;
+    void* p = clEnqueueMapBuffer(queue, mem, CL_TRUE, in ? CL_MAP_WRITE : CL_MAP_READ,
+                                 offset, bytes, 0, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Warning: cannot map a device buffer on unified memory, transfers are copied" << std::endl;
+        unified_ = false;
+        return false;
+    }
+    if (in) std::memcpy(p, in, bytes);
+    else    std::memcpy(host, p, bytes);
+    cl_event done = nullptr;
+    clEnqueueUnmapMemObject(queue, mem, p, 0, nullptr, in ? &done : nullptr);
+    // the next kernel may run on another queue
+    if (done) {
+        clWaitForEvents(1, &done);
+        clReleaseEvent(done);
+    }
+    return true;
+}
+
+cl_int Staging::read(cl_mem mem, void* host, std::size_t bytes, std::size_t offset, cl_command_queue queue) {
+    if (!queue) queue = queue_;
+    if (unified_ && mapped(queue, mem, host, nullptr, bytes, offset)) return CL_SUCCESS;
+    const std::size_t block = reserve(bytes);
+    if (block == 0) return clEnqueueReadBuffer(queue, mem, CL_TRUE, offset, bytes, host, 0, nullptr, nullptr);
+    char* out = static_cast<char*>(host);
+    for (std::size_t done = 0; done < bytes; done += block) {
+        const std::size_t len = std::min(block, bytes - done);
+        const cl_int err = clEnqueueReadBuffer(queue, mem, CL_TRUE, offset + done, len, host_, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) return err;
+        std::memcpy(out + done, host_, len);
+    }
+    return CL_SUCCESS;
+}
+
+cl_int Staging::write(cl_mem mem, const void* host, std::size_t bytes, std::size_t offset, cl_command_queue queue) {
+    if (!queue) queue = queue_;
+    if (unified_ && mapped(queue, mem, nullptr, host, bytes, offset)) return CL_SUCCESS;
+    const std::size_t block = reserve(bytes);
+    if (block == 0) return clEnqueueWriteBuffer(queue, mem, CL_TRUE, offset, bytes, host, 0, nullptr, nullptr);
+    const char* in = static_cast<const char*>(host);
+    for (std::size_t done = 0; done < bytes; done += block) {
+        const std::size_t len = std::min(block, bytes - done);
+        std::memcpy(host_, in + done, len);
+        // blocking: the block is free again when the call returns
+        const cl_int err = clEnqueueWriteBuffer(queue, mem, CL_TRUE, offset + done, len, host_, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) return err;
+    }
+    return CL_SUCCESS;
+}
+
+} // namespace opencl
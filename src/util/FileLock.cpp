@@ -0,0 +1,34 @@
+#include "util/FileLock.hpp"
+#include <iostream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace util {
+
+#ifndef _WIN32
+FileLock::FileLock(const std::string& file) : path_(file + ".lock") {
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Cannot open " << path_ << "\n";
+    } else if (::flock(fd_, LOCK_EX) != 0) {
+        ::close(fd_);
+        fd_ = -1;
+        std::cerr << "Cannot lock " << path_ << "\n";
+    }
+}
+
+FileLock::~FileLock() {
+    if (fd_ >= 0) {
+        ::flock(fd_, LOCK_UN);
+        ::close(fd_);
+    }
+}
+#else
+FileLock::FileLock(const std::string& file) : path_(file + ".lock"), fd_(0) {}
+FileLock::~FileLock() {}
+#endif
+
+} // namespace util
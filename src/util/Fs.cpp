@@ -20,12 +20,18 @@
  * This code is released as free software. 
  */
 #include "util/Fs.hpp"
+#include <cstdio>
 #include <filesystem>
+#include <functional>
 #include <stdexcept>
+#include <thread>
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
+#include <unistd.h>
 #elif defined(_WIN32)
 #include <windows.h>
+#include <io.h>
+#include <process.h>
 #else
 #include <unistd.h>
 #endif
@@ -56,3 +62,41 @@ std::string getExecutableDir() {
 void markJsonAsSent(const std::string& path) {
     std::filesystem::rename(path, path + ".sent");
 }
+
+// A name of its own for each writer: concurrent runs (-devices children,
+// -batch slots) share the save and cache directories.
+static std::string tempName(const std::string& path) {
+#ifdef _WIN32
+    const long pid = static_cast<long>(::_getpid());
+#else
+    const long pid = static_cast<long>(::getpid());
+#endif
+    return path + ".tmp" + std::to_string(pid) + "_"
+         + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+}
+
+bool writeFileDurable(const std::string& path,
+                      const std::vector<std::pair<const void*, std::size_t>>& parts)
+{
+    const std::string tmp = tempName(path);
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = true;
+    for (const auto& part : parts) {
+        if (part.second && std::fwrite(part.first, 1, part.second, f) != part.second) { ok = false; break; }
+    }
+    ok = ok && std::fflush(f) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = (std::fclose(f) == 0) && ok;
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
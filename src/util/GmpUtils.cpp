@@ -1,4 +1,5 @@
 #include "util/GmpUtils.hpp"
+#include "util/Residue.hpp"
 #include <thread>
 #include <atomic>
 #include <algorithm>
@@ -94,65 +95,35 @@ std::vector<uint32_t> convertFromGMP(const mpz_class& gmp_val) {
   return data;
 }
 
-static inline void add_ui64(mpz_class& x, uint64_t w) {
-#if ULONG_MAX == 0xFFFFFFFFFFFFFFFFULL
-    mpz_add_ui(x.get_mpz_t(), x.get_mpz_t(), static_cast<unsigned long>(w));
-#else
-    mpz_class tmp;
-    mpz_import(tmp.get_mpz_t(), 1, -1, sizeof(uint64_t), 0, 0, &w);
-    x += tmp;
-#endif
-}
-
 mpz_class vectToMpz(const std::vector<uint64_t>& v,
                     const std::vector<int>& widths,
                     const mpz_class& Mp)
 {
-    const size_t n = v.size();
-    const unsigned T = std::max(1u, std::thread::hardware_concurrency());
-    std::vector<mpz_class> partial(T);
-
-    std::vector<unsigned> total_width(T, 0);
-    std::atomic<size_t> global_count{0};
-
-    std::vector<std::thread> threads(T);
-    size_t chunk = (n + T - 1) / T;
-
-    for (unsigned t = 0; t < T; ++t) {
-        size_t start = t * chunk;
-        size_t end = std::min(start + chunk, n);
-        threads[t] = std::thread([&, start, end, t]() {
-            mpz_class acc = 0;
-            for (ptrdiff_t i = ptrdiff_t(end) - 1; i >= ptrdiff_t(start); --i) {
-                acc <<= widths[i];
-                add_ui64(acc, v[i]);
-                if (acc >= Mp) acc -= Mp;
-
-                total_width[t] += widths[i];
-
-                size_t count = ++global_count;
-                if (count % 10000 == 0 || count == n) {
-                    double progress = 100.0 * count / n;
-                    printf("\rProgress: %.2f%%", progress);
-                    fflush(stdout);
-                }
-            }
-            partial[t] = acc;
-        });
-    }
+    // Mp = 2^E - 1: the digits are packed and reduced word by word
+    const uint32_t E = static_cast<uint32_t>(mpz_sizeinbase(Mp.get_mpz_t(), 2));
+    return convertToGMP(packResidue(v, widths, E));
+}
 
-    for (auto& th : threads) th.join();
-    printf("\n");
 
-    mpz_class result = 0;
-    for (int t = T - 1; t >= 0; --t) {
-        result <<= total_width[t];
-        result += partial[t];
-        if (result >= Mp) result -= Mp;
+std::vector<uint64_t> mpzToVect(const mpz_class& x,
+                                const std::vector<int>& widths)
+{
+    std::vector<uint64_t> words(mpz_sizeinbase(x.get_mpz_t(), 2) / 64 + 1, 0);
+    size_t count = 0;
+    mpz_export(words.data(), &count, -1 /*order: LSWord first*/, sizeof(uint64_t), 0, 0, x.get_mpz_t());
+
+    std::vector<uint64_t> v(widths.size(), 0);
+    uint64_t bit = 0;
+    for (size_t i = 0; i < widths.size(); ++i) {
+        const int w = widths[i];
+        const size_t word = static_cast<size_t>(bit >> 6);
+        const unsigned off = static_cast<unsigned>(bit & 63);
+        uint64_t val = word < words.size() ? words[word] >> off : 0;
+        if (off + w > 64 && word + 1 < words.size()) val |= words[word + 1] << (64 - off);
+        v[i] = val & ((1ULL << w) - 1);
+        bit += static_cast<uint64_t>(w);
     }
-
-    return result;
+    return v;
 }
 
-
 }
@@ -0,0 +1,99 @@
+// src/util/HostPool.cpp
+#include "util/HostPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <utility>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace util {
+
+namespace {
+
+struct Pool {
+    std::mutex                          mutex;
+    std::size_t                         limbs = 0;
+    std::vector<std::vector<uint64_t>>  free;
+    std::atomic<std::size_t>            leased{0};      // bytes
+    std::atomic<std::size_t>            pooled{0};      // bytes
+};
+
+// Never destroyed: a lease held by a detached thread may come back while
+// the statics are torn down.
+Pool& pool() {
+    static Pool* p = new Pool;
+    return *p;
+}
+
+} // namespace
+
+void HostPool::Lease::reset() {
+    if (v_.capacity() == 0) return;
+    HostPool::release(std::move(v_));
+    v_ = {};
+}
+
+void HostPool::reserve(std::size_t limbs) {
+    Pool& p = pool();
+    std::vector<std::vector<uint64_t>> drop;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        if (p.limbs == limbs) return;
+        p.limbs = limbs;
+        drop.swap(p.free);
+        p.pooled = 0;
+    }
+}
+
+HostPool::Lease HostPool::acquire(std::size_t limbs, bool clear) {
+    Pool& p = pool();
+    std::vector<uint64_t> v;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        if (limbs == p.limbs && !p.free.empty()) {
+            v = std::move(p.free.back());
+            p.free.pop_back();
+            p.pooled -= v.capacity() * sizeof(uint64_t);
+        }
+    }
+    if (v.size() != limbs) {
+        v.assign(limbs, 0);
+    } else if (clear) {
+        std::fill(v.begin(), v.end(), 0);
+    }
+    p.leased += v.capacity() * sizeof(uint64_t);
+    return Lease(std::move(v));
+}
+
+void HostPool::release(std::vector<uint64_t>&& v) {
+    Pool& p = pool();
+    const std::size_t bytes = v.capacity() * sizeof(uint64_t);
+    p.leased -= bytes;
+    std::lock_guard<std::mutex> lock(p.mutex);
+    if (v.size() == p.limbs && p.free.size() < kMaxFree) {
+        p.free.push_back(std::move(v));
+        p.pooled += bytes;
+    }
+}
+
+std::size_t HostPool::bytes() noexcept {
+    const Pool& p = pool();
+    return p.leased.load(std::memory_order_relaxed) + p.pooled.load(std::memory_order_relaxed);
+}
+
+std::size_t residentBytes() {
+#ifdef __linux__
+    std::ifstream in("/proc/self/statm");
+    std::size_t pages = 0, resident = 0;
+    if (!(in >> pages >> resident)) return 0;
+    const long page = ::sysconf(_SC_PAGESIZE);
+    return page > 0 ? resident * static_cast<std::size_t>(page) : 0;
+#else
+    return 0;
+#endif
+}
+
+} // namespace util
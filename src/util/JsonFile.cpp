@@ -0,0 +1,85 @@
+#include "util/JsonFile.hpp"
+#include "util/FileLock.hpp"
+#include "util/Fs.hpp"
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace util {
+
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+std::optional<std::string> jsonField(const std::string& obj, const std::string& key) {
+    const std::string tag = "\"" + key + "\"";
+    size_t pos = obj.find(tag);
+    if (pos == std::string::npos) return std::nullopt;
+    pos = obj.find(':', pos + tag.size());
+    if (pos == std::string::npos) return std::nullopt;
+    ++pos;
+    while (pos < obj.size() && std::isspace(static_cast<unsigned char>(obj[pos]))) ++pos;
+    if (pos >= obj.size()) return std::nullopt;
+    std::string v;
+    if (obj[pos] == '"') {
+        for (++pos; pos < obj.size() && obj[pos] != '"'; ++pos) {
+            if (obj[pos] == '\\' && pos + 1 < obj.size()) ++pos;
+            v += obj[pos];
+        }
+        return v;
+    }
+    if (obj[pos] == '[') {
+        const size_t end = obj.find(']', pos);
+        if (end == std::string::npos) return std::nullopt;
+        return obj.substr(pos + 1, end - pos - 1);
+    }
+    while (pos < obj.size() && obj[pos] != ',' && obj[pos] != '}'
+           && !std::isspace(static_cast<unsigned char>(obj[pos])))
+        v += obj[pos++];
+    return v;
+}
+
+std::vector<std::string> jsonObjects(const std::string& text) {
+    std::vector<std::string> objects;
+    size_t pos = text.find('[');
+    while (pos != std::string::npos && (pos = text.find('{', pos)) != std::string::npos) {
+        const size_t end = text.find('}', pos);
+        if (end == std::string::npos) break;
+        objects.push_back(text.substr(pos, end - pos + 1));
+        pos = end + 1;
+    }
+    return objects;
+}
+
+std::string readJsonFile(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return {};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+bool updateJsonFile(const std::string& path,
+                    const std::function<std::string(const std::string& current)>& update)
+{
+    // the -batch slots of one process take turns here before the flock
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> guard(mutex);
+
+    std::error_code ec;
+    const auto parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+    FileLock lock(path);
+    if (!lock.held()) return false;
+    const std::string text = update(readJsonFile(path));
+    return writeFileDurable(path, {{text.data(), text.size()}});
+}
+
+} // namespace util
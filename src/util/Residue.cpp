@@ -0,0 +1,122 @@
+#include "util/Residue.hpp"
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace util {
+
+namespace {
+
+// W += c * 2^0 mod 2^E - 1.
+void addWrapped(std::vector<uint32_t>& W, uint64_t c, uint32_t E) {
+    const unsigned top = E % 32;
+    while (c != 0) {
+        size_t i = 0;
+        for (; i < W.size() && c != 0; ++i) {
+            const uint64_t s = uint64_t(W[i]) + (c & 0xFFFFFFFFu);
+            W[i] = uint32_t(s);
+            c = (c >> 32) + (s >> 32);
+        }
+        // bit 32 * W.size() is bit 32 * W.size() - E above bit 0
+        if (top != 0) {
+            c = (c << (32 - top)) + (W.back() >> top);
+            W.back() &= (1u << top) - 1;
+        }
+    }
+}
+
+} // namespace
+
+std::vector<uint32_t> packResidue(const std::vector<uint64_t>& x,
+                                  const std::vector<int>& widths,
+                                  uint32_t E)
+{
+    if (x.size() != widths.size()) throw std::runtime_error("packResidue: digit and width counts differ");
+    std::vector<uint32_t> W((E + 31) / 32, 0u);
+    uint64_t carry = 0, acc = 0;
+    int accBits = 0;
+    size_t o = 0;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+        const int w = widths[i];
+        if (w < 1 || w > 32) throw std::runtime_error("packResidue: digit width out of range");
+        bits += uint64_t(w);
+        // x + carry needs 65 bits
+        const uint64_t s = x[i] + carry;
+        const uint64_t hi = (s < carry) ? 1 : 0;
+        const uint64_t v = s & ((uint64_t(1) << w) - 1);
+        carry = (s >> w) | (hi << (64 - w));
+        acc |= v << accBits;
+        accBits += w;
+        while (accBits >= 32 && o < W.size()) {
+            W[o++] = uint32_t(acc);
+            acc >>= 32;
+            accBits -= 32;
+        }
+    }
+    if (bits != E) throw std::runtime_error("packResidue: digit widths do not add up to the exponent");
+    if (o < W.size()) W[o++] = uint32_t(acc);
+    addWrapped(W, carry, E);
+
+    // 2^E - 1 is 0
+    const unsigned top = E % 32;
+    bool ones = true;
+    for (size_t i = 0; ones && i < W.size(); ++i) {
+        const uint32_t full = (i + 1 == W.size() && top != 0) ? (1u << top) - 1 : 0xFFFFFFFFu;
+        ones = (W[i] == full);
+    }
+    if (ones) std::fill(W.begin(), W.end(), 0u);
+    return W;
+}
+
+uint32_t mod3(const std::vector<uint32_t>& W) {
+    // 2^32 = 1 (mod 3)
+    uint64_t r = 0;
+    for (uint32_t w : W) r += w % 3;
+    return uint32_t(r % 3);
+}
+
+void div3(uint32_t E, std::vector<uint32_t>& W) {
+    uint32_t r = (3 - mod3(W)) % 3;
+    const int topBits = int(E % 32);
+    {
+        const uint64_t t = (uint64_t(r) << topBits) + W.back();
+        W.back() = uint32_t(t / 3);
+        r        = uint32_t(t % 3);
+    }
+    for (auto it = W.rbegin() + 1; it != W.rend(); ++it) {
+        const uint64_t t = (uint64_t(r) << 32) + *it;
+        *it = uint32_t(t / 3);
+        r   = uint32_t(t % 3);
+    }
+}
+
+void div9(uint32_t E, std::vector<uint32_t>& W) {
+    div3(E, W);
+    div3(E, W);
+}
+
+bool isResidue(const std::vector<uint32_t>& W, uint32_t a) {
+    if (W.empty()) return a == 0;
+    if (W[0] != a) return false;
+    for (size_t i = 1; i < W.size(); ++i) {
+        if (W[i] != 0) return false;
+    }
+    return true;
+}
+
+std::string res64Hex(const std::vector<uint32_t>& W) {
+    const uint64_t r64 = (uint64_t(W.size() > 1 ? W[1] : 0) << 32) | (W.empty() ? 0u : W[0]);
+    std::ostringstream oss;
+    oss << std::hex << std::uppercase << std::setw(16) << std::setfill('0') << r64;
+    return oss.str();
+}
+
+std::string res2048Hex(const std::vector<uint32_t>& W) {
+    std::ostringstream oss;
+    oss << std::hex << std::nouppercase << std::setfill('0');
+    for (int i = 63; i >= 0; --i) oss << std::setw(8) << ((i < int(W.size())) ? W[i] : 0u);
+    return oss.str();
+}
+
+} // namespace util
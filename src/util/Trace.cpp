@@ -0,0 +1,132 @@
+// src/util/Trace.cpp
+#include "util/Trace.hpp"
+#include "util/JsonFile.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+
+namespace {
+
+struct Event {
+    std::string name;
+    const char* cat;
+    uint64_t    ts, dur;     // ns on the trace clock
+    uint32_t    pid, tid;
+};
+
+struct State {
+    std::mutex                         mutex;
+    std::string                        path;
+    std::vector<Event>                 ring;
+    std::size_t                        head = 0, size = 0;
+    std::map<std::thread::id, uint32_t> tids;
+    std::chrono::steady_clock::time_point epoch;
+    std::atomic<int64_t>               gpuOffset{0};
+    std::atomic<bool>                  gpuCalibrated{false};
+    std::atomic<bool>                  enabled{false};
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+constexpr uint32_t kHostPid = 1, kGpuPid = 2;
+
+void push(State& s, Event&& e) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (e.pid == kHostPid) {
+        auto it = s.tids.emplace(std::this_thread::get_id(), static_cast<uint32_t>(s.tids.size() + 1)).first;
+        e.tid = it->second;
+    }
+    s.ring[s.head] = std::move(e);
+    s.head = (s.head + 1) % s.ring.size();
+    if (s.size < s.ring.size()) ++s.size;
+}
+
+} // namespace
+
+bool Trace::open(const std::string& path, std::size_t capacity) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    {
+        std::ofstream probe(path, std::ios::trunc);
+        if (!probe) {
+            std::cerr << "Warning: cannot write trace file " << path << ", tracing disabled" << std::endl;
+            return false;
+        }
+    }
+    s.path = path;
+    s.ring.assign(capacity == 0 ? 1 : capacity, Event{});
+    s.head = s.size = 0;
+    s.epoch = std::chrono::steady_clock::now();
+    s.enabled = true;
+    return true;
+}
+
+bool Trace::enabled() noexcept { return state().enabled.load(std::memory_order_relaxed); }
+
+uint64_t Trace::nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - state().epoch).count());
+}
+
+void Trace::host(const char* name, uint64_t beginNs, uint64_t endNs, const char* cat) {
+    if (!enabled()) return;
+    push(state(), { name, cat, beginNs, endNs > beginNs ? endNs - beginNs : 0, kHostPid, 0 });
+}
+
+void Trace::gpu(const std::string& name, uint64_t deviceBeginNs, uint64_t deviceEndNs) {
+    State& s = state();
+    if (!enabled() || !s.gpuCalibrated) return;
+    const int64_t off = s.gpuOffset.load(std::memory_order_relaxed);
+    const int64_t begin = static_cast<int64_t>(deviceBeginNs) + off;
+    if (begin < 0) return;    // queued before open()
+    push(s, { name, "gpu", static_cast<uint64_t>(begin),
+              deviceEndNs > deviceBeginNs ? deviceEndNs - deviceBeginNs : 0, kGpuPid, 1 });
+}
+
+void Trace::setGpuOffset(int64_t offsetNs) {
+    state().gpuOffset = offsetNs;
+    state().gpuCalibrated = true;
+}
+
+bool Trace::gpuCalibrated() noexcept { return state().gpuCalibrated.load(std::memory_order_relaxed); }
+
+bool Trace::write() {
+    State& s = state();
+    if (!enabled()) return false;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::ofstream out(s.path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Warning: cannot write trace file " << s.path << std::endl;
+        return false;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << kHostPid << ",\"args\":{\"name\":\"host\"}},\n"
+        << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << kGpuPid << ",\"args\":{\"name\":\"gpu queue\"}}";
+    out << std::fixed << std::setprecision(3);
+    const std::size_t first = (s.head + s.ring.size() - s.size) % s.ring.size();
+    for (std::size_t i = 0; i < s.size; ++i) {
+        const Event& e = s.ring[(first + i) % s.ring.size()];
+        out << ",\n{\"name\":\"" << jsonEscape(e.name) << "\",\"cat\":\"" << e.cat
+            << "\",\"ph\":\"X\",\"ts\":" << e.ts * 1e-3 << ",\"dur\":" << e.dur * 1e-3
+            << ",\"pid\":" << e.pid << ",\"tid\":" << e.tid << "}";
+    }
+    out << "\n]}\n";
+    if (s.size == s.ring.size())
+        std::cout << "Trace: kept the last " << s.size << " events in " << s.path << std::endl;
+    else
+        std::cout << "Trace: " << s.size << " events written to " << s.path << std::endl;
+    return static_cast<bool>(out);
+}
+
+} // namespace util
@@ -87,6 +87,23 @@ for test in "${pm1_tests[@]}"; do
   $valid && echo "✅"
 done
 
+echo ""
+echo "=== Extended P-1 factoring tests, legacy backend ==="
+for test in "${pm1_tests[@]}"; do
+  IFS=':' read -r args expected <<< "$test"
+  echo -n "Testing ./prmers $args -marin ... "
+  output=$(./prmers $args -marin --noask 2>&1)
+  echo "$output" > "logs/pm1_legacy_${args// /_}.log"
+  IFS='|' read -ra expected_lines <<< "$expected"
+  for expected_line in "${expected_lines[@]}"; do
+    if ! grep -qF "$expected_line" <<< "$output"; then
+      echo "❌ Missing '$expected_line' (see logs/pm1_legacy_${args// /_}.log)"
+      exit 1
+    fi
+  done
+  echo "✅"
+done
+
 
 echo ""
 echo "=== Out-of-range exponent verification ==="
@@ -118,6 +135,49 @@ for p in "${prime_exponents[@]}"; do
     fi
 done
 
+echo ""
+echo "=== Prime exponents, lazy reduction (legacy backend) ==="
+for p in "${prime_exponents[@]}"; do
+    echo -n "Testing M$p -marin -lazyreduce... "
+    ./prmers "$p" --noask -prp -marin -lazyreduce > "logs/ok_lazy_${p}.log" 2>&1
+    if [ $? -ne 0 ]; then
+        echo "❌ Failed (see logs/ok_lazy_${p}.log)"
+        exit 1
+    else
+        echo "✅"
+    fi
+done
+
+echo -n "Testing M100003 -marin -lazyreduce… and check res64"
+output=$(./prmers 100003 --noask -prp -marin -lazyreduce 2>&1)
+echo "$output" > logs/ok_lazy_100003.log
+if echo "$output" | grep -q '"res64":"1CF45E9503C71FD6"'; then
+    echo "✅ M100003 OK"
+else
+    echo "❌ M100003 -lazyreduce: unexpected output (see logs/ok_lazy_100003.log)"
+    exit 1
+fi
+
+echo -n "Testing M100003 -marin -fourstep… and check res64"
+output=$(./prmers 100003 --noask -prp -marin -fourstep 2>&1)
+echo "$output" > logs/ok_fourstep_100003.log
+if echo "$output" | grep -q '"res64":"1CF45E9503C71FD6"'; then
+    echo "✅ M100003 OK"
+else
+    echo "❌ M100003 -fourstep: unexpected output (see logs/ok_fourstep_100003.log)"
+    exit 1
+fi
+
+echo -n "Testing M100003 -cpu… and check res64"
+output=$(./prmers 100003 --noask -prp -cpu 2>&1)
+echo "$output" > logs/ok_cpu_100003.log
+if echo "$output" | grep -q '"res64":"1CF45E9503C71FD6"'; then
+    echo "✅ M100003 OK"
+else
+    echo "❌ M100003 -cpu: unexpected output (see logs/ok_cpu_100003.log)"
+    exit 1
+fi
+
 echo ""
 echo "=== Composite exponents ==="
 for p in "${composite_exponents[@]}"; do
@@ -131,6 +191,58 @@ for p in "${composite_exponents[@]}"; do
     fi
 done
 
+echo ""
+echo "=== Wagstaff PRP tests ==="
+# (2^313 + 1)/3 is a Wagstaff prime, (2^311 + 1)/3 is composite: its res64
+# is 3^(2^311) mod 2^311 + 1 on every engine
+for engine in "" -cpu -marin; do
+    name=${engine:-gpu}
+    echo -n "Testing W313 (prime) ${engine}... "
+    output=$(./prmers 313 -wagstaff --noask $engine 2>&1)
+    status=$?
+    echo "$output" > "logs/wagstaff_313_${name#-}.log"
+    if [ $status -eq 0 ] && echo "$output" | grep -q "Wagstaff PRP confirmed: (2^313+1)/3"; then
+        echo "✅"
+    else
+        echo "❌ unexpected output (see logs/wagstaff_313_${name#-}.log)"
+        exit 1
+    fi
+    echo -n "Testing W311 (composite) ${engine}... "
+    output=$(./prmers 311 -wagstaff --noask $engine 2>&1)
+    status=$?
+    echo "$output" > "logs/wagstaff_311_${name#-}.log"
+    if [ $status -ne 0 ] && echo "$output" | grep -q "Not a Wagstaff PRP, res64 = 8AB67CA9E3A0AD4D"; then
+        echo "✅"
+    else
+        echo "❌ unexpected output (see logs/wagstaff_311_${name#-}.log)"
+        exit 1
+    fi
+done
+
+echo ""
+echo "=== Trial factoring tests ==="
+# 2^67 - 1 = 193707721 * 761838257287 (Cole), 2^127 - 1 is prime
+echo -n "Testing -tfonly M67 to 2^30 (factor 193707721)... "
+output=$(./prmers 67 -tfonly -tf 30 --noask 2>&1)
+echo "$output" > logs/tf_67.log
+if echo "$output" | grep -q "M67 has a factor: 193707721"; then
+    echo "✅"
+else
+    echo "❌ unexpected output (see logs/tf_67.log)"
+    exit 1
+fi
+echo -n "Testing -tfonly M127 to 2^32 (no factor)... "
+output=$(./prmers 127 -tfonly -tf 32 --noask 2>&1)
+status=$?
+echo "$output" > logs/tf_127.log
+if [ $status -eq 0 ] && echo "$output" | grep -q "No factor up to 2^32" \
+   && ! echo "$output" | grep -q "has a factor"; then
+    echo "✅"
+else
+    echo "❌ unexpected output (see logs/tf_127.log)"
+    exit 1
+fi
+
 echo ""
 echo "=== Specific result verification ==="
 
@@ -212,6 +324,14 @@ else
     echo "❌ M541 P-1 factor not found or output mismatch (see logs/pm1_541.log)"
     exit 1
 fi
+output=$(./prmers 541 -pm1 -b1 899 -marin --noask 2>&1)
+echo "$output" > logs/pm1_legacy_541.log
+if echo "$output" | grep -q 'P-1 factor stage 1 found: 4312790327'; then
+    echo "✅ M541 P-1 factor found (legacy backend)"
+else
+    echo "❌ M541 -marin P-1 factor not found or output mismatch (see logs/pm1_legacy_541.log)"
+    exit 1
+fi
 
 echo ""
 echo "=== Mersenne cofactor PRP tests ==="